@@ -157,7 +157,8 @@ void CUPTIAPI CallbackHandler(CUpti_CallbackDomain domain, CUpti_CallbackId call
 }
 
 static void
-SetupCupti()
+SetupCupti(
+    int autoTuneBuffers)
 {
     UserData *pUserData = (UserData *)malloc(sizeof(UserData));
     MEMORY_ALLOCATION_CALL(pUserData);
@@ -165,6 +166,7 @@ SetupCupti()
     memset(pUserData, 0, sizeof(UserData));
     pUserData->pPostProcessActivityRecords = NULL;
     pUserData->printActivityRecords        = 1;
+    pUserData->autoTuneBuffers             = autoTuneBuffers ? 1 : 0;
 
     // Common CUPTI Initialization
     InitCuptiTrace(pUserData, (void *)CallbackHandler, stdout);
@@ -186,8 +188,10 @@ SetupCupti()
 
 void printUsage() {
     std::cout << "Usage: \n"
-              << "  ./activity_trace_async -e [ --enableHwTrace ] <value>\n"
-              << "  Non-zero value to enable, 0 to disable (disabled by default)\n";
+              << "  ./activity_trace_async -e [ --enableHwTrace ] <value> -a [ --autoTuneBuffers ] <value>\n"
+              << "  --enableHwTrace: Non-zero value to enable, 0 to disable (disabled by default)\n"
+              << "  --autoTuneBuffers: Non-zero value to size the activity buffers from the dropped records and\n"
+              << "    buffer completion telemetry and report the decisions at exit, 0 to disable (disabled by default)\n";
 }
 
 int
@@ -199,6 +203,7 @@ main(
     char deviceName[256];
     int deviceId = 0, deviceCount = 0;
     int enableHwTrace = 0;
+    int autoTuneBuffers = 0;
 
     for (int i = 1; i < argc; i++)
     {
@@ -214,6 +219,17 @@ main(
 
             enableHwTrace = std::atoi(argv[++i]);
         }
+        else if (arg == "--autoTuneBuffers" || arg == "-a")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cout << "Missing value for " << arg << " option." << std::endl;
+                printUsage();
+                return 1;
+            }
+
+            autoTuneBuffers = std::atoi(argv[++i]);
+        }
         else
         {
             std::cout << "Unknown option: " << arg << std::endl;
@@ -222,7 +238,7 @@ main(
         }
     }
 
-    SetupCupti();
+    SetupCupti(autoTuneBuffers);
 
     // Enable CUPTI callback on CUDA Initialization Finished if hardware trace is enabled
     if (enableHwTrace)
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Benchmark of the activity record processing path: walking the buffers with
+ * cuptiActivityGetNextRecord(), PrintActivityBuffer() with record printing
+ * and with a post processing callback only, and the streaming correlation
+ * join of helper_cupti_correlation.h.
+ *
+ * The input is a set of completed activity buffers, generated with the mock
+ * CUPTI workload generator (configured with the CUPTI_MOCK_* environment
+ * variables) or read from a fixture, so the same records can be replayed
+ * across commits. A fixture is either an activity trace file (written by
+ * --save-fixture or a flight recorder dump) or an operation trace of the mock
+ * generator (see ReadMockOperationTrace()), replayed until --records records
+ * are generated.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// CUPTI headers
+#include "helper_cupti_activity.h"
+#include "helper_cupti_correlation.h"
+#include "helper_cupti_trace_file.h"
+#include "command_line_parser_util.h"
+
+// Mock CUPTI headers
+#include "mock_workload.h"
+
+#include "benchmark_util.h"
+
+// Macros
+#define ACTIVITY_BUFFER_SIZE (1024 * 1024)
+#define ACTIVITY_DEFAULT_RECORDS 1000000
+
+#define CORRELATION_JOIN_CAPACITY 4096
+#define CORRELATION_MAX_AGE_NS (10ULL * 1000 * 1000 * 1000)
+
+// Data structures
+typedef struct ActivityInput_st
+{
+    std::vector<uint8_t *>    buffers;                               // Completed activity buffers.
+    std::vector<size_t>       validSizes;                            // Valid bytes of every buffer.
+    std::vector<std::string>  names;                                 // Kernel names of the records loaded from a fixture.
+    uint64_t                  numRecords;                            // Records in all the buffers.
+    MockGenerator             generator;                             // Owns the kernel names of the synthetic records.
+    MockOperationTrace        operationTrace;                        // Operations replayed by the generator, empty if none.
+    FILE                      *pNullFile;                            // Output of PrintActivityBuffer().
+    CorrelationJoin           join;
+    uint64_t                  sink;                                  // Keeps the passes from being optimized away.
+} ActivityInput;
+
+// Global variables
+static ActivityInput s_Input;
+
+// Helper Functions
+static uint64_t
+CountBufferRecords(
+    uint8_t *pBuffer,
+    size_t validSize)
+{
+    CUpti_Activity *pRecord = NULL;
+    uint64_t numRecords = 0;
+
+    while (cuptiActivityGetNextRecord(pBuffer, validSize, &pRecord) == CUPTI_SUCCESS)
+    {
+        numRecords++;
+    }
+
+    return numRecords;
+}
+
+static void
+GenerateSyntheticInput(
+    ActivityInput *pInput,
+    uint64_t numRecords)
+{
+    MockWorkload workload;
+
+    GetDefaultMockWorkload(&workload);
+    ReadMockWorkloadFromEnv(&workload);
+    workload.pOperationTrace = pInput->operationTrace.operations.empty() ? NULL : &pInput->operationTrace;
+    InitMockGenerator(&pInput->generator, &workload, 0);
+
+    while (pInput->numRecords < numRecords)
+    {
+        uint8_t *pBuffer = (uint8_t *)malloc(ACTIVITY_BUFFER_SIZE);
+        MEMORY_ALLOCATION_CALL(pBuffer);
+
+        size_t validSize = FillMockActivityBuffer(&pInput->generator, pBuffer, ACTIVITY_BUFFER_SIZE, true);
+        pInput->buffers.push_back(pBuffer);
+        pInput->validSizes.push_back(validSize);
+        pInput->numRecords += CountBufferRecords(pBuffer, validSize);
+    }
+}
+
+static void
+FreeInput(
+    ActivityInput *pInput)
+{
+    for (size_t i = 0; i < pInput->buffers.size(); i++)
+    {
+        free(pInput->buffers[i]);
+    }
+    pInput->buffers.clear();
+    pInput->validSizes.clear();
+}
+
+// Post processing callback of PrintActivityBuffer().
+static void
+CountRecord(
+    CUpti_Activity *pRecord)
+{
+    s_Input.sink += pRecord->kind;
+}
+
+static void
+CountCorrelation(
+    void *pUserData,
+    const CorrelationEntry *pEntry)
+{
+    ((ActivityInput *)pUserData)->sink += pEntry->correlationId;
+}
+
+// Benchmark passes
+static void
+GetNextRecordPass(
+    void *pUserData)
+{
+    ActivityInput *pInput = (ActivityInput *)pUserData;
+
+    for (size_t i = 0; i < pInput->buffers.size(); i++)
+    {
+        CUpti_Activity *pRecord = NULL;
+        while (cuptiActivityGetNextRecord(pInput->buffers[i], pInput->validSizes[i], &pRecord) == CUPTI_SUCCESS)
+        {
+            pInput->sink += pRecord->kind;
+        }
+    }
+}
+
+static void
+PrintActivityBufferPass(
+    void *pUserData)
+{
+    ActivityInput *pInput = (ActivityInput *)pUserData;
+
+    for (size_t i = 0; i < pInput->buffers.size(); i++)
+    {
+        PrintActivityBuffer(pInput->buffers[i], pInput->validSizes[i], pInput->pNullFile, NULL);
+    }
+}
+
+static void
+PostProcessPass(
+    void *pUserData)
+{
+    ActivityInput *pInput = (ActivityInput *)pUserData;
+    UserData userData;
+
+    memset(&userData, 0, sizeof(UserData));
+    userData.printActivityRecords = 0;
+    userData.pPostProcessActivityRecords = CountRecord;
+
+    for (size_t i = 0; i < pInput->buffers.size(); i++)
+    {
+        PrintActivityBuffer(pInput->buffers[i], pInput->validSizes[i], pInput->pNullFile, &userData);
+    }
+}
+
+static void
+CorrelationJoinPass(
+    void *pUserData)
+{
+    ActivityInput *pInput = (ActivityInput *)pUserData;
+
+    for (size_t i = 0; i < pInput->buffers.size(); i++)
+    {
+        CUpti_Activity *pRecord = NULL;
+        while (cuptiActivityGetNextRecord(pInput->buffers[i], pInput->validSizes[i], &pRecord) == CUPTI_SUCCESS)
+        {
+            CorrelationJoinAddRecord(&pInput->join, pRecord);
+        }
+    }
+    CorrelationJoinFlush(&pInput->join);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CommandLineParser parser;
+    BenchmarkReport report;
+
+    parser.addOption<int>("-n", "--records", "Minimum number of generated records, also with an operation trace fixture", ACTIVITY_DEFAULT_RECORDS);
+    parser.addOption<std::string>("-f", "--fixture", "Activity trace file or operation trace to replay instead of synthetic records", "");
+    parser.addOption<std::string>("-s", "--save-fixture", "Write the input to a fixture file", "");
+    parser.addOption<int>("-t", "--min-time", "Minimum run time of every stage in ms", BENCHMARK_DEFAULT_MIN_TIME_MS);
+    parser.addOption<std::string>("-o", "--output", "JSON report file, stdout if not set", "");
+    parser.addOption<std::string>("-l", "--label", "Label stored in the report", "");
+    ParseBenchmarkOptions(&parser, argc, argv);
+
+    std::string fixture = parser.get<std::string>("--fixture");
+    std::string saveFixture = parser.get<std::string>("--save-fixture");
+    uint64_t minTimeMs = (uint64_t)parser.get<int>("--min-time");
+
+    s_Input.numRecords = 0;
+    s_Input.sink = 0;
+    if (!fixture.empty() && IsActivityTraceFile(fixture.c_str()))
+    {
+        if (!ReadActivityTraceFile(fixture.c_str(), &s_Input.buffers, &s_Input.validSizes, &s_Input.names))
+        {
+            std::cerr << "Error: " << fixture << " is not an activity trace file or is truncated.\n";
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < s_Input.buffers.size(); i++)
+        {
+            s_Input.numRecords += CountBufferRecords(s_Input.buffers[i], s_Input.validSizes[i]);
+        }
+    }
+    else
+    {
+        if (!fixture.empty() && !ReadMockOperationTrace(fixture.c_str(), &s_Input.operationTrace))
+        {
+            exit(EXIT_FAILURE);
+        }
+        GenerateSyntheticInput(&s_Input, (uint64_t)parser.get<int>("--records"));
+    }
+
+    if (!saveFixture.empty())
+    {
+        if (!WriteActivityTraceFile(saveFixture.c_str(), s_Input.buffers, s_Input.validSizes))
+        {
+            std::cerr << "Error: Failed to write the fixture " << saveFixture << ".\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    s_Input.pNullFile = fopen("/dev/null", "w");
+    if (!s_Input.pNullFile)
+    {
+        std::cerr << "Error: Failed to open /dev/null.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    report.benchmark = "activity_benchmark";
+    report.label = parser.get<std::string>("--label");
+    report.input = fixture.empty() ? "synthetic" : fixture;
+
+    InitCorrelationJoin(&s_Input.join, CORRELATION_JOIN_CAPACITY, CORRELATION_MAX_AGE_NS, CountCorrelation, CountCorrelation, &s_Input);
+
+    RunBenchmarkStage(&report, "get_next_record", s_Input.numRecords, GetNextRecordPass, &s_Input, minTimeMs);
+    RunBenchmarkStage(&report, "print_activity_buffer", s_Input.numRecords, PrintActivityBufferPass, &s_Input, minTimeMs);
+    RunBenchmarkStage(&report, "post_process_activity_records", s_Input.numRecords, PostProcessPass, &s_Input, minTimeMs);
+    RunBenchmarkStage(&report, "correlation_join", s_Input.numRecords, CorrelationJoinPass, &s_Input, minTimeMs);
+
+    WriteBenchmarkReport(parser.get<std::string>("--output"), &report);
+
+    FreeCorrelationJoin(&s_Input.join);
+    fclose(s_Input.pNullFile);
+    FreeInput(&s_Input);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Shared code of the host-side benchmarks.
+ *
+ * Every benchmark binary runs one or more stages over an input prepared up
+ * front (synthetic records from the mock CUPTI workload generator or a fixture
+ * file). A stage is a function making one pass over the input; it is repeated
+ * until the minimum run time is reached and reported as records/sec,
+ * ns/record, heap allocations per record and the change of the resident set
+ * size over the stage. The peak RSS only ever rises, so it is reported once
+ * for the whole binary.
+ * The report is printed as JSON so the results of two commits can be compared
+ * with compare_benchmarks.py.
+ *
+ * Allocations are counted by interposing malloc(), calloc() and realloc() in
+ * the benchmark executable, which also covers operator new and the allocations
+ * made inside the shared libraries. This is only available with glibc, other
+ * C libraries report zero allocations.
+ */
+
+#ifndef BENCHMARK_UTIL_H_
+#define BENCHMARK_UTIL_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "command_line_parser_util.h"
+
+// Macros
+#define BENCHMARK_DEFAULT_MIN_TIME_MS 500
+
+// Data structures
+typedef struct BenchmarkResult_st
+{
+    std::string name;                                                // Stage name.
+    uint64_t    recordsPerPass;                                      // Records processed by one pass over the input.
+    uint64_t    passes;                                              // Timed passes.
+    double      seconds;                                             // Time spent in the timed passes.
+    uint64_t    allocations;                                         // Heap allocations made by the timed passes.
+    long        rssGrowthKb;                                         // RSS after the stage minus RSS before it, can be negative.
+    uint64_t    droppedRecords;                                      // Records the code under test dropped during the stage, set by the benchmark.
+} BenchmarkResult;
+
+typedef struct BenchmarkReport_st
+{
+    std::string                  benchmark;                          // Benchmark binary name.
+    std::string                  label;                              // Free form label, e.g. the commit being measured.
+    std::string                  input;                              // "synthetic" or the fixture file.
+    std::vector<BenchmarkResult> results;
+    long                         peakRssKb;                          // Peak RSS of the process, set when the report is written.
+} BenchmarkReport;
+
+// Makes one pass over the input of a stage.
+typedef void (*BenchmarkPassFunc)(void *pUserData);
+
+// Global variables
+static std::atomic<uint64_t> s_BenchmarkAllocations(0);
+static int s_SavedStdout = -1;
+
+#if defined(__GLIBC__)
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *pPointer, size_t size);
+
+extern "C" void *
+malloc(
+    size_t size) __THROW
+{
+    s_BenchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(
+    size_t count,
+    size_t size) __THROW
+{
+    s_BenchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *
+realloc(
+    void *pPointer,
+    size_t size) __THROW
+{
+    s_BenchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(pPointer, size);
+}
+#endif
+
+// Helper Functions
+static long
+GetPeakRssKb()
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+    // ru_maxrss is in kilobytes on Linux.
+    return usage.ru_maxrss;
+}
+
+// Current RSS, 0 if /proc is not available.
+static long
+GetCurrentRssKb()
+{
+    long totalPages = 0;
+    long residentPages = 0;
+
+    FILE *pFile = fopen("/proc/self/statm", "r");
+    if (!pFile)
+    {
+        return 0;
+    }
+
+    if (fscanf(pFile, "%ld %ld", &totalPages, &residentPages) != 2)
+    {
+        residentPages = 0;
+    }
+    fclose(pFile);
+
+    return residentPages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// The code under test prints through stdout (e.g. the NVTX payload parser logs), send it to /dev/null
+// while the stages run so that only the report reaches the terminal.
+static void
+SuppressStdout()
+{
+    int devNull = open("/dev/null", O_WRONLY);
+
+    if (devNull < 0 || s_SavedStdout >= 0)
+    {
+        if (devNull >= 0)
+        {
+            close(devNull);
+        }
+        return;
+    }
+
+    fflush(stdout);
+    std::cout.flush();
+    s_SavedStdout = dup(STDOUT_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+}
+
+static void
+RestoreStdout()
+{
+    if (s_SavedStdout < 0)
+    {
+        return;
+    }
+
+    fflush(stdout);
+    std::cout.flush();
+    dup2(s_SavedStdout, STDOUT_FILENO);
+    close(s_SavedStdout);
+    s_SavedStdout = -1;
+}
+
+// Unknown options are errors: a misspelled or unsupported --fixture would otherwise silently
+// measure the synthetic input.
+static void
+ParseBenchmarkOptions(
+    CommandLineParser *pParser,
+    int argc,
+    char *argv[])
+{
+    pParser->setRejectUnknownOptions(true);
+    try
+    {
+        pParser->parse(argc, argv);
+    }
+    catch (const std::exception &error)
+    {
+        std::cerr << "Error: " << error.what() << ", see --help.\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+RunBenchmarkStage(
+    BenchmarkReport *pReport,
+    const char *pName,
+    uint64_t recordsPerPass,
+    BenchmarkPassFunc pPass,
+    void *pUserData,
+    uint64_t minTimeMs)
+{
+    BenchmarkResult result;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::duration minTime = std::chrono::milliseconds(minTimeMs);
+    std::chrono::steady_clock::duration elapsed;
+    uint64_t allocations;
+    long rssKb = GetCurrentRssKb();
+
+    // Untimed pass to warm up the caches and fill the lazily built state (e.g. schema caches).
+    pPass(pUserData);
+
+    result.name = pName;
+    result.recordsPerPass = recordsPerPass;
+    result.passes = 0;
+    result.droppedRecords = 0;
+
+    allocations = s_BenchmarkAllocations.load(std::memory_order_relaxed);
+    start = std::chrono::steady_clock::now();
+    do
+    {
+        pPass(pUserData);
+        result.passes++;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < minTime);
+
+    result.seconds = std::chrono::duration<double>(elapsed).count();
+    result.allocations = s_BenchmarkAllocations.load(std::memory_order_relaxed) - allocations;
+    result.rssGrowthKb = GetCurrentRssKb() - rssKb;
+
+    pReport->results.push_back(result);
+}
+
+static void
+PrintJsonString(
+    FILE *pFileHandle,
+    const std::string &value)
+{
+    fputc('"', pFileHandle);
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (c == '"' || c == '\\')
+        {
+            fprintf(pFileHandle, "\\%c", c);
+        }
+        else if (c < 0x20)
+        {
+            fprintf(pFileHandle, "\\u%04x", c);
+        }
+        else
+        {
+            fputc(c, pFileHandle);
+        }
+    }
+    fputc('"', pFileHandle);
+}
+
+static void
+PrintBenchmarkReport(
+    FILE *pFileHandle,
+    const BenchmarkReport *pReport)
+{
+    fprintf(pFileHandle, "{\n  \"benchmark\": ");
+    PrintJsonString(pFileHandle, pReport->benchmark);
+    fprintf(pFileHandle, ",\n  \"label\": ");
+    PrintJsonString(pFileHandle, pReport->label);
+    fprintf(pFileHandle, ",\n  \"input\": ");
+    PrintJsonString(pFileHandle, pReport->input);
+    fprintf(pFileHandle, ",\n  \"peak_rss_kb\": %ld", pReport->peakRssKb);
+    fprintf(pFileHandle, ",\n  \"results\": [");
+
+    for (size_t i = 0; i < pReport->results.size(); i++)
+    {
+        const BenchmarkResult *pResult = &pReport->results[i];
+        double records = (double)pResult->recordsPerPass * (double)pResult->passes;
+
+        fprintf(pFileHandle, "%s\n    {\n      \"stage\": ", i ? "," : "");
+        PrintJsonString(pFileHandle, pResult->name);
+        fprintf(pFileHandle, ",\n      \"records_per_pass\": %llu,\n      \"passes\": %llu,\n      \"seconds\": %.6f,\n",
+                (unsigned long long)pResult->recordsPerPass,
+                (unsigned long long)pResult->passes,
+                pResult->seconds);
+        fprintf(pFileHandle, "      \"records_per_sec\": %.1f,\n      \"ns_per_record\": %.3f,\n      \"allocations_per_record\": %.4f,\n      \"rss_growth_kb\": %ld,\n      \"dropped_records\": %llu\n    }",
+                pResult->seconds > 0 ? records / pResult->seconds : 0.0,
+                records > 0 ? pResult->seconds * 1e9 / records : 0.0,
+                records > 0 ? (double)pResult->allocations / records : 0.0,
+                pResult->rssGrowthKb,
+                (unsigned long long)pResult->droppedRecords);
+    }
+
+    fprintf(pFileHandle, "\n  ]\n}\n");
+}
+
+// Print the report to the file, or to stdout if fileName is empty.
+static void
+WriteBenchmarkReport(
+    const std::string &fileName,
+    BenchmarkReport *pReport)
+{
+    FILE *pFileHandle = stdout;
+
+    pReport->peakRssKb = GetPeakRssKb();
+
+    if (!fileName.empty())
+    {
+        pFileHandle = fopen(fileName.c_str(), "w");
+        if (!pFileHandle)
+        {
+            std::cerr << "Error: Failed to open the report file " << fileName << ".\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    PrintBenchmarkReport(pFileHandle, pReport);
+
+    if (pFileHandle != stdout)
+    {
+        fclose(pFileHandle);
+    }
+}
+
+#endif // BENCHMARK_UTIL_H_
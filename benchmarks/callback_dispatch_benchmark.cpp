@@ -0,0 +1,222 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Benchmark of the callback path of helper_cupti_activity.h: the runtime API
+ * callbacks issued by the mock CUPTI library go through the table driven
+ * dispatch of CuptiCallbackHandler(), and through a copy of the previous
+ * handler (cuptiGetLastError() on every callback, printing with a flush per
+ * callback and a switch per domain) for comparison.
+ *
+ * Every pass generates --operations mock operations, each issuing the enter
+ * and exit callbacks, so a stage reports callbacks per second. The
+ * mock_no_subscriber stage measures the generator alone, subtract its
+ * ns_per_record from the other stages to get the cost of the handler. The
+ * callbacks are printed to /dev/null. With --fixture the operations are
+ * replayed from an operation trace of the mock generator instead of the
+ * synthetic mix.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+// CUPTI headers
+#include "helper_cupti_activity.h"
+#include "command_line_parser_util.h"
+
+// Mock CUPTI headers
+#include "cupti_mock.h"
+
+#include "benchmark_util.h"
+
+// Macros
+#define CALLBACK_DEFAULT_OPERATIONS 100000
+
+// Data structures
+typedef struct CallbackInput_st
+{
+    uint64_t                numOperations;                           // Mock operations generated per pass.
+    UserData                userData;                                // User data of the subscribed handler.
+    FILE                    *pNullFile;                              // Output of the printed callbacks.
+    MockOperationTrace      operationTrace;                          // Operations replayed by the mock, empty if none.
+} CallbackInput;
+
+// Global variables
+static CallbackInput s_Input;
+
+// Helper Functions
+// The handler of helper_cupti_activity.h before the dispatch table.
+static void CUPTIAPI
+LegacyCallbackHandler(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    CUPTI_API_CALL(cuptiGetLastError());
+
+    if (((UserData *)pUserData)->printCallbacks &&
+        globals.pOutputFile != NULL)
+    {
+        fprintf(globals.pOutputFile, "CUPTI Callback: Domain %d CbId %d\n", domain, callbackId);
+        fflush(globals.pOutputFile);
+    }
+
+    const CUpti_CallbackData *pCallabckInfo = (CUpti_CallbackData *)pCallbackData;
+
+    switch (domain)
+    {
+        case CUPTI_CB_DOMAIN_STATE:
+            HandleDomainStateCallback(callbackId, (CUpti_StateData *)pCallbackData);
+            break;
+        case CUPTI_CB_DOMAIN_RUNTIME_API:
+            switch (callbackId)
+            {
+                case CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020:
+                    if (pCallabckInfo->callbackSite == CUPTI_API_ENTER)
+                    {
+                        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(0));
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case CUPTI_CB_DOMAIN_SYNCHRONIZE:
+            HandleSyncronizationCallbacks(callbackId, (CUpti_SynchronizeData *)pCallbackData, pUserData);
+            break;
+        default:
+            break;
+    }
+}
+
+// Subscribe pCallback to the runtime API domain of the mock, NULL leaves the mock without subscriber.
+static void
+SubscribeCallback(
+    CallbackInput *pInput,
+    CUpti_CallbackFunc pCallback,
+    int printCallbacks)
+{
+    pInput->userData.printCallbacks = printCallbacks;
+    globals.pOutputFile = pInput->pNullFile;
+
+    if (pCallback)
+    {
+        CUPTI_API_CALL(cuptiSubscribe(&globals.subscriberHandle, pCallback, &pInput->userData));
+        CUPTI_API_CALL(cuptiEnableDomain(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API));
+    }
+}
+
+static void
+UnsubscribeCallback()
+{
+    if (globals.subscriberHandle)
+    {
+        CUPTI_API_CALL(cuptiUnsubscribe(globals.subscriberHandle));
+        globals.subscriberHandle = NULL;
+    }
+}
+
+// Same handlers as InitCuptiTrace().
+static void
+RegisterDispatchHandlers(
+    CallbackInput *pInput)
+{
+    RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_STATE, CUPTI_CBID_STATE_FATAL_ERROR, DispatchStateCallback, &pInput->userData);
+    RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020, DispatchDeviceResetCallback, &pInput->userData);
+    RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_SYNCHRONIZE, CUPTI_CBID_SYNCHRONIZE_CONTEXT_SYNCHRONIZED, DispatchSynchronizeCallback, &pInput->userData);
+    RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_SYNCHRONIZE, CUPTI_CBID_SYNCHRONIZE_STREAM_SYNCHRONIZED, DispatchSynchronizeCallback, &pInput->userData);
+}
+
+// Benchmark passes
+static void
+GeneratePass(
+    void *pUserData)
+{
+    CallbackInput *pInput = (CallbackInput *)pUserData;
+
+    CuptiMockGenerate(pInput->numOperations);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CommandLineParser parser;
+    BenchmarkReport report;
+
+    parser.addOption<int>("-n", "--operations", "Mock operations per pass, each issues two callbacks", CALLBACK_DEFAULT_OPERATIONS);
+    parser.addOption<std::string>("-f", "--fixture", "Operation trace replayed by the mock instead of the synthetic mix", "");
+    parser.addOption<int>("-t", "--min-time", "Minimum run time of every stage in ms", BENCHMARK_DEFAULT_MIN_TIME_MS);
+    parser.addOption<std::string>("-o", "--output", "JSON report file, stdout if not set", "");
+    parser.addOption<std::string>("-l", "--label", "Label stored in the report", "");
+    ParseBenchmarkOptions(&parser, argc, argv);
+
+    uint64_t minTimeMs = (uint64_t)parser.get<int>("--min-time");
+    std::string fixture = parser.get<std::string>("--fixture");
+    uint64_t numCallbacks = 0;
+    MockWorkload workload;
+
+    s_Input.numOperations = (uint64_t)parser.get<int>("--operations");
+    numCallbacks = 2 * s_Input.numOperations;
+    memset(&s_Input.userData, 0, sizeof(UserData));
+
+    if (!fixture.empty())
+    {
+        if (!ReadMockOperationTrace(fixture.c_str(), &s_Input.operationTrace))
+        {
+            exit(EXIT_FAILURE);
+        }
+
+        CuptiMockGetWorkload(&workload);
+        workload.pOperationTrace = &s_Input.operationTrace;
+        CuptiMockSetWorkload(&workload);
+    }
+
+    s_Input.pNullFile = fopen("/dev/null", "w");
+    if (!s_Input.pNullFile)
+    {
+        std::cerr << "Error: Failed to open /dev/null.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    report.benchmark = "callback_dispatch_benchmark";
+    report.label = parser.get<std::string>("--label");
+    report.input = fixture.empty() ? "synthetic" : fixture;
+
+    SubscribeCallback(&s_Input, NULL, 0);
+    RunBenchmarkStage(&report, "mock_no_subscriber", numCallbacks, GeneratePass, &s_Input, minTimeMs);
+
+    SubscribeCallback(&s_Input, (CUpti_CallbackFunc)LegacyCallbackHandler, 0);
+    RunBenchmarkStage(&report, "legacy_switch", numCallbacks, GeneratePass, &s_Input, minTimeMs);
+    UnsubscribeCallback();
+
+    SubscribeCallback(&s_Input, (CUpti_CallbackFunc)LegacyCallbackHandler, 1);
+    RunBenchmarkStage(&report, "legacy_switch_print", numCallbacks, GeneratePass, &s_Input, minTimeMs);
+    UnsubscribeCallback();
+
+    RegisterDispatchHandlers(&s_Input);
+
+    SubscribeCallback(&s_Input, (CUpti_CallbackFunc)CuptiCallbackHandler, 0);
+    RunBenchmarkStage(&report, "dispatch_table", numCallbacks, GeneratePass, &s_Input, minTimeMs);
+    UnsubscribeCallback();
+
+    SubscribeCallback(&s_Input, (CUpti_CallbackFunc)CuptiCallbackHandler, 1);
+    StartCallbackPrinter(&globals.callbackDispatch, s_Input.pNullFile);
+    RunBenchmarkStage(&report, "dispatch_table_print", numCallbacks, GeneratePass, &s_Input, minTimeMs);
+    // A callback dropped by the full print queue is dispatched but not printed, the stage did less work.
+    report.results.back().droppedRecords = globals.callbackDispatch.printDropped.load();
+    UnsubscribeCallback();
+    StopCallbackPrinter(&globals.callbackDispatch);
+
+    WriteBenchmarkReport(parser.get<std::string>("--output"), &report);
+
+    fclose(s_Input.pNullFile);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+#
+# Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+#
+# Compare two sets of benchmark reports, e.g. the results directories of two commits:
+#   python3 compare_benchmarks.py base_results new_results
+# Every stage present in both is printed with the change of ns/record and
+# allocations/record. A positive change means slower or more allocations.
+# Stages that dropped records did less work than their record count says,
+# they are flagged with the number of records dropped.
+
+import json
+import os
+import sys
+
+
+def load_reports(path):
+    files = [path]
+    if os.path.isdir(path):
+        files = [os.path.join(path, name) for name in sorted(os.listdir(path)) if name.endswith(".json")]
+
+    stages = {}
+    for file_name in files:
+        with open(file_name) as report_file:
+            report = json.load(report_file)
+        for result in report["results"]:
+            stages[(report["benchmark"], result["stage"])] = result
+    return stages
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("Usage: compare_benchmarks.py <base report or directory> <new report or directory>")
+        sys.exit(1)
+
+    base = load_reports(sys.argv[1])
+    new = load_reports(sys.argv[2])
+
+    print("%-24s %-32s %12s %12s %8s %10s %10s" %
+          ("benchmark", "stage", "base ns/rec", "new ns/rec", "change", "base alloc", "new alloc"))
+    for key in sorted(base):
+        if key not in new:
+            continue
+        base_ns = base[key]["ns_per_record"]
+        new_ns = new[key]["ns_per_record"]
+        change = (new_ns - base_ns) * 100.0 / base_ns if base_ns else 0.0
+        dropped = ""
+        if base[key].get("dropped_records", 0) or new[key].get("dropped_records", 0):
+            dropped = "  dropped %d / %d" % (base[key].get("dropped_records", 0), new[key].get("dropped_records", 0))
+        print("%-24s %-32s %12.3f %12.3f %+7.1f%% %10.4f %10.4f%s" %
+              (key[0], key[1], base_ns, new_ns, change,
+               base[key]["allocations_per_record"], new[key]["allocations_per_record"], dropped))
+
+
+if __name__ == "__main__":
+    main()
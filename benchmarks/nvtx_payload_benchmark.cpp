@@ -0,0 +1,470 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Benchmark of the NVTX extended payload parser (common/nvtx): decoding of
+ * payloads with a static schema holding a nested enum (the layout used by the
+ * cupti_nvtx_ext_payload sample), a wide schema of predefined types and a
+ * plain enum, through CuptiParseNvtxPayload().
+ *
+ * The schemas are registered with the mock CUPTI library, which returns them
+ * from cuptiActivityGetNvtxExtPayloadAttr() like CUPTI does for the schemas
+ * registered by the application through NVTX. The first lookup of a schema
+ * is made by the warm up pass, the timed passes measure the cached path.
+ *
+ * The payloads are synthetic, or read from a fixture with one payload per
+ * line (see ReadPayloadFixture()) and repeated up to --payloads per stage.
+ * --save-fixture writes the payloads in the same format.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// NVTX headers
+#include "nvtx3/nvToolsExt.h"
+#include <nvtx3/nvToolsExtPayload.h>
+
+// CUPTI headers
+#include "helper_cupti.h"
+#include "command_line_parser_util.h"
+
+// NVTX payload parser headers
+#include "nvtx_payload_parser.h"
+
+// Mock CUPTI headers
+#include "cupti_mock.h"
+
+#include "benchmark_util.h"
+
+// Macros
+#define NVTX_DEFAULT_PAYLOADS 10000
+#define NVTX_BENCHMARK_DOMAIN_ID 1
+#define NVTX_FIXTURE_LINE_SIZE 1024
+
+#define VECTOR_ADD_ENUM_SCHEMA_ID (NVTX_PAYLOAD_SCHEMA_ID_STATIC_START + 1)
+#define VECTOR_ADD_SCHEMA_ID (NVTX_PAYLOAD_SCHEMA_ID_STATIC_START + 2)
+#define WIDE_SCHEMA_ID (NVTX_PAYLOAD_SCHEMA_ID_STATIC_START + 3)
+
+// Data structures
+enum VectorAddOp
+{
+    VECADD_ALLOC = 1,
+    VECADD_MEMCPY = 2,
+    VECADD_KERNEL = 3,
+    VECADD_FREE = 4
+};
+
+typedef struct
+{
+    enum VectorAddOp vectorOp;
+    uint32_t deviceId;
+    int vectorElements;
+    size_t vectorSize;
+} VectorAddPayload_t;
+
+typedef struct
+{
+    int8_t   int8Value;
+    uint8_t  uint8Value;
+    int16_t  int16Value;
+    uint16_t uint16Value;
+    int32_t  int32Value;
+    uint32_t uint32Value;
+    int64_t  int64Value;
+    uint64_t uint64Value;
+    float    floatValue;
+    double   doubleValue;
+    void     *pAddress;
+    size_t   sizeValue;
+} WidePayload_t;
+
+typedef struct NvtxInput_st
+{
+    std::vector<VectorAddPayload_t> vectorAddPayloads;
+    std::vector<WidePayload_t>      widePayloads;
+    std::vector<enum VectorAddOp>   enumPayloads;
+    FILE                            *pNullFile;                      // Output of the parsed values.
+} NvtxInput;
+
+// Global variables
+static nvtxPayloadEnum_t s_VectorAddEnumEntries[] =
+{
+    {"Allocate memory", VECADD_ALLOC},
+    {"Copy memory", VECADD_MEMCPY},
+    {"Kernel launch", VECADD_KERNEL},
+    {"Free memory", VECADD_FREE}
+};
+
+static nvtxPayloadSchemaEntry_t s_VectorAddEntries[] =
+{
+    {0, VECTOR_ADD_ENUM_SCHEMA_ID, "VectorAddOp"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_UINT32, "Device ID"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_INT, "No. of elements"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_SIZE, "Size of vector"}
+};
+
+static nvtxPayloadSchemaEntry_t s_WideEntries[] =
+{
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_INT8, "int8"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_UINT8, "uint8"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_INT16, "int16"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_UINT16, "uint16"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_INT32, "int32"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_UINT32, "uint32"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_INT64, "int64"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_UINT64, "uint64"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_FLOAT, "float"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_DOUBLE, "double"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_ADDRESS, "address"},
+    {0, NVTX_PAYLOAD_ENTRY_TYPE_SIZE, "size"}
+};
+
+static nvtxPayloadEnumAttr_t s_VectorAddEnumAttr;
+static nvtxPayloadSchemaAttr_t s_VectorAddSchemaAttr;
+static nvtxPayloadSchemaAttr_t s_WideSchemaAttr;
+
+static NvtxInput s_Input;
+
+// Helper Functions
+static void
+RegisterSchemas()
+{
+    CUpti_NvtxExtPayloadAttr payloadAttr;
+
+    memset(&s_VectorAddEnumAttr, 0, sizeof(s_VectorAddEnumAttr));
+    s_VectorAddEnumAttr.fieldMask = NVTX_PAYLOAD_ENUM_ATTR_FIELD_NAME |
+            NVTX_PAYLOAD_ENUM_ATTR_FIELD_ENTRIES |
+            NVTX_PAYLOAD_ENUM_ATTR_FIELD_NUM_ENTRIES |
+            NVTX_PAYLOAD_ENUM_ATTR_FIELD_SIZE;
+    s_VectorAddEnumAttr.name = "Vector Addition Operation Enum";
+    s_VectorAddEnumAttr.entries = s_VectorAddEnumEntries;
+    s_VectorAddEnumAttr.numEntries = std::extent<decltype(s_VectorAddEnumEntries)>::value;
+    s_VectorAddEnumAttr.sizeOfEnum = sizeof(enum VectorAddOp);
+
+    memset(&s_VectorAddSchemaAttr, 0, sizeof(s_VectorAddSchemaAttr));
+    s_VectorAddSchemaAttr.fieldMask = NVTX_PAYLOAD_SCHEMA_ATTR_FIELD_NAME |
+            NVTX_PAYLOAD_SCHEMA_ATTR_FIELD_TYPE |
+            NVTX_PAYLOAD_SCHEMA_ATTR_FIELD_ENTRIES |
+            NVTX_PAYLOAD_SCHEMA_ATTR_FIELD_NUM_ENTRIES |
+            NVTX_PAYLOAD_SCHEMA_ATTR_FIELD_STATIC_SIZE;
+    s_VectorAddSchemaAttr.name = "Vector Addition Schema";
+    s_VectorAddSchemaAttr.type = NVTX_PAYLOAD_SCHEMA_TYPE_STATIC;
+    s_VectorAddSchemaAttr.entries = s_VectorAddEntries;
+    s_VectorAddSchemaAttr.numEntries = std::extent<decltype(s_VectorAddEntries)>::value;
+    s_VectorAddSchemaAttr.payloadStaticSize = sizeof(VectorAddPayload_t);
+
+    s_WideSchemaAttr = s_VectorAddSchemaAttr;
+    s_WideSchemaAttr.name = "Wide Schema";
+    s_WideSchemaAttr.entries = s_WideEntries;
+    s_WideSchemaAttr.numEntries = std::extent<decltype(s_WideEntries)>::value;
+    s_WideSchemaAttr.payloadStaticSize = sizeof(WidePayload_t);
+
+    payloadAttr.type = CUPTI_NVTX_EXT_PAYLOAD_TYPE_ENUM;
+    payloadAttr.attributes = &s_VectorAddEnumAttr;
+    CuptiMockRegisterNvtxPayloadAttr(NVTX_BENCHMARK_DOMAIN_ID, VECTOR_ADD_ENUM_SCHEMA_ID, &payloadAttr);
+
+    payloadAttr.type = CUPTI_NVTX_EXT_PAYLOAD_TYPE_SCHEMA;
+    payloadAttr.attributes = &s_VectorAddSchemaAttr;
+    CuptiMockRegisterNvtxPayloadAttr(NVTX_BENCHMARK_DOMAIN_ID, VECTOR_ADD_SCHEMA_ID, &payloadAttr);
+
+    payloadAttr.attributes = &s_WideSchemaAttr;
+    CuptiMockRegisterNvtxPayloadAttr(NVTX_BENCHMARK_DOMAIN_ID, WIDE_SCHEMA_ID, &payloadAttr);
+}
+
+static void
+GeneratePayloads(
+    NvtxInput *pInput,
+    size_t numPayloads)
+{
+    pInput->vectorAddPayloads.resize(numPayloads);
+    pInput->widePayloads.resize(numPayloads);
+    pInput->enumPayloads.resize(numPayloads);
+
+    for (size_t i = 0; i < numPayloads; i++)
+    {
+        VectorAddPayload_t *pVectorAdd = &pInput->vectorAddPayloads[i];
+        WidePayload_t *pWide = &pInput->widePayloads[i];
+
+        pVectorAdd->vectorOp = (enum VectorAddOp)(VECADD_ALLOC + i % 4);
+        pVectorAdd->deviceId = (uint32_t)(i % 8);
+        pVectorAdd->vectorElements = (int)(i * 1024);
+        pVectorAdd->vectorSize = i * 1024 * sizeof(int);
+
+        memset(pWide, 0, sizeof(WidePayload_t));
+        pWide->int8Value = (int8_t)i;
+        pWide->uint8Value = (uint8_t)i;
+        pWide->int16Value = (int16_t)i;
+        pWide->uint16Value = (uint16_t)i;
+        pWide->int32Value = -(int32_t)i;
+        pWide->uint32Value = (uint32_t)i;
+        pWide->int64Value = -(int64_t)i * 1000003;
+        pWide->uint64Value = (uint64_t)i * 1000003;
+        pWide->floatValue = (float)i * 0.5f;
+        pWide->doubleValue = (double)i * 0.25;
+        pWide->pAddress = pWide;
+        pWide->sizeValue = i;
+
+        pInput->enumPayloads[i] = pVectorAdd->vectorOp;
+    }
+}
+
+// Read the payloads of a fixture. Every line that is not empty or a # comment holds one payload:
+//
+//   vector_add <vectorOp> <deviceId> <vectorElements> <vectorSize>
+//   wide <int8> <uint8> <int16> <uint16> <int32> <uint32> <int64> <uint64> <float> <double> <address> <size>
+//   enum <vectorOp>
+//
+// Each list is then repeated up to numPayloads payloads.
+static void
+ReadPayloadFixture(
+    NvtxInput *pInput,
+    const std::string &fixture,
+    size_t numPayloads)
+{
+    char line[NVTX_FIXTURE_LINE_SIZE];
+    unsigned int lineNumber = 0;
+
+    FILE *pFile = fopen(fixture.c_str(), "r");
+    if (!pFile)
+    {
+        std::cerr << "Error: Failed to open the fixture " << fixture << ".\n";
+        exit(EXIT_FAILURE);
+    }
+
+    while (fgets(line, sizeof(line), pFile))
+    {
+        char kind[16];
+        int offset = 0;
+        bool valid = false;
+
+        lineNumber++;
+        if (sscanf(line, "%15s %n", kind, &offset) != 1 || kind[0] == '#')
+        {
+            continue;
+        }
+
+        const char *pValues = line + offset;
+        if (!strcmp(kind, "vector_add"))
+        {
+            VectorAddPayload_t payload;
+            int vectorOp = 0;
+            unsigned long long vectorSize = 0;
+
+            memset(&payload, 0, sizeof(payload));
+            valid = sscanf(pValues, "%d %u %d %llu", &vectorOp, &payload.deviceId, &payload.vectorElements, &vectorSize) == 4;
+            payload.vectorOp = (enum VectorAddOp)vectorOp;
+            payload.vectorSize = (size_t)vectorSize;
+            pInput->vectorAddPayloads.push_back(payload);
+        }
+        else if (!strcmp(kind, "wide"))
+        {
+            WidePayload_t payload;
+            int int8Value = 0, int16Value = 0;
+            unsigned int uint8Value = 0, uint16Value = 0;
+            long long int64Value = 0;
+            unsigned long long uint64Value = 0, address = 0, sizeValue = 0;
+
+            memset(&payload, 0, sizeof(payload));
+            valid = sscanf(pValues, "%d %u %d %u %d %u %lld %llu %f %lf %llx %llu", &int8Value, &uint8Value, &int16Value, &uint16Value,
+                           &payload.int32Value, &payload.uint32Value, &int64Value, &uint64Value, &payload.floatValue,
+                           &payload.doubleValue, &address, &sizeValue) == 12;
+            payload.int8Value = (int8_t)int8Value;
+            payload.uint8Value = (uint8_t)uint8Value;
+            payload.int16Value = (int16_t)int16Value;
+            payload.uint16Value = (uint16_t)uint16Value;
+            payload.int64Value = (int64_t)int64Value;
+            payload.uint64Value = (uint64_t)uint64Value;
+            payload.pAddress = (void *)(uintptr_t)address;
+            payload.sizeValue = (size_t)sizeValue;
+            pInput->widePayloads.push_back(payload);
+        }
+        else if (!strcmp(kind, "enum"))
+        {
+            int vectorOp = 0;
+
+            valid = sscanf(pValues, "%d", &vectorOp) == 1;
+            pInput->enumPayloads.push_back((enum VectorAddOp)vectorOp);
+        }
+
+        if (!valid)
+        {
+            std::cerr << "Error: Invalid payload at line " << lineNumber << " of " << fixture << ".\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+    fclose(pFile);
+
+    if (pInput->vectorAddPayloads.empty() || pInput->widePayloads.empty() || pInput->enumPayloads.empty())
+    {
+        std::cerr << "Error: The fixture " << fixture << " needs vector_add, wide and enum payloads.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    size_t numVectorAdd = pInput->vectorAddPayloads.size();
+    size_t numWide = pInput->widePayloads.size();
+    size_t numEnum = pInput->enumPayloads.size();
+
+    for (size_t i = numVectorAdd; i < numPayloads; i++)
+    {
+        pInput->vectorAddPayloads.push_back(pInput->vectorAddPayloads[i % numVectorAdd]);
+    }
+    for (size_t i = numWide; i < numPayloads; i++)
+    {
+        pInput->widePayloads.push_back(pInput->widePayloads[i % numWide]);
+    }
+    for (size_t i = numEnum; i < numPayloads; i++)
+    {
+        pInput->enumPayloads.push_back(pInput->enumPayloads[i % numEnum]);
+    }
+}
+
+// Write the payloads in the format of ReadPayloadFixture().
+static void
+WritePayloadFixture(
+    const NvtxInput *pInput,
+    const std::string &fixture)
+{
+    FILE *pFile = fopen(fixture.c_str(), "w");
+    if (!pFile)
+    {
+        std::cerr << "Error: Failed to write the fixture " << fixture << ".\n";
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < pInput->vectorAddPayloads.size(); i++)
+    {
+        const VectorAddPayload_t *pPayload = &pInput->vectorAddPayloads[i];
+        fprintf(pFile, "vector_add %d %u %d %llu\n", (int)pPayload->vectorOp, pPayload->deviceId, pPayload->vectorElements,
+                (unsigned long long)pPayload->vectorSize);
+    }
+    for (size_t i = 0; i < pInput->widePayloads.size(); i++)
+    {
+        const WidePayload_t *pPayload = &pInput->widePayloads[i];
+        fprintf(pFile, "wide %d %u %d %u %d %u %lld %llu %.9g %.17g %llx %llu\n", (int)pPayload->int8Value, (unsigned int)pPayload->uint8Value,
+                (int)pPayload->int16Value, (unsigned int)pPayload->uint16Value, pPayload->int32Value, pPayload->uint32Value,
+                (long long)pPayload->int64Value, (unsigned long long)pPayload->uint64Value, pPayload->floatValue, pPayload->doubleValue,
+                (unsigned long long)(uintptr_t)pPayload->pAddress, (unsigned long long)pPayload->sizeValue);
+    }
+    for (size_t i = 0; i < pInput->enumPayloads.size(); i++)
+    {
+        fprintf(pFile, "enum %d\n", (int)pInput->enumPayloads[i]);
+    }
+
+    if (fclose(pFile) != 0)
+    {
+        std::cerr << "Error: Failed to write the fixture " << fixture << ".\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+ParsePayloads(
+    uint64_t schemaId,
+    const void *pPayloads,
+    size_t payloadSize,
+    size_t numPayloads)
+{
+    nvtxPayloadData_t payloadData;
+
+    for (size_t i = 0; i < numPayloads; i++)
+    {
+        payloadData.schemaId = schemaId;
+        payloadData.size = payloadSize;
+        payloadData.payload = (const char *)pPayloads + i * payloadSize;
+
+        CuptiParseNvtxPayload(NVTX_BENCHMARK_DOMAIN_ID, &payloadData, s_Input.pNullFile);
+    }
+}
+
+// Benchmark passes
+static void
+VectorAddSchemaPass(
+    void *pUserData)
+{
+    NvtxInput *pInput = (NvtxInput *)pUserData;
+    ParsePayloads(VECTOR_ADD_SCHEMA_ID, pInput->vectorAddPayloads.data(), sizeof(VectorAddPayload_t), pInput->vectorAddPayloads.size());
+}
+
+static void
+WideSchemaPass(
+    void *pUserData)
+{
+    NvtxInput *pInput = (NvtxInput *)pUserData;
+    ParsePayloads(WIDE_SCHEMA_ID, pInput->widePayloads.data(), sizeof(WidePayload_t), pInput->widePayloads.size());
+}
+
+static void
+EnumPass(
+    void *pUserData)
+{
+    NvtxInput *pInput = (NvtxInput *)pUserData;
+    ParsePayloads(VECTOR_ADD_ENUM_SCHEMA_ID, pInput->enumPayloads.data(), sizeof(enum VectorAddOp), pInput->enumPayloads.size());
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CommandLineParser parser;
+    BenchmarkReport report;
+
+    parser.addOption<int>("-n", "--payloads", "Payloads parsed by every pass", NVTX_DEFAULT_PAYLOADS);
+    parser.addOption<std::string>("-f", "--fixture", "Payload fixture to replay instead of synthetic payloads", "");
+    parser.addOption<std::string>("-s", "--save-fixture", "Write the payloads to a fixture file", "");
+    parser.addOption<int>("-t", "--min-time", "Minimum run time of every stage in ms", BENCHMARK_DEFAULT_MIN_TIME_MS);
+    parser.addOption<std::string>("-o", "--output", "JSON report file, stdout if not set", "");
+    parser.addOption<std::string>("-l", "--label", "Label stored in the report", "");
+    ParseBenchmarkOptions(&parser, argc, argv);
+
+    uint64_t minTimeMs = (uint64_t)parser.get<int>("--min-time");
+    size_t numPayloads = (size_t)parser.get<int>("--payloads");
+    std::string fixture = parser.get<std::string>("--fixture");
+    std::string saveFixture = parser.get<std::string>("--save-fixture");
+
+    RegisterSchemas();
+    if (!fixture.empty())
+    {
+        ReadPayloadFixture(&s_Input, fixture, numPayloads);
+    }
+    else
+    {
+        GeneratePayloads(&s_Input, numPayloads);
+    }
+
+    if (!saveFixture.empty())
+    {
+        WritePayloadFixture(&s_Input, saveFixture);
+    }
+
+    s_Input.pNullFile = fopen("/dev/null", "w");
+    if (!s_Input.pNullFile)
+    {
+        std::cerr << "Error: Failed to open /dev/null.\n";
+        exit(EXIT_FAILURE);
+    }
+
+    report.benchmark = "nvtx_payload_benchmark";
+    report.label = parser.get<std::string>("--label");
+    report.input = fixture.empty() ? "synthetic" : fixture;
+
+    // The parser logs every decoded entry to stdout.
+    SuppressStdout();
+    RunBenchmarkStage(&report, "parse_schema_nested_enum", s_Input.vectorAddPayloads.size(), VectorAddSchemaPass, &s_Input, minTimeMs);
+    RunBenchmarkStage(&report, "parse_schema_predefined_types", s_Input.widePayloads.size(), WideSchemaPass, &s_Input, minTimeMs);
+    RunBenchmarkStage(&report, "parse_enum", s_Input.enumPayloads.size(), EnumPass, &s_Input, minTimeMs);
+    RestoreStdout();
+
+    WriteBenchmarkReport(parser.get<std::string>("--output"), &report);
+
+    FreeAllNvtxPayloadAttributes();
+    fclose(s_Input.pNullFile);
+
+    return EXIT_SUCCESS;
+}
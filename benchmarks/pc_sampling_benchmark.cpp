@@ -0,0 +1,362 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Benchmark of the host side of PC sampling, through the code of the
+ * samples: the circular buffers and queue of pc_sampling_continuous, which
+ * store every buffer with CuptiUtilPutPcSampData()
+ * (helper_cupti_pc_sampling_store.h), and the file reading and source
+ * correlation of pc_sampling_utility (pc_sampling_utility_helper.h).
+ *
+ * The input is a file written by pc_sampling_continuous (--fixture), read
+ * with RetrievePcSampData(); the mock cuptiPCSamplingGetData() replays its
+ * PC records. Without a fixture the mock generates --pcs PCs per buffer and
+ * the file written by the store stage is read back. The store thread of the
+ * sample is not started: the pass fills the circular buffers and drains the
+ * queue with StorePcSampDataInFile() itself, so the 100 ms polling interval
+ * of the thread is not part of the measurement.
+ *
+ * The cubins of a capture are not available here: every CRC of the input is
+ * mapped to a placeholder module and the mock cuptiGetSassToSourceCorrelation()
+ * returns a synthetic line, so source_correlation measures the lookups, the
+ * calls and the printing of SourceCorrelation(), not the SASS decoding.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <cupti_pcsampling.h>
+#include <cupti_pcsampling_util.h>
+#include "helper_cupti.h"
+#include "command_line_parser_util.h"
+
+// Sample headers
+#include "helper_cupti_pc_sampling_store.h"
+#include "pc_sampling_utility_helper.h"
+
+// Mock CUPTI headers
+#include "cupti_mock.h"
+
+#include "benchmark_util.h"
+
+// Macros
+#define PC_DEFAULT_PCS_PER_BUFFER 500
+#define PC_DEFAULT_BUFFERS_PER_PASS 200
+#define PC_STORE_FILE_NAME "pc_sampling_benchmark.dat"
+
+// Data structures
+typedef struct PcSamplingInput_st
+{
+    size_t                            buffersPerPass;
+    ContextInfo                       contextInfo;                   // Context of the stored buffers.
+    std::string                       storeFile;                     // File written by the store path, <context id>_<g_fileName>.
+    std::vector<CUpti_PCSamplingData> fixtureBuffers;                // Buffers of the fixture, replayed by the mock.
+    uint64_t                          numStoredPcs;                  // PCs stored by the last pass.
+    CUpti_PCSamplingData              *pCorrelationBuffers;          // Input of the source correlation.
+    size_t                            numCorrelationBuffers;
+} PcSamplingInput;
+
+// Global variables
+static PcSamplingInput s_Input;
+
+// Helper Functions
+static uint64_t
+CountPcs(
+    const CUpti_PCSamplingData *pBuffers,
+    size_t numBuffers)
+{
+    uint64_t numPcs = 0;
+
+    for (size_t i = 0; i < numBuffers; i++)
+    {
+        numPcs += pBuffers[i].totalNumPcs;
+    }
+
+    return numPcs;
+}
+
+// Stall reasons of the context when the PC records are generated by the mock, allocated as in
+// ConfigureActivity() of pc_sampling_continuous.
+static void
+QueryStallReasons(
+    PcSamplingStallReasons *pContextStallReasons)
+{
+    size_t numStallReasons = 0;
+
+    CUpti_PCSamplingGetNumStallReasonsParams numStallReasonsParams = {};
+    numStallReasonsParams.size = CUpti_PCSamplingGetNumStallReasonsParamsSize;
+    numStallReasonsParams.numStallReasons = &numStallReasons;
+    CUPTI_API_CALL(cuptiPCSamplingGetNumStallReasons(&numStallReasonsParams));
+
+    char **pStallReasons = (char **)malloc(numStallReasons * sizeof(char*));
+    MEMORY_ALLOCATION_CALL(pStallReasons);
+    for (size_t i = 0; i < numStallReasons; i++)
+    {
+        pStallReasons[i] = (char *)malloc(CUPTI_STALL_REASON_STRING_SIZE * sizeof(char));
+        MEMORY_ALLOCATION_CALL(pStallReasons[i]);
+    }
+    uint32_t *pStallReasonIndex = (uint32_t *)malloc(numStallReasons * sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pStallReasonIndex);
+
+    CUpti_PCSamplingGetStallReasonsParams stallReasonsParams = {};
+    stallReasonsParams.size = CUpti_PCSamplingGetStallReasonsParamsSize;
+    stallReasonsParams.numStallReasons = numStallReasons;
+    stallReasonsParams.stallReasonIndex = pStallReasonIndex;
+    stallReasonsParams.stallReasons = pStallReasons;
+    CUPTI_API_CALL(cuptiPCSamplingGetStallReasons(&stallReasonsParams));
+
+    pContextStallReasons->numStallReasons = numStallReasons;
+    pContextStallReasons->stallReasons = pStallReasons;
+    pContextStallReasons->stallReasonIndex = pStallReasonIndex;
+}
+
+// Configuration stored with every buffer, the attributes pc_sampling_continuous stores.
+static void
+SetConfigurationInfo(
+    ContextInfo *pContextInfo,
+    CUpti_PCSamplingCollectionMode mode)
+{
+    CUpti_PCSamplingConfigurationInfo configurationInfo[7] = {};
+
+    configurationInfo[0].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_COLLECTION_MODE;
+    configurationInfo[0].attributeData.collectionModeData.collectionMode = mode;
+    configurationInfo[1].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_SAMPLING_PERIOD;
+    configurationInfo[2].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_SCRATCH_BUFFER_SIZE;
+    configurationInfo[3].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_HARDWARE_BUFFER_SIZE;
+    configurationInfo[4].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_ENABLE_START_STOP_CONTROL;
+    configurationInfo[5].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_OUTPUT_DATA_FORMAT;
+    configurationInfo[5].attributeData.outputDataFormatData.outputDataFormat = CUPTI_PC_SAMPLING_OUTPUT_DATA_FORMAT_PARSED;
+    configurationInfo[6].attributeType = CUPTI_PC_SAMPLING_CONFIGURATION_ATTR_TYPE_STALL_REASON;
+    configurationInfo[6].attributeData.stallReasonData.stallReasonCount = pContextInfo->pcSamplingStallReasons.numStallReasons;
+    configurationInfo[6].attributeData.stallReasonData.pStallReasonIndex = pContextInfo->pcSamplingStallReasons.stallReasonIndex;
+
+    pContextInfo->pcSamplingConfigurationInfo.assign(configurationInfo, configurationInfo + 7);
+}
+
+// Read the fixture with pc_sampling_utility and keep its buffers and stall reasons for the replay.
+static void
+LoadFixture(
+    PcSamplingInput *pInput,
+    const std::string &fixture)
+{
+    fileName = fixture;
+    buffersRetrievedDataVector.clear();
+    RetrievePcSampData();
+
+    pInput->fixtureBuffers.swap(buffersRetrievedDataVector);
+    pInput->contextInfo.pcSamplingStallReasons = pcSamplingStallReasonsRetrieve;
+    pcSamplingStallReasonsRetrieve = {};
+
+    if (CountPcs(pInput->fixtureBuffers.data(), pInput->fixtureBuffers.size()) == 0)
+    {
+        std::cerr << "Error: The fixture " << fixture << " holds no PC records.\n";
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Map every cubin CRC of the buffers to a placeholder module, see the top of the file.
+static void
+FillPlaceholderModules(
+    const CUpti_PCSamplingData *pBuffers,
+    size_t numBuffers)
+{
+    for (size_t i = 0; i < numBuffers; i++)
+    {
+        for (size_t j = 0; j < pBuffers[i].totalNumPcs; j++)
+        {
+            uint64_t cubinCrc = pBuffers[i].pPcData[j].cubinCrc;
+            if (crcModuleMap.find(cubinCrc) != crcModuleMap.end())
+            {
+                continue;
+            }
+
+            ModuleDetails moduleDetailsStruct = {};
+            moduleDetailsStruct.cubinSize = sizeof(cubinCrc);
+            moduleDetailsStruct.pCubinImage = malloc(moduleDetailsStruct.cubinSize);
+            MEMORY_ALLOCATION_CALL(moduleDetailsStruct.pCubinImage);
+            memcpy(moduleDetailsStruct.pCubinImage, &cubinCrc, sizeof(cubinCrc));
+            crcModuleMap.insert(std::make_pair(cubinCrc, moduleDetailsStruct));
+        }
+    }
+}
+
+// Benchmark passes
+static void
+QueueStorePass(
+    void *pUserData)
+{
+    PcSamplingInput *pInput = (PcSamplingInput *)pUserData;
+
+    // Every pass writes a new file, CuptiUtilPutPcSampData() appends to an existing one.
+    remove(pInput->storeFile.c_str());
+    if (!pInput->fixtureBuffers.empty())
+    {
+        CuptiMockSetPcSamplingData(pInput->fixtureBuffers.data(), pInput->fixtureBuffers.size());
+    }
+    pInput->numStoredPcs = 0;
+
+    for (size_t i = 0; i < pInput->buffersPerPass; )
+    {
+        // Fill the circular buffers, then drain the queue as the store thread does.
+        for (size_t j = 0; j < g_circularbufCount && i < pInput->buffersPerPass; j++, i++)
+        {
+            CUpti_PCSamplingGetDataParams pcSamplingGetDataParams = {};
+            pcSamplingGetDataParams.size = CUpti_PCSamplingGetDataParamsSize;
+
+            if (!GetPcSamplingDataFromCupti(pcSamplingGetDataParams, &pInput->contextInfo))
+            {
+                exit(EXIT_FAILURE);
+            }
+            pInput->numStoredPcs += ((CUpti_PCSamplingData *)pcSamplingGetDataParams.pcSamplingData)->totalNumPcs;
+        }
+
+        while (!g_pcSampDataQueue.empty())
+        {
+            StorePcSampDataInFile();
+        }
+        FreeStoredFunctionNames();
+    }
+}
+
+static void
+RetrievePass(
+    void *pUserData)
+{
+    buffersRetrievedDataVector.clear();
+    RetrievePcSampData();
+
+    FreePcSampDataBuffers(buffersRetrievedDataVector.data(), buffersRetrievedDataVector.size());
+    FreePcSampStallReasonsMemory();
+    buffersRetrievedDataVector.clear();
+    pcSamplingStallReasonsRetrieve = {};
+}
+
+static void
+SourceCorrelationPass(
+    void *pUserData)
+{
+    PcSamplingInput *pInput = (PcSamplingInput *)pUserData;
+    SourceCorrelation(pInput->pCorrelationBuffers, pInput->numCorrelationBuffers);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CommandLineParser parser;
+    BenchmarkReport report;
+    MockWorkload workload;
+
+    parser.addOption<std::string>("-f", "--fixture", "File written by pc_sampling_continuous to replay instead of synthetic PCs", "");
+    parser.addOption<int>("-p", "--pcs", "PCs returned by every synthetic cuptiPCSamplingGetData() call", PC_DEFAULT_PCS_PER_BUFFER);
+    parser.addOption<int>("-b", "--buffers", "Buffers retrieved and stored by every pass", PC_DEFAULT_BUFFERS_PER_PASS);
+    parser.addOption<int>("-t", "--min-time", "Minimum run time of every stage in ms", BENCHMARK_DEFAULT_MIN_TIME_MS);
+    parser.addOption<std::string>("-o", "--output", "JSON report file, stdout if not set", "");
+    parser.addOption<std::string>("-l", "--label", "Label stored in the report", "");
+    ParseBenchmarkOptions(&parser, argc, argv);
+
+    uint64_t minTimeMs = (uint64_t)parser.get<int>("--min-time");
+    std::string fixture = parser.get<std::string>("--fixture");
+    CUpti_PCSamplingCollectionMode mode = CUPTI_PC_SAMPLING_COLLECTION_MODE_CONTINUOUS;
+
+    Init();
+    s_Input.buffersPerPass = (size_t)parser.get<int>("--buffers");
+    s_Input.contextInfo.contextUid = 0;
+
+    if (!fixture.empty())
+    {
+        LoadFixture(&s_Input, fixture);
+        mode = collectionMode;
+    }
+    else
+    {
+        CuptiMockGetWorkload(&workload);
+        workload.numPcs = (uint32_t)parser.get<int>("--pcs");
+        CuptiMockSetWorkload(&workload);
+
+        QueryStallReasons(&s_Input.contextInfo.pcSamplingStallReasons);
+    }
+    SetConfigurationInfo(&s_Input.contextInfo, mode);
+
+    // Circular buffers sized as in pc_sampling_continuous.
+    stallReasonsCount = s_Input.contextInfo.pcSamplingStallReasons.numStallReasons;
+    g_circularBuffer.resize(g_circularbufCount);
+    g_bufferEmptyTrackerArray.resize(g_circularbufCount, false);
+    PreallocateBuffersForRecords();
+
+    g_fileName = PC_STORE_FILE_NAME;
+    s_Input.storeFile = std::to_string((long int)s_Input.contextInfo.contextUid) + "_" + g_fileName;
+
+    report.benchmark = "pc_sampling_benchmark";
+    report.label = parser.get<std::string>("--label");
+    report.input = fixture.empty() ? "synthetic" : fixture;
+
+    // The replay restarts with every pass, so every pass stores the same PCs.
+    QueueStorePass(&s_Input);
+    RunBenchmarkStage(&report, "continuous_queue_store", s_Input.numStoredPcs, QueueStorePass, &s_Input, minTimeMs);
+
+    // The fixture, or the file written by the last store pass, is read by pc_sampling_utility.
+    fileName = fixture.empty() ? s_Input.storeFile : fixture;
+    buffersRetrievedDataVector.clear();
+    RetrievePcSampData();
+    uint64_t numFilePcs = CountPcs(buffersRetrievedDataVector.data(), buffersRetrievedDataVector.size());
+    FreePcSampDataBuffers(buffersRetrievedDataVector.data(), buffersRetrievedDataVector.size());
+    FreePcSampStallReasonsMemory();
+    pcSamplingStallReasonsRetrieve = {};
+
+    RunBenchmarkStage(&report, "retrieve_pc_samp_data", numFilePcs, RetrievePass, &s_Input, minTimeMs);
+
+    // Source correlation input, merged as pc_sampling_utility does.
+    CUpti_PCSamplingData *pMergedPcSampDataBuffer = NULL;
+    size_t numMergedPcSampDataBuffer = 0;
+
+    buffersRetrievedDataVector.clear();
+    RetrievePcSampData();
+    if (collectionMode != CUPTI_PC_SAMPLING_COLLECTION_MODE_KERNEL_SERIALIZED)
+    {
+        MergePcSampDataBuffers(&pMergedPcSampDataBuffer, numMergedPcSampDataBuffer);
+        s_Input.pCorrelationBuffers = pMergedPcSampDataBuffer;
+        s_Input.numCorrelationBuffers = numMergedPcSampDataBuffer;
+    }
+    else
+    {
+        s_Input.pCorrelationBuffers = buffersRetrievedDataVector.data();
+        s_Input.numCorrelationBuffers = buffersRetrievedDataVector.size();
+    }
+    FillPlaceholderModules(s_Input.pCorrelationBuffers, s_Input.numCorrelationBuffers);
+
+    // SourceCorrelation() prints every PC.
+    SuppressStdout();
+    RunBenchmarkStage(&report, "source_correlation", CountPcs(s_Input.pCorrelationBuffers, s_Input.numCorrelationBuffers),
+                      SourceCorrelationPass, &s_Input, minTimeMs);
+    RestoreStdout();
+
+    WriteBenchmarkReport(parser.get<std::string>("--output"), &report);
+
+    FreePcSampStallReasonsMemory();
+    FreePcSampDataBuffers(pMergedPcSampDataBuffer, numMergedPcSampDataBuffer);
+    FreePcSampDataBuffers(buffersRetrievedDataVector.data(), buffersRetrievedDataVector.size());
+    FreeCrcModuleMapMemory();
+
+    CuptiMockSetPcSamplingData(NULL, 0);
+    FreePcSampDataBuffers(s_Input.fixtureBuffers.data(), s_Input.fixtureBuffers.size());
+    FreeCircularBuffers();
+    FreeStoredFunctionNames();
+    for (size_t i = 0; i < s_Input.contextInfo.pcSamplingStallReasons.numStallReasons; i++)
+    {
+        free(s_Input.contextInfo.pcSamplingStallReasons.stallReasons[i]);
+    }
+    free(s_Input.contextInfo.pcSamplingStallReasons.stallReasons);
+    free(s_Input.contextInfo.pcSamplingStallReasons.stallReasonIndex);
+    remove(s_Input.storeFile.c_str());
+
+    return EXIT_SUCCESS;
+}
@@ -20,27 +20,76 @@
 
 // Macros
 #define METRIC_NAME "ipc"
+#define NUM_LAUNCHES 1
+#define EVENT_NAME_LEN 128
 
 // Variables
 
+// Layout of one event group, cached at setup so the kernel exit callback only reads counters.
+typedef struct GroupLayout_st
+{
+    // The event group.
+    CUpti_EventGroup group;
+    // The number of events in the group.
+    uint32_t numEvents;
+    // The number of domain instances counted by the group.
+    uint32_t numInstances;
+    // The total number of domain instances on the device.
+    uint32_t numTotalInstances;
+    // Column of the first event of the group in a launch table row.
+    uint32_t firstColumn;
+    // Event ids in the order of CUPTI_EVENT_GROUP_ATTR_EVENTS, the columns of the launch table.
+    CUpti_EventID *pEventIds;
+    // Preallocated buffer for the event ids returned by cuptiEventGroupReadAllEvents, checked against pEventIds.
+    CUpti_EventID *pReadEventIds;
+    // Preallocated read buffer, numInstances x numEvents values.
+    uint64_t *pValues;
+    // Preallocated per event sum over instances.
+    uint64_t *pSum;
+} GroupLayout;
+
+// Event values of every kernel launch, one row of numEvents columns per launch.
+typedef struct LaunchTable_st
+{
+    // The number of columns in a row.
+    uint32_t numEvents;
+    // The number of rows allocated.
+    uint32_t capacity;
+    // The number of rows filled, i.e. the most launches seen in a pass.
+    uint32_t numLaunches;
+    // Row major event values.
+    uint64_t *pValues;
+} LaunchTable;
+
 // User data for event collection callback.
 typedef struct MetricData_st
 {
     // The device where metric is being collected.
     CUdevice device;
-    // The set of event groups to collect for a pass.
-    CUpti_EventGroupSet *pEventGroups;
-    // The current number of events collected in pEventIdArray and pEventValueArray.
-    uint32_t eventIdx;
-    // The number of entries in pEventIdArray and pEventValueArray.
+    // The number of passes needed to collect all events of the metric.
+    uint32_t numPasses;
+    // Per pass number of event groups.
+    uint32_t *pNumGroups;
+    // Per pass event group layouts.
+    GroupLayout **ppGroups;
+    // The pass being collected.
+    uint32_t pass;
+    // The number of launches seen so far in the current pass.
+    uint32_t launchIndex;
+    // The number of events needed by the metric, i.e. the columns of the launch table.
     uint32_t numEvents;
-    // Array of event ids.
+    // Array of event ids in column order.
     CUpti_EventID *pEventIdArray;
-    // Array of event values.
-    uint64_t *pEventValueArray;
+    // Array of event names in column order.
+    char (*pEventNames)[EVENT_NAME_LEN];
+    // Collected per launch event values.
+    LaunchTable launchTable;
 } MetricData;
 
-static uint64_t s_KernelDuration;
+// Kernel durations of the launches, in launch order, from the activity pass.
+static uint64_t *s_pKernelDurations;
+static uint32_t s_numKernelDurations;
+static uint32_t s_maxKernelDurations;
 
 // Kernels
 __global__ void
@@ -70,7 +119,8 @@ InitializeVector(
 }
 
 static void
-DoPass()
+DoPass(
+    int numLaunches)
 {
     int N = 50000;
     size_t size = N * sizeof(int);
@@ -107,10 +157,13 @@ DoPass()
     // Invoke kernel.
     threadsPerBlock = 256;
     blocksPerGrid = (N + threadsPerBlock - 1) / threadsPerBlock;
-    printf("Launching kernel: blocks %d, thread/block %d\n", blocksPerGrid, threadsPerBlock);
+    printf("Launching kernel %d times: blocks %d, thread/block %d\n", numLaunches, blocksPerGrid, threadsPerBlock);
 
-    VectorAdd <<< blocksPerGrid, threadsPerBlock >>> (pDeviceA, pDeviceB, pDeviceC, N);
-    RUNTIME_API_CALL(cudaGetLastError());
+    for (i = 0; i < numLaunches; i++)
+    {
+        VectorAdd <<< blocksPerGrid, threadsPerBlock >>> (pDeviceA, pDeviceB, pDeviceC, N);
+        RUNTIME_API_CALL(cudaGetLastError());
+    }
 
     // Copy result from device memory to host memory.
     // pHostC contains the result in host memory.
@@ -156,6 +209,56 @@ DoPass()
     }
 }
 
+// Grows the launch table when a pass launches more kernels than expected.
+// Rows are preallocated for the expected launch count, so this is not hit in steady state.
+static uint64_t *
+GetLaunchRow(
+    LaunchTable *pLaunchTable,
+    uint32_t launchIndex)
+{
+    if (launchIndex >= pLaunchTable->capacity)
+    {
+        uint32_t capacity = pLaunchTable->capacity ? pLaunchTable->capacity * 2 : 1;
+        while (capacity <= launchIndex)
+        {
+            capacity *= 2;
+        }
+
+        pLaunchTable->pValues = (uint64_t *)realloc(pLaunchTable->pValues, (size_t)capacity * pLaunchTable->numEvents * sizeof(uint64_t));
+        MEMORY_ALLOCATION_CALL(pLaunchTable->pValues);
+        memset(pLaunchTable->pValues + (size_t)pLaunchTable->capacity * pLaunchTable->numEvents, 0,
+               (size_t)(capacity - pLaunchTable->capacity) * pLaunchTable->numEvents * sizeof(uint64_t));
+        pLaunchTable->capacity = capacity;
+    }
+
+    if (launchIndex >= pLaunchTable->numLaunches)
+    {
+        pLaunchTable->numLaunches = launchIndex + 1;
+    }
+
+    return pLaunchTable->pValues + (size_t)launchIndex * pLaunchTable->numEvents;
+}
+
+// Sums the values of all instances for every event of a group.
+// Instance rows are contiguous, so the inner loop is a straight vector add.
+static void
+SumInstances(
+    const uint64_t * __restrict__ pValues,
+    uint64_t * __restrict__ pSum,
+    uint32_t numInstances,
+    uint32_t numEvents)
+{
+    memcpy(pSum, pValues, sizeof(uint64_t) * numEvents);
+    for (uint32_t k = 1; k < numInstances; k++)
+    {
+        const uint64_t * __restrict__ pInstanceValues = pValues + (size_t)k * numEvents;
+        for (uint32_t j = 0; j < numEvents; j++)
+        {
+            pSum[j] += pInstanceValues[j];
+        }
+    }
+}
+
 void CUPTIAPI
 MetricCallbackHandler(
     void *pUserdata,
@@ -164,7 +267,9 @@ MetricCallbackHandler(
     const CUpti_CallbackData *pCallbackData)
 {
     MetricData *pMetricData = (MetricData*)pUserdata;
-    unsigned int i, j, k;
+    uint32_t numGroups = pMetricData->pNumGroups[pMetricData->pass];
+    GroupLayout *pGroups = pMetricData->ppGroups[pMetricData->pass];
+    unsigned int i, j;
 
     // This callback is enabled only for launch so we shouldn't see anything else.
     if ((callbackId != CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020) &&
@@ -174,127 +279,236 @@ MetricCallbackHandler(
         exit(EXIT_FAILURE);
     }
 
-    // On entry, enable all the event groups being collected this pass,
-    // for metrics we collect for all instances of the event.
+    // On entry, enable all the event groups being collected this pass.
+    // Collection mode and instance attributes are set once at setup.
     if (pCallbackData->callbackSite == CUPTI_API_ENTER)
     {
         RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-        CUPTI_API_CALL(cuptiSetEventCollectionMode(pCallbackData->context, CUPTI_EVENT_COLLECTION_MODE_KERNEL));
-
-        for (i = 0; i < pMetricData->pEventGroups->numEventGroups; i++)
+        for (i = 0; i < numGroups; i++)
         {
-            uint32_t all = 1;
-            CUPTI_API_CALL(cuptiEventGroupSetAttribute(pMetricData->pEventGroups->eventGroups[i], CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(all), &all));
-            CUPTI_API_CALL(cuptiEventGroupEnable(pMetricData->pEventGroups->eventGroups[i]));
+            CUPTI_API_CALL(cuptiEventGroupEnable(pGroups[i].group));
         }
     }
 
-    // On exit, read and record event values.
+    // On exit, read and record event values into this launch's row.
     if (pCallbackData->callbackSite == CUPTI_API_EXIT)
     {
         RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-        // For each group, read the event values from the group and record in pMetricData.
-        for (i = 0; i < pMetricData->pEventGroups->numEventGroups; i++)
+        uint64_t *pRow = GetLaunchRow(&pMetricData->launchTable, pMetricData->launchIndex);
+
+        for (i = 0; i < numGroups; i++)
         {
-            CUpti_EventGroup group = pMetricData->pEventGroups->eventGroups[i];
-            CUpti_EventDomainID groupDomain;
-            CUpti_EventID *pEventIds;
+            GroupLayout *pGroup = &pGroups[i];
+            size_t expectedValuesSize = sizeof(uint64_t) * pGroup->numInstances * pGroup->numEvents;
+            size_t expectedEventIdsSize = sizeof(CUpti_EventID) * pGroup->numEvents;
+            size_t valuesSize = expectedValuesSize;
+            size_t eventIdsSize = expectedEventIdsSize;
+            size_t numEventIdsRead = 0;
+
+            CUPTI_API_CALL(cuptiEventGroupReadAllEvents(pGroup->group, CUPTI_EVENT_READ_FLAG_NONE, &valuesSize, pGroup->pValues, &eventIdsSize, pGroup->pReadEventIds, &numEventIdsRead));
+
+            // The columns assume the layout cached at setup: same events, in the same order, for every instance.
+            if (numEventIdsRead != pGroup->numEvents || valuesSize != expectedValuesSize ||
+                eventIdsSize != expectedEventIdsSize || memcmp(pGroup->pReadEventIds, pGroup->pEventIds, expectedEventIdsSize) != 0)
+            {
+                fprintf(stderr, "Error: Event group read returned %llu event ids (%llu bytes of values, %llu bytes of event ids) not matching the cached layout of %u events x %u instances.\n",
+                        (unsigned long long)numEventIdsRead, (unsigned long long)valuesSize, (unsigned long long)eventIdsSize,
+                        pGroup->numEvents, pGroup->numInstances);
+                exit(EXIT_FAILURE);
+            }
 
-            uint32_t numEvents, numInstances, numTotalInstances;
+            SumInstances(pGroup->pValues, pGroup->pSum, pGroup->numInstances, pGroup->numEvents);
 
-            size_t groupDomainSize = sizeof(groupDomain);
-            size_t numEventsSize = sizeof(numEvents);
-            size_t numInstancesSize = sizeof(numInstances);
-            size_t numTotalInstancesSize = sizeof(numTotalInstances);
-            size_t valuesSize, eventIdsSize;
-            size_t numCountersRead = 0;
+            // Normalize the event value to represent the total number of domain instances on the device.
+            for (j = 0; j < pGroup->numEvents; j++)
+            {
+                pRow[pGroup->firstColumn + j] = (pGroup->pSum[j] * pGroup->numTotalInstances) / pGroup->numInstances;
+            }
+        }
 
-            uint64_t *pValues, normalized, *pSum;
+        for (i = 0; i < numGroups; i++)
+        {
+            CUPTI_API_CALL(cuptiEventGroupDisable(pGroups[i].group));
+        }
+
+        pMetricData->launchIndex++;
+    }
+}
+
+// Query the layout of every event group of every pass once and allocate all buffers used while collecting.
+static void
+SetupMetricData(
+    MetricData *pMetricData,
+    CUcontext context,
+    CUpti_EventGroupSets *pPassData,
+    uint32_t numLaunches)
+{
+    uint32_t column = 0;
 
-            CUPTI_API_CALL(cuptiEventGroupGetAttribute(group, CUPTI_EVENT_GROUP_ATTR_EVENT_DOMAIN_ID, &groupDomainSize, &groupDomain));
-            CUPTI_API_CALL(cuptiDeviceGetEventDomainAttribute(pMetricData->device, groupDomain, CUPTI_EVENT_DOMAIN_ATTR_TOTAL_INSTANCE_COUNT, &numTotalInstancesSize, &numTotalInstances));
-            CUPTI_API_CALL(cuptiEventGroupGetAttribute(group, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &numInstancesSize, &numInstances));
-            CUPTI_API_CALL(cuptiEventGroupGetAttribute(group, CUPTI_EVENT_GROUP_ATTR_NUM_EVENTS, &numEventsSize, &numEvents));
+    CUPTI_API_CALL(cuptiSetEventCollectionMode(context, CUPTI_EVENT_COLLECTION_MODE_KERNEL));
 
-            eventIdsSize = numEvents * sizeof(CUpti_EventID);
-            pEventIds = (CUpti_EventID *)malloc(eventIdsSize);
-            MEMORY_ALLOCATION_CALL(pEventIds);
+    pMetricData->numPasses = pPassData->numSets;
+    pMetricData->pNumGroups = (uint32_t *)calloc(pPassData->numSets, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pMetricData->pNumGroups);
+    pMetricData->ppGroups = (GroupLayout **)calloc(pPassData->numSets, sizeof(GroupLayout *));
+    MEMORY_ALLOCATION_CALL(pMetricData->ppGroups);
 
-            CUPTI_API_CALL(cuptiEventGroupGetAttribute(group, CUPTI_EVENT_GROUP_ATTR_EVENTS, &eventIdsSize, pEventIds));
+    pMetricData->pEventIdArray = (CUpti_EventID *)malloc(pMetricData->numEvents * sizeof(CUpti_EventID));
+    MEMORY_ALLOCATION_CALL(pMetricData->pEventIdArray);
+    pMetricData->pEventNames = (char (*)[EVENT_NAME_LEN])calloc(pMetricData->numEvents, EVENT_NAME_LEN);
+    MEMORY_ALLOCATION_CALL(pMetricData->pEventNames);
 
-            valuesSize = sizeof(uint64_t) * numInstances * numEvents;
-            pValues = (uint64_t *)malloc(valuesSize);
-            MEMORY_ALLOCATION_CALL(pValues);
+    for (uint32_t pass = 0; pass < pPassData->numSets; pass++)
+    {
+        CUpti_EventGroupSet *pEventGroups = pPassData->sets + pass;
 
-            CUPTI_API_CALL(cuptiEventGroupReadAllEvents(group, CUPTI_EVENT_READ_FLAG_NONE, &valuesSize, pValues, &eventIdsSize, pEventIds, &numCountersRead));
+        pMetricData->pNumGroups[pass] = pEventGroups->numEventGroups;
+        pMetricData->ppGroups[pass] = (GroupLayout *)calloc(pEventGroups->numEventGroups, sizeof(GroupLayout));
+        MEMORY_ALLOCATION_CALL(pMetricData->ppGroups[pass]);
 
-            if (pMetricData->eventIdx >= pMetricData->numEvents)
+        for (uint32_t i = 0; i < pEventGroups->numEventGroups; i++)
+        {
+            GroupLayout *pGroup = &pMetricData->ppGroups[pass][i];
+            CUpti_EventDomainID groupDomain;
+            size_t groupDomainSize = sizeof(groupDomain);
+            size_t attributeSize = sizeof(uint32_t);
+            size_t eventIdsSize = 0;
+            uint32_t all = 1;
+
+            pGroup->group = pEventGroups->eventGroups[i];
+
+            // For metrics we collect for all instances of the event.
+            CUPTI_API_CALL(cuptiEventGroupSetAttribute(pGroup->group, CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(all), &all));
+
+            CUPTI_API_CALL(cuptiEventGroupGetAttribute(pGroup->group, CUPTI_EVENT_GROUP_ATTR_EVENT_DOMAIN_ID, &groupDomainSize, &groupDomain));
+            attributeSize = sizeof(uint32_t);
+            CUPTI_API_CALL(cuptiDeviceGetEventDomainAttribute(pMetricData->device, groupDomain, CUPTI_EVENT_DOMAIN_ATTR_TOTAL_INSTANCE_COUNT, &attributeSize, &pGroup->numTotalInstances));
+            attributeSize = sizeof(uint32_t);
+            CUPTI_API_CALL(cuptiEventGroupGetAttribute(pGroup->group, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &attributeSize, &pGroup->numInstances));
+            attributeSize = sizeof(uint32_t);
+            CUPTI_API_CALL(cuptiEventGroupGetAttribute(pGroup->group, CUPTI_EVENT_GROUP_ATTR_NUM_EVENTS, &attributeSize, &pGroup->numEvents));
+
+            if (column + pGroup->numEvents > pMetricData->numEvents)
             {
                 fprintf(stderr, "Error: Too many events collected, metric expects only %d events.\n", (int)pMetricData->numEvents);
                 exit(EXIT_FAILURE);
             }
 
-            pSum = (uint64_t *)calloc(sizeof(uint64_t), numEvents);
-            // Sum collected of event values from all instances.
-            for (k = 0; k < numInstances; k++)
+            eventIdsSize = pGroup->numEvents * sizeof(CUpti_EventID);
+            pGroup->pEventIds = (CUpti_EventID *)malloc(eventIdsSize);
+            MEMORY_ALLOCATION_CALL(pGroup->pEventIds);
+            CUPTI_API_CALL(cuptiEventGroupGetAttribute(pGroup->group, CUPTI_EVENT_GROUP_ATTR_EVENTS, &eventIdsSize, pGroup->pEventIds));
+            pGroup->pReadEventIds = (CUpti_EventID *)malloc(eventIdsSize);
+            MEMORY_ALLOCATION_CALL(pGroup->pReadEventIds);
+
+            pGroup->pValues = (uint64_t *)malloc(sizeof(uint64_t) * pGroup->numInstances * pGroup->numEvents);
+            MEMORY_ALLOCATION_CALL(pGroup->pValues);
+            pGroup->pSum = (uint64_t *)malloc(sizeof(uint64_t) * pGroup->numEvents);
+            MEMORY_ALLOCATION_CALL(pGroup->pSum);
+
+            // Resolve event names once instead of on every launch.
+            pGroup->firstColumn = column;
+            for (uint32_t j = 0; j < pGroup->numEvents; j++, column++)
             {
-                for (j = 0; j < numEvents; j++)
-                {
-                    pSum[j] += pValues[(k * numEvents) + j];
-                }
+                size_t eventNameSize = EVENT_NAME_LEN - 1;
+                pMetricData->pEventIdArray[column] = pGroup->pEventIds[j];
+                CUPTI_API_CALL(cuptiEventGetAttribute(pGroup->pEventIds[j], CUPTI_EVENT_ATTR_NAME, &eventNameSize, pMetricData->pEventNames[column]));
+                pMetricData->pEventNames[column][EVENT_NAME_LEN - 1] = '\0';
             }
+        }
+    }
 
-            for (j = 0; j < numEvents; j++)
-            {
-                // Normalize the event value to represent the total number of domain instances on the device.
-                normalized = (pSum[j] * numTotalInstances) / numInstances;
-
-                pMetricData->pEventIdArray[pMetricData->eventIdx] = pEventIds[j];
-                pMetricData->pEventValueArray[pMetricData->eventIdx] = normalized;
-                pMetricData->eventIdx++;
-
-                // Print collected value.
-                {
-                    char eventName[128];
-                    size_t eventNameSize = sizeof(eventName) - 1;
-                    CUPTI_API_CALL(cuptiEventGetAttribute(pEventIds[j], CUPTI_EVENT_ATTR_NAME,
-                                                      &eventNameSize, eventName));
-
-                    eventName[127] = '\0';
-                    printf("\t%s = %llu (", eventName, (unsigned long long)pSum[j]);
-                    if (numInstances > 1)
-                    {
-                        for (k = 0; k < numInstances; k++)
-                        {
-                            if (k != 0)
-                            {
-                                printf(", ");
-                            }
-                            printf("%llu", (unsigned long long)pValues[(k * numEvents) + j]);
-                        }
-                    }
-
-                    printf(")\n");
-                    printf("\t%s (normalized) (%llu * %u) / %u = %llu\n",
-                            eventName, (unsigned long long)pSum[j],
-                            numTotalInstances, numInstances,
-                            (unsigned long long)normalized);
-                }
-            }
+    if (column != pMetricData->numEvents)
+    {
+        fprintf(stderr, "Error: Expected %u metric events, got %u metric events.\n", pMetricData->numEvents, column);
+        exit(EXIT_FAILURE);
+    }
 
-            free(pValues);
-            free(pSum);
+    pMetricData->launchTable.numEvents = pMetricData->numEvents;
+    pMetricData->launchTable.capacity = numLaunches;
+    pMetricData->launchTable.numLaunches = 0;
+    pMetricData->launchTable.pValues = (uint64_t *)calloc((size_t)numLaunches * pMetricData->numEvents, sizeof(uint64_t));
+    MEMORY_ALLOCATION_CALL(pMetricData->launchTable.pValues);
+}
+
+static void
+FreeMetricData(
+    MetricData *pMetricData)
+{
+    for (uint32_t pass = 0; pass < pMetricData->numPasses; pass++)
+    {
+        for (uint32_t i = 0; i < pMetricData->pNumGroups[pass]; i++)
+        {
+            free(pMetricData->ppGroups[pass][i].pEventIds);
+            free(pMetricData->ppGroups[pass][i].pReadEventIds);
+            free(pMetricData->ppGroups[pass][i].pValues);
+            free(pMetricData->ppGroups[pass][i].pSum);
         }
+        free(pMetricData->ppGroups[pass]);
+    }
+
+    free(pMetricData->ppGroups);
+    free(pMetricData->pNumGroups);
+    free(pMetricData->pEventIdArray);
+    free(pMetricData->pEventNames);
+    free(pMetricData->launchTable.pValues);
+}
+
+// Record the duration of each kernel from the activity pass, in launch order.
+static void
+RecordKernelDuration(
+    CUpti_Activity *pRecord)
+{
+    if (pRecord->kind == CUPTI_ACTIVITY_KIND_KERNEL)
+    {
+        CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
 
-        for (i = 0; i < pMetricData->pEventGroups->numEventGroups; i++)
+        if (s_numKernelDurations < s_maxKernelDurations)
         {
-            CUPTI_API_CALL(cuptiEventGroupDisable(pMetricData->pEventGroups->eventGroups[i]));
+            s_pKernelDurations[s_numKernelDurations++] = pKernelRecord->end - pKernelRecord->start;
         }
     }
 }
 
+// Print the metric value, we format based on the value kind.
+static void
+PrintMetricValue(
+    CUpti_MetricID metricId,
+    const char *pMetricName,
+    CUpti_MetricValue metricValue)
+{
+    CUpti_MetricValueKind valueKind;
+    size_t valueKindSize = sizeof(valueKind);
+
+    CUPTI_API_CALL(cuptiMetricGetAttribute(metricId, CUPTI_METRIC_ATTR_VALUE_KIND, &valueKindSize, &valueKind));
+    switch (valueKind)
+    {
+        case CUPTI_METRIC_VALUE_KIND_DOUBLE:
+            printf("Metric %s = %f\n", pMetricName, metricValue.metricValueDouble);
+            break;
+        case CUPTI_METRIC_VALUE_KIND_UINT64:
+            printf("Metric %s = %llu\n", pMetricName, (unsigned long long)metricValue.metricValueUint64);
+            break;
+        case CUPTI_METRIC_VALUE_KIND_INT64:
+            printf("Metric %s = %lld\n", pMetricName, (long long)metricValue.metricValueInt64);
+            break;
+        case CUPTI_METRIC_VALUE_KIND_PERCENT:
+            printf("Metric %s = %f%%\n", pMetricName, metricValue.metricValuePercent);
+            break;
+        case CUPTI_METRIC_VALUE_KIND_THROUGHPUT:
+            printf("Metric %s = %llu bytes/sec\n", pMetricName, (unsigned long long)metricValue.metricValueThroughput);
+            break;
+        case CUPTI_METRIC_VALUE_KIND_UTILIZATION_LEVEL:
+            printf("Metric %s = utilization level %u\n", pMetricName, (unsigned int)metricValue.metricValueUtilizationLevel);
+            break;
+        default:
+            fprintf(stderr, "Error: unknown value kind.\n");
+            exit(EXIT_FAILURE);
+    }
+}
+
 static void
 SetupCupti()
 {
@@ -302,7 +516,7 @@ SetupCupti()
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
-    pUserData->pPostProcessActivityRecords = NULL;
+    pUserData->pPostProcessActivityRecords = RecordKernelDuration;
     pUserData->printActivityRecords        = 1;
     pUserData->skipCuptiSubscription       = 1;
 
@@ -332,8 +546,9 @@ main(
 
     MetricData metricData;
     unsigned int pass;
+    int numLaunches = NUM_LAUNCHES;
 
-    printf("Usage: %s [device_num] [metric_name].\n", argv[0]);
+    printf("Usage: %s [device_num] [metric_name] [num_launches].\n", argv[0]);
 
     // Initialize CUDA
     DRIVER_API_CALL(cuInit(0));
@@ -384,13 +599,27 @@ main(
         pMetricName = METRIC_NAME;
     }
 
+    if (argc > 3)
+    {
+        numLaunches = atoi(argv[3]);
+        if (numLaunches <= 0)
+        {
+            numLaunches = NUM_LAUNCHES;
+        }
+    }
+
+    memset(&metricData, 0, sizeof(metricData));
+    s_maxKernelDurations = numLaunches;
+    s_pKernelDurations = (uint64_t *)calloc(numLaunches, sizeof(uint64_t));
+    MEMORY_ALLOCATION_CALL(s_pKernelDurations);
+
     // Need to collect duration of kernel execution without any event
     // collection enabled (some metrics need kernel duration as part of
     // calculation). The only accurate way to do this is by using the
     // activity API.
     {
         SetupCupti();
-        DoPass();
+        DoPass(numLaunches);
         RUNTIME_API_CALL(cudaDeviceSynchronize());
         CUPTI_API_CALL(cuptiActivityFlushAll(0));
     }
@@ -400,67 +629,44 @@ main(
     CUPTI_API_CALL(cuptiEnableCallback(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaLaunch_v3020));
     CUPTI_API_CALL(cuptiEnableCallback(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000));
 
-    // Allocate space to hold all the events needed for the metric.
+    // Get the events needed for the metric and the event groups for each pass,
+    // and cache their layout before any kernel is launched.
     CUPTI_API_CALL(cuptiMetricGetIdFromName(device, pMetricName, &metricId));
     CUPTI_API_CALL(cuptiMetricGetNumEvents(metricId, &metricData.numEvents));
     metricData.device = device;
-    metricData.pEventIdArray = (CUpti_EventID *)malloc(metricData.numEvents * sizeof(CUpti_EventID));
-    MEMORY_ALLOCATION_CALL(metricData.pEventIdArray);
-    metricData.pEventValueArray = (uint64_t *)malloc(metricData.numEvents * sizeof(uint64_t));
-    MEMORY_ALLOCATION_CALL(metricData.pEventValueArray);
-    metricData.eventIdx = 0;
-
-    // Get the number of passes required to collect all the events.
-    // Needed for the metric and the event groups for each pass.
+
     CUPTI_API_CALL(cuptiMetricCreateEventGroupSets(context, sizeof(metricId), &metricId, &pPassData));
+    SetupMetricData(&metricData, context, pPassData, numLaunches);
+
+    // Every pass replays the same launches, each pass fills its own columns of the launch rows.
     for (pass = 0; pass < pPassData->numSets; pass++)
     {
         printf("Pass: %u\n", pass);
-        metricData.pEventGroups = pPassData->sets + pass;
-        DoPass();
-    }
-
-    if (metricData.eventIdx != metricData.numEvents)
-    {
-        fprintf(stderr, "Error: Expected %u metric events, got %u metric events.\n", metricData.numEvents, metricData.eventIdx);
-        exit(EXIT_FAILURE);
+        metricData.pass = pass;
+        metricData.launchIndex = 0;
+        DoPass(numLaunches);
     }
 
-    // Use all the collected events to calculate the metric value.
-    CUPTI_API_CALL(cuptiMetricGetValue(device, metricId, metricData.numEvents * sizeof(CUpti_EventID), metricData.pEventIdArray, metricData.numEvents * sizeof(uint64_t), metricData.pEventValueArray, s_KernelDuration, &metricValue));
-
-    // Print the metric value, we format based on the value kind.
+    // Use the collected events of each launch to calculate its metric value.
+    for (uint32_t launch = 0; launch < metricData.launchTable.numLaunches; launch++)
     {
-        CUpti_MetricValueKind valueKind;
-        size_t valueKindSize = sizeof(valueKind);
+        const uint64_t *pRow = metricData.launchTable.pValues + (size_t)launch * metricData.numEvents;
+        uint64_t kernelDuration = (launch < s_numKernelDurations) ? s_pKernelDurations[launch] : 0;
 
-        CUPTI_API_CALL(cuptiMetricGetAttribute(metricId, CUPTI_METRIC_ATTR_VALUE_KIND, &valueKindSize, &valueKind));
-        switch (valueKind)
+        printf("Launch %u: duration %llu ns\n", launch, (unsigned long long)kernelDuration);
+        for (uint32_t column = 0; column < metricData.numEvents; column++)
         {
-            case CUPTI_METRIC_VALUE_KIND_DOUBLE:
-                printf("Metric %s = %f\n", pMetricName, metricValue.metricValueDouble);
-                break;
-            case CUPTI_METRIC_VALUE_KIND_UINT64:
-                printf("Metric %s = %llu\n", pMetricName, (unsigned long long)metricValue.metricValueUint64);
-                break;
-            case CUPTI_METRIC_VALUE_KIND_INT64:
-                printf("Metric %s = %lld\n", pMetricName, (long long)metricValue.metricValueInt64);
-                break;
-            case CUPTI_METRIC_VALUE_KIND_PERCENT:
-                printf("Metric %s = %f%%\n", pMetricName, metricValue.metricValuePercent);
-                break;
-            case CUPTI_METRIC_VALUE_KIND_THROUGHPUT:
-                printf("Metric %s = %llu bytes/sec\n", pMetricName, (unsigned long long)metricValue.metricValueThroughput);
-                break;
-            case CUPTI_METRIC_VALUE_KIND_UTILIZATION_LEVEL:
-                printf("Metric %s = utilization level %u\n", pMetricName, (unsigned int)metricValue.metricValueUtilizationLevel);
-                break;
-            default:
-                fprintf(stderr, "Error: unknown value kind.\n");
-                exit(EXIT_FAILURE);
+            printf("\t%s (normalized) = %llu\n", metricData.pEventNames[column], (unsigned long long)pRow[column]);
         }
+
+        CUPTI_API_CALL(cuptiMetricGetValue(device, metricId, metricData.numEvents * sizeof(CUpti_EventID), metricData.pEventIdArray, metricData.numEvents * sizeof(uint64_t), (uint64_t *)pRow, kernelDuration, &metricValue));
+        printf("\t");
+        PrintMetricValue(metricId, pMetricName, metricValue);
     }
 
+    FreeMetricData(&metricData);
+    free(s_pKernelDurations);
+
     DeInitCuptiTrace();
 
     exit(EXIT_SUCCESS);
@@ -4,6 +4,10 @@
  * Sample app to demonstrate use of CUPTI library to obtain timestamps
  * using callbacks for CUDA runtime APIs
  *
+ * With --apiTiming every runtime and driver API call is also timed by the
+ * per-thread tracer of helper_cupti_api_timing.h, which reports the latency
+ * distribution of each API and its own overhead.
+ *
  */
 
 // System headers
@@ -11,6 +15,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <iostream>
+#include <string>
+
 // CUDA headers
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -19,6 +26,7 @@
 #include "cupti.h"
 #include "helper_cupti.h"
 #include "helper_cupti_activity.h"
+#include "helper_cupti_api_timing.h"
 
 // Structure to hold data collected by callback.
 typedef struct RuntimeApiTrace_st
@@ -40,6 +48,10 @@ enum launchOrder
     LAUNCH_LAST
 };
 
+// Global variables
+static ApiTimingTracer s_ApiTimingTracer;
+static int s_ApiTimingEnabled = 0;
+
 // Kernel
 // Vector addition kernel.
 __global__ void
@@ -82,6 +94,12 @@ TimestampCallback(
     uint64_t endTimestamp;
     RuntimeApiTrace *pRuntimeApiTrace = (RuntimeApiTrace*)pUserdata;
 
+    if (s_ApiTimingEnabled &&
+        (domain == CUPTI_CB_DOMAIN_RUNTIME_API || domain == CUPTI_CB_DOMAIN_DRIVER_API))
+    {
+        ApiTimingCallback(&s_ApiTimingTracer, domain, callbackId, pCallbackData);
+    }
+
     switch(domain)
     {
         case CUPTI_CB_DOMAIN_RUNTIME_API:
@@ -247,6 +265,16 @@ CleanUp(
     }
 }
 
+static void
+PrintUsage(void)
+{
+    std::cout << "Usage: \n"
+              << "  ./callback_timestamp -t [ --apiTiming ] <value> -r [ --rawEvents ] <file>\n"
+              << "  --apiTiming: Non-zero value to time every runtime and driver API call with a per-thread\n"
+              << "    tracer and report the latency histograms and the tracer overhead, 0 to disable (disabled by default)\n"
+              << "  --rawEvents: With --apiTiming, also write every API call to the CSV file\n";
+}
+
 int
 main(
     int argc,
@@ -269,6 +297,53 @@ main(
     CUpti_SubscriberHandle subscriber;
     RuntimeApiTrace pRuntimeApiTrace[LAUNCH_LAST];
 
+    std::string rawEventsFile;
+    FILE *pRawEventsFile = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--apiTiming" || arg == "-t" || arg == "--rawEvents" || arg == "-r")
+        {
+            if (i + 1 >= argc)
+            {
+                std::cout << "Missing value for " << arg << " option." << std::endl;
+                PrintUsage();
+                return 1;
+            }
+
+            if (arg == "--apiTiming" || arg == "-t")
+            {
+                s_ApiTimingEnabled = std::atoi(argv[++i]) ? 1 : 0;
+            }
+            else
+            {
+                rawEventsFile = argv[++i];
+            }
+        }
+        else
+        {
+            std::cout << "Unknown option: " << arg << std::endl;
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (s_ApiTimingEnabled)
+    {
+        if (!rawEventsFile.empty())
+        {
+            pRawEventsFile = fopen(rawEventsFile.c_str(), "w");
+            if (!pRawEventsFile)
+            {
+                std::cout << "Error: Failed to open " << rawEventsFile << " for writing." << std::endl;
+                return 1;
+            }
+        }
+
+        InitApiTimingTracer(&s_ApiTimingTracer, API_TIMING_DEFAULT_RING_CAPACITY, API_TIMING_DEFAULT_DRAIN_INTERVAL_MS, pRawEventsFile);
+    }
+
     globals.pOutputFile = stdout;
     // Subscribe to CUPTI callbacks.
     CUPTI_API_CALL_VERBOSE(cuptiSubscribe(&subscriber, (CUpti_CallbackFunc)TimestampCallback , &pRuntimeApiTrace));
@@ -277,6 +352,11 @@ main(
     // Callback will be invoked at the entry and exit points of each of the CUDA Runtime API.
     CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, subscriber, CUPTI_CB_DOMAIN_RUNTIME_API));
 
+    if (s_ApiTimingEnabled)
+    {
+        CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, subscriber, CUPTI_CB_DOMAIN_DRIVER_API));
+    }
+
     // Enable the state domain callbacks for instantaneous error reporting.
     CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, subscriber, CUPTI_CB_DOMAIN_STATE));
 
@@ -339,12 +419,30 @@ main(
 
     CUPTI_API_CALL_VERBOSE(cuptiUnsubscribe(subscriber));
 
+    if (s_ApiTimingEnabled)
+    {
+        StopApiTimingTracer(&s_ApiTimingTracer);
+        PrintApiTimingReport(&s_ApiTimingTracer, stdout);
+        FreeApiTimingTracer(&s_ApiTimingTracer);
+
+        if (pRawEventsFile)
+        {
+            fclose(pRawEventsFile);
+        }
+    }
+
     exit(EXIT_SUCCESS);
 
 Error:
     CleanUp(pHostA, pHostB, pHostC, pDeviceA, pDeviceB, pDeviceC);
     RUNTIME_API_CALL(cudaDeviceSynchronize());
 
+    if (s_ApiTimingEnabled)
+    {
+        // The collector thread must be joined before the static destructors run.
+        StopApiTimingTracer(&s_ApiTimingTracer);
+    }
+
     exit(EXIT_FAILURE);
 }
 
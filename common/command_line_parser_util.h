@@ -70,8 +70,15 @@ class CommandLineParser
 
     std::unordered_map<std::string, std::string> m_aliasMap;  // short -> long
     std::map<std::string, std::unique_ptr<OptionBase>> m_optionsMap;
+    bool m_rejectUnknownOptions = false;
 
 public:
+    // By default unknown options are ignored, reject them to catch misspelled or misplaced options.
+    void setRejectUnknownOptions(bool reject)
+    {
+        m_rejectUnknownOptions = reject;
+    }
+
     template<typename T>
     void addOption(const std::string& shortName, const std::string& longName, const std::string& desc, const T& defaultValue)
     {
@@ -104,6 +111,9 @@ public:
 
             auto it = m_optionsMap.find(arg);
             if (it == m_optionsMap.end()) {
+                if (m_rejectUnknownOptions) {
+                    throw std::runtime_error("Unknown option: " + arg);
+                }
                 continue; // ignore unknown options
             }
 
@@ -22,9 +22,14 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <atomic>
+#include <chrono>
+
 // CUPTI headers
 #include <cupti.h>
 #include <helper_cupti.h>
+#include <helper_cupti_buffer_tuner.h>
+#include <helper_cupti_callback_dispatch.h>
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
@@ -54,6 +59,11 @@ typedef struct GlobalState_st
     void   *pUserData;                                               // User data used to initialize CUPTI trace. Refer UserData structure.
     uint64_t buffersRequested;                                       // Requested buffers by CUPTI.
     uint64_t buffersCompleted;                                       // Completed buffers by received from CUPTI.
+    std::atomic<uint64_t> bufferProcessingNs;                        // Time spent processing the completed buffers.
+    BufferTuner bufferTuner;                                         // Sizes the activity buffers when UserData::autoTuneBuffers is set.
+    void   (*pFatalErrorHandler)(void);                              // Called on a CUPTI fatal error before exiting, e.g. to save the recorded activity.
+    void   (*pRecordBuffer)(uint8_t *pBuffer, size_t validSize);     // Called by BufferCompleted() with every non empty buffer before the records are printed, e.g. to keep a copy.
+    CallbackDispatch callbackDispatch;                               // Handlers of CuptiCallbackHandler(), by domain and callback id.
 } GlobalState;
 
 // User data provided by the application using InitCuptiTrace()
@@ -68,11 +78,12 @@ typedef struct UserData_st
     uint8_t printCallbacks;                                          // Print callbacks enabled in CUPTI.
     uint8_t printActivityRecords;                                    // Print CUPTI activity records.
     uint8_t skipCuptiSubscription;                                   // Check if the user application wants to skip subscription in CUPTI.
+    uint8_t autoTuneBuffers;                                         // Size the host and device activity buffers from the buffer telemetry, report at DeInitCuptiTrace().
     void    (*pPostProcessActivityRecords)(CUpti_Activity *pRecord); // Provide function pointer in the user application for CUPTI records for post processing.
 } UserData;
 
 // Global variables
-static GlobalState globals = { 0 };
+static GlobalState globals = { };
 
 // Helper Functions
 static const char *
@@ -1929,10 +1940,16 @@ BufferRequested(
     size_t *pSize,
     size_t *pMaxNumRecords)
 {
-    uint8_t *pBuffer = (uint8_t *) malloc(globals.activityBufferSize + ALIGN_SIZE);
+    size_t bufferSize = globals.activityBufferSize;
+    if (globals.bufferTuner.enabled)
+    {
+        bufferSize = BufferTunerOnRequested(&globals.bufferTuner);
+    }
+
+    uint8_t *pBuffer = (uint8_t *) malloc(bufferSize + ALIGN_SIZE);
     MEMORY_ALLOCATION_CALL(pBuffer);
 
-    *pSize = globals.activityBufferSize;
+    *pSize = bufferSize;
     *ppBuffer = ALIGN_BUFFER(pBuffer, ALIGN_SIZE);
     *pMaxNumRecords = 0;
 
@@ -1947,6 +1964,9 @@ BufferCompleted(
     size_t size,
     size_t validSize)
 {
+    // The callbacks no longer check cuptiGetLastError(), check it here on a thread CUPTI calls back.
+    CUPTI_API_CALL(cuptiGetLastError());
+
     if (validSize > 0)
     {
         FILE *pOutputFile = globals.pOutputFile;
@@ -1955,7 +1975,20 @@ BufferCompleted(
             pOutputFile = stdout;
         }
 
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (globals.pRecordBuffer)
+        {
+            globals.pRecordBuffer(pBuffer, validSize);
+        }
         PrintActivityBuffer(pBuffer, validSize, pOutputFile, globals.pUserData);
+        globals.bufferProcessingNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    if (globals.bufferTuner.enabled)
+    {
+        size_t droppedRecords = 0;
+        CUPTI_API_CALL(cuptiActivityGetNumDroppedRecords(context, streamId, &droppedRecords));
+        BufferTunerOnCompleted(&globals.bufferTuner, context, streamId, size, validSize, droppedRecords);
     }
 
     globals.buffersCompleted++;
@@ -2000,6 +2033,11 @@ HandleDomainStateCallback(
             fprintf(globals.pOutputFile, "\nCUPTI encountered fatal error: %s\n", errorString);
             fprintf(globals.pOutputFile, "Error message: %s\n", pStateData->notification.message);
 
+            if (globals.pFatalErrorHandler)
+            {
+                globals.pFatalErrorHandler();
+            }
+
             // Exiting the application if fatal error encountered in CUPTI
             // If there is a CUPTI fatal error, it means CUPTI has stopped profiling the application.
             exit(EXIT_FAILURE);
@@ -2009,48 +2047,51 @@ HandleDomainStateCallback(
     }
 }
 
-static void CUPTIAPI
-CuptiCallbackHandler(
+// Handlers registered by InitCuptiTrace() in globals.callbackDispatch.
+static void
+DispatchStateCallback(
     void *pUserData,
     CUpti_CallbackDomain domain,
     CUpti_CallbackId callbackId,
     const void *pCallbackData)
 {
-    CUPTI_API_CALL(cuptiGetLastError());
+    HandleDomainStateCallback(callbackId, (const CUpti_StateData *)pCallbackData);
+}
 
-    if (((UserData *)pUserData)->printCallbacks &&
-        globals.pOutputFile != NULL)
+static void
+DispatchDeviceResetCallback(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    if (((const CUpti_CallbackData *)pCallbackData)->callbackSite == CUPTI_API_ENTER)
     {
-        fprintf(globals.pOutputFile, "CUPTI Callback: Domain %d CbId %d\n", domain, callbackId);
-        fflush(globals.pOutputFile);
+        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(0));
     }
+}
 
-    const CUpti_CallbackData *pCallabckInfo = (CUpti_CallbackData *)pCallbackData;
+static void
+DispatchSynchronizeCallback(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    HandleSyncronizationCallbacks(callbackId, (const CUpti_SynchronizeData *)pCallbackData, pUserData);
+}
 
-    switch (domain)
-    {
-        case CUPTI_CB_DOMAIN_STATE:
-            HandleDomainStateCallback(callbackId, (CUpti_StateData *)pCallbackData);
-            break;
-        case CUPTI_CB_DOMAIN_RUNTIME_API:
-            switch (callbackId)
-            {
-                case CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020:
-                    if (pCallabckInfo->callbackSite == CUPTI_API_ENTER)
-                    {
-                        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(0));
-                    }
-                    break;
-                default:
-                    break;
-            }
-            break;
-        case CUPTI_CB_DOMAIN_SYNCHRONIZE:
-            HandleSyncronizationCallbacks(callbackId, (CUpti_SynchronizeData *)pCallbackData, pUserData);
-            break;
-        default:
-            break;
-    }
+// Callbacks are dispatched through globals.callbackDispatch, samples add their handlers with RegisterCallbackHandler().
+// Errors are not checked per callback: the handlers check the return codes of the CUPTI calls they make, and
+// cuptiGetLastError() is checked by BufferCompleted() and DeInitCuptiTrace().
+static void CUPTIAPI
+CuptiCallbackHandler(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    DispatchCallback(&globals.callbackDispatch, domain, callbackId, pCallbackData);
 }
 
 // CUPTI Trace Setup
@@ -2081,6 +2122,16 @@ InitCuptiTrace(
         else
         {
             CUPTI_API_CALL_VERBOSE(cuptiSubscribe(&globals.subscriberHandle, (CUpti_CallbackFunc)CuptiCallbackHandler, pUserData));
+
+            RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_STATE, CUPTI_CBID_STATE_FATAL_ERROR, DispatchStateCallback, pUserData);
+            RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020, DispatchDeviceResetCallback, pUserData);
+            RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_SYNCHRONIZE, CUPTI_CBID_SYNCHRONIZE_CONTEXT_SYNCHRONIZED, DispatchSynchronizeCallback, pUserData);
+            RegisterCallbackHandler(&globals.callbackDispatch, CUPTI_CB_DOMAIN_SYNCHRONIZE, CUPTI_CBID_SYNCHRONIZE_STREAM_SYNCHRONIZED, DispatchSynchronizeCallback, pUserData);
+
+            if (((UserData *)pUserData)->printCallbacks && globals.pOutputFile != NULL)
+            {
+                StartCallbackPrinter(&globals.callbackDispatch, globals.pOutputFile);
+            }
         }
 
 
@@ -2130,6 +2181,12 @@ InitCuptiTrace(
     }
 
     std::cout << "Activity buffer size = " << globals.activityBufferSize << " bytes.\n";
+
+    if ((((UserData *)pUserData))->autoTuneBuffers)
+    {
+        InitBufferTuner(&globals.bufferTuner, globals.activityBufferSize);
+        std::cout << "Activity buffer auto-tuning enabled.\n";
+    }
 }
 
 static void
@@ -2142,8 +2199,16 @@ DeInitCuptiTrace(void)
         CUPTI_API_CALL_VERBOSE(cuptiUnsubscribe(globals.subscriberHandle));
     }
 
+    StopCallbackPrinter(&globals.callbackDispatch);
+
     CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
 
+    if (globals.bufferTuner.enabled)
+    {
+        PrintBufferTunerReport(&globals.bufferTuner, globals.pOutputFile ? globals.pOutputFile : stdout);
+        globals.bufferTuner.enabled = 0;
+    }
+
     if (globals.pUserData != NULL)
     {
         free(globals.pUserData);
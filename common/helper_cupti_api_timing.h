@@ -0,0 +1,560 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_API_TIMING_H_
+#define HELPER_CUPTI_API_TIMING_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Timing of every runtime and driver API call from the callback API.
+//
+// The enter callback stores its timestamp in the correlationData of the call,
+// the exit callback writes a compact (domain, cbid, correlation id, start,
+// end) event to a ring owned by the calling thread. A ring has a single
+// producer, its thread, and a single consumer, the collector thread, so the
+// hot path takes no lock: a full ring drops the event and counts it.
+// The collector drains the rings periodically into per-API latency
+// histograms and optionally writes every event to a raw CSV stream.
+//
+// One callback in API_TIMING_OVERHEAD_SAMPLE_PERIOD reads the timestamp a
+// second time to measure the time spent in the tracer itself. Adding the cost
+// of the first timestamp read, measured at initialization, gives the
+// per-callback overhead in ns reported by PrintApiTimingReport().
+
+// Macros
+#define API_TIMING_DEFAULT_RING_CAPACITY 8192
+#define API_TIMING_DEFAULT_DRAIN_INTERVAL_MS 100
+#define API_TIMING_OVERHEAD_SAMPLE_PERIOD 64
+#define API_TIMING_TIMESTAMP_CALIBRATION_CALLS 1000
+// Linear sub-buckets per power of two of the latency histograms, as a number of bits.
+#define API_TIMING_SUB_BUCKET_BITS 3
+#define API_TIMING_NUM_BUCKETS (64 << API_TIMING_SUB_BUCKET_BITS)
+#define API_TIMING_KEY(domain, cbid) (((uint32_t)(domain) << 16) | (uint32_t)(cbid))
+
+// Data structures
+typedef struct ApiTimingEvent_st
+{
+    uint16_t    domain;                                              // CUPTI_CB_DOMAIN_RUNTIME_API or CUPTI_CB_DOMAIN_DRIVER_API.
+    uint16_t    cbid;
+    uint32_t    correlationId;
+    uint64_t    startTimestamp;
+    uint64_t    endTimestamp;
+} ApiTimingEvent;
+
+// Events of one thread. The counters are only written by the thread and read by the collector.
+typedef struct ApiTimingRing_st
+{
+    std::atomic<uint64_t>   head;                                    // Next event written by the thread.
+    char                    headPadding[64 - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t>   tail;                                    // Next event read by the collector.
+    char                    tailPadding[64 - sizeof(std::atomic<uint64_t>)];
+
+    ApiTimingEvent          *pEvents;
+    uint64_t                capacity;                                // Power of two.
+    uint32_t                threadIndex;                             // Order in which the threads made their first API call.
+
+    std::atomic<uint64_t>   callbacks;                               // Enter and exit callbacks.
+    std::atomic<uint64_t>   droppedEvents;                           // Events lost to a full ring.
+    std::atomic<uint64_t>   enterSamples;
+    std::atomic<uint64_t>   enterOverheadNs;                         // Time spent in the sampled enter callbacks.
+    std::atomic<uint64_t>   exitSamples;
+    std::atomic<uint64_t>   exitOverheadNs;                          // Time spent in the sampled exit callbacks.
+} ApiTimingRing;
+
+typedef struct ApiTimingHistogram_st
+{
+    uint16_t    domain;
+    uint16_t    cbid;
+    uint64_t    count;
+    uint64_t    totalNs;
+    uint64_t    minNs;
+    uint64_t    maxNs;
+    uint64_t    buckets[API_TIMING_NUM_BUCKETS];
+} ApiTimingHistogram;
+
+typedef struct ApiTimingTracer_st
+{
+    std::atomic<int>        enabled;
+    uint32_t                generation;                              // Identifies the tracer owning the thread rings.
+    uint64_t                ringCapacity;
+    uint64_t                drainIntervalMs;
+    FILE                    *pRawFile;                               // Raw event stream, NULL to disable.
+    double                  timestampCostNs;                         // Cost of a cuptiGetTimestamp() call.
+
+    std::mutex              registryMutex;                           // Taken once per thread, to register its ring.
+    std::vector<ApiTimingRing *> rings;
+
+    std::thread             collectorThread;
+    std::mutex              collectorMutex;
+    std::condition_variable collectorCondition;
+    bool                    terminateCollector;
+
+    // Only used by the collector.
+    std::unordered_map<uint32_t, ApiTimingHistogram *> histograms;
+    uint64_t                eventsCollected;
+} ApiTimingTracer;
+
+// Global variables
+static std::atomic<uint32_t> s_ApiTimingGeneration(0);
+static thread_local ApiTimingRing *s_pApiTimingRing = NULL;
+static thread_local uint32_t s_ApiTimingRingGeneration = 0;
+
+// Helper Functions
+// Increment a counter only written by the calling thread, without a locked instruction.
+static inline void
+ApiTimingAdd(
+    std::atomic<uint64_t> &counter,
+    uint64_t value)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static ApiTimingRing *
+RegisterApiTimingRing(
+    ApiTimingTracer *pTracer)
+{
+    ApiTimingRing *pRing = new ApiTimingRing();
+
+    pRing->head = 0;
+    pRing->tail = 0;
+    pRing->capacity = pTracer->ringCapacity;
+    pRing->pEvents = (ApiTimingEvent *)malloc(pRing->capacity * sizeof(ApiTimingEvent));
+    MEMORY_ALLOCATION_CALL(pRing->pEvents);
+    pRing->callbacks = 0;
+    pRing->droppedEvents = 0;
+    pRing->enterSamples = 0;
+    pRing->enterOverheadNs = 0;
+    pRing->exitSamples = 0;
+    pRing->exitOverheadNs = 0;
+
+    std::lock_guard<std::mutex> lock(pTracer->registryMutex);
+    pRing->threadIndex = (uint32_t)pTracer->rings.size();
+    pTracer->rings.push_back(pRing);
+
+    return pRing;
+}
+
+// Ring of the calling thread, registered on its first API call.
+static inline ApiTimingRing *
+GetApiTimingRing(
+    ApiTimingTracer *pTracer)
+{
+    if (s_pApiTimingRing == NULL || s_ApiTimingRingGeneration != pTracer->generation)
+    {
+        s_pApiTimingRing = RegisterApiTimingRing(pTracer);
+        s_ApiTimingRingGeneration = pTracer->generation;
+    }
+
+    return s_pApiTimingRing;
+}
+
+// Call from the callback function for the CUPTI_CB_DOMAIN_RUNTIME_API and CUPTI_CB_DOMAIN_DRIVER_API domains.
+static inline void
+ApiTimingCallback(
+    ApiTimingTracer *pTracer,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const CUpti_CallbackData *pCallbackData)
+{
+    uint64_t timestamp = 0;
+
+    if (!pTracer->enabled.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    CUPTI_API_CALL(cuptiGetTimestamp(&timestamp));
+
+    ApiTimingRing *pRing = GetApiTimingRing(pTracer);
+    uint64_t callbacks = pRing->callbacks.load(std::memory_order_relaxed);
+    pRing->callbacks.store(callbacks + 1, std::memory_order_relaxed);
+
+    if (pCallbackData->callbackSite == CUPTI_API_ENTER)
+    {
+        // Handed by CUPTI to the exit callback of the same call.
+        *pCallbackData->correlationData = timestamp;
+    }
+    else
+    {
+        uint64_t head = pRing->head.load(std::memory_order_relaxed);
+
+        if (head - pRing->tail.load(std::memory_order_acquire) >= pRing->capacity)
+        {
+            ApiTimingAdd(pRing->droppedEvents, 1);
+        }
+        else
+        {
+            ApiTimingEvent *pEvent = &pRing->pEvents[head & (pRing->capacity - 1)];
+
+            pEvent->domain = (uint16_t)domain;
+            pEvent->cbid = (uint16_t)callbackId;
+            pEvent->correlationId = pCallbackData->correlationId;
+            pEvent->startTimestamp = *pCallbackData->correlationData;
+            pEvent->endTimestamp = timestamp;
+            pRing->head.store(head + 1, std::memory_order_release);
+        }
+    }
+
+    if (callbacks % API_TIMING_OVERHEAD_SAMPLE_PERIOD < 2)
+    {
+        uint64_t now = 0;
+        CUPTI_API_CALL(cuptiGetTimestamp(&now));
+
+        if (pCallbackData->callbackSite == CUPTI_API_ENTER)
+        {
+            ApiTimingAdd(pRing->enterSamples, 1);
+            ApiTimingAdd(pRing->enterOverheadNs, now - timestamp);
+        }
+        else
+        {
+            ApiTimingAdd(pRing->exitSamples, 1);
+            ApiTimingAdd(pRing->exitOverheadNs, now - timestamp);
+        }
+    }
+}
+
+static uint32_t
+GetApiTimingBucket(
+    uint64_t durationNs)
+{
+    if (durationNs < (1 << API_TIMING_SUB_BUCKET_BITS))
+    {
+        return (uint32_t)durationNs;
+    }
+
+    uint32_t msb = API_TIMING_SUB_BUCKET_BITS;
+    while (msb < 63 && (durationNs >> (msb + 1)))
+    {
+        msb++;
+    }
+
+    uint32_t shift = msb - API_TIMING_SUB_BUCKET_BITS;
+    return ((shift + 1) << API_TIMING_SUB_BUCKET_BITS) | (uint32_t)((durationNs >> shift) & ((1 << API_TIMING_SUB_BUCKET_BITS) - 1));
+}
+
+// Smallest duration falling in the bucket.
+static uint64_t
+GetApiTimingBucketStart(
+    uint32_t bucket)
+{
+    if (bucket < (1 << API_TIMING_SUB_BUCKET_BITS))
+    {
+        return bucket;
+    }
+
+    uint32_t shift = (bucket >> API_TIMING_SUB_BUCKET_BITS) - 1;
+    return (uint64_t)((1 << API_TIMING_SUB_BUCKET_BITS) | (bucket & ((1 << API_TIMING_SUB_BUCKET_BITS) - 1))) << shift;
+}
+
+static const char *
+GetApiTimingName(
+    uint16_t domain,
+    uint16_t cbid)
+{
+    const char *pName = NULL;
+
+    if (cuptiGetCallbackName((CUpti_CallbackDomain)domain, cbid, &pName) != CUPTI_SUCCESS || pName == NULL)
+    {
+        cuptiGetLastError();
+        pName = "<unknown>";
+    }
+
+    return pName;
+}
+
+static void
+CollectApiTimingEvent(
+    ApiTimingTracer *pTracer,
+    const ApiTimingEvent *pEvent,
+    uint32_t threadIndex)
+{
+    uint32_t key = API_TIMING_KEY(pEvent->domain, pEvent->cbid);
+    uint64_t durationNs = pEvent->endTimestamp - pEvent->startTimestamp;
+    ApiTimingHistogram *pHistogram = NULL;
+
+    std::unordered_map<uint32_t, ApiTimingHistogram *>::iterator it = pTracer->histograms.find(key);
+    if (it == pTracer->histograms.end())
+    {
+        pHistogram = (ApiTimingHistogram *)calloc(1, sizeof(ApiTimingHistogram));
+        MEMORY_ALLOCATION_CALL(pHistogram);
+        pHistogram->domain = pEvent->domain;
+        pHistogram->cbid = pEvent->cbid;
+        pHistogram->minNs = UINT64_MAX;
+        pTracer->histograms[key] = pHistogram;
+    }
+    else
+    {
+        pHistogram = it->second;
+    }
+
+    pHistogram->count++;
+    pHistogram->totalNs += durationNs;
+    pHistogram->minNs = std::min(pHistogram->minNs, durationNs);
+    pHistogram->maxNs = std::max(pHistogram->maxNs, durationNs);
+    pHistogram->buckets[GetApiTimingBucket(durationNs)]++;
+
+    if (pTracer->pRawFile)
+    {
+        fprintf(pTracer->pRawFile, "%s,%u,%s,%llu,%llu,%u,%u\n",
+                pEvent->domain == CUPTI_CB_DOMAIN_DRIVER_API ? "DRIVER" : "RUNTIME",
+                pEvent->cbid,
+                GetApiTimingName(pEvent->domain, pEvent->cbid),
+                (unsigned long long)pEvent->startTimestamp,
+                (unsigned long long)pEvent->endTimestamp,
+                pEvent->correlationId,
+                threadIndex);
+    }
+
+    pTracer->eventsCollected++;
+}
+
+// Move the events of all the rings to the histograms. Only called by the collector, or once it stopped.
+static void
+DrainApiTimingRings(
+    ApiTimingTracer *pTracer)
+{
+    std::vector<ApiTimingRing *> rings;
+
+    {
+        std::lock_guard<std::mutex> lock(pTracer->registryMutex);
+        rings = pTracer->rings;
+    }
+
+    for (size_t i = 0; i < rings.size(); i++)
+    {
+        ApiTimingRing *pRing = rings[i];
+        uint64_t tail = pRing->tail.load(std::memory_order_relaxed);
+        uint64_t head = pRing->head.load(std::memory_order_acquire);
+
+        for (; tail != head; tail++)
+        {
+            CollectApiTimingEvent(pTracer, &pRing->pEvents[tail & (pRing->capacity - 1)], pRing->threadIndex);
+        }
+
+        // Hand the slots back to the thread.
+        pRing->tail.store(tail, std::memory_order_release);
+    }
+}
+
+static void
+ApiTimingCollectorThread(
+    ApiTimingTracer *pTracer)
+{
+    std::chrono::milliseconds interval(pTracer->drainIntervalMs);
+
+    while (1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pTracer->collectorMutex);
+            pTracer->collectorCondition.wait_for(lock, interval, [pTracer]{ return pTracer->terminateCollector; });
+            if (pTracer->terminateCollector)
+            {
+                break;
+            }
+        }
+
+        DrainApiTimingRings(pTracer);
+    }
+}
+
+// Start the tracer. ringCapacity is the number of events per thread, rounded up to a power of two.
+// pRawFile receives every event as a CSV line, NULL to only build the histograms.
+static void
+InitApiTimingTracer(
+    ApiTimingTracer *pTracer,
+    uint64_t ringCapacity,
+    uint64_t drainIntervalMs,
+    FILE *pRawFile)
+{
+    pTracer->ringCapacity = 1;
+    while (pTracer->ringCapacity < ringCapacity)
+    {
+        pTracer->ringCapacity <<= 1;
+    }
+
+    pTracer->drainIntervalMs = drainIntervalMs ? drainIntervalMs : API_TIMING_DEFAULT_DRAIN_INTERVAL_MS;
+    pTracer->pRawFile = pRawFile;
+    pTracer->generation = ++s_ApiTimingGeneration;
+    pTracer->terminateCollector = false;
+    pTracer->eventsCollected = 0;
+
+    uint64_t firstTimestamp = 0, lastTimestamp = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&firstTimestamp));
+    for (int i = 0; i < API_TIMING_TIMESTAMP_CALIBRATION_CALLS; i++)
+    {
+        CUPTI_API_CALL(cuptiGetTimestamp(&lastTimestamp));
+    }
+    pTracer->timestampCostNs = (double)(lastTimestamp - firstTimestamp) / API_TIMING_TIMESTAMP_CALIBRATION_CALLS;
+
+    if (pRawFile)
+    {
+        fprintf(pRawFile, "domain,cbid,name,start,end,correlationId,thread\n");
+    }
+
+    pTracer->collectorThread = std::thread(ApiTimingCollectorThread, pTracer);
+    pTracer->enabled = 1;
+}
+
+// Stop recording, then collect the events left in the rings.
+static void
+StopApiTimingTracer(
+    ApiTimingTracer *pTracer)
+{
+    pTracer->enabled = 0;
+
+    if (pTracer->collectorThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(pTracer->collectorMutex);
+            pTracer->terminateCollector = true;
+        }
+        pTracer->collectorCondition.notify_all();
+        pTracer->collectorThread.join();
+    }
+
+    DrainApiTimingRings(pTracer);
+
+    if (pTracer->pRawFile)
+    {
+        fflush(pTracer->pRawFile);
+    }
+}
+
+static uint64_t
+GetApiTimingPercentile(
+    const ApiTimingHistogram *pHistogram,
+    double percentile)
+{
+    uint64_t rank = (uint64_t)(percentile * (pHistogram->count - 1)) + 1;
+    uint64_t seen = 0;
+
+    for (uint32_t i = 0; i < API_TIMING_NUM_BUCKETS; i++)
+    {
+        seen += pHistogram->buckets[i];
+        if (seen >= rank)
+        {
+            return std::min(std::max(GetApiTimingBucketStart(i), pHistogram->minNs), pHistogram->maxNs);
+        }
+    }
+
+    return pHistogram->maxNs;
+}
+
+static bool
+CompareApiTimingTotal(
+    const ApiTimingHistogram *pLeft,
+    const ApiTimingHistogram *pRight)
+{
+    return pLeft->totalNs > pRight->totalNs;
+}
+
+// Print the latency of every API called, the most expensive first, and the overhead of the tracer.
+// Call after StopApiTimingTracer(); the percentiles are the start of their histogram bucket (within 12.5%).
+static void
+PrintApiTimingReport(
+    ApiTimingTracer *pTracer,
+    FILE *pOutputFile)
+{
+    std::vector<ApiTimingHistogram *> histograms;
+    uint64_t callbacks = 0, droppedEvents = 0;
+    uint64_t enterSamples = 0, enterOverheadNs = 0, exitSamples = 0, exitOverheadNs = 0;
+
+    for (std::unordered_map<uint32_t, ApiTimingHistogram *>::iterator it = pTracer->histograms.begin(); it != pTracer->histograms.end(); ++it)
+    {
+        histograms.push_back(it->second);
+    }
+    std::sort(histograms.begin(), histograms.end(), CompareApiTimingTotal);
+
+    fprintf(pOutputFile, "\nAPI timing, durations in ns:\n");
+    fprintf(pOutputFile, "%-8s %-48s %10s %14s %10s %10s %10s %10s %12s\n",
+            "Domain", "Name", "Calls", "Total", "Mean", "P50", "P90", "P99", "Max");
+
+    for (size_t i = 0; i < histograms.size(); i++)
+    {
+        ApiTimingHistogram *pHistogram = histograms[i];
+
+        fprintf(pOutputFile, "%-8s %-48s %10llu %14llu %10llu %10llu %10llu %10llu %12llu\n",
+                pHistogram->domain == CUPTI_CB_DOMAIN_DRIVER_API ? "DRIVER" : "RUNTIME",
+                GetApiTimingName(pHistogram->domain, pHistogram->cbid),
+                (unsigned long long)pHistogram->count,
+                (unsigned long long)pHistogram->totalNs,
+                (unsigned long long)(pHistogram->totalNs / pHistogram->count),
+                (unsigned long long)GetApiTimingPercentile(pHistogram, 0.5),
+                (unsigned long long)GetApiTimingPercentile(pHistogram, 0.9),
+                (unsigned long long)GetApiTimingPercentile(pHistogram, 0.99),
+                (unsigned long long)pHistogram->maxNs);
+    }
+
+    std::lock_guard<std::mutex> lock(pTracer->registryMutex);
+    for (size_t i = 0; i < pTracer->rings.size(); i++)
+    {
+        ApiTimingRing *pRing = pTracer->rings[i];
+
+        callbacks += pRing->callbacks;
+        droppedEvents += pRing->droppedEvents;
+        enterSamples += pRing->enterSamples;
+        enterOverheadNs += pRing->enterOverheadNs;
+        exitSamples += pRing->exitSamples;
+        exitOverheadNs += pRing->exitOverheadNs;
+    }
+
+    double enterNs = pTracer->timestampCostNs + (enterSamples ? (double)enterOverheadNs / enterSamples : 0);
+    double exitNs = pTracer->timestampCostNs + (exitSamples ? (double)exitOverheadNs / exitSamples : 0);
+
+    fprintf(pOutputFile, "API timing: %llu events from %zu threads, %llu dropped (full ring).\n",
+            (unsigned long long)pTracer->eventsCollected, pTracer->rings.size(), (unsigned long long)droppedEvents);
+    fprintf(pOutputFile, "API timing overhead: %.1f ns per enter callback, %.1f ns per exit callback, %.1f ns per API call (%llu callbacks, %llu sampled).\n",
+            enterNs, exitNs, enterNs + exitNs, (unsigned long long)callbacks, (unsigned long long)(enterSamples + exitSamples));
+}
+
+// Release the rings and histograms. Call after StopApiTimingTracer(), once no API call can reach ApiTimingCallback().
+static void
+FreeApiTimingTracer(
+    ApiTimingTracer *pTracer)
+{
+    std::lock_guard<std::mutex> lock(pTracer->registryMutex);
+
+    for (size_t i = 0; i < pTracer->rings.size(); i++)
+    {
+        free(pTracer->rings[i]->pEvents);
+        delete pTracer->rings[i];
+    }
+    pTracer->rings.clear();
+
+    for (std::unordered_map<uint32_t, ApiTimingHistogram *>::iterator it = pTracer->histograms.begin(); it != pTracer->histograms.end(); ++it)
+    {
+        free(it->second);
+    }
+    pTracer->histograms.clear();
+}
+
+#endif // HELPER_CUPTI_API_TIMING_H_
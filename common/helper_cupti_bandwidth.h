@@ -0,0 +1,660 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_BANDWIDTH_H_
+#define HELPER_CUPTI_BANDWIDTH_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Achieved bandwidth of the MEMCPY and MEMCPY2 records.
+//
+// The copies are grouped by path: copy kind, source and destination memory
+// kinds, source and destination devices, and size bucket (a power of two),
+// since small copies are bound by their fixed cost and do not reach the
+// bandwidth of the link. The throughput of every copy goes to a log-linear
+// sketch of the path (8 buckets per power of two, a quantile is within 6%), in
+// MB/s.
+//
+// Every path belongs to a link type, compared with the peak of the link in a
+// table set by the caller, e.g. "pcie=25,peer=50". The report also flags the
+// copies from or to pageable memory, which are staged by the driver and do not
+// overlap, and the tiny copy storms: windows where a device does many copies
+// below the tiny size, which batching would save the fixed cost of.
+
+// Macros
+#define BANDWIDTH_HOST (0xFFFFFFFFu)                                 // Device id of the host side of a copy.
+#define BANDWIDTH_SUB_BUCKET_BITS 3
+#define BANDWIDTH_LINEAR_BUCKETS (2 << BANDWIDTH_SUB_BUCKET_BITS)
+#define BANDWIDTH_SKETCH_BUCKETS (BANDWIDTH_LINEAR_BUCKETS + (64 - BANDWIDTH_SUB_BUCKET_BITS - 1) * (1 << BANDWIDTH_SUB_BUCKET_BITS))
+#define BANDWIDTH_MAX_PATHS 4096                                     // Further paths are counted as dropped.
+#define BANDWIDTH_DEFAULT_TINY_BYTES (64 * 1024)
+#define BANDWIDTH_DEFAULT_STORM_COPIES 100                           // Tiny copies of a device in a window to flag it.
+#define BANDWIDTH_STORM_WINDOW_NS (1000ULL * 1000)
+#define BANDWIDTH_MAX_STORM_WINDOWS 1024                             // Windows counted at once, the oldest are closed beyond it.
+#define BANDWIDTH_MAX_STORMS 64
+#define BANDWIDTH_TOP_COUNT 20
+#define BANDWIDTH_DEFAULT_PEAKS "pcie=25,peer=50,device=900,host=10"  // GB/s.
+
+// Data structures
+typedef enum
+{
+    BANDWIDTH_LINK_PCIE   = 0,                                       // Host to or from device.
+    BANDWIDTH_LINK_PEER   = 1,                                       // Device to another device.
+    BANDWIDTH_LINK_DEVICE = 2,                                       // Within the memory of a device.
+    BANDWIDTH_LINK_HOST   = 3,                                       // Host to host.
+    BANDWIDTH_LINK_COUNT  = 4
+} BandwidthLink;
+
+// Log-linear sketch of the throughputs in MB/s.
+typedef struct BandwidthSketch_st
+{
+    uint64_t count;
+    uint64_t maxMBps;
+    uint32_t buckets[BANDWIDTH_SKETCH_BUCKETS];
+} BandwidthSketch;
+
+typedef struct BandwidthPathKey_st
+{
+    uint32_t srcDevice;                                              // BANDWIDTH_HOST for the host.
+    uint32_t dstDevice;
+    uint8_t  copyKind;                                               // CUpti_ActivityMemcpyKind.
+    uint8_t  srcKind;                                                // CUpti_ActivityMemoryKind.
+    uint8_t  dstKind;
+    uint8_t  sizeBucket;                                             // Copies of [2^sizeBucket, 2^(sizeBucket+1)) bytes.
+
+    bool operator<(const BandwidthPathKey_st &other) const
+    {
+        return memcmp(this, &other, sizeof(BandwidthPathKey_st)) < 0;
+    }
+} BandwidthPathKey;
+
+typedef struct BandwidthPath_st
+{
+    uint64_t        bytes;
+    uint64_t        durationNs;
+    BandwidthSketch sketch;
+} BandwidthPath;
+
+typedef struct BandwidthLinkTotal_st
+{
+    uint64_t numCopies;
+    uint64_t bytes;
+    uint64_t durationNs;
+    double   peakGBps;                                               // 0 if not in the table.
+} BandwidthLinkTotal;
+
+typedef struct BandwidthStormWindow_st
+{
+    uint32_t numCopies;
+    uint64_t bytes;
+} BandwidthStormWindow;
+
+typedef struct BandwidthStorm_st
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t deviceId;
+    uint64_t numCopies;
+    uint64_t bytes;
+} BandwidthStorm;
+
+typedef struct BandwidthAnalyzer_st
+{
+    std::mutex                                   mutex;              // The buffers can be completed by several threads.
+    uint64_t                                     tinyBytes;
+    uint32_t                                     stormCopies;
+    std::map<BandwidthPathKey, BandwidthPath>    paths;
+    BandwidthLinkTotal                           links[BANDWIDTH_LINK_COUNT];
+    std::map<std::pair<uint64_t, uint32_t>, BandwidthStormWindow> stormWindows; // Tiny copies by (window, device).
+    std::vector<BandwidthStorm>                  storms;
+    uint64_t                                     numStormWindows;    // Windows flagged, including the ones past BANDWIDTH_MAX_STORMS.
+    uint64_t                                     pageableCopies;
+    uint64_t                                     pageableBytes;
+    uint64_t                                     pageableNs;
+    uint64_t                                     numCopies;
+    uint64_t                                     droppedCopies;      // Paths past BANDWIDTH_MAX_PATHS, or without duration.
+} BandwidthAnalyzer;
+
+// Helper Functions
+static const char *
+GetBandwidthLinkString(
+    BandwidthLink link)
+{
+    switch (link)
+    {
+        case BANDWIDTH_LINK_PCIE:
+            return "pcie";
+        case BANDWIDTH_LINK_PEER:
+            return "peer";
+        case BANDWIDTH_LINK_DEVICE:
+            return "device";
+        case BANDWIDTH_LINK_HOST:
+            return "host";
+        default:
+            return "<unknown>";
+    }
+}
+
+static BandwidthLink
+GetBandwidthLink(
+    const BandwidthPathKey *pKey)
+{
+    if (pKey->srcDevice == BANDWIDTH_HOST && pKey->dstDevice == BANDWIDTH_HOST)
+    {
+        return BANDWIDTH_LINK_HOST;
+    }
+    if (pKey->srcDevice == BANDWIDTH_HOST || pKey->dstDevice == BANDWIDTH_HOST)
+    {
+        return BANDWIDTH_LINK_PCIE;
+    }
+
+    return pKey->srcDevice == pKey->dstDevice ? BANDWIDTH_LINK_DEVICE : BANDWIDTH_LINK_PEER;
+}
+
+static inline uint32_t
+GetBandwidthSketchBucket(
+    uint64_t value)
+{
+    if (value < BANDWIDTH_LINEAR_BUCKETS)
+    {
+        return (uint32_t)value;
+    }
+
+    uint32_t octave = 63;
+    while (!(value >> octave))
+    {
+        octave--;
+    }
+
+    uint32_t subBucket = (uint32_t)(value >> (octave - BANDWIDTH_SUB_BUCKET_BITS)) - (1 << BANDWIDTH_SUB_BUCKET_BITS);
+    return BANDWIDTH_LINEAR_BUCKETS + (octave - BANDWIDTH_SUB_BUCKET_BITS - 1) * (1 << BANDWIDTH_SUB_BUCKET_BITS) + subBucket;
+}
+
+static inline uint64_t
+GetBandwidthSketchValue(
+    uint32_t bucket)
+{
+    if (bucket < BANDWIDTH_LINEAR_BUCKETS)
+    {
+        return bucket;
+    }
+
+    uint32_t index = bucket - BANDWIDTH_LINEAR_BUCKETS;
+    uint32_t octave = index / (1 << BANDWIDTH_SUB_BUCKET_BITS) + BANDWIDTH_SUB_BUCKET_BITS + 1;
+    uint64_t subBucket = (index % (1 << BANDWIDTH_SUB_BUCKET_BITS)) + (1 << BANDWIDTH_SUB_BUCKET_BITS);
+    uint64_t width = 1ULL << (octave - BANDWIDTH_SUB_BUCKET_BITS);
+
+    return subBucket * width + width / 2;
+}
+
+// Throughput under which percent of the copies are, in MB/s.
+static uint64_t
+GetBandwidthQuantile(
+    const BandwidthSketch *pSketch,
+    double percent)
+{
+    uint64_t rank = (uint64_t)((double)pSketch->count * percent / 100.0);
+    uint64_t seen = 0;
+
+    if (rank >= pSketch->count)
+    {
+        return pSketch->maxMBps;
+    }
+
+    for (uint32_t i = 0; i < BANDWIDTH_SKETCH_BUCKETS; i++)
+    {
+        seen += pSketch->buckets[i];
+        if (seen > rank)
+        {
+            return std::min(GetBandwidthSketchValue(i), pSketch->maxMBps);
+        }
+    }
+
+    return pSketch->maxMBps;
+}
+
+// Set the peak of the links from pTable, a list of link=GB/s, e.g. "pcie=25,peer=50". Returns false on a malformed table.
+static bool
+SetBandwidthPeaks(
+    BandwidthAnalyzer *pAnalyzer,
+    const char *pTable)
+{
+    std::string table(pTable ? pTable : "");
+    size_t position = 0;
+
+    while (position < table.size())
+    {
+        size_t end = table.find(',', position);
+        std::string entry = table.substr(position, end == std::string::npos ? std::string::npos : end - position);
+        size_t equal = entry.find('=');
+        bool found = false;
+
+        position = end == std::string::npos ? table.size() : end + 1;
+        if (entry.empty())
+        {
+            continue;
+        }
+        if (equal == std::string::npos)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < BANDWIDTH_LINK_COUNT; i++)
+        {
+            if (entry.compare(0, equal, GetBandwidthLinkString((BandwidthLink)i)) == 0)
+            {
+                pAnalyzer->links[i].peakGBps = atof(entry.c_str() + equal + 1);
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+AddBandwidthStorm(
+    BandwidthAnalyzer *pAnalyzer,
+    uint64_t window,
+    uint32_t deviceId,
+    const BandwidthStormWindow *pWindow)
+{
+    pAnalyzer->numStormWindows++;
+
+    // Extend the storm of the device ending where the window starts.
+    for (size_t i = pAnalyzer->storms.size(); i > 0; i--)
+    {
+        BandwidthStorm &storm = pAnalyzer->storms[i - 1];
+
+        if (storm.deviceId == deviceId && storm.end == window * BANDWIDTH_STORM_WINDOW_NS)
+        {
+            storm.end += BANDWIDTH_STORM_WINDOW_NS;
+            storm.numCopies += pWindow->numCopies;
+            storm.bytes += pWindow->bytes;
+            return;
+        }
+    }
+
+    if (pAnalyzer->storms.size() >= BANDWIDTH_MAX_STORMS)
+    {
+        return;
+    }
+
+    BandwidthStorm storm;
+    storm.start = window * BANDWIDTH_STORM_WINDOW_NS;
+    storm.end = storm.start + BANDWIDTH_STORM_WINDOW_NS;
+    storm.deviceId = deviceId;
+    storm.numCopies = pWindow->numCopies;
+    storm.bytes = pWindow->bytes;
+    pAnalyzer->storms.push_back(storm);
+}
+
+// Close the oldest tiny copy window, flagging it if it is a storm.
+static void
+CloseBandwidthStormWindow(
+    BandwidthAnalyzer *pAnalyzer)
+{
+    std::map<std::pair<uint64_t, uint32_t>, BandwidthStormWindow>::iterator it = pAnalyzer->stormWindows.begin();
+
+    if (it->second.numCopies >= pAnalyzer->stormCopies)
+    {
+        AddBandwidthStorm(pAnalyzer, it->first.first, it->first.second, &it->second);
+    }
+    pAnalyzer->stormWindows.erase(it);
+}
+
+static void
+AddBandwidthCopy(
+    BandwidthAnalyzer *pAnalyzer,
+    const BandwidthPathKey *pKey,
+    uint64_t bytes,
+    uint64_t start,
+    uint64_t end,
+    uint32_t deviceId)
+{
+    if (end <= start || bytes == 0)
+    {
+        pAnalyzer->droppedCopies++;
+        return;
+    }
+
+    uint64_t durationNs = end - start;
+    std::map<BandwidthPathKey, BandwidthPath>::iterator it = pAnalyzer->paths.find(*pKey);
+
+    if (it == pAnalyzer->paths.end())
+    {
+        if (pAnalyzer->paths.size() >= BANDWIDTH_MAX_PATHS)
+        {
+            pAnalyzer->droppedCopies++;
+            return;
+        }
+
+        BandwidthPath path;
+        memset(&path, 0, sizeof(BandwidthPath));
+        it = pAnalyzer->paths.insert(std::make_pair(*pKey, path)).first;
+    }
+
+    // bytes / ns is GB/s, the sketch keeps MB/s.
+    uint64_t throughputMBps = (uint64_t)((double)bytes * 1000.0 / (double)durationNs);
+    BandwidthPath &path = it->second;
+
+    path.bytes += bytes;
+    path.durationNs += durationNs;
+    path.sketch.count++;
+    path.sketch.maxMBps = std::max(path.sketch.maxMBps, throughputMBps);
+    path.sketch.buckets[GetBandwidthSketchBucket(throughputMBps)]++;
+
+    BandwidthLinkTotal &link = pAnalyzer->links[GetBandwidthLink(pKey)];
+    link.numCopies++;
+    link.bytes += bytes;
+    link.durationNs += durationNs;
+
+    if (pKey->srcKind == CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE || pKey->dstKind == CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE)
+    {
+        pAnalyzer->pageableCopies++;
+        pAnalyzer->pageableBytes += bytes;
+        pAnalyzer->pageableNs += durationNs;
+    }
+
+    if (bytes < pAnalyzer->tinyBytes)
+    {
+        BandwidthStormWindow &window = pAnalyzer->stormWindows[std::make_pair(start / BANDWIDTH_STORM_WINDOW_NS, deviceId)];
+        window.numCopies++;
+        window.bytes += bytes;
+
+        while (pAnalyzer->stormWindows.size() > BANDWIDTH_MAX_STORM_WINDOWS)
+        {
+            CloseBandwidthStormWindow(pAnalyzer);
+        }
+    }
+
+    pAnalyzer->numCopies++;
+}
+
+static inline uint8_t
+GetBandwidthSizeBucket(
+    uint64_t bytes)
+{
+    uint8_t bucket = 0;
+
+    while (bucket < 63 && (bytes >> (bucket + 1)))
+    {
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void
+InitBandwidthAnalyzer(
+    BandwidthAnalyzer *pAnalyzer,
+    uint64_t tinyBytes,
+    uint32_t stormCopies)
+{
+    pAnalyzer->tinyBytes = tinyBytes;
+    pAnalyzer->stormCopies = stormCopies ? stormCopies : BANDWIDTH_DEFAULT_STORM_COPIES;
+    pAnalyzer->paths.clear();
+    memset(pAnalyzer->links, 0, sizeof(pAnalyzer->links));
+    pAnalyzer->stormWindows.clear();
+    pAnalyzer->storms.clear();
+    pAnalyzer->numStormWindows = 0;
+    pAnalyzer->pageableCopies = 0;
+    pAnalyzer->pageableBytes = 0;
+    pAnalyzer->pageableNs = 0;
+    pAnalyzer->numCopies = 0;
+    pAnalyzer->droppedCopies = 0;
+
+    SetBandwidthPeaks(pAnalyzer, BANDWIDTH_DEFAULT_PEAKS);
+}
+
+// Feed one activity record: MEMCPY and MEMCPY2 records are used, other kinds are ignored.
+static void
+BandwidthAddRecord(
+    BandwidthAnalyzer *pAnalyzer,
+    CUpti_Activity *pRecord)
+{
+    BandwidthPathKey key;
+    memset(&key, 0, sizeof(BandwidthPathKey));
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            bool hostSource = pMemcpyRecord->srcKind == CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE ||
+                              pMemcpyRecord->srcKind == CUPTI_ACTIVITY_MEMORY_KIND_PINNED;
+            bool hostDestination = pMemcpyRecord->dstKind == CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE ||
+                                   pMemcpyRecord->dstKind == CUPTI_ACTIVITY_MEMORY_KIND_PINNED;
+
+            key.srcDevice = hostSource ? BANDWIDTH_HOST : pMemcpyRecord->deviceId;
+            key.dstDevice = hostDestination ? BANDWIDTH_HOST : pMemcpyRecord->deviceId;
+            key.copyKind = pMemcpyRecord->copyKind;
+            key.srcKind = pMemcpyRecord->srcKind;
+            key.dstKind = pMemcpyRecord->dstKind;
+            key.sizeBucket = GetBandwidthSizeBucket(pMemcpyRecord->bytes);
+
+            std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+            AddBandwidthCopy(pAnalyzer, &key, pMemcpyRecord->bytes, pMemcpyRecord->start, pMemcpyRecord->end, pMemcpyRecord->deviceId);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY2:
+        {
+            CUpti_ActivityMemcpyPtoP4 *pMemcpyPtoPRecord = (CUpti_ActivityMemcpyPtoP4 *)pRecord;
+
+            key.srcDevice = pMemcpyPtoPRecord->srcDeviceId;
+            key.dstDevice = pMemcpyPtoPRecord->dstDeviceId;
+            key.copyKind = pMemcpyPtoPRecord->copyKind;
+            key.srcKind = pMemcpyPtoPRecord->srcKind;
+            key.dstKind = pMemcpyPtoPRecord->dstKind;
+            key.sizeBucket = GetBandwidthSizeBucket(pMemcpyPtoPRecord->bytes);
+
+            std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+            AddBandwidthCopy(pAnalyzer, &key, pMemcpyPtoPRecord->bytes, pMemcpyPtoPRecord->start, pMemcpyPtoPRecord->end,
+                             pMemcpyPtoPRecord->deviceId);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void
+FormatBandwidthDevice(
+    char *pBuffer,
+    size_t size,
+    uint32_t deviceId)
+{
+    if (deviceId == BANDWIDTH_HOST)
+    {
+        snprintf(pBuffer, size, "host");
+    }
+    else
+    {
+        snprintf(pBuffer, size, "%u", deviceId);
+    }
+}
+
+static void
+FormatBandwidthSize(
+    char *pBuffer,
+    size_t size,
+    uint64_t bytes)
+{
+    if (bytes >= (1ULL << 30))
+    {
+        snprintf(pBuffer, size, "%lluG", (unsigned long long)(bytes >> 30));
+    }
+    else if (bytes >= (1ULL << 20))
+    {
+        snprintf(pBuffer, size, "%lluM", (unsigned long long)(bytes >> 20));
+    }
+    else if (bytes >= (1ULL << 10))
+    {
+        snprintf(pBuffer, size, "%lluK", (unsigned long long)(bytes >> 10));
+    }
+    else
+    {
+        snprintf(pBuffer, size, "%llu", (unsigned long long)bytes);
+    }
+}
+
+static bool
+CompareBandwidthPathBytes(
+    const std::pair<BandwidthPathKey, const BandwidthPath *> &a,
+    const std::pair<BandwidthPathKey, const BandwidthPath *> &b)
+{
+    return a.second->bytes > b.second->bytes;
+}
+
+// Print the throughput per path and per link, the pageable copies and the tiny copy storms. Throughputs in GB/s.
+static void
+PrintBandwidthReport(
+    BandwidthAnalyzer *pAnalyzer,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    while (!pAnalyzer->stormWindows.empty())
+    {
+        CloseBandwidthStormWindow(pAnalyzer);
+    }
+
+    fprintf(pFile, "\nMemcpy bandwidth: %llu copies, %u paths, %llu copies dropped\n",
+            (unsigned long long)pAnalyzer->numCopies, (uint32_t)pAnalyzer->paths.size(), (unsigned long long)pAnalyzer->droppedCopies);
+
+    fprintf(pFile, "  %-6s %-10s %-10s %-11s %-13s %10s %14s %8s %8s %8s %8s %8s\n", "Link", "Kind", "Src", "Dst", "Devices",
+            "Copies", "Bytes", "p10", "p50", "p90", "max", "p50/peak");
+
+    std::vector<std::pair<BandwidthPathKey, const BandwidthPath *> > paths;
+    for (std::map<BandwidthPathKey, BandwidthPath>::const_iterator it = pAnalyzer->paths.begin(); it != pAnalyzer->paths.end(); ++it)
+    {
+        paths.push_back(std::make_pair(it->first, &it->second));
+    }
+    size_t top = std::min(paths.size(), (size_t)BANDWIDTH_TOP_COUNT);
+    std::partial_sort(paths.begin(), paths.begin() + top, paths.end(), CompareBandwidthPathBytes);
+
+    for (size_t i = 0; i < top; i++)
+    {
+        const BandwidthPathKey &key = paths[i].first;
+        const BandwidthSketch &sketch = paths[i].second->sketch;
+        BandwidthLink link = GetBandwidthLink(&key);
+        char source[16];
+        char destination[16];
+        char devices[40];
+        char sizeLow[16];
+        char sizeHigh[16];
+
+        FormatBandwidthDevice(source, sizeof(source), key.srcDevice);
+        FormatBandwidthDevice(destination, sizeof(destination), key.dstDevice);
+        snprintf(devices, sizeof(devices), "%s->%s", source, destination);
+        FormatBandwidthSize(sizeLow, sizeof(sizeLow), 1ULL << key.sizeBucket);
+        FormatBandwidthSize(sizeHigh, sizeof(sizeHigh), 2ULL << key.sizeBucket);
+
+        double p50 = (double)GetBandwidthQuantile(&sketch, 50) / 1000.0;
+        double peak = pAnalyzer->links[link].peakGBps;
+
+        fprintf(pFile, "  %-6s %-10s %-10s %-11s %-13s %10llu %14llu %8.2f %8.2f %8.2f %8.2f ",
+                GetBandwidthLinkString(link), GetMemcpyKindString((CUpti_ActivityMemcpyKind)key.copyKind),
+                GetMemoryKindString((CUpti_ActivityMemoryKind)key.srcKind), GetMemoryKindString((CUpti_ActivityMemoryKind)key.dstKind),
+                devices, (unsigned long long)sketch.count, (unsigned long long)paths[i].second->bytes,
+                (double)GetBandwidthQuantile(&sketch, 10) / 1000.0, p50,
+                (double)GetBandwidthQuantile(&sketch, 90) / 1000.0, (double)sketch.maxMBps / 1000.0);
+        if (peak > 0)
+        {
+            fprintf(pFile, "%7.1f%%", 100.0 * p50 / peak);
+        }
+        else
+        {
+            fprintf(pFile, "%8s", "-");
+        }
+        fprintf(pFile, "  [%s, %s)\n", sizeLow, sizeHigh);
+    }
+
+    fprintf(pFile, "Per link (achieved = bytes / copy time):\n");
+    for (int i = 0; i < BANDWIDTH_LINK_COUNT; i++)
+    {
+        const BandwidthLinkTotal &link = pAnalyzer->links[i];
+
+        if (!link.numCopies)
+        {
+            continue;
+        }
+
+        double achieved = (double)link.bytes / (double)link.durationNs;
+        fprintf(pFile, "  %-6s copies %llu, bytes %llu, time %llu ns, achieved %.2f GB/s", GetBandwidthLinkString((BandwidthLink)i),
+                (unsigned long long)link.numCopies, (unsigned long long)link.bytes, (unsigned long long)link.durationNs, achieved);
+        if (link.peakGBps > 0)
+        {
+            fprintf(pFile, ", peak %.1f GB/s (%.1f%%)", link.peakGBps, 100.0 * achieved / link.peakGBps);
+        }
+        fprintf(pFile, "\n");
+    }
+
+    if (pAnalyzer->pageableCopies)
+    {
+        fprintf(pFile, "Pageable memory: %llu copies, %llu bytes, %llu ns. Pinned memory (cudaMallocHost) avoids the staging and allows asynchronous copies.\n",
+                (unsigned long long)pAnalyzer->pageableCopies, (unsigned long long)pAnalyzer->pageableBytes,
+                (unsigned long long)pAnalyzer->pageableNs);
+    }
+
+    if (pAnalyzer->numStormWindows)
+    {
+        fprintf(pFile, "Tiny copy storms (%u or more copies below %llu bytes in %llu ns windows, %llu windows):\n",
+                pAnalyzer->stormCopies, (unsigned long long)pAnalyzer->tinyBytes, (unsigned long long)BANDWIDTH_STORM_WINDOW_NS,
+                (unsigned long long)pAnalyzer->numStormWindows);
+        for (size_t i = 0; i < pAnalyzer->storms.size(); i++)
+        {
+            const BandwidthStorm &storm = pAnalyzer->storms[i];
+
+            fprintf(pFile, "  Device %u: [ %llu, %llu ) %llu copies, %llu bytes\n", storm.deviceId, (unsigned long long)storm.start,
+                    (unsigned long long)storm.end, (unsigned long long)storm.numCopies, (unsigned long long)storm.bytes);
+        }
+    }
+    fflush(pFile);
+}
+
+static void
+FreeBandwidthAnalyzer(
+    BandwidthAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    pAnalyzer->paths.clear();
+    pAnalyzer->stormWindows.clear();
+    pAnalyzer->storms.clear();
+}
+
+#endif // HELPER_CUPTI_BANDWIDTH_H_
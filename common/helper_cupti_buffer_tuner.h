@@ -0,0 +1,437 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_BUFFER_TUNER_H_
+#define HELPER_CUPTI_BUFFER_TUNER_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Adaptive sizing of the CUPTI activity buffers.
+//
+// The tuner follows the buffers handed to CUPTI and the buffers it returns:
+// request and completion rates per second, fill ratio (valid bytes over
+// buffer size) and the records dropped per context and stream. From those it
+// sizes the next host buffers:
+//  - records were dropped: double the host buffer, and double the device
+//    buffer size (CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_SIZE) used for the contexts
+//    created from now on, or the device buffer pool limit once the device
+//    buffer size reached its cap.
+//  - buffers come back full at a high rate: double the host buffer, to reduce
+//    the number of buffer callbacks.
+//  - buffers come back mostly empty for a while: halve the host buffer, to
+//    reduce memory, but not below a size that dropped records.
+// Every change is recorded with its reason and printed by
+// PrintBufferTunerReport().
+
+// Macros
+#define BUFFER_TUNER_MIN_HOST_BUFFER_SIZE (64 * 1024)
+#define BUFFER_TUNER_MAX_HOST_BUFFER_SIZE (128 * 1024 * 1024)
+// Device buffer size and pool limit grow at most by this factor from their initial value.
+#define BUFFER_TUNER_MAX_DEVICE_GROWTH 8
+// Buffers completed per second above which full buffers make the host buffer grow.
+#define BUFFER_TUNER_HIGH_COMPLETION_RATE 4.0
+#define BUFFER_TUNER_FULL_RATIO 0.9
+#define BUFFER_TUNER_SHRINK_RATIO 0.25
+// Completions since the last change before the host buffer may shrink.
+#define BUFFER_TUNER_SHRINK_COMPLETIONS 16
+#define BUFFER_TUNER_MAX_DECISIONS 64
+
+// Data structures
+typedef struct BufferTunerDecision_st
+{
+    double      timeSec;                                             // Time of the decision since the tuner started.
+    const char  *pTarget;                                            // Tuned setting.
+    size_t      oldValue;
+    size_t      newValue;
+    char        reason[96];                                          // Telemetry that triggered the decision.
+} BufferTunerDecision;
+
+typedef struct BufferTunerStream_st
+{
+    uint64_t    buffersCompleted;                                    // Buffers completed for the context and stream.
+    uint64_t    droppedRecords;                                      // Records dropped for the context and stream.
+} BufferTunerStream;
+
+typedef struct BufferTuner_st
+{
+    std::mutex  mutex;                                               // CUPTI may request and complete buffers from several threads.
+    int         enabled;
+
+    size_t      hostBufferSize;                                      // Size of the next host buffer.
+    size_t      peakHostBufferSize;
+    size_t      hostBufferFloor;                                     // Smallest host buffer size since records were dropped.
+    size_t      deviceBufferSize;                                    // CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_SIZE, 0 if unknown.
+    size_t      maxDeviceBufferSize;
+    size_t      devicePoolLimit;                                     // CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_POOL_LIMIT, 0 if unknown.
+    size_t      maxDevicePoolLimit;
+
+    std::chrono::steady_clock::time_point startTime;
+    std::chrono::steady_clock::time_point rateWindowStart;           // Start of the current one second rate window.
+    uint64_t    windowRequested;                                     // Buffers requested in the rate window.
+    uint64_t    windowCompleted;                                     // Buffers completed in the rate window.
+    double      requestRate;                                         // Buffers requested per second in the last rate window.
+    double      completionRate;                                      // Buffers completed per second in the last rate window.
+    double      peakCompletionRate;
+
+    uint64_t    buffersRequested;
+    uint64_t    buffersCompleted;
+    uint64_t    outstandingBytes;                                    // Host buffer bytes held by CUPTI.
+    uint64_t    peakOutstandingBytes;
+    uint64_t    allocatedBytes;                                      // Size of the completed buffers.
+    uint64_t    validBytes;                                          // Valid bytes of the completed buffers.
+    double      fillRatio;                                           // Moving average of validSize / size.
+    uint64_t    completionsSinceChange;
+    uint64_t    droppedRecords;
+
+    std::map<std::pair<uintptr_t, uint32_t>, BufferTunerStream> streams; // Per context and stream telemetry.
+    std::vector<BufferTunerDecision> decisions;
+    uint64_t    omittedDecisions;                                    // Decisions past BUFFER_TUNER_MAX_DECISIONS.
+} BufferTuner;
+
+// Helper Functions
+static double
+GetBufferTunerSeconds(
+    BufferTuner *pTuner)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - pTuner->startTime).count();
+}
+
+static void
+AddBufferTunerDecision(
+    BufferTuner *pTuner,
+    const char *pTarget,
+    size_t oldValue,
+    size_t newValue,
+    const char *pReason)
+{
+    if (pTuner->decisions.size() >= BUFFER_TUNER_MAX_DECISIONS)
+    {
+        pTuner->omittedDecisions++;
+        return;
+    }
+
+    BufferTunerDecision decision;
+    decision.timeSec = GetBufferTunerSeconds(pTuner);
+    decision.pTarget = pTarget;
+    decision.oldValue = oldValue;
+    decision.newValue = newValue;
+    snprintf(decision.reason, sizeof(decision.reason), "%s", pReason);
+
+    pTuner->decisions.push_back(decision);
+}
+
+static void
+SetHostBufferSize(
+    BufferTuner *pTuner,
+    size_t newSize,
+    const char *pReason)
+{
+    if (newSize < pTuner->hostBufferFloor)
+    {
+        newSize = pTuner->hostBufferFloor;
+    }
+    if (newSize > BUFFER_TUNER_MAX_HOST_BUFFER_SIZE)
+    {
+        newSize = BUFFER_TUNER_MAX_HOST_BUFFER_SIZE;
+    }
+    if (newSize == pTuner->hostBufferSize)
+    {
+        return;
+    }
+
+    AddBufferTunerDecision(pTuner, "host buffer size", pTuner->hostBufferSize, newSize, pReason);
+
+    pTuner->hostBufferSize = newSize;
+    if (newSize > pTuner->peakHostBufferSize)
+    {
+        pTuner->peakHostBufferSize = newSize;
+    }
+    pTuner->completionsSinceChange = 0;
+}
+
+// Grow the device buffers used by the contexts created from now on.
+static void
+GrowDeviceBuffers(
+    BufferTuner *pTuner,
+    const char *pReason)
+{
+    size_t attrValueSize = sizeof(size_t);
+
+    if (pTuner->deviceBufferSize && pTuner->deviceBufferSize < pTuner->maxDeviceBufferSize)
+    {
+        size_t newSize = pTuner->deviceBufferSize * 2;
+        if (newSize > pTuner->maxDeviceBufferSize)
+        {
+            newSize = pTuner->maxDeviceBufferSize;
+        }
+
+        if (cuptiActivitySetAttribute(CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_SIZE, &attrValueSize, &newSize) == CUPTI_SUCCESS)
+        {
+            AddBufferTunerDecision(pTuner, "device buffer size", pTuner->deviceBufferSize, newSize, pReason);
+            pTuner->deviceBufferSize = newSize;
+        }
+        else
+        {
+            cuptiGetLastError();
+            pTuner->maxDeviceBufferSize = pTuner->deviceBufferSize;
+        }
+    }
+    else if (pTuner->devicePoolLimit && pTuner->devicePoolLimit < pTuner->maxDevicePoolLimit)
+    {
+        size_t newLimit = pTuner->devicePoolLimit * 2;
+        if (newLimit > pTuner->maxDevicePoolLimit)
+        {
+            newLimit = pTuner->maxDevicePoolLimit;
+        }
+
+        if (cuptiActivitySetAttribute(CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_POOL_LIMIT, &attrValueSize, &newLimit) == CUPTI_SUCCESS)
+        {
+            AddBufferTunerDecision(pTuner, "device buffer pool limit", pTuner->devicePoolLimit, newLimit, pReason);
+            pTuner->devicePoolLimit = newLimit;
+        }
+        else
+        {
+            cuptiGetLastError();
+            pTuner->maxDevicePoolLimit = pTuner->devicePoolLimit;
+        }
+    }
+}
+
+// Close the rate window once a second has passed. Called with the mutex held.
+static void
+UpdateBufferTunerRates(
+    BufferTuner *pTuner)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - pTuner->rateWindowStart).count();
+
+    if (seconds < 1.0)
+    {
+        return;
+    }
+
+    pTuner->requestRate = pTuner->windowRequested / seconds;
+    pTuner->completionRate = pTuner->windowCompleted / seconds;
+    if (pTuner->completionRate > pTuner->peakCompletionRate)
+    {
+        pTuner->peakCompletionRate = pTuner->completionRate;
+    }
+
+    pTuner->windowRequested = 0;
+    pTuner->windowCompleted = 0;
+    pTuner->rateWindowStart = now;
+}
+
+static void
+InitBufferTuner(
+    BufferTuner *pTuner,
+    size_t hostBufferSize)
+{
+    size_t attrValue = 0;
+    size_t attrValueSize = sizeof(size_t);
+
+    std::lock_guard<std::mutex> lock(pTuner->mutex);
+
+    pTuner->enabled = 1;
+    pTuner->hostBufferSize = hostBufferSize;
+    pTuner->peakHostBufferSize = hostBufferSize;
+    pTuner->hostBufferFloor = BUFFER_TUNER_MIN_HOST_BUFFER_SIZE;
+
+    pTuner->deviceBufferSize = 0;
+    if (cuptiActivityGetAttribute(CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_SIZE, &attrValueSize, &attrValue) == CUPTI_SUCCESS)
+    {
+        pTuner->deviceBufferSize = attrValue;
+    }
+    else
+    {
+        cuptiGetLastError();
+    }
+    pTuner->maxDeviceBufferSize = pTuner->deviceBufferSize * BUFFER_TUNER_MAX_DEVICE_GROWTH;
+
+    pTuner->devicePoolLimit = 0;
+    attrValueSize = sizeof(size_t);
+    if (cuptiActivityGetAttribute(CUPTI_ACTIVITY_ATTR_DEVICE_BUFFER_POOL_LIMIT, &attrValueSize, &attrValue) == CUPTI_SUCCESS)
+    {
+        pTuner->devicePoolLimit = attrValue;
+    }
+    else
+    {
+        cuptiGetLastError();
+    }
+    pTuner->maxDevicePoolLimit = pTuner->devicePoolLimit * BUFFER_TUNER_MAX_DEVICE_GROWTH;
+
+    pTuner->startTime = std::chrono::steady_clock::now();
+    pTuner->rateWindowStart = pTuner->startTime;
+    pTuner->windowRequested = 0;
+    pTuner->windowCompleted = 0;
+    pTuner->requestRate = 0;
+    pTuner->completionRate = 0;
+    pTuner->peakCompletionRate = 0;
+
+    pTuner->buffersRequested = 0;
+    pTuner->buffersCompleted = 0;
+    pTuner->outstandingBytes = 0;
+    pTuner->peakOutstandingBytes = 0;
+    pTuner->allocatedBytes = 0;
+    pTuner->validBytes = 0;
+    pTuner->fillRatio = 0;
+    pTuner->completionsSinceChange = 0;
+    pTuner->droppedRecords = 0;
+
+    pTuner->streams.clear();
+    pTuner->decisions.clear();
+    pTuner->omittedDecisions = 0;
+}
+
+// Size of the buffer to hand to CUPTI.
+static size_t
+BufferTunerOnRequested(
+    BufferTuner *pTuner)
+{
+    std::lock_guard<std::mutex> lock(pTuner->mutex);
+
+    UpdateBufferTunerRates(pTuner);
+
+    pTuner->buffersRequested++;
+    pTuner->windowRequested++;
+    pTuner->outstandingBytes += pTuner->hostBufferSize;
+    if (pTuner->outstandingBytes > pTuner->peakOutstandingBytes)
+    {
+        pTuner->peakOutstandingBytes = pTuner->outstandingBytes;
+    }
+
+    return pTuner->hostBufferSize;
+}
+
+// Account a completed buffer and the records dropped for its context and stream since the last completion.
+static void
+BufferTunerOnCompleted(
+    BufferTuner *pTuner,
+    CUcontext context,
+    uint32_t streamId,
+    size_t size,
+    size_t validSize,
+    size_t droppedRecords)
+{
+    char reason[96];
+    double fill = size ? (double)validSize / (double)size : 0.0;
+
+    std::lock_guard<std::mutex> lock(pTuner->mutex);
+
+    UpdateBufferTunerRates(pTuner);
+
+    pTuner->buffersCompleted++;
+    pTuner->windowCompleted++;
+    pTuner->completionsSinceChange++;
+    pTuner->outstandingBytes -= (size <= pTuner->outstandingBytes) ? size : pTuner->outstandingBytes;
+    pTuner->allocatedBytes += size;
+    pTuner->validBytes += validSize;
+    pTuner->fillRatio = (pTuner->buffersCompleted == 1) ? fill : 0.75 * pTuner->fillRatio + 0.25 * fill;
+    pTuner->droppedRecords += droppedRecords;
+
+    BufferTunerStream &stream = pTuner->streams[std::make_pair((uintptr_t)context, streamId)];
+    stream.buffersCompleted++;
+    stream.droppedRecords += droppedRecords;
+
+    if (droppedRecords > 0)
+    {
+        snprintf(reason, sizeof(reason), "%llu records dropped on stream %u", (unsigned long long)droppedRecords, streamId);
+        SetHostBufferSize(pTuner, pTuner->hostBufferSize * 2, reason);
+        GrowDeviceBuffers(pTuner, reason);
+
+        // Never shrink back to a size that dropped records.
+        pTuner->hostBufferFloor = pTuner->hostBufferSize;
+    }
+    else if (fill >= BUFFER_TUNER_FULL_RATIO && pTuner->completionRate > BUFFER_TUNER_HIGH_COMPLETION_RATE && size >= pTuner->hostBufferSize)
+    {
+        snprintf(reason, sizeof(reason), "full buffers completed at %.1f/s", pTuner->completionRate);
+        SetHostBufferSize(pTuner, pTuner->hostBufferSize * 2, reason);
+    }
+    else if (pTuner->fillRatio < BUFFER_TUNER_SHRINK_RATIO && pTuner->completionsSinceChange >= BUFFER_TUNER_SHRINK_COMPLETIONS)
+    {
+        snprintf(reason, sizeof(reason), "average fill ratio %.2f", pTuner->fillRatio);
+        SetHostBufferSize(pTuner, pTuner->hostBufferSize / 2, reason);
+    }
+}
+
+static void
+PrintBufferTunerReport(
+    BufferTuner *pTuner,
+    FILE *pFileHandle)
+{
+    std::lock_guard<std::mutex> lock(pTuner->mutex);
+
+    fprintf(pFileHandle, "\nActivity buffer tuning report:\n");
+    fprintf(pFileHandle, "  buffers requested %llu, completed %llu, peak completion rate %.1f/s\n",
+            (unsigned long long)pTuner->buffersRequested,
+            (unsigned long long)pTuner->buffersCompleted,
+            pTuner->peakCompletionRate);
+    fprintf(pFileHandle, "  fill ratio %.3f overall, %.3f recent, dropped records %llu\n",
+            pTuner->allocatedBytes ? (double)pTuner->validBytes / (double)pTuner->allocatedBytes : 0.0,
+            pTuner->fillRatio,
+            (unsigned long long)pTuner->droppedRecords);
+    fprintf(pFileHandle, "  host buffer size %llu bytes, peak %llu bytes, peak held by CUPTI %llu bytes\n",
+            (unsigned long long)pTuner->hostBufferSize,
+            (unsigned long long)pTuner->peakHostBufferSize,
+            (unsigned long long)pTuner->peakOutstandingBytes);
+    fprintf(pFileHandle, "  device buffer size %llu bytes, device buffer pool limit %llu\n",
+            (unsigned long long)pTuner->deviceBufferSize,
+            (unsigned long long)pTuner->devicePoolLimit);
+
+    for (std::map<std::pair<uintptr_t, uint32_t>, BufferTunerStream>::const_iterator it = pTuner->streams.begin(); it != pTuner->streams.end(); ++it)
+    {
+        if (it->second.droppedRecords)
+        {
+            fprintf(pFileHandle, "  context %p, stream %u: %llu buffers, %llu dropped records\n",
+                    (void *)it->first.first,
+                    it->first.second,
+                    (unsigned long long)it->second.buffersCompleted,
+                    (unsigned long long)it->second.droppedRecords);
+        }
+    }
+
+    for (size_t i = 0; i < pTuner->decisions.size(); i++)
+    {
+        const BufferTunerDecision *pDecision = &pTuner->decisions[i];
+
+        fprintf(pFileHandle, "  [ %.3f s ] %s %llu -> %llu: %s\n",
+                pDecision->timeSec,
+                pDecision->pTarget,
+                (unsigned long long)pDecision->oldValue,
+                (unsigned long long)pDecision->newValue,
+                pDecision->reason);
+    }
+
+    if (pTuner->omittedDecisions)
+    {
+        fprintf(pFileHandle, "  %llu more decisions not shown\n", (unsigned long long)pTuner->omittedDecisions);
+    }
+}
+
+#endif // HELPER_CUPTI_BUFFER_TUNER_H_
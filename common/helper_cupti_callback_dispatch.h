@@ -0,0 +1,299 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_CALLBACK_DISPATCH_H_
+#define HELPER_CUPTI_CALLBACK_DISPATCH_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Table driven dispatch of the CUPTI callbacks.
+//
+// The handlers are registered at setup in a table indexed by domain and
+// callback id, so a callback costs two bounds checks and an indirect call
+// instead of a switch per domain. The table is not synchronized: register the
+// handlers before enabling their callbacks in CUPTI.
+//
+// Nothing else runs per callback unless printing is enabled, and then the
+// callback is only queued: a printer thread formats and writes the queued
+// callbacks. The queue is a bounded lock-free queue shared by the calling
+// threads, a full queue drops the callback and counts it. Errors are not
+// checked per callback, the handlers check the return codes of the CUPTI
+// calls they make.
+
+// Macros
+#define CALLBACK_PRINT_QUEUE_CAPACITY 65536
+#define CALLBACK_PRINT_INTERVAL_MS 10
+
+// Data structures
+typedef void (*CallbackDispatchFunc)(void *pUserData, CUpti_CallbackDomain domain, CUpti_CallbackId callbackId, const void *pCallbackData);
+
+typedef struct CallbackHandlerEntry_st
+{
+    CallbackDispatchFunc    pHandler;                                // NULL if the callback has no handler.
+    void                    *pUserData;
+} CallbackHandlerEntry;
+
+typedef struct CallbackPrintSlot_st
+{
+    std::atomic<uint64_t>   sequence;                                // Position the slot is ready to be written (== position) or read (== position + 1) at.
+    uint32_t                domain;
+    uint32_t                callbackId;
+} CallbackPrintSlot;
+
+typedef struct CallbackDispatch_st
+{
+    std::vector<CallbackHandlerEntry> handlers[CUPTI_CB_DOMAIN_SIZE]; // Indexed by callback id.
+
+    std::atomic<int>        printCallbacks;
+    FILE                    *pPrintFile;
+    CallbackPrintSlot       *pPrintSlots;                            // CALLBACK_PRINT_QUEUE_CAPACITY slots.
+    std::atomic<uint64_t>   printHead;                               // Next position written by the calling threads.
+    uint64_t                printTail;                               // Next position read by the printer thread.
+    std::atomic<uint64_t>   printDropped;                            // Callbacks not printed, the queue being full.
+    std::atomic<uint32_t>   printProducers;                          // Calling threads inside QueueCallbackPrint(), the slots are freed once it is 0.
+
+    std::thread             printThread;
+    std::mutex              printMutex;
+    std::condition_variable printCondition;
+    bool                    terminatePrinter;
+} CallbackDispatch;
+
+// Helper Functions
+// Call pHandler for the callback. Replaces the handler registered before, a NULL pHandler removes it.
+static void
+RegisterCallbackHandler(
+    CallbackDispatch *pDispatch,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    CallbackDispatchFunc pHandler,
+    void *pUserData)
+{
+    if ((uint32_t)domain >= CUPTI_CB_DOMAIN_SIZE)
+    {
+        std::cerr << "Invalid callback domain " << domain << ".\n";
+        return;
+    }
+
+    std::vector<CallbackHandlerEntry> &handlers = pDispatch->handlers[domain];
+    if (callbackId >= handlers.size())
+    {
+        CallbackHandlerEntry empty = { NULL, NULL };
+        handlers.resize(callbackId + 1, empty);
+    }
+
+    handlers[callbackId].pHandler = pHandler;
+    handlers[callbackId].pUserData = pUserData;
+}
+
+static inline void
+QueueCallbackPrint(
+    CallbackDispatch *pDispatch,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId)
+{
+    uint64_t position = pDispatch->printHead.load(std::memory_order_relaxed);
+    CallbackPrintSlot *pSlot = NULL;
+
+    while (1)
+    {
+        pSlot = &pDispatch->pPrintSlots[position & (CALLBACK_PRINT_QUEUE_CAPACITY - 1)];
+        int64_t difference = (int64_t)(pSlot->sequence.load(std::memory_order_acquire) - position);
+
+        if (difference == 0)
+        {
+            // The slot is free, claim the position.
+            if (pDispatch->printHead.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (difference < 0)
+        {
+            // The printer did not read the slot of the previous round yet.
+            pDispatch->printDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            position = pDispatch->printHead.load(std::memory_order_relaxed);
+        }
+    }
+
+    pSlot->domain = (uint32_t)domain;
+    pSlot->callbackId = (uint32_t)callbackId;
+    pSlot->sequence.store(position + 1, std::memory_order_release);
+}
+
+// Subscribe this function to CUPTI, or call it from the subscribed function, with the dispatch table.
+static inline void
+DispatchCallback(
+    CallbackDispatch *pDispatch,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    if (pDispatch->printCallbacks.load(std::memory_order_relaxed))
+    {
+        // Check the flag again once counted: either StopCallbackPrinter() sees this thread, or this thread sees the
+        // flag cleared, so the slots are not freed under it.
+        pDispatch->printProducers.fetch_add(1, std::memory_order_seq_cst);
+        if (pDispatch->printCallbacks.load(std::memory_order_seq_cst))
+        {
+            QueueCallbackPrint(pDispatch, domain, callbackId);
+        }
+        pDispatch->printProducers.fetch_sub(1, std::memory_order_release);
+    }
+
+    if ((uint32_t)domain < CUPTI_CB_DOMAIN_SIZE)
+    {
+        const std::vector<CallbackHandlerEntry> &handlers = pDispatch->handlers[domain];
+
+        if (callbackId < handlers.size() && handlers[callbackId].pHandler)
+        {
+            handlers[callbackId].pHandler(handlers[callbackId].pUserData, domain, callbackId, pCallbackData);
+        }
+    }
+}
+
+// Write the queued callbacks. Only called by the printer thread, or once it stopped.
+static void
+DrainCallbackPrints(
+    CallbackDispatch *pDispatch)
+{
+    bool printed = false;
+
+    while (1)
+    {
+        CallbackPrintSlot *pSlot = &pDispatch->pPrintSlots[pDispatch->printTail & (CALLBACK_PRINT_QUEUE_CAPACITY - 1)];
+
+        if (pSlot->sequence.load(std::memory_order_acquire) != pDispatch->printTail + 1)
+        {
+            break;
+        }
+
+        fprintf(pDispatch->pPrintFile, "CUPTI Callback: Domain %d CbId %d\n", (int)pSlot->domain, (int)pSlot->callbackId);
+        printed = true;
+
+        // Free the slot for the next round.
+        pSlot->sequence.store(pDispatch->printTail + CALLBACK_PRINT_QUEUE_CAPACITY, std::memory_order_release);
+        pDispatch->printTail++;
+    }
+
+    if (printed)
+    {
+        fflush(pDispatch->pPrintFile);
+    }
+}
+
+static void
+CallbackPrinterThread(
+    CallbackDispatch *pDispatch)
+{
+    std::chrono::milliseconds interval(CALLBACK_PRINT_INTERVAL_MS);
+
+    while (1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pDispatch->printMutex);
+            pDispatch->printCondition.wait_for(lock, interval, [pDispatch]{ return pDispatch->terminatePrinter; });
+            if (pDispatch->terminatePrinter)
+            {
+                break;
+            }
+        }
+
+        DrainCallbackPrints(pDispatch);
+    }
+}
+
+// Print every dispatched callback to pPrintFile from a printer thread.
+static void
+StartCallbackPrinter(
+    CallbackDispatch *pDispatch,
+    FILE *pPrintFile)
+{
+    if (pDispatch->printThread.joinable())
+    {
+        return;
+    }
+
+    pDispatch->pPrintSlots = new CallbackPrintSlot[CALLBACK_PRINT_QUEUE_CAPACITY];
+    for (uint64_t i = 0; i < CALLBACK_PRINT_QUEUE_CAPACITY; i++)
+    {
+        pDispatch->pPrintSlots[i].sequence = i;
+    }
+
+    pDispatch->pPrintFile = pPrintFile ? pPrintFile : stdout;
+    pDispatch->printHead = 0;
+    pDispatch->printTail = 0;
+    pDispatch->printDropped = 0;
+    pDispatch->terminatePrinter = false;
+    pDispatch->printThread = std::thread(CallbackPrinterThread, pDispatch);
+    pDispatch->printCallbacks = 1;
+}
+
+// Stop queuing, wait for the calling threads still queuing, write what is left in the queue and release it.
+static void
+StopCallbackPrinter(
+    CallbackDispatch *pDispatch)
+{
+    if (!pDispatch->printThread.joinable())
+    {
+        return;
+    }
+
+    pDispatch->printCallbacks.store(0, std::memory_order_seq_cst);
+
+    // cuptiUnsubscribe() does not wait for the callbacks already running, wait for the ones still queuing.
+    while (pDispatch->printProducers.load(std::memory_order_seq_cst) != 0)
+    {
+        std::this_thread::yield();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pDispatch->printMutex);
+        pDispatch->terminatePrinter = true;
+    }
+    pDispatch->printCondition.notify_all();
+    pDispatch->printThread.join();
+
+    DrainCallbackPrints(pDispatch);
+
+    if (pDispatch->printDropped)
+    {
+        fprintf(pDispatch->pPrintFile, "CUPTI Callback: %llu callbacks not printed, the print queue was full.\n",
+                (unsigned long long)pDispatch->printDropped.load());
+    }
+
+    delete[] pDispatch->pPrintSlots;
+    pDispatch->pPrintSlots = NULL;
+}
+
+#endif // HELPER_CUPTI_CALLBACK_DISPATCH_H_
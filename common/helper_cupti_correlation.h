@@ -0,0 +1,518 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_CORRELATION_H_
+#define HELPER_CUPTI_CORRELATION_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Streaming join of CUDA API records with the GPU activity records that share
+// their correlation id.
+//
+// Only the fields needed for the join are kept, in a fixed pool of entries
+// allocated once. Entries are indexed by an open addressing hash table on the
+// correlation id. As soon as the GPU side and the runtime API side of a
+// correlation id have arrived the pair is handed to the caller. The driver API
+// called by a runtime API shares its correlation id and its record comes first,
+// so a pair with a driver API is held until the runtime record arrives or the
+// entry leaves the join. A matched entry stays until it ages out, so that the
+// records of its correlation id still to come (the runtime record, the other
+// GPU records of a graph launch) are joined instead of counted as unmatched.
+// Memory is bounded by the number of correlation ids in flight, not by the
+// length of the run. Entries that never find a partner (most API calls have no
+// GPU work) are evicted oldest first, once they exceed the age limit or the
+// pool is full.
+
+// Macros
+#define CORRELATION_SIDE_API (1 << 0)
+#define CORRELATION_SIDE_GPU (1 << 1)
+
+// Data structures
+
+// API side of a correlation id, from a RUNTIME or DRIVER record.
+typedef struct CorrelationApi_st
+{
+    uint64_t start;                                                  // API start timestamp.
+    uint64_t end;                                                    // API end timestamp.
+    uint32_t cbid;                                                   // Callback id of the API.
+    uint32_t processId;                                              // Process calling the API.
+    uint32_t threadId;                                               // Thread calling the API.
+    uint8_t  kind;                                                   // CUPTI_ACTIVITY_KIND_RUNTIME or CUPTI_ACTIVITY_KIND_DRIVER.
+} CorrelationApi;
+
+// GPU side of a correlation id, from a kernel, memcpy or memset record.
+typedef struct CorrelationGpu_st
+{
+    uint64_t   start;                                                // GPU start timestamp.
+    uint64_t   end;                                                  // GPU end timestamp.
+    uint64_t   bytes;                                                // Bytes copied or set, 0 for kernels.
+    const char *pName;                                               // Kernel name owned by CUPTI, NULL for memory operations.
+    uint32_t   deviceId;                                             // Device executing the activity.
+    uint32_t   contextId;                                            // Context of the activity.
+    uint32_t   streamId;                                             // Stream of the activity.
+    uint8_t    kind;                                                 // Activity kind of the record.
+    uint8_t    copyKind;                                             // CUpti_ActivityMemcpyKind for memcpy records.
+} CorrelationGpu;
+
+typedef struct CorrelationEntry_st
+{
+    uint32_t       correlationId;                                    // Key of the entry.
+    uint8_t        sides;                                            // CORRELATION_SIDE_* flags received so far.
+    uint8_t        matched;                                          // 1 once a pair was handed to pMatched, the entry only absorbs later records.
+    uint64_t       sequence;                                         // Insertion sequence, used to detect stale age queue items.
+    uint64_t       timestamp;                                        // Start timestamp of the first side received.
+    CorrelationApi api;                                              // Valid if sides has CORRELATION_SIDE_API.
+    CorrelationGpu gpu;                                              // Valid if sides has CORRELATION_SIDE_GPU.
+} CorrelationEntry;
+
+// Called for every pair matched (both sides set), and for every entry evicted without a partner.
+typedef void (*CorrelationEntryFunc)(void *pUserData, const CorrelationEntry *pEntry);
+
+typedef struct CorrelationJoin_st
+{
+    uint32_t             capacity;                                   // Maximum number of entries in flight.
+    uint32_t             tableMask;                                  // Number of hash slots - 1, slots are a power of two.
+    uint32_t             *pSlots;                                    // Pool index + 1 per slot, 0 for an empty slot.
+    CorrelationEntry     *pPool;                                     // Entry arena, allocated once.
+    uint32_t             *pFreeList;                                 // Free pool indices.
+    uint32_t             numFree;                                    // Number of free pool indices.
+    uint32_t             *pAgeQueue;                                 // Pool indices in insertion order.
+    uint64_t             *pAgeSequence;                              // Sequence of the entry when it was queued.
+    uint32_t             ageQueueSize;                               // Capacity of the age queue.
+    uint32_t             ageHead;                                    // Oldest queued item.
+    uint32_t             ageCount;                                   // Number of queued items, including stale ones.
+    uint64_t             nextSequence;                               // Sequence of the next inserted entry.
+    uint64_t             maxAgeNs;                                   // Evict unmatched entries older than this, 0 disables age based eviction.
+    uint64_t             latestTimestamp;                            // Latest start timestamp seen.
+    CorrelationEntryFunc pMatched;                                   // Called for matched pairs.
+    CorrelationEntryFunc pEvicted;                                   // Called for unmatched entries, may be NULL.
+    void                 *pUserData;                                 // Passed to pMatched and pEvicted.
+    uint64_t             numMatched;                                 // Pairs matched.
+    uint64_t             numEvictedApi;                              // Evicted entries with only the API side.
+    uint64_t             numEvictedGpu;                              // Evicted entries with only the GPU side.
+    uint32_t             numEntries;                                 // Entries in flight.
+    uint32_t             peakEntries;                                // Most entries in flight at once.
+} CorrelationJoin;
+
+// Helper Functions
+static inline uint32_t
+HashCorrelationId(
+    uint32_t correlationId)
+{
+    // Fibonacci hashing spreads the sequential correlation ids over the table.
+    return (uint32_t)(correlationId * 2654435761u);
+}
+
+static int32_t
+FindCorrelationSlot(
+    const CorrelationJoin *pJoin,
+    uint32_t correlationId)
+{
+    uint32_t slot = HashCorrelationId(correlationId) & pJoin->tableMask;
+
+    while (pJoin->pSlots[slot])
+    {
+        if (pJoin->pPool[pJoin->pSlots[slot] - 1].correlationId == correlationId)
+        {
+            return (int32_t)slot;
+        }
+        slot = (slot + 1) & pJoin->tableMask;
+    }
+
+    return -1;
+}
+
+// Remove the entry in slot and return its pool index to the free list.
+// Uses backward shift deletion, so the table never accumulates tombstones.
+static void
+RemoveCorrelationSlot(
+    CorrelationJoin *pJoin,
+    uint32_t slot)
+{
+    uint32_t poolIndex = pJoin->pSlots[slot] - 1;
+    uint32_t hole = slot;
+    uint32_t next = (slot + 1) & pJoin->tableMask;
+
+    while (pJoin->pSlots[next])
+    {
+        uint32_t home = HashCorrelationId(pJoin->pPool[pJoin->pSlots[next] - 1].correlationId) & pJoin->tableMask;
+
+        // Move the entry into the hole if its home slot is not between the hole and its current slot.
+        if (((next - home) & pJoin->tableMask) >= ((next - hole) & pJoin->tableMask))
+        {
+            pJoin->pSlots[hole] = pJoin->pSlots[next];
+            hole = next;
+        }
+        next = (next + 1) & pJoin->tableMask;
+    }
+    pJoin->pSlots[hole] = 0;
+
+    pJoin->pPool[poolIndex].sequence = 0;
+    pJoin->pFreeList[pJoin->numFree++] = poolIndex;
+    pJoin->numEntries--;
+}
+
+// Hand the pair to the caller. The GPU side is cleared for the next GPU record of the correlation id.
+static void
+EmitCorrelationPair(
+    CorrelationJoin *pJoin,
+    CorrelationEntry *pEntry)
+{
+    pJoin->numMatched++;
+    if (pJoin->pMatched)
+    {
+        pJoin->pMatched(pJoin->pUserData, pEntry);
+    }
+
+    pEntry->matched = 1;
+    pEntry->sides &= ~CORRELATION_SIDE_GPU;
+}
+
+static void
+EvictCorrelationEntry(
+    CorrelationJoin *pJoin,
+    uint32_t poolIndex)
+{
+    CorrelationEntry *pEntry = &pJoin->pPool[poolIndex];
+    int32_t slot = FindCorrelationSlot(pJoin, pEntry->correlationId);
+
+    if (pEntry->sides == (CORRELATION_SIDE_API | CORRELATION_SIDE_GPU))
+    {
+        // A pair held for a runtime record that never came: the driver API is the API side.
+        EmitCorrelationPair(pJoin, pEntry);
+    }
+    else if (!pEntry->matched)
+    {
+        if (pEntry->sides & CORRELATION_SIDE_API)
+        {
+            pJoin->numEvictedApi++;
+        }
+        else
+        {
+            pJoin->numEvictedGpu++;
+        }
+
+        if (pJoin->pEvicted)
+        {
+            pJoin->pEvicted(pJoin->pUserData, pEntry);
+        }
+    }
+
+    if (slot >= 0)
+    {
+        RemoveCorrelationSlot(pJoin, (uint32_t)slot);
+    }
+}
+
+// Pop the oldest queued item. Items whose entry was matched in the meantime are stale and skipped.
+// Returns 1 if a live entry was evicted.
+static int
+EvictOldestCorrelationEntry(
+    CorrelationJoin *pJoin)
+{
+    uint32_t poolIndex = pJoin->pAgeQueue[pJoin->ageHead];
+    uint64_t sequence = pJoin->pAgeSequence[pJoin->ageHead];
+
+    pJoin->ageHead = (pJoin->ageHead + 1) % pJoin->ageQueueSize;
+    pJoin->ageCount--;
+
+    if (pJoin->pPool[poolIndex].sequence == sequence)
+    {
+        EvictCorrelationEntry(pJoin, poolIndex);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void
+EvictAgedCorrelationEntries(
+    CorrelationJoin *pJoin)
+{
+    while (pJoin->ageCount)
+    {
+        uint32_t poolIndex = pJoin->pAgeQueue[pJoin->ageHead];
+        const CorrelationEntry *pEntry = &pJoin->pPool[poolIndex];
+        int stale = (pEntry->sequence != pJoin->pAgeSequence[pJoin->ageHead]);
+
+        if (!stale &&
+            (pJoin->maxAgeNs == 0 || pEntry->timestamp + pJoin->maxAgeNs >= pJoin->latestTimestamp))
+        {
+            break;
+        }
+
+        EvictOldestCorrelationEntry(pJoin);
+    }
+}
+
+// Return the entry for correlationId, inserting an empty one if needed.
+static CorrelationEntry *
+GetCorrelationEntry(
+    CorrelationJoin *pJoin,
+    uint32_t correlationId,
+    uint64_t timestamp)
+{
+    int32_t found = FindCorrelationSlot(pJoin, correlationId);
+    if (found >= 0)
+    {
+        return &pJoin->pPool[pJoin->pSlots[found] - 1];
+    }
+
+    // Make room: the pool bounds the entries in flight, the queue bounds the stale items.
+    while (pJoin->numFree == 0 || pJoin->ageCount == pJoin->ageQueueSize)
+    {
+        EvictOldestCorrelationEntry(pJoin);
+    }
+
+    uint32_t poolIndex = pJoin->pFreeList[--pJoin->numFree];
+    CorrelationEntry *pEntry = &pJoin->pPool[poolIndex];
+    memset(pEntry, 0, sizeof(CorrelationEntry));
+    pEntry->correlationId = correlationId;
+    pEntry->sequence = pJoin->nextSequence++;
+    pEntry->timestamp = timestamp;
+
+    uint32_t slot = HashCorrelationId(correlationId) & pJoin->tableMask;
+    while (pJoin->pSlots[slot])
+    {
+        slot = (slot + 1) & pJoin->tableMask;
+    }
+    pJoin->pSlots[slot] = poolIndex + 1;
+
+    uint32_t tail = (pJoin->ageHead + pJoin->ageCount) % pJoin->ageQueueSize;
+    pJoin->pAgeQueue[tail] = poolIndex;
+    pJoin->pAgeSequence[tail] = pEntry->sequence;
+    pJoin->ageCount++;
+
+    pJoin->numEntries++;
+    if (pJoin->numEntries > pJoin->peakEntries)
+    {
+        pJoin->peakEntries = pJoin->numEntries;
+    }
+
+    return pEntry;
+}
+
+// Return the entry for correlationId with its GPU side free for a new GPU record.
+// A graph launch has several GPU records for one correlation id: the pair held
+// with a driver API is handed over first, a GPU side still without an API side
+// is evicted unmatched.
+static CorrelationEntry *
+GetCorrelationGpuEntry(
+    CorrelationJoin *pJoin,
+    uint32_t correlationId,
+    uint64_t timestamp)
+{
+    CorrelationEntry *pEntry = GetCorrelationEntry(pJoin, correlationId, timestamp);
+
+    if (pEntry->sides == (CORRELATION_SIDE_API | CORRELATION_SIDE_GPU))
+    {
+        EmitCorrelationPair(pJoin, pEntry);
+    }
+    else if (pEntry->sides == CORRELATION_SIDE_GPU)
+    {
+        pJoin->numEvictedGpu++;
+        if (pJoin->pEvicted)
+        {
+            pJoin->pEvicted(pJoin->pUserData, pEntry);
+        }
+        pEntry->sides = 0;
+    }
+
+    return pEntry;
+}
+
+// Join Functions
+static void
+InitCorrelationJoin(
+    CorrelationJoin *pJoin,
+    uint32_t capacity,
+    uint64_t maxAgeNs,
+    CorrelationEntryFunc pMatched,
+    CorrelationEntryFunc pEvicted,
+    void *pUserData)
+{
+    uint32_t numSlots = 1;
+
+    // Keep the load factor at or below one half.
+    while (numSlots < capacity * 2)
+    {
+        numSlots <<= 1;
+    }
+
+    memset(pJoin, 0, sizeof(CorrelationJoin));
+    pJoin->capacity = capacity;
+    pJoin->tableMask = numSlots - 1;
+    pJoin->ageQueueSize = capacity * 2;
+    pJoin->nextSequence = 1;
+    pJoin->maxAgeNs = maxAgeNs;
+    pJoin->pMatched = pMatched;
+    pJoin->pEvicted = pEvicted;
+    pJoin->pUserData = pUserData;
+
+    pJoin->pSlots = (uint32_t *)calloc(numSlots, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pJoin->pSlots);
+    pJoin->pPool = (CorrelationEntry *)calloc(capacity, sizeof(CorrelationEntry));
+    MEMORY_ALLOCATION_CALL(pJoin->pPool);
+    pJoin->pFreeList = (uint32_t *)malloc(capacity * sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pJoin->pFreeList);
+    pJoin->pAgeQueue = (uint32_t *)malloc(pJoin->ageQueueSize * sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pJoin->pAgeQueue);
+    pJoin->pAgeSequence = (uint64_t *)malloc(pJoin->ageQueueSize * sizeof(uint64_t));
+    MEMORY_ALLOCATION_CALL(pJoin->pAgeSequence);
+
+    for (uint32_t i = 0; i < capacity; i++)
+    {
+        pJoin->pFreeList[i] = capacity - 1 - i;
+    }
+    pJoin->numFree = capacity;
+}
+
+// Feed one activity record. RUNTIME and DRIVER records provide the API side,
+// KERNEL, CONCURRENT_KERNEL, MEMCPY and MEMSET records the GPU side; other kinds are ignored.
+// A pair is handed to pMatched at once with a runtime API, or once the entry leaves the join with a driver API.
+static void
+CorrelationJoinAddRecord(
+    CorrelationJoin *pJoin,
+    CUpti_Activity *pRecord)
+{
+    CorrelationEntry *pEntry = NULL;
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        {
+            CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)pRecord;
+
+            pEntry = GetCorrelationEntry(pJoin, pApiRecord->correlationId, pApiRecord->start);
+
+            // A runtime API and the driver API it calls share the correlation id, prefer the runtime API.
+            // Once a pair was handed over with the driver API, the runtime record only replaces it for the next GPU records.
+            if ((pEntry->sides & CORRELATION_SIDE_API) &&
+                pApiRecord->kind == CUPTI_ACTIVITY_KIND_DRIVER)
+            {
+                break;
+            }
+
+            pEntry->api.start = pApiRecord->start;
+            pEntry->api.end = pApiRecord->end;
+            pEntry->api.cbid = pApiRecord->cbid;
+            pEntry->api.processId = pApiRecord->processId;
+            pEntry->api.threadId = pApiRecord->threadId;
+            pEntry->api.kind = (uint8_t)pApiRecord->kind;
+            pEntry->sides |= CORRELATION_SIDE_API;
+
+            if (pApiRecord->start > pJoin->latestTimestamp)
+            {
+                pJoin->latestTimestamp = pApiRecord->start;
+            }
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+
+            pEntry = GetCorrelationGpuEntry(pJoin, pKernelRecord->correlationId, pKernelRecord->start);
+            pEntry->gpu.start = pKernelRecord->start;
+            pEntry->gpu.end = pKernelRecord->end;
+            pEntry->gpu.bytes = 0;
+            pEntry->gpu.pName = pKernelRecord->name;
+            pEntry->gpu.deviceId = pKernelRecord->deviceId;
+            pEntry->gpu.contextId = pKernelRecord->contextId;
+            pEntry->gpu.streamId = pKernelRecord->streamId;
+            pEntry->gpu.kind = (uint8_t)pKernelRecord->kind;
+            pEntry->sides |= CORRELATION_SIDE_GPU;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+
+            pEntry = GetCorrelationGpuEntry(pJoin, pMemcpyRecord->correlationId, pMemcpyRecord->start);
+            pEntry->gpu.start = pMemcpyRecord->start;
+            pEntry->gpu.end = pMemcpyRecord->end;
+            pEntry->gpu.bytes = pMemcpyRecord->bytes;
+            pEntry->gpu.pName = NULL;
+            pEntry->gpu.deviceId = pMemcpyRecord->deviceId;
+            pEntry->gpu.contextId = pMemcpyRecord->contextId;
+            pEntry->gpu.streamId = pMemcpyRecord->streamId;
+            pEntry->gpu.kind = (uint8_t)pMemcpyRecord->kind;
+            pEntry->gpu.copyKind = pMemcpyRecord->copyKind;
+            pEntry->sides |= CORRELATION_SIDE_GPU;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+
+            pEntry = GetCorrelationGpuEntry(pJoin, pMemsetRecord->correlationId, pMemsetRecord->start);
+            pEntry->gpu.start = pMemsetRecord->start;
+            pEntry->gpu.end = pMemsetRecord->end;
+            pEntry->gpu.bytes = pMemsetRecord->bytes;
+            pEntry->gpu.pName = NULL;
+            pEntry->gpu.deviceId = pMemsetRecord->deviceId;
+            pEntry->gpu.contextId = pMemsetRecord->contextId;
+            pEntry->gpu.streamId = pMemsetRecord->streamId;
+            pEntry->gpu.kind = (uint8_t)pMemsetRecord->kind;
+            pEntry->sides |= CORRELATION_SIDE_GPU;
+            break;
+        }
+        default:
+            return;
+    }
+
+    // Hold a pair with a driver API for the runtime record, unless a pair of the correlation id was already handed over.
+    if (pEntry->sides == (CORRELATION_SIDE_API | CORRELATION_SIDE_GPU) &&
+        (pEntry->api.kind == CUPTI_ACTIVITY_KIND_RUNTIME || pEntry->matched))
+    {
+        EmitCorrelationPair(pJoin, pEntry);
+    }
+
+    EvictAgedCorrelationEntries(pJoin);
+}
+
+// Evict every entry still in flight and hand over the pairs still held, e.g. at the end of the run.
+static void
+CorrelationJoinFlush(
+    CorrelationJoin *pJoin)
+{
+    while (pJoin->ageCount)
+    {
+        EvictOldestCorrelationEntry(pJoin);
+    }
+}
+
+static void
+FreeCorrelationJoin(
+    CorrelationJoin *pJoin)
+{
+    free(pJoin->pSlots);
+    free(pJoin->pPool);
+    free(pJoin->pFreeList);
+    free(pJoin->pAgeQueue);
+    free(pJoin->pAgeSequence);
+    memset(pJoin, 0, sizeof(CorrelationJoin));
+}
+
+#endif // HELPER_CUPTI_CORRELATION_H_
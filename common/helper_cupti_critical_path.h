@@ -0,0 +1,1317 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_CRITICAL_PATH_H_
+#define HELPER_CUPTI_CRITICAL_PATH_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Critical path of a step through the dependency DAG of the kernels,
+// memcpys, memsets and API calls, across the streams, devices and host
+// threads.
+//
+// Every operation is a node with a start and an end vertex. The edges are:
+//  - stream order: an operation starts after the previous one on its stream
+//    ended. The operations of a graph launch share the correlation id of the
+//    launch and their own dependencies are not in the activity records, so
+//    they are a batch which starts after the previous batch of the stream.
+//  - launch: a GPU operation starts after the start of the API call with its
+//    correlation id, and an API call which returned after the operation ended
+//    (a blocking memcpy) waited for it.
+//  - synchronization: a stream, event or context synchronization returns after
+//    the last operation issued before it (in correlation id order) on the
+//    streams it waits for, the event being resolved to the stream and the
+//    cudaEventRecord call it was recorded by from the CUDA_EVENT records.
+//  - stream wait event: the next batch of the waiting stream starts after
+//    the last operation issued on the stream of the event before the event.
+//  - host order: an API call starts after the previous call of its thread.
+//
+// A step is an NVTX range with the given name, the interval between two
+// instantaneous NVTX markers with that name, or the whole trace. Its critical
+// path is found by walking back from the last vertex of the step, through the
+// predecessor which finished last: the operations walked through from start
+// to end are on the path, and the time between two vertices of the path is
+// latency (launch, synchronization return, idle host). The slack of an
+// operation off the path is how much later it could have ended, the timing of
+// the rest being unchanged, without making the step longer.
+//
+// The nodes are appended as the records arrive to an arena of fixed size
+// blocks, which never moves them. The edges are built by the report in flat
+// arrays (compressed sparse rows), so memory grows linearly with the nodes.
+
+// Macros
+#define CRITICAL_PATH_INVALID 0xFFFFFFFFu
+#define CRITICAL_PATH_BLOCK_SHIFT 16                                 // Arena blocks of 65536 nodes.
+#define CRITICAL_PATH_BLOCK_NODES (1u << CRITICAL_PATH_BLOCK_SHIFT)
+#define CRITICAL_PATH_DEFAULT_MAX_NODES (1u << 24)
+#define CRITICAL_PATH_MAX_SYNCS (1 << 20)
+#define CRITICAL_PATH_MAX_EVENTS (1 << 20)
+#define CRITICAL_PATH_MAX_STEPS 65536
+#define CRITICAL_PATH_MAX_NAMES 4096                                 // Further names are counted under "<other>".
+#define CRITICAL_PATH_MAX_PATH_LINES 20
+#define CRITICAL_PATH_TOP_COUNT 10
+
+// Data structures
+typedef enum
+{
+    CRITICAL_PATH_NODE_KERNEL = 0,
+    CRITICAL_PATH_NODE_MEMCPY = 1,
+    CRITICAL_PATH_NODE_MEMSET = 2,
+    CRITICAL_PATH_NODE_RUNTIME = 3,                                  // Sorted before the driver, preferred for a correlation id.
+    CRITICAL_PATH_NODE_DRIVER = 4,
+    CRITICAL_PATH_NODE_KIND_COUNT = 5
+} CriticalPathNodeKind;
+
+typedef struct CriticalPathNode_st
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t correlationId;
+    uint32_t name;                                                   // Name id of a GPU operation, cbid of an API call.
+    uint32_t lane;                                                   // Stream of a GPU operation, thread of an API call.
+    uint32_t kind;                                                   // CriticalPathNodeKind.
+} CriticalPathNode;
+
+typedef struct CriticalPathSync_st
+{
+    uint64_t eventSyncId;
+    uint32_t correlationId;
+    uint32_t contextId;
+    uint32_t streamId;
+    uint32_t eventId;
+    uint32_t type;                                                   // CUpti_ActivitySynchronizationType.
+} CriticalPathSync;
+
+// Stream and cudaEventRecord call of an event.
+typedef struct CriticalPathEvent_st
+{
+    uint32_t streamId;
+    uint32_t correlationId;
+} CriticalPathEvent;
+
+// Totals of the operations of one kind and name over the steps.
+typedef struct CriticalPathName_st
+{
+    uint64_t pathNs;
+    uint64_t pathCount;
+    uint64_t offPathCount;
+    uint64_t slackNs;                                                // Sum of the slack off the path.
+    uint64_t minSlackNs;
+} CriticalPathName;
+
+// Consecutive operations of the same kind and name on the critical path.
+typedef struct CriticalPathSegment_st
+{
+    uint64_t start;
+    uint64_t durationNs;
+    uint64_t gapNs;                                                  // Latency before the segment.
+    uint32_t kind;
+    uint32_t name;
+    uint32_t count;
+} CriticalPathSegment;
+
+// Dependency graph of all the nodes, built by the report.
+typedef struct CriticalPathGraph_st
+{
+    std::vector<uint8_t>  dead;                                      // API records duplicating the runtime record of their correlation id.
+    std::vector<uint32_t> apiByCorrelation;                          // Live API nodes sorted by correlation id.
+    std::vector<uint32_t> laneOffsets;
+    std::vector<uint32_t> laneNodes;                                 // Nodes of every lane sorted by start.
+    std::vector<uint32_t> laneTails;                                 // Latest ending node of the batch of every lane node.
+    std::vector<uint32_t> successorOffsets;                          // By vertex: 2 * node for the start, 2 * node + 1 for the end.
+    std::vector<uint32_t> successors;
+    std::vector<uint32_t> byStart;                                   // Live nodes sorted by start.
+    uint64_t              numEdges;
+    uint64_t              numBackwardEdges;                          // Dropped, the target being earlier than the source.
+} CriticalPathGraph;
+
+typedef struct CriticalPathAnalyzer_st
+{
+    std::mutex                                                  mutex;
+    std::vector<CriticalPathNode *>                             blocks;   // Node arena.
+    uint32_t                                                    numNodes;
+    uint32_t                                                    maxNodes;
+    std::unordered_map<uint64_t, uint32_t>                      streamLanes; // contextId << 32 | streamId to lane.
+    std::unordered_map<uint64_t, uint32_t>                      threadLanes; // processId << 32 | threadId to lane.
+    std::vector<uint64_t>                                       laneKeys;
+    std::vector<CriticalPathSync>                               syncs;
+    std::map<std::pair<uint64_t, uint64_t>, CriticalPathEvent>  events;   // (contextId << 32 | eventId, cudaEventSyncId).
+    std::map<uint64_t, CriticalPathEvent>                       latestEvents;
+    std::string                                                 stepName; // Empty for the whole trace.
+    std::unordered_map<uint64_t, uint64_t>                      openSteps; // Marker id to start.
+    std::vector<std::pair<uint64_t, uint64_t> >                 steps;
+    std::vector<uint64_t>                                       stepMarks; // Instantaneous markers.
+    std::vector<std::string>                                    names;
+    std::unordered_map<std::string, uint32_t>                   nameIds;
+    uint64_t                                                    numDroppedNodes;
+    uint64_t                                                    numDroppedSyncs;
+    uint64_t                                                    numDroppedEvents;
+    uint64_t                                                    numDroppedSteps;
+} CriticalPathAnalyzer;
+
+// Helper Functions
+static inline CriticalPathNode *
+GetCriticalPathNode(
+    const CriticalPathAnalyzer *pAnalyzer,
+    uint32_t node)
+{
+    return &pAnalyzer->blocks[node >> CRITICAL_PATH_BLOCK_SHIFT][node & (CRITICAL_PATH_BLOCK_NODES - 1)];
+}
+
+// Time of a vertex, 2 * node for the start of the node and 2 * node + 1 for its end.
+static inline uint64_t
+GetCriticalPathTime(
+    const CriticalPathAnalyzer *pAnalyzer,
+    uint32_t vertex)
+{
+    const CriticalPathNode *pNode = GetCriticalPathNode(pAnalyzer, vertex >> 1);
+
+    return (vertex & 1) ? pNode->end : pNode->start;
+}
+
+static inline bool
+IsCriticalPathApi(
+    uint32_t kind)
+{
+    return kind == CRITICAL_PATH_NODE_RUNTIME || kind == CRITICAL_PATH_NODE_DRIVER;
+}
+
+static uint32_t
+GetCriticalPathNameId(
+    CriticalPathAnalyzer *pAnalyzer,
+    const std::string &name)
+{
+    std::unordered_map<std::string, uint32_t>::const_iterator it = pAnalyzer->nameIds.find(name);
+    if (it != pAnalyzer->nameIds.end())
+    {
+        return it->second;
+    }
+
+    if (pAnalyzer->names.size() >= CRITICAL_PATH_MAX_NAMES)
+    {
+        return GetCriticalPathNameId(pAnalyzer, "<other>");
+    }
+
+    uint32_t nameId = (uint32_t)pAnalyzer->names.size();
+    pAnalyzer->names.push_back(name);
+    pAnalyzer->nameIds[name] = nameId;
+
+    return nameId;
+}
+
+static uint32_t
+GetCriticalPathLane(
+    CriticalPathAnalyzer *pAnalyzer,
+    std::unordered_map<uint64_t, uint32_t> &lanes,
+    uint64_t key)
+{
+    std::unordered_map<uint64_t, uint32_t>::const_iterator it = lanes.find(key);
+    if (it != lanes.end())
+    {
+        return it->second;
+    }
+
+    uint32_t lane = (uint32_t)pAnalyzer->laneKeys.size();
+    pAnalyzer->laneKeys.push_back(key);
+    lanes[key] = lane;
+
+    return lane;
+}
+
+static void
+AddCriticalPathNode(
+    CriticalPathAnalyzer *pAnalyzer,
+    uint32_t kind,
+    uint64_t start,
+    uint64_t end,
+    uint32_t correlationId,
+    uint32_t name,
+    uint32_t lane)
+{
+    if (pAnalyzer->numNodes >= pAnalyzer->maxNodes)
+    {
+        pAnalyzer->numDroppedNodes++;
+        return;
+    }
+
+    if ((pAnalyzer->numNodes >> CRITICAL_PATH_BLOCK_SHIFT) >= pAnalyzer->blocks.size())
+    {
+        CriticalPathNode *pBlock = (CriticalPathNode *)malloc(CRITICAL_PATH_BLOCK_NODES * sizeof(CriticalPathNode));
+        MEMORY_ALLOCATION_CALL(pBlock);
+        pAnalyzer->blocks.push_back(pBlock);
+    }
+
+    CriticalPathNode *pNode = GetCriticalPathNode(pAnalyzer, pAnalyzer->numNodes++);
+    pNode->start = start;
+    pNode->end = std::max(start, end);
+    pNode->correlationId = correlationId;
+    pNode->name = name;
+    pNode->lane = lane;
+    pNode->kind = kind;
+}
+
+static void
+AddCriticalPathGpuNode(
+    CriticalPathAnalyzer *pAnalyzer,
+    uint32_t kind,
+    uint64_t start,
+    uint64_t end,
+    uint32_t correlationId,
+    uint32_t contextId,
+    uint32_t streamId,
+    const std::string &name)
+{
+    if (pAnalyzer->numNodes >= pAnalyzer->maxNodes)
+    {
+        pAnalyzer->numDroppedNodes++;
+        return;
+    }
+
+    uint32_t lane = GetCriticalPathLane(pAnalyzer, pAnalyzer->streamLanes, ((uint64_t)contextId << 32) | streamId);
+    AddCriticalPathNode(pAnalyzer, kind, start, end, correlationId, GetCriticalPathNameId(pAnalyzer, name), lane);
+}
+
+static void
+AddCriticalPathMarker(
+    CriticalPathAnalyzer *pAnalyzer,
+    const CUpti_ActivityMarker2 *pMarker)
+{
+    if (pMarker->flags & CUPTI_ACTIVITY_FLAG_MARKER_START)
+    {
+        if (pMarker->name && pAnalyzer->stepName == pMarker->name)
+        {
+            pAnalyzer->openSteps[pMarker->id] = pMarker->timestamp;
+        }
+    }
+    else if (pMarker->flags & CUPTI_ACTIVITY_FLAG_MARKER_END)
+    {
+        std::unordered_map<uint64_t, uint64_t>::iterator it = pAnalyzer->openSteps.find(pMarker->id);
+        if (it != pAnalyzer->openSteps.end())
+        {
+            if (pAnalyzer->steps.size() < CRITICAL_PATH_MAX_STEPS)
+            {
+                pAnalyzer->steps.push_back(std::make_pair(it->second, pMarker->timestamp));
+            }
+            else
+            {
+                pAnalyzer->numDroppedSteps++;
+            }
+            pAnalyzer->openSteps.erase(it);
+        }
+    }
+    else if (pMarker->flags & CUPTI_ACTIVITY_FLAG_MARKER_INSTANTANEOUS)
+    {
+        if (pMarker->name && pAnalyzer->stepName == pMarker->name)
+        {
+            if (pAnalyzer->stepMarks.size() <= CRITICAL_PATH_MAX_STEPS)
+            {
+                pAnalyzer->stepMarks.push_back(pMarker->timestamp);
+            }
+            else
+            {
+                pAnalyzer->numDroppedSteps++;
+            }
+        }
+    }
+}
+
+// maxNodes bounds the arena, pStepName selects the steps (NULL or empty for the whole trace).
+static void
+InitCriticalPathAnalyzer(
+    CriticalPathAnalyzer *pAnalyzer,
+    uint32_t maxNodes,
+    const char *pStepName)
+{
+    pAnalyzer->blocks.clear();
+    pAnalyzer->numNodes = 0;
+    // Vertices are 2 * node + 1 in 32 bits.
+    pAnalyzer->maxNodes = std::min(std::max(maxNodes, 1u), 0x7FFFFFFFu);
+    pAnalyzer->streamLanes.clear();
+    pAnalyzer->threadLanes.clear();
+    pAnalyzer->laneKeys.clear();
+    pAnalyzer->syncs.clear();
+    pAnalyzer->events.clear();
+    pAnalyzer->latestEvents.clear();
+    pAnalyzer->stepName = pStepName ? pStepName : "";
+    pAnalyzer->openSteps.clear();
+    pAnalyzer->steps.clear();
+    pAnalyzer->stepMarks.clear();
+    pAnalyzer->names.clear();
+    pAnalyzer->nameIds.clear();
+    pAnalyzer->numDroppedNodes = 0;
+    pAnalyzer->numDroppedSyncs = 0;
+    pAnalyzer->numDroppedEvents = 0;
+    pAnalyzer->numDroppedSteps = 0;
+}
+
+// Feed one activity record: kernel, memcpy, memset, RUNTIME, DRIVER, SYNCHRONIZATION,
+// CUDA_EVENT and MARKER records are used, other kinds are ignored.
+static void
+CriticalPathAddRecord(
+    CriticalPathAnalyzer *pAnalyzer,
+    CUpti_Activity *pRecord)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            AddCriticalPathGpuNode(pAnalyzer, CRITICAL_PATH_NODE_KERNEL, pKernelRecord->start, pKernelRecord->end, pKernelRecord->correlationId,
+                                   pKernelRecord->contextId, pKernelRecord->streamId, pKernelRecord->name ? pKernelRecord->name : "<unknown>");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            AddCriticalPathGpuNode(pAnalyzer, CRITICAL_PATH_NODE_MEMCPY, pMemcpyRecord->start, pMemcpyRecord->end, pMemcpyRecord->correlationId,
+                                   pMemcpyRecord->contextId, pMemcpyRecord->streamId,
+                                   std::string("[memcpy ") + GetMemcpyKindString((CUpti_ActivityMemcpyKind)pMemcpyRecord->copyKind) + "]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY2:
+        {
+            CUpti_ActivityMemcpyPtoP4 *pMemcpyPtoPRecord = (CUpti_ActivityMemcpyPtoP4 *)pRecord;
+            AddCriticalPathGpuNode(pAnalyzer, CRITICAL_PATH_NODE_MEMCPY, pMemcpyPtoPRecord->start, pMemcpyPtoPRecord->end,
+                                   pMemcpyPtoPRecord->correlationId, pMemcpyPtoPRecord->contextId, pMemcpyPtoPRecord->streamId, "[memcpy PtoP]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+            AddCriticalPathGpuNode(pAnalyzer, CRITICAL_PATH_NODE_MEMSET, pMemsetRecord->start, pMemsetRecord->end, pMemsetRecord->correlationId,
+                                   pMemsetRecord->contextId, pMemsetRecord->streamId, "[memset]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        {
+            CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)pRecord;
+
+            if (pAnalyzer->numNodes >= pAnalyzer->maxNodes)
+            {
+                pAnalyzer->numDroppedNodes++;
+                break;
+            }
+            uint32_t lane = GetCriticalPathLane(pAnalyzer, pAnalyzer->threadLanes, ((uint64_t)pApiRecord->processId << 32) | pApiRecord->threadId);
+            AddCriticalPathNode(pAnalyzer, pRecord->kind == CUPTI_ACTIVITY_KIND_RUNTIME ? CRITICAL_PATH_NODE_RUNTIME : CRITICAL_PATH_NODE_DRIVER,
+                                pApiRecord->start, pApiRecord->end, pApiRecord->correlationId, pApiRecord->cbid, lane);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_SYNCHRONIZATION:
+        {
+            CUpti_ActivitySynchronization2 *pSynchronizationRecord = (CUpti_ActivitySynchronization2 *)pRecord;
+
+            if (pAnalyzer->syncs.size() >= CRITICAL_PATH_MAX_SYNCS)
+            {
+                pAnalyzer->numDroppedSyncs++;
+                break;
+            }
+
+            CriticalPathSync sync;
+            sync.eventSyncId = pSynchronizationRecord->cudaEventSyncId;
+            sync.correlationId = pSynchronizationRecord->correlationId;
+            sync.contextId = pSynchronizationRecord->contextId;
+            sync.streamId = pSynchronizationRecord->streamId;
+            sync.eventId = pSynchronizationRecord->cudaEventId;
+            sync.type = pSynchronizationRecord->type;
+            pAnalyzer->syncs.push_back(sync);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_CUDA_EVENT:
+        {
+            CUpti_ActivityCudaEvent2 *pCudaEventRecord = (CUpti_ActivityCudaEvent2 *)pRecord;
+            uint64_t eventKey = ((uint64_t)pCudaEventRecord->contextId << 32) | pCudaEventRecord->eventId;
+
+            CriticalPathEvent event;
+            event.streamId = pCudaEventRecord->streamId;
+            event.correlationId = pCudaEventRecord->correlationId;
+
+            pAnalyzer->latestEvents[eventKey] = event;
+            if (pAnalyzer->events.size() < CRITICAL_PATH_MAX_EVENTS)
+            {
+                pAnalyzer->events[std::make_pair(eventKey, (uint64_t)pCudaEventRecord->cudaEventSyncId)] = event;
+            }
+            else
+            {
+                pAnalyzer->numDroppedEvents++;
+            }
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MARKER:
+        {
+            if (!pAnalyzer->stepName.empty())
+            {
+                AddCriticalPathMarker(pAnalyzer, (CUpti_ActivityMarker2 *)pRecord);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Live API node of a correlation id, CRITICAL_PATH_INVALID if none.
+static uint32_t
+FindCriticalPathApi(
+    const CriticalPathAnalyzer *pAnalyzer,
+    const CriticalPathGraph *pGraph,
+    uint32_t correlationId)
+{
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(pGraph->apiByCorrelation.begin(), pGraph->apiByCorrelation.end(), correlationId,
+        [pAnalyzer](uint32_t node, uint32_t id) { return GetCriticalPathNode(pAnalyzer, node)->correlationId < id; });
+
+    if (it == pGraph->apiByCorrelation.end() || GetCriticalPathNode(pAnalyzer, *it)->correlationId != correlationId)
+    {
+        return CRITICAL_PATH_INVALID;
+    }
+
+    return *it;
+}
+
+// Position in laneNodes of the first node of the lane issued after correlationId.
+static uint32_t
+FindCriticalPathIssued(
+    const CriticalPathAnalyzer *pAnalyzer,
+    const CriticalPathGraph *pGraph,
+    uint32_t lane,
+    uint32_t correlationId)
+{
+    // The operations of a stream run in issue order, so the correlation ids increase with the start.
+    return (uint32_t)(std::upper_bound(pGraph->laneNodes.begin() + pGraph->laneOffsets[lane], pGraph->laneNodes.begin() + pGraph->laneOffsets[lane + 1],
+                                       correlationId,
+                                       [pAnalyzer](uint32_t id, uint32_t node) { return id < GetCriticalPathNode(pAnalyzer, node)->correlationId; }) -
+                      pGraph->laneNodes.begin());
+}
+
+// Latest ending operation of the last batch issued on the stream before correlationId, CRITICAL_PATH_INVALID if none.
+static uint32_t
+FindCriticalPathLastIssued(
+    const CriticalPathAnalyzer *pAnalyzer,
+    const CriticalPathGraph *pGraph,
+    uint32_t lane,
+    uint32_t correlationId)
+{
+    if (!correlationId)
+    {
+        return CRITICAL_PATH_INVALID;
+    }
+
+    uint32_t position = FindCriticalPathIssued(pAnalyzer, pGraph, lane, correlationId - 1);
+
+    return position > pGraph->laneOffsets[lane] ? pGraph->laneTails[position - 1] : CRITICAL_PATH_INVALID;
+}
+
+static void
+AddCriticalPathEdge(
+    const CriticalPathAnalyzer *pAnalyzer,
+    CriticalPathGraph *pGraph,
+    std::vector<std::pair<uint32_t, uint32_t> > &edges,
+    uint32_t from,
+    uint32_t to)
+{
+    // Only the edges forward in time are kept, which keeps the graph acyclic but for equal timestamps.
+    if (GetCriticalPathTime(pAnalyzer, from) > GetCriticalPathTime(pAnalyzer, to))
+    {
+        pGraph->numBackwardEdges++;
+        return;
+    }
+
+    edges.push_back(std::make_pair(from, to));
+}
+
+static void
+BuildCriticalPathGraph(
+    const CriticalPathAnalyzer *pAnalyzer,
+    CriticalPathGraph *pGraph)
+{
+    uint32_t numNodes = pAnalyzer->numNodes;
+    uint32_t numLanes = (uint32_t)pAnalyzer->laneKeys.size();
+
+    pGraph->numEdges = 0;
+    pGraph->numBackwardEdges = 0;
+
+    // A runtime API call and the driver API call it makes share the correlation id, the runtime one is kept.
+    pGraph->dead.assign(numNodes, 0);
+    pGraph->apiByCorrelation.clear();
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        if (IsCriticalPathApi(GetCriticalPathNode(pAnalyzer, node)->kind))
+        {
+            pGraph->apiByCorrelation.push_back(node);
+        }
+    }
+    std::sort(pGraph->apiByCorrelation.begin(), pGraph->apiByCorrelation.end(), [pAnalyzer](uint32_t a, uint32_t b)
+    {
+        const CriticalPathNode *pA = GetCriticalPathNode(pAnalyzer, a);
+        const CriticalPathNode *pB = GetCriticalPathNode(pAnalyzer, b);
+        return pA->correlationId != pB->correlationId ? pA->correlationId < pB->correlationId : pA->kind < pB->kind;
+    });
+    size_t numLive = 0;
+    for (size_t i = 0; i < pGraph->apiByCorrelation.size(); i++)
+    {
+        uint32_t node = pGraph->apiByCorrelation[i];
+        if (numLive && GetCriticalPathNode(pAnalyzer, pGraph->apiByCorrelation[numLive - 1])->correlationId == GetCriticalPathNode(pAnalyzer, node)->correlationId)
+        {
+            pGraph->dead[node] = 1;
+            continue;
+        }
+        pGraph->apiByCorrelation[numLive++] = node;
+    }
+    pGraph->apiByCorrelation.resize(numLive);
+
+    // Lanes, by counting sort.
+    pGraph->laneOffsets.assign(numLanes + 1, 0);
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        if (!pGraph->dead[node])
+        {
+            pGraph->laneOffsets[GetCriticalPathNode(pAnalyzer, node)->lane + 1]++;
+        }
+    }
+    for (uint32_t lane = 0; lane < numLanes; lane++)
+    {
+        pGraph->laneOffsets[lane + 1] += pGraph->laneOffsets[lane];
+    }
+    pGraph->laneNodes.resize(pGraph->laneOffsets[numLanes]);
+    {
+        std::vector<uint32_t> next(pGraph->laneOffsets.begin(), pGraph->laneOffsets.end() - 1);
+        for (uint32_t node = 0; node < numNodes; node++)
+        {
+            if (!pGraph->dead[node])
+            {
+                pGraph->laneNodes[next[GetCriticalPathNode(pAnalyzer, node)->lane]++] = node;
+            }
+        }
+    }
+    for (uint32_t lane = 0; lane < numLanes; lane++)
+    {
+        std::sort(pGraph->laneNodes.begin() + pGraph->laneOffsets[lane], pGraph->laneNodes.begin() + pGraph->laneOffsets[lane + 1],
+                  [pAnalyzer](uint32_t a, uint32_t b)
+        {
+            const CriticalPathNode *pA = GetCriticalPathNode(pAnalyzer, a);
+            const CriticalPathNode *pB = GetCriticalPathNode(pAnalyzer, b);
+            return pA->start != pB->start ? pA->start < pB->start : pA->correlationId < pB->correlationId;
+        });
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t> > edges;
+    edges.reserve((size_t)numNodes * 2);
+
+    // Stream order by batch, and host order.
+    pGraph->laneTails.resize(pGraph->laneNodes.size());
+    for (uint32_t lane = 0; lane < numLanes; lane++)
+    {
+        uint32_t begin = pGraph->laneOffsets[lane];
+        uint32_t end = pGraph->laneOffsets[lane + 1];
+
+        if (begin == end)
+        {
+            continue;
+        }
+
+        if (IsCriticalPathApi(GetCriticalPathNode(pAnalyzer, pGraph->laneNodes[begin])->kind))
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                pGraph->laneTails[i] = pGraph->laneNodes[i];
+                if (i == begin)
+                {
+                    continue;
+                }
+
+                uint32_t previous = pGraph->laneNodes[i - 1];
+                uint32_t node = pGraph->laneNodes[i];
+                if (GetCriticalPathNode(pAnalyzer, node)->start >= GetCriticalPathNode(pAnalyzer, previous)->end)
+                {
+                    AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * previous + 1, 2 * node);
+                }
+                else
+                {
+                    // Nested call, e.g. a driver call made by a runtime call.
+                    AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * previous, 2 * node);
+                    AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * node + 1, 2 * previous + 1);
+                }
+            }
+            continue;
+        }
+
+        uint32_t previousTail = CRITICAL_PATH_INVALID;
+        for (uint32_t i = begin; i < end;)
+        {
+            uint32_t correlationId = GetCriticalPathNode(pAnalyzer, pGraph->laneNodes[i])->correlationId;
+            uint32_t tail = pGraph->laneNodes[i];
+            uint32_t j = i;
+
+            for (; j < end && GetCriticalPathNode(pAnalyzer, pGraph->laneNodes[j])->correlationId == correlationId; j++)
+            {
+                if (GetCriticalPathNode(pAnalyzer, pGraph->laneNodes[j])->end > GetCriticalPathNode(pAnalyzer, tail)->end)
+                {
+                    tail = pGraph->laneNodes[j];
+                }
+            }
+            for (uint32_t k = i; k < j; k++)
+            {
+                pGraph->laneTails[k] = tail;
+                if (previousTail != CRITICAL_PATH_INVALID)
+                {
+                    AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * previousTail + 1, 2 * pGraph->laneNodes[k]);
+                }
+            }
+            previousTail = tail;
+            i = j;
+        }
+    }
+
+    // Launches, and the API calls which waited for their operation.
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        const CriticalPathNode *pNode = GetCriticalPathNode(pAnalyzer, node);
+
+        if (IsCriticalPathApi(pNode->kind))
+        {
+            continue;
+        }
+
+        uint32_t api = FindCriticalPathApi(pAnalyzer, pGraph, pNode->correlationId);
+        if (api != CRITICAL_PATH_INVALID)
+        {
+            AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * api, 2 * node);
+            if (GetCriticalPathNode(pAnalyzer, api)->end >= pNode->end)
+            {
+                AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * node + 1, 2 * api + 1);
+            }
+        }
+    }
+
+    // Synchronizations and stream waits.
+    for (size_t i = 0; i < pAnalyzer->syncs.size(); i++)
+    {
+        const CriticalPathSync &sync = pAnalyzer->syncs[i];
+        uint32_t api = FindCriticalPathApi(pAnalyzer, pGraph, sync.correlationId);
+        std::unordered_map<uint64_t, uint32_t>::const_iterator lane;
+        const CriticalPathEvent *pEvent = NULL;
+
+        if (sync.type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_EVENT_SYNCHRONIZE || sync.type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_WAIT_EVENT)
+        {
+            uint64_t eventKey = ((uint64_t)sync.contextId << 32) | sync.eventId;
+            std::map<std::pair<uint64_t, uint64_t>, CriticalPathEvent>::const_iterator event = pAnalyzer->events.find(std::make_pair(eventKey, sync.eventSyncId));
+            std::map<uint64_t, CriticalPathEvent>::const_iterator latest = pAnalyzer->latestEvents.find(eventKey);
+
+            if (event != pAnalyzer->events.end())
+            {
+                pEvent = &event->second;
+            }
+            else if (latest != pAnalyzer->latestEvents.end())
+            {
+                pEvent = &latest->second;
+            }
+            else
+            {
+                continue;
+            }
+        }
+
+        switch (sync.type)
+        {
+            case CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_SYNCHRONIZE:
+            case CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_EVENT_SYNCHRONIZE:
+            {
+                lane = pAnalyzer->streamLanes.find(((uint64_t)sync.contextId << 32) | (pEvent ? pEvent->streamId : sync.streamId));
+                if (api != CRITICAL_PATH_INVALID && lane != pAnalyzer->streamLanes.end())
+                {
+                    uint32_t last = FindCriticalPathLastIssued(pAnalyzer, pGraph, lane->second, pEvent ? pEvent->correlationId : sync.correlationId);
+                    if (last != CRITICAL_PATH_INVALID)
+                    {
+                        AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * last + 1, 2 * api + 1);
+                    }
+                }
+                break;
+            }
+            case CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_CONTEXT_SYNCHRONIZE:
+            {
+                if (api == CRITICAL_PATH_INVALID)
+                {
+                    break;
+                }
+                for (lane = pAnalyzer->streamLanes.begin(); lane != pAnalyzer->streamLanes.end(); ++lane)
+                {
+                    if ((uint32_t)(lane->first >> 32) == sync.contextId)
+                    {
+                        uint32_t last = FindCriticalPathLastIssued(pAnalyzer, pGraph, lane->second, sync.correlationId);
+                        if (last != CRITICAL_PATH_INVALID)
+                        {
+                            AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * last + 1, 2 * api + 1);
+                        }
+                    }
+                }
+                break;
+            }
+            case CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_WAIT_EVENT:
+            {
+                std::unordered_map<uint64_t, uint32_t>::const_iterator producerLane =
+                    pAnalyzer->streamLanes.find(((uint64_t)sync.contextId << 32) | pEvent->streamId);
+                lane = pAnalyzer->streamLanes.find(((uint64_t)sync.contextId << 32) | sync.streamId);
+                if (producerLane == pAnalyzer->streamLanes.end() || lane == pAnalyzer->streamLanes.end())
+                {
+                    break;
+                }
+
+                uint32_t last = FindCriticalPathLastIssued(pAnalyzer, pGraph, producerLane->second, pEvent->correlationId);
+                uint32_t first = FindCriticalPathIssued(pAnalyzer, pGraph, lane->second, sync.correlationId);
+                if (last == CRITICAL_PATH_INVALID)
+                {
+                    break;
+                }
+                for (uint32_t k = first; k < pGraph->laneOffsets[lane->second + 1] && pGraph->laneTails[k] == pGraph->laneTails[first]; k++)
+                {
+                    AddCriticalPathEdge(pAnalyzer, pGraph, edges, 2 * last + 1, 2 * pGraph->laneNodes[k]);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Successor lists, by counting sort of the edges on their source.
+    pGraph->numEdges = edges.size();
+    pGraph->successorOffsets.assign((size_t)numNodes * 2 + 1, 0);
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        pGraph->successorOffsets[edges[i].first + 1]++;
+    }
+    for (size_t vertex = 0; vertex < (size_t)numNodes * 2; vertex++)
+    {
+        pGraph->successorOffsets[vertex + 1] += pGraph->successorOffsets[vertex];
+    }
+    pGraph->successors.resize(edges.size());
+    {
+        std::vector<uint32_t> next(pGraph->successorOffsets.begin(), pGraph->successorOffsets.end() - 1);
+        for (size_t i = 0; i < edges.size(); i++)
+        {
+            pGraph->successors[next[edges[i].first]++] = edges[i].second;
+        }
+    }
+    std::vector<std::pair<uint32_t, uint32_t> >().swap(edges);
+
+    pGraph->byStart.clear();
+    pGraph->byStart.reserve(numNodes);
+    for (uint32_t node = 0; node < numNodes; node++)
+    {
+        if (!pGraph->dead[node])
+        {
+            pGraph->byStart.push_back(node);
+        }
+    }
+    std::sort(pGraph->byStart.begin(), pGraph->byStart.end(), [pAnalyzer](uint32_t a, uint32_t b)
+    {
+        return GetCriticalPathNode(pAnalyzer, a)->start < GetCriticalPathNode(pAnalyzer, b)->start;
+    });
+}
+
+// Buffers of the step analysis, reused from one step to the next.
+typedef struct CriticalPathWork_st
+{
+    std::vector<uint32_t> local;                                     // Node to its index in the step, CRITICAL_PATH_INVALID outside.
+    std::vector<uint32_t> inDegree;
+    std::vector<uint32_t> order;                                     // Local vertices in topological order.
+    std::vector<uint32_t> gate;                                      // Predecessor of the local vertex which finished last.
+    std::vector<uint64_t> gateTime;
+    std::vector<uint64_t> slack;
+    std::vector<uint8_t>  onPath;
+} CriticalPathWork;
+
+// Totals of all the steps.
+typedef struct CriticalPathTotals_st
+{
+    std::unordered_map<uint64_t, CriticalPathName> names;            // By kind << 32 | name.
+    uint64_t                                       kindNs[CRITICAL_PATH_NODE_KIND_COUNT];
+    uint64_t                                       gapNs;
+    uint64_t                                       pathNs;
+    uint64_t                                       stepNs;
+    uint64_t                                       numSteps;
+    uint64_t                                       numCyclicVertices; // Vertices on equal timestamp cycles, without slack.
+    uint64_t                                       slowestStepNs;
+    uint64_t                                       slowestStepStart;
+    uint64_t                                       slowestPathNs;
+    std::vector<CriticalPathSegment>               slowestPath;
+} CriticalPathTotals;
+
+// Successors of a local vertex within the step: the implicit start to end edge of its node, then the graph edges.
+template<typename Visit>
+static void
+ForEachCriticalPathSuccessor(
+    const CriticalPathGraph *pGraph,
+    const CriticalPathWork *pWork,
+    uint32_t firstNode,
+    uint32_t vertex,
+    Visit visit)
+{
+    uint32_t globalVertex = 2 * pGraph->byStart[firstNode + (vertex >> 1)] + (vertex & 1);
+
+    if (!(vertex & 1))
+    {
+        visit(vertex + 1);
+    }
+    for (uint32_t i = pGraph->successorOffsets[globalVertex]; i < pGraph->successorOffsets[globalVertex + 1]; i++)
+    {
+        uint32_t successor = pGraph->successors[i];
+        uint32_t local = pWork->local[successor >> 1];
+        if (local != CRITICAL_PATH_INVALID)
+        {
+            visit(2 * local + (successor & 1));
+        }
+    }
+}
+
+// Critical path and slack of the nodes starting in [firstNode, lastNode) of byStart.
+static void
+AnalyzeCriticalPathStep(
+    const CriticalPathAnalyzer *pAnalyzer,
+    const CriticalPathGraph *pGraph,
+    uint32_t firstNode,
+    uint32_t lastNode,
+    uint64_t stepStart,
+    CriticalPathWork *pWork,
+    CriticalPathTotals *pTotals)
+{
+    uint32_t numNodes = lastNode - firstNode;
+    uint32_t numVertices = 2 * numNodes;
+
+    if (!numNodes)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        pWork->local[pGraph->byStart[firstNode + i]] = i;
+    }
+
+    #define CRITICAL_PATH_VERTEX_TIME(vertex) GetCriticalPathTime(pAnalyzer, 2 * pGraph->byStart[firstNode + ((vertex) >> 1)] + ((vertex) & 1))
+
+    // Topological order (Kahn), the vertices on cycles of equal timestamps are left out.
+    pWork->inDegree.assign(numVertices, 0);
+    for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+    {
+        ForEachCriticalPathSuccessor(pGraph, pWork, firstNode, vertex, [pWork](uint32_t successor) { pWork->inDegree[successor]++; });
+    }
+    pWork->order.clear();
+    for (uint32_t vertex = 0; vertex < numVertices; vertex++)
+    {
+        if (!pWork->inDegree[vertex])
+        {
+            pWork->order.push_back(vertex);
+        }
+    }
+    for (size_t i = 0; i < pWork->order.size(); i++)
+    {
+        ForEachCriticalPathSuccessor(pGraph, pWork, firstNode, pWork->order[i], [pWork](uint32_t successor)
+        {
+            if (!--pWork->inDegree[successor])
+            {
+                pWork->order.push_back(successor);
+            }
+        });
+    }
+    pTotals->numCyclicVertices += numVertices - pWork->order.size();
+
+    // Predecessor which finished last, and the last vertex of the step.
+    pWork->gate.assign(numVertices, CRITICAL_PATH_INVALID);
+    pWork->gateTime.assign(numVertices, 0);
+    uint32_t sink = CRITICAL_PATH_INVALID;
+    uint64_t sinkTime = 0;
+    for (size_t i = 0; i < pWork->order.size(); i++)
+    {
+        uint32_t vertex = pWork->order[i];
+        uint64_t time = CRITICAL_PATH_VERTEX_TIME(vertex);
+
+        if (sink == CRITICAL_PATH_INVALID || time > sinkTime)
+        {
+            sink = vertex;
+            sinkTime = time;
+        }
+        ForEachCriticalPathSuccessor(pGraph, pWork, firstNode, vertex, [pWork, vertex, time](uint32_t successor)
+        {
+            if (pWork->gate[successor] == CRITICAL_PATH_INVALID || time > pWork->gateTime[successor])
+            {
+                pWork->gate[successor] = vertex;
+                pWork->gateTime[successor] = time;
+            }
+        });
+    }
+
+    // Slack, latest the vertex could have happened without delaying the sink.
+    pWork->slack.assign(numVertices, UINT64_MAX);
+    for (size_t i = pWork->order.size(); i-- > 0;)
+    {
+        uint32_t vertex = pWork->order[i];
+        uint64_t time = CRITICAL_PATH_VERTEX_TIME(vertex);
+        uint64_t slack = UINT64_MAX;
+        bool hasSuccessor = false;
+
+        ForEachCriticalPathSuccessor(pGraph, pWork, firstNode, vertex, [&](uint32_t successor)
+        {
+            uint64_t successorTime = CRITICAL_PATH_VERTEX_TIME(successor);
+            hasSuccessor = true;
+            if (pWork->slack[successor] == UINT64_MAX)
+            {
+                return;
+            }
+            if (!(vertex & 1) && successor == vertex + 1)
+            {
+                // Starting later ends the operation as much later.
+                slack = std::min(slack, pWork->slack[successor]);
+            }
+            else
+            {
+                slack = std::min(slack, pWork->slack[successor] + (successorTime > time ? successorTime - time : 0));
+            }
+        });
+        pWork->slack[vertex] = hasSuccessor ? slack : (sinkTime > time ? sinkTime - time : 0);
+    }
+
+    // Walk back from the sink.
+    std::vector<CriticalPathSegment> path;
+    uint64_t pathStart = sinkTime;
+    pWork->onPath.assign(numNodes, 0);
+    for (uint32_t vertex = sink; vertex != CRITICAL_PATH_INVALID;)
+    {
+        uint32_t previous = pWork->gate[vertex];
+        pathStart = CRITICAL_PATH_VERTEX_TIME(vertex);
+        if (previous == CRITICAL_PATH_INVALID)
+        {
+            break;
+        }
+
+        uint64_t gapNs = 0;
+        if ((vertex & 1) && previous == vertex - 1)
+        {
+            const CriticalPathNode *pNode = GetCriticalPathNode(pAnalyzer, pGraph->byStart[firstNode + (vertex >> 1)]);
+            pWork->onPath[vertex >> 1] = 1;
+            pTotals->kindNs[pNode->kind] += pNode->end - pNode->start;
+
+            if (!path.empty() && path.back().kind == pNode->kind && path.back().name == pNode->name && !path.back().gapNs)
+            {
+                path.back().start = pNode->start;
+                path.back().durationNs += pNode->end - pNode->start;
+                path.back().count++;
+            }
+            else
+            {
+                CriticalPathSegment segment;
+                segment.start = pNode->start;
+                segment.durationNs = pNode->end - pNode->start;
+                segment.gapNs = 0;
+                segment.kind = pNode->kind;
+                segment.name = pNode->name;
+                segment.count = 1;
+                path.push_back(segment);
+            }
+        }
+        else
+        {
+            gapNs = CRITICAL_PATH_VERTEX_TIME(vertex) - CRITICAL_PATH_VERTEX_TIME(previous);
+            pTotals->gapNs += gapNs;
+            if (!path.empty())
+            {
+                path.back().gapNs += gapNs;
+            }
+        }
+        vertex = previous;
+    }
+
+    #undef CRITICAL_PATH_VERTEX_TIME
+
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        uint32_t node = pGraph->byStart[firstNode + i];
+        const CriticalPathNode *pNode = GetCriticalPathNode(pAnalyzer, node);
+        CriticalPathName &name = pTotals->names[((uint64_t)pNode->kind << 32) | pNode->name];
+
+        if (!name.pathCount && !name.offPathCount)
+        {
+            name.minSlackNs = UINT64_MAX;
+        }
+        if (pWork->onPath[i])
+        {
+            name.pathNs += pNode->end - pNode->start;
+            name.pathCount++;
+        }
+        else if (pWork->slack[2 * i + 1] != UINT64_MAX)
+        {
+            name.offPathCount++;
+            name.slackNs += pWork->slack[2 * i + 1];
+            name.minSlackNs = std::min(name.minSlackNs, pWork->slack[2 * i + 1]);
+        }
+        pWork->local[node] = CRITICAL_PATH_INVALID;
+    }
+
+    uint64_t stepNs = sinkTime - std::min(stepStart, pathStart);
+    pTotals->numSteps++;
+    pTotals->stepNs += stepNs;
+    pTotals->pathNs += sinkTime - pathStart;
+    if (stepNs >= pTotals->slowestStepNs)
+    {
+        std::reverse(path.begin(), path.end());
+        pTotals->slowestStepNs = stepNs;
+        pTotals->slowestStepStart = std::min(stepStart, pathStart);
+        pTotals->slowestPathNs = sinkTime - pathStart;
+        pTotals->slowestPath.swap(path);
+    }
+}
+
+static const char *
+GetCriticalPathKindString(
+    uint32_t kind)
+{
+    switch (kind)
+    {
+        case CRITICAL_PATH_NODE_KERNEL:
+            return "kernel";
+        case CRITICAL_PATH_NODE_MEMCPY:
+            return "memcpy";
+        case CRITICAL_PATH_NODE_MEMSET:
+            return "memset";
+        case CRITICAL_PATH_NODE_RUNTIME:
+            return "runtime";
+        case CRITICAL_PATH_NODE_DRIVER:
+            return "driver";
+        default:
+            return "<unknown>";
+    }
+}
+
+static const char *
+GetCriticalPathName(
+    const CriticalPathAnalyzer *pAnalyzer,
+    uint32_t kind,
+    uint32_t name)
+{
+    const char *pName = NULL;
+
+    if (kind == CRITICAL_PATH_NODE_RUNTIME)
+    {
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_RUNTIME_API, name, &pName);
+    }
+    else if (kind == CRITICAL_PATH_NODE_DRIVER)
+    {
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_DRIVER_API, name, &pName);
+    }
+    else
+    {
+        pName = pAnalyzer->names[name].c_str();
+    }
+
+    return pName ? pName : "<unknown>";
+}
+
+static bool
+CompareCriticalPathOnPath(
+    const std::pair<uint64_t, CriticalPathName> &a,
+    const std::pair<uint64_t, CriticalPathName> &b)
+{
+    return a.second.pathNs > b.second.pathNs;
+}
+
+static bool
+CompareCriticalPathSlack(
+    const std::pair<uint64_t, CriticalPathName> &a,
+    const std::pair<uint64_t, CriticalPathName> &b)
+{
+    return a.second.slackNs / a.second.offPathCount < b.second.slackNs / b.second.offPathCount;
+}
+
+// Build the dependency graph, analyze every step and print the operations on the critical path,
+// the near critical ones off the path and the critical path of the slowest step.
+static void
+PrintCriticalPathReport(
+    CriticalPathAnalyzer *pAnalyzer,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    CriticalPathGraph graph;
+    BuildCriticalPathGraph(pAnalyzer, &graph);
+
+    std::vector<std::pair<uint64_t, uint64_t> > steps = pAnalyzer->steps;
+    if (pAnalyzer->stepName.empty())
+    {
+        steps.push_back(std::make_pair(graph.byStart.empty() ? 0 : GetCriticalPathNode(pAnalyzer, graph.byStart[0])->start, UINT64_MAX));
+    }
+    else
+    {
+        std::sort(pAnalyzer->stepMarks.begin(), pAnalyzer->stepMarks.end());
+        for (size_t i = 1; i < pAnalyzer->stepMarks.size(); i++)
+        {
+            steps.push_back(std::make_pair(pAnalyzer->stepMarks[i - 1], pAnalyzer->stepMarks[i]));
+        }
+    }
+
+    CriticalPathWork work;
+    CriticalPathTotals totals;
+    work.local.assign(pAnalyzer->numNodes, CRITICAL_PATH_INVALID);
+    memset(totals.kindNs, 0, sizeof(totals.kindNs));
+    totals.gapNs = 0;
+    totals.pathNs = 0;
+    totals.stepNs = 0;
+    totals.numSteps = 0;
+    totals.numCyclicVertices = 0;
+    totals.slowestStepNs = 0;
+    totals.slowestStepStart = 0;
+    totals.slowestPathNs = 0;
+
+    for (size_t i = 0; i < steps.size(); i++)
+    {
+        std::vector<uint32_t>::iterator first = std::lower_bound(graph.byStart.begin(), graph.byStart.end(), steps[i].first,
+            [pAnalyzer](uint32_t node, uint64_t time) { return GetCriticalPathNode(pAnalyzer, node)->start < time; });
+        std::vector<uint32_t>::iterator last = std::lower_bound(first, graph.byStart.end(), steps[i].second,
+            [pAnalyzer](uint32_t node, uint64_t time) { return GetCriticalPathNode(pAnalyzer, node)->start < time; });
+
+        AnalyzeCriticalPathStep(pAnalyzer, &graph, (uint32_t)(first - graph.byStart.begin()), (uint32_t)(last - graph.byStart.begin()),
+                                steps[i].first, &work, &totals);
+    }
+
+    fprintf(pFile, "\nCritical path: %llu steps (%s%s%s), %u nodes, %llu edges\n", (unsigned long long)totals.numSteps,
+            pAnalyzer->stepName.empty() ? "whole trace" : "NVTX \"", pAnalyzer->stepName.c_str(), pAnalyzer->stepName.empty() ? "" : "\"",
+            pAnalyzer->numNodes, (unsigned long long)graph.numEdges);
+    if (pAnalyzer->numDroppedNodes || pAnalyzer->numDroppedSyncs || pAnalyzer->numDroppedEvents || pAnalyzer->numDroppedSteps ||
+        graph.numBackwardEdges || totals.numCyclicVertices)
+    {
+        fprintf(pFile, "  dropped: %llu nodes, %llu synchronizations, %llu events and %llu steps over the limits, %llu edges backward in time, "
+                "%llu vertices on cycles\n",
+                (unsigned long long)pAnalyzer->numDroppedNodes, (unsigned long long)pAnalyzer->numDroppedSyncs,
+                (unsigned long long)pAnalyzer->numDroppedEvents, (unsigned long long)pAnalyzer->numDroppedSteps,
+                (unsigned long long)graph.numBackwardEdges, (unsigned long long)totals.numCyclicVertices);
+    }
+    if (!totals.numSteps)
+    {
+        return;
+    }
+
+    double percentScale = totals.pathNs ? 100.0 / totals.pathNs : 0.0;
+    fprintf(pFile, "  Step avg %.3f ms, slowest %.3f ms, critical path avg %.3f ms:", totals.stepNs / 1e6 / totals.numSteps,
+            totals.slowestStepNs / 1e6, totals.pathNs / 1e6 / totals.numSteps);
+    for (uint32_t kind = 0; kind < CRITICAL_PATH_NODE_KIND_COUNT; kind++)
+    {
+        fprintf(pFile, " %s %.1f%%,", GetCriticalPathKindString(kind), totals.kindNs[kind] * percentScale);
+    }
+    fprintf(pFile, " latency between operations %.1f%%\n", totals.gapNs * percentScale);
+
+    std::vector<std::pair<uint64_t, CriticalPathName> > onPath;
+    std::vector<std::pair<uint64_t, CriticalPathName> > offPath;
+    for (std::unordered_map<uint64_t, CriticalPathName>::const_iterator it = totals.names.begin(); it != totals.names.end(); ++it)
+    {
+        if (it->second.pathCount)
+        {
+            onPath.push_back(*it);
+        }
+        if (it->second.offPathCount)
+        {
+            offPath.push_back(*it);
+        }
+    }
+
+    size_t top = std::min(onPath.size(), (size_t)CRITICAL_PATH_TOP_COUNT);
+    std::partial_sort(onPath.begin(), onPath.begin() + top, onPath.end(), CompareCriticalPathOnPath);
+    fprintf(pFile, "Top operations on the critical path:\n");
+    fprintf(pFile, "  %12s %7s %10s %10s  %-8s %s\n", "Path ms", "%", "On path", "Off path", "Kind", "Name");
+    for (size_t i = 0; i < top; i++)
+    {
+        const CriticalPathName &name = onPath[i].second;
+        fprintf(pFile, "  %12.3f %6.1f%% %10llu %10llu  %-8s %s\n", name.pathNs / 1e6, name.pathNs * percentScale,
+                (unsigned long long)name.pathCount, (unsigned long long)name.offPathCount, GetCriticalPathKindString((uint32_t)(onPath[i].first >> 32)),
+                GetCriticalPathName(pAnalyzer, (uint32_t)(onPath[i].first >> 32), (uint32_t)onPath[i].first));
+    }
+
+    top = std::min(offPath.size(), (size_t)CRITICAL_PATH_TOP_COUNT);
+    std::partial_sort(offPath.begin(), offPath.begin() + top, offPath.end(), CompareCriticalPathSlack);
+    fprintf(pFile, "Near critical operations off the path, least average slack first:\n");
+    fprintf(pFile, "  %12s %12s %10s  %-8s %s\n", "Avg slack us", "Min slack us", "Count", "Kind", "Name");
+    for (size_t i = 0; i < top; i++)
+    {
+        const CriticalPathName &name = offPath[i].second;
+        fprintf(pFile, "  %12.1f %12.1f %10llu  %-8s %s\n", (double)name.slackNs / name.offPathCount / 1e3, name.minSlackNs / 1e3,
+                (unsigned long long)name.offPathCount, GetCriticalPathKindString((uint32_t)(offPath[i].first >> 32)),
+                GetCriticalPathName(pAnalyzer, (uint32_t)(offPath[i].first >> 32), (uint32_t)offPath[i].first));
+    }
+
+    fprintf(pFile, "Critical path of the slowest step (%llu, %.3f ms, path %.3f ms):\n", (unsigned long long)totals.slowestStepStart,
+            totals.slowestStepNs / 1e6, totals.slowestPathNs / 1e6);
+    fprintf(pFile, "  %12s %12s %12s  %-8s %s\n", "Start us", "Duration us", "Then gap us", "Kind", "Name");
+    for (size_t i = 0; i < totals.slowestPath.size() && i < CRITICAL_PATH_MAX_PATH_LINES; i++)
+    {
+        const CriticalPathSegment &segment = totals.slowestPath[i];
+        fprintf(pFile, "  %12.1f %12.1f %12.1f  %-8s %s", (segment.start - totals.slowestStepStart) / 1e3, segment.durationNs / 1e3,
+                (i + 1 < totals.slowestPath.size() ? totals.slowestPath[i + 1].gapNs : 0) / 1e3, GetCriticalPathKindString(segment.kind),
+                GetCriticalPathName(pAnalyzer, segment.kind, segment.name));
+        if (segment.count > 1)
+        {
+            fprintf(pFile, " x%u", segment.count);
+        }
+        fprintf(pFile, "\n");
+    }
+    if (totals.slowestPath.size() > CRITICAL_PATH_MAX_PATH_LINES)
+    {
+        fprintf(pFile, "  ... %llu more segments\n", (unsigned long long)(totals.slowestPath.size() - CRITICAL_PATH_MAX_PATH_LINES));
+    }
+}
+
+static void
+FreeCriticalPathAnalyzer(
+    CriticalPathAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    for (size_t i = 0; i < pAnalyzer->blocks.size(); i++)
+    {
+        free(pAnalyzer->blocks[i]);
+    }
+    pAnalyzer->blocks.clear();
+    pAnalyzer->numNodes = 0;
+    pAnalyzer->streamLanes.clear();
+    pAnalyzer->threadLanes.clear();
+    pAnalyzer->laneKeys.clear();
+    std::vector<CriticalPathSync>().swap(pAnalyzer->syncs);
+    pAnalyzer->events.clear();
+    pAnalyzer->latestEvents.clear();
+    pAnalyzer->openSteps.clear();
+    pAnalyzer->steps.clear();
+    pAnalyzer->stepMarks.clear();
+    pAnalyzer->names.clear();
+    pAnalyzer->nameIds.clear();
+}
+
+#endif // HELPER_CUPTI_CRITICAL_PATH_H_
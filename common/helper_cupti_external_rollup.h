@@ -0,0 +1,588 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_EXTERNAL_ROLLUP_H_
+#define HELPER_CUPTI_EXTERNAL_ROLLUP_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// GPU cost of the external correlation ids, e.g. one id per framework
+// operator pushed with cuptiActivityPushExternalCorrelationId().
+//
+// The EXTERNAL_CORRELATION records map a correlation id to the external ids
+// (one per kind) on top of the stacks of the thread when the API was called.
+// The kernel, memcpy and memset records with that correlation id are charged
+// to these ids: GPU time, bytes, and launch counts. The records of a
+// correlation id come in any order, the GPU cost received before the external
+// ids is kept with the correlation id until they arrive.
+//
+// Memory is bounded for long runs: the correlation ids and the external ids of
+// every kind are in hash tables of bounded size. An entry not charged for
+// maxAgeNs (by the latest GPU timestamp) is complete: a few of the oldest
+// entries are checked on every record, and the complete external ids are
+// folded into the totals of their kind, a histogram of the GPU time per id and
+// the most expensive ids. When a table is full its oldest entry is completed
+// early.
+
+// Macros
+#define EXTERNAL_ROLLUP_NUM_KINDS CUPTI_EXTERNAL_CORRELATION_KIND_SIZE
+#define EXTERNAL_ROLLUP_MAX_REFS 4                                   // External ids of a correlation id, one per kind pushed.
+#define EXTERNAL_ROLLUP_DEFAULT_CAPACITY 65536                       // Correlation ids, and external ids of every kind, in flight.
+#define EXTERNAL_ROLLUP_DEFAULT_MAX_AGE_NS (5ULL * 1000 * 1000 * 1000)
+#define EXTERNAL_ROLLUP_EVICT_BATCH 8                                // Oldest entries checked per record.
+#define EXTERNAL_ROLLUP_HISTOGRAM_BUCKETS 64                         // GPU time per id, by power of two of ns.
+#define EXTERNAL_ROLLUP_TOP_COUNT 10
+
+// Data structures
+typedef struct ExternalRollupCost_st
+{
+    uint64_t gpuNs;
+    uint64_t bytes;
+    uint64_t kernels;
+    uint64_t memcpys;
+    uint64_t memsets;
+} ExternalRollupCost;
+
+typedef struct ExternalRollupRef_st
+{
+    uint64_t externalId;
+    uint32_t kind;                                                   // CUpti_ExternalCorrelationKind.
+} ExternalRollupRef;
+
+typedef struct ExternalRollupCorrelation_st
+{
+    ExternalRollupCost pending;                                      // GPU cost received before the external ids.
+    ExternalRollupRef  refs[EXTERNAL_ROLLUP_MAX_REFS];
+    uint32_t           numRefs;
+    uint64_t           lastSeen;
+} ExternalRollupCorrelation;
+
+typedef struct ExternalRollupId_st
+{
+    ExternalRollupCost cost;
+    uint64_t           numCorrelations;                              // API calls made with the id on top of the stack.
+    uint64_t           lastSeen;
+} ExternalRollupId;
+
+typedef struct ExternalRollupTop_st
+{
+    uint64_t         externalId;
+    ExternalRollupId id;
+} ExternalRollupTop;
+
+typedef struct ExternalRollupKind_st
+{
+    std::unordered_map<uint64_t, ExternalRollupId> ids;              // Live ids.
+    std::deque<uint64_t>                           ageQueue;         // Live ids, oldest inserted first.
+    ExternalRollupCost                             total;            // Of the complete ids.
+    uint64_t                                       numIds;           // Complete ids.
+    uint64_t                                       numCorrelations;
+    uint64_t                                       numEarlyCompletions; // Completed early, the table being full.
+    uint64_t                                       peakIds;
+    uint64_t                                       histogram[EXTERNAL_ROLLUP_HISTOGRAM_BUCKETS];
+    std::vector<ExternalRollupTop>                 top;              // Min-heap on the GPU time.
+} ExternalRollupKind;
+
+typedef struct ExternalRollup_st
+{
+    std::mutex                                              mutex;   // The buffers can be completed by several threads.
+    ExternalRollupKind                                      kinds[EXTERNAL_ROLLUP_NUM_KINDS];
+    std::unordered_map<uint32_t, ExternalRollupCorrelation> correlations;
+    std::deque<uint32_t>                                    correlationQueue;
+    uint32_t                                                capacity;
+    uint64_t                                                maxAgeNs;
+    uint64_t                                                latestTimestamp; // Latest GPU end seen.
+    uint64_t                                                numExternalRecords;
+    uint64_t                                                numGpuRecords;
+    ExternalRollupCost                                      unattributed; // GPU cost of the correlation ids without external id.
+    uint64_t                                                numDroppedRefs;
+    uint64_t                                                numEarlyCompletions;
+    uint64_t                                                peakCorrelations;
+} ExternalRollup;
+
+// Helper Functions
+static inline void
+AddExternalRollupCost(
+    ExternalRollupCost *pTotal,
+    const ExternalRollupCost *pCost)
+{
+    pTotal->gpuNs += pCost->gpuNs;
+    pTotal->bytes += pCost->bytes;
+    pTotal->kernels += pCost->kernels;
+    pTotal->memcpys += pCost->memcpys;
+    pTotal->memsets += pCost->memsets;
+}
+
+static bool
+CompareExternalRollupTop(
+    const ExternalRollupTop &a,
+    const ExternalRollupTop &b)
+{
+    // Greater first makes std::push_heap a min-heap.
+    return a.id.cost.gpuNs > b.id.cost.gpuNs;
+}
+
+static void
+CompleteExternalRollupId(
+    ExternalRollupKind *pKind,
+    uint64_t externalId,
+    const ExternalRollupId *pId)
+{
+    uint32_t bucket = 0;
+    while (bucket + 1 < EXTERNAL_ROLLUP_HISTOGRAM_BUCKETS && (pId->cost.gpuNs >> (bucket + 1)))
+    {
+        bucket++;
+    }
+
+    AddExternalRollupCost(&pKind->total, &pId->cost);
+    pKind->numIds++;
+    pKind->numCorrelations += pId->numCorrelations;
+    pKind->histogram[bucket]++;
+
+    if (pKind->top.size() < EXTERNAL_ROLLUP_TOP_COUNT || pId->cost.gpuNs > pKind->top.front().id.cost.gpuNs)
+    {
+        if (pKind->top.size() >= EXTERNAL_ROLLUP_TOP_COUNT)
+        {
+            std::pop_heap(pKind->top.begin(), pKind->top.end(), CompareExternalRollupTop);
+            pKind->top.pop_back();
+        }
+
+        ExternalRollupTop top;
+        top.externalId = externalId;
+        top.id = *pId;
+        pKind->top.push_back(top);
+        std::push_heap(pKind->top.begin(), pKind->top.end(), CompareExternalRollupTop);
+    }
+}
+
+// Complete the oldest ids of the kind not charged for maxAgeNs, at most EXTERNAL_ROLLUP_EVICT_BATCH checked,
+// or the oldest one if early is set.
+static void
+EvictExternalRollupIds(
+    ExternalRollup *pRollup,
+    ExternalRollupKind *pKind,
+    bool early)
+{
+    for (uint32_t i = 0; i < EXTERNAL_ROLLUP_EVICT_BATCH && !pKind->ageQueue.empty(); i++)
+    {
+        uint64_t externalId = pKind->ageQueue.front();
+        std::unordered_map<uint64_t, ExternalRollupId>::iterator it = pKind->ids.find(externalId);
+
+        pKind->ageQueue.pop_front();
+        if (!early && it->second.lastSeen + pRollup->maxAgeNs > pRollup->latestTimestamp)
+        {
+            // Charged since it was queued, checked again after the other ids.
+            pKind->ageQueue.push_back(externalId);
+            continue;
+        }
+
+        if (early)
+        {
+            pKind->numEarlyCompletions++;
+        }
+        CompleteExternalRollupId(pKind, externalId, &it->second);
+        pKind->ids.erase(it);
+        if (early)
+        {
+            return;
+        }
+    }
+}
+
+static void
+CompleteExternalRollupCorrelation(
+    ExternalRollup *pRollup,
+    const ExternalRollupCorrelation *pCorrelation)
+{
+    if (!pCorrelation->numRefs)
+    {
+        AddExternalRollupCost(&pRollup->unattributed, &pCorrelation->pending);
+    }
+}
+
+static void
+EvictExternalRollupCorrelations(
+    ExternalRollup *pRollup,
+    bool early)
+{
+    for (uint32_t i = 0; i < EXTERNAL_ROLLUP_EVICT_BATCH && !pRollup->correlationQueue.empty(); i++)
+    {
+        uint32_t correlationId = pRollup->correlationQueue.front();
+        std::unordered_map<uint32_t, ExternalRollupCorrelation>::iterator it = pRollup->correlations.find(correlationId);
+
+        pRollup->correlationQueue.pop_front();
+        if (!early && it->second.lastSeen + pRollup->maxAgeNs > pRollup->latestTimestamp)
+        {
+            pRollup->correlationQueue.push_back(correlationId);
+            continue;
+        }
+
+        if (early)
+        {
+            pRollup->numEarlyCompletions++;
+        }
+        CompleteExternalRollupCorrelation(pRollup, &it->second);
+        pRollup->correlations.erase(it);
+        if (early)
+        {
+            return;
+        }
+    }
+}
+
+static ExternalRollupCorrelation *
+GetExternalRollupCorrelation(
+    ExternalRollup *pRollup,
+    uint32_t correlationId)
+{
+    std::unordered_map<uint32_t, ExternalRollupCorrelation>::iterator it = pRollup->correlations.find(correlationId);
+    if (it != pRollup->correlations.end())
+    {
+        return &it->second;
+    }
+
+    if (pRollup->correlations.size() >= pRollup->capacity)
+    {
+        EvictExternalRollupCorrelations(pRollup, true);
+    }
+
+    ExternalRollupCorrelation &correlation = pRollup->correlations[correlationId];
+    memset(&correlation, 0, sizeof(correlation));
+    pRollup->correlationQueue.push_back(correlationId);
+    pRollup->peakCorrelations = std::max(pRollup->peakCorrelations, (uint64_t)pRollup->correlations.size());
+
+    return &correlation;
+}
+
+static void
+ChargeExternalRollupId(
+    ExternalRollup *pRollup,
+    const ExternalRollupRef *pRef,
+    const ExternalRollupCost *pCost,
+    bool newCorrelation)
+{
+    ExternalRollupKind *pKind = &pRollup->kinds[pRef->kind];
+    std::unordered_map<uint64_t, ExternalRollupId>::iterator it = pKind->ids.find(pRef->externalId);
+
+    if (it == pKind->ids.end())
+    {
+        if (pKind->ids.size() >= pRollup->capacity)
+        {
+            EvictExternalRollupIds(pRollup, pKind, true);
+        }
+
+        ExternalRollupId id;
+        memset(&id, 0, sizeof(id));
+        it = pKind->ids.insert(std::make_pair(pRef->externalId, id)).first;
+        pKind->ageQueue.push_back(pRef->externalId);
+        pKind->peakIds = std::max(pKind->peakIds, (uint64_t)pKind->ids.size());
+    }
+
+    AddExternalRollupCost(&it->second.cost, pCost);
+    it->second.numCorrelations += newCorrelation ? 1 : 0;
+    it->second.lastSeen = pRollup->latestTimestamp;
+}
+
+static void
+AddExternalRollupGpuCost(
+    ExternalRollup *pRollup,
+    uint32_t correlationId,
+    const ExternalRollupCost *pCost,
+    uint64_t end)
+{
+    pRollup->numGpuRecords++;
+    pRollup->latestTimestamp = std::max(pRollup->latestTimestamp, end);
+
+    ExternalRollupCorrelation *pCorrelation = GetExternalRollupCorrelation(pRollup, correlationId);
+    if (pCorrelation->numRefs)
+    {
+        for (uint32_t i = 0; i < pCorrelation->numRefs; i++)
+        {
+            ChargeExternalRollupId(pRollup, &pCorrelation->refs[i], pCost, false);
+        }
+    }
+    else
+    {
+        AddExternalRollupCost(&pCorrelation->pending, pCost);
+    }
+    pCorrelation->lastSeen = pRollup->latestTimestamp;
+}
+
+static void
+InitExternalRollup(
+    ExternalRollup *pRollup,
+    uint32_t capacity,
+    uint64_t maxAgeNs)
+{
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        ExternalRollupKind *pKind = &pRollup->kinds[kind];
+
+        pKind->ids.clear();
+        pKind->ageQueue.clear();
+        memset(&pKind->total, 0, sizeof(pKind->total));
+        pKind->numIds = 0;
+        pKind->numCorrelations = 0;
+        pKind->numEarlyCompletions = 0;
+        pKind->peakIds = 0;
+        memset(pKind->histogram, 0, sizeof(pKind->histogram));
+        pKind->top.clear();
+    }
+
+    pRollup->correlations.clear();
+    pRollup->correlationQueue.clear();
+    pRollup->capacity = std::max(capacity, 1u);
+    pRollup->maxAgeNs = maxAgeNs;
+    pRollup->latestTimestamp = 0;
+    pRollup->numExternalRecords = 0;
+    pRollup->numGpuRecords = 0;
+    memset(&pRollup->unattributed, 0, sizeof(pRollup->unattributed));
+    pRollup->numDroppedRefs = 0;
+    pRollup->numEarlyCompletions = 0;
+    pRollup->peakCorrelations = 0;
+}
+
+// Feed one activity record: EXTERNAL_CORRELATION, kernel, memcpy and memset records are used, other kinds are ignored.
+static void
+ExternalRollupAddRecord(
+    ExternalRollup *pRollup,
+    CUpti_Activity *pRecord)
+{
+    ExternalRollupCost cost;
+    uint32_t correlationId = 0;
+    uint64_t end = 0;
+
+    memset(&cost, 0, sizeof(cost));
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION:
+        {
+            CUpti_ActivityExternalCorrelation *pExternalCorrelationRecord = (CUpti_ActivityExternalCorrelation *)pRecord;
+
+            if ((uint32_t)pExternalCorrelationRecord->externalKind >= EXTERNAL_ROLLUP_NUM_KINDS)
+            {
+                return;
+            }
+
+            std::lock_guard<std::mutex> lock(pRollup->mutex);
+            ExternalRollupCorrelation *pCorrelation = GetExternalRollupCorrelation(pRollup, pExternalCorrelationRecord->correlationId);
+
+            pRollup->numExternalRecords++;
+            if (pCorrelation->numRefs >= EXTERNAL_ROLLUP_MAX_REFS)
+            {
+                pRollup->numDroppedRefs++;
+                return;
+            }
+
+            ExternalRollupRef &ref = pCorrelation->refs[pCorrelation->numRefs++];
+            ref.externalId = pExternalCorrelationRecord->externalId;
+            ref.kind = (uint32_t)pExternalCorrelationRecord->externalKind;
+            ChargeExternalRollupId(pRollup, &ref, &pCorrelation->pending, true);
+            pCorrelation->lastSeen = pRollup->latestTimestamp;
+
+            EvictExternalRollupIds(pRollup, &pRollup->kinds[ref.kind], false);
+            EvictExternalRollupCorrelations(pRollup, false);
+            return;
+        }
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            cost.gpuNs = pKernelRecord->end - pKernelRecord->start;
+            cost.kernels = 1;
+            correlationId = pKernelRecord->correlationId;
+            end = pKernelRecord->end;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            cost.gpuNs = pMemcpyRecord->end - pMemcpyRecord->start;
+            cost.bytes = pMemcpyRecord->bytes;
+            cost.memcpys = 1;
+            correlationId = pMemcpyRecord->correlationId;
+            end = pMemcpyRecord->end;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY2:
+        {
+            CUpti_ActivityMemcpyPtoP4 *pMemcpyPtoPRecord = (CUpti_ActivityMemcpyPtoP4 *)pRecord;
+            cost.gpuNs = pMemcpyPtoPRecord->end - pMemcpyPtoPRecord->start;
+            cost.bytes = pMemcpyPtoPRecord->bytes;
+            cost.memcpys = 1;
+            correlationId = pMemcpyPtoPRecord->correlationId;
+            end = pMemcpyPtoPRecord->end;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+            cost.gpuNs = pMemsetRecord->end - pMemsetRecord->start;
+            cost.bytes = pMemsetRecord->bytes;
+            cost.memsets = 1;
+            correlationId = pMemsetRecord->correlationId;
+            end = pMemsetRecord->end;
+            break;
+        }
+        default:
+            return;
+    }
+
+    std::lock_guard<std::mutex> lock(pRollup->mutex);
+
+    AddExternalRollupGpuCost(pRollup, correlationId, &cost, end);
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        EvictExternalRollupIds(pRollup, &pRollup->kinds[kind], false);
+    }
+    EvictExternalRollupCorrelations(pRollup, false);
+}
+
+// Upper bound in ns of the quantile of the GPU time per id.
+static uint64_t
+GetExternalRollupQuantile(
+    const ExternalRollupKind *pKind,
+    double quantile)
+{
+    uint64_t rank = (uint64_t)(quantile * (double)(pKind->numIds - 1));
+    uint64_t count = 0;
+
+    for (uint32_t bucket = 0; bucket < EXTERNAL_ROLLUP_HISTOGRAM_BUCKETS; bucket++)
+    {
+        count += pKind->histogram[bucket];
+        if (count > rank)
+        {
+            return bucket + 1 < EXTERNAL_ROLLUP_HISTOGRAM_BUCKETS ? (2ULL << bucket) - 1 : UINT64_MAX;
+        }
+    }
+
+    return 0;
+}
+
+// Complete all the entries, then print the cost per kind and the most expensive external ids.
+static void
+PrintExternalRollupReport(
+    ExternalRollup *pRollup,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pRollup->mutex);
+
+    for (std::unordered_map<uint32_t, ExternalRollupCorrelation>::const_iterator it = pRollup->correlations.begin(); it != pRollup->correlations.end(); ++it)
+    {
+        CompleteExternalRollupCorrelation(pRollup, &it->second);
+    }
+    pRollup->correlations.clear();
+    pRollup->correlationQueue.clear();
+
+    uint64_t numEarlyCompletions = pRollup->numEarlyCompletions;
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        ExternalRollupKind *pKind = &pRollup->kinds[kind];
+
+        for (std::unordered_map<uint64_t, ExternalRollupId>::const_iterator it = pKind->ids.begin(); it != pKind->ids.end(); ++it)
+        {
+            CompleteExternalRollupId(pKind, it->first, &it->second);
+        }
+        pKind->ids.clear();
+        pKind->ageQueue.clear();
+        numEarlyCompletions += pKind->numEarlyCompletions;
+    }
+
+    fprintf(pFile, "\nExternal correlation rollup: %llu external correlation records, %llu GPU records, peak %llu correlation ids in flight\n",
+            (unsigned long long)pRollup->numExternalRecords, (unsigned long long)pRollup->numGpuRecords,
+            (unsigned long long)pRollup->peakCorrelations);
+    fprintf(pFile, "  without external id: %.3f ms GPU, %llu bytes, %llu kernels, %llu memcpys, %llu memsets\n",
+            pRollup->unattributed.gpuNs / 1e6, (unsigned long long)pRollup->unattributed.bytes, (unsigned long long)pRollup->unattributed.kernels,
+            (unsigned long long)pRollup->unattributed.memcpys, (unsigned long long)pRollup->unattributed.memsets);
+    if (numEarlyCompletions || pRollup->numDroppedRefs)
+    {
+        fprintf(pFile, "  %llu entries completed early (tables full, increase the capacity or decrease the age), %llu external ids dropped (more than %d per correlation id)\n",
+                (unsigned long long)numEarlyCompletions, (unsigned long long)pRollup->numDroppedRefs, EXTERNAL_ROLLUP_MAX_REFS);
+    }
+
+    fprintf(pFile, "  %-8s %10s %10s %12s %14s %10s %9s %9s %10s %10s %10s %10s\n", "Kind", "Ids", "API calls", "GPU ms", "Bytes", "Kernels",
+            "Memcpys", "Memsets", "p50 us", "p90 us", "p99 us", "Peak live");
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        const ExternalRollupKind *pKind = &pRollup->kinds[kind];
+
+        if (!pKind->numIds)
+        {
+            continue;
+        }
+        fprintf(pFile, "  %-8s %10llu %10llu %12.3f %14llu %10llu %9llu %9llu %10.1f %10.1f %10.1f %10llu\n",
+                GetExternalCorrelationKindString((CUpti_ExternalCorrelationKind)kind), (unsigned long long)pKind->numIds,
+                (unsigned long long)pKind->numCorrelations, pKind->total.gpuNs / 1e6, (unsigned long long)pKind->total.bytes,
+                (unsigned long long)pKind->total.kernels, (unsigned long long)pKind->total.memcpys, (unsigned long long)pKind->total.memsets,
+                GetExternalRollupQuantile(pKind, 0.5) / 1e3, GetExternalRollupQuantile(pKind, 0.9) / 1e3, GetExternalRollupQuantile(pKind, 0.99) / 1e3,
+                (unsigned long long)pKind->peakIds);
+    }
+
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        std::vector<ExternalRollupTop> top = pRollup->kinds[kind].top;
+
+        if (top.empty())
+        {
+            continue;
+        }
+        std::sort(top.begin(), top.end(), CompareExternalRollupTop);
+
+        fprintf(pFile, "Top %s external ids by GPU time:\n", GetExternalCorrelationKindString((CUpti_ExternalCorrelationKind)kind));
+        fprintf(pFile, "  %20s %12s %7s %10s %10s %9s %9s %14s\n", "External id", "GPU ms", "%", "API calls", "Kernels", "Memcpys", "Memsets", "Bytes");
+        for (size_t i = 0; i < top.size(); i++)
+        {
+            const ExternalRollupId &id = top[i].id;
+            fprintf(pFile, "  %20llu %12.3f %6.1f%% %10llu %10llu %9llu %9llu %14llu\n", (unsigned long long)top[i].externalId, id.cost.gpuNs / 1e6,
+                    pRollup->kinds[kind].total.gpuNs ? 100.0 * id.cost.gpuNs / pRollup->kinds[kind].total.gpuNs : 0.0,
+                    (unsigned long long)id.numCorrelations, (unsigned long long)id.cost.kernels, (unsigned long long)id.cost.memcpys,
+                    (unsigned long long)id.cost.memsets, (unsigned long long)id.cost.bytes);
+        }
+    }
+}
+
+static void
+FreeExternalRollup(
+    ExternalRollup *pRollup)
+{
+    std::lock_guard<std::mutex> lock(pRollup->mutex);
+
+    for (uint32_t kind = 0; kind < EXTERNAL_ROLLUP_NUM_KINDS; kind++)
+    {
+        pRollup->kinds[kind].ids.clear();
+        pRollup->kinds[kind].ageQueue.clear();
+        std::vector<ExternalRollupTop>().swap(pRollup->kinds[kind].top);
+    }
+    pRollup->correlations.clear();
+    pRollup->correlationQueue.clear();
+}
+
+#endif // HELPER_CUPTI_EXTERNAL_ROLLUP_H_
@@ -0,0 +1,463 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_FLIGHT_RECORDER_H_
+#define HELPER_CUPTI_FLIGHT_RECORDER_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+#include "helper_cupti_trace_file.h"
+
+// Flight recorder: keeps the most recent activity in memory and writes it out
+// only when asked.
+//
+// The completed activity buffers are copied into a ring of fixed size
+// allocated once, the oldest buffers being overwritten, and the CUPTI buffer
+// is released right away. Kernel name pointers of the copies are redirected to
+// names interned by the recorder by content, so the ring does not depend on
+// memory owned by CUPTI. Every buffer of the ring keeps the time range of its
+// records. The copies are made by the globals.pRecordBuffer hook of the shared
+// BufferCompleted(). Nothing is printed or written while recording.
+//
+// The ring is written in the trace file format of helper_cupti_trace_file.h,
+// oldest buffer first, by FlightRecorderDump(), on a CUPTI fatal error and,
+// except on Windows, on SIGUSR1 (the process keeps running) and SIGTERM (the
+// process is then terminated). The signal handlers only wake up a dump
+// thread, the dump itself does not run in the signal handler.
+
+// Macros
+#define FLIGHT_RECORDER_DEFAULT_SIZE (64 * 1024 * 1024)
+
+// Data structures
+typedef struct FlightRecorderEntry_st
+{
+    size_t      offset;                                              // Offset of the buffer copy in the ring.
+    size_t      validSize;                                           // Bytes of the copy.
+    uint64_t    startTimestamp;                                      // Earliest start of the records with a time range, 0 if none.
+    uint64_t    endTimestamp;                                        // Latest end of these records.
+    uint64_t    numRecords;
+} FlightRecorderEntry;
+
+typedef struct FlightRecorder_st
+{
+    std::mutex  mutex;                                               // Buffers can complete on several threads while a dump runs.
+    int         enabled;
+
+    uint8_t     *pRing;                                              // Ring of buffer copies, allocated once.
+    size_t      capacity;
+    size_t      head;                                                // Offset of the next copy.
+    std::deque<FlightRecorderEntry> entries;                         // Buffers in the ring, oldest first.
+    std::unordered_set<std::string> names;                           // Kernel names interned by content, kept as long as the ring.
+
+    std::string dumpFileName;                                        // Default dump file.
+    uint64_t    dumpWindowNs;                                        // Only dump the buffers ending in the last dumpWindowNs, 0 for the whole ring.
+    uint32_t    dumps;                                               // Dumps written so far.
+
+    uint64_t    buffersRecorded;
+    uint64_t    buffersOverwritten;
+    uint64_t    buffersTooLarge;                                     // Buffers larger than the ring, dropped.
+
+#ifndef _WIN32
+    int         signalPipe[2];                                       // Written by the signal handlers, read by the dump thread.
+    std::thread dumpThread;
+    struct sigaction previousUsr1Action;
+    struct sigaction previousTermAction;
+#endif
+} FlightRecorder;
+
+// Global variables
+static FlightRecorder flightRecorder;
+
+// Helper Functions
+
+// Time range of the records with a start and end timestamp. Returns false for the other kinds.
+static bool
+GetActivityTimeRange(
+    CUpti_Activity *pRecord,
+    uint64_t *pStart,
+    uint64_t *pEnd)
+{
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+            *pStart = ((CUpti_ActivityKernel10 *)pRecord)->start;
+            *pEnd = ((CUpti_ActivityKernel10 *)pRecord)->end;
+            return true;
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+            *pStart = ((CUpti_ActivityMemcpy6 *)pRecord)->start;
+            *pEnd = ((CUpti_ActivityMemcpy6 *)pRecord)->end;
+            return true;
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+            *pStart = ((CUpti_ActivityMemset4 *)pRecord)->start;
+            *pEnd = ((CUpti_ActivityMemset4 *)pRecord)->end;
+            return true;
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+            *pStart = ((CUpti_ActivityAPI *)pRecord)->start;
+            *pEnd = ((CUpti_ActivityAPI *)pRecord)->end;
+            return true;
+        case CUPTI_ACTIVITY_KIND_OVERHEAD:
+            *pStart = ((CUpti_ActivityOverhead3 *)pRecord)->start;
+            *pEnd = ((CUpti_ActivityOverhead3 *)pRecord)->end;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Called with the mutex held. The interned strings are never modified, the copies already in the ring keep pointing
+// to them; the set nodes do not move when it grows.
+static const char *
+InternKernelName(
+    const char *pName)
+{
+    if (!pName)
+    {
+        return NULL;
+    }
+
+    return flightRecorder.names.insert(pName).first->c_str();
+}
+
+// Copy a completed buffer into the ring. Called with the mutex held.
+static void
+RecordFlightRecorderBuffer(
+    uint8_t *pBuffer,
+    size_t validSize)
+{
+    if (validSize > flightRecorder.capacity)
+    {
+        flightRecorder.buffersTooLarge++;
+        return;
+    }
+
+    if (flightRecorder.head + validSize > flightRecorder.capacity)
+    {
+        // Wrap around. The copies past the head are the oldest ones, drop them to keep the entries in order.
+        while (!flightRecorder.entries.empty() && flightRecorder.entries.front().offset >= flightRecorder.head)
+        {
+            flightRecorder.entries.pop_front();
+            flightRecorder.buffersOverwritten++;
+        }
+        flightRecorder.head = 0;
+    }
+
+    while (!flightRecorder.entries.empty() &&
+           flightRecorder.entries.front().offset >= flightRecorder.head &&
+           flightRecorder.entries.front().offset < flightRecorder.head + validSize)
+    {
+        flightRecorder.entries.pop_front();
+        flightRecorder.buffersOverwritten++;
+    }
+
+    FlightRecorderEntry entry;
+    entry.offset = flightRecorder.head;
+    entry.validSize = validSize;
+    entry.startTimestamp = 0;
+    entry.endTimestamp = 0;
+    entry.numRecords = 0;
+
+    uint8_t *pCopy = flightRecorder.pRing + entry.offset;
+    memcpy(pCopy, pBuffer, validSize);
+
+    CUpti_Activity *pRecord = NULL;
+    while (cuptiActivityGetNextRecord(pCopy, validSize, &pRecord) == CUPTI_SUCCESS)
+    {
+        uint64_t start = 0;
+        uint64_t end = 0;
+
+        if (pRecord->kind == CUPTI_ACTIVITY_KIND_KERNEL ||
+            pRecord->kind == CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL)
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            pKernelRecord->name = InternKernelName(pKernelRecord->name);
+        }
+
+        if (GetActivityTimeRange(pRecord, &start, &end) && start)
+        {
+            if (!entry.startTimestamp || start < entry.startTimestamp)
+            {
+                entry.startTimestamp = start;
+            }
+            if (end > entry.endTimestamp)
+            {
+                entry.endTimestamp = end;
+            }
+        }
+
+        entry.numRecords++;
+    }
+
+    flightRecorder.entries.push_back(entry);
+    // Keep the copies aligned like the CUPTI buffers.
+    flightRecorder.head += (validSize + ALIGN_SIZE - 1) & ~((size_t)ALIGN_SIZE - 1);
+    flightRecorder.buffersRecorded++;
+}
+
+// Hook of BufferCompleted(), set while the flight recorder is enabled.
+static void
+FlightRecorderRecordBuffer(
+    uint8_t *pBuffer,
+    size_t validSize)
+{
+    std::lock_guard<std::mutex> lock(flightRecorder.mutex);
+    if (flightRecorder.enabled)
+    {
+        RecordFlightRecorderBuffer(pBuffer, validSize);
+    }
+}
+
+// Write the ring to pFileName, or to the default dump file if NULL. With flush set the buffers
+// held by CUPTI are completed first. Returns false if the file could not be written.
+static bool
+FlightRecorderDump(
+    const char *pFileName,
+    bool flush)
+{
+    std::vector<uint8_t *> buffers;
+    std::vector<size_t> validSizes;
+    std::string fileName;
+    uint64_t startTimestamp = 0;
+    uint64_t endTimestamp = 0;
+
+    if (!flightRecorder.enabled)
+    {
+        return false;
+    }
+
+    if (flush)
+    {
+        cuptiActivityFlushAll(0);
+        cuptiGetLastError();
+    }
+
+    std::lock_guard<std::mutex> lock(flightRecorder.mutex);
+
+    if (pFileName)
+    {
+        fileName = pFileName;
+    }
+    else
+    {
+        // Keep the earlier dumps of the process.
+        fileName = flightRecorder.dumpFileName;
+        if (flightRecorder.dumps)
+        {
+            fileName += "." + std::to_string(flightRecorder.dumps);
+        }
+    }
+
+    uint64_t newest = 0;
+    for (size_t i = 0; i < flightRecorder.entries.size(); i++)
+    {
+        if (flightRecorder.entries[i].endTimestamp > newest)
+        {
+            newest = flightRecorder.entries[i].endTimestamp;
+        }
+    }
+
+    for (size_t i = 0; i < flightRecorder.entries.size(); i++)
+    {
+        const FlightRecorderEntry *pEntry = &flightRecorder.entries[i];
+
+        // Buffers without timed records (e.g. names, devices) are always kept, they describe the others.
+        if (flightRecorder.dumpWindowNs && pEntry->endTimestamp &&
+            pEntry->endTimestamp + flightRecorder.dumpWindowNs < newest)
+        {
+            continue;
+        }
+
+        buffers.push_back(flightRecorder.pRing + pEntry->offset);
+        validSizes.push_back(pEntry->validSize);
+
+        if (pEntry->startTimestamp && (!startTimestamp || pEntry->startTimestamp < startTimestamp))
+        {
+            startTimestamp = pEntry->startTimestamp;
+        }
+        if (pEntry->endTimestamp > endTimestamp)
+        {
+            endTimestamp = pEntry->endTimestamp;
+        }
+    }
+
+    bool success = WriteActivityTraceFile(fileName.c_str(), buffers, validSizes);
+    if (success)
+    {
+        flightRecorder.dumps++;
+        fprintf(stderr, "Flight recorder: wrote %llu buffers, [ %llu, %llu ], to %s (%llu buffers overwritten so far).\n",
+                (unsigned long long)buffers.size(),
+                (unsigned long long)startTimestamp,
+                (unsigned long long)endTimestamp,
+                fileName.c_str(),
+                (unsigned long long)flightRecorder.buffersOverwritten);
+    }
+    else
+    {
+        fprintf(stderr, "Flight recorder: failed to write %s.\n", fileName.c_str());
+    }
+
+    return success;
+}
+
+// Called by HandleDomainStateCallback() before exiting. CUPTI is not usable anymore, the ring is written as is.
+static void
+FlightRecorderOnFatalError(void)
+{
+    FlightRecorderDump(NULL, false);
+}
+
+#ifndef _WIN32
+static void
+FlightRecorderSignalHandler(
+    int signalNumber)
+{
+    unsigned char message = (unsigned char)signalNumber;
+
+    // Only async-signal-safe calls here, the dump thread does the work.
+    ssize_t written = write(flightRecorder.signalPipe[1], &message, 1);
+    (void)written;
+}
+
+static void
+FlightRecorderDumpThread(void)
+{
+    unsigned char message = 0;
+
+    while (read(flightRecorder.signalPipe[0], &message, 1) == 1 && message != 0)
+    {
+        FlightRecorderDump(NULL, true);
+
+        if (message == SIGTERM)
+        {
+            // Terminate the way the process would have without the recorder.
+            sigaction(SIGTERM, &flightRecorder.previousTermAction, NULL);
+            raise(SIGTERM);
+        }
+    }
+}
+#endif
+
+// Record the buffers completed by BufferCompleted(). Call after InitCuptiTrace() and clear
+// UserData::printActivityRecords, the records are then only post processed.
+// ringSize is the memory used by the ring, pDumpFileName the file written on a signal or fatal error.
+static void
+InitFlightRecorder(
+    size_t ringSize,
+    const char *pDumpFileName,
+    uint64_t dumpWindowNs)
+{
+    flightRecorder.pRing = (uint8_t *)malloc(ringSize);
+    MEMORY_ALLOCATION_CALL(flightRecorder.pRing);
+
+    flightRecorder.capacity = ringSize;
+    flightRecorder.head = 0;
+    flightRecorder.entries.clear();
+    flightRecorder.names.clear();
+    flightRecorder.dumpFileName = pDumpFileName;
+    flightRecorder.dumpWindowNs = dumpWindowNs;
+    flightRecorder.dumps = 0;
+    flightRecorder.buffersRecorded = 0;
+    flightRecorder.buffersOverwritten = 0;
+    flightRecorder.buffersTooLarge = 0;
+    flightRecorder.enabled = 1;
+
+    globals.pFatalErrorHandler = FlightRecorderOnFatalError;
+    globals.pRecordBuffer = FlightRecorderRecordBuffer;
+
+#ifndef _WIN32
+    if (pipe(flightRecorder.signalPipe) != 0)
+    {
+        std::cerr << "Flight recorder: failed to create the signal pipe, signals will not trigger dumps.\n";
+        return;
+    }
+
+    flightRecorder.dumpThread = std::thread(FlightRecorderDumpThread);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = FlightRecorderSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, &flightRecorder.previousUsr1Action);
+    sigaction(SIGTERM, &action, &flightRecorder.previousTermAction);
+#endif
+
+    std::cout << "Flight recorder: " << ringSize << " bytes ring, dump file " << pDumpFileName << ".\n";
+}
+
+// Stop recording and release the ring. Nothing is written.
+static void
+DeInitFlightRecorder(void)
+{
+    if (!flightRecorder.enabled)
+    {
+        return;
+    }
+
+#ifndef _WIN32
+    if (flightRecorder.dumpThread.joinable())
+    {
+        unsigned char message = 0;
+
+        sigaction(SIGUSR1, &flightRecorder.previousUsr1Action, NULL);
+        sigaction(SIGTERM, &flightRecorder.previousTermAction, NULL);
+
+        if (write(flightRecorder.signalPipe[1], &message, 1) == 1)
+        {
+            flightRecorder.dumpThread.join();
+        }
+        else
+        {
+            flightRecorder.dumpThread.detach();
+        }
+
+        close(flightRecorder.signalPipe[0]);
+        close(flightRecorder.signalPipe[1]);
+    }
+#endif
+
+    globals.pFatalErrorHandler = NULL;
+    globals.pRecordBuffer = NULL;
+
+    std::lock_guard<std::mutex> lock(flightRecorder.mutex);
+    flightRecorder.enabled = 0;
+    flightRecorder.entries.clear();
+    flightRecorder.names.clear();
+    free(flightRecorder.pRing);
+    flightRecorder.pRing = NULL;
+}
+
+#endif // HELPER_CUPTI_FLIGHT_RECORDER_H_
@@ -0,0 +1,572 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_LAUNCH_LATENCY_H_
+#define HELPER_CUPTI_LAUNCH_LATENCY_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+#include "helper_cupti_correlation.h"
+
+// Launch latency and queueing delay of the GPU activities.
+//
+// The RUNTIME and DRIVER records are joined with the kernel, memcpy and memset
+// records by correlation id with the streaming join of
+// helper_cupti_correlation.h. For every matched pair:
+//  - the launch latency is the time from the start of the API call to the
+//    start of the activity on the GPU,
+//  - the queueing delay is the time from the end of the API call to the start
+//    on the GPU, 0 if the activity started before the call returned,
+//  - a kernel is short when it executes for less time than its launch call
+//    takes on the CPU: a sequence of them is bound by the launches.
+// The latencies go to log-linear histograms (8 buckets per power of two, so a
+// percentile is within 6%) per stream, per thread and per kernel name.
+//
+// The queueing delays also give the queue depth over time: a launch is queued
+// from the end of its call to its start on the GPU, and the queued time summed
+// over a window divided by its length is the average number of launches queued
+// in the window. The windows are kept by index in a map, so the pairs can be
+// matched in any order, and the window length doubles when the map is full.
+
+// Macros
+#define LAUNCH_LATENCY_DEFAULT_JOIN_CAPACITY (1 << 16)
+#define LAUNCH_LATENCY_DEFAULT_MAX_AGE_NS (10ULL * 1000 * 1000 * 1000)
+#define LAUNCH_LATENCY_DEFAULT_WINDOW_NS (1000ULL * 1000)
+#define LAUNCH_LATENCY_SUB_BUCKET_BITS 3
+#define LAUNCH_LATENCY_LINEAR_BUCKETS (2 << LAUNCH_LATENCY_SUB_BUCKET_BITS) // Exact buckets for the values below 16.
+#define LAUNCH_LATENCY_BUCKETS (LAUNCH_LATENCY_LINEAR_BUCKETS + (64 - LAUNCH_LATENCY_SUB_BUCKET_BITS - 1) * (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS))
+#define LAUNCH_LATENCY_MAX_WINDOWS 512                               // Windows of the process series.
+#define LAUNCH_LATENCY_MAX_STREAM_WINDOWS 64                         // Windows of the series of every stream.
+#define LAUNCH_LATENCY_MAX_NAMES 1024                                // Further names are counted under "<other>".
+#define LAUNCH_LATENCY_MIN_PHASE_KERNELS 16                          // Kernels in a window for it to be flagged as launch bound.
+#define LAUNCH_LATENCY_PRINT_WINDOWS 32
+#define LAUNCH_LATENCY_TOP_COUNT 20
+
+// Data structures
+typedef struct LatencyHistogram_st
+{
+    uint64_t count;
+    uint64_t sumNs;
+    uint64_t maxNs;
+    uint32_t buckets[LAUNCH_LATENCY_BUCKETS];
+} LatencyHistogram;
+
+typedef struct LaunchLatencyStats_st
+{
+    LatencyHistogram launch;                                         // API start to GPU start.
+    LatencyHistogram queue;                                          // API end to GPU start.
+    uint64_t         numKernels;
+    uint64_t         numShortKernels;                                // Kernels executing for less time than their launch call.
+} LaunchLatencyStats;
+
+typedef struct LaunchLatencyWindow_st
+{
+    uint64_t queuedNs;                                               // Sum of the queued time of the launches in the window.
+    uint32_t numLaunches;                                            // Activities starting on the GPU in the window.
+    uint32_t numKernels;
+    uint32_t numShortKernels;
+} LaunchLatencyWindow;
+
+typedef struct LaunchLatencySeries_st
+{
+    uint64_t                                 intervalNs;
+    uint32_t                                 maxWindows;
+    std::map<uint64_t, LaunchLatencyWindow>  windows;                // By start / intervalNs.
+} LaunchLatencySeries;
+
+typedef struct LaunchLatencyStream_st
+{
+    LaunchLatencyStats  stats;
+    LaunchLatencySeries series;
+} LaunchLatencyStream;
+
+typedef struct LaunchLatencyAnalyzer_st
+{
+    std::mutex                                          mutex;       // The buffers can be completed by several threads.
+    CorrelationJoin                                     join;
+    LaunchLatencyStats                                  total;
+    LaunchLatencySeries                                 series;
+    std::map<uint64_t, LaunchLatencyStream>             streams;     // By deviceId << 32 | streamId.
+    std::map<uint64_t, LaunchLatencyStats>              threads;     // By processId << 32 | threadId.
+    std::unordered_map<std::string, LaunchLatencyStats> names;       // By kernel name, or memory operation.
+} LaunchLatencyAnalyzer;
+
+// Helper Functions
+static inline uint32_t
+GetLatencyBucket(
+    uint64_t valueNs)
+{
+    if (valueNs < LAUNCH_LATENCY_LINEAR_BUCKETS)
+    {
+        return (uint32_t)valueNs;
+    }
+
+    uint32_t octave = 63;
+    while (!(valueNs >> octave))
+    {
+        octave--;
+    }
+
+    uint32_t subBucket = (uint32_t)(valueNs >> (octave - LAUNCH_LATENCY_SUB_BUCKET_BITS)) - (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS);
+    return LAUNCH_LATENCY_LINEAR_BUCKETS + (octave - LAUNCH_LATENCY_SUB_BUCKET_BITS - 1) * (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS) + subBucket;
+}
+
+// Middle of the values of bucket.
+static inline uint64_t
+GetLatencyBucketValue(
+    uint32_t bucket)
+{
+    if (bucket < LAUNCH_LATENCY_LINEAR_BUCKETS)
+    {
+        return bucket;
+    }
+
+    uint32_t index = bucket - LAUNCH_LATENCY_LINEAR_BUCKETS;
+    uint32_t octave = index / (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS) + LAUNCH_LATENCY_SUB_BUCKET_BITS + 1;
+    uint64_t subBucket = (index % (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS)) + (1 << LAUNCH_LATENCY_SUB_BUCKET_BITS);
+    uint64_t width = 1ULL << (octave - LAUNCH_LATENCY_SUB_BUCKET_BITS);
+
+    return subBucket * width + width / 2;
+}
+
+static inline void
+AddLatencySample(
+    LatencyHistogram *pHistogram,
+    uint64_t valueNs)
+{
+    pHistogram->count++;
+    pHistogram->sumNs += valueNs;
+    pHistogram->maxNs = std::max(pHistogram->maxNs, valueNs);
+    pHistogram->buckets[GetLatencyBucket(valueNs)]++;
+}
+
+// Value under which percent of the samples are, the maximum for 100.
+static uint64_t
+GetLatencyPercentile(
+    const LatencyHistogram *pHistogram,
+    double percent)
+{
+    uint64_t rank = (uint64_t)((double)pHistogram->count * percent / 100.0);
+    uint64_t seen = 0;
+
+    if (rank >= pHistogram->count)
+    {
+        return pHistogram->maxNs;
+    }
+
+    for (uint32_t i = 0; i < LAUNCH_LATENCY_BUCKETS; i++)
+    {
+        seen += pHistogram->buckets[i];
+        if (seen > rank)
+        {
+            return std::min(GetLatencyBucketValue(i), pHistogram->maxNs);
+        }
+    }
+
+    return pHistogram->maxNs;
+}
+
+static void
+InitLaunchLatencySeries(
+    LaunchLatencySeries *pSeries,
+    uint64_t intervalNs,
+    uint32_t maxWindows)
+{
+    pSeries->intervalNs = intervalNs;
+    pSeries->maxWindows = maxWindows;
+    pSeries->windows.clear();
+}
+
+static void
+HalveLaunchLatencySeries(
+    LaunchLatencySeries *pSeries)
+{
+    std::map<uint64_t, LaunchLatencyWindow> windows;
+
+    for (std::map<uint64_t, LaunchLatencyWindow>::const_iterator it = pSeries->windows.begin(); it != pSeries->windows.end(); ++it)
+    {
+        LaunchLatencyWindow &window = windows[it->first / 2];
+
+        window.queuedNs += it->second.queuedNs;
+        window.numLaunches += it->second.numLaunches;
+        window.numKernels += it->second.numKernels;
+        window.numShortKernels += it->second.numShortKernels;
+    }
+
+    pSeries->windows.swap(windows);
+    pSeries->intervalNs *= 2;
+}
+
+static LaunchLatencyWindow *
+GetLaunchLatencyWindow(
+    LaunchLatencySeries *pSeries,
+    uint64_t timestamp)
+{
+    uint64_t index = timestamp / pSeries->intervalNs;
+
+    if (pSeries->windows.find(index) == pSeries->windows.end())
+    {
+        while (pSeries->windows.size() >= pSeries->maxWindows)
+        {
+            HalveLaunchLatencySeries(pSeries);
+        }
+        index = timestamp / pSeries->intervalNs;
+    }
+
+    return &pSeries->windows[index];
+}
+
+// Count the launch starting at gpuStart, queued from queuedStart.
+static void
+AddLaunchLatencyWindows(
+    LaunchLatencySeries *pSeries,
+    uint64_t queuedStart,
+    uint64_t gpuStart,
+    bool isKernel,
+    bool isShort)
+{
+    // Spread the queued time over the windows it covers, a few at most.
+    while (gpuStart > queuedStart && (gpuStart - 1) / pSeries->intervalNs - queuedStart / pSeries->intervalNs >= pSeries->maxWindows / 4)
+    {
+        HalveLaunchLatencySeries(pSeries);
+    }
+
+    for (uint64_t time = queuedStart; time < gpuStart;)
+    {
+        uint64_t windowEnd = (time / pSeries->intervalNs + 1) * pSeries->intervalNs;
+        uint64_t end = std::min(windowEnd, gpuStart);
+
+        GetLaunchLatencyWindow(pSeries, time)->queuedNs += end - time;
+        time = end;
+    }
+
+    LaunchLatencyWindow *pWindow = GetLaunchLatencyWindow(pSeries, gpuStart);
+    pWindow->numLaunches++;
+    if (isKernel)
+    {
+        pWindow->numKernels++;
+        pWindow->numShortKernels += isShort ? 1 : 0;
+    }
+}
+
+static void
+AddLaunchLatencyStats(
+    LaunchLatencyStats *pStats,
+    uint64_t launchNs,
+    uint64_t queueNs,
+    bool isKernel,
+    bool isShort)
+{
+    AddLatencySample(&pStats->launch, launchNs);
+    AddLatencySample(&pStats->queue, queueNs);
+    if (isKernel)
+    {
+        pStats->numKernels++;
+        pStats->numShortKernels += isShort ? 1 : 0;
+    }
+}
+
+// Matched callback of the join, called with the analyzer locked.
+static void
+LaunchLatencyMatched(
+    void *pUserData,
+    const CorrelationEntry *pEntry)
+{
+    LaunchLatencyAnalyzer *pAnalyzer = (LaunchLatencyAnalyzer *)pUserData;
+    const CorrelationApi *pApi = &pEntry->api;
+    const CorrelationGpu *pGpu = &pEntry->gpu;
+    bool isKernel = pGpu->kind == CUPTI_ACTIVITY_KIND_KERNEL || pGpu->kind == CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL;
+
+    if (pGpu->start < pApi->start)
+    {
+        // Clocks of the CPU and GPU timestamps not in sync, nothing to measure.
+        return;
+    }
+
+    uint64_t launchNs = pGpu->start - pApi->start;
+    uint64_t queueNs = pGpu->start > pApi->end ? pGpu->start - pApi->end : 0;
+    bool isShort = isKernel && pGpu->end - pGpu->start < pApi->end - pApi->start;
+
+    AddLaunchLatencyStats(&pAnalyzer->total, launchNs, queueNs, isKernel, isShort);
+    AddLaunchLatencyWindows(&pAnalyzer->series, pApi->end, pGpu->start, isKernel, isShort);
+
+    std::map<uint64_t, LaunchLatencyStream>::iterator stream = pAnalyzer->streams.find(((uint64_t)pGpu->deviceId << 32) | pGpu->streamId);
+    if (stream == pAnalyzer->streams.end())
+    {
+        stream = pAnalyzer->streams.insert(std::make_pair(((uint64_t)pGpu->deviceId << 32) | pGpu->streamId, LaunchLatencyStream())).first;
+        InitLaunchLatencySeries(&stream->second.series, pAnalyzer->series.intervalNs, LAUNCH_LATENCY_MAX_STREAM_WINDOWS);
+    }
+    AddLaunchLatencyStats(&stream->second.stats, launchNs, queueNs, isKernel, isShort);
+    AddLaunchLatencyWindows(&stream->second.series, pApi->end, pGpu->start, isKernel, isShort);
+
+    AddLaunchLatencyStats(&pAnalyzer->threads[((uint64_t)pApi->processId << 32) | pApi->threadId], launchNs, queueNs, isKernel, isShort);
+
+    std::string name;
+    if (isKernel)
+    {
+        name = GetName(pGpu->pName);
+    }
+    else if (pGpu->kind == CUPTI_ACTIVITY_KIND_MEMCPY)
+    {
+        name = std::string("[memcpy ") + GetMemcpyKindString((CUpti_ActivityMemcpyKind)pGpu->copyKind) + "]";
+    }
+    else
+    {
+        name = "[memset]";
+    }
+
+    std::unordered_map<std::string, LaunchLatencyStats>::iterator it = pAnalyzer->names.find(name);
+    if (it == pAnalyzer->names.end())
+    {
+        if (pAnalyzer->names.size() >= LAUNCH_LATENCY_MAX_NAMES)
+        {
+            name = "<other>";
+        }
+        it = pAnalyzer->names.insert(std::make_pair(name, LaunchLatencyStats())).first;
+    }
+    AddLaunchLatencyStats(&it->second, launchNs, queueNs, isKernel, isShort);
+}
+
+static void
+InitLaunchLatencyAnalyzer(
+    LaunchLatencyAnalyzer *pAnalyzer,
+    uint32_t joinCapacity,
+    uint64_t maxAgeNs,
+    uint64_t windowNs)
+{
+    InitCorrelationJoin(&pAnalyzer->join, joinCapacity, maxAgeNs, LaunchLatencyMatched, NULL, pAnalyzer);
+    memset(&pAnalyzer->total, 0, sizeof(LaunchLatencyStats));
+    InitLaunchLatencySeries(&pAnalyzer->series, windowNs ? windowNs : LAUNCH_LATENCY_DEFAULT_WINDOW_NS, LAUNCH_LATENCY_MAX_WINDOWS);
+    pAnalyzer->streams.clear();
+    pAnalyzer->threads.clear();
+    pAnalyzer->names.clear();
+}
+
+// Feed one activity record: RUNTIME, DRIVER, kernel, MEMCPY and MEMSET records are used, other kinds are ignored.
+static void
+LaunchLatencyAddRecord(
+    LaunchLatencyAnalyzer *pAnalyzer,
+    CUpti_Activity *pRecord)
+{
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+            CorrelationJoinAddRecord(&pAnalyzer->join, pRecord);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void
+PrintLaunchLatencyStats(
+    FILE *pFile,
+    const LaunchLatencyStats *pStats)
+{
+    const LatencyHistogram *pLaunch = &pStats->launch;
+    const LatencyHistogram *pQueue = &pStats->queue;
+
+    fprintf(pFile, "%10llu %10llu %10llu %10llu %10llu %10llu %10llu %10llu %8llu/%-8llu",
+            (unsigned long long)pLaunch->count,
+            (unsigned long long)GetLatencyPercentile(pLaunch, 50), (unsigned long long)GetLatencyPercentile(pLaunch, 90),
+            (unsigned long long)GetLatencyPercentile(pLaunch, 99), (unsigned long long)pLaunch->maxNs,
+            (unsigned long long)GetLatencyPercentile(pQueue, 50), (unsigned long long)GetLatencyPercentile(pQueue, 99),
+            (unsigned long long)pQueue->maxNs,
+            (unsigned long long)pStats->numShortKernels, (unsigned long long)pStats->numKernels);
+}
+
+static void
+PrintLaunchLatencyHeader(
+    FILE *pFile,
+    const char *pKey)
+{
+    fprintf(pFile, "  %10s %10s %10s %10s %10s %10s %10s %10s %17s  %s\n", "Launches", "Launch p50", "p90", "p99", "max",
+            "Queue p50", "p99", "max", "Short/Kernels", pKey);
+}
+
+static bool
+CompareLaunchLatencyCount(
+    const std::pair<std::string, const LaunchLatencyStats *> &a,
+    const std::pair<std::string, const LaunchLatencyStats *> &b)
+{
+    return a.second->launch.count > b.second->launch.count;
+}
+
+// Flush the join and print the latencies, the queue depth over time and the launch bound phases. Times in ns.
+static void
+PrintLaunchLatencyReport(
+    LaunchLatencyAnalyzer *pAnalyzer,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    CorrelationJoinFlush(&pAnalyzer->join);
+
+    fprintf(pFile, "\nLaunch latency: %llu launches matched, %llu API calls without GPU activity, %llu activities without API record\n",
+            (unsigned long long)pAnalyzer->join.numMatched, (unsigned long long)pAnalyzer->join.numEvictedApi,
+            (unsigned long long)pAnalyzer->join.numEvictedGpu);
+    PrintLaunchLatencyHeader(pFile, "");
+    fprintf(pFile, "  ");
+    PrintLaunchLatencyStats(pFile, &pAnalyzer->total);
+    fprintf(pFile, "  <all>\n");
+
+    fprintf(pFile, "Per stream:\n");
+    PrintLaunchLatencyHeader(pFile, "Device/Stream, queue depth avg/peak");
+    for (std::map<uint64_t, LaunchLatencyStream>::const_iterator it = pAnalyzer->streams.begin(); it != pAnalyzer->streams.end(); ++it)
+    {
+        const LaunchLatencySeries &series = it->second.series;
+        uint64_t queuedNs = 0;
+        uint64_t peakQueuedNs = 0;
+
+        for (std::map<uint64_t, LaunchLatencyWindow>::const_iterator window = series.windows.begin(); window != series.windows.end(); ++window)
+        {
+            queuedNs += window->second.queuedNs;
+            peakQueuedNs = std::max(peakQueuedNs, window->second.queuedNs);
+        }
+
+        uint64_t spanNs = series.windows.empty() ? 0 : (series.windows.rbegin()->first - series.windows.begin()->first + 1) * series.intervalNs;
+
+        fprintf(pFile, "  ");
+        PrintLaunchLatencyStats(pFile, &it->second.stats);
+        fprintf(pFile, "  %u/%u, %.2f/%.2f\n", (uint32_t)(it->first >> 32), (uint32_t)it->first,
+                spanNs ? (double)queuedNs / (double)spanNs : 0.0, (double)peakQueuedNs / (double)series.intervalNs);
+    }
+
+    fprintf(pFile, "Per thread:\n");
+    PrintLaunchLatencyHeader(pFile, "Process/Thread");
+    for (std::map<uint64_t, LaunchLatencyStats>::const_iterator it = pAnalyzer->threads.begin(); it != pAnalyzer->threads.end(); ++it)
+    {
+        fprintf(pFile, "  ");
+        PrintLaunchLatencyStats(pFile, &it->second);
+        fprintf(pFile, "  %u/%u\n", (uint32_t)(it->first >> 32), (uint32_t)it->first);
+    }
+
+    std::vector<std::pair<std::string, const LaunchLatencyStats *> > names;
+    for (std::unordered_map<std::string, LaunchLatencyStats>::const_iterator it = pAnalyzer->names.begin(); it != pAnalyzer->names.end(); ++it)
+    {
+        names.push_back(std::make_pair(it->first, &it->second));
+    }
+    size_t top = std::min(names.size(), (size_t)LAUNCH_LATENCY_TOP_COUNT);
+    std::partial_sort(names.begin(), names.begin() + top, names.end(), CompareLaunchLatencyCount);
+
+    fprintf(pFile, "Per kernel name, most launched first:\n");
+    PrintLaunchLatencyHeader(pFile, "Name");
+    for (size_t i = 0; i < top; i++)
+    {
+        fprintf(pFile, "  ");
+        PrintLaunchLatencyStats(pFile, names[i].second);
+        fprintf(pFile, "  %s\n", names[i].first.c_str());
+    }
+
+    // The process series, merged down for printing.
+    LaunchLatencySeries series = pAnalyzer->series;
+    while (!series.windows.empty() &&
+           series.windows.rbegin()->first - series.windows.begin()->first >= LAUNCH_LATENCY_PRINT_WINDOWS)
+    {
+        HalveLaunchLatencySeries(&series);
+    }
+
+    fprintf(pFile, "Queue depth over time (windows of %llu ns):\n", (unsigned long long)series.intervalNs);
+    fprintf(pFile, "  %20s %10s %12s %15s\n", "Window", "Launches", "Avg queued", "Short/Kernels");
+    for (std::map<uint64_t, LaunchLatencyWindow>::const_iterator it = series.windows.begin(); it != series.windows.end(); ++it)
+    {
+        fprintf(pFile, "  %20llu %10u %12.2f %7u/%-7u\n", (unsigned long long)(it->first * series.intervalNs), it->second.numLaunches,
+                (double)it->second.queuedNs / (double)series.intervalNs, it->second.numShortKernels, it->second.numKernels);
+    }
+
+    // Launch bound phases: consecutive windows of the full resolution series where most kernels are short.
+    fprintf(pFile, "Launch bound phases (most kernels shorter than their launch call, windows of %llu ns):\n",
+            (unsigned long long)pAnalyzer->series.intervalNs);
+    uint64_t phaseStart = 0;
+    uint64_t phaseEnd = 0;
+    uint64_t phaseKernels = 0;
+    uint64_t phaseShortKernels = 0;
+    bool inPhase = false;
+
+    for (std::map<uint64_t, LaunchLatencyWindow>::const_iterator it = pAnalyzer->series.windows.begin(); ; ++it)
+    {
+        bool last = it == pAnalyzer->series.windows.end();
+        bool launchBound = !last &&
+                           it->second.numKernels >= LAUNCH_LATENCY_MIN_PHASE_KERNELS &&
+                           2 * it->second.numShortKernels >= it->second.numKernels;
+
+        if (inPhase && (!launchBound || it->first != phaseEnd))
+        {
+            fprintf(pFile, "  [ %llu, %llu ) %llu of %llu kernels short\n", (unsigned long long)(phaseStart * pAnalyzer->series.intervalNs),
+                    (unsigned long long)(phaseEnd * pAnalyzer->series.intervalNs), (unsigned long long)phaseShortKernels,
+                    (unsigned long long)phaseKernels);
+            inPhase = false;
+        }
+
+        if (last)
+        {
+            break;
+        }
+
+        if (launchBound)
+        {
+            if (!inPhase)
+            {
+                inPhase = true;
+                phaseStart = it->first;
+                phaseKernels = 0;
+                phaseShortKernels = 0;
+            }
+            phaseEnd = it->first + 1;
+            phaseKernels += it->second.numKernels;
+            phaseShortKernels += it->second.numShortKernels;
+        }
+    }
+    fflush(pFile);
+}
+
+static void
+FreeLaunchLatencyAnalyzer(
+    LaunchLatencyAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    FreeCorrelationJoin(&pAnalyzer->join);
+    pAnalyzer->series.windows.clear();
+    pAnalyzer->streams.clear();
+    pAnalyzer->threads.clear();
+    pAnalyzer->names.clear();
+}
+
+#endif // HELPER_CUPTI_LAUNCH_LATENCY_H_
@@ -0,0 +1,629 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_MEMORY_FOOTPRINT_H_
+#define HELPER_CUPTI_MEMORY_FOOTPRINT_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Live memory footprint from the MEMORY2 and MEMORY_POOL records.
+//
+// The live allocations are kept in an address ordered map, so an allocation,
+// a release or the lookup of the allocation containing an address costs
+// O(log n), and an entry holds only the fields the reports need. With a
+// 64-bit libstdc++ a live allocation costs a map node of 88 bytes, the 48
+// byte LiveAllocation, its 8 byte address and 32 bytes of tree links, plus the
+// overhead of the heap allocator. An allocation overlapping live ones means
+// their release records were lost: they are removed and counted.
+//
+// For every device the tracker keeps the footprint of the device resident
+// memory kinds over time, in a bounded series whose interval doubles when it
+// is full, and a snapshot of the largest live allocations when the peak is
+// reached. The snapshot is taken at the first release after a new peak and
+// skipped if the peak grew by less than 1/64 since the previous one, which
+// bounds the number of scans of the live allocations. The memory pools report
+// their reserved and utilized size, and the allocations still live at the end
+// are reported as leaks.
+
+// Macros
+#define MEMORY_FOOTPRINT_DEFAULT_INTERVAL_NS (1000ULL * 1000)
+#define MEMORY_FOOTPRINT_MAX_SAMPLES 1024
+#define MEMORY_FOOTPRINT_TOP_ALLOCATIONS 10
+#define MEMORY_FOOTPRINT_SNAPSHOT_GROWTH_SHIFT 6                   // Snapshot again once the peak grew by 1/64.
+
+// Data structures
+typedef struct LiveAllocation_st
+{
+    uint64_t bytes;
+    uint64_t timestamp;                                              // Allocation timestamp.
+    uint64_t pc;                                                     // PC of the allocation call, 0 if not collected.
+    uint64_t poolAddress;                                            // Memory pool of the allocation, 0 if none.
+    uint32_t correlationId;                                          // Correlation id of the allocation API call.
+    uint32_t contextId;
+    uint32_t deviceId;
+    uint8_t  memoryKind;                                             // CUpti_ActivityMemoryKind.
+} LiveAllocation;
+
+typedef struct FootprintSample_st
+{
+    uint64_t timestamp;                                              // Start of the interval.
+    uint64_t bytes;                                                  // Footprint at the end of the interval.
+    uint64_t maxBytes;                                               // Highest footprint in the interval.
+} FootprintSample;
+
+typedef struct DeviceFootprint_st
+{
+    uint64_t                                       currentBytes;     // Live bytes of the device resident kinds.
+    uint64_t                                       peakBytes;
+    uint64_t                                       peakTimestamp;
+    uint64_t                                       numAllocations;
+    uint64_t                                       numReleases;
+    uint64_t                                       liveAllocations;  // All memory kinds.
+    std::vector<FootprintSample>                   series;
+    uint64_t                                       intervalNs;       // Interval of the samples of series.
+    int                                            peakPending;      // A new peak was reached and not captured yet.
+    uint64_t                                       snapshotBytes;    // Footprint when the snapshot was taken.
+    uint64_t                                       snapshotTimestamp;
+    std::vector<std::pair<uint64_t, LiveAllocation> > snapshot;      // Largest live allocations (address, allocation) at the peak.
+} DeviceFootprint;
+
+typedef struct MemoryPoolUsage_st
+{
+    uint32_t deviceId;
+    uint8_t  memoryPoolType;                                         // CUpti_ActivityMemoryPoolType.
+    uint8_t  isManagedPool;
+    uint8_t  destroyed;
+    uint64_t size;                                                   // Reserved size.
+    uint64_t utilizedSize;
+    uint64_t peakSize;
+    uint64_t peakUtilizedSize;
+    uint64_t releaseThreshold;
+    uint64_t numAllocations;                                         // Allocations made from the pool.
+    uint64_t numTrims;
+} MemoryPoolUsage;
+
+typedef struct MemoryFootprintTracker_st
+{
+    std::mutex                          mutex;                       // The buffers can be completed by several threads.
+    std::map<uint64_t, LiveAllocation>  allocations;                 // Live allocations by address, 88 bytes per node.
+    std::map<uint32_t, DeviceFootprint> devices;
+    std::map<uint64_t, MemoryPoolUsage> pools;                       // By pool address.
+    uint64_t                            intervalNs;                  // Initial interval of the series.
+    uint64_t                            unmatchedReleases;           // Releases of an address not allocated.
+    uint64_t                            overlappedAllocations;       // Live allocations removed by an overlapping allocation.
+} MemoryFootprintTracker;
+
+// Helper Functions
+static inline bool
+IsDeviceMemoryKind(
+    uint8_t memoryKind)
+{
+    return memoryKind == CUPTI_ACTIVITY_MEMORY_KIND_DEVICE ||
+           memoryKind == CUPTI_ACTIVITY_MEMORY_KIND_DEVICE_STATIC ||
+           memoryKind == CUPTI_ACTIVITY_MEMORY_KIND_ARRAY ||
+           memoryKind == CUPTI_ACTIVITY_MEMORY_KIND_MANAGED ||
+           memoryKind == CUPTI_ACTIVITY_MEMORY_KIND_MANAGED_STATIC;
+}
+
+static DeviceFootprint &
+GetDeviceFootprint(
+    MemoryFootprintTracker *pTracker,
+    uint32_t deviceId)
+{
+    std::map<uint32_t, DeviceFootprint>::iterator it = pTracker->devices.find(deviceId);
+
+    if (it == pTracker->devices.end())
+    {
+        DeviceFootprint device;
+
+        device.currentBytes = 0;
+        device.peakBytes = 0;
+        device.peakTimestamp = 0;
+        device.numAllocations = 0;
+        device.numReleases = 0;
+        device.liveAllocations = 0;
+        device.intervalNs = pTracker->intervalNs;
+        device.peakPending = 0;
+        device.snapshotBytes = 0;
+        device.snapshotTimestamp = 0;
+        it = pTracker->devices.insert(std::make_pair(deviceId, device)).first;
+    }
+
+    return it->second;
+}
+
+// Merge the samples of the series two intervals at a time.
+static void
+HalveFootprintSeries(
+    DeviceFootprint *pDevice)
+{
+    std::vector<FootprintSample> &series = pDevice->series;
+    size_t kept = 0;
+
+    pDevice->intervalNs *= 2;
+    for (size_t i = 0; i < series.size(); i++)
+    {
+        uint64_t start = series[i].timestamp - series[i].timestamp % pDevice->intervalNs;
+
+        if (kept && series[kept - 1].timestamp == start)
+        {
+            series[kept - 1].bytes = series[i].bytes;
+            series[kept - 1].maxBytes = std::max(series[kept - 1].maxBytes, series[i].maxBytes);
+            continue;
+        }
+        series[kept] = series[i];
+        series[kept].timestamp = start;
+        kept++;
+    }
+    series.resize(kept);
+}
+
+// Add the current footprint to the series, halving its resolution while it is full.
+static void
+RecordFootprintSample(
+    DeviceFootprint *pDevice,
+    uint64_t timestamp)
+{
+    std::vector<FootprintSample> &series = pDevice->series;
+
+    while (1)
+    {
+        uint64_t start = timestamp - timestamp % pDevice->intervalNs;
+
+        // Records of different buffers may be slightly out of order, they go to the latest sample.
+        if (!series.empty() && start <= series.back().timestamp)
+        {
+            series.back().bytes = pDevice->currentBytes;
+            series.back().maxBytes = std::max(series.back().maxBytes, pDevice->currentBytes);
+            return;
+        }
+
+        if (series.size() < MEMORY_FOOTPRINT_MAX_SAMPLES)
+        {
+            FootprintSample sample;
+            sample.timestamp = start;
+            sample.bytes = pDevice->currentBytes;
+            sample.maxBytes = pDevice->currentBytes;
+            series.push_back(sample);
+            return;
+        }
+
+        HalveFootprintSeries(pDevice);
+    }
+}
+
+static bool
+CompareAllocationSize(
+    const std::pair<uint64_t, LiveAllocation> &a,
+    const std::pair<uint64_t, LiveAllocation> &b)
+{
+    return a.second.bytes > b.second.bytes;
+}
+
+// Set pLargest to the largest live allocations, of deviceId and the device resident kinds only if deviceOnly.
+static void
+SelectLargestAllocations(
+    MemoryFootprintTracker *pTracker,
+    uint32_t deviceId,
+    bool deviceOnly,
+    std::vector<std::pair<uint64_t, LiveAllocation> > *pLargest)
+{
+    std::vector<std::pair<uint64_t, LiveAllocation> > &largest = *pLargest;
+
+    largest.clear();
+    for (std::map<uint64_t, LiveAllocation>::const_iterator it = pTracker->allocations.begin(); it != pTracker->allocations.end(); ++it)
+    {
+        if (deviceOnly && (it->second.deviceId != deviceId || !IsDeviceMemoryKind(it->second.memoryKind)))
+        {
+            continue;
+        }
+
+        // Keep the candidates few, without sorting on every allocation.
+        largest.push_back(*it);
+        if (largest.size() > 4 * MEMORY_FOOTPRINT_TOP_ALLOCATIONS)
+        {
+            std::partial_sort(largest.begin(), largest.begin() + MEMORY_FOOTPRINT_TOP_ALLOCATIONS, largest.end(), CompareAllocationSize);
+            largest.resize(MEMORY_FOOTPRINT_TOP_ALLOCATIONS);
+        }
+    }
+
+    size_t top = std::min(largest.size(), (size_t)MEMORY_FOOTPRINT_TOP_ALLOCATIONS);
+    std::partial_sort(largest.begin(), largest.begin() + top, largest.end(), CompareAllocationSize);
+    largest.resize(top);
+}
+
+// Keep the largest live allocations of the device, the footprint being at its peak.
+static void
+CaptureFootprintPeak(
+    MemoryFootprintTracker *pTracker,
+    uint32_t deviceId,
+    DeviceFootprint *pDevice)
+{
+    pDevice->peakPending = 0;
+
+    if (!pDevice->snapshot.empty() &&
+        pDevice->peakBytes < pDevice->snapshotBytes + (pDevice->snapshotBytes >> MEMORY_FOOTPRINT_SNAPSHOT_GROWTH_SHIFT))
+    {
+        return;
+    }
+
+    SelectLargestAllocations(pTracker, deviceId, true, &pDevice->snapshot);
+    pDevice->snapshotBytes = pDevice->currentBytes;
+    pDevice->snapshotTimestamp = pDevice->peakTimestamp;
+}
+
+// Remove the live allocation at it, timestamp being the time it is released.
+static void
+RemoveLiveAllocation(
+    MemoryFootprintTracker *pTracker,
+    std::map<uint64_t, LiveAllocation>::iterator it,
+    uint64_t timestamp)
+{
+    const LiveAllocation &allocation = it->second;
+    DeviceFootprint &device = GetDeviceFootprint(pTracker, allocation.deviceId);
+
+    if (IsDeviceMemoryKind(allocation.memoryKind))
+    {
+        if (device.peakPending)
+        {
+            CaptureFootprintPeak(pTracker, allocation.deviceId, &device);
+        }
+
+        device.currentBytes -= std::min(device.currentBytes, allocation.bytes);
+        RecordFootprintSample(&device, timestamp);
+    }
+
+    device.liveAllocations--;
+    pTracker->allocations.erase(it);
+}
+
+static MemoryPoolUsage &
+GetMemoryPoolUsage(
+    MemoryFootprintTracker *pTracker,
+    uint64_t address,
+    uint32_t deviceId,
+    uint8_t memoryPoolType)
+{
+    std::map<uint64_t, MemoryPoolUsage>::iterator it = pTracker->pools.find(address);
+
+    if (it == pTracker->pools.end())
+    {
+        MemoryPoolUsage pool;
+
+        memset(&pool, 0, sizeof(MemoryPoolUsage));
+        pool.deviceId = deviceId;
+        pool.memoryPoolType = memoryPoolType;
+        it = pTracker->pools.insert(std::make_pair(address, pool)).first;
+    }
+
+    return it->second;
+}
+
+static void
+UpdateMemoryPoolSize(
+    MemoryPoolUsage *pPool,
+    uint64_t size,
+    uint64_t utilizedSize)
+{
+    pPool->size = size;
+    pPool->utilizedSize = utilizedSize;
+    pPool->peakSize = std::max(pPool->peakSize, size);
+    pPool->peakUtilizedSize = std::max(pPool->peakUtilizedSize, utilizedSize);
+}
+
+static void
+AddMemoryRecord(
+    MemoryFootprintTracker *pTracker,
+    CUpti_ActivityMemory4 *pMemory)
+{
+    uint64_t poolAddress = 0;
+
+    if (pMemory->memoryPoolConfig.memoryPoolType != CUPTI_ACTIVITY_MEMORY_POOL_TYPE_INVALID)
+    {
+        poolAddress = pMemory->memoryPoolConfig.address;
+
+        MemoryPoolUsage &pool = GetMemoryPoolUsage(pTracker, poolAddress, pMemory->deviceId, (uint8_t)pMemory->memoryPoolConfig.memoryPoolType);
+        pool.releaseThreshold = pMemory->memoryPoolConfig.releaseThreshold;
+        if (pMemory->memoryPoolConfig.memoryPoolType == CUPTI_ACTIVITY_MEMORY_POOL_TYPE_LOCAL)
+        {
+            UpdateMemoryPoolSize(&pool, pMemory->memoryPoolConfig.pool.size, pMemory->memoryPoolConfig.utilizedSize);
+        }
+        if (pMemory->memoryOperationType == CUPTI_ACTIVITY_MEMORY_OPERATION_TYPE_ALLOCATION)
+        {
+            pool.numAllocations++;
+        }
+    }
+
+    if (pMemory->memoryOperationType == CUPTI_ACTIVITY_MEMORY_OPERATION_TYPE_RELEASE)
+    {
+        std::map<uint64_t, LiveAllocation>::iterator it = pTracker->allocations.find(pMemory->address);
+
+        if (it == pTracker->allocations.end())
+        {
+            pTracker->unmatchedReleases++;
+            return;
+        }
+
+        GetDeviceFootprint(pTracker, it->second.deviceId).numReleases++;
+        RemoveLiveAllocation(pTracker, it, pMemory->timestamp);
+        return;
+    }
+
+    if (pMemory->memoryOperationType != CUPTI_ACTIVITY_MEMORY_OPERATION_TYPE_ALLOCATION)
+    {
+        return;
+    }
+
+    // Live allocations overlapping the new one were released without a record.
+    uint64_t end = pMemory->address + std::max(pMemory->bytes, (uint64_t)1);
+    std::map<uint64_t, LiveAllocation>::iterator it = pTracker->allocations.lower_bound(pMemory->address);
+
+    if (it != pTracker->allocations.begin())
+    {
+        std::map<uint64_t, LiveAllocation>::iterator previous = it;
+        --previous;
+        if (previous->first + previous->second.bytes > pMemory->address)
+        {
+            it = previous;
+        }
+    }
+    while (it != pTracker->allocations.end() && it->first < end)
+    {
+        std::map<uint64_t, LiveAllocation>::iterator next = it;
+        ++next;
+        RemoveLiveAllocation(pTracker, it, pMemory->timestamp);
+        pTracker->overlappedAllocations++;
+        it = next;
+    }
+
+    LiveAllocation allocation;
+    allocation.bytes = pMemory->bytes;
+    allocation.timestamp = pMemory->timestamp;
+    allocation.pc = pMemory->PC;
+    allocation.poolAddress = poolAddress;
+    allocation.correlationId = pMemory->correlationId;
+    allocation.contextId = pMemory->contextId;
+    allocation.deviceId = pMemory->deviceId;
+    allocation.memoryKind = (uint8_t)pMemory->memoryKind;
+    pTracker->allocations.insert(std::make_pair(pMemory->address, allocation));
+
+    DeviceFootprint &device = GetDeviceFootprint(pTracker, pMemory->deviceId);
+    device.numAllocations++;
+    device.liveAllocations++;
+
+    if (IsDeviceMemoryKind(allocation.memoryKind))
+    {
+        device.currentBytes += allocation.bytes;
+        if (device.currentBytes > device.peakBytes)
+        {
+            device.peakBytes = device.currentBytes;
+            device.peakTimestamp = pMemory->timestamp;
+            device.peakPending = 1;
+        }
+        RecordFootprintSample(&device, pMemory->timestamp);
+    }
+}
+
+static void
+AddMemoryPoolRecord(
+    MemoryFootprintTracker *pTracker,
+    CUpti_ActivityMemoryPool3 *pMemoryPool)
+{
+    MemoryPoolUsage &pool = GetMemoryPoolUsage(pTracker, pMemoryPool->address, pMemoryPool->deviceId, (uint8_t)pMemoryPool->memoryPoolType);
+
+    pool.isManagedPool = (uint8_t)pMemoryPool->isManagedPool;
+    pool.releaseThreshold = pMemoryPool->releaseThreshold;
+
+    switch (pMemoryPool->memoryPoolOperationType)
+    {
+        case CUPTI_ACTIVITY_MEMORY_POOL_OPERATION_TYPE_CREATED:
+            pool.destroyed = 0;
+            UpdateMemoryPoolSize(&pool, pMemoryPool->size, pMemoryPool->utilizedSize);
+            break;
+        case CUPTI_ACTIVITY_MEMORY_POOL_OPERATION_TYPE_DESTROYED:
+            pool.destroyed = 1;
+            pool.size = 0;
+            pool.utilizedSize = 0;
+            break;
+        case CUPTI_ACTIVITY_MEMORY_POOL_OPERATION_TYPE_TRIMMED:
+            pool.numTrims++;
+            UpdateMemoryPoolSize(&pool, pMemoryPool->size, pMemoryPool->utilizedSize);
+            break;
+        default:
+            break;
+    }
+}
+
+static void
+InitMemoryFootprintTracker(
+    MemoryFootprintTracker *pTracker,
+    uint64_t intervalNs)
+{
+    pTracker->allocations.clear();
+    pTracker->devices.clear();
+    pTracker->pools.clear();
+    pTracker->intervalNs = intervalNs ? intervalNs : MEMORY_FOOTPRINT_DEFAULT_INTERVAL_NS;
+    pTracker->unmatchedReleases = 0;
+    pTracker->overlappedAllocations = 0;
+}
+
+// Feed one activity record: MEMORY2 and MEMORY_POOL records are used, other kinds are ignored.
+static void
+MemoryFootprintAddRecord(
+    MemoryFootprintTracker *pTracker,
+    CUpti_Activity *pRecord)
+{
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_MEMORY2:
+        {
+            std::lock_guard<std::mutex> lock(pTracker->mutex);
+            AddMemoryRecord(pTracker, (CUpti_ActivityMemory4 *)(void *)pRecord);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMORY_POOL:
+        {
+            std::lock_guard<std::mutex> lock(pTracker->mutex);
+            AddMemoryPoolRecord(pTracker, (CUpti_ActivityMemoryPool3 *)(void *)pRecord);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Live allocation containing address, NULL if none.
+static const LiveAllocation *
+FindLiveAllocation(
+    MemoryFootprintTracker *pTracker,
+    uint64_t address)
+{
+    std::lock_guard<std::mutex> lock(pTracker->mutex);
+    std::map<uint64_t, LiveAllocation>::const_iterator it = pTracker->allocations.upper_bound(address);
+
+    if (it == pTracker->allocations.begin())
+    {
+        return NULL;
+    }
+
+    --it;
+    return address < it->first + it->second.bytes ? &it->second : NULL;
+}
+
+static void
+PrintLiveAllocation(
+    FILE *pFile,
+    uint64_t address,
+    const LiveAllocation &allocation)
+{
+    fprintf(pFile, "    size %llu, address 0x%llx, memoryKind %s, deviceId %u, contextId %u, correlationId %u, pc 0x%llx, timestamp %llu\n",
+            (unsigned long long)allocation.bytes, (unsigned long long)address,
+            GetMemoryKindString((CUpti_ActivityMemoryKind)allocation.memoryKind),
+            allocation.deviceId, allocation.contextId, allocation.correlationId,
+            (unsigned long long)allocation.pc, (unsigned long long)allocation.timestamp);
+}
+
+// Print the footprint series and peak of every device, the memory pools and the allocations still live.
+static void
+PrintMemoryFootprintReport(
+    MemoryFootprintTracker *pTracker,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pTracker->mutex);
+
+    fprintf(pFile, "\nDevice memory footprint (DEVICE, DEVICE_STATIC, ARRAY and MANAGED memory):\n");
+
+    for (std::map<uint32_t, DeviceFootprint>::iterator it = pTracker->devices.begin(); it != pTracker->devices.end(); ++it)
+    {
+        DeviceFootprint &device = it->second;
+
+        if (device.peakPending)
+        {
+            CaptureFootprintPeak(pTracker, it->first, &device);
+        }
+
+        fprintf(pFile, "  Device %u: peak %llu bytes at [ %llu ], current %llu bytes, allocations %llu, releases %llu, live allocations %llu\n",
+                it->first, (unsigned long long)device.peakBytes, (unsigned long long)device.peakTimestamp,
+                (unsigned long long)device.currentBytes, (unsigned long long)device.numAllocations,
+                (unsigned long long)device.numReleases, (unsigned long long)device.liveAllocations);
+
+        if (!device.snapshot.empty())
+        {
+            fprintf(pFile, "  Largest allocations at [ %llu ], %llu bytes live:\n",
+                    (unsigned long long)device.snapshotTimestamp, (unsigned long long)device.snapshotBytes);
+            for (size_t i = 0; i < device.snapshot.size(); i++)
+            {
+                PrintLiveAllocation(pFile, device.snapshot[i].first, device.snapshot[i].second);
+            }
+        }
+
+        fprintf(pFile, "  Footprint over time, interval %llu ns:\n", (unsigned long long)device.intervalNs);
+        for (size_t i = 0; i < device.series.size(); i++)
+        {
+            fprintf(pFile, "    [ %llu ] bytes %llu, maxBytes %llu\n", (unsigned long long)device.series[i].timestamp,
+                    (unsigned long long)device.series[i].bytes, (unsigned long long)device.series[i].maxBytes);
+        }
+    }
+
+    if (!pTracker->pools.empty())
+    {
+        fprintf(pFile, "Memory pools:\n");
+    }
+    for (std::map<uint64_t, MemoryPoolUsage>::const_iterator it = pTracker->pools.begin(); it != pTracker->pools.end(); ++it)
+    {
+        const MemoryPoolUsage &pool = it->second;
+
+        fprintf(pFile, "  Pool 0x%llx %s, deviceId %u%s: size %llu (peak %llu), utilizedSize %llu (peak %llu), peak utilization %.1f%%,\n"
+                "    releaseThreshold %llu, allocations %llu, trims %llu%s\n",
+                (unsigned long long)it->first, GetMemoryPoolTypeString((CUpti_ActivityMemoryPoolType)pool.memoryPoolType), pool.deviceId,
+                pool.isManagedPool ? ", managed" : "",
+                (unsigned long long)pool.size, (unsigned long long)pool.peakSize,
+                (unsigned long long)pool.utilizedSize, (unsigned long long)pool.peakUtilizedSize,
+                pool.peakSize ? 100.0 * pool.peakUtilizedSize / pool.peakSize : 0.0,
+                (unsigned long long)pool.releaseThreshold, (unsigned long long)pool.numAllocations,
+                (unsigned long long)pool.numTrims, pool.destroyed ? ", destroyed" : "");
+    }
+
+    uint64_t leakedBytes = 0;
+    std::vector<std::pair<uint64_t, LiveAllocation> > leaks;
+
+    for (std::map<uint64_t, LiveAllocation>::const_iterator it = pTracker->allocations.begin(); it != pTracker->allocations.end(); ++it)
+    {
+        leakedBytes += it->second.bytes;
+    }
+    fprintf(pFile, "Leaks: %llu allocations, %llu bytes not released\n",
+            (unsigned long long)pTracker->allocations.size(), (unsigned long long)leakedBytes);
+
+    SelectLargestAllocations(pTracker, 0, false, &leaks);
+    for (size_t i = 0; i < leaks.size(); i++)
+    {
+        PrintLiveAllocation(pFile, leaks[i].first, leaks[i].second);
+    }
+
+    if (pTracker->unmatchedReleases || pTracker->overlappedAllocations)
+    {
+        fprintf(pFile, "Releases without allocation: %llu, allocations overlapped without release: %llu\n",
+                (unsigned long long)pTracker->unmatchedReleases, (unsigned long long)pTracker->overlappedAllocations);
+    }
+    fflush(pFile);
+}
+
+static void
+FreeMemoryFootprintTracker(
+    MemoryFootprintTracker *pTracker)
+{
+    std::lock_guard<std::mutex> lock(pTracker->mutex);
+
+    pTracker->allocations.clear();
+    pTracker->devices.clear();
+    pTracker->pools.clear();
+}
+
+#endif // HELPER_CUPTI_MEMORY_FOOTPRINT_H_
@@ -0,0 +1,666 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_MODULE_STORE_H_
+#define HELPER_CUPTI_MODULE_STORE_H_
+
+#pragma once
+
+// System headers
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Cubins of the loaded modules, and the cost of loading them.
+//
+// On CUPTI_CBID_RESOURCE_MODULE_LOADED the cubin is hashed with
+// cuptiGetCubinCrc(), the hash the PC sampling records carry in cubinCrc, and
+// stored once in a content-addressed directory as <cubinCrc>.cubin. The
+// callback only copies a cubin not seen before in the process, a writer thread
+// writes it: an existing file of the same size is kept, otherwise the cubin is
+// written to a temporary file renamed in place, so processes sharing the
+// directory store a cubin once and never see a partial file. The callback
+// waits for the writer only when the queued copies exceed a byte limit.
+//
+// The load and unload time is the duration of the driver API call the module
+// was loaded or unloaded in: the explicit loads (cuModuleLoad*, cuLibraryLoad*)
+// and the lazy loads triggered by a launch. Enable the driver API callbacks of
+// these functions, or the whole domain, and pass them to
+// ModuleStoreHandleDriverApi(). The JIT records give the time spent compiling
+// PTX and in the JIT cache: a compile is a JIT cache miss.
+//
+// At the end a manifest modules_<pid>.txt lists the modules of the process
+// with their cubin file.
+
+// Macros
+#define MODULE_STORE_DEFAULT_QUEUE_BYTES (256ULL * 1024 * 1024)      // Cubin copies queued before a load waits for the writer.
+#define MODULE_STORE_JIT_ENTRY_TYPES 3                               // CUpti_ActivityJitEntryType values.
+#define MODULE_STORE_JIT_OPERATION_TYPES 4                           // CUpti_ActivityJitOperationType values.
+#define MODULE_STORE_TOP_COUNT 10
+
+// Data structures
+typedef struct ModuleStoreModule_st
+{
+    uint32_t    moduleId;
+    uint32_t    contextId;
+    uint64_t    cubinCrc;
+    uint64_t    cubinSize;
+    uint64_t    loadTimestamp;                                       // At the MODULE_LOADED callback.
+    uint64_t    unloadTimestamp;                                     // At the MODULE_UNLOAD_STARTING callback, 0 if still loaded.
+    uint64_t    loadNs;                                              // Share of the driver API call it was loaded in, 0 if not traced.
+    uint32_t    loadCbid;                                            // Driver API the module was loaded in, 0 if not traced.
+} ModuleStoreModule;
+
+typedef struct ModuleStoreApiCost_st
+{
+    uint64_t    calls;                                               // Calls loading or unloading modules.
+    uint64_t    loads;
+    uint64_t    unloads;
+    uint64_t    totalNs;
+    uint64_t    maxNs;
+} ModuleStoreApiCost;
+
+typedef struct ModuleStoreJitCost_st
+{
+    uint64_t    count;
+    uint64_t    totalNs;
+    uint64_t    maxNs;
+    uint64_t    maxCacheSize;
+} ModuleStoreJitCost;
+
+typedef struct ModuleStoreWrite_st
+{
+    uint64_t             cubinCrc;
+    std::vector<uint8_t> cubin;
+} ModuleStoreWrite;
+
+// Driver API call in progress on a thread.
+typedef struct ModuleStoreApiCall_st
+{
+    uint32_t              depth;                                     // Nested driver API calls.
+    uint32_t              cbid;
+    uint64_t              start;
+    uint32_t              numUnloads;
+    std::vector<uint32_t> loadedModules;                             // Indices in ModuleStore::modules.
+} ModuleStoreApiCall;
+
+typedef struct ModuleStore_st
+{
+    std::mutex                                       mutex;          // Modules load on any thread, the writer runs on its own.
+    std::string                                      directory;      // Empty to only record the costs.
+
+    std::vector<ModuleStoreModule>                   modules;        // In load order.
+    std::unordered_map<uint32_t, size_t>             moduleIndex;    // By module id.
+    std::unordered_set<uint64_t>                     cubinCrcs;      // Cubins seen by the process.
+    uint64_t                                         uniqueBytes;
+    uint64_t                                         numUnloads;
+    uint64_t                                         callbackNs;     // Hashing and copying in the MODULE_LOADED callbacks.
+    std::unordered_map<uint32_t, ModuleStoreApiCost> apiCosts;       // By driver API cbid.
+    ModuleStoreJitCost                               jitCosts[MODULE_STORE_JIT_ENTRY_TYPES][MODULE_STORE_JIT_OPERATION_TYPES];
+
+    std::deque<ModuleStoreWrite>                     writeQueue;
+    uint64_t                                         queuedBytes;
+    uint64_t                                         maxQueuedBytes;
+    uint64_t                                         numQueueWaits;  // Loads that waited for the writer.
+    uint64_t                                         numStored;
+    uint64_t                                         numAlreadyStored; // By this or another process.
+    uint64_t                                         numWriteErrors;
+    std::thread                                      writerThread;
+    std::condition_variable                          writerCondition;
+    std::condition_variable                          spaceCondition;
+    bool                                             terminateWriter;
+    bool                                             flushed;        // Manifest written.
+} ModuleStore;
+
+// Global variables
+static thread_local ModuleStoreApiCall s_moduleStoreApiCall;
+
+// Helper Functions
+static int
+GetModuleStoreProcessId(void)
+{
+#ifdef _WIN32
+    return _getpid();
+#else
+    return (int)getpid();
+#endif
+}
+
+static std::string
+GetModuleStoreCubinPath(
+    const std::string &directory,
+    uint64_t cubinCrc)
+{
+    char fileName[32];
+    snprintf(fileName, sizeof(fileName), "%016llx.cubin", (unsigned long long)cubinCrc);
+
+    return directory + "/" + fileName;
+}
+
+// Size of the file, -1 if it does not exist.
+static int64_t
+GetModuleStoreFileSize(
+    const std::string &path)
+{
+    struct stat fileStat;
+
+    if (stat(path.c_str(), &fileStat) != 0)
+    {
+        return -1;
+    }
+
+    return (int64_t)fileStat.st_size;
+}
+
+// Write the cubin unless a file of the same size is already stored. Only called by the writer thread.
+static void
+WriteModuleStoreCubin(
+    ModuleStore *pStore,
+    const ModuleStoreWrite &write)
+{
+    std::string path = GetModuleStoreCubinPath(pStore->directory, write.cubinCrc);
+
+    if (GetModuleStoreFileSize(path) == (int64_t)write.cubin.size())
+    {
+        std::lock_guard<std::mutex> lock(pStore->mutex);
+        pStore->numAlreadyStored++;
+        return;
+    }
+
+    // A temporary file per process, renamed in place once complete.
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d.tmp", GetModuleStoreProcessId());
+    std::string temporaryPath = path + suffix;
+
+    bool written = false;
+    FILE *pFile = fopen(temporaryPath.c_str(), "wb");
+    if (pFile)
+    {
+        written = fwrite(write.cubin.data(), 1, write.cubin.size(), pFile) == write.cubin.size();
+        written = (fclose(pFile) == 0) && written;
+    }
+
+    if (written && rename(temporaryPath.c_str(), path.c_str()) == 0)
+    {
+        std::lock_guard<std::mutex> lock(pStore->mutex);
+        pStore->numStored++;
+        return;
+    }
+
+    remove(temporaryPath.c_str());
+
+    // Renaming fails on Windows when another process stored the cubin first.
+    bool stored = GetModuleStoreFileSize(path) == (int64_t)write.cubin.size();
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+    if (stored)
+    {
+        pStore->numAlreadyStored++;
+    }
+    else
+    {
+        pStore->numWriteErrors++;
+    }
+}
+
+static void
+ModuleStoreWriterThread(
+    ModuleStore *pStore)
+{
+    std::unique_lock<std::mutex> lock(pStore->mutex);
+
+    while (1)
+    {
+        pStore->writerCondition.wait(lock, [pStore]{ return pStore->terminateWriter || !pStore->writeQueue.empty(); });
+        if (pStore->writeQueue.empty())
+        {
+            // Only stops once the queue is written.
+            break;
+        }
+
+        ModuleStoreWrite write;
+        write.cubinCrc = pStore->writeQueue.front().cubinCrc;
+        write.cubin.swap(pStore->writeQueue.front().cubin);
+        pStore->writeQueue.pop_front();
+
+        lock.unlock();
+        WriteModuleStoreCubin(pStore, write);
+        lock.lock();
+
+        pStore->queuedBytes -= write.cubin.size();
+        pStore->spaceCondition.notify_all();
+    }
+}
+
+static void
+AddModuleStoreApiCost(
+    ModuleStore *pStore,
+    uint32_t cbid,
+    uint64_t durationNs,
+    uint32_t numLoads,
+    uint32_t numUnloads)
+{
+    ModuleStoreApiCost &cost = pStore->apiCosts[cbid];
+
+    cost.calls++;
+    cost.loads += numLoads;
+    cost.unloads += numUnloads;
+    cost.totalNs += durationNs;
+    cost.maxNs = std::max(cost.maxNs, durationNs);
+}
+
+// Store the cubins in pDirectory, created if needed; NULL only records the costs.
+static void
+InitModuleStore(
+    ModuleStore *pStore,
+    const char *pDirectory,
+    uint64_t maxQueuedBytes)
+{
+    pStore->directory = pDirectory ? pDirectory : "";
+    pStore->modules.clear();
+    pStore->moduleIndex.clear();
+    pStore->cubinCrcs.clear();
+    pStore->uniqueBytes = 0;
+    pStore->numUnloads = 0;
+    pStore->callbackNs = 0;
+    pStore->apiCosts.clear();
+    memset(pStore->jitCosts, 0, sizeof(pStore->jitCosts));
+    pStore->writeQueue.clear();
+    pStore->queuedBytes = 0;
+    pStore->maxQueuedBytes = maxQueuedBytes;
+    pStore->numQueueWaits = 0;
+    pStore->numStored = 0;
+    pStore->numAlreadyStored = 0;
+    pStore->numWriteErrors = 0;
+    pStore->terminateWriter = false;
+    pStore->flushed = false;
+
+    if (pStore->directory.empty())
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    int status = _mkdir(pStore->directory.c_str());
+#else
+    int status = mkdir(pStore->directory.c_str(), 0755);
+#endif
+    if (status != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "Error: Failed to create the cubin store directory %s: %s.\n", pStore->directory.c_str(), strerror(errno));
+        pStore->directory.clear();
+        return;
+    }
+
+    pStore->writerThread = std::thread(ModuleStoreWriterThread, pStore);
+}
+
+// Call on the CUPTI_CBID_RESOURCE_MODULE_LOADED and CUPTI_CBID_RESOURCE_MODULE_UNLOAD_STARTING callbacks.
+static void
+ModuleStoreHandleResource(
+    ModuleStore *pStore,
+    CUpti_CallbackId callbackId,
+    const CUpti_ResourceData *pResourceData)
+{
+    if (callbackId != CUPTI_CBID_RESOURCE_MODULE_LOADED && callbackId != CUPTI_CBID_RESOURCE_MODULE_UNLOAD_STARTING)
+    {
+        return;
+    }
+
+    CUpti_ModuleResourceData *pModuleResourceData = (CUpti_ModuleResourceData *)pResourceData->resourceDescriptor;
+    uint64_t timestamp = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&timestamp));
+
+    if (callbackId == CUPTI_CBID_RESOURCE_MODULE_UNLOAD_STARTING)
+    {
+        std::lock_guard<std::mutex> lock(pStore->mutex);
+
+        std::unordered_map<uint32_t, size_t>::const_iterator it = pStore->moduleIndex.find(pModuleResourceData->moduleId);
+        if (it != pStore->moduleIndex.end())
+        {
+            pStore->modules[it->second].unloadTimestamp = timestamp;
+        }
+        pStore->numUnloads++;
+        s_moduleStoreApiCall.numUnloads++;
+
+        return;
+    }
+
+    ModuleStoreModule module;
+    memset(&module, 0, sizeof(module));
+    module.moduleId = pModuleResourceData->moduleId;
+    module.cubinSize = pModuleResourceData->cubinSize;
+    module.loadTimestamp = timestamp;
+    cuptiGetContextId(pResourceData->context, &module.contextId);
+
+    CUpti_GetCubinCrcParams cubinCrcParams = {0};
+    cubinCrcParams.size = CUpti_GetCubinCrcParamsSize;
+    cubinCrcParams.cubinSize = pModuleResourceData->cubinSize;
+    cubinCrcParams.cubin = pModuleResourceData->pCubin;
+    CUPTI_API_CALL(cuptiGetCubinCrc(&cubinCrcParams));
+    module.cubinCrc = cubinCrcParams.cubinCrc;
+
+    bool isNewCubin;
+    {
+        std::lock_guard<std::mutex> lock(pStore->mutex);
+
+        pStore->moduleIndex[module.moduleId] = pStore->modules.size();
+        if (s_moduleStoreApiCall.depth > 0)
+        {
+            s_moduleStoreApiCall.loadedModules.push_back((uint32_t)pStore->modules.size());
+        }
+        pStore->modules.push_back(module);
+
+        isNewCubin = pStore->cubinCrcs.insert(module.cubinCrc).second;
+        if (isNewCubin)
+        {
+            pStore->uniqueBytes += module.cubinSize;
+        }
+    }
+
+    // The cubin is only valid during the callback: queue a copy for the writer.
+    if (isNewCubin && !pStore->directory.empty())
+    {
+        ModuleStoreWrite write;
+        write.cubinCrc = module.cubinCrc;
+        write.cubin.assign((const uint8_t *)pModuleResourceData->pCubin, (const uint8_t *)pModuleResourceData->pCubin + pModuleResourceData->cubinSize);
+
+        std::unique_lock<std::mutex> lock(pStore->mutex);
+        if (pStore->queuedBytes > 0 && pStore->queuedBytes + module.cubinSize > pStore->maxQueuedBytes)
+        {
+            pStore->numQueueWaits++;
+            pStore->spaceCondition.wait(lock, [pStore, &module]{ return pStore->queuedBytes == 0 || pStore->queuedBytes + module.cubinSize <= pStore->maxQueuedBytes; });
+        }
+
+        pStore->queuedBytes += module.cubinSize;
+        pStore->writeQueue.push_back(ModuleStoreWrite());
+        pStore->writeQueue.back().cubinCrc = write.cubinCrc;
+        pStore->writeQueue.back().cubin.swap(write.cubin);
+        pStore->writerCondition.notify_one();
+    }
+
+    uint64_t end = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&end));
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+    pStore->callbackNs += end - timestamp;
+}
+
+// Call on the enter and exit of the driver API callbacks loading and unloading modules, explicitly or lazily.
+static void
+ModuleStoreHandleDriverApi(
+    ModuleStore *pStore,
+    CUpti_CallbackId callbackId,
+    const CUpti_CallbackData *pCallbackData)
+{
+    ModuleStoreApiCall &call = s_moduleStoreApiCall;
+
+    if (pCallbackData->callbackSite == CUPTI_API_ENTER)
+    {
+        if (call.depth++ == 0)
+        {
+            call.cbid = (uint32_t)callbackId;
+            call.numUnloads = 0;
+            call.loadedModules.clear();
+            CUPTI_API_CALL(cuptiGetTimestamp(&call.start));
+        }
+
+        return;
+    }
+
+    if (call.depth == 0 || --call.depth > 0)
+    {
+        return;
+    }
+
+    if (call.loadedModules.empty() && call.numUnloads == 0)
+    {
+        return;
+    }
+
+    uint64_t end = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&end));
+    uint64_t durationNs = end > call.start ? end - call.start : 0;
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+
+    // Split the call between the modules it loaded.
+    for (size_t i = 0; i < call.loadedModules.size(); i++)
+    {
+        ModuleStoreModule &module = pStore->modules[call.loadedModules[i]];
+        module.loadNs = durationNs / call.loadedModules.size();
+        module.loadCbid = call.cbid;
+    }
+
+    AddModuleStoreApiCost(pStore, call.cbid, durationNs, (uint32_t)call.loadedModules.size(), call.numUnloads);
+}
+
+// Feed one activity record: the JIT records are used, other kinds are ignored.
+static void
+ModuleStoreAddRecord(
+    ModuleStore *pStore,
+    CUpti_Activity *pRecord)
+{
+    if (pRecord->kind != CUPTI_ACTIVITY_KIND_JIT)
+    {
+        return;
+    }
+
+    CUpti_ActivityJit2 *pJitRecord = (CUpti_ActivityJit2 *)pRecord;
+    uint32_t entryType = (uint32_t)pJitRecord->jitEntryType;
+    uint32_t operationType = (uint32_t)pJitRecord->jitOperationType;
+
+    if (entryType >= MODULE_STORE_JIT_ENTRY_TYPES || operationType >= MODULE_STORE_JIT_OPERATION_TYPES)
+    {
+        entryType = CUPTI_ACTIVITY_JIT_ENTRY_INVALID;
+        operationType = CUPTI_ACTIVITY_JIT_OPERATION_INVALID;
+    }
+
+    uint64_t durationNs = pJitRecord->end > pJitRecord->start ? pJitRecord->end - pJitRecord->start : 0;
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+
+    ModuleStoreJitCost &cost = pStore->jitCosts[entryType][operationType];
+    cost.count++;
+    cost.totalNs += durationNs;
+    cost.maxNs = std::max(cost.maxNs, durationNs);
+    cost.maxCacheSize = std::max(cost.maxCacheSize, (uint64_t)pJitRecord->cacheSize);
+}
+
+static const char *
+GetModuleStoreApiName(
+    uint32_t cbid)
+{
+    const char *pName = NULL;
+
+    if (cbid == 0 || cuptiGetCallbackName(CUPTI_CB_DOMAIN_DRIVER_API, cbid, &pName) != CUPTI_SUCCESS || pName == NULL)
+    {
+        return "<not traced>";
+    }
+
+    return pName;
+}
+
+static bool
+CompareModuleStoreLoadNs(
+    const ModuleStoreModule &first,
+    const ModuleStoreModule &second)
+{
+    return first.loadNs > second.loadNs;
+}
+
+// Wait for the queued cubins, then write the manifest of the modules of the process.
+static void
+FlushModuleStore(
+    ModuleStore *pStore)
+{
+    if (pStore->writerThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(pStore->mutex);
+            pStore->terminateWriter = true;
+        }
+        pStore->writerCondition.notify_all();
+        pStore->writerThread.join();
+    }
+
+    if (pStore->directory.empty() || pStore->flushed)
+    {
+        return;
+    }
+    pStore->flushed = true;
+
+    char fileName[64];
+    snprintf(fileName, sizeof(fileName), "/modules_%d.txt", GetModuleStoreProcessId());
+    std::string path = pStore->directory + fileName;
+
+    FILE *pFile = fopen(path.c_str(), "w");
+    if (!pFile)
+    {
+        fprintf(stderr, "Error: Failed to write the module manifest %s.\n", path.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+
+    fprintf(pFile, "# moduleId contextId cubinCrc cubinSize loadTimestamp unloadTimestamp loadNs loadApi\n");
+    for (size_t i = 0; i < pStore->modules.size(); i++)
+    {
+        const ModuleStoreModule &module = pStore->modules[i];
+
+        fprintf(pFile, "%u %u %016llx %llu %llu %llu %llu %s\n", module.moduleId, module.contextId, (unsigned long long)module.cubinCrc,
+                (unsigned long long)module.cubinSize, (unsigned long long)module.loadTimestamp, (unsigned long long)module.unloadTimestamp,
+                (unsigned long long)module.loadNs, GetModuleStoreApiName(module.loadCbid));
+    }
+
+    fclose(pFile);
+}
+
+// Flush the store, then print the modules stored, the load and unload cost per driver API and the JIT cost.
+static void
+PrintModuleStoreReport(
+    ModuleStore *pStore,
+    FILE *pFile)
+{
+    FlushModuleStore(pStore);
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+
+    fprintf(pFile, "\nModule store: %s, %llu modules loaded (%llu unique cubins, %llu bytes), %llu unloaded\n",
+            pStore->directory.empty() ? "<not stored>" : pStore->directory.c_str(), (unsigned long long)pStore->modules.size(),
+            (unsigned long long)pStore->cubinCrcs.size(), (unsigned long long)pStore->uniqueBytes, (unsigned long long)pStore->numUnloads);
+    if (!pStore->directory.empty())
+    {
+        fprintf(pFile, "  %llu cubins written, %llu already stored, %llu write errors, %llu loads waited for the writer\n",
+                (unsigned long long)pStore->numStored, (unsigned long long)pStore->numAlreadyStored, (unsigned long long)pStore->numWriteErrors,
+                (unsigned long long)pStore->numQueueWaits);
+    }
+    fprintf(pFile, "  %.3f ms hashing and copying in the module load callbacks, included in the load times\n", pStore->callbackNs / 1e6);
+
+    if (!pStore->apiCosts.empty())
+    {
+        std::vector<std::pair<uint32_t, ModuleStoreApiCost> > apiCosts(pStore->apiCosts.begin(), pStore->apiCosts.end());
+        std::sort(apiCosts.begin(), apiCosts.end(),
+                  [](const std::pair<uint32_t, ModuleStoreApiCost> &first, const std::pair<uint32_t, ModuleStoreApiCost> &second)
+                  { return first.second.totalNs > second.second.totalNs; });
+
+        fprintf(pFile, "Module loads and unloads by driver API:\n");
+        fprintf(pFile, "  %-32s %8s %8s %8s %12s %12s\n", "API", "Calls", "Loads", "Unloads", "Total ms", "Max ms");
+        for (size_t i = 0; i < apiCosts.size(); i++)
+        {
+            const ModuleStoreApiCost &cost = apiCosts[i].second;
+
+            fprintf(pFile, "  %-32s %8llu %8llu %8llu %12.3f %12.3f\n", GetModuleStoreApiName(apiCosts[i].first), (unsigned long long)cost.calls,
+                    (unsigned long long)cost.loads, (unsigned long long)cost.unloads, cost.totalNs / 1e6, cost.maxNs / 1e6);
+        }
+
+        std::vector<ModuleStoreModule> slowest(pStore->modules);
+        size_t count = std::min(slowest.size(), (size_t)MODULE_STORE_TOP_COUNT);
+        std::partial_sort(slowest.begin(), slowest.begin() + count, slowest.end(), CompareModuleStoreLoadNs);
+
+        fprintf(pFile, "Slowest module loads:\n");
+        fprintf(pFile, "  %8s %8s %16s %12s %10s  %s\n", "Module", "Context", "Cubin CRC", "Bytes", "Load ms", "API");
+        for (size_t i = 0; i < count && slowest[i].loadNs > 0; i++)
+        {
+            fprintf(pFile, "  %8u %8u %016llx %12llu %10.3f  %s\n", slowest[i].moduleId, slowest[i].contextId, (unsigned long long)slowest[i].cubinCrc,
+                    (unsigned long long)slowest[i].cubinSize, slowest[i].loadNs / 1e6, GetModuleStoreApiName(slowest[i].loadCbid));
+        }
+    }
+
+    bool hasJit = false;
+    for (uint32_t entryType = 0; entryType < MODULE_STORE_JIT_ENTRY_TYPES; entryType++)
+    {
+        for (uint32_t operationType = 0; operationType < MODULE_STORE_JIT_OPERATION_TYPES; operationType++)
+        {
+            const ModuleStoreJitCost &cost = pStore->jitCosts[entryType][operationType];
+            if (cost.count == 0)
+            {
+                continue;
+            }
+
+            if (!hasJit)
+            {
+                fprintf(pFile, "JIT operations (a compile is a JIT cache miss):\n");
+                fprintf(pFile, "  %-16s %-12s %8s %12s %12s %14s\n", "Entry", "Operation", "Count", "Total ms", "Max ms", "Cache bytes");
+                hasJit = true;
+            }
+
+            fprintf(pFile, "  %-16s %-12s %8llu %12.3f %12.3f %14llu\n", GetJitEntryType((CUpti_ActivityJitEntryType)entryType),
+                    GetJitOperationType((CUpti_ActivityJitOperationType)operationType), (unsigned long long)cost.count, cost.totalNs / 1e6,
+                    cost.maxNs / 1e6, (unsigned long long)cost.maxCacheSize);
+        }
+    }
+}
+
+static void
+FreeModuleStore(
+    ModuleStore *pStore)
+{
+    FlushModuleStore(pStore);
+
+    std::lock_guard<std::mutex> lock(pStore->mutex);
+
+    std::vector<ModuleStoreModule>().swap(pStore->modules);
+    std::unordered_map<uint32_t, size_t>().swap(pStore->moduleIndex);
+    std::unordered_set<uint64_t>().swap(pStore->cubinCrcs);
+    pStore->apiCosts.clear();
+    pStore->directory.clear();
+}
+
+#endif // HELPER_CUPTI_MODULE_STORE_H_
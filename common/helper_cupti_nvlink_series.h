@@ -0,0 +1,742 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_NVLINK_SERIES_H_
+#define HELPER_CUPTI_NVLINK_SERIES_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Per link NVLink throughput over time.
+//
+// The NVLINK activity records give the topology: every physical link of a
+// record connects port portDev0[i] of the first device to port portDev1[i]
+// of the second one. GPUs are identified by UUID in the records, so the
+// CUDA ordinal of every device is registered with NvLinkSeriesSetDeviceUuid()
+// before the first sample.
+//
+// The samples are the cumulative TX and RX byte counters of a port of a
+// device, read at a fixed cadence. The bytes between two samples of a link
+// are spread over the time bins the interval covers, in proportion to the
+// overlap, giving a link x time matrix of the bytes sent in each direction.
+// A counter smaller than the previous one was reset and counts from 0. The
+// matrix is allocated once for the maximum number of links and bins; when
+// a sample falls past the last bin, adjacent bins are merged and the bin
+// length doubles.
+//
+// Directions are named from the first endpoint of the link: TX is from the
+// first to the second endpoint. A link is fed by the counters of the first
+// of its endpoints sampled, the other one reads the same traffic mirrored.
+// A port sampled before its topology is known gets a link with an unknown
+// peer, so no traffic is lost.
+//
+// Nothing but the record fields and the counter values is used, so the
+// topology mapping and the rate math can be exercised on the host.
+
+// Macros
+#define NVLINK_SERIES_DEFAULT_MAX_LINKS 64
+#define NVLINK_SERIES_DEFAULT_MAX_BINS 1024
+#define NVLINK_SERIES_DEFAULT_BIN_NS (10ULL * 1000 * 1000)
+#define NVLINK_SERIES_BANDWIDTH_UNIT 1000ULL                         // The record bandwidth is in KB/s per physical link and direction.
+#define NVLINK_SERIES_NO_DEVICE (-1)
+#define NVLINK_SERIES_BUSY_PERCENT 50.0                              // Utilization of a bin for it to count as busy.
+#define NVLINK_SERIES_PRINT_COLUMNS 64
+#define NVLINK_SERIES_SHADES " .:-=+*#%@"
+
+// Data structures
+typedef struct NvLinkSeriesEndpoint_st
+{
+    CUpti_DevType type;
+    CUuuid        uuid;                                              // For a GPU.
+    int32_t       id;                                                // CUDA ordinal of a GPU once its UUID is registered, index of an NPU.
+    int32_t       port;
+} NvLinkSeriesEndpoint;
+
+typedef struct NvLinkSeriesLink_st
+{
+    NvLinkSeriesEndpoint endpoints[2];                               // Second one of type CUPTI_DEV_TYPE_INVALID while the topology is unknown.
+    uint32_t             flag;                                       // CUPTI_LINK_FLAG_* of the record.
+    uint64_t             peakBytesPerSec;                            // Per direction, 0 if unknown.
+    int32_t              sampledEndpoint;                            // Endpoint whose counters feed the link, -1 before the first sample.
+    uint64_t             lastTimestampNs;
+    uint64_t             lastTxBytes;                                // Last cumulative counters, from the first endpoint.
+    uint64_t             lastRxBytes;
+    uint64_t             totalTxBytes;
+    uint64_t             totalRxBytes;
+} NvLinkSeriesLink;
+
+typedef struct NvLinkSeries_st
+{
+    std::mutex                                 mutex;                // The topology records and the samples come from different threads.
+    uint32_t                                   maxLinks;
+    uint32_t                                   maxBins;
+    uint64_t                                   binNs;                // Doubles when the bins are merged.
+    uint32_t                                   numBins;              // Bins up to the last one holding bytes.
+    bool                                       started;
+    uint64_t                                   startNs;              // First sample.
+    uint64_t                                   endNs;                // Last sample.
+    std::vector<NvLinkSeriesLink>              links;
+    std::vector<uint64_t>                      txBytes;              // maxLinks x maxBins, bytes sent from the first endpoint.
+    std::vector<uint64_t>                      rxBytes;              // maxLinks x maxBins, bytes sent to the first endpoint.
+    std::vector<std::pair<CUuuid, int32_t> >   devices;              // UUID and CUDA ordinal of the GPUs.
+    std::map<uint64_t, uint32_t>               ports;                // GPU ordinal << 32 | port to link index.
+    uint64_t                                   numTopologyRecords;
+    uint64_t                                   numSamples;
+    uint64_t                                   numResets;            // Counters found smaller than at the previous sample.
+    uint64_t                                   numOutOfOrder;        // Samples not later than the previous one of the link, dropped.
+    uint64_t                                   numMirrored;          // Samples of the second endpoint of a link fed by the first, dropped.
+    uint64_t                                   numDroppedSamples;    // Samples of a port with no room left for its link.
+} NvLinkSeries;
+
+// Helper Functions
+static inline uint64_t
+GetNvLinkSeriesPortKey(
+    int32_t device,
+    int32_t port)
+{
+    return ((uint64_t)(uint32_t)device << 32) | (uint32_t)port;
+}
+
+// Bytes per second for bytes moved in durationNs, 0 for an empty interval.
+static inline double
+GetNvLinkSeriesRate(
+    uint64_t bytes,
+    uint64_t durationNs)
+{
+    return durationNs ? (double)bytes * 1e9 / (double)durationNs : 0.0;
+}
+
+// Bytes moved between two readings of a cumulative counter.
+static inline uint64_t
+GetNvLinkSeriesDelta(
+    uint64_t previous,
+    uint64_t current,
+    bool *pReset)
+{
+    *pReset = current < previous;
+
+    return *pReset ? current : current - previous;
+}
+
+static bool
+IsNvLinkSeriesEndpoint(
+    const NvLinkSeriesEndpoint *pEndpoint,
+    int32_t device,
+    int32_t port)
+{
+    return pEndpoint->type == CUPTI_DEV_TYPE_GPU && pEndpoint->id == device && pEndpoint->port == port;
+}
+
+static bool
+IsSameNvLinkSeriesEndpoint(
+    const NvLinkSeriesEndpoint *pA,
+    const NvLinkSeriesEndpoint *pB)
+{
+    if (pA->type != pB->type || pA->port != pB->port)
+    {
+        return false;
+    }
+
+    return pA->type == CUPTI_DEV_TYPE_GPU ? memcmp(&pA->uuid, &pB->uuid, sizeof(CUuuid)) == 0 : pA->id == pB->id;
+}
+
+// Sets the CUDA ordinal of the GPU endpoints from their UUID and indexes the ports of the GPUs.
+static void
+ResolveNvLinkSeriesEndpoints(
+    NvLinkSeries *pSeries)
+{
+    for (uint32_t i = 0; i < (uint32_t)pSeries->links.size(); i++)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            NvLinkSeriesEndpoint &endpoint = pSeries->links[i].endpoints[side];
+
+            if (endpoint.type != CUPTI_DEV_TYPE_GPU)
+            {
+                continue;
+            }
+
+            if (endpoint.id == NVLINK_SERIES_NO_DEVICE)
+            {
+                for (size_t j = 0; j < pSeries->devices.size(); j++)
+                {
+                    if (memcmp(&pSeries->devices[j].first, &endpoint.uuid, sizeof(CUuuid)) == 0)
+                    {
+                        endpoint.id = pSeries->devices[j].second;
+                        break;
+                    }
+                }
+            }
+
+            if (endpoint.id != NVLINK_SERIES_NO_DEVICE)
+            {
+                // The first link of a port keeps it.
+                pSeries->ports.insert(std::make_pair(GetNvLinkSeriesPortKey(endpoint.id, endpoint.port), i));
+            }
+        }
+    }
+}
+
+static void
+InitNvLinkSeries(
+    NvLinkSeries *pSeries,
+    uint32_t maxLinks,
+    uint32_t maxBins,
+    uint64_t binNs)
+{
+    pSeries->maxLinks = maxLinks ? maxLinks : NVLINK_SERIES_DEFAULT_MAX_LINKS;
+    pSeries->maxBins = maxBins > 1 ? maxBins : NVLINK_SERIES_DEFAULT_MAX_BINS;
+    pSeries->binNs = binNs ? binNs : NVLINK_SERIES_DEFAULT_BIN_NS;
+    pSeries->numBins = 0;
+    pSeries->started = false;
+    pSeries->startNs = 0;
+    pSeries->endNs = 0;
+    pSeries->links.clear();
+    pSeries->links.reserve(pSeries->maxLinks);
+    pSeries->txBytes.assign((size_t)pSeries->maxLinks * pSeries->maxBins, 0);
+    pSeries->rxBytes.assign((size_t)pSeries->maxLinks * pSeries->maxBins, 0);
+    pSeries->devices.clear();
+    pSeries->ports.clear();
+    pSeries->numTopologyRecords = 0;
+    pSeries->numSamples = 0;
+    pSeries->numResets = 0;
+    pSeries->numOutOfOrder = 0;
+    pSeries->numMirrored = 0;
+    pSeries->numDroppedSamples = 0;
+}
+
+static void
+NvLinkSeriesSetDeviceUuid(
+    NvLinkSeries *pSeries,
+    int32_t device,
+    const CUuuid *pUuid)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    pSeries->devices.push_back(std::make_pair(*pUuid, device));
+    ResolveNvLinkSeriesEndpoints(pSeries);
+}
+
+// Adds a link per physical link of an NVLINK record.
+static void
+NvLinkSeriesAddTopology(
+    NvLinkSeries *pSeries,
+    const CUpti_ActivityNvLink4 *pRecord)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    pSeries->numTopologyRecords++;
+
+    for (uint32_t i = 0; i < pRecord->physicalNvLinkCount && i < CUPTI_MAX_NVLINK_PORTS; i++)
+    {
+        NvLinkSeriesLink link;
+        memset(&link, 0, sizeof(link));
+
+        link.endpoints[0].type = pRecord->typeDev0;
+        link.endpoints[0].uuid = pRecord->idDev0.uuidDev;
+        link.endpoints[0].id = pRecord->typeDev0 == CUPTI_DEV_TYPE_NPU ? (int32_t)pRecord->idDev0.npu.index : NVLINK_SERIES_NO_DEVICE;
+        link.endpoints[0].port = pRecord->portDev0[i];
+        link.endpoints[1].type = pRecord->typeDev1;
+        link.endpoints[1].uuid = pRecord->idDev1.uuidDev;
+        link.endpoints[1].id = pRecord->typeDev1 == CUPTI_DEV_TYPE_NPU ? (int32_t)pRecord->idDev1.npu.index : NVLINK_SERIES_NO_DEVICE;
+        link.endpoints[1].port = pRecord->portDev1[i];
+        link.flag = pRecord->flag;
+        link.peakBytesPerSec = pRecord->bandwidth * NVLINK_SERIES_BANDWIDTH_UNIT;
+        link.sampledEndpoint = -1;
+
+        for (int side = 0; side < 2; side++)
+        {
+            NvLinkSeriesEndpoint &endpoint = link.endpoints[side];
+
+            for (size_t j = 0; endpoint.type == CUPTI_DEV_TYPE_GPU && j < pSeries->devices.size(); j++)
+            {
+                if (memcmp(&pSeries->devices[j].first, &endpoint.uuid, sizeof(CUuuid)) == 0)
+                {
+                    endpoint.id = pSeries->devices[j].second;
+                    break;
+                }
+            }
+        }
+
+        bool known = false;
+        for (size_t j = 0; j < pSeries->links.size() && !known; j++)
+        {
+            const NvLinkSeriesLink &existing = pSeries->links[j];
+
+            known = (IsSameNvLinkSeriesEndpoint(&existing.endpoints[0], &link.endpoints[0]) && IsSameNvLinkSeriesEndpoint(&existing.endpoints[1], &link.endpoints[1])) ||
+                    (IsSameNvLinkSeriesEndpoint(&existing.endpoints[0], &link.endpoints[1]) && IsSameNvLinkSeriesEndpoint(&existing.endpoints[1], &link.endpoints[0]));
+        }
+        if (known)
+        {
+            continue;
+        }
+
+        // A port already sampled without topology: complete its link, keeping the sampled port first
+        // so that the bytes already in the matrix keep their direction.
+        for (int side = 0; side < 2; side++)
+        {
+            const NvLinkSeriesEndpoint &endpoint = link.endpoints[side];
+            if (endpoint.type != CUPTI_DEV_TYPE_GPU || endpoint.id == NVLINK_SERIES_NO_DEVICE)
+            {
+                continue;
+            }
+
+            std::map<uint64_t, uint32_t>::iterator port = pSeries->ports.find(GetNvLinkSeriesPortKey(endpoint.id, endpoint.port));
+            if (port != pSeries->ports.end() && pSeries->links[port->second].endpoints[1].type == CUPTI_DEV_TYPE_INVALID)
+            {
+                NvLinkSeriesLink &existing = pSeries->links[port->second];
+
+                existing.endpoints[0] = link.endpoints[side];
+                existing.endpoints[1] = link.endpoints[1 - side];
+                existing.flag = link.flag;
+                existing.peakBytesPerSec = link.peakBytesPerSec;
+                known = true;
+                break;
+            }
+        }
+
+        if (!known && pSeries->links.size() < pSeries->maxLinks)
+        {
+            pSeries->links.push_back(link);
+        }
+    }
+
+    ResolveNvLinkSeriesEndpoints(pSeries);
+}
+
+// Merges pairs of adjacent bins, doubling the bin length.
+static void
+HalveNvLinkSeries(
+    NvLinkSeries *pSeries)
+{
+    for (size_t link = 0; link < pSeries->links.size(); link++)
+    {
+        uint64_t *pTx = &pSeries->txBytes[link * pSeries->maxBins];
+        uint64_t *pRx = &pSeries->rxBytes[link * pSeries->maxBins];
+
+        for (uint32_t bin = 0; bin < pSeries->maxBins; bin++)
+        {
+            uint32_t merged = 2 * bin;
+
+            pTx[bin] = merged < pSeries->maxBins ? pTx[merged] + (merged + 1 < pSeries->maxBins ? pTx[merged + 1] : 0) : 0;
+            pRx[bin] = merged < pSeries->maxBins ? pRx[merged] + (merged + 1 < pSeries->maxBins ? pRx[merged + 1] : 0) : 0;
+        }
+    }
+
+    pSeries->binNs *= 2;
+    pSeries->numBins = (pSeries->numBins + 1) / 2;
+}
+
+// Spreads the bytes moved over [startNs, endNs) on the bins the interval covers.
+static void
+AddNvLinkSeriesBytes(
+    NvLinkSeries *pSeries,
+    uint32_t link,
+    uint64_t startNs,
+    uint64_t endNs,
+    uint64_t txBytes,
+    uint64_t rxBytes)
+{
+    uint64_t start = startNs - pSeries->startNs;
+    uint64_t end = endNs - pSeries->startNs;
+
+    while ((end - 1) / pSeries->binNs >= pSeries->maxBins)
+    {
+        HalveNvLinkSeries(pSeries);
+    }
+
+    uint32_t firstBin = (uint32_t)(start / pSeries->binNs);
+    uint32_t lastBin = (uint32_t)((end - 1) / pSeries->binNs);
+    uint64_t *pTx = &pSeries->txBytes[(size_t)link * pSeries->maxBins];
+    uint64_t *pRx = &pSeries->rxBytes[(size_t)link * pSeries->maxBins];
+    uint64_t txLeft = txBytes;
+    uint64_t rxLeft = rxBytes;
+
+    for (uint32_t bin = firstBin; bin < lastBin; bin++)
+    {
+        uint64_t overlap = std::min(end, (uint64_t)(bin + 1) * pSeries->binNs) - std::max(start, (uint64_t)bin * pSeries->binNs);
+        double share = (double)overlap / (double)(end - start);
+        uint64_t tx = std::min(txLeft, (uint64_t)((double)txBytes * share));
+        uint64_t rx = std::min(rxLeft, (uint64_t)((double)rxBytes * share));
+
+        pTx[bin] += tx;
+        pRx[bin] += rx;
+        txLeft -= tx;
+        rxLeft -= rx;
+    }
+
+    // The last bin gets the rounding remainder, so no byte is lost.
+    pTx[lastBin] += txLeft;
+    pRx[lastBin] += rxLeft;
+    pSeries->numBins = std::max(pSeries->numBins, lastBin + 1);
+}
+
+// Adds a reading of the cumulative counters of a port of a device.
+static void
+NvLinkSeriesAddSample(
+    NvLinkSeries *pSeries,
+    int32_t device,
+    int32_t port,
+    uint64_t timestampNs,
+    uint64_t txBytes,
+    uint64_t rxBytes)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    pSeries->numSamples++;
+
+    uint32_t index;
+    std::map<uint64_t, uint32_t>::const_iterator it = pSeries->ports.find(GetNvLinkSeriesPortKey(device, port));
+    if (it != pSeries->ports.end())
+    {
+        index = it->second;
+    }
+    else if (pSeries->links.size() < pSeries->maxLinks)
+    {
+        NvLinkSeriesLink link;
+        memset(&link, 0, sizeof(link));
+
+        link.endpoints[0].type = CUPTI_DEV_TYPE_GPU;
+        link.endpoints[0].id = device;
+        link.endpoints[0].port = port;
+        link.endpoints[1].type = CUPTI_DEV_TYPE_INVALID;
+        link.endpoints[1].id = NVLINK_SERIES_NO_DEVICE;
+        link.endpoints[1].port = -1;
+        link.sampledEndpoint = -1;
+
+        index = (uint32_t)pSeries->links.size();
+        pSeries->links.push_back(link);
+        pSeries->ports[GetNvLinkSeriesPortKey(device, port)] = index;
+    }
+    else
+    {
+        pSeries->numDroppedSamples++;
+        return;
+    }
+
+    NvLinkSeriesLink &link = pSeries->links[index];
+    int32_t side = IsNvLinkSeriesEndpoint(&link.endpoints[0], device, port) ? 0 : 1;
+
+    if (link.sampledEndpoint != -1 && link.sampledEndpoint != side)
+    {
+        pSeries->numMirrored++;
+        return;
+    }
+
+    // Counters of the second endpoint read the traffic of the first one mirrored.
+    if (side == 1)
+    {
+        std::swap(txBytes, rxBytes);
+    }
+
+    if (!pSeries->started)
+    {
+        pSeries->started = true;
+        pSeries->startNs = timestampNs;
+    }
+
+    // The first sample of a link is the base of its counters.
+    if (link.sampledEndpoint == -1)
+    {
+        link.sampledEndpoint = side;
+        link.lastTimestampNs = std::max(timestampNs, pSeries->startNs);
+        link.lastTxBytes = txBytes;
+        link.lastRxBytes = rxBytes;
+        pSeries->endNs = std::max(pSeries->endNs, link.lastTimestampNs);
+        return;
+    }
+
+    if (timestampNs <= link.lastTimestampNs)
+    {
+        pSeries->numOutOfOrder++;
+        return;
+    }
+
+    bool txReset = false;
+    bool rxReset = false;
+    uint64_t tx = GetNvLinkSeriesDelta(link.lastTxBytes, txBytes, &txReset);
+    uint64_t rx = GetNvLinkSeriesDelta(link.lastRxBytes, rxBytes, &rxReset);
+
+    if (txReset || rxReset)
+    {
+        pSeries->numResets++;
+    }
+
+    AddNvLinkSeriesBytes(pSeries, index, link.lastTimestampNs, timestampNs, tx, rx);
+
+    link.totalTxBytes += tx;
+    link.totalRxBytes += rx;
+    link.lastTimestampNs = timestampNs;
+    link.lastTxBytes = txBytes;
+    link.lastRxBytes = rxBytes;
+    pSeries->endNs = std::max(pSeries->endNs, timestampNs);
+}
+
+// For pPostProcessActivityRecords: the NVLINK records give the topology.
+static void
+NvLinkSeriesAddRecord(
+    NvLinkSeries *pSeries,
+    CUpti_Activity *pRecord)
+{
+    if (pRecord->kind == CUPTI_ACTIVITY_KIND_NVLINK)
+    {
+        NvLinkSeriesAddTopology(pSeries, (CUpti_ActivityNvLink4 *)pRecord);
+    }
+}
+
+// Time covered by the bins [firstBin, lastBin), the last bin ends at the last sample.
+static uint64_t
+GetNvLinkSeriesCoveredNs(
+    const NvLinkSeries *pSeries,
+    uint32_t firstBin,
+    uint32_t lastBin)
+{
+    uint64_t start = (uint64_t)firstBin * pSeries->binNs;
+    uint64_t end = std::min((uint64_t)lastBin * pSeries->binNs, pSeries->endNs - pSeries->startNs);
+
+    return end > start ? end - start : 0;
+}
+
+static void
+FormatNvLinkSeriesEndpoint(
+    const NvLinkSeriesEndpoint *pEndpoint,
+    char *pBuffer,
+    size_t size)
+{
+    if (pEndpoint->type == CUPTI_DEV_TYPE_INVALID)
+    {
+        snprintf(pBuffer, size, "?");
+    }
+    else if (pEndpoint->id == NVLINK_SERIES_NO_DEVICE)
+    {
+        snprintf(pBuffer, size, "%s ?:%d", pEndpoint->type == CUPTI_DEV_TYPE_GPU ? "GPU" : "NPU", pEndpoint->port);
+    }
+    else
+    {
+        snprintf(pBuffer, size, "%s %d:%d", pEndpoint->type == CUPTI_DEV_TYPE_GPU ? "GPU" : "NPU", pEndpoint->id, pEndpoint->port);
+    }
+}
+
+static void
+PrintNvLinkSeriesRow(
+    FILE *pFile,
+    const NvLinkSeries *pSeries,
+    uint32_t index,
+    int direction)
+{
+    const NvLinkSeriesLink &link = pSeries->links[index];
+    const uint64_t *pBytes = &(direction == 0 ? pSeries->txBytes : pSeries->rxBytes)[(size_t)index * pSeries->maxBins];
+    uint64_t total = direction == 0 ? link.totalTxBytes : link.totalRxBytes;
+    char source[32];
+    char destination[32];
+    char endpoints[72];
+    double peakRate = 0.0;
+    uint32_t busyBins = 0;
+
+    FormatNvLinkSeriesEndpoint(&link.endpoints[direction], source, sizeof(source));
+    FormatNvLinkSeriesEndpoint(&link.endpoints[1 - direction], destination, sizeof(destination));
+    snprintf(endpoints, sizeof(endpoints), "%s -> %s", source, destination);
+
+    for (uint32_t bin = 0; bin < pSeries->numBins; bin++)
+    {
+        double rate = GetNvLinkSeriesRate(pBytes[bin], GetNvLinkSeriesCoveredNs(pSeries, bin, bin + 1));
+
+        peakRate = std::max(peakRate, rate);
+        if (link.peakBytesPerSec && rate * 100.0 >= NVLINK_SERIES_BUSY_PERCENT * (double)link.peakBytesPerSec)
+        {
+            busyBins++;
+        }
+    }
+
+    double averageRate = GetNvLinkSeriesRate(total, GetNvLinkSeriesCoveredNs(pSeries, 0, pSeries->numBins));
+
+    fprintf(pFile, "  %4u %s  %-28s %9.2f %10.1f %9.2f %9.2f", index, direction == 0 ? "TX" : "RX", endpoints,
+            (double)link.peakBytesPerSec / 1e9, (double)total / (1024.0 * 1024.0), averageRate / 1e9, peakRate / 1e9);
+    if (link.peakBytesPerSec)
+    {
+        fprintf(pFile, " %6.1f %6.1f %5u/%u\n", averageRate * 100.0 / (double)link.peakBytesPerSec,
+                peakRate * 100.0 / (double)link.peakBytesPerSec, busyBins, pSeries->numBins);
+    }
+    else
+    {
+        fprintf(pFile, " %6s %6s %7s\n", "-", "-", "-");
+    }
+}
+
+// Prints one character per column, the shade of the utilization of the link,
+// or of the throughput relative to the busiest column if the peak is unknown.
+static void
+PrintNvLinkSeriesStrip(
+    FILE *pFile,
+    const NvLinkSeries *pSeries,
+    uint32_t index,
+    int direction,
+    uint32_t binsPerColumn)
+{
+    const NvLinkSeriesLink &link = pSeries->links[index];
+    const uint64_t *pBytes = &(direction == 0 ? pSeries->txBytes : pSeries->rxBytes)[(size_t)index * pSeries->maxBins];
+    const char *pShades = NVLINK_SERIES_SHADES;
+    const int numShades = (int)strlen(NVLINK_SERIES_SHADES);
+    double rates[NVLINK_SERIES_PRINT_COLUMNS];
+    uint32_t numColumns = 0;
+    double scale = (double)link.peakBytesPerSec;
+
+    for (uint32_t bin = 0; bin < pSeries->numBins && numColumns < NVLINK_SERIES_PRINT_COLUMNS; bin += binsPerColumn, numColumns++)
+    {
+        uint32_t last = std::min(bin + binsPerColumn, pSeries->numBins);
+        uint64_t bytes = 0;
+
+        for (uint32_t j = bin; j < last; j++)
+        {
+            bytes += pBytes[j];
+        }
+        rates[numColumns] = GetNvLinkSeriesRate(bytes, GetNvLinkSeriesCoveredNs(pSeries, bin, last));
+        if (!link.peakBytesPerSec)
+        {
+            scale = std::max(scale, rates[numColumns]);
+        }
+    }
+
+    fprintf(pFile, "  %4u %s |", index, direction == 0 ? "TX" : "RX");
+    for (uint32_t column = 0; column < numColumns; column++)
+    {
+        int shade = scale > 0.0 ? (int)(rates[column] / scale * (numShades - 1) + 0.5) : 0;
+        fputc(pShades[std::min(std::max(shade, 0), numShades - 1)], pFile);
+    }
+    fprintf(pFile, "|%s\n", link.peakBytesPerSec ? "" : " relative");
+}
+
+static void
+PrintNvLinkSeriesReport(
+    NvLinkSeries *pSeries,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    fprintf(pFile, "\nNVLink throughput: %llu topology records, %u links, %llu samples, %u bins of %.3f ms over %.3f s\n",
+            (unsigned long long)pSeries->numTopologyRecords, (uint32_t)pSeries->links.size(),
+            (unsigned long long)pSeries->numSamples, pSeries->numBins, (double)pSeries->binNs / 1e6,
+            (double)(pSeries->endNs - pSeries->startNs) / 1e9);
+    if (pSeries->numResets || pSeries->numOutOfOrder || pSeries->numMirrored || pSeries->numDroppedSamples)
+    {
+        fprintf(pFile, "  counter resets %llu, out of order samples %llu, mirrored samples %llu, samples without room for their link %llu\n",
+                (unsigned long long)pSeries->numResets, (unsigned long long)pSeries->numOutOfOrder,
+                (unsigned long long)pSeries->numMirrored, (unsigned long long)pSeries->numDroppedSamples);
+    }
+
+    if (pSeries->numBins == 0)
+    {
+        fprintf(pFile, "  No NVLink traffic sampled.\n");
+        return;
+    }
+
+    fprintf(pFile, "Per link utilization, busy bins above %.0f%% of the peak:\n", NVLINK_SERIES_BUSY_PERCENT);
+    fprintf(pFile, "  %4s %-2s  %-28s %9s %10s %9s %9s %6s %6s %7s\n", "Link", "", "Endpoints (device:port)",
+            "Peak GB/s", "Total MB", "Avg GB/s", "Max GB/s", "Avg %", "Max %", "Busy");
+    for (uint32_t index = 0; index < (uint32_t)pSeries->links.size(); index++)
+    {
+        if (pSeries->links[index].sampledEndpoint == -1)
+        {
+            continue;
+        }
+        PrintNvLinkSeriesRow(pFile, pSeries, index, 0);
+        PrintNvLinkSeriesRow(pFile, pSeries, index, 1);
+    }
+
+    uint32_t binsPerColumn = (pSeries->numBins + NVLINK_SERIES_PRINT_COLUMNS - 1) / NVLINK_SERIES_PRINT_COLUMNS;
+
+    fprintf(pFile, "Utilization over time, %.3f ms per column, \"%s\" from 0 to 100%% of the peak:\n",
+            (double)(binsPerColumn * pSeries->binNs) / 1e6, NVLINK_SERIES_SHADES);
+    for (uint32_t index = 0; index < (uint32_t)pSeries->links.size(); index++)
+    {
+        if (pSeries->links[index].sampledEndpoint == -1)
+        {
+            continue;
+        }
+        PrintNvLinkSeriesStrip(pFile, pSeries, index, 0, binsPerColumn);
+        PrintNvLinkSeriesStrip(pFile, pSeries, index, 1, binsPerColumn);
+    }
+}
+
+// Writes the link x time matrix, one row per link and direction, one column of bytes per second per bin.
+static void
+WriteNvLinkSeriesCsv(
+    NvLinkSeries *pSeries,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    fprintf(pFile, "link,direction,source,destination,peak_bytes_per_sec");
+    for (uint32_t bin = 0; bin < pSeries->numBins; bin++)
+    {
+        fprintf(pFile, ",%llu", (unsigned long long)(bin * pSeries->binNs));
+    }
+    fprintf(pFile, "\n");
+
+    for (uint32_t index = 0; index < (uint32_t)pSeries->links.size(); index++)
+    {
+        const NvLinkSeriesLink &link = pSeries->links[index];
+
+        if (link.sampledEndpoint == -1)
+        {
+            continue;
+        }
+
+        for (int direction = 0; direction < 2; direction++)
+        {
+            const uint64_t *pBytes = &(direction == 0 ? pSeries->txBytes : pSeries->rxBytes)[(size_t)index * pSeries->maxBins];
+            char source[32];
+            char destination[32];
+
+            FormatNvLinkSeriesEndpoint(&link.endpoints[direction], source, sizeof(source));
+            FormatNvLinkSeriesEndpoint(&link.endpoints[1 - direction], destination, sizeof(destination));
+            fprintf(pFile, "%u,%s,%s,%s,%llu", index, direction == 0 ? "tx" : "rx", source, destination,
+                    (unsigned long long)link.peakBytesPerSec);
+            for (uint32_t bin = 0; bin < pSeries->numBins; bin++)
+            {
+                fprintf(pFile, ",%.0f", GetNvLinkSeriesRate(pBytes[bin], GetNvLinkSeriesCoveredNs(pSeries, bin, bin + 1)));
+            }
+            fprintf(pFile, "\n");
+        }
+    }
+}
+
+static void
+FreeNvLinkSeries(
+    NvLinkSeries *pSeries)
+{
+    std::lock_guard<std::mutex> lock(pSeries->mutex);
+
+    std::vector<NvLinkSeriesLink>().swap(pSeries->links);
+    std::vector<uint64_t>().swap(pSeries->txBytes);
+    std::vector<uint64_t>().swap(pSeries->rxBytes);
+    std::vector<std::pair<CUuuid, int32_t> >().swap(pSeries->devices);
+    pSeries->ports.clear();
+}
+
+#endif // HELPER_CUPTI_NVLINK_SERIES_H_
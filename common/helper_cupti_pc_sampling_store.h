@@ -0,0 +1,226 @@
+/*
+ * Copyright 2020-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Circular buffers, queue and store thread of the pc_sampling_continuous
+ * sample.
+ *
+ * GetPcSamplingDataFromCupti() retrieves the PC records of a context with
+ * cuptiPCSamplingGetData() into the next free circular buffer and queues it
+ * with its context info. The store thread pops the queue and writes every
+ * buffer to the file <context id>_<g_fileName> with CuptiUtilPutPcSampData(),
+ * then hands the circular buffer back. The host-side benchmarks drive the
+ * same functions against the mock CUPTI library.
+ *
+ * Everything is static: every program including the header gets its own
+ * buffers and queue.
+ */
+
+#ifndef HELPER_CUPTI_PC_SAMPLING_STORE_H_
+#define HELPER_CUPTI_PC_SAMPLING_STORE_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <chrono>
+
+// CUPTI headers
+#include <cupti_pcsampling_util.h>
+#include <cupti_pcsampling.h>
+#include "helper_cupti.h"
+#include <cupti.h>
+
+// Macros
+#define THREAD_SLEEP_TIME 100 // in ms
+
+// Global structures and variables
+typedef struct ContextInfo_st
+{
+    uint32_t contextUid;
+    CUpti_PCSamplingData pcSamplingData;
+    std::vector<CUpti_PCSamplingConfigurationInfo> pcSamplingConfigurationInfo;
+    CUPTI::PcSamplingUtil::PcSamplingStallReasons pcSamplingStallReasons;
+} ContextInfo;
+
+// For multi-gpu we are preallocating buffers only for first context creation,
+// So preallocated buffer stall reason size will be equal to max stall reason for first context GPU.
+static size_t stallReasonsCount = 0;
+
+// Variables related to circular buffer.
+static std::vector<CUpti_PCSamplingData> g_circularBuffer;
+static std::unordered_set<char*> functions;
+static int g_put = 0;
+static int g_get = 0;
+static std::vector<bool> g_bufferEmptyTrackerArray; // true - used, false - free.
+static std::mutex g_circularBufferMutex;
+static bool g_buffersGetUtilisedFasterThanStore = false;
+static size_t g_circularbufCount = 10;
+static size_t g_circularbufSize = 500;
+
+// Variables related to thread which store data in file.
+static std::string g_fileName = "pcsampling.dat";
+static std::queue<std::pair<CUpti_PCSamplingData *, ContextInfo *>> g_pcSampDataQueue;
+static bool g_waitAtJoin = false;
+static std::mutex g_pcSampDataQueueMutex;
+static bool g_disableFileDump = false;
+
+static bool
+GetPcSamplingDataFromCupti(
+    CUpti_PCSamplingGetDataParams &pcSamplingGetDataParams,
+    ContextInfo *pContextInfo)
+{
+    CUpti_PCSamplingData *pPcSamplingData = NULL;
+
+    g_circularBufferMutex.lock();
+    while (g_bufferEmptyTrackerArray[g_put])
+    {
+        g_buffersGetUtilisedFasterThanStore = true;
+    }
+
+    pcSamplingGetDataParams.pcSamplingData = (void *)&g_circularBuffer[g_put];
+    pPcSamplingData = &g_circularBuffer[g_put];
+
+    if (!g_disableFileDump)
+    {
+        g_bufferEmptyTrackerArray[g_put] = true;
+        g_put = (g_put + 1) % g_circularbufCount;
+    }
+    g_circularBufferMutex.unlock();
+
+    CUptiResult cuptiStatus = cuptiPCSamplingGetData(&pcSamplingGetDataParams);
+    if (cuptiStatus != CUPTI_SUCCESS)
+    {
+        CUpti_PCSamplingData *samplingData = (CUpti_PCSamplingData*)pcSamplingGetDataParams.pcSamplingData;
+        if (samplingData->hardwareBufferFull)
+        {
+            printf("ERROR!! hardware buffer is full, need to increase hardware buffer size or frequency of pc sample data decoding\n");
+            return false;
+        }
+    }
+
+    if (!g_disableFileDump)
+    {
+        g_pcSampDataQueueMutex.lock();
+        g_pcSampDataQueue.push(std::make_pair(pPcSamplingData, pContextInfo));
+        g_pcSampDataQueueMutex.unlock();
+    }
+
+    return true;
+}
+
+static void
+StorePcSampDataInFile()
+{
+    // The size macro names the params type unqualified.
+    using CUPTI::PcSamplingUtil::CUptiUtil_PutPcSampDataParams;
+    CUPTI::PcSamplingUtil::CUptiUtilResult utilResult;
+    ContextInfo *pContextInfo;
+    CUpti_PCSamplingData *pcSamplingData;
+
+    g_pcSampDataQueueMutex.lock();
+    pcSamplingData = g_pcSampDataQueue.front().first;
+    pContextInfo = g_pcSampDataQueue.front().second;
+    g_pcSampDataQueue.pop();
+    g_pcSampDataQueueMutex.unlock();
+
+    std::string file = std::to_string((long int)pContextInfo->contextUid) + "_" + g_fileName;
+
+    CUptiUtil_PutPcSampDataParams pPutPcSampDataParams = {};
+    pPutPcSampDataParams.size = CUptiUtil_PutPcSampDataParamsSize;
+    pPutPcSampDataParams.bufferType = CUPTI::PcSamplingUtil::PC_SAMPLING_BUFFER_PC_TO_COUNTER_DATA;
+    pPutPcSampDataParams.pSamplingData = (void*)pcSamplingData;
+    pPutPcSampDataParams.numAttributes = pContextInfo->pcSamplingConfigurationInfo.size();
+    pPutPcSampDataParams.pPCSamplingConfigurationInfo = pContextInfo->pcSamplingConfigurationInfo.data();
+    pPutPcSampDataParams.pPcSamplingStallReasons = &pContextInfo->pcSamplingStallReasons;
+    pPutPcSampDataParams.fileName = file.c_str();
+
+    utilResult = CUPTI::PcSamplingUtil::CuptiUtilPutPcSampData(&pPutPcSampDataParams);
+    if (utilResult != CUPTI::PcSamplingUtil::CUPTI_UTIL_SUCCESS)
+    {
+        std::cout << "error in StorePcSampDataInFile(), failed with error : " << utilResult << std::endl;
+        exit (EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < pcSamplingData->totalNumPcs; i++)
+    {
+        functions.insert(pcSamplingData->pPcData[i].functionName);
+    }
+    g_bufferEmptyTrackerArray[g_get] = false;
+    g_get = (g_get + 1) % g_circularbufCount;
+}
+
+static void
+StorePcSampDataInFileThread()
+{
+    while (1)
+    {
+        if (g_waitAtJoin)
+        {
+            while (!g_pcSampDataQueue.empty())
+            {
+                StorePcSampDataInFile();
+            }
+            break;
+        }
+        else
+        {
+            while (!g_pcSampDataQueue.empty())
+            {
+                StorePcSampDataInFile();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(THREAD_SLEEP_TIME));
+        }
+    }
+}
+
+static void
+PreallocateBuffersForRecords()
+{
+    for (size_t buffers = 0; buffers < g_circularbufCount; buffers++)
+    {
+        g_circularBuffer[buffers].size = sizeof(CUpti_PCSamplingData);
+        g_circularBuffer[buffers].collectNumPcs = g_circularbufSize;
+        g_circularBuffer[buffers].pPcData = (CUpti_PCSamplingPCData *)malloc(g_circularBuffer[buffers].collectNumPcs * sizeof(CUpti_PCSamplingPCData));
+        MEMORY_ALLOCATION_CALL(g_circularBuffer[buffers].pPcData);
+        for (size_t i = 0; i < g_circularBuffer[buffers].collectNumPcs; i++)
+        {
+            g_circularBuffer[buffers].pPcData[i].stallReason = (CUpti_PCSamplingStallReason *)malloc(stallReasonsCount * sizeof(CUpti_PCSamplingStallReason));
+            MEMORY_ALLOCATION_CALL(g_circularBuffer[buffers].pPcData[i].stallReason);
+        }
+    }
+}
+
+// Free the function names of the stored buffers, CUPTI allocates them for the caller.
+static void
+FreeStoredFunctionNames()
+{
+    for (auto it = functions.begin(); it != functions.end(); ++it)
+    {
+        free(*it);
+    }
+    functions.clear();
+}
+
+static void
+FreeCircularBuffers()
+{
+    for (size_t buffers = 0; buffers < g_circularbufCount; buffers++)
+    {
+        for (size_t i = 0; i < g_circularBuffer[buffers].collectNumPcs; i++)
+        {
+            free(g_circularBuffer[buffers].pPcData[i].stallReason);
+        }
+
+        free(g_circularBuffer[buffers].pPcData);
+    }
+}
+
+#endif // HELPER_CUPTI_PC_SAMPLING_STORE_H_
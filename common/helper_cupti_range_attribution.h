@@ -0,0 +1,509 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_RANGE_ATTRIBUTION_H_
+#define HELPER_CUPTI_RANGE_ATTRIBUTION_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_correlation.h"
+
+// Attribution of the kernel GPU time to the NVTX ranges of the thread that
+// launched the kernel.
+//
+// The MARKER records rebuild the ranges of every thread: a range started on a
+// thread is nested in the ranges open on that thread at the time, which gives
+// its path ("training_step/forward/attention"). Push/pop and start/end ranges
+// are handled the same way, a range is closed by the END record with its id,
+// whichever thread ends it. A kernel is joined with its runtime or driver API
+// record by correlation id (helper_cupti_correlation.h), and its duration is
+// added to the innermost range open on the launching thread at the API start.
+//
+// Records are consumed as the buffers arrive. Closed ranges are kept only as
+// long as the join can still match an API call made inside them, and the
+// ranges of a thread are capped, the oldest being dropped first.
+
+// Macros
+#define RANGE_ATTRIBUTION_ROOT 0                                     // Node of the kernels launched outside of any range.
+#define RANGE_ATTRIBUTION_OPEN_END UINT64_MAX
+#define RANGE_ATTRIBUTION_DEFAULT_JOIN_CAPACITY 65536
+#define RANGE_ATTRIBUTION_DEFAULT_MAX_AGE_NS (10ULL * 1000 * 1000 * 1000)
+#define RANGE_ATTRIBUTION_DEFAULT_MAX_RANGES 4096                    // Per thread, open and closed.
+#define RANGE_ATTRIBUTION_MAX_NODES 65536
+#define RANGE_ATTRIBUTION_MIN_COMPACTION 64
+
+// Data structures
+
+// A distinct range path, the child of parent named name.
+typedef struct RangeNode_st
+{
+    uint32_t    parent;                                              // Index of the parent node, the root is its own parent.
+    std::string name;
+    uint64_t    selfNs;                                              // GPU time of the kernels launched in this range and no child.
+    uint64_t    selfKernels;
+    uint64_t    totalNs;                                             // Including the children, computed by the report.
+    uint64_t    totalKernels;
+} RangeNode;
+
+// A range instance on a thread.
+typedef struct RangeInterval_st
+{
+    uint64_t start;
+    uint64_t end;                                                    // RANGE_ATTRIBUTION_OPEN_END while open.
+    uint64_t id;                                                     // Marker id of the range.
+    uint32_t node;
+} RangeInterval;
+
+typedef struct RangeThread_st
+{
+    std::vector<RangeInterval> intervals;                            // In start order.
+    size_t                     compactAt;                            // Size which triggers the next removal of the expired ranges.
+} RangeThread;
+
+typedef struct RangeAttribution_st
+{
+    std::mutex                                        mutex;         // The buffers can be completed by several threads.
+    std::vector<RangeNode>                            nodes;
+    std::map<std::pair<uint32_t, std::string>, uint32_t> nodeIndex;  // Node of (parent, name).
+    std::unordered_map<uint64_t, RangeThread>         threads;       // By process id << 32 | thread id.
+    std::unordered_map<uint64_t, uint64_t>            openRanges;    // Thread of the open ranges, by marker id.
+    CorrelationJoin                                   join;
+    uint64_t                                          maxAgeNs;      // Closed ranges are kept that long after the latest API start.
+    uint32_t                                          maxRanges;     // Ranges kept per thread.
+
+    uint64_t                                          totalNs;       // GPU time of all the kernels.
+    uint64_t                                          totalKernels;
+    uint64_t                                          unjoinedNs;    // GPU time of the kernels without API record.
+    uint64_t                                          unjoinedKernels;
+    uint64_t                                          droppedRanges; // Ranges dropped by the per thread limit.
+    uint64_t                                          mergedRanges;  // Ranges merged into their parent, RANGE_ATTRIBUTION_MAX_NODES being reached.
+    uint64_t                                          unknownEnds;   // END records of a range not seen or dropped.
+} RangeAttribution;
+
+// Helper Functions
+static inline uint64_t
+GetRangeThreadKey(
+    uint32_t processId,
+    uint32_t threadId)
+{
+    return ((uint64_t)processId << 32) | threadId;
+}
+
+static uint32_t
+GetRangeNode(
+    RangeAttribution *pAttribution,
+    uint32_t parent,
+    const char *pName)
+{
+    std::pair<uint32_t, std::string> key(parent, pName ? pName : "<unnamed>");
+    std::map<std::pair<uint32_t, std::string>, uint32_t>::iterator it = pAttribution->nodeIndex.find(key);
+
+    if (it != pAttribution->nodeIndex.end())
+    {
+        return it->second;
+    }
+
+    if (pAttribution->nodes.size() >= RANGE_ATTRIBUTION_MAX_NODES)
+    {
+        pAttribution->mergedRanges++;
+        return parent;
+    }
+
+    RangeNode node;
+    node.parent = parent;
+    node.name = key.second;
+    node.selfNs = 0;
+    node.selfKernels = 0;
+    node.totalNs = 0;
+    node.totalKernels = 0;
+    pAttribution->nodes.push_back(node);
+    pAttribution->nodeIndex[key] = (uint32_t)(pAttribution->nodes.size() - 1);
+
+    return (uint32_t)(pAttribution->nodes.size() - 1);
+}
+
+// Remove the closed ranges no API call can be joined with anymore, then the oldest ranges if above the limit.
+static void
+CompactRangeThread(
+    RangeAttribution *pAttribution,
+    RangeThread *pThread)
+{
+    uint64_t latest = pAttribution->join.latestTimestamp;
+    std::vector<RangeInterval> &intervals = pThread->intervals;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < intervals.size(); i++)
+    {
+        const RangeInterval &interval = intervals[i];
+
+        if (interval.end != RANGE_ATTRIBUTION_OPEN_END &&
+            interval.end + pAttribution->maxAgeNs < latest)
+        {
+            continue;
+        }
+        intervals[kept++] = interval;
+    }
+    intervals.resize(kept);
+
+    if (intervals.size() > pAttribution->maxRanges)
+    {
+        // Down to three quarters of the limit, so the next ranges do not compact the thread again one by one.
+        size_t excess = intervals.size() - pAttribution->maxRanges * 3 / 4;
+
+        for (size_t i = 0; i < excess; i++)
+        {
+            if (intervals[i].end == RANGE_ATTRIBUTION_OPEN_END)
+            {
+                pAttribution->openRanges.erase(intervals[i].id);
+            }
+        }
+        intervals.erase(intervals.begin(), intervals.begin() + excess);
+        pAttribution->droppedRanges += excess;
+    }
+
+    // Amortized over the ranges added in between, without letting the thread exceed the limit.
+    pThread->compactAt = std::min(std::max((size_t)RANGE_ATTRIBUTION_MIN_COMPACTION, intervals.size() * 2),
+                                  (size_t)pAttribution->maxRanges + 1);
+}
+
+static void
+AddRangeMarker(
+    RangeAttribution *pAttribution,
+    CUpti_ActivityMarker2 *pMarker)
+{
+    if (pMarker->flags & CUPTI_ACTIVITY_FLAG_MARKER_START)
+    {
+        uint64_t threadKey = GetRangeThreadKey(pMarker->objectId.pt.processId, pMarker->objectId.pt.threadId);
+        RangeThread &thread = pAttribution->threads[threadKey];
+        uint32_t parent = RANGE_ATTRIBUTION_ROOT;
+
+        // Nested in the innermost range still open on the thread.
+        for (size_t i = thread.intervals.size(); i > 0; i--)
+        {
+            if (thread.intervals[i - 1].end == RANGE_ATTRIBUTION_OPEN_END)
+            {
+                parent = thread.intervals[i - 1].node;
+                break;
+            }
+        }
+
+        RangeInterval interval;
+        interval.start = pMarker->timestamp;
+        interval.end = RANGE_ATTRIBUTION_OPEN_END;
+        interval.id = pMarker->id;
+        interval.node = GetRangeNode(pAttribution, parent, pMarker->name);
+        thread.intervals.push_back(interval);
+        pAttribution->openRanges[pMarker->id] = threadKey;
+
+        if (thread.intervals.size() >= thread.compactAt)
+        {
+            CompactRangeThread(pAttribution, &thread);
+        }
+    }
+    else if (pMarker->flags & CUPTI_ACTIVITY_FLAG_MARKER_END)
+    {
+        std::unordered_map<uint64_t, uint64_t>::iterator it = pAttribution->openRanges.find(pMarker->id);
+
+        if (it == pAttribution->openRanges.end())
+        {
+            pAttribution->unknownEnds++;
+            return;
+        }
+
+        std::vector<RangeInterval> &intervals = pAttribution->threads[it->second].intervals;
+        for (size_t i = intervals.size(); i > 0; i--)
+        {
+            if (intervals[i - 1].id == pMarker->id &&
+                intervals[i - 1].end == RANGE_ATTRIBUTION_OPEN_END)
+            {
+                intervals[i - 1].end = pMarker->timestamp;
+                break;
+            }
+        }
+        pAttribution->openRanges.erase(it);
+    }
+}
+
+// Innermost range of the thread containing timestamp, RANGE_ATTRIBUTION_ROOT if none.
+static uint32_t
+FindRangeNode(
+    RangeAttribution *pAttribution,
+    uint64_t threadKey,
+    uint64_t timestamp)
+{
+    std::unordered_map<uint64_t, RangeThread>::iterator it = pAttribution->threads.find(threadKey);
+
+    if (it == pAttribution->threads.end())
+    {
+        return RANGE_ATTRIBUTION_ROOT;
+    }
+
+    // The ranges are in start order, the latest started one containing the timestamp is the innermost.
+    const std::vector<RangeInterval> &intervals = it->second.intervals;
+    for (size_t i = intervals.size(); i > 0; i--)
+    {
+        if (intervals[i - 1].start <= timestamp && timestamp <= intervals[i - 1].end)
+        {
+            return intervals[i - 1].node;
+        }
+    }
+
+    return RANGE_ATTRIBUTION_ROOT;
+}
+
+static void
+RangeAttributionMatched(
+    void *pUserData,
+    const CorrelationEntry *pEntry)
+{
+    RangeAttribution *pAttribution = (RangeAttribution *)pUserData;
+
+    if (pEntry->gpu.kind != CUPTI_ACTIVITY_KIND_KERNEL &&
+        pEntry->gpu.kind != CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL)
+    {
+        return;
+    }
+
+    uint64_t duration = pEntry->gpu.end > pEntry->gpu.start ? pEntry->gpu.end - pEntry->gpu.start : 0;
+    uint32_t node = FindRangeNode(pAttribution, GetRangeThreadKey(pEntry->api.processId, pEntry->api.threadId), pEntry->api.start);
+
+    pAttribution->nodes[node].selfNs += duration;
+    pAttribution->nodes[node].selfKernels++;
+    pAttribution->totalNs += duration;
+    pAttribution->totalKernels++;
+}
+
+static void
+RangeAttributionEvicted(
+    void *pUserData,
+    const CorrelationEntry *pEntry)
+{
+    RangeAttribution *pAttribution = (RangeAttribution *)pUserData;
+
+    // API calls without GPU work are the common case, only the kernels matter here.
+    if (!(pEntry->sides & CORRELATION_SIDE_GPU) ||
+        (pEntry->gpu.kind != CUPTI_ACTIVITY_KIND_KERNEL &&
+         pEntry->gpu.kind != CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL))
+    {
+        return;
+    }
+
+    uint64_t duration = pEntry->gpu.end > pEntry->gpu.start ? pEntry->gpu.end - pEntry->gpu.start : 0;
+
+    pAttribution->unjoinedNs += duration;
+    pAttribution->unjoinedKernels++;
+    pAttribution->totalNs += duration;
+    pAttribution->totalKernels++;
+}
+
+static void
+InitRangeAttribution(
+    RangeAttribution *pAttribution,
+    uint32_t joinCapacity,
+    uint64_t maxAgeNs,
+    uint32_t maxRanges)
+{
+    pAttribution->nodes.clear();
+    pAttribution->nodeIndex.clear();
+    pAttribution->threads.clear();
+    pAttribution->openRanges.clear();
+    pAttribution->maxAgeNs = maxAgeNs;
+    pAttribution->maxRanges = maxRanges;
+    pAttribution->totalNs = 0;
+    pAttribution->totalKernels = 0;
+    pAttribution->unjoinedNs = 0;
+    pAttribution->unjoinedKernels = 0;
+    pAttribution->droppedRanges = 0;
+    pAttribution->mergedRanges = 0;
+    pAttribution->unknownEnds = 0;
+
+    RangeNode root;
+    root.parent = RANGE_ATTRIBUTION_ROOT;
+    root.name = "<no range>";
+    root.selfNs = 0;
+    root.selfKernels = 0;
+    root.totalNs = 0;
+    root.totalKernels = 0;
+    pAttribution->nodes.push_back(root);
+
+    InitCorrelationJoin(&pAttribution->join, joinCapacity, maxAgeNs, RangeAttributionMatched, RangeAttributionEvicted, pAttribution);
+}
+
+// Feed one activity record: MARKER, RUNTIME, DRIVER and kernel records are used, other kinds are ignored.
+static void
+RangeAttributionAddRecord(
+    RangeAttribution *pAttribution,
+    CUpti_Activity *pRecord)
+{
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_MARKER:
+        {
+            std::lock_guard<std::mutex> lock(pAttribution->mutex);
+            AddRangeMarker(pAttribution, (CUpti_ActivityMarker2 *)pRecord);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            std::lock_guard<std::mutex> lock(pAttribution->mutex);
+            CorrelationJoinAddRecord(&pAttribution->join, pRecord);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static std::string
+GetRangePath(
+    const RangeAttribution *pAttribution,
+    uint32_t node)
+{
+    std::string path = pAttribution->nodes[node].name;
+
+    while (pAttribution->nodes[node].parent != RANGE_ATTRIBUTION_ROOT)
+    {
+        node = pAttribution->nodes[node].parent;
+        path = pAttribution->nodes[node].name + "/" + path;
+    }
+
+    return path;
+}
+
+static void
+PrintRangeLine(
+    FILE *pFile,
+    uint64_t totalNs,
+    uint64_t rangeNs,
+    uint64_t selfNs,
+    uint64_t kernels,
+    const char *pPath)
+{
+    double percentScale = totalNs ? 100.0 / totalNs : 0.0;
+
+    fprintf(pFile, "%6.1f%% %6.1f%% %16llu %10llu  %s\n", rangeNs * percentScale, selfNs * percentScale,
+            (unsigned long long)rangeNs, (unsigned long long)kernels, pPath);
+}
+
+static void
+PrintRangeNode(
+    const RangeAttribution *pAttribution,
+    const std::vector<std::vector<uint32_t> > &children,
+    uint32_t node,
+    FILE *pFile)
+{
+    const RangeNode &range = pAttribution->nodes[node];
+
+    PrintRangeLine(pFile, pAttribution->totalNs, range.totalNs, range.selfNs, range.totalKernels, GetRangePath(pAttribution, node).c_str());
+
+    for (size_t i = 0; i < children[node].size(); i++)
+    {
+        PrintRangeNode(pAttribution, children, children[node][i], pFile);
+    }
+}
+
+// Join what is still in flight and print the GPU time of every range path, the children sorted by GPU time.
+static void
+PrintRangeAttribution(
+    RangeAttribution *pAttribution,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pAttribution->mutex);
+    std::vector<RangeNode> &nodes = pAttribution->nodes;
+    std::vector<std::vector<uint32_t> > children(nodes.size());
+
+    CorrelationJoinFlush(&pAttribution->join);
+
+    // A parent is always created before its children.
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i].totalNs = nodes[i].selfNs;
+        nodes[i].totalKernels = nodes[i].selfKernels;
+    }
+    for (size_t i = nodes.size() - 1; i > 0; i--)
+    {
+        if (nodes[i].parent != RANGE_ATTRIBUTION_ROOT)
+        {
+            nodes[nodes[i].parent].totalNs += nodes[i].totalNs;
+            nodes[nodes[i].parent].totalKernels += nodes[i].totalKernels;
+        }
+        children[nodes[i].parent].push_back((uint32_t)i);
+    }
+    for (size_t i = 0; i < children.size(); i++)
+    {
+        std::sort(children[i].begin(), children[i].end(),
+                  [&nodes](uint32_t a, uint32_t b) { return nodes[a].totalNs > nodes[b].totalNs; });
+    }
+
+    fprintf(pFile, "\nNVTX range attribution: %llu kernels, %llu ns of kernel GPU time\n",
+            (unsigned long long)pAttribution->totalKernels, (unsigned long long)pAttribution->totalNs);
+    fprintf(pFile, "  Total    Self         GPU (ns)    Kernels  Range\n");
+
+    for (size_t i = 0; i < children[RANGE_ATTRIBUTION_ROOT].size(); i++)
+    {
+        PrintRangeNode(pAttribution, children, children[RANGE_ATTRIBUTION_ROOT][i], pFile);
+    }
+
+    if (nodes[RANGE_ATTRIBUTION_ROOT].selfKernels)
+    {
+        const RangeNode &root = nodes[RANGE_ATTRIBUTION_ROOT];
+        PrintRangeLine(pFile, pAttribution->totalNs, root.selfNs, root.selfNs, root.selfKernels, root.name.c_str());
+    }
+
+    if (pAttribution->unjoinedKernels)
+    {
+        PrintRangeLine(pFile, pAttribution->totalNs, pAttribution->unjoinedNs, pAttribution->unjoinedNs, pAttribution->unjoinedKernels, "<launch not found>");
+    }
+
+    if (pAttribution->droppedRanges || pAttribution->mergedRanges || pAttribution->unknownEnds)
+    {
+        fprintf(pFile, "Ranges dropped (per thread limit): %llu, merged into their parent: %llu, unknown range ends: %llu\n",
+                (unsigned long long)pAttribution->droppedRanges, (unsigned long long)pAttribution->mergedRanges,
+                (unsigned long long)pAttribution->unknownEnds);
+    }
+    fflush(pFile);
+}
+
+static void
+FreeRangeAttribution(
+    RangeAttribution *pAttribution)
+{
+    std::lock_guard<std::mutex> lock(pAttribution->mutex);
+
+    FreeCorrelationJoin(&pAttribution->join);
+    pAttribution->nodes.clear();
+    pAttribution->nodeIndex.clear();
+    pAttribution->threads.clear();
+    pAttribution->openRanges.clear();
+}
+
+#endif // HELPER_CUPTI_RANGE_ATTRIBUTION_H_
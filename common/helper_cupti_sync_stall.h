@@ -0,0 +1,902 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_SYNC_STALL_H_
+#define HELPER_CUPTI_SYNC_STALL_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Attribution of the time host threads block in CUDA synchronizations to the
+// GPU work they wait for.
+//
+// A SYNCHRONIZATION record gives the blocked interval and what is waited
+// for: a stream, an event or the whole context. Its correlation id gives
+// the API call, hence the blocked thread, and the CUDA_EVENT records give
+// the stream an event was recorded on, matched by cudaEventSyncId (or by
+// the latest record of the event if the sync ids are not available). The
+// stream wait event records are not blocking the host, they are the edges
+// of the cross-stream dependency graph: the waiting stream depends on the
+// stream of the event.
+//
+// A stall waits for the work of its streams, and through the wait edges
+// issued before the stall ended, for the work of the streams they depend
+// on, up to SYNC_STALL_MAX_UPSTREAM_DEPTH hops. Every instant of the stall
+// is split evenly between the kernels, memcpys and memsets running on these
+// streams at that instant, so the blocked time adds up exactly, and the
+// instants where none of them runs are reported as not covered (the
+// synchronization overhead, or work that was not traced).
+//
+// The records arrive in any order, so the attribution is done by the report
+// from bounded lists of the stalls and of the activities of every stream.
+
+// Macros
+#define SYNC_STALL_INVALID 0xFFFFFFFFu                               // CUPTI_SYNCHRONIZATION_INVALID_VALUE.
+#define SYNC_STALL_API_CACHE_SIZE (1 << 14)                          // API records kept by correlation id, direct mapped.
+#define SYNC_STALL_MAX_PENDING (1 << 16)                             // Synchronizations waiting for their API record.
+#define SYNC_STALL_MAX_STALLS (1 << 18)                              // Synchronizations kept for the attribution.
+#define SYNC_STALL_MAX_ACTIVITIES (1 << 20)                          // GPU activities kept for the attribution.
+#define SYNC_STALL_MAX_EVENTS (1 << 18)                              // Event records kept to resolve the stream of an event.
+#define SYNC_STALL_MAX_NAMES 4096                                    // Further names are counted under "<other>".
+#define SYNC_STALL_MAX_UPSTREAM_DEPTH 4
+#define SYNC_STALL_NUM_TYPES 5                                       // CUpti_ActivitySynchronizationType values.
+#define SYNC_STALL_TOP_COUNT 10
+
+// Data structures
+
+// API call of a synchronization, from a RUNTIME or DRIVER record.
+typedef struct SyncStallApi_st
+{
+    uint32_t correlationId;
+    uint32_t cbid;
+    uint32_t processId;
+    uint32_t threadId;
+    uint8_t  kind;                                                   // RUNTIME or DRIVER, 0 if unknown.
+} SyncStallApi;
+
+typedef struct SyncStall_st
+{
+    uint64_t     start;
+    uint64_t     end;
+    uint64_t     eventSyncId;
+    uint32_t     contextId;
+    uint32_t     streamId;                                           // Stream synchronized, or waiting for the event.
+    uint32_t     eventId;
+    uint8_t      type;                                               // CUpti_ActivitySynchronizationType.
+    SyncStallApi api;
+} SyncStall;
+
+typedef struct SyncStallActivity_st
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t nameId;
+} SyncStallActivity;
+
+// Stream of a kernel, memcpy or memset, also the vertex of the dependency graph.
+typedef struct SyncStallStream_st
+{
+    std::vector<SyncStallActivity> activities;
+    std::vector<uint64_t>          maxEnd;                           // Latest end of the activities up to each one, once sorted.
+    double                         directNs;                         // Blocked time waiting for this stream.
+    double                         upstreamNs;                       // Blocked time waiting for it through wait edges.
+} SyncStallStream;
+
+// A blocking call site: the thread, the API and the stream, event stream or context waited for.
+typedef struct SyncStallSiteKey_st
+{
+    uint64_t target;                                                 // contextId << 32 | streamId, SYNC_STALL_INVALID stream for a context.
+    uint32_t type;
+    uint32_t cbid;
+    uint32_t apiKind;
+    uint32_t processId;
+    uint32_t threadId;
+    uint32_t pad;
+
+    bool operator<(const SyncStallSiteKey_st &other) const
+    {
+        return memcmp(this, &other, sizeof(SyncStallSiteKey_st)) < 0;
+    }
+} SyncStallSiteKey;
+
+typedef struct SyncStallSite_st
+{
+    uint64_t                     count;
+    uint64_t                     blockedNs;
+    uint64_t                     maxNs;
+    double                       uncoveredNs;
+    std::map<uint32_t, double>   waitedNs;                           // By name id.
+} SyncStallSite;
+
+typedef struct SyncStallAnalyzer_st
+{
+    std::mutex                                              mutex;   // The buffers can be completed by several threads.
+    std::vector<SyncStallApi>                               apiCache;
+    std::unordered_map<uint32_t, size_t>                    pending; // Correlation id to index in stalls.
+    std::vector<SyncStall>                                  stalls;
+    std::map<uint64_t, SyncStallStream>                     streams; // By contextId << 32 | streamId.
+    std::map<std::pair<uint64_t, uint64_t>, uint32_t>       events;  // (contextId << 32 | eventId, cudaEventSyncId) to stream.
+    std::map<uint64_t, uint32_t>                            latestEvents; // contextId << 32 | eventId to stream of its latest record.
+    std::vector<std::string>                                names;
+    std::unordered_map<std::string, uint32_t>               nameIds;
+    uint64_t                                                numActivities;
+    uint64_t                                                numSynchronizations[SYNC_STALL_NUM_TYPES];
+    uint64_t                                                blockedNs[SYNC_STALL_NUM_TYPES];
+    uint64_t                                                numDroppedStalls;
+    uint64_t                                                numDroppedActivities;
+    uint64_t                                                numDroppedEvents;
+} SyncStallAnalyzer;
+
+// Helper Functions
+static inline uint64_t
+GetSyncStallStreamKey(
+    uint32_t contextId,
+    uint32_t streamId)
+{
+    return ((uint64_t)contextId << 32) | streamId;
+}
+
+static inline bool
+IsSyncStallBlocking(
+    uint8_t type)
+{
+    return type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_EVENT_SYNCHRONIZE ||
+           type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_SYNCHRONIZE ||
+           type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_CONTEXT_SYNCHRONIZE;
+}
+
+static uint32_t
+GetSyncStallNameId(
+    SyncStallAnalyzer *pAnalyzer,
+    const std::string &name)
+{
+    std::unordered_map<std::string, uint32_t>::const_iterator it = pAnalyzer->nameIds.find(name);
+    if (it != pAnalyzer->nameIds.end())
+    {
+        return it->second;
+    }
+
+    if (pAnalyzer->names.size() >= SYNC_STALL_MAX_NAMES)
+    {
+        return GetSyncStallNameId(pAnalyzer, "<other>");
+    }
+
+    uint32_t nameId = (uint32_t)pAnalyzer->names.size();
+    pAnalyzer->names.push_back(name);
+    pAnalyzer->nameIds[name] = nameId;
+
+    return nameId;
+}
+
+static void
+AddSyncStallActivity(
+    SyncStallAnalyzer *pAnalyzer,
+    uint32_t contextId,
+    uint32_t streamId,
+    uint64_t start,
+    uint64_t end,
+    const std::string &name)
+{
+    if (pAnalyzer->numActivities >= SYNC_STALL_MAX_ACTIVITIES)
+    {
+        pAnalyzer->numDroppedActivities++;
+        return;
+    }
+
+    SyncStallActivity activity;
+    activity.start = start;
+    activity.end = end;
+    activity.nameId = GetSyncStallNameId(pAnalyzer, name);
+
+    SyncStallStream &stream = pAnalyzer->streams[GetSyncStallStreamKey(contextId, streamId)];
+    stream.activities.push_back(activity);
+    pAnalyzer->numActivities++;
+}
+
+static void
+AddSyncStallApi(
+    SyncStallAnalyzer *pAnalyzer,
+    const CUpti_ActivityAPI *pApiRecord)
+{
+    SyncStallApi api;
+    api.correlationId = pApiRecord->correlationId;
+    api.cbid = pApiRecord->cbid;
+    api.processId = pApiRecord->processId;
+    api.threadId = pApiRecord->threadId;
+    api.kind = (uint8_t)pApiRecord->kind;
+
+    std::unordered_map<uint32_t, size_t>::iterator pending = pAnalyzer->pending.find(api.correlationId);
+    if (pending != pAnalyzer->pending.end())
+    {
+        SyncStallApi &stallApi = pAnalyzer->stalls[pending->second].api;
+
+        // A runtime API and the driver API it calls share the correlation id, prefer the runtime API.
+        if (!stallApi.kind || api.kind == CUPTI_ACTIVITY_KIND_RUNTIME)
+        {
+            stallApi = api;
+        }
+        if (api.kind == CUPTI_ACTIVITY_KIND_RUNTIME)
+        {
+            pAnalyzer->pending.erase(pending);
+        }
+    }
+
+    SyncStallApi &slot = pAnalyzer->apiCache[api.correlationId & (SYNC_STALL_API_CACHE_SIZE - 1)];
+    if (slot.correlationId != api.correlationId || slot.kind != CUPTI_ACTIVITY_KIND_RUNTIME)
+    {
+        slot = api;
+    }
+}
+
+static void
+AddSyncStall(
+    SyncStallAnalyzer *pAnalyzer,
+    const CUpti_ActivitySynchronization2 *pSynchronizationRecord)
+{
+    uint8_t type = (uint8_t)pSynchronizationRecord->type;
+
+    if (type < SYNC_STALL_NUM_TYPES)
+    {
+        pAnalyzer->numSynchronizations[type]++;
+        if (IsSyncStallBlocking(type))
+        {
+            pAnalyzer->blockedNs[type] += pSynchronizationRecord->end - pSynchronizationRecord->start;
+        }
+    }
+
+    if (pAnalyzer->stalls.size() >= SYNC_STALL_MAX_STALLS)
+    {
+        pAnalyzer->numDroppedStalls++;
+        return;
+    }
+
+    SyncStall stall;
+    memset(&stall, 0, sizeof(stall));
+    stall.start = pSynchronizationRecord->start;
+    stall.end = pSynchronizationRecord->end;
+    stall.eventSyncId = pSynchronizationRecord->cudaEventSyncId;
+    stall.contextId = pSynchronizationRecord->contextId;
+    stall.streamId = pSynchronizationRecord->streamId;
+    stall.eventId = pSynchronizationRecord->cudaEventId;
+    stall.type = type;
+
+    const SyncStallApi &slot = pAnalyzer->apiCache[pSynchronizationRecord->correlationId & (SYNC_STALL_API_CACHE_SIZE - 1)];
+    if (slot.kind && slot.correlationId == pSynchronizationRecord->correlationId)
+    {
+        stall.api = slot;
+    }
+
+    // The runtime API record may still come, e.g. in a later buffer.
+    if (slot.kind != CUPTI_ACTIVITY_KIND_RUNTIME || slot.correlationId != pSynchronizationRecord->correlationId)
+    {
+        if (pAnalyzer->pending.size() < SYNC_STALL_MAX_PENDING)
+        {
+            pAnalyzer->pending[pSynchronizationRecord->correlationId] = pAnalyzer->stalls.size();
+        }
+    }
+
+    pAnalyzer->stalls.push_back(stall);
+}
+
+// Stream an event was recorded on before being synchronized or waited for, SYNC_STALL_INVALID if unknown.
+static uint32_t
+GetSyncStallEventStream(
+    const SyncStallAnalyzer *pAnalyzer,
+    const SyncStall *pStall)
+{
+    uint64_t eventKey = GetSyncStallStreamKey(pStall->contextId, pStall->eventId);
+
+    if (pStall->eventSyncId)
+    {
+        std::map<std::pair<uint64_t, uint64_t>, uint32_t>::const_iterator it = pAnalyzer->events.find(std::make_pair(eventKey, pStall->eventSyncId));
+        if (it != pAnalyzer->events.end())
+        {
+            return it->second;
+        }
+    }
+
+    std::map<uint64_t, uint32_t>::const_iterator latest = pAnalyzer->latestEvents.find(eventKey);
+
+    return latest != pAnalyzer->latestEvents.end() ? latest->second : SYNC_STALL_INVALID;
+}
+
+static void
+InitSyncStallAnalyzer(
+    SyncStallAnalyzer *pAnalyzer)
+{
+    SyncStallApi empty;
+    memset(&empty, 0, sizeof(empty));
+
+    pAnalyzer->apiCache.assign(SYNC_STALL_API_CACHE_SIZE, empty);
+    pAnalyzer->pending.clear();
+    pAnalyzer->stalls.clear();
+    pAnalyzer->streams.clear();
+    pAnalyzer->events.clear();
+    pAnalyzer->latestEvents.clear();
+    pAnalyzer->names.clear();
+    pAnalyzer->nameIds.clear();
+    pAnalyzer->numActivities = 0;
+    memset(pAnalyzer->numSynchronizations, 0, sizeof(pAnalyzer->numSynchronizations));
+    memset(pAnalyzer->blockedNs, 0, sizeof(pAnalyzer->blockedNs));
+    pAnalyzer->numDroppedStalls = 0;
+    pAnalyzer->numDroppedActivities = 0;
+    pAnalyzer->numDroppedEvents = 0;
+}
+
+// Feed one activity record. SYNCHRONIZATION and CUDA_EVENT records, RUNTIME and DRIVER
+// records for the threads, and the kernel, memcpy and memset records are used.
+static void
+SyncStallAddRecord(
+    SyncStallAnalyzer *pAnalyzer,
+    CUpti_Activity *pRecord)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            AddSyncStallActivity(pAnalyzer, pKernelRecord->contextId, pKernelRecord->streamId, pKernelRecord->start, pKernelRecord->end,
+                                 pKernelRecord->name ? pKernelRecord->name : "<unknown>");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            AddSyncStallActivity(pAnalyzer, pMemcpyRecord->contextId, pMemcpyRecord->streamId, pMemcpyRecord->start, pMemcpyRecord->end,
+                                 std::string("[memcpy ") + GetMemcpyKindString((CUpti_ActivityMemcpyKind)pMemcpyRecord->copyKind) + "]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY2:
+        {
+            CUpti_ActivityMemcpyPtoP4 *pMemcpyPtoPRecord = (CUpti_ActivityMemcpyPtoP4 *)pRecord;
+            AddSyncStallActivity(pAnalyzer, pMemcpyPtoPRecord->contextId, pMemcpyPtoPRecord->streamId, pMemcpyPtoPRecord->start,
+                                 pMemcpyPtoPRecord->end, "[memcpy PtoP]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+            AddSyncStallActivity(pAnalyzer, pMemsetRecord->contextId, pMemsetRecord->streamId, pMemsetRecord->start, pMemsetRecord->end,
+                                 "[memset]");
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        {
+            AddSyncStallApi(pAnalyzer, (CUpti_ActivityAPI *)pRecord);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_SYNCHRONIZATION:
+        {
+            AddSyncStall(pAnalyzer, (CUpti_ActivitySynchronization2 *)pRecord);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_CUDA_EVENT:
+        {
+            CUpti_ActivityCudaEvent2 *pCudaEventRecord = (CUpti_ActivityCudaEvent2 *)pRecord;
+            uint64_t eventKey = GetSyncStallStreamKey(pCudaEventRecord->contextId, pCudaEventRecord->eventId);
+
+            pAnalyzer->latestEvents[eventKey] = pCudaEventRecord->streamId;
+            if (pAnalyzer->events.size() < SYNC_STALL_MAX_EVENTS)
+            {
+                pAnalyzer->events[std::make_pair(eventKey, (uint64_t)pCudaEventRecord->cudaEventSyncId)] = pCudaEventRecord->streamId;
+            }
+            else
+            {
+                pAnalyzer->numDroppedEvents++;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Part of the stall waiting for one activity.
+typedef struct SyncStallShare_st
+{
+    uint64_t start;                                                  // Activity clipped to the stall.
+    uint64_t end;
+    uint32_t nameId;
+    uint64_t streamKey;
+    bool     upstream;
+} SyncStallShare;
+
+// Splits every instant of [start, end) evenly between the shares running at that instant.
+// Returns the time of the interval where no share runs; pShareNs receives the time of every share.
+static uint64_t
+SplitSyncStall(
+    uint64_t start,
+    uint64_t end,
+    const std::vector<SyncStallShare> &shares,
+    std::vector<double> &shareNs)
+{
+    std::vector<std::pair<uint64_t, int> > edges;
+    edges.reserve(shares.size() * 2);
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        edges.push_back(std::make_pair(shares[i].start, 1));
+        edges.push_back(std::make_pair(shares[i].end, -1));
+    }
+    std::sort(edges.begin(), edges.end());
+
+    // weight[i] is the integral of 1 / running from start to times[i].
+    std::vector<uint64_t> times;
+    std::vector<double> weight;
+    uint64_t covered = 0;
+    uint64_t previous = start;
+    double integral = 0.0;
+    int running = 0;
+
+    times.push_back(start);
+    weight.push_back(0.0);
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        if (edges[i].first > previous)
+        {
+            if (running > 0)
+            {
+                integral += (double)(edges[i].first - previous) / running;
+                covered += edges[i].first - previous;
+            }
+            previous = edges[i].first;
+            times.push_back(previous);
+            weight.push_back(integral);
+        }
+        running += edges[i].second;
+    }
+
+    shareNs.resize(shares.size());
+    for (size_t i = 0; i < shares.size(); i++)
+    {
+        size_t first = std::lower_bound(times.begin(), times.end(), shares[i].start) - times.begin();
+        size_t last = std::lower_bound(times.begin(), times.end(), shares[i].end) - times.begin();
+        shareNs[i] = weight[last] - weight[first];
+    }
+
+    return (end - start) - covered;
+}
+
+// Adds the activities of a stream overlapping [start, end) to shares.
+static void
+CollectSyncStallShares(
+    const SyncStallStream &stream,
+    uint64_t streamKey,
+    bool upstream,
+    uint64_t start,
+    uint64_t end,
+    std::vector<SyncStallShare> &shares)
+{
+    // Activities sorted by start: the ones starting before the end of the stall, walking back while any may still run.
+    size_t i = std::lower_bound(stream.activities.begin(), stream.activities.end(), end,
+                                [](const SyncStallActivity &activity, uint64_t time) { return activity.start < time; }) - stream.activities.begin();
+    while (i > 0 && stream.maxEnd[i - 1] > start)
+    {
+        const SyncStallActivity &activity = stream.activities[--i];
+        if (activity.end > start)
+        {
+            SyncStallShare share;
+            share.start = std::max(activity.start, start);
+            share.end = std::min(activity.end, end);
+            share.nameId = activity.nameId;
+            share.streamKey = streamKey;
+            share.upstream = upstream;
+            shares.push_back(share);
+        }
+    }
+}
+
+static bool
+CompareSyncStallSites(
+    const std::pair<SyncStallSiteKey, const SyncStallSite *> &a,
+    const std::pair<SyncStallSiteKey, const SyncStallSite *> &b)
+{
+    return a.second->blockedNs > b.second->blockedNs;
+}
+
+static bool
+CompareSyncStallNames(
+    const std::pair<uint32_t, double> &a,
+    const std::pair<uint32_t, double> &b)
+{
+    return a.second > b.second;
+}
+
+static const char *
+GetSyncStallApiName(
+    const SyncStallSiteKey *pKey)
+{
+    const char *pName = NULL;
+
+    if (pKey->apiKind == CUPTI_ACTIVITY_KIND_RUNTIME)
+    {
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_RUNTIME_API, pKey->cbid, &pName);
+    }
+    else if (pKey->apiKind == CUPTI_ACTIVITY_KIND_DRIVER)
+    {
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_DRIVER_API, pKey->cbid, &pName);
+    }
+
+    return pName ? pName : "<unknown>";
+}
+
+static void
+FormatSyncStallStream(
+    uint64_t streamKey,
+    char *pBuffer,
+    size_t size)
+{
+    if ((uint32_t)streamKey == SYNC_STALL_INVALID)
+    {
+        snprintf(pBuffer, size, "ctx %u", (uint32_t)(streamKey >> 32));
+    }
+    else
+    {
+        snprintf(pBuffer, size, "ctx %u stream %u", (uint32_t)(streamKey >> 32), (uint32_t)streamKey);
+    }
+}
+
+// Attribute every stall and print the blocked time per type, thread and call site, the GPU work
+// waited for and the cross-stream dependencies.
+static void
+PrintSyncStallReport(
+    SyncStallAnalyzer *pAnalyzer,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    for (std::map<uint64_t, SyncStallStream>::iterator it = pAnalyzer->streams.begin(); it != pAnalyzer->streams.end(); ++it)
+    {
+        std::vector<SyncStallActivity> &activities = it->second.activities;
+
+        std::sort(activities.begin(), activities.end(),
+                  [](const SyncStallActivity &a, const SyncStallActivity &b) { return a.start < b.start; });
+        it->second.maxEnd.resize(activities.size());
+        for (size_t i = 0; i < activities.size(); i++)
+        {
+            it->second.maxEnd[i] = std::max(activities[i].end, i ? it->second.maxEnd[i - 1] : 0);
+        }
+        it->second.directNs = 0.0;
+        it->second.upstreamNs = 0.0;
+    }
+
+    // Wait edges: the waiting stream depends on the stream the event was recorded on.
+    std::map<uint64_t, std::vector<std::pair<uint64_t, uint64_t> > > dependencies;  // Waiting stream to (stream waited for, time of the wait).
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> edges;                         // (stream waited for, waiting stream) to waits.
+    uint64_t numUnresolvedWaits = 0;
+
+    for (size_t i = 0; i < pAnalyzer->stalls.size(); i++)
+    {
+        const SyncStall &stall = pAnalyzer->stalls[i];
+
+        if (stall.type != CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_WAIT_EVENT)
+        {
+            continue;
+        }
+
+        uint32_t eventStream = GetSyncStallEventStream(pAnalyzer, &stall);
+        if (eventStream == SYNC_STALL_INVALID)
+        {
+            numUnresolvedWaits++;
+            continue;
+        }
+
+        uint64_t producer = GetSyncStallStreamKey(stall.contextId, eventStream);
+        uint64_t consumer = GetSyncStallStreamKey(stall.contextId, stall.streamId);
+        if (producer != consumer)
+        {
+            dependencies[consumer].push_back(std::make_pair(producer, stall.start));
+            edges[std::make_pair(producer, consumer)]++;
+        }
+    }
+
+    std::map<SyncStallSiteKey, SyncStallSite> sites;
+    std::map<uint64_t, std::pair<uint64_t, uint64_t> > threads;                    // processId << 32 | threadId to count and blocked time.
+    std::map<uint32_t, double> waitedNames;
+    double uncoveredNs = 0.0;
+    uint64_t attributedNs = 0;
+    uint64_t numUnresolvedEvents = 0;
+    std::vector<SyncStallShare> shares;
+    std::vector<double> shareNs;
+
+    for (size_t i = 0; i < pAnalyzer->stalls.size(); i++)
+    {
+        const SyncStall &stall = pAnalyzer->stalls[i];
+
+        if (!IsSyncStallBlocking(stall.type) || stall.end <= stall.start)
+        {
+            continue;
+        }
+
+        // Streams waited for directly.
+        std::vector<uint64_t> direct;
+        uint64_t target = GetSyncStallStreamKey(stall.contextId, SYNC_STALL_INVALID);
+
+        if (stall.type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_SYNCHRONIZE)
+        {
+            target = GetSyncStallStreamKey(stall.contextId, stall.streamId);
+            direct.push_back(target);
+        }
+        else if (stall.type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_EVENT_SYNCHRONIZE)
+        {
+            uint32_t eventStream = GetSyncStallEventStream(pAnalyzer, &stall);
+            if (eventStream != SYNC_STALL_INVALID)
+            {
+                target = GetSyncStallStreamKey(stall.contextId, eventStream);
+                direct.push_back(target);
+            }
+            else
+            {
+                numUnresolvedEvents++;
+            }
+        }
+        else
+        {
+            std::map<uint64_t, SyncStallStream>::const_iterator it = pAnalyzer->streams.lower_bound(GetSyncStallStreamKey(stall.contextId, 0));
+            for (; it != pAnalyzer->streams.end() && (uint32_t)(it->first >> 32) == stall.contextId; ++it)
+            {
+                direct.push_back(it->first);
+            }
+        }
+
+        // Streams waited for through the wait edges issued before the end of the stall.
+        std::vector<uint64_t> upstream;
+        std::vector<uint64_t> frontier = direct;
+        for (int depth = 0; depth < SYNC_STALL_MAX_UPSTREAM_DEPTH && !frontier.empty(); depth++)
+        {
+            std::vector<uint64_t> next;
+            for (size_t j = 0; j < frontier.size(); j++)
+            {
+                std::map<uint64_t, std::vector<std::pair<uint64_t, uint64_t> > >::const_iterator it = dependencies.find(frontier[j]);
+                for (size_t k = 0; it != dependencies.end() && k < it->second.size(); k++)
+                {
+                    uint64_t producer = it->second[k].first;
+                    if (it->second[k].second <= stall.end &&
+                        std::find(direct.begin(), direct.end(), producer) == direct.end() &&
+                        std::find(upstream.begin(), upstream.end(), producer) == upstream.end())
+                    {
+                        upstream.push_back(producer);
+                        next.push_back(producer);
+                    }
+                }
+            }
+            frontier.swap(next);
+        }
+
+        shares.clear();
+        for (size_t j = 0; j < direct.size() + upstream.size(); j++)
+        {
+            bool isUpstream = j >= direct.size();
+            uint64_t key = isUpstream ? upstream[j - direct.size()] : direct[j];
+            std::map<uint64_t, SyncStallStream>::const_iterator it = pAnalyzer->streams.find(key);
+            if (it != pAnalyzer->streams.end())
+            {
+                CollectSyncStallShares(it->second, key, isUpstream, stall.start, stall.end, shares);
+            }
+        }
+
+        uint64_t uncovered = SplitSyncStall(stall.start, stall.end, shares, shareNs);
+        uint64_t duration = stall.end - stall.start;
+
+        SyncStallSiteKey siteKey;
+        memset(&siteKey, 0, sizeof(siteKey));
+        siteKey.target = target;
+        siteKey.type = stall.type;
+        siteKey.cbid = stall.api.cbid;
+        siteKey.apiKind = stall.api.kind;
+        siteKey.processId = stall.api.processId;
+        siteKey.threadId = stall.api.threadId;
+
+        SyncStallSite &site = sites[siteKey];
+        site.count++;
+        site.blockedNs += duration;
+        site.maxNs = std::max(site.maxNs, duration);
+        site.uncoveredNs += (double)uncovered;
+
+        for (size_t j = 0; j < shares.size(); j++)
+        {
+            SyncStallStream &stream = pAnalyzer->streams[shares[j].streamKey];
+
+            (shares[j].upstream ? stream.upstreamNs : stream.directNs) += shareNs[j];
+            site.waitedNs[shares[j].nameId] += shareNs[j];
+            waitedNames[shares[j].nameId] += shareNs[j];
+        }
+
+        std::pair<uint64_t, uint64_t> &thread = threads[GetSyncStallStreamKey(stall.api.processId, stall.api.threadId)];
+        thread.first++;
+        thread.second += duration;
+        uncoveredNs += (double)uncovered;
+        attributedNs += duration;
+    }
+
+    uint64_t numBlocking = 0;
+    uint64_t blockedNs = 0;
+    for (uint32_t type = 0; type < SYNC_STALL_NUM_TYPES; type++)
+    {
+        if (IsSyncStallBlocking((uint8_t)type))
+        {
+            numBlocking += pAnalyzer->numSynchronizations[type];
+            blockedNs += pAnalyzer->blockedNs[type];
+        }
+    }
+
+    fprintf(pFile, "\nSynchronization stalls: %llu host synchronizations blocked %.3f ms, %llu stream waits\n",
+            (unsigned long long)numBlocking, (double)blockedNs / 1e6,
+            (unsigned long long)pAnalyzer->numSynchronizations[CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_STREAM_WAIT_EVENT]);
+    if (pAnalyzer->numDroppedStalls || pAnalyzer->numDroppedActivities || pAnalyzer->numDroppedEvents || numUnresolvedEvents || numUnresolvedWaits)
+    {
+        fprintf(pFile, "  not attributed: %llu synchronizations and %llu activities over the limits, %llu event records dropped, "
+                "%llu event synchronizations and %llu waits on events without record\n",
+                (unsigned long long)pAnalyzer->numDroppedStalls, (unsigned long long)pAnalyzer->numDroppedActivities,
+                (unsigned long long)pAnalyzer->numDroppedEvents, (unsigned long long)numUnresolvedEvents,
+                (unsigned long long)numUnresolvedWaits);
+    }
+
+    fprintf(pFile, "  %-24s %10s %12s\n", "Type", "Count", "Blocked ms");
+    for (uint32_t type = 0; type < SYNC_STALL_NUM_TYPES; type++)
+    {
+        if (IsSyncStallBlocking((uint8_t)type))
+        {
+            fprintf(pFile, "  %-24s %10llu %12.3f\n", GetSynchronizationType((CUpti_ActivitySynchronizationType)type),
+                    (unsigned long long)pAnalyzer->numSynchronizations[type], (double)pAnalyzer->blockedNs[type] / 1e6);
+        }
+    }
+
+    if (threads.empty())
+    {
+        return;
+    }
+
+    fprintf(pFile, "Blocked time per thread:\n");
+    fprintf(pFile, "  %-24s %10s %12s\n", "Process/Thread", "Count", "Blocked ms");
+    for (std::map<uint64_t, std::pair<uint64_t, uint64_t> >::const_iterator it = threads.begin(); it != threads.end(); ++it)
+    {
+        char thread[32];
+
+        if (it->first)
+        {
+            snprintf(thread, sizeof(thread), "%u/%u", (uint32_t)(it->first >> 32), (uint32_t)it->first);
+        }
+        else
+        {
+            snprintf(thread, sizeof(thread), "<no API record>");
+        }
+        fprintf(pFile, "  %-24s %10llu %12.3f\n", thread, (unsigned long long)it->second.first, (double)it->second.second / 1e6);
+    }
+
+    std::vector<std::pair<SyncStallSiteKey, const SyncStallSite *> > topSites;
+    for (std::map<SyncStallSiteKey, SyncStallSite>::const_iterator it = sites.begin(); it != sites.end(); ++it)
+    {
+        topSites.push_back(std::make_pair(it->first, &it->second));
+    }
+    size_t top = std::min(topSites.size(), (size_t)SYNC_STALL_TOP_COUNT);
+    std::partial_sort(topSites.begin(), topSites.begin() + top, topSites.end(), CompareSyncStallSites);
+
+    fprintf(pFile, "Top blocking sync sites, with the GPU work waited for most:\n");
+    fprintf(pFile, "  %12s %8s %10s %10s  %-14s %-28s %-20s %s\n", "Blocked ms", "Count", "Avg us", "Max us", "Thread", "API", "Waiting for", "Waited on");
+    for (size_t i = 0; i < top; i++)
+    {
+        const SyncStallSiteKey &key = topSites[i].first;
+        const SyncStallSite *pSite = topSites[i].second;
+        char thread[32];
+        char target[48];
+        std::pair<uint32_t, double> waited(0, 0.0);
+
+        snprintf(thread, sizeof(thread), "%u/%u", key.processId, key.threadId);
+        if (key.type == CUPTI_ACTIVITY_SYNCHRONIZATION_TYPE_EVENT_SYNCHRONIZE && (uint32_t)key.target == SYNC_STALL_INVALID)
+        {
+            snprintf(target, sizeof(target), "ctx %u event ?", (uint32_t)(key.target >> 32));
+        }
+        else
+        {
+            FormatSyncStallStream(key.target, target, sizeof(target));
+        }
+        for (std::map<uint32_t, double>::const_iterator it = pSite->waitedNs.begin(); it != pSite->waitedNs.end(); ++it)
+        {
+            if (it->second > waited.second)
+            {
+                waited = *it;
+            }
+        }
+
+        fprintf(pFile, "  %12.3f %8llu %10.1f %10.1f  %-14s %-28s %-20s ", (double)pSite->blockedNs / 1e6, (unsigned long long)pSite->count,
+                (double)pSite->blockedNs / 1e3 / (double)pSite->count, (double)pSite->maxNs / 1e3, key.apiKind ? thread : "?",
+                GetSyncStallApiName(&key), target);
+        if (waited.second > 0.0)
+        {
+            fprintf(pFile, "%.0f%% %s\n", 100.0 * waited.second / (double)pSite->blockedNs, pAnalyzer->names[waited.first].c_str());
+        }
+        else
+        {
+            fprintf(pFile, "%s\n", "no GPU work");
+        }
+    }
+
+    fprintf(pFile, "Waited-on GPU work, the blocked time split between the activities running on the streams waited for:\n");
+    fprintf(pFile, "  %-28s %12s %14s\n", "Stream", "Direct ms", "Upstream ms");
+    for (std::map<uint64_t, SyncStallStream>::const_iterator it = pAnalyzer->streams.begin(); it != pAnalyzer->streams.end(); ++it)
+    {
+        char stream[48];
+
+        if (it->second.directNs == 0.0 && it->second.upstreamNs == 0.0)
+        {
+            continue;
+        }
+        FormatSyncStallStream(it->first, stream, sizeof(stream));
+        fprintf(pFile, "  %-28s %12.3f %14.3f\n", stream, it->second.directNs / 1e6, it->second.upstreamNs / 1e6);
+    }
+
+    std::vector<std::pair<uint32_t, double> > names(waitedNames.begin(), waitedNames.end());
+    top = std::min(names.size(), (size_t)SYNC_STALL_TOP_COUNT);
+    std::partial_sort(names.begin(), names.begin() + top, names.end(), CompareSyncStallNames);
+
+    fprintf(pFile, "  %12s %7s  %s\n", "Waited ms", "%", "Name");
+    for (size_t i = 0; i < top; i++)
+    {
+        fprintf(pFile, "  %12.3f %6.1f%%  %s\n", names[i].second / 1e6, attributedNs ? 100.0 * names[i].second / (double)attributedNs : 0.0,
+                pAnalyzer->names[names[i].first].c_str());
+    }
+    fprintf(pFile, "  %12.3f %6.1f%%  <no waited work running: synchronization overhead, or work not traced>\n", uncoveredNs / 1e6,
+            attributedNs ? 100.0 * uncoveredNs / (double)attributedNs : 0.0);
+
+    if (!edges.empty())
+    {
+        fprintf(pFile, "Cross-stream dependencies, from the stream wait event records:\n");
+        for (std::map<std::pair<uint64_t, uint64_t>, uint64_t>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+        {
+            char producer[48];
+
+            FormatSyncStallStream(it->first.first, producer, sizeof(producer));
+            fprintf(pFile, "  %-28s -> stream %u: %llu waits\n", producer, (uint32_t)it->first.second, (unsigned long long)it->second);
+        }
+    }
+}
+
+static void
+FreeSyncStallAnalyzer(
+    SyncStallAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    std::vector<SyncStallApi>().swap(pAnalyzer->apiCache);
+    pAnalyzer->pending.clear();
+    std::vector<SyncStall>().swap(pAnalyzer->stalls);
+    pAnalyzer->streams.clear();
+    pAnalyzer->events.clear();
+    pAnalyzer->latestEvents.clear();
+    std::vector<std::string>().swap(pAnalyzer->names);
+    pAnalyzer->nameIds.clear();
+}
+
+#endif // HELPER_CUPTI_SYNC_STALL_H_
@@ -0,0 +1,251 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_TRACE_FILE_H_
+#define HELPER_CUPTI_TRACE_FILE_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Binary trace file of raw CUPTI activity buffers.
+//
+// Layout: the magic, the number of buffers, then for every buffer its valid
+// size, its bytes, the number of kernel records and for each of them the
+// record offset and name. Name pointers inside the records are meaningless
+// once written and are patched on load, so the buffers read back can be
+// walked with cuptiActivityGetNextRecord() and PrintActivityBuffer() like
+// the buffers completed by CUPTI.
+
+// Macros
+#define ACTIVITY_TRACE_FILE_MAGIC "CUPTIFX1"
+
+// Helper Functions
+static bool
+WriteActivityTraceBuffer(
+    FILE *pFile,
+    uint8_t *pBuffer,
+    size_t validBytes)
+{
+    uint64_t validSize = validBytes;
+    std::vector<uint64_t> kernelOffsets;
+    CUpti_Activity *pRecord = NULL;
+
+    if (fwrite(&validSize, sizeof(validSize), 1, pFile) != 1 ||
+        fwrite(pBuffer, 1, validSize, pFile) != validSize)
+    {
+        return false;
+    }
+
+    while (cuptiActivityGetNextRecord(pBuffer, validSize, &pRecord) == CUPTI_SUCCESS)
+    {
+        if (pRecord->kind == CUPTI_ACTIVITY_KIND_KERNEL ||
+            pRecord->kind == CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL)
+        {
+            kernelOffsets.push_back((uint8_t *)pRecord - pBuffer);
+        }
+    }
+
+    uint64_t numKernels = kernelOffsets.size();
+    if (fwrite(&numKernels, sizeof(numKernels), 1, pFile) != 1)
+    {
+        return false;
+    }
+
+    for (size_t j = 0; j < kernelOffsets.size(); j++)
+    {
+        const char *pName = GetName(((CUpti_ActivityKernel10 *)(pBuffer + kernelOffsets[j]))->name);
+        uint32_t length = (uint32_t)strlen(pName);
+
+        if (fwrite(&kernelOffsets[j], sizeof(uint64_t), 1, pFile) != 1 ||
+            fwrite(&length, sizeof(length), 1, pFile) != 1 ||
+            fwrite(pName, 1, length, pFile) != length)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Write the buffers to pFileName. Returns false if the file could not be written.
+static bool
+WriteActivityTraceFile(
+    const char *pFileName,
+    const std::vector<uint8_t *> &buffers,
+    const std::vector<size_t> &validSizes)
+{
+    FILE *pFile = fopen(pFileName, "wb");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    uint64_t numBuffers = buffers.size();
+    bool success = fwrite(ACTIVITY_TRACE_FILE_MAGIC, 1, 8, pFile) == 8 &&
+                   fwrite(&numBuffers, sizeof(numBuffers), 1, pFile) == 1;
+
+    for (size_t i = 0; success && i < buffers.size(); i++)
+    {
+        success = WriteActivityTraceBuffer(pFile, buffers[i], validSizes[i]);
+    }
+
+    if (fclose(pFile) != 0)
+    {
+        success = false;
+    }
+
+    return success;
+}
+
+// Returns true if pFileName starts with the magic of a trace file.
+static bool
+IsActivityTraceFile(
+    const char *pFileName)
+{
+    FILE *pFile = fopen(pFileName, "rb");
+    char magic[8];
+
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool isTraceFile = fread(magic, 1, sizeof(magic), pFile) == sizeof(magic) &&
+                       !memcmp(magic, ACTIVITY_TRACE_FILE_MAGIC, sizeof(magic));
+    fclose(pFile);
+
+    return isTraceFile;
+}
+
+static bool
+ReadActivityTraceBytes(
+    FILE *pFile,
+    void *pDestination,
+    size_t size)
+{
+    return fread(pDestination, 1, size, pFile) == size;
+}
+
+// Append the buffers of pFileName to pBuffers and pValidSizes, the buffers are allocated with malloc().
+// The kernel names are stored in pNames, which must outlive the buffers and not be modified anymore.
+// Returns false if the file is not a trace file or is truncated.
+static bool
+ReadActivityTraceFile(
+    const char *pFileName,
+    std::vector<uint8_t *> *pBuffers,
+    std::vector<size_t> *pValidSizes,
+    std::vector<std::string> *pNames)
+{
+    FILE *pFile = fopen(pFileName, "rb");
+    char magic[8];
+    uint64_t numBuffers = 0;
+    bool success = true;
+    std::vector<std::pair<uint8_t *, size_t> > namePatches;
+
+    if (!pFile)
+    {
+        return false;
+    }
+
+    if (!ReadActivityTraceBytes(pFile, magic, sizeof(magic)) ||
+        memcmp(magic, ACTIVITY_TRACE_FILE_MAGIC, sizeof(magic)) ||
+        !ReadActivityTraceBytes(pFile, &numBuffers, sizeof(numBuffers)))
+    {
+        fclose(pFile);
+        return false;
+    }
+
+    for (uint64_t i = 0; success && i < numBuffers; i++)
+    {
+        uint64_t validSize = 0;
+        uint64_t numKernels = 0;
+        size_t numPatches = namePatches.size();
+
+        if (!ReadActivityTraceBytes(pFile, &validSize, sizeof(validSize)))
+        {
+            success = false;
+            break;
+        }
+
+        uint8_t *pBuffer = (uint8_t *)malloc(validSize + 1);
+        MEMORY_ALLOCATION_CALL(pBuffer);
+        if (!ReadActivityTraceBytes(pFile, pBuffer, validSize) ||
+            !ReadActivityTraceBytes(pFile, &numKernels, sizeof(numKernels)))
+        {
+            free(pBuffer);
+            success = false;
+            break;
+        }
+
+        for (uint64_t j = 0; success && j < numKernels; j++)
+        {
+            uint64_t offset = 0;
+            uint32_t length = 0;
+
+            if (!ReadActivityTraceBytes(pFile, &offset, sizeof(offset)) ||
+                !ReadActivityTraceBytes(pFile, &length, sizeof(length)) ||
+                offset + sizeof(CUpti_ActivityKernel10) > validSize)
+            {
+                success = false;
+                break;
+            }
+
+            std::string name(length, '\0');
+            if (length && !ReadActivityTraceBytes(pFile, &name[0], length))
+            {
+                success = false;
+                break;
+            }
+
+            pNames->push_back(name);
+            namePatches.push_back(std::make_pair(pBuffer + offset, pNames->size() - 1));
+        }
+
+        if (!success)
+        {
+            // Drop the partial buffer, keep the complete ones.
+            namePatches.resize(numPatches);
+            free(pBuffer);
+            break;
+        }
+
+        pBuffers->push_back(pBuffer);
+        pValidSizes->push_back(validSize);
+    }
+
+    fclose(pFile);
+
+    // Patch once all the names are loaded, the vector does not move them anymore.
+    for (size_t i = 0; i < namePatches.size(); i++)
+    {
+        ((CUpti_ActivityKernel10 *)namePatches[i].first)->name = (*pNames)[namePatches[i].second].c_str();
+    }
+
+    return success;
+}
+
+#endif // HELPER_CUPTI_TRACE_FILE_H_
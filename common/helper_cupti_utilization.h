@@ -0,0 +1,670 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_UTILIZATION_H_
+#define HELPER_CUPTI_UTILIZATION_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Device and stream utilization from the kernel, memcpy and memset records.
+//
+// The GPU intervals are swept in start order per device: the sweep keeps the
+// ends of the intervals in flight, and accounts every segment between two
+// events to the busy time, the kernel, copy and memset time, the time copies
+// overlap kernels and the time with N kernels in flight. The segments without
+// any interval in flight after the first one are the idle gaps, kept as a log2
+// histogram, and the largest ones with the API calls which started just before
+// they ended (the RUNTIME, DRIVER and SYNCHRONIZATION records).
+//
+// The records of a buffer complete out of order with the records of the other
+// buffers, so the intervals wait in a heap until the latest start seen is
+// reorderNs past them. An interval starting before the sweep position
+// (arriving later than the reorder window) is clipped to it and counted as
+// late. The heap and the API history are bounded, the heap is swept early
+// when full.
+
+// Macros
+#define UTILIZATION_DEFAULT_REORDER_NS (500ULL * 1000 * 1000)
+#define UTILIZATION_DEFAULT_LARGE_GAP_NS (100ULL * 1000)
+#define UTILIZATION_MAX_PENDING (1 << 20)                            // Intervals waiting for the sweep.
+#define UTILIZATION_MAX_CONCURRENCY 32                               // Last bucket of the concurrency histogram is 32 or more kernels.
+#define UTILIZATION_GAP_BUCKETS 40                                   // Bucket i holds the gaps of [2^i, 2^(i+1)) ns.
+#define UTILIZATION_TOP_GAPS 10
+#define UTILIZATION_GAP_API_CALLS 4                                  // API calls kept per gap, the latest started before its end.
+#define UTILIZATION_MAX_API_HISTORY (1 << 16)
+
+// Data structures
+typedef enum
+{
+    UTILIZATION_CLASS_KERNEL = 0,
+    UTILIZATION_CLASS_COPY   = 1,
+    UTILIZATION_CLASS_MEMSET = 2,
+    UTILIZATION_CLASS_COUNT  = 3
+} UtilizationClass;
+
+typedef struct UtilizationInterval_st
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t deviceId;
+    uint32_t streamId;
+    uint8_t  workClass;                                              // UtilizationClass.
+} UtilizationInterval;
+
+typedef struct UtilizationApiCall_st
+{
+    uint64_t start;
+    uint64_t end;
+    uint32_t threadId;                                               // 0 for the synchronization records.
+    uint32_t id;                                                     // cbid, or CUpti_ActivitySynchronizationType.
+    uint8_t  kind;                                                   // RUNTIME, DRIVER or SYNCHRONIZATION.
+} UtilizationApiCall;
+
+typedef struct UtilizationGap_st
+{
+    uint64_t           start;
+    uint64_t           end;
+    uint32_t           deviceId;
+    uint32_t           numApiCalls;
+    UtilizationApiCall apiCalls[UTILIZATION_GAP_API_CALLS];          // Latest started first.
+} UtilizationGap;
+
+typedef struct UtilizationDevice_st
+{
+    // Sweep state.
+    std::priority_queue<std::pair<uint64_t, uint8_t>, std::vector<std::pair<uint64_t, uint8_t> >,
+                        std::greater<std::pair<uint64_t, uint8_t> > > inFlight; // (end, class) of the intervals in flight.
+    uint32_t numInFlight[UTILIZATION_CLASS_COUNT];
+    uint64_t position;                                               // Time accounted up to.
+    uint64_t idleSince;                                              // End of the last interval in flight, when none is.
+    bool     started;
+
+    // Statistics.
+    uint64_t firstStart;
+    uint64_t lastEnd;
+    uint64_t numIntervals[UTILIZATION_CLASS_COUNT];
+    uint64_t busyNs;                                                 // Any interval in flight.
+    uint64_t classNs[UTILIZATION_CLASS_COUNT];                       // At least one interval of the class in flight.
+    uint64_t overlapNs;                                              // Copies in flight with kernels.
+    uint64_t concurrencyNs[UTILIZATION_MAX_CONCURRENCY + 1];         // Busy time by number of kernels in flight.
+    uint64_t gapCount[UTILIZATION_GAP_BUCKETS];
+    uint64_t numGaps;
+    uint64_t gapNs;
+} UtilizationDevice;
+
+typedef struct UtilizationStream_st
+{
+    uint64_t coveredUntil;                                           // End of the union of the swept intervals.
+    uint64_t busyNs;
+    uint64_t numIntervals;
+    uint64_t firstStart;
+    uint64_t lastEnd;
+} UtilizationStream;
+
+typedef struct UtilizationAnalyzer_st
+{
+    std::mutex                                     mutex;            // The buffers can be completed by several threads.
+    uint64_t                                       reorderNs;
+    uint64_t                                       largeGapNs;       // Gaps kept with their API calls from this length.
+    std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t> >,
+                        std::greater<std::pair<uint64_t, size_t> > > pending; // (start, index in intervals).
+    std::vector<UtilizationInterval>               intervals;        // Pending intervals, by index.
+    std::vector<size_t>                            freeIntervals;    // Indices of intervals already swept.
+    uint64_t                                       latestStart;
+    uint64_t                                       sweepPosition;    // Start of the last swept interval.
+    std::map<uint32_t, UtilizationDevice>          devices;
+    std::unordered_map<uint64_t, UtilizationStream> streams;         // By deviceId << 32 | streamId.
+    std::multimap<uint64_t, UtilizationApiCall>    apiCalls;         // By start.
+    std::vector<UtilizationGap>                    largestGaps;      // Min heap on the length, UTILIZATION_TOP_GAPS at most.
+    uint64_t                                       lateRecords;      // Started before the sweep position, clipped.
+    uint64_t                                       droppedRecords;   // Ended before the sweep position, or without end.
+} UtilizationAnalyzer;
+
+// Helper Functions
+static inline bool
+IsLargerUtilizationGap(
+    const UtilizationGap &first,
+    const UtilizationGap &second)
+{
+    // Comparator of the min heap: the shortest gap on top.
+    return first.end - first.start > second.end - second.start;
+}
+
+static void
+AccountUtilizationSegment(
+    UtilizationDevice *pDevice,
+    uint64_t time)
+{
+    if (time <= pDevice->position)
+    {
+        return;
+    }
+
+    uint64_t duration = time - pDevice->position;
+    uint32_t numKernels = pDevice->numInFlight[UTILIZATION_CLASS_KERNEL];
+    bool busy = false;
+
+    for (int i = 0; i < UTILIZATION_CLASS_COUNT; i++)
+    {
+        if (pDevice->numInFlight[i])
+        {
+            pDevice->classNs[i] += duration;
+            busy = true;
+        }
+    }
+
+    if (busy)
+    {
+        pDevice->busyNs += duration;
+        pDevice->concurrencyNs[std::min(numKernels, (uint32_t)UTILIZATION_MAX_CONCURRENCY)] += duration;
+
+        if (numKernels && pDevice->numInFlight[UTILIZATION_CLASS_COPY])
+        {
+            pDevice->overlapNs += duration;
+        }
+    }
+
+    pDevice->position = time;
+}
+
+// Account the device up to time, retiring the intervals ending before.
+static void
+AdvanceUtilizationDevice(
+    UtilizationDevice *pDevice,
+    uint64_t time)
+{
+    while (!pDevice->inFlight.empty() && pDevice->inFlight.top().first <= time)
+    {
+        std::pair<uint64_t, uint8_t> top = pDevice->inFlight.top();
+
+        AccountUtilizationSegment(pDevice, top.first);
+        pDevice->inFlight.pop();
+        pDevice->numInFlight[top.second]--;
+
+        if (pDevice->inFlight.empty())
+        {
+            pDevice->idleSince = top.first;
+        }
+    }
+
+    AccountUtilizationSegment(pDevice, time);
+}
+
+static void
+RecordUtilizationGap(
+    UtilizationAnalyzer *pAnalyzer,
+    UtilizationDevice *pDevice,
+    uint32_t deviceId,
+    uint64_t start,
+    uint64_t end)
+{
+    uint64_t length = end - start;
+    uint32_t bucket = 0;
+
+    while (bucket + 1 < UTILIZATION_GAP_BUCKETS && (length >> (bucket + 1)))
+    {
+        bucket++;
+    }
+
+    pDevice->gapCount[bucket]++;
+    pDevice->numGaps++;
+    pDevice->gapNs += length;
+
+    if (length < pAnalyzer->largeGapNs)
+    {
+        return;
+    }
+
+    std::vector<UtilizationGap> &gaps = pAnalyzer->largestGaps;
+    if (gaps.size() == UTILIZATION_TOP_GAPS && length <= gaps.front().end - gaps.front().start)
+    {
+        return;
+    }
+
+    UtilizationGap gap;
+    memset(&gap, 0, sizeof(UtilizationGap));
+    gap.start = start;
+    gap.end = end;
+    gap.deviceId = deviceId;
+
+    // The API calls started before the end of the gap: what the host did while the device was idle.
+    std::multimap<uint64_t, UtilizationApiCall>::const_iterator it = pAnalyzer->apiCalls.lower_bound(end);
+    while (gap.numApiCalls < UTILIZATION_GAP_API_CALLS && it != pAnalyzer->apiCalls.begin())
+    {
+        --it;
+        gap.apiCalls[gap.numApiCalls++] = it->second;
+    }
+
+    if (gaps.size() == UTILIZATION_TOP_GAPS)
+    {
+        std::pop_heap(gaps.begin(), gaps.end(), IsLargerUtilizationGap);
+        gaps.pop_back();
+    }
+    gaps.push_back(gap);
+    std::push_heap(gaps.begin(), gaps.end(), IsLargerUtilizationGap);
+}
+
+static void
+SweepUtilizationInterval(
+    UtilizationAnalyzer *pAnalyzer,
+    const UtilizationInterval *pInterval)
+{
+    UtilizationDevice &device = pAnalyzer->devices[pInterval->deviceId];
+
+    if (!device.started)
+    {
+        device.started = true;
+        device.position = pInterval->start;
+        device.firstStart = pInterval->start;
+    }
+    else
+    {
+        AdvanceUtilizationDevice(&device, pInterval->start);
+
+        if (device.inFlight.empty() && pInterval->start > device.idleSince)
+        {
+            RecordUtilizationGap(pAnalyzer, &device, pInterval->deviceId, device.idleSince, pInterval->start);
+        }
+    }
+
+    device.inFlight.push(std::make_pair(pInterval->end, pInterval->workClass));
+    device.numInFlight[pInterval->workClass]++;
+    device.numIntervals[pInterval->workClass]++;
+    device.lastEnd = std::max(device.lastEnd, pInterval->end);
+
+    // Union of the intervals of the stream, swept in start order.
+    UtilizationStream &stream = pAnalyzer->streams[((uint64_t)pInterval->deviceId << 32) | pInterval->streamId];
+    if (stream.numIntervals == 0)
+    {
+        stream.firstStart = pInterval->start;
+    }
+    if (pInterval->end > stream.coveredUntil)
+    {
+        stream.busyNs += pInterval->end - std::max(pInterval->start, stream.coveredUntil);
+        stream.coveredUntil = pInterval->end;
+    }
+    stream.numIntervals++;
+    stream.lastEnd = std::max(stream.lastEnd, pInterval->end);
+
+    pAnalyzer->sweepPosition = pInterval->start;
+}
+
+// Keep the API calls started from the sweep position, and the few before it the next gap can need.
+static void
+PruneUtilizationApiCalls(
+    UtilizationAnalyzer *pAnalyzer)
+{
+    std::multimap<uint64_t, UtilizationApiCall>::iterator it = pAnalyzer->apiCalls.lower_bound(pAnalyzer->sweepPosition);
+
+    for (int i = 0; i < UTILIZATION_GAP_API_CALLS && it != pAnalyzer->apiCalls.begin(); i++)
+    {
+        --it;
+    }
+    pAnalyzer->apiCalls.erase(pAnalyzer->apiCalls.begin(), it);
+
+    while (pAnalyzer->apiCalls.size() > UTILIZATION_MAX_API_HISTORY)
+    {
+        pAnalyzer->apiCalls.erase(pAnalyzer->apiCalls.begin());
+    }
+}
+
+// Sweep the pending intervals starting up to watermark.
+static void
+SweepUtilizationPending(
+    UtilizationAnalyzer *pAnalyzer,
+    uint64_t watermark)
+{
+    bool swept = false;
+
+    while (!pAnalyzer->pending.empty() && pAnalyzer->pending.top().first <= watermark)
+    {
+        size_t index = pAnalyzer->pending.top().second;
+
+        pAnalyzer->pending.pop();
+        SweepUtilizationInterval(pAnalyzer, &pAnalyzer->intervals[index]);
+        pAnalyzer->freeIntervals.push_back(index);
+        swept = true;
+    }
+
+    if (swept)
+    {
+        PruneUtilizationApiCalls(pAnalyzer);
+    }
+}
+
+static void
+AddUtilizationInterval(
+    UtilizationAnalyzer *pAnalyzer,
+    uint64_t start,
+    uint64_t end,
+    uint32_t deviceId,
+    uint32_t streamId,
+    UtilizationClass workClass)
+{
+    if (end == 0 || end < start || end <= pAnalyzer->sweepPosition)
+    {
+        pAnalyzer->droppedRecords++;
+        return;
+    }
+
+    if (start < pAnalyzer->sweepPosition)
+    {
+        pAnalyzer->lateRecords++;
+        start = pAnalyzer->sweepPosition;
+    }
+
+    UtilizationInterval interval;
+    interval.start = start;
+    interval.end = end;
+    interval.deviceId = deviceId;
+    interval.streamId = streamId;
+    interval.workClass = (uint8_t)workClass;
+
+    size_t index = pAnalyzer->intervals.size();
+    if (!pAnalyzer->freeIntervals.empty())
+    {
+        index = pAnalyzer->freeIntervals.back();
+        pAnalyzer->freeIntervals.pop_back();
+        pAnalyzer->intervals[index] = interval;
+    }
+    else
+    {
+        pAnalyzer->intervals.push_back(interval);
+    }
+    pAnalyzer->pending.push(std::make_pair(start, index));
+
+    pAnalyzer->latestStart = std::max(pAnalyzer->latestStart, start);
+    if (pAnalyzer->latestStart > pAnalyzer->reorderNs)
+    {
+        SweepUtilizationPending(pAnalyzer, pAnalyzer->latestStart - pAnalyzer->reorderNs);
+    }
+
+    // Bound the memory: sweep the earliest intervals before their window is over.
+    while (pAnalyzer->pending.size() > UTILIZATION_MAX_PENDING)
+    {
+        SweepUtilizationPending(pAnalyzer, pAnalyzer->pending.top().first);
+    }
+}
+
+static void
+AddUtilizationApiCall(
+    UtilizationAnalyzer *pAnalyzer,
+    uint64_t start,
+    uint64_t end,
+    uint32_t threadId,
+    uint32_t id,
+    CUpti_ActivityKind kind)
+{
+    UtilizationApiCall apiCall;
+    apiCall.start = start;
+    apiCall.end = end;
+    apiCall.threadId = threadId;
+    apiCall.id = id;
+    apiCall.kind = (uint8_t)kind;
+
+    pAnalyzer->apiCalls.insert(std::make_pair(start, apiCall));
+    if (pAnalyzer->apiCalls.size() > UTILIZATION_MAX_API_HISTORY)
+    {
+        PruneUtilizationApiCalls(pAnalyzer);
+    }
+}
+
+static void
+InitUtilizationAnalyzer(
+    UtilizationAnalyzer *pAnalyzer,
+    uint64_t reorderNs,
+    uint64_t largeGapNs)
+{
+    pAnalyzer->reorderNs = reorderNs;
+    pAnalyzer->largeGapNs = largeGapNs;
+    pAnalyzer->pending = std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t> >,
+                                             std::greater<std::pair<uint64_t, size_t> > >();
+    pAnalyzer->intervals.clear();
+    pAnalyzer->freeIntervals.clear();
+    pAnalyzer->latestStart = 0;
+    pAnalyzer->sweepPosition = 0;
+    pAnalyzer->devices.clear();
+    pAnalyzer->streams.clear();
+    pAnalyzer->apiCalls.clear();
+    pAnalyzer->largestGaps.clear();
+    pAnalyzer->lateRecords = 0;
+    pAnalyzer->droppedRecords = 0;
+}
+
+// Feed one activity record: kernel, memcpy, memset, API and synchronization records are used, other kinds are ignored.
+static void
+UtilizationAddRecord(
+    UtilizationAnalyzer *pAnalyzer,
+    CUpti_Activity *pRecord)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            AddUtilizationInterval(pAnalyzer, pKernelRecord->start, pKernelRecord->end, pKernelRecord->deviceId,
+                                   pKernelRecord->streamId, UTILIZATION_CLASS_KERNEL);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            AddUtilizationInterval(pAnalyzer, pMemcpyRecord->start, pMemcpyRecord->end, pMemcpyRecord->deviceId,
+                                   pMemcpyRecord->streamId, UTILIZATION_CLASS_COPY);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY2:
+        {
+            CUpti_ActivityMemcpyPtoP4 *pMemcpyPtoPRecord = (CUpti_ActivityMemcpyPtoP4 *)pRecord;
+            AddUtilizationInterval(pAnalyzer, pMemcpyPtoPRecord->start, pMemcpyPtoPRecord->end, pMemcpyPtoPRecord->deviceId,
+                                   pMemcpyPtoPRecord->streamId, UTILIZATION_CLASS_COPY);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+            AddUtilizationInterval(pAnalyzer, pMemsetRecord->start, pMemsetRecord->end, pMemsetRecord->deviceId,
+                                   pMemsetRecord->streamId, UTILIZATION_CLASS_MEMSET);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+        {
+            CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)pRecord;
+            AddUtilizationApiCall(pAnalyzer, pApiRecord->start, pApiRecord->end, pApiRecord->threadId, pApiRecord->cbid, pRecord->kind);
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_SYNCHRONIZATION:
+        {
+            CUpti_ActivitySynchronization2 *pSynchronizationRecord = (CUpti_ActivitySynchronization2 *)pRecord;
+            AddUtilizationApiCall(pAnalyzer, pSynchronizationRecord->start, pSynchronizationRecord->end, 0,
+                                  (uint32_t)pSynchronizationRecord->type, pRecord->kind);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Sweep every pending interval and retire the intervals in flight. Records added afterwards are late.
+static void
+FlushUtilizationAnalyzer(
+    UtilizationAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    SweepUtilizationPending(pAnalyzer, UINT64_MAX);
+
+    for (std::map<uint32_t, UtilizationDevice>::iterator it = pAnalyzer->devices.begin(); it != pAnalyzer->devices.end(); ++it)
+    {
+        AdvanceUtilizationDevice(&it->second, it->second.lastEnd);
+    }
+}
+
+static const char *
+GetUtilizationApiName(
+    const UtilizationApiCall *pApiCall)
+{
+    const char *pName = NULL;
+
+    switch (pApiCall->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+            cuptiGetCallbackName(CUPTI_CB_DOMAIN_DRIVER_API, pApiCall->id, &pName);
+            break;
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+            cuptiGetCallbackName(CUPTI_CB_DOMAIN_RUNTIME_API, pApiCall->id, &pName);
+            break;
+        case CUPTI_ACTIVITY_KIND_SYNCHRONIZATION:
+            pName = GetSynchronizationType((CUpti_ActivitySynchronizationType)pApiCall->id);
+            break;
+        default:
+            break;
+    }
+
+    return pName ? pName : "<unknown>";
+}
+
+static inline double
+GetUtilizationPercent(
+    uint64_t value,
+    uint64_t total)
+{
+    return total ? 100.0 * (double)value / (double)total : 0.0;
+}
+
+// Flush the analyzer and print the utilization of every device and stream, the idle gaps and the largest ones.
+static void
+PrintUtilizationReport(
+    UtilizationAnalyzer *pAnalyzer,
+    FILE *pFile)
+{
+    FlushUtilizationAnalyzer(pAnalyzer);
+
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    fprintf(pFile, "\nDevice utilization (reorder window %llu ns, late records %llu, dropped records %llu):\n",
+            (unsigned long long)pAnalyzer->reorderNs, (unsigned long long)pAnalyzer->lateRecords,
+            (unsigned long long)pAnalyzer->droppedRecords);
+
+    for (std::map<uint32_t, UtilizationDevice>::const_iterator it = pAnalyzer->devices.begin(); it != pAnalyzer->devices.end(); ++it)
+    {
+        const UtilizationDevice &device = it->second;
+        uint64_t span = device.lastEnd - device.firstStart;
+
+        fprintf(pFile, "  Device %u: [ %llu, %llu ] span %llu ns, busy %llu ns (%.1f%%), idle gaps %llu, %llu ns\n",
+                it->first, (unsigned long long)device.firstStart, (unsigned long long)device.lastEnd, (unsigned long long)span,
+                (unsigned long long)device.busyNs, GetUtilizationPercent(device.busyNs, span),
+                (unsigned long long)device.numGaps, (unsigned long long)device.gapNs);
+        fprintf(pFile, "    Kernels %llu, %llu ns (%.1f%%); copies %llu, %llu ns (%.1f%%); memsets %llu, %llu ns (%.1f%%)\n",
+                (unsigned long long)device.numIntervals[UTILIZATION_CLASS_KERNEL], (unsigned long long)device.classNs[UTILIZATION_CLASS_KERNEL],
+                GetUtilizationPercent(device.classNs[UTILIZATION_CLASS_KERNEL], span),
+                (unsigned long long)device.numIntervals[UTILIZATION_CLASS_COPY], (unsigned long long)device.classNs[UTILIZATION_CLASS_COPY],
+                GetUtilizationPercent(device.classNs[UTILIZATION_CLASS_COPY], span),
+                (unsigned long long)device.numIntervals[UTILIZATION_CLASS_MEMSET], (unsigned long long)device.classNs[UTILIZATION_CLASS_MEMSET],
+                GetUtilizationPercent(device.classNs[UTILIZATION_CLASS_MEMSET], span));
+        fprintf(pFile, "    Copy/compute overlap %llu ns, %.1f%% of the copy time\n",
+                (unsigned long long)device.overlapNs, GetUtilizationPercent(device.overlapNs, device.classNs[UTILIZATION_CLASS_COPY]));
+
+        fprintf(pFile, "    Kernels in flight (share of the busy time):");
+        for (int i = 0; i <= UTILIZATION_MAX_CONCURRENCY; i++)
+        {
+            if (device.concurrencyNs[i])
+            {
+                fprintf(pFile, " %d%s: %.1f%%", i, i == UTILIZATION_MAX_CONCURRENCY ? "+" : "",
+                        GetUtilizationPercent(device.concurrencyNs[i], device.busyNs));
+            }
+        }
+        fprintf(pFile, "\n");
+
+        fprintf(pFile, "    Idle gaps (ns: count):");
+        for (int i = 0; i < UTILIZATION_GAP_BUCKETS; i++)
+        {
+            if (device.gapCount[i])
+            {
+                fprintf(pFile, " [%llu, %llu): %llu", i ? (unsigned long long)(1ULL << i) : 0ULL,
+                        (unsigned long long)(1ULL << (i + 1)), (unsigned long long)device.gapCount[i]);
+            }
+        }
+        fprintf(pFile, "\n");
+    }
+
+    fprintf(pFile, "Stream utilization:\n");
+    std::map<uint64_t, const UtilizationStream *> streams;
+    for (std::unordered_map<uint64_t, UtilizationStream>::const_iterator it = pAnalyzer->streams.begin(); it != pAnalyzer->streams.end(); ++it)
+    {
+        streams[it->first] = &it->second;
+    }
+    for (std::map<uint64_t, const UtilizationStream *>::const_iterator it = streams.begin(); it != streams.end(); ++it)
+    {
+        const UtilizationStream *pStream = it->second;
+        uint64_t span = pStream->lastEnd - pStream->firstStart;
+
+        fprintf(pFile, "  Device %u stream %u: operations %llu, busy %llu ns of %llu ns (%.1f%%)\n",
+                (uint32_t)(it->first >> 32), (uint32_t)it->first, (unsigned long long)pStream->numIntervals,
+                (unsigned long long)pStream->busyNs, (unsigned long long)span, GetUtilizationPercent(pStream->busyNs, span));
+    }
+
+    std::vector<UtilizationGap> gaps = pAnalyzer->largestGaps;
+    std::sort(gaps.begin(), gaps.end(), IsLargerUtilizationGap);
+    fprintf(pFile, "Largest idle gaps (from %llu ns), with the API calls started before their end:\n", (unsigned long long)pAnalyzer->largeGapNs);
+    for (size_t i = 0; i < gaps.size(); i++)
+    {
+        fprintf(pFile, "  Device %u: [ %llu, %llu ] %llu ns\n", gaps[i].deviceId, (unsigned long long)gaps[i].start,
+                (unsigned long long)gaps[i].end, (unsigned long long)(gaps[i].end - gaps[i].start));
+
+        for (uint32_t j = 0; j < gaps[i].numApiCalls; j++)
+        {
+            const UtilizationApiCall *pApiCall = &gaps[i].apiCalls[j];
+
+            fprintf(pFile, "    %s %s [ %llu, %llu ] threadId %u\n", GetActivityKindString((CUpti_ActivityKind)pApiCall->kind),
+                    GetUtilizationApiName(pApiCall), (unsigned long long)pApiCall->start, (unsigned long long)pApiCall->end,
+                    pApiCall->threadId);
+        }
+    }
+    fflush(pFile);
+}
+
+static void
+FreeUtilizationAnalyzer(
+    UtilizationAnalyzer *pAnalyzer)
+{
+    std::lock_guard<std::mutex> lock(pAnalyzer->mutex);
+
+    InitUtilizationAnalyzer(pAnalyzer, pAnalyzer->reorderNs, pAnalyzer->largeGapNs);
+}
+
+#endif // HELPER_CUPTI_UTILIZATION_H_
@@ -0,0 +1,574 @@
+/**
+ * Copyright 2022-2024 NVIDIA Corporation.  All rights reserved.
+ *
+ * Please refer to the NVIDIA end user license agreement (EULA) associated
+ * with this source code for terms and conditions that govern your use of
+ * this software. Any use, reproduction, disclosure, or distribution of
+ * this software and related documentation outside the terms of the EULA
+ * is strictly prohibited.
+ *
+ */
+
+////////////////////////////////////////////////////////////////////////////////
+
+#ifndef HELPER_CUPTI_UVM_HEATMAP_H_
+#define HELPER_CUPTI_UVM_HEATMAP_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+#include "helper_cupti_activity.h"
+
+// Heatmap of the unified memory counter records.
+//
+// Every UNIFIED_MEMORY_COUNTER record is binned by virtual address range (a
+// power of two, e.g. the 4 KB page or the 2 MB large page) and by time window
+// into a sparse 2D histogram; a transfer covering several address bins is
+// split between them. Per address bin the totals give the hot ranges, and
+// the destination of the successive migrations gives the ping-pong: a bin
+// migrated back to the processor it left, within the bounce window, counts
+// as one bounce.
+//
+// The counter records carry no correlation id, the transfers and GPU page
+// faults are attributed to the kernel executing on the source or destination
+// device at their start, the latest started one if several. Kernel records
+// may arrive after the counter records, so the attribution is done by the
+// report, from a bounded list of the events.
+//
+// UvmHeatmapAddRecord() only needs the fields of the records, so the binning
+// and the report can be exercised with synthetic records.
+
+// Macros
+#define UVM_HEATMAP_DEFAULT_BIN_SHIFT 21                             // 2 MB address bins.
+#define UVM_HEATMAP_DEFAULT_WINDOW_NS (1000ULL * 1000)
+#define UVM_HEATMAP_DEFAULT_BOUNCE_NS (100ULL * 1000 * 1000)
+#define UVM_HEATMAP_MAX_CELLS (1 << 20)
+#define UVM_HEATMAP_MAX_EVENTS (1 << 20)                             // Events kept for the kernel attribution.
+#define UVM_HEATMAP_MAX_KERNEL_OVERLAP 64                            // Kernels searched back for one containing an event.
+#define UVM_HEATMAP_TOP_COUNT 10
+#define UVM_HEATMAP_CPU_ID 0xFFFFFFFFu                               // Destination of the DTOH transfers.
+#define UVM_HEATMAP_NO_PROCESSOR 0xFFFFFFFEu                         // Previous destination of a bin migrated once.
+
+// Data structures
+
+// Counters of an address bin in a time window, or of an address bin or a kernel over the run.
+typedef struct UvmHeatmapCounters_st
+{
+    uint64_t bytesHtoD;
+    uint64_t bytesDtoH;
+    uint64_t bytesDtoD;
+    uint64_t cpuPageFaults;
+    uint64_t gpuPageFaults;
+    uint32_t thrashing;                                              // Records, for the thrashing, throttling and remote map kinds.
+    uint32_t throttling;
+    uint32_t remoteMap;
+} UvmHeatmapCounters;
+
+typedef struct UvmHeatmapRange_st
+{
+    UvmHeatmapCounters counters;
+    uint64_t           lastMigration;                                // Start of the latest migration of the bin.
+    uint32_t           lastDestination;                              // Processor the bin was migrated to last, UVM_HEATMAP_CPU_ID for the CPU.
+    uint32_t           previousDestination;                          // Processor before it.
+    uint32_t           bounces;                                      // Migrations back to the previous processor within the bounce window.
+} UvmHeatmapRange;
+
+// A transfer or GPU page fault waiting for the kernel attribution.
+typedef struct UvmHeatmapEvent_st
+{
+    uint64_t start;
+    uint64_t value;                                                  // Bytes, or faults.
+    uint32_t srcId;
+    uint32_t dstId;
+    uint8_t  counterKind;
+} UvmHeatmapEvent;
+
+typedef struct UvmHeatmapKernel_st
+{
+    uint64_t   end;
+    uint32_t   correlationId;
+    const char *pName;                                               // Owned by CUPTI.
+} UvmHeatmapKernel;
+
+typedef struct UvmHeatmap_st
+{
+    std::mutex                                           mutex;      // The buffers can be completed by several threads.
+    uint32_t                                             binShift;   // Address bins of 1 << binShift bytes.
+    uint64_t                                             windowNs;
+    uint64_t                                             bounceNs;
+    std::map<std::pair<uint64_t, uint64_t>, UvmHeatmapCounters> cells; // By (bin, window).
+    std::unordered_map<uint64_t, UvmHeatmapRange>        ranges;     // By bin.
+    std::vector<UvmHeatmapEvent>                         events;
+    std::map<uint32_t, std::multimap<uint64_t, UvmHeatmapKernel> > kernels; // By device, then start.
+    UvmHeatmapCounters                                   totals;
+    uint64_t                                             numRecords;
+    uint64_t                                             droppedCells;  // Updates of new cells past UVM_HEATMAP_MAX_CELLS.
+    uint64_t                                             droppedEvents; // Events past UVM_HEATMAP_MAX_EVENTS, not attributed.
+} UvmHeatmap;
+
+// Counters of the kernels the events are attributed to, by kernel start and correlation id.
+typedef std::map<std::pair<uint64_t, uint32_t>, std::pair<const UvmHeatmapKernel *, UvmHeatmapCounters> > UvmHeatmapKernelCounters;
+
+// Helper Functions
+static void
+AddUvmHeatmapCounter(
+    UvmHeatmapCounters *pCounters,
+    uint8_t counterKind,
+    uint64_t value)
+{
+    switch (counterKind)
+    {
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD:
+            pCounters->bytesHtoD += value;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH:
+            pCounters->bytesDtoH += value;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD:
+            pCounters->bytesDtoD += value;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_CPU_PAGE_FAULT_COUNT:
+            pCounters->cpuPageFaults += value;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT:
+            pCounters->gpuPageFaults += value;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THRASHING:
+            pCounters->thrashing++;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THROTTLING:
+            pCounters->throttling++;
+            break;
+        case CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_REMOTE_MAP:
+            pCounters->remoteMap++;
+            break;
+        default:
+            break;
+    }
+}
+
+static inline uint64_t
+GetUvmHeatmapBytes(
+    const UvmHeatmapCounters *pCounters)
+{
+    return pCounters->bytesHtoD + pCounters->bytesDtoH + pCounters->bytesDtoD;
+}
+
+static inline bool
+IsUvmTransferKind(
+    uint8_t counterKind)
+{
+    return counterKind == CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD ||
+           counterKind == CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH ||
+           counterKind == CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD;
+}
+
+// Count a migration of bin to destination, and a bounce if it goes back where it came from.
+static void
+AddUvmHeatmapMigration(
+    UvmHeatmap *pHeatmap,
+    UvmHeatmapRange *pRange,
+    uint32_t destination,
+    uint64_t start)
+{
+    bool known = pRange->lastMigration != 0;
+
+    if (known && destination == pRange->lastDestination)
+    {
+        // Another part of the bin moving the same way.
+        pRange->lastMigration = start;
+        return;
+    }
+
+    if (known &&
+        destination == pRange->previousDestination &&
+        start - std::min(start, pRange->lastMigration) <= pHeatmap->bounceNs)
+    {
+        pRange->bounces++;
+    }
+
+    pRange->previousDestination = known ? pRange->lastDestination : UVM_HEATMAP_NO_PROCESSOR;
+    pRange->lastDestination = destination;
+    pRange->lastMigration = start ? start : 1;
+}
+
+static void
+AddUvmHeatmapCell(
+    UvmHeatmap *pHeatmap,
+    uint64_t bin,
+    uint64_t window,
+    uint8_t counterKind,
+    uint64_t value)
+{
+    std::pair<uint64_t, uint64_t> key(bin, window);
+    std::map<std::pair<uint64_t, uint64_t>, UvmHeatmapCounters>::iterator it = pHeatmap->cells.find(key);
+
+    if (it == pHeatmap->cells.end())
+    {
+        if (pHeatmap->cells.size() >= UVM_HEATMAP_MAX_CELLS)
+        {
+            pHeatmap->droppedCells++;
+            return;
+        }
+
+        UvmHeatmapCounters counters;
+        memset(&counters, 0, sizeof(UvmHeatmapCounters));
+        it = pHeatmap->cells.insert(std::make_pair(key, counters)).first;
+    }
+
+    AddUvmHeatmapCounter(&it->second, counterKind, value);
+}
+
+static void
+AddUvmCounterRecord(
+    UvmHeatmap *pHeatmap,
+    const CUpti_ActivityUnifiedMemoryCounter2 *pCounter)
+{
+    uint8_t counterKind = (uint8_t)pCounter->counterKind;
+    uint64_t window = pCounter->start / pHeatmap->windowNs;
+    uint64_t firstBin = pCounter->address >> pHeatmap->binShift;
+    uint64_t lastBin = firstBin;
+
+    // A transfer spans value bytes from address, the other kinds are for the bin of the address.
+    if (IsUvmTransferKind(counterKind) && pCounter->value > 0)
+    {
+        lastBin = (pCounter->address + pCounter->value - 1) >> pHeatmap->binShift;
+    }
+
+    uint32_t destination = pCounter->dstId;
+    if (counterKind == CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH)
+    {
+        destination = UVM_HEATMAP_CPU_ID;
+    }
+
+    for (uint64_t bin = firstBin; bin <= lastBin; bin++)
+    {
+        uint64_t value = pCounter->value;
+
+        if (IsUvmTransferKind(counterKind))
+        {
+            // Bytes of the transfer inside the bin.
+            uint64_t binStart = std::max(bin << pHeatmap->binShift, (uint64_t)pCounter->address);
+            uint64_t binEnd = std::min((bin + 1) << pHeatmap->binShift, (uint64_t)(pCounter->address + pCounter->value));
+            value = binEnd - binStart;
+        }
+
+        AddUvmHeatmapCell(pHeatmap, bin, window, counterKind, value);
+
+        UvmHeatmapRange &range = pHeatmap->ranges[bin];
+        AddUvmHeatmapCounter(&range.counters, counterKind, value);
+        if (IsUvmTransferKind(counterKind))
+        {
+            AddUvmHeatmapMigration(pHeatmap, &range, destination, pCounter->start);
+        }
+    }
+
+    AddUvmHeatmapCounter(&pHeatmap->totals, counterKind, pCounter->value);
+
+    if (IsUvmTransferKind(counterKind) || counterKind == CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT)
+    {
+        if (pHeatmap->events.size() >= UVM_HEATMAP_MAX_EVENTS)
+        {
+            pHeatmap->droppedEvents++;
+            return;
+        }
+
+        UvmHeatmapEvent event;
+        event.start = pCounter->start;
+        event.value = pCounter->value;
+        event.srcId = pCounter->srcId;
+        event.dstId = pCounter->dstId;
+        event.counterKind = counterKind;
+        pHeatmap->events.push_back(event);
+    }
+}
+
+static void
+InitUvmHeatmap(
+    UvmHeatmap *pHeatmap,
+    uint32_t binShift,
+    uint64_t windowNs,
+    uint64_t bounceNs)
+{
+    pHeatmap->binShift = binShift;
+    pHeatmap->windowNs = windowNs ? windowNs : UVM_HEATMAP_DEFAULT_WINDOW_NS;
+    pHeatmap->bounceNs = bounceNs;
+    pHeatmap->cells.clear();
+    pHeatmap->ranges.clear();
+    pHeatmap->events.clear();
+    pHeatmap->kernels.clear();
+    memset(&pHeatmap->totals, 0, sizeof(UvmHeatmapCounters));
+    pHeatmap->numRecords = 0;
+    pHeatmap->droppedCells = 0;
+    pHeatmap->droppedEvents = 0;
+}
+
+// Feed one activity record: UNIFIED_MEMORY_COUNTER and kernel records are used, other kinds are ignored.
+static void
+UvmHeatmapAddRecord(
+    UvmHeatmap *pHeatmap,
+    CUpti_Activity *pRecord)
+{
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER:
+        {
+            std::lock_guard<std::mutex> lock(pHeatmap->mutex);
+            AddUvmCounterRecord(pHeatmap, (CUpti_ActivityUnifiedMemoryCounter2 *)pRecord);
+            pHeatmap->numRecords++;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            UvmHeatmapKernel kernel;
+
+            kernel.end = pKernelRecord->end;
+            kernel.correlationId = pKernelRecord->correlationId;
+            kernel.pName = pKernelRecord->name;
+
+            std::lock_guard<std::mutex> lock(pHeatmap->mutex);
+            pHeatmap->kernels[pKernelRecord->deviceId].insert(std::make_pair((uint64_t)pKernelRecord->start, kernel));
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Latest started kernel of deviceId executing at timestamp, NULL if none.
+static const UvmHeatmapKernel *
+FindUvmHeatmapKernel(
+    const UvmHeatmap *pHeatmap,
+    uint32_t deviceId,
+    uint64_t timestamp,
+    uint64_t *pStart)
+{
+    std::map<uint32_t, std::multimap<uint64_t, UvmHeatmapKernel> >::const_iterator device = pHeatmap->kernels.find(deviceId);
+
+    if (device == pHeatmap->kernels.end())
+    {
+        return NULL;
+    }
+
+    std::multimap<uint64_t, UvmHeatmapKernel>::const_iterator it = device->second.upper_bound(timestamp);
+    for (int i = 0; i < UVM_HEATMAP_MAX_KERNEL_OVERLAP && it != device->second.begin(); i++)
+    {
+        --it;
+        if (timestamp <= it->second.end)
+        {
+            *pStart = it->first;
+            return &it->second;
+        }
+    }
+
+    return NULL;
+}
+
+// Attribute the transfers and GPU page faults to the kernel executing on their destination, else source,
+// device. Called with the mutex held.
+static void
+GetUvmHeatmapKernelCounters(
+    const UvmHeatmap *pHeatmap,
+    UvmHeatmapKernelCounters *pKernels,
+    UvmHeatmapCounters *pUnattributed)
+{
+    pKernels->clear();
+    memset(pUnattributed, 0, sizeof(UvmHeatmapCounters));
+
+    for (size_t i = 0; i < pHeatmap->events.size(); i++)
+    {
+        const UvmHeatmapEvent &event = pHeatmap->events[i];
+        uint64_t start = 0;
+        const UvmHeatmapKernel *pKernel = FindUvmHeatmapKernel(pHeatmap, event.dstId, event.start, &start);
+
+        if (!pKernel)
+        {
+            pKernel = FindUvmHeatmapKernel(pHeatmap, event.srcId, event.start, &start);
+        }
+
+        if (!pKernel)
+        {
+            AddUvmHeatmapCounter(pUnattributed, event.counterKind, event.value);
+            continue;
+        }
+
+        std::pair<const UvmHeatmapKernel *, UvmHeatmapCounters> &entry = (*pKernels)[std::make_pair(start, pKernel->correlationId)];
+        if (!entry.first)
+        {
+            entry.first = pKernel;
+            memset(&entry.second, 0, sizeof(UvmHeatmapCounters));
+        }
+        AddUvmHeatmapCounter(&entry.second, event.counterKind, event.value);
+    }
+}
+
+static void
+PrintUvmHeatmapCounters(
+    FILE *pFile,
+    const UvmHeatmapCounters *pCounters)
+{
+    fprintf(pFile, "HtoD %llu, DtoH %llu, DtoD %llu, cpuPageFaults %llu, gpuPageFaults %llu, thrashing %u, throttling %u, remoteMap %u",
+            (unsigned long long)pCounters->bytesHtoD, (unsigned long long)pCounters->bytesDtoH,
+            (unsigned long long)pCounters->bytesDtoD, (unsigned long long)pCounters->cpuPageFaults,
+            (unsigned long long)pCounters->gpuPageFaults, pCounters->thrashing, pCounters->throttling, pCounters->remoteMap);
+}
+
+// Print the hot address ranges, the ping-pong ranges, the migrations per kernel and the hottest heatmap cells.
+static void
+PrintUvmHeatmapReport(
+    UvmHeatmap *pHeatmap,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pHeatmap->mutex);
+    uint64_t binSize = 1ULL << pHeatmap->binShift;
+    std::vector<std::pair<uint64_t, const UvmHeatmapRange *> > ranges;
+
+    fprintf(pFile, "\nUnified memory heatmap: %llu records, bins of %llu bytes, windows of %llu ns, %llu cells\n  Total: ",
+            (unsigned long long)pHeatmap->numRecords, (unsigned long long)binSize,
+            (unsigned long long)pHeatmap->windowNs, (unsigned long long)pHeatmap->cells.size());
+    PrintUvmHeatmapCounters(pFile, &pHeatmap->totals);
+    fprintf(pFile, "\n");
+
+    for (std::unordered_map<uint64_t, UvmHeatmapRange>::const_iterator it = pHeatmap->ranges.begin(); it != pHeatmap->ranges.end(); ++it)
+    {
+        ranges.push_back(std::make_pair(it->first, &it->second));
+    }
+
+    // Hot ranges: most bytes migrated, then most faults.
+    size_t top = std::min(ranges.size(), (size_t)UVM_HEATMAP_TOP_COUNT);
+    std::partial_sort(ranges.begin(), ranges.begin() + top, ranges.end(),
+                      [](const std::pair<uint64_t, const UvmHeatmapRange *> &a, const std::pair<uint64_t, const UvmHeatmapRange *> &b)
+                      {
+                          uint64_t bytesA = GetUvmHeatmapBytes(&a.second->counters);
+                          uint64_t bytesB = GetUvmHeatmapBytes(&b.second->counters);
+                          if (bytesA != bytesB)
+                          {
+                              return bytesA > bytesB;
+                          }
+                          return a.second->counters.cpuPageFaults + a.second->counters.gpuPageFaults >
+                                 b.second->counters.cpuPageFaults + b.second->counters.gpuPageFaults;
+                      });
+    fprintf(pFile, "Hot ranges:\n");
+    for (size_t i = 0; i < top; i++)
+    {
+        fprintf(pFile, "  [ 0x%llx, 0x%llx ) ", (unsigned long long)(ranges[i].first * binSize), (unsigned long long)((ranges[i].first + 1) * binSize));
+        PrintUvmHeatmapCounters(pFile, &ranges[i].second->counters);
+        fprintf(pFile, ", bounces %u\n", ranges[i].second->bounces);
+    }
+
+    // Ping-pong: ranges migrated back and forth.
+    std::partial_sort(ranges.begin(), ranges.begin() + top, ranges.end(),
+                      [](const std::pair<uint64_t, const UvmHeatmapRange *> &a, const std::pair<uint64_t, const UvmHeatmapRange *> &b)
+                      {
+                          return a.second->bounces > b.second->bounces;
+                      });
+    fprintf(pFile, "Ping-pong ranges (migrated back within %llu ns):\n", (unsigned long long)pHeatmap->bounceNs);
+    for (size_t i = 0; i < top && ranges[i].second->bounces; i++)
+    {
+        fprintf(pFile, "  [ 0x%llx, 0x%llx ) bounces %u, thrashing %u, bytes migrated %llu\n",
+                (unsigned long long)(ranges[i].first * binSize), (unsigned long long)((ranges[i].first + 1) * binSize),
+                ranges[i].second->bounces, ranges[i].second->counters.thrashing,
+                (unsigned long long)GetUvmHeatmapBytes(&ranges[i].second->counters));
+    }
+
+    // Transfers and GPU page faults per kernel.
+    UvmHeatmapKernelCounters kernels;
+    UvmHeatmapCounters unattributed;
+    GetUvmHeatmapKernelCounters(pHeatmap, &kernels, &unattributed);
+
+    fprintf(pFile, "Migrations per kernel:\n");
+    for (UvmHeatmapKernelCounters::const_iterator it = kernels.begin(); it != kernels.end(); ++it)
+    {
+        fprintf(pFile, "  [ %llu ] correlationId %u, name %s: ", (unsigned long long)it->first.first, it->first.second,
+                it->second.first->pName ? GetName(it->second.first->pName) : "<unknown>");
+        PrintUvmHeatmapCounters(pFile, &it->second.second);
+        fprintf(pFile, "\n");
+    }
+    fprintf(pFile, "  Outside of any kernel: ");
+    PrintUvmHeatmapCounters(pFile, &unattributed);
+    fprintf(pFile, "\n");
+
+    // Hottest cells of the heatmap, by bytes migrated.
+    std::vector<std::pair<std::pair<uint64_t, uint64_t>, const UvmHeatmapCounters *> > cells;
+    for (std::map<std::pair<uint64_t, uint64_t>, UvmHeatmapCounters>::const_iterator it = pHeatmap->cells.begin(); it != pHeatmap->cells.end(); ++it)
+    {
+        cells.push_back(std::make_pair(it->first, &it->second));
+    }
+
+    top = std::min(cells.size(), (size_t)UVM_HEATMAP_TOP_COUNT);
+    std::partial_sort(cells.begin(), cells.begin() + top, cells.end(),
+                      [](const std::pair<std::pair<uint64_t, uint64_t>, const UvmHeatmapCounters *> &a,
+                         const std::pair<std::pair<uint64_t, uint64_t>, const UvmHeatmapCounters *> &b)
+                      {
+                          return GetUvmHeatmapBytes(a.second) > GetUvmHeatmapBytes(b.second);
+                      });
+    fprintf(pFile, "Hottest cells:\n");
+    for (size_t i = 0; i < top; i++)
+    {
+        fprintf(pFile, "  [ 0x%llx, 0x%llx ) window [ %llu ] ",
+                (unsigned long long)(cells[i].first.first * binSize), (unsigned long long)((cells[i].first.first + 1) * binSize),
+                (unsigned long long)(cells[i].first.second * pHeatmap->windowNs));
+        PrintUvmHeatmapCounters(pFile, cells[i].second);
+        fprintf(pFile, "\n");
+    }
+
+    if (pHeatmap->droppedCells || pHeatmap->droppedEvents)
+    {
+        fprintf(pFile, "Cell updates dropped: %llu, events not attributed to kernels: %llu\n",
+                (unsigned long long)pHeatmap->droppedCells, (unsigned long long)pHeatmap->droppedEvents);
+    }
+    fflush(pFile);
+}
+
+// Write every cell of the heatmap as CSV, one line per address bin and time window.
+static void
+WriteUvmHeatmapCsv(
+    UvmHeatmap *pHeatmap,
+    FILE *pFile)
+{
+    std::lock_guard<std::mutex> lock(pHeatmap->mutex);
+
+    fprintf(pFile, "address,timestamp,bytesHtoD,bytesDtoH,bytesDtoD,cpuPageFaults,gpuPageFaults,thrashing,throttling,remoteMap\n");
+    for (std::map<std::pair<uint64_t, uint64_t>, UvmHeatmapCounters>::const_iterator it = pHeatmap->cells.begin(); it != pHeatmap->cells.end(); ++it)
+    {
+        const UvmHeatmapCounters &counters = it->second;
+
+        fprintf(pFile, "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u,%u\n",
+                (unsigned long long)(it->first.first << pHeatmap->binShift), (unsigned long long)(it->first.second * pHeatmap->windowNs),
+                (unsigned long long)counters.bytesHtoD, (unsigned long long)counters.bytesDtoH, (unsigned long long)counters.bytesDtoD,
+                (unsigned long long)counters.cpuPageFaults, (unsigned long long)counters.gpuPageFaults,
+                counters.thrashing, counters.throttling, counters.remoteMap);
+    }
+}
+
+static void
+FreeUvmHeatmap(
+    UvmHeatmap *pHeatmap)
+{
+    std::lock_guard<std::mutex> lock(pHeatmap->mutex);
+
+    pHeatmap->cells.clear();
+    pHeatmap->ranges.clear();
+    pHeatmap->events.clear();
+    pHeatmap->kernels.clear();
+}
+
+#endif // HELPER_CUPTI_UVM_HEATMAP_H_
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2011-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Periodic counter sampler used by the event_sampling and nvlink_bandwidth
+ * samples.
+ *
+ * The sampler is independent of CUPTI: it calls a reader function at
+ * absolute deadlines and stores each row of values, together with its
+ * tick number and timestamp, in a preallocated single-producer
+ * single-consumer ring. A separate consumer drains the ring for output,
+ * so the time spent printing never delays the next sample. Any reader
+ * with the SampleReaderFunc signature can drive it, including a mock
+ * reader on machines without a GPU.
+ */
+
+#ifndef HELPER_PERIODIC_SAMPLER_H_
+#define HELPER_PERIODIC_SAMPLER_H_
+
+#pragma once
+
+// System headers
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+// Reads one row of numValues counter values into pValues.
+// Returns 0 on success, non-zero stops the sampler.
+typedef int (*SampleReaderFunc)(void *pReaderData, uint64_t *pValues, size_t numValues);
+
+// Called by DrainSampleRing() for every row, in tick order.
+typedef void (*SampleConsumerFunc)(void *pConsumerData, uint64_t tick, uint64_t timestampNs, const uint64_t *pValues, size_t numValues);
+
+// Preallocated ring of timestamped rows. One thread writes, one thread reads.
+typedef struct SampleRing_st
+{
+    size_t   capacity;                                               // Number of rows.
+    size_t   numValues;                                              // Values per row.
+    uint64_t *pTicks;                                                // Tick number of each row.
+    uint64_t *pTimestamps;                                           // Monotonic timestamp (ns) of each row.
+    uint64_t *pValues;                                               // capacity x numValues values.
+    std::atomic<uint64_t> writeIndex;                                // Rows committed by the producer.
+    std::atomic<uint64_t> readIndex;                                 // Rows released by the consumer.
+    std::atomic<uint64_t> droppedRows;                               // Rows dropped because the ring was full.
+} SampleRing;
+
+// Absolute deadline scheduler state.
+typedef struct PeriodicSampler_st
+{
+    uint64_t         periodNs;                                       // Sampling period.
+    SampleReaderFunc pReader;                                        // Reader invoked at every tick.
+    void             *pReaderData;                                   // Opaque reader state.
+    SampleRing       *pRing;                                         // Destination ring.
+    std::atomic<int> stop;                                           // Set to request the sampler loop to exit.
+    std::atomic<int> finished;                                       // Set by the sampler loop once it has exited.
+    uint64_t         ticks;                                          // Rows sampled.
+    uint64_t         missedTicks;                                    // Deadlines skipped because a tick overran the period.
+    uint64_t         maxLatenessNs;                                  // Worst wake-up lateness relative to the deadline.
+} PeriodicSampler;
+
+// Time functions
+static uint64_t
+GetMonotonicTimeNs(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+
+    return (uint64_t)((double)counter.QuadPart * NANOSECONDS_PER_SECOND / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * NANOSECONDS_PER_SECOND + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// Sleep until the absolute monotonic time deadlineNs. Time spent before the
+// call does not shift the deadline, so the period does not drift.
+static void
+SleepUntilNs(
+    uint64_t deadlineNs)
+{
+#ifdef _WIN32
+    uint64_t now = GetMonotonicTimeNs();
+    while (now < deadlineNs)
+    {
+        Sleep((DWORD)((deadlineNs - now) / 1000000));
+        now = GetMonotonicTimeNs();
+        if (deadlineNs - now < 1000000)
+        {
+            break;
+        }
+    }
+#else
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)(deadlineNs / NANOSECONDS_PER_SECOND);
+    deadline.tv_nsec = (long)(deadlineNs % NANOSECONDS_PER_SECOND);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR)
+    {
+    }
+#endif
+}
+
+// Ring functions
+static int
+InitSampleRing(
+    SampleRing *pRing,
+    size_t capacity,
+    size_t numValues)
+{
+    pRing->capacity = capacity;
+    pRing->numValues = numValues;
+    pRing->pTicks = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    pRing->pTimestamps = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+    pRing->pValues = (uint64_t *)calloc(capacity * numValues, sizeof(uint64_t));
+    pRing->writeIndex.store(0);
+    pRing->readIndex.store(0);
+    pRing->droppedRows.store(0);
+
+    if (!pRing->pTicks || !pRing->pTimestamps || !pRing->pValues)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+FreeSampleRing(
+    SampleRing *pRing)
+{
+    free(pRing->pTicks);
+    free(pRing->pTimestamps);
+    free(pRing->pValues);
+    pRing->pTicks = NULL;
+    pRing->pTimestamps = NULL;
+    pRing->pValues = NULL;
+}
+
+// Returns the value slot of the next row, or NULL if the ring is full.
+// The row becomes visible to the consumer only after CommitSampleRow().
+static uint64_t *
+ReserveSampleRow(
+    SampleRing *pRing)
+{
+    uint64_t writeIndex = pRing->writeIndex.load(std::memory_order_relaxed);
+
+    if (writeIndex - pRing->readIndex.load(std::memory_order_acquire) >= pRing->capacity)
+    {
+        return NULL;
+    }
+
+    return pRing->pValues + (writeIndex % pRing->capacity) * pRing->numValues;
+}
+
+static void
+CommitSampleRow(
+    SampleRing *pRing,
+    uint64_t tick,
+    uint64_t timestampNs)
+{
+    uint64_t writeIndex = pRing->writeIndex.load(std::memory_order_relaxed);
+    size_t slot = (size_t)(writeIndex % pRing->capacity);
+
+    pRing->pTicks[slot] = tick;
+    pRing->pTimestamps[slot] = timestampNs;
+    pRing->writeIndex.store(writeIndex + 1, std::memory_order_release);
+}
+
+// Hands every committed row to pConsumer and releases it. Returns the number of rows drained.
+static size_t
+DrainSampleRing(
+    SampleRing *pRing,
+    SampleConsumerFunc pConsumer,
+    void *pConsumerData)
+{
+    uint64_t readIndex = pRing->readIndex.load(std::memory_order_relaxed);
+    uint64_t writeIndex = pRing->writeIndex.load(std::memory_order_acquire);
+    size_t numRows = 0;
+
+    for (; readIndex < writeIndex; readIndex++, numRows++)
+    {
+        size_t slot = (size_t)(readIndex % pRing->capacity);
+        pConsumer(pConsumerData, pRing->pTicks[slot], pRing->pTimestamps[slot],
+                  pRing->pValues + slot * pRing->numValues, pRing->numValues);
+    }
+    pRing->readIndex.store(readIndex, std::memory_order_release);
+
+    return numRows;
+}
+
+// Sampler functions
+static void
+InitPeriodicSampler(
+    PeriodicSampler *pSampler,
+    uint64_t periodNs,
+    SampleReaderFunc pReader,
+    void *pReaderData,
+    SampleRing *pRing)
+{
+    pSampler->periodNs = periodNs;
+    pSampler->pReader = pReader;
+    pSampler->pReaderData = pReaderData;
+    pSampler->pRing = pRing;
+    pSampler->stop.store(0);
+    pSampler->finished.store(0);
+    pSampler->ticks = 0;
+    pSampler->missedTicks = 0;
+    pSampler->maxLatenessNs = 0;
+}
+
+// Sampling loop. Runs on the calling thread until StopPeriodicSampler() is
+// called or the reader fails. Deadlines are start + n * period; if a tick
+// overruns by whole periods those deadlines are counted as missed instead of
+// being sampled back to back.
+static void
+RunPeriodicSampler(
+    PeriodicSampler *pSampler)
+{
+    uint64_t deadline = GetMonotonicTimeNs();
+    uint64_t tick = 0;
+
+    while (!pSampler->stop.load(std::memory_order_relaxed))
+    {
+        uint64_t now = GetMonotonicTimeNs();
+        if (now > deadline)
+        {
+            uint64_t lateness = now - deadline;
+            uint64_t missed = lateness / pSampler->periodNs;
+
+            if (missed)
+            {
+                pSampler->missedTicks += missed;
+                tick += missed;
+                deadline += missed * pSampler->periodNs;
+                lateness -= missed * pSampler->periodNs;
+            }
+            if (lateness > pSampler->maxLatenessNs)
+            {
+                pSampler->maxLatenessNs = lateness;
+            }
+        }
+
+        uint64_t *pValues = ReserveSampleRow(pSampler->pRing);
+        if (pValues)
+        {
+            if (pSampler->pReader(pSampler->pReaderData, pValues, pSampler->pRing->numValues) != 0)
+            {
+                break;
+            }
+            CommitSampleRow(pSampler->pRing, tick, now);
+        }
+        else
+        {
+            pSampler->pRing->droppedRows.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        pSampler->ticks++;
+        tick++;
+        deadline += pSampler->periodNs;
+        SleepUntilNs(deadline);
+    }
+
+    pSampler->finished.store(1, std::memory_order_release);
+}
+
+static void
+StopPeriodicSampler(
+    PeriodicSampler *pSampler)
+{
+    pSampler->stop.store(1, std::memory_order_relaxed);
+}
+
+#endif // HELPER_PERIODIC_SAMPLER_H_
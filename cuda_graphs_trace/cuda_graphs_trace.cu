@@ -3,13 +3,14 @@
  *
  * Sample CUPTI app to print the trace of CUDA graphs and correlate
  * the graph node launch to the node creation API using CUPTI callbacks.
+ * The graph topology is recorded once and every launch is folded into
+ * per node duration statistics and a critical path estimate.
  */
 
  // System headers
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <map>
 
 // CUDA headers
 #include <cuda.h>
@@ -17,19 +18,14 @@
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "graph_timeline.h"
 
 // Macros
 #define COMPUTE_N 50000
+#define DEFAULT_NUM_LAUNCHES 10
 
-// Data structures
-typedef struct ApiData_st
-{
-    const char *pFunctionName;
-    uint32_t correlationId;
-} ApiData;
-
-typedef std::map<uint64_t, ApiData> NodeIdApiDataMap;
-NodeIdApiDataMap nodeIdCorrelationMap;
+// Topology of the graphs and statistics of their launches.
+static GraphTimeline s_GraphTimeline;
 
 // Kernels
 __global__ void
@@ -63,7 +59,8 @@ VectorSubtract(
 // Functions
 static void
 DoPass(
-    cudaStream_t stream)
+    cudaStream_t stream,
+    int numLaunches)
 {
     int *pHostA, *pHostB, *pHostC;
     int *pDeviceA, *pDeviceB, *pDeviceC;
@@ -135,9 +132,16 @@ DoPass(
 
     RUNTIME_API_CALL(cudaGraphInstantiate(&graphExec, graph, NULL, NULL, 0));
 
-    RUNTIME_API_CALL(cudaGraphLaunch(graphExec, stream));
+    // Launch the same instantiated graph repeatedly, its topology is recorded only once.
+    for (int i = 0; i < numLaunches; i++)
+    {
+        RUNTIME_API_CALL(cudaGraphLaunch(graphExec, stream));
+    }
     RUNTIME_API_CALL(cudaStreamSynchronize(stream));
 
+    RUNTIME_API_CALL(cudaGraphExecDestroy(graphExec));
+    RUNTIME_API_CALL(cudaGraphDestroy(graph));
+
     // Free host memory.
     if (pHostA)
     {
@@ -171,37 +175,8 @@ void
 GraphTraceRecords(
     CUpti_Activity *pRecord)
 {
-    switch (pRecord->kind)
-    {
-        case CUPTI_ACTIVITY_KIND_MEMCPY:
-        {
-            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *) pRecord;
-
-            // Retrieve the information of the API used to create the node.
-            NodeIdApiDataMap::iterator it = nodeIdCorrelationMap.find(pMemcpyRecord->graphNodeId);
-            if (it != nodeIdCorrelationMap.end())
-            {
-                printf("Graph node was created using API %s with correlationId %u\n", it->second.pFunctionName, it->second.correlationId);
-            }
-            break;
-        }
-        case CUPTI_ACTIVITY_KIND_KERNEL:
-        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
-        {
-            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *) pRecord;
-
-            // Retrieve the information of the API used to create the node.
-            NodeIdApiDataMap::iterator it = nodeIdCorrelationMap.find(pKernelRecord->graphNodeId);
-            if (it != nodeIdCorrelationMap.end())
-            {
-                printf("Graph node was created using API %s with correlationId %u\n", it->second.pFunctionName, it->second.correlationId);
-            }
-
-            break;
-        }
-        default:
-            break;
-    }
+    // Attribute kernel, memcpy and memset records of graph launches to their node.
+    GraphTimelineAddRecord(&s_GraphTimeline, pRecord);
 }
 
 void CUPTIAPI
@@ -235,14 +210,24 @@ GraphsCallbackHandler(
                         break;
                     }
                     CUpti_GraphData *callbackData = (CUpti_GraphData *) pResourceData->resourceDescriptor;
+                    uint32_t graphId;
                     uint64_t nodeId;
 
-                    // Query the graph node ID and store the API correlation id and function name.
+                    // Query the graph and node IDs and add the node with its creation API to the graph topology.
+                    CUPTI_API_CALL(cuptiGetGraphId(callbackData->graph, &graphId));
+                    CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->node, &nodeId));
+                    GraphTimelineAddNode(&s_GraphTimeline, graphId, nodeId, s_pFunctionName, s_correlationId);
+                    break;
+                }
+                case CUPTI_CBID_RESOURCE_GRAPHNODE_DEPENDENCY_CREATED:
+                {
+                    CUpti_GraphData *callbackData = (CUpti_GraphData *) pResourceData->resourceDescriptor;
+                    uint64_t nodeId, dependencyId;
+
+                    // The node depends on the dependency node.
                     CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->node, &nodeId));
-                    ApiData apiData;
-                    apiData.correlationId = s_correlationId;
-                    apiData.pFunctionName = s_pFunctionName;
-                    nodeIdCorrelationMap[nodeId] = apiData;
+                    CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->dependency, &dependencyId));
+                    GraphTimelineAddDependency(&s_GraphTimeline, dependencyId, nodeId);
                     break;
                 }
                 case CUPTI_CBID_RESOURCE_GRAPHNODE_CLONED:
@@ -250,16 +235,10 @@ GraphsCallbackHandler(
                     CUpti_GraphData *callbackData = (CUpti_GraphData *) pResourceData->resourceDescriptor;
                     uint64_t nodeId, originalNodeId;
 
-                    // Overwrite the map entry with node ID of the cloned graph node.
+                    // Map the cloned graph node to the topology of the original node.
                     CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->originalNode, &originalNodeId));
-                    NodeIdApiDataMap::iterator it = nodeIdCorrelationMap.find(originalNodeId);
-                    if (it != nodeIdCorrelationMap.end())
-                    {
-                        CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->node, &nodeId));
-                        ApiData apiData = it->second;
-                        nodeIdCorrelationMap.erase(it);
-                        nodeIdCorrelationMap[nodeId] = apiData;
-                    }
+                    CUPTI_API_CALL(cuptiGetGraphNodeId(callbackData->node, &nodeId));
+                    GraphTimelineCloneNode(&s_GraphTimeline, originalNodeId, nodeId);
                     break;
                 }
                 default:
@@ -302,6 +281,7 @@ SetupCupti()
 
     // Enable callbacks for CUDA graph.
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RESOURCE, CUPTI_CBID_RESOURCE_GRAPHNODE_CREATED));
+    CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RESOURCE, CUPTI_CBID_RESOURCE_GRAPHNODE_DEPENDENCY_CREATED));
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RESOURCE, CUPTI_CBID_RESOURCE_GRAPHNODE_CLONED));
     CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API));
 }
@@ -313,6 +293,17 @@ main(
 {
     CUdevice device;
     char deviceName[256];
+    int numLaunches = DEFAULT_NUM_LAUNCHES;
+
+    if (argc > 1)
+    {
+        numLaunches = atoi(argv[1]);
+        if (numLaunches <= 0)
+        {
+            printf("Usage: %s [num_launches]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     SetupCupti();
 
@@ -328,12 +319,16 @@ main(
     // DoPass with user stream.
     cudaStream_t stream;
     RUNTIME_API_CALL(cudaStreamCreate(&stream));
-    DoPass(stream);
+    DoPass(stream, numLaunches);
 
     RUNTIME_API_CALL(cudaDeviceSynchronize());
     RUNTIME_API_CALL(cudaDeviceReset());
 
     DeInitCuptiTrace();
 
+    GraphTimelineFlush(&s_GraphTimeline);
+    PrintGraphTimeline(&s_GraphTimeline, stdout);
+    FreeGraphTimeline(&s_GraphTimeline);
+
     exit(EXIT_SUCCESS);
 }
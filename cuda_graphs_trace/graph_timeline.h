@@ -0,0 +1,629 @@
+/*
+ * Copyright 2020-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Node level timeline of CUDA graph launches used by the cuda_graphs_trace sample.
+ *
+ * The topology of every graph (its nodes and dependencies) is recorded once,
+ * from the CUPTI resource callbacks. Nodes cloned into an executable graph are
+ * mapped back to the node they were cloned from, so every instantiation shares
+ * the topology of its graph. Kernel, memcpy and memset records of graph
+ * launches are attributed to their node through graphNodeId and grouped into
+ * launches by correlationId. Each finished launch updates the per node
+ * duration statistics and a critical path estimate, and is then discarded.
+ * Memory is proportional to the size of the graphs, not to the number of
+ * launches.
+ */
+
+#ifndef GRAPH_TIMELINE_H_
+#define GRAPH_TIMELINE_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include "helper_cupti_activity.h"
+
+// Macros
+// Launches of the same graph that can be in flight at once; the oldest is finished when a new one needs a slot.
+#define GRAPH_OPEN_LAUNCHES 4
+
+// Data structures
+typedef struct GraphDurationStats_st
+{
+    uint64_t count;                                                  // Samples.
+    uint64_t totalNs;                                                // Sum of the samples.
+    uint64_t minNs;                                                  // Smallest sample.
+    uint64_t maxNs;                                                  // Largest sample.
+} GraphDurationStats;
+
+typedef struct GraphNode_st
+{
+    uint64_t           nodeId;                                       // Id of the node in the graph it was created in.
+    const char         *pApiName;                                    // API used to create the node.
+    uint32_t           apiCorrelationId;                             // Correlation id of that API.
+    const char         *pName;                                       // Kernel name from the first kernel record, NULL otherwise.
+    CUpti_ActivityKind kind;                                         // Activity kind of the node records, CUPTI_ACTIVITY_KIND_INVALID until one is seen.
+    uint8_t            copyKind;                                     // CUpti_ActivityMemcpyKind for memcpy nodes.
+    GraphDurationStats duration;                                     // Duration of the node across launches.
+    uint64_t           criticalCount;                                // Launches in which the node was on the critical path.
+} GraphNode;
+
+// Activity of one launch, indexed by node.
+typedef struct GraphLaunch_st
+{
+    uint32_t              correlationId;                             // Correlation id of the launch API.
+    uint32_t              numRecords;                                // Records attributed so far, 0 for a free slot.
+    uint64_t              sequence;                                  // Order in which the slot was opened.
+    std::vector<uint64_t> start;                                     // Start timestamp per node, 0 if not seen.
+    std::vector<uint64_t> end;                                       // End timestamp per node.
+} GraphLaunch;
+
+typedef struct GraphTopology_st
+{
+    uint32_t              graphId;                                   // Id of the graph the nodes were created in.
+    std::vector<GraphNode> nodes;                                    // Nodes in creation order.
+    uint32_t              numActiveNodes;                            // Nodes that produced activity records in any launch.
+    std::vector<uint32_t> edgeFrom;                                  // Dependency edges as node indices, edgeFrom[i] -> edgeTo[i].
+    std::vector<uint32_t> edgeTo;
+    bool                  orderValid;                                // False when nodes or edges changed since the order was computed.
+    std::vector<uint32_t> order;                                     // Nodes in topological order.
+    std::vector<uint32_t> predOffsets;                               // Predecessors of node i are preds[predOffsets[i] .. predOffsets[i + 1]).
+    std::vector<uint32_t> preds;
+    std::vector<uint64_t> finish;                                    // Scratch for the critical path: longest path ending at each node.
+    std::vector<int32_t>  criticalPred;                              // Scratch for the critical path: predecessor on that path.
+    GraphLaunch           launches[GRAPH_OPEN_LAUNCHES];             // Launches in flight.
+    uint64_t              nextSequence;                              // Sequence of the next opened launch.
+    uint64_t              incompleteLaunches;                        // Launches finished without a record from every active node.
+    GraphDurationStats    span;                                      // First node start to last node end, per launch.
+    GraphDurationStats    criticalPath;                              // Critical path estimate, per launch.
+} GraphTopology;
+
+typedef struct GraphNodeRef_st
+{
+    uint32_t topologyIndex;                                          // Index in GraphTimeline::topologies.
+    uint32_t nodeIndex;                                              // Index in GraphTopology::nodes.
+} GraphNodeRef;
+
+typedef struct GraphTimeline_st
+{
+    std::vector<GraphTopology *>               topologies;           // One per graph.
+    std::unordered_map<uint32_t, uint32_t>     graphIndex;           // Graph id -> index in topologies.
+    std::unordered_map<uint64_t, GraphNodeRef> nodeIndex;            // Node id, including cloned ids -> node.
+    uint64_t                                   unattributedRecords;  // Graph records whose node is unknown.
+} GraphTimeline;
+
+// Helper Functions
+static void
+AddGraphDuration(
+    GraphDurationStats *pStats,
+    uint64_t durationNs)
+{
+    if (pStats->count == 0 || durationNs < pStats->minNs)
+    {
+        pStats->minNs = durationNs;
+    }
+    if (durationNs > pStats->maxNs)
+    {
+        pStats->maxNs = durationNs;
+    }
+    pStats->totalNs += durationNs;
+    pStats->count++;
+}
+
+static GraphTopology *
+GetGraphTopology(
+    GraphTimeline *pTimeline,
+    uint32_t graphId,
+    uint32_t *pTopologyIndex)
+{
+    std::unordered_map<uint32_t, uint32_t>::iterator it = pTimeline->graphIndex.find(graphId);
+    if (it != pTimeline->graphIndex.end())
+    {
+        *pTopologyIndex = it->second;
+        return pTimeline->topologies[it->second];
+    }
+
+    GraphTopology *pTopology = new GraphTopology();
+    pTopology->graphId = graphId;
+    pTopology->numActiveNodes = 0;
+    pTopology->orderValid = false;
+    pTopology->nextSequence = 1;
+    pTopology->incompleteLaunches = 0;
+    memset(&pTopology->span, 0, sizeof(GraphDurationStats));
+    memset(&pTopology->criticalPath, 0, sizeof(GraphDurationStats));
+    for (int i = 0; i < GRAPH_OPEN_LAUNCHES; i++)
+    {
+        pTopology->launches[i].correlationId = 0;
+        pTopology->launches[i].numRecords = 0;
+        pTopology->launches[i].sequence = 0;
+    }
+
+    *pTopologyIndex = (uint32_t)pTimeline->topologies.size();
+    pTimeline->graphIndex[graphId] = *pTopologyIndex;
+    pTimeline->topologies.push_back(pTopology);
+
+    return pTopology;
+}
+
+// Compute the topological order and the predecessor lists (Kahn's algorithm).
+// If the edges contain a cycle the remaining nodes are appended in creation order.
+static void
+ComputeGraphOrder(
+    GraphTopology *pTopology)
+{
+    uint32_t numNodes = (uint32_t)pTopology->nodes.size();
+    std::vector<uint32_t> inDegree(numNodes, 0);
+    std::vector<uint32_t> succOffsets(numNodes + 1, 0);
+    std::vector<uint32_t> succs(pTopology->edgeTo.size());
+
+    pTopology->predOffsets.assign(numNodes + 1, 0);
+    pTopology->preds.resize(pTopology->edgeFrom.size());
+
+    for (size_t i = 0; i < pTopology->edgeFrom.size(); i++)
+    {
+        succOffsets[pTopology->edgeFrom[i] + 1]++;
+        pTopology->predOffsets[pTopology->edgeTo[i] + 1]++;
+        inDegree[pTopology->edgeTo[i]]++;
+    }
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        succOffsets[i + 1] += succOffsets[i];
+        pTopology->predOffsets[i + 1] += pTopology->predOffsets[i];
+    }
+
+    std::vector<uint32_t> succFill(succOffsets.begin(), succOffsets.end() - 1);
+    std::vector<uint32_t> predFill(pTopology->predOffsets.begin(), pTopology->predOffsets.end() - 1);
+    for (size_t i = 0; i < pTopology->edgeFrom.size(); i++)
+    {
+        succs[succFill[pTopology->edgeFrom[i]]++] = pTopology->edgeTo[i];
+        pTopology->preds[predFill[pTopology->edgeTo[i]]++] = pTopology->edgeFrom[i];
+    }
+
+    std::vector<bool> placed(numNodes, false);
+    pTopology->order.clear();
+    pTopology->order.reserve(numNodes);
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        if (inDegree[i] == 0)
+        {
+            pTopology->order.push_back(i);
+            placed[i] = true;
+        }
+    }
+    for (size_t head = 0; head < pTopology->order.size(); head++)
+    {
+        uint32_t node = pTopology->order[head];
+        for (uint32_t s = succOffsets[node]; s < succOffsets[node + 1]; s++)
+        {
+            if (--inDegree[succs[s]] == 0)
+            {
+                pTopology->order.push_back(succs[s]);
+                placed[succs[s]] = true;
+            }
+        }
+    }
+    for (uint32_t i = 0; i < numNodes; i++)
+    {
+        if (!placed[i])
+        {
+            pTopology->order.push_back(i);
+        }
+    }
+
+    pTopology->finish.resize(numNodes);
+    pTopology->criticalPred.resize(numNodes);
+    pTopology->orderValid = true;
+}
+
+// Fold a launch into the statistics of its graph and free its slot.
+static void
+FinishGraphLaunch(
+    GraphTopology *pTopology,
+    GraphLaunch *pLaunch)
+{
+    uint64_t firstStart = 0;
+    uint64_t lastEnd = 0;
+    uint64_t criticalNs = 0;
+    int32_t criticalNode = -1;
+
+    if (!pTopology->orderValid)
+    {
+        ComputeGraphOrder(pTopology);
+    }
+    if (pLaunch->start.size() < pTopology->nodes.size())
+    {
+        pLaunch->start.resize(pTopology->nodes.size(), 0);
+        pLaunch->end.resize(pTopology->nodes.size(), 0);
+    }
+
+    // Longest path through the dependencies, weighted by the node durations of this launch.
+    for (size_t i = 0; i < pTopology->order.size(); i++)
+    {
+        uint32_t node = pTopology->order[i];
+        uint64_t best = 0;
+        int32_t bestPred = -1;
+
+        for (uint32_t p = pTopology->predOffsets[node]; p < pTopology->predOffsets[node + 1]; p++)
+        {
+            uint32_t pred = pTopology->preds[p];
+            if (bestPred < 0 || pTopology->finish[pred] > best)
+            {
+                best = pTopology->finish[pred];
+                bestPred = (int32_t)pred;
+            }
+        }
+
+        if (pLaunch->start[node])
+        {
+            best += pLaunch->end[node] - pLaunch->start[node];
+
+            if (firstStart == 0 || pLaunch->start[node] < firstStart)
+            {
+                firstStart = pLaunch->start[node];
+            }
+            if (pLaunch->end[node] > lastEnd)
+            {
+                lastEnd = pLaunch->end[node];
+            }
+        }
+
+        pTopology->finish[node] = best;
+        pTopology->criticalPred[node] = bestPred;
+        if (criticalNode < 0 || best > criticalNs)
+        {
+            criticalNs = best;
+            criticalNode = (int32_t)node;
+        }
+    }
+
+    for (int32_t node = criticalNode; node >= 0; node = pTopology->criticalPred[node])
+    {
+        if (pLaunch->start[node])
+        {
+            pTopology->nodes[node].criticalCount++;
+        }
+    }
+
+    if (pLaunch->numRecords < pTopology->numActiveNodes)
+    {
+        pTopology->incompleteLaunches++;
+    }
+    AddGraphDuration(&pTopology->span, lastEnd - firstStart);
+    AddGraphDuration(&pTopology->criticalPath, criticalNs);
+
+    pLaunch->numRecords = 0;
+}
+
+// Return the slot of the launch with correlationId, opening one if needed.
+static GraphLaunch *
+GetGraphLaunch(
+    GraphTopology *pTopology,
+    uint32_t correlationId)
+{
+    GraphLaunch *pSlot = NULL;
+
+    for (int i = 0; i < GRAPH_OPEN_LAUNCHES; i++)
+    {
+        GraphLaunch *pLaunch = &pTopology->launches[i];
+        if (pLaunch->numRecords && pLaunch->correlationId == correlationId)
+        {
+            return pLaunch;
+        }
+        if (!pSlot ||
+            (pSlot->numRecords && (!pLaunch->numRecords || pLaunch->sequence < pSlot->sequence)))
+        {
+            pSlot = pLaunch;
+        }
+    }
+
+    if (pSlot->numRecords)
+    {
+        FinishGraphLaunch(pTopology, pSlot);
+    }
+
+    size_t numNodes = pTopology->nodes.size();
+    pSlot->correlationId = correlationId;
+    pSlot->sequence = pTopology->nextSequence++;
+    pSlot->start.assign(numNodes, 0);
+    pSlot->end.assign(numNodes, 0);
+
+    return pSlot;
+}
+
+// Topology Functions
+
+// Record a node created by the API pApiName in the graph graphId.
+static void
+GraphTimelineAddNode(
+    GraphTimeline *pTimeline,
+    uint32_t graphId,
+    uint64_t nodeId,
+    const char *pApiName,
+    uint32_t apiCorrelationId)
+{
+    GraphNodeRef ref;
+    GraphTopology *pTopology = GetGraphTopology(pTimeline, graphId, &ref.topologyIndex);
+    GraphNode node;
+
+    memset(&node, 0, sizeof(GraphNode));
+    node.nodeId = nodeId;
+    node.pApiName = pApiName;
+    node.apiCorrelationId = apiCorrelationId;
+    node.kind = CUPTI_ACTIVITY_KIND_INVALID;
+
+    ref.nodeIndex = (uint32_t)pTopology->nodes.size();
+    pTopology->nodes.push_back(node);
+    pTopology->orderValid = false;
+    pTimeline->nodeIndex[nodeId] = ref;
+}
+
+// Record that nodeId depends on dependencyId. Edges across graphs are ignored.
+static void
+GraphTimelineAddDependency(
+    GraphTimeline *pTimeline,
+    uint64_t dependencyId,
+    uint64_t nodeId)
+{
+    std::unordered_map<uint64_t, GraphNodeRef>::iterator from = pTimeline->nodeIndex.find(dependencyId);
+    std::unordered_map<uint64_t, GraphNodeRef>::iterator to = pTimeline->nodeIndex.find(nodeId);
+
+    if (from == pTimeline->nodeIndex.end() || to == pTimeline->nodeIndex.end() ||
+        from->second.topologyIndex != to->second.topologyIndex)
+    {
+        return;
+    }
+
+    GraphTopology *pTopology = pTimeline->topologies[to->second.topologyIndex];
+    for (size_t i = 0; i < pTopology->edgeFrom.size(); i++)
+    {
+        if (pTopology->edgeFrom[i] == from->second.nodeIndex && pTopology->edgeTo[i] == to->second.nodeIndex)
+        {
+            return;
+        }
+    }
+
+    pTopology->edgeFrom.push_back(from->second.nodeIndex);
+    pTopology->edgeTo.push_back(to->second.nodeIndex);
+    pTopology->orderValid = false;
+}
+
+// Map a cloned node, e.g. the copy made by cudaGraphInstantiate, to the node it was cloned from.
+static void
+GraphTimelineCloneNode(
+    GraphTimeline *pTimeline,
+    uint64_t originalNodeId,
+    uint64_t nodeId)
+{
+    std::unordered_map<uint64_t, GraphNodeRef>::iterator it = pTimeline->nodeIndex.find(originalNodeId);
+    if (it != pTimeline->nodeIndex.end())
+    {
+        GraphNodeRef ref = it->second;
+        pTimeline->nodeIndex[nodeId] = ref;
+    }
+}
+
+// Activity Functions
+
+// Attribute a kernel, memcpy or memset record of a graph launch to its node.
+// Returns true if the record belongs to a known graph node.
+static bool
+GraphTimelineAddRecord(
+    GraphTimeline *pTimeline,
+    CUpti_Activity *pRecord)
+{
+    uint64_t graphNodeId = 0;
+    uint32_t correlationId = 0;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    const char *pName = NULL;
+    uint8_t copyKind = 0;
+
+    switch (pRecord->kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
+            graphNodeId = pKernelRecord->graphNodeId;
+            correlationId = pKernelRecord->correlationId;
+            start = pKernelRecord->start;
+            end = pKernelRecord->end;
+            pName = pKernelRecord->name;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
+            graphNodeId = pMemcpyRecord->graphNodeId;
+            correlationId = pMemcpyRecord->correlationId;
+            start = pMemcpyRecord->start;
+            end = pMemcpyRecord->end;
+            copyKind = pMemcpyRecord->copyKind;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
+            graphNodeId = pMemsetRecord->graphNodeId;
+            correlationId = pMemsetRecord->correlationId;
+            start = pMemsetRecord->start;
+            end = pMemsetRecord->end;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    // Not part of a graph launch.
+    if (graphNodeId == 0)
+    {
+        return false;
+    }
+
+    std::unordered_map<uint64_t, GraphNodeRef>::iterator it = pTimeline->nodeIndex.find(graphNodeId);
+    if (it == pTimeline->nodeIndex.end())
+    {
+        pTimeline->unattributedRecords++;
+        return false;
+    }
+
+    GraphTopology *pTopology = pTimeline->topologies[it->second.topologyIndex];
+    uint32_t nodeIndex = it->second.nodeIndex;
+    GraphNode *pNode = &pTopology->nodes[nodeIndex];
+
+    if (pNode->kind == CUPTI_ACTIVITY_KIND_INVALID)
+    {
+        pNode->kind = pRecord->kind;
+        pNode->pName = pName;
+        pNode->copyKind = copyKind;
+        pTopology->numActiveNodes++;
+    }
+    AddGraphDuration(&pNode->duration, end - start);
+
+    GraphLaunch *pLaunch = GetGraphLaunch(pTopology, correlationId);
+    if (nodeIndex >= pLaunch->start.size())
+    {
+        // Node added after the launch was opened.
+        pLaunch->start.resize(pTopology->nodes.size(), 0);
+        pLaunch->end.resize(pTopology->nodes.size(), 0);
+    }
+    if (pLaunch->start[nodeIndex] == 0)
+    {
+        pLaunch->start[nodeIndex] = start;
+        pLaunch->end[nodeIndex] = end;
+        pLaunch->numRecords++;
+    }
+
+    // Every node has reported, the launch is complete. Launches of graphs with nodes
+    // that produce no activity (e.g. host or empty nodes) finish when their slot is reused.
+    if (pLaunch->numRecords == pTopology->nodes.size())
+    {
+        FinishGraphLaunch(pTopology, pLaunch);
+    }
+
+    return true;
+}
+
+// Finish the launches still in flight, e.g. after the last activity buffer.
+static void
+GraphTimelineFlush(
+    GraphTimeline *pTimeline)
+{
+    for (size_t t = 0; t < pTimeline->topologies.size(); t++)
+    {
+        GraphTopology *pTopology = pTimeline->topologies[t];
+
+        for (;;)
+        {
+            GraphLaunch *pOldest = NULL;
+            for (int i = 0; i < GRAPH_OPEN_LAUNCHES; i++)
+            {
+                if (pTopology->launches[i].numRecords &&
+                    (!pOldest || pTopology->launches[i].sequence < pOldest->sequence))
+                {
+                    pOldest = &pTopology->launches[i];
+                }
+            }
+            if (!pOldest)
+            {
+                break;
+            }
+            FinishGraphLaunch(pTopology, pOldest);
+        }
+    }
+}
+
+static uint64_t
+AverageGraphDuration(
+    const GraphDurationStats *pStats)
+{
+    return pStats->count ? pStats->totalNs / pStats->count : 0;
+}
+
+static void
+PrintGraphTimeline(
+    const GraphTimeline *pTimeline,
+    FILE *pFileHandle)
+{
+    for (size_t t = 0; t < pTimeline->topologies.size(); t++)
+    {
+        const GraphTopology *pTopology = pTimeline->topologies[t];
+
+        // Graphs that were never launched, e.g. the graphs built internally by instantiation.
+        if (pTopology->span.count == 0)
+        {
+            continue;
+        }
+
+        fprintf(pFileHandle, "\nGraph %u: %zu nodes, %zu dependencies, %llu launches (%llu incomplete)\n",
+                pTopology->graphId,
+                pTopology->nodes.size(),
+                pTopology->edgeFrom.size(),
+                (unsigned long long)pTopology->span.count,
+                (unsigned long long)pTopology->incompleteLaunches);
+        fprintf(pFileHandle, "  Launch span ns: avg %llu, min %llu, max %llu\n",
+                (unsigned long long)AverageGraphDuration(&pTopology->span),
+                (unsigned long long)pTopology->span.minNs,
+                (unsigned long long)pTopology->span.maxNs);
+        fprintf(pFileHandle, "  Critical path ns: avg %llu, min %llu, max %llu\n",
+                (unsigned long long)AverageGraphDuration(&pTopology->criticalPath),
+                (unsigned long long)pTopology->criticalPath.minNs,
+                (unsigned long long)pTopology->criticalPath.maxNs);
+
+        for (size_t n = 0; n < pTopology->nodes.size(); n++)
+        {
+            const GraphNode *pNode = &pTopology->nodes[n];
+            const char *pName = pNode->pName;
+
+            if (pNode->kind == CUPTI_ACTIVITY_KIND_MEMCPY)
+            {
+                pName = GetMemcpyKindString((CUpti_ActivityMemcpyKind)pNode->copyKind);
+            }
+            else if (pNode->kind == CUPTI_ACTIVITY_KIND_INVALID)
+            {
+                pName = "<no activity>";
+            }
+
+            fprintf(pFileHandle, "  node %llu %s \"%s\" (%s, correlationId %u): count %llu, avg %llu ns, min %llu ns, max %llu ns, critical %llu\n",
+                    (unsigned long long)pNode->nodeId,
+                    pNode->kind == CUPTI_ACTIVITY_KIND_INVALID ? "-" : GetActivityKindString(pNode->kind),
+                    GetName(pName),
+                    GetName(pNode->pApiName),
+                    pNode->apiCorrelationId,
+                    (unsigned long long)pNode->duration.count,
+                    (unsigned long long)AverageGraphDuration(&pNode->duration),
+                    (unsigned long long)pNode->duration.minNs,
+                    (unsigned long long)pNode->duration.maxNs,
+                    (unsigned long long)pNode->criticalCount);
+        }
+    }
+
+    if (pTimeline->unattributedRecords)
+    {
+        fprintf(pFileHandle, "\n%llu graph records had an unknown graph node\n",
+                (unsigned long long)pTimeline->unattributedRecords);
+    }
+}
+
+static void
+FreeGraphTimeline(
+    GraphTimeline *pTimeline)
+{
+    for (size_t t = 0; t < pTimeline->topologies.size(); t++)
+    {
+        delete pTimeline->topologies[t];
+    }
+    pTimeline->topologies.clear();
+    pTimeline->graphIndex.clear();
+    pTimeline->nodeIndex.clear();
+}
+
+#endif // GRAPH_TIMELINE_H_
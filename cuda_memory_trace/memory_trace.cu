@@ -5,6 +5,11 @@
  * The sample also traces CUDA memory operations done via
  * default memory pool.
  *
+ * The MEMORY2 and MEMORY_POOL records are also fed to the footprint tracker
+ * of helper_cupti_memory_footprint.h, which reports the footprint of every
+ * device over time, the largest allocations at the peak, the memory pool
+ * utilization and the allocations never released.
+ *
  */
 
 // System headers
@@ -18,8 +23,12 @@
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_memory_footprint.h"
 #include "helper_cupti.h"
 
+// Global variables
+static MemoryFootprintTracker s_FootprintTracker;
+
 // Kernels
 __global__ void
 VectorAdd(
@@ -36,6 +45,13 @@ VectorAdd(
 }
 
 // Functions
+static void
+FootprintPostProcessRecord(
+    CUpti_Activity *pRecord)
+{
+    MemoryFootprintAddRecord(&s_FootprintTracker, pRecord);
+}
+
 static void
 DoMemoryAllocations()
 {
@@ -150,9 +166,11 @@ SetupCupti()
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
-    pUserData->pPostProcessActivityRecords = NULL;
+    pUserData->pPostProcessActivityRecords = FootprintPostProcessRecord;
     pUserData->printActivityRecords        = 1;
 
+    InitMemoryFootprintTracker(&s_FootprintTracker, MEMORY_FOOTPRINT_DEFAULT_INTERVAL_NS);
+
     // Common CUPTI Initialization
     InitCuptiTrace(pUserData, NULL, stdout);
 
@@ -184,5 +202,8 @@ main(
 
     DeInitCuptiTrace();
 
+    PrintMemoryFootprintReport(&s_FootprintTracker, stdout);
+    FreeMemoryFootprintTracker(&s_FootprintTracker);
+
     exit(EXIT_SUCCESS);
 }
@@ -4,14 +4,16 @@
  * Sample to show how to correlate CUDA APIs with the corresponding GPU
  * activities using the correlation-id field in the activity records.
  *
+ * Records are joined on the fly as the activity buffers complete, so the
+ * memory used is bounded by the correlation ids in flight, not by the
+ * length of the run.
+ *
  */
 
 // System headers
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <map>
-using namespace std;
 
 // CUDA headers
 #include <cuda.h>
@@ -19,16 +21,18 @@ using namespace std;
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_correlation.h"
 
 // Macros
 #define COMPUTE_N 50000
 
-// Map to store correlation id and its corresponding activity record.
-static std::map<uint32_t, CUpti_Activity *> s_CorrelationMap;
-static std::map<uint32_t, CUpti_Activity *> s_ConnectionMap;
+// Maximum number of correlation ids waiting for their partner.
+#define CORRELATION_JOIN_CAPACITY 4096
+// Unmatched records older than this, relative to the latest API record, are evicted.
+#define CORRELATION_MAX_AGE_NS (10ULL * 1000 * 1000 * 1000)
 
-// Iterator to traverse the map.
-static std::map<uint32_t, CUpti_Activity *>::iterator s_Iter;
+// Join of the API and GPU activity records.
+static CorrelationJoin s_CorrelationJoin;
 
 // Kernels
 __global__ void
@@ -136,155 +140,92 @@ DoPass(
     }
 }
 
+// Print an API call and the GPU activity it generated once the join matched them.
 static void
-PrintCorrealtionInformation()
+PrintCorrelationPair(
+    void *pUserData,
+    const CorrelationEntry *pEntry)
 {
-    s_Iter = s_CorrelationMap.begin();
-    // Iterate over the map using Iterator till end.
-    while (s_Iter != s_CorrelationMap.end())
+    FILE *pFileHandle = (FILE *)pUserData;
+    const char *pApiName = NULL;
+
+    if (pEntry->api.kind == CUPTI_ACTIVITY_KIND_DRIVER)
     {
-        // s_Iter->first is correlation id and s_Iter->second is activity record.
-        switch (s_Iter->second->kind) {
-            case CUPTI_ACTIVITY_KIND_MEMCPY:
-            {
-                CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)s_Iter->second;
-                // Check whether memcpy correlation id is present in connection map.
-                if (s_ConnectionMap.find(pMemcpyRecord->correlationId) != s_ConnectionMap.end())
-                {
-                    printf("\nCUDA_API AND GPU ACTIVITY CORRELATION : correlation %u\n", pMemcpyRecord->correlationId);
-
-                    PrintActivity(s_Iter->second, stdout);
-
-                    CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)s_ConnectionMap[pMemcpyRecord->correlationId];
-                    if (pApiRecord != NULL)
-                    {
-                        PrintActivity((CUpti_Activity *)pApiRecord, stdout);
-                    }
-                }
-                break;
-            }
-            case CUPTI_ACTIVITY_KIND_MEMSET:
-            {
-                CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)s_Iter->second;
-                // Check whether memset correlation id is present in connection map.
-                if (s_ConnectionMap.find(pMemsetRecord->correlationId) != s_ConnectionMap.end())
-                {
-                    printf("\nCUDA_API AND GPU ACTIVITY CORRELATION : correlation %u\n", pMemsetRecord->correlationId);
-
-                    PrintActivity(s_Iter->second, stdout);
-
-                    CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)s_ConnectionMap[pMemsetRecord->correlationId];
-                    if (pApiRecord != NULL)
-                    {
-                        PrintActivity((CUpti_Activity *)pApiRecord, stdout);
-                    }
-                }
-                break;
-            }
-            case CUPTI_ACTIVITY_KIND_KERNEL:
-            case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
-            {
-                CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)s_Iter->second;
-                // Check whether kernel correlation id is present in connection map.
-                if (s_ConnectionMap.find(pKernelRecord->correlationId) != s_ConnectionMap.end())
-                {
-                    printf("\nCUDA_API AND GPU ACTIVITY CORRELATION : correlation %u\n", pKernelRecord->correlationId);
-
-                    PrintActivity(s_Iter->second, stdout);
-
-                    CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)s_ConnectionMap[pKernelRecord->correlationId];
-                    if (pApiRecord != NULL)
-                    {
-                        PrintActivity((CUpti_Activity *)pApiRecord, stdout);
-                    }
-
-                }
-                break;
-            }
-            default:
-                break;
-        }
-
-        // Free the allocated memory for the activity record
-        free(s_Iter->second);
-        s_Iter++;
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_DRIVER_API, pEntry->api.cbid, &pApiName);
     }
-    for (auto& pair : s_ConnectionMap) {
-        free(pair.second);
+    else
+    {
+        cuptiGetCallbackName(CUPTI_CB_DOMAIN_RUNTIME_API, pEntry->api.cbid, &pApiName);
     }
-    s_CorrelationMap.clear();
-    s_ConnectionMap.clear();
+
+    fprintf(pFileHandle, "\nCUDA_API AND GPU ACTIVITY CORRELATION : correlation %u\n", pEntry->correlationId);
+
+    if (pEntry->gpu.kind == CUPTI_ACTIVITY_KIND_MEMCPY)
+    {
+        fprintf(pFileHandle, "%s [ %llu, %llu ] duration %llu, \"%s\", bytes %llu, device %u, context %u, stream %u\n",
+                GetActivityKindString((CUpti_ActivityKind)pEntry->gpu.kind),
+                (unsigned long long)pEntry->gpu.start,
+                (unsigned long long)pEntry->gpu.end,
+                (unsigned long long)(pEntry->gpu.end - pEntry->gpu.start),
+                GetMemcpyKindString((CUpti_ActivityMemcpyKind)pEntry->gpu.copyKind),
+                (unsigned long long)pEntry->gpu.bytes,
+                pEntry->gpu.deviceId,
+                pEntry->gpu.contextId,
+                pEntry->gpu.streamId);
+    }
+    else if (pEntry->gpu.kind == CUPTI_ACTIVITY_KIND_MEMSET)
+    {
+        fprintf(pFileHandle, "%s [ %llu, %llu ] duration %llu, bytes %llu, device %u, context %u, stream %u\n",
+                GetActivityKindString((CUpti_ActivityKind)pEntry->gpu.kind),
+                (unsigned long long)pEntry->gpu.start,
+                (unsigned long long)pEntry->gpu.end,
+                (unsigned long long)(pEntry->gpu.end - pEntry->gpu.start),
+                (unsigned long long)pEntry->gpu.bytes,
+                pEntry->gpu.deviceId,
+                pEntry->gpu.contextId,
+                pEntry->gpu.streamId);
+    }
+    else
+    {
+        fprintf(pFileHandle, "%s [ %llu, %llu ] duration %llu, \"%s\", device %u, context %u, stream %u\n",
+                GetActivityKindString((CUpti_ActivityKind)pEntry->gpu.kind),
+                (unsigned long long)pEntry->gpu.start,
+                (unsigned long long)pEntry->gpu.end,
+                (unsigned long long)(pEntry->gpu.end - pEntry->gpu.start),
+                GetName(pEntry->gpu.pName),
+                pEntry->gpu.deviceId,
+                pEntry->gpu.contextId,
+                pEntry->gpu.streamId);
+    }
+
+    fprintf(pFileHandle, "%s [ %llu, %llu ] duration %llu, \"%s\", cbid %u, process %u, thread %u\n",
+            GetActivityKindString((CUpti_ActivityKind)pEntry->api.kind),
+            (unsigned long long)pEntry->api.start,
+            (unsigned long long)pEntry->api.end,
+            (unsigned long long)(pEntry->api.end - pEntry->api.start),
+            GetName(pApiName),
+            pEntry->api.cbid,
+            pEntry->api.processId,
+            pEntry->api.threadId);
 }
 
-// Store the runtime and driver API records in s_ConnectionMap and others in s_CorrelationMap.
+// Feed every record to the join; matched pairs are printed from within.
 void
 CorrelationActivityRecords(
     CUpti_Activity *pRecord)
 {
-    switch (pRecord->kind)
-    {
-        case CUPTI_ACTIVITY_KIND_MEMCPY:
-        {
-            CUpti_ActivityMemcpy6 *pMemcpyRecord = (CUpti_ActivityMemcpy6 *)pRecord;
-            uint32_t recordSize = sizeof(CUpti_ActivityMemcpy6);
-
-            // Creating copy of the record to print correaltion data after the application is over.
-            CUpti_Activity *pRecordCopy = (CUpti_Activity *)malloc(recordSize);
-            MEMORY_ALLOCATION_CALL(pRecordCopy);
-            memset(pRecordCopy, 0, recordSize);
-            memcpy(pRecordCopy, pRecord, recordSize);
-
-            s_CorrelationMap[pMemcpyRecord->correlationId] = pRecordCopy;
-
-            break;
-        }
-        case CUPTI_ACTIVITY_KIND_MEMSET:
-        {
-            CUpti_ActivityMemset4 *pMemsetRecord = (CUpti_ActivityMemset4 *)pRecord;
-            uint32_t recordSize = sizeof(CUpti_ActivityMemset4);
-
-            // Creating copy of the record to print correaltion data after the application is over.
-            CUpti_Activity *pRecordCopy = (CUpti_Activity *)malloc(recordSize);
-            MEMORY_ALLOCATION_CALL(pRecordCopy);
-            memset(pRecordCopy, 0, recordSize);
-            memcpy(pRecordCopy, pRecord, recordSize);
-
-            s_CorrelationMap[pMemsetRecord->correlationId] = pRecordCopy;
-            break;
-        }
-        case CUPTI_ACTIVITY_KIND_KERNEL:
-        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
-        {
-            CUpti_ActivityKernel10 *pKernelRecord = (CUpti_ActivityKernel10 *)pRecord;
-            uint32_t recordSize = sizeof(CUpti_ActivityKernel10);
-
-            // Creating copy of the record to print correaltion data after the application is over.
-            CUpti_Activity *pRecordCopy = (CUpti_Activity *)malloc(recordSize);
-            MEMORY_ALLOCATION_CALL(pRecordCopy);
-            memset(pRecordCopy, 0, recordSize);
-            memcpy(pRecordCopy, pRecord, recordSize);
-
-            s_CorrelationMap[pKernelRecord->correlationId] = pRecordCopy;
-            break;
-        }
-        case CUPTI_ACTIVITY_KIND_RUNTIME:
-        case CUPTI_ACTIVITY_KIND_DRIVER:
-        {
-            CUpti_ActivityAPI *pApiRecord = (CUpti_ActivityAPI *)pRecord;
-            uint32_t recordSize = sizeof(CUpti_ActivityAPI);
-
-            // Creating copy of the record to print correaltion data after the application is over.
-            CUpti_Activity *pRecordCopy = (CUpti_Activity *)malloc(recordSize);
-            MEMORY_ALLOCATION_CALL(pRecordCopy);
-            memset(pRecordCopy, 0, recordSize);
-            memcpy(pRecordCopy, pRecord, recordSize);
-
-            s_ConnectionMap[pApiRecord->correlationId] = pRecordCopy;
-            break;
-        }
-        default:
-            break;
-    }
+    CorrelationJoinAddRecord(&s_CorrelationJoin, pRecord);
+}
+
+static void
+PrintCorrelationSummary()
+{
+    printf("\nCorrelation join: %llu matched, %llu API calls without GPU activity, %llu GPU activities without API record, peak %u of %u entries in flight\n",
+           (unsigned long long)s_CorrelationJoin.numMatched,
+           (unsigned long long)s_CorrelationJoin.numEvictedApi,
+           (unsigned long long)s_CorrelationJoin.numEvictedGpu,
+           s_CorrelationJoin.peakEntries,
+           s_CorrelationJoin.capacity);
 }
 
 static void
@@ -297,6 +238,10 @@ SetupCupti()
     pUserData->pPostProcessActivityRecords = CorrelationActivityRecords;
     pUserData->printActivityRecords        = 0;
 
+    // Most API calls have no GPU activity, those are only counted when evicted.
+    InitCorrelationJoin(&s_CorrelationJoin, CORRELATION_JOIN_CAPACITY, CORRELATION_MAX_AGE_NS,
+                        PrintCorrelationPair, NULL, stdout);
+
     // Common CUPTI Initialization
     InitCuptiTrace(pUserData, NULL, stdout);
 
@@ -338,7 +283,10 @@ main(
 
     DeInitCuptiTrace();
 
-    PrintCorrealtionInformation();
+    // Evict whatever is still waiting for a partner.
+    CorrelationJoinFlush(&s_CorrelationJoin);
+    PrintCorrelationSummary();
+    FreeCorrelationJoin(&s_CorrelationJoin);
 
     exit(EXIT_SUCCESS);
 }
@@ -14,14 +14,16 @@
  * cuptiActivityPopExternalCorrelationId()
  * All CUDA activity activities within this range will generate external correlation
  * record which then can be used to correlate it with the external API
+ *
+ * The kernel and memcpy records are joined with the external correlation records
+ * through their correlation ids, and the GPU time, bytes and launches of every
+ * external id are summarized at the end (helper_cupti_external_rollup.h).
  */
 
 // System headers
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <vector>
-#include <map>
 
 // CUDA headers
 #include <cuda.h>
@@ -29,6 +31,7 @@
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_external_rollup.h"
 
 // Enum mapping the external id to the different phases in the vector addition it correlates to.
 typedef enum ExternalId_st
@@ -39,8 +42,8 @@ typedef enum ExternalId_st
     MAX_EXTERNAL_ID = 3
 } ExternalId;
 
-// Map to book-keep the correlation ids mapped to the external ids.
-static std::map<uint64_t, std::vector<uint32_t> > s_externalCorrelationMap;
+// GPU cost of the external ids, from the correlation ids mapped to them.
+static ExternalRollup s_externalRollup;
 
 // Kernels
 __global__ void
@@ -170,65 +173,22 @@ DoVectorAddition() {
 static void
 ShowExternalCorrelation()
 {
-    // Print the summary of extenal ids mapping with the correaltion ids.
-    printf ("\n=== SUMMARY ===");
-    for (auto externalIdIter : s_externalCorrelationMap)
-    {
-        printf("\nExternal Id: %llu: ", (unsigned long long)externalIdIter.first);
-
-        if (externalIdIter.first == INITIALIZATION_EXTERNAL_ID)
-        {
-            printf("INITIALIZATION_EXTERNAL_ID");
-        }
-        else if (externalIdIter.first == EXECUTION_EXTERNAL_ID)
-        {
-            printf("EXECUTION_EXTERNAL_ID");
-        }
-        else if (externalIdIter.first == CLEANUP_EXTERNAL_ID)
-        {
-            printf("CLEANUP_EXTERNAL_ID");
-        }
-
-        printf("\n  Correlate to CUPTI records with correlation ids: ");
-
-        auto correlationIter = externalIdIter.second;
-        for (auto correlationId : correlationIter)
-        {
-            printf("%u ", correlationId);
-        }
-
-        printf("\n");
-    }
+    // Print the summary of the GPU cost of the external ids.
+    printf("\n=== SUMMARY ===\n");
+    printf("External Id %d: INITIALIZATION_EXTERNAL_ID\n", INITIALIZATION_EXTERNAL_ID);
+    printf("External Id %d: EXECUTION_EXTERNAL_ID\n", EXECUTION_EXTERNAL_ID);
+    printf("External Id %d: CLEANUP_EXTERNAL_ID\n", CLEANUP_EXTERNAL_ID);
+
+    PrintExternalRollupReport(&s_externalRollup, stdout);
+    FreeExternalRollup(&s_externalRollup);
 }
 
 void
 ExternalCorrelationRecords(
     CUpti_Activity *pRecord)
 {
-    switch(pRecord->kind)
-    {
-        case CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION:
-        {
-            CUpti_ActivityExternalCorrelation *pExternalCorrelationRecord = (CUpti_ActivityExternalCorrelation *)pRecord;
-
-            //  Map the correlation ids to external ids for correlation.
-            auto externalMapIter = s_externalCorrelationMap.find(pExternalCorrelationRecord->externalId);
-            if (externalMapIter == s_externalCorrelationMap.end())
-            {
-                std::vector<uint32_t> correlationVector;
-                correlationVector.push_back((uint32_t)pExternalCorrelationRecord->correlationId);
-                s_externalCorrelationMap.insert({(uint64_t)pExternalCorrelationRecord->externalId, correlationVector });
-            }
-            else
-            {
-                s_externalCorrelationMap[(uint64_t)pExternalCorrelationRecord->externalId].push_back((uint32_t)pExternalCorrelationRecord->correlationId);
-            }
-
-            break;
-        }
-        default:
-            break;
-    }
+    // Join the external correlation records with the kernel and memcpy records through the correlation ids.
+    ExternalRollupAddRecord(&s_externalRollup, pRecord);
 }
 
 static void
@@ -238,6 +198,7 @@ SetupCupti()
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
+    InitExternalRollup(&s_externalRollup, EXTERNAL_ROLLUP_DEFAULT_CAPACITY, EXTERNAL_ROLLUP_DEFAULT_MAX_AGE_NS);
     pUserData->pPostProcessActivityRecords = ExternalCorrelationRecords;
     pUserData->printActivityRecords        = 1;
 
@@ -18,6 +18,16 @@
  *
  * You can attach and detach CUPTI any number of times.
  *
+ * The attach/detach cycle is used for duty-cycled tracing: CUPTI traces
+ * for CUPTI_DUTY_CYCLE_TRACE_MS out of every CUPTI_DUTY_CYCLE_PERIOD_MS,
+ * the start of every trace window is moved by a random offset of up to
+ * CUPTI_DUTY_CYCLE_JITTER_MS to avoid aliasing with periodic workloads.
+ * While detached CUPTI is finalized, so the application runs without any
+ * callback or activity overhead. The records of every trace window are
+ * printed between a TRACE_WINDOW_BEGIN and a TRACE_WINDOW_END line tagged
+ * with the window id; the end line gives the scale factor to apply to the
+ * counts of the window to estimate the whole run.
+ *
  * After building the sample, set the following environment variable
  * export CUDA_INJECTION64_PATH=<full_path>/libCuptiFinalize.so
  * Add CUPTI library in LD_LIBRARY_PATH and run any CUDA sample
@@ -26,9 +36,11 @@
  */
 
 // System headers
+#include <errno.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 // CUDA headers
@@ -40,6 +52,11 @@
 // Macros
 #define STDCALL
 
+// Default duty cycle: trace 3 seconds out of every 6 seconds.
+#define DEFAULT_TRACE_MS 3000
+#define DEFAULT_PERIOD_MS 6000
+#define DEFAULT_JITTER_MS 0
+
 #define PTHREAD_CALL(call)                                                         \
 do                                                                                 \
 {                                                                                  \
@@ -61,53 +78,239 @@ typedef struct InjectionGlobals_st
     volatile uint32_t       detachCupti;
     CUpti_SubscriberHandle  subscriberHandle;
 
-    int                     frequency;
+    uint64_t                traceMs;                                 // Length of a trace window.
+    uint64_t                periodMs;                                // Distance between the starts of two trace windows.
+    uint64_t                jitterMs;                                // Maximum random offset of the start of a window.
+    uint64_t                rngState;                                // xorshift64 state for the jitter.
     int                     tracingEnabled;
-    int                     terminateThread;
+    volatile int            terminateThread;
+
+    uint32_t                windowId;                                // Current or last trace window.
+    uint64_t                windowStartTimestamp;                    // CUPTI timestamp of the window attach.
+    uint64_t                windowRecords;                           // Activity records received in the window.
+    uint64_t                tracedNs;                                // Traced time of all the completed windows.
+    struct timespec         firstWindowStart;                        // Monotonic time of the first attach.
 
     pthread_t               dynamicThread;
     pthread_mutex_t         mutexFinalize;
-    pthread_cond_t          mutexCondition;
+    pthread_cond_t          mutexCondition;                          // Signaled by the callback once CUPTI is detached.
+    pthread_cond_t          wakeCondition;                           // Signaled at exit to end the waits of the thread.
 } InjectionGlobals;
 
 InjectionGlobals injectionGlobals;
 
 // Functions
+static uint64_t
+ReadEnvMs(
+    const char *pName,
+    uint64_t defaultValue)
+{
+    const char *pValue = getenv(pName);
+    if (!pValue || !*pValue)
+    {
+        return defaultValue;
+    }
+
+    return strtoull(pValue, NULL, 10);
+}
+
 static void
 InitializeInjectionGlobals(void)
 {
     injectionGlobals.initialized        = 0;
     injectionGlobals.subscriberHandle   = NULL;
     injectionGlobals.detachCupti        = 0;
-    injectionGlobals.frequency          = 3; // in seconds
+    injectionGlobals.traceMs            = ReadEnvMs("CUPTI_DUTY_CYCLE_TRACE_MS", DEFAULT_TRACE_MS);
+    injectionGlobals.periodMs           = ReadEnvMs("CUPTI_DUTY_CYCLE_PERIOD_MS", DEFAULT_PERIOD_MS);
+    injectionGlobals.jitterMs           = ReadEnvMs("CUPTI_DUTY_CYCLE_JITTER_MS", DEFAULT_JITTER_MS);
+    injectionGlobals.rngState           = ((uint64_t)getpid() << 32) ^ (uint64_t)time(NULL) ^ 0x9e3779b97f4a7c15ULL;
     injectionGlobals.tracingEnabled     = 0;
     injectionGlobals.terminateThread    = 0;
+    injectionGlobals.windowId           = 0;
+    injectionGlobals.windowStartTimestamp = 0;
+    injectionGlobals.windowRecords      = 0;
+    injectionGlobals.tracedNs           = 0;
     injectionGlobals.mutexFinalize      = PTHREAD_MUTEX_INITIALIZER;
     injectionGlobals.mutexCondition     = PTHREAD_COND_INITIALIZER;
+
+    if (injectionGlobals.traceMs == 0)
+    {
+        injectionGlobals.traceMs = 1;
+    }
+    if (injectionGlobals.periodMs < injectionGlobals.traceMs)
+    {
+        printf("CUPTI_DUTY_CYCLE_PERIOD_MS %llu is shorter than the trace window, tracing continuously.\n",
+               (unsigned long long)injectionGlobals.periodMs);
+        injectionGlobals.periodMs = injectionGlobals.traceMs;
+    }
+    if (injectionGlobals.jitterMs > injectionGlobals.periodMs - injectionGlobals.traceMs)
+    {
+        // The jitter may not make windows overlap.
+        injectionGlobals.jitterMs = injectionGlobals.periodMs - injectionGlobals.traceMs;
+    }
+}
+
+static uint64_t
+NextJitterMs(void)
+{
+    uint64_t x = injectionGlobals.rngState;
+
+    if (injectionGlobals.jitterMs == 0)
+    {
+        return 0;
+    }
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    injectionGlobals.rngState = x;
+
+    return x % (injectionGlobals.jitterMs + 1);
 }
 
 static void
-AtExitHandler(void)
+AddMs(
+    struct timespec *pTime,
+    uint64_t ms)
 {
-    injectionGlobals.terminateThread = 1;
+    pTime->tv_sec += (time_t)(ms / 1000);
+    pTime->tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (pTime->tv_nsec >= 1000000000L)
+    {
+        pTime->tv_sec++;
+        pTime->tv_nsec -= 1000000000L;
+    }
+}
 
-    // Force flush the activity buffers.
-    if (injectionGlobals.tracingEnabled)
+static void
+SubtractMs(
+    struct timespec *pTime,
+    uint64_t ms)
+{
+    pTime->tv_sec -= (time_t)(ms / 1000);
+    pTime->tv_nsec -= (long)(ms % 1000) * 1000000L;
+    if (pTime->tv_nsec < 0)
     {
-        DeInitCuptiTrace();
+        pTime->tv_sec--;
+        pTime->tv_nsec += 1000000000L;
+    }
+}
 
-        // Release mutex lock in AtExitHandler() function
-        // Scenario: The thread initiating detach might wait for cuptiFinalize() API
-        // call to take place which will signal for the mutex release.
-        // But there are no CUDA API callbacks after the thread initiates detach.
-        // This will cause the mutex to never be released causing a hang.
-        if (injectionGlobals.detachCupti)
+static uint64_t
+GetElapsedNs(
+    const struct timespec *pStart,
+    const struct timespec *pEnd)
+{
+    return (uint64_t)(pEnd->tv_sec - pStart->tv_sec) * 1000000000ULL + (uint64_t)pEnd->tv_nsec - (uint64_t)pStart->tv_nsec;
+}
+
+// Sleep until the absolute monotonic deadline. Returns 0 if woken up for the termination.
+static int
+WaitUntil(
+    const struct timespec *pDeadline)
+{
+    PTHREAD_CALL(pthread_mutex_lock(&injectionGlobals.mutexFinalize));
+    while (!injectionGlobals.terminateThread)
+    {
+        int status = pthread_cond_timedwait(&injectionGlobals.wakeCondition, &injectionGlobals.mutexFinalize, pDeadline);
+        if (status == ETIMEDOUT)
         {
-            PTHREAD_CALL(pthread_cond_broadcast(&injectionGlobals.mutexCondition));
+            break;
         }
+        else if (status != 0)
+        {
+            PTHREAD_CALL(status);
+        }
+    }
+    int proceed = !injectionGlobals.terminateThread;
+    PTHREAD_CALL(pthread_mutex_unlock(&injectionGlobals.mutexFinalize));
+
+    return proceed;
+}
+
+// Post processing of the records of the current window.
+static void
+CountWindowRecord(
+    CUpti_Activity *pRecord)
+{
+    injectionGlobals.windowRecords++;
+}
+
+static void
+PrintWindowBegin(void)
+{
+    printf("TRACE_WINDOW_BEGIN windowId %u, timestamp %llu, traceMs %llu, periodMs %llu, jitterMs %llu\n",
+           injectionGlobals.windowId,
+           (unsigned long long)injectionGlobals.windowStartTimestamp,
+           (unsigned long long)injectionGlobals.traceMs,
+           (unsigned long long)injectionGlobals.periodMs,
+           (unsigned long long)injectionGlobals.jitterMs);
+}
+
+// Called once the records of the window are flushed, while CUPTI is still attached.
+static void
+PrintWindowEnd(void)
+{
+    uint64_t endTimestamp = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&endTimestamp));
+
+    uint64_t durationNs = endTimestamp - injectionGlobals.windowStartTimestamp;
+    injectionGlobals.tracedNs += durationNs;
+
+    // The window closes at the first API exit after traceMs, it can be much longer. The next window
+    // starts a period after this one, or right away when this one overran the period.
+    uint64_t periodNs = injectionGlobals.periodMs * 1000000ULL;
+    if (periodNs < durationNs)
+    {
+        periodNs = durationNs;
     }
 
+    printf("TRACE_WINDOW_END windowId %u, timestamp %llu, durationNs %llu, records %llu, scale %.3f\n",
+           injectionGlobals.windowId,
+           (unsigned long long)endTimestamp,
+           (unsigned long long)durationNs,
+           (unsigned long long)injectionGlobals.windowRecords,
+           durationNs ? (double)periodNs / (double)durationNs : 1.0);
+}
+
+static void
+PrintDutyCycleSummary(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsedNs = GetElapsedNs(&injectionGlobals.firstWindowStart, &now);
+
+    // The effective duty cycle includes the time the detach waits for an API exit.
+    printf("TRACE_DUTY_CYCLE windows %u, tracedNs %llu, elapsedNs %llu, dutyCycle %.4f\n",
+           injectionGlobals.windowId,
+           (unsigned long long)injectionGlobals.tracedNs,
+           (unsigned long long)elapsedNs,
+           elapsedNs ? (double)injectionGlobals.tracedNs / (double)elapsedNs : 0.0);
+}
+
+static void
+AtExitHandler(void)
+{
+    PTHREAD_CALL(pthread_mutex_lock(&injectionGlobals.mutexFinalize));
+    injectionGlobals.terminateThread = 1;
+
+    // Release the thread waiting for the end of a phase, or for cuptiFinalize():
+    // there may be no CUDA API callbacks anymore to perform the detach.
+    PTHREAD_CALL(pthread_cond_broadcast(&injectionGlobals.wakeCondition));
+    PTHREAD_CALL(pthread_cond_broadcast(&injectionGlobals.mutexCondition));
+    PTHREAD_CALL(pthread_mutex_unlock(&injectionGlobals.mutexFinalize));
+
     PTHREAD_CALL(pthread_join(injectionGlobals.dynamicThread, NULL));
+
+    // Force flush the activity buffers of the window in progress.
+    if (injectionGlobals.tracingEnabled)
+    {
+        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
+        PrintWindowEnd();
+        DeInitCuptiTrace();
+    }
+
+    PrintDutyCycleSummary();
 }
 
 void RegisterAtExitHandler(void)
@@ -146,11 +349,18 @@ InjectionCallbackHandler(
             {
                 if (pCallbackInfo->callbackSite == CUPTI_API_EXIT)
                 {
-                    // Detach CUPTI calling cuptiFinalize() API.
-                    printf("Calling cuptiFinalize() API.\n");
-                    CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
-                    CUPTI_API_CALL_VERBOSE(cuptiFinalize());
-                    PTHREAD_CALL(pthread_cond_broadcast(&injectionGlobals.mutexCondition));
+                    PTHREAD_CALL(pthread_mutex_lock(&injectionGlobals.mutexFinalize));
+                    if (injectionGlobals.detachCupti)
+                    {
+                        // Detach CUPTI calling cuptiFinalize() API, once the window is flushed and closed.
+                        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
+                        PrintWindowEnd();
+                        CUPTI_API_CALL_VERBOSE(cuptiFinalize());
+
+                        injectionGlobals.detachCupti = 0;
+                        PTHREAD_CALL(pthread_cond_broadcast(&injectionGlobals.mutexCondition));
+                    }
+                    PTHREAD_CALL(pthread_mutex_unlock(&injectionGlobals.mutexFinalize));
                 }
                 break;
             }
@@ -167,7 +377,7 @@ SetupCupti(void)
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
-    pUserData->pPostProcessActivityRecords = NULL;
+    pUserData->pPostProcessActivityRecords = CountWindowRecord;
     pUserData->printActivityRecords        = 1;
 
     // Common CUPTI Initialization.
@@ -185,53 +395,96 @@ SetupCupti(void)
     CUPTI_API_CALL_VERBOSE(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL));
 }
 
-void *DynamicAttachDetach(
-    void *arg)
+// Attach CUPTI and open a new trace window.
+static void
+StartTraceWindow(void)
 {
-    while (!injectionGlobals.terminateThread)
-    {
-        sleep(injectionGlobals.frequency);
+    SetupCupti();
 
-        // Check the condition again after sleep.
-        if (injectionGlobals.terminateThread)
-        {
-            break;
-        }
+    injectionGlobals.windowId++;
+    injectionGlobals.windowRecords = 0;
+    CUPTI_API_CALL(cuptiGetTimestamp(&injectionGlobals.windowStartTimestamp));
+    injectionGlobals.tracingEnabled = 1;
 
-        // Turn on/off CUPTI at a regular interval.
-        if (injectionGlobals.tracingEnabled)
-        {
-            printf("\nCUPTI detach starting ...\n");
+    PrintWindowBegin();
+}
 
-            // Force flush activity buffers.
-            CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
-            injectionGlobals.detachCupti = 1;
+// Flush and detach CUPTI, closing the trace window. Returns 0 if the process exits before the
+// detach could take place, the window is then closed by AtExitHandler().
+static int
+EndTraceWindow(void)
+{
+    // Force flush activity buffers.
+    CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
+
+    // Wait for callbackHandler() to perform CUPTI teardown at the next API exit.
+    PTHREAD_CALL(pthread_mutex_lock(&injectionGlobals.mutexFinalize));
+    injectionGlobals.detachCupti = 1;
+    while (injectionGlobals.detachCupti && !injectionGlobals.terminateThread)
+    {
+        PTHREAD_CALL(pthread_cond_wait(&injectionGlobals.mutexCondition, &injectionGlobals.mutexFinalize));
+    }
 
-            // Lock and wait for callbackHandler() to perform CUPTI teardown.
-            PTHREAD_CALL(pthread_mutex_lock(&injectionGlobals.mutexFinalize));
-            PTHREAD_CALL(pthread_cond_wait(&injectionGlobals.mutexCondition, &injectionGlobals.mutexFinalize));
-            PTHREAD_CALL(pthread_mutex_unlock(&injectionGlobals.mutexFinalize));
+    int detached = !injectionGlobals.detachCupti;
+    injectionGlobals.detachCupti = 0;
+    PTHREAD_CALL(pthread_mutex_unlock(&injectionGlobals.mutexFinalize));
 
-            printf("CUPTI detach completed.\n");
+    if (!detached)
+    {
+        return 0;
+    }
 
-            injectionGlobals.detachCupti = 0;
-            injectionGlobals.tracingEnabled = 0;
-            injectionGlobals.subscriberHandle = 0;
+    injectionGlobals.tracingEnabled = 0;
+    injectionGlobals.subscriberHandle = 0;
 
-            if (globals.pUserData) {
-                free(globals.pUserData);
-            }
+    if (globals.pUserData) {
+        free(globals.pUserData);
+        globals.pUserData = NULL;
+    }
+
+    return 1;
+}
+
+void *DynamicAttachDetach(
+    void *arg)
+{
+    // Deadlines are absolute so the windows do not drift with the time spent attaching and detaching.
+    // The nominal starts are exactly periodMs apart, the jitter of a window does not carry over to the next.
+    struct timespec nominalStart = injectionGlobals.firstWindowStart;
+    struct timespec windowStart = injectionGlobals.firstWindowStart;
 
+    while (!injectionGlobals.terminateThread)
+    {
+        struct timespec deadline = windowStart;
+        AddMs(&deadline, injectionGlobals.traceMs);
+        if (!WaitUntil(&deadline))
+        {
+            break;
         }
-        else
+
+        // Continuous tracing when the window covers the whole period.
+        if (injectionGlobals.periodMs == injectionGlobals.traceMs)
         {
-            printf("\nCUPTI attach starting ...\n");
+            nominalStart = deadline;
+            windowStart = deadline;
+            continue;
+        }
 
-            SetupCupti();
-            injectionGlobals.tracingEnabled = 1;
+        if (!EndTraceWindow())
+        {
+            break;
+        }
 
-            printf("CUPTI attach completed.\n");
+        AddMs(&nominalStart, injectionGlobals.periodMs);
+        windowStart = nominalStart;
+        AddMs(&windowStart, NextJitterMs());
+        SubtractMs(&windowStart, injectionGlobals.jitterMs / 2);
+        if (!WaitUntil(&windowStart))
+        {
+            break;
         }
+
+        StartTraceWindow();
     }
 
     return NULL;
@@ -248,14 +501,20 @@ InitializeInjection(void)
     // Initialize InjectionGlobals structure.
     InitializeInjectionGlobals();
 
-    // Initialize Mutex.
+    // Initialize Mutex and the condition variable timed on the monotonic clock.
     PTHREAD_CALL(pthread_mutex_init(&injectionGlobals.mutexFinalize, 0));
 
+    pthread_condattr_t conditionAttributes;
+    PTHREAD_CALL(pthread_condattr_init(&conditionAttributes));
+    PTHREAD_CALL(pthread_condattr_setclock(&conditionAttributes, CLOCK_MONOTONIC));
+    PTHREAD_CALL(pthread_cond_init(&injectionGlobals.wakeCondition, &conditionAttributes));
+    PTHREAD_CALL(pthread_condattr_destroy(&conditionAttributes));
+
     RegisterAtExitHandler();
 
-    // Initialize CUPTI.
-    SetupCupti();
-    injectionGlobals.tracingEnabled = 1;
+    // Initialize CUPTI, the first trace window starts now.
+    clock_gettime(CLOCK_MONOTONIC, &injectionGlobals.firstWindowStart);
+    StartTraceWindow();
 
     // Launch the thread.
     PTHREAD_CALL(pthread_create(&injectionGlobals.dynamicThread, NULL, DynamicAttachDetach, NULL));
@@ -0,0 +1,1160 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Mock CUPTI library for running the host side of the samples without a GPU.
+ *
+ * It is built as libcupti.so and implements the CUPTI entry points used by
+ * the activity, callback, PC sampling and NVTX payload paths of the samples.
+ * CUDA work is replaced by the synthetic workload of mock_workload.h:
+ * operations are generated on every cuptiActivityFlushAll(), by a background
+ * thread at CUPTI_MOCK_RECORD_RATE operations per second, or on demand with
+ * CuptiMockGenerate(). For each operation the subscriber receives the runtime
+ * API enter and exit callbacks, and the records of the enabled activity kinds
+ * are written to the buffers obtained from the registered buffer requested
+ * callback, which are handed back through the buffer completed callback.
+ *
+ * The profiling, event and metric APIs are not provided.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include <cupti_pcsampling.h>
+
+// NVTX headers
+#include <nvtx3/nvToolsExtPayload.h>
+
+#include "cupti_mock.h"
+#include "mock_workload.h"
+
+// Macros
+#define MOCK_NUM_STALL_REASONS 8
+#define MOCK_NUM_PC_FUNCTIONS 4
+#define MOCK_GENERATOR_PERIOD_US 1000
+
+// Data structures
+typedef struct MockSubscriber_st
+{
+    CUpti_CallbackFunc   callback;                                   // NULL when nobody is subscribed.
+    void                 *pUserData;
+    std::vector<uint8_t> runtimeCallbacks;                           // Enabled flag per runtime API callback id.
+} MockSubscriber;
+
+typedef struct MockCuptiState_st
+{
+    std::recursive_mutex              mutex;                         // Serializes generation, callbacks and buffer handling.
+    bool                              initialized;
+    MockGenerator                     generator;
+
+    CUpti_BuffersCallbackRequestFunc  pBufferRequested;
+    CUpti_BuffersCallbackCompleteFunc pBufferCompleted;
+    std::vector<uint8_t>              enabledKinds;                  // Enabled flag per CUpti_ActivityKind.
+    uint8_t                           *pBuffer;                      // Buffer being filled, NULL if none.
+    size_t                            bufferSize;
+    size_t                            validSize;
+    std::map<int, uint64_t>           attributes;                    // Values set with cuptiActivitySetAttribute().
+
+    MockSubscriber                    subscriber;
+    std::vector<uint64_t>             externalIds[CUPTI_EXTERNAL_CORRELATION_KIND_SIZE];
+
+    std::thread                       generatorThread;               // Background generator, see CUPTI_MOCK_RECORD_RATE.
+    std::atomic<bool>                 stopGenerator;
+
+    std::map<std::pair<uint32_t, uint64_t>, CUpti_NvtxExtPayloadAttr> nvtxPayloadAttributes;
+
+    const CUpti_PCSamplingData        *pPcSamplingReplay;           // PC records replayed by cuptiPCSamplingGetData(), NULL if none.
+    size_t                            numPcSamplingReplay;
+    size_t                            replayBuffer;                  // Position of the next replayed PC.
+    size_t                            replayPc;
+
+    ~MockCuptiState_st()
+    {
+        // Only join the thread at exit, the application callbacks may already be gone.
+        stopGenerator.store(true);
+        if (generatorThread.joinable())
+        {
+            generatorThread.join();
+        }
+    }
+} MockCuptiState;
+
+// Global state
+static MockCuptiState s_Mock;
+
+static const char *s_StallReasonNames[MOCK_NUM_STALL_REASONS] =
+{
+    "smsp__pcsamp_warps_issue_stalled_barrier",
+    "smsp__pcsamp_warps_issue_stalled_branch_resolving",
+    "smsp__pcsamp_warps_issue_stalled_dispatch_stall",
+    "smsp__pcsamp_warps_issue_stalled_long_scoreboard",
+    "smsp__pcsamp_warps_issue_stalled_math_pipe_throttle",
+    "smsp__pcsamp_warps_issue_stalled_not_selected",
+    "smsp__pcsamp_warps_issue_stalled_selected",
+    "smsp__pcsamp_warps_issue_stalled_wait"
+};
+
+// Helper Functions
+static uint64_t
+HashMockBytes(
+    const void *pData,
+    size_t size)
+{
+    const uint8_t *pBytes = (const uint8_t *)pData;
+    uint64_t hash = 0xcbf29ce484222325ULL;                           // FNV-1a.
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ pBytes[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+static uint64_t
+GetMockTimestamp()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Must be called with the mutex held.
+static void
+InitMockState()
+{
+    if (s_Mock.initialized)
+    {
+        return;
+    }
+
+    MockWorkload workload;
+    GetDefaultMockWorkload(&workload);
+    ReadMockWorkloadFromEnv(&workload);
+    InitMockGenerator(&s_Mock.generator, &workload, GetMockTimestamp());
+
+    s_Mock.enabledKinds.assign(CUPTI_ACTIVITY_KIND_COUNT, 0);
+    s_Mock.subscriber.runtimeCallbacks.assign(CUPTI_RUNTIME_TRACE_CBID_SIZE, 0);
+    s_Mock.stopGenerator.store(false);
+    s_Mock.initialized = true;
+}
+
+static bool
+IsMockKindEnabled(
+    CUpti_ActivityKind kind)
+{
+    return (size_t)kind < s_Mock.enabledKinds.size() && s_Mock.enabledKinds[kind];
+}
+
+// Hand the buffer being filled back to the application.
+static void
+CompleteMockBuffer()
+{
+    if (!s_Mock.pBuffer)
+    {
+        return;
+    }
+
+    uint8_t *pBuffer = s_Mock.pBuffer;
+    size_t bufferSize = s_Mock.bufferSize;
+    size_t validSize = s_Mock.validSize;
+
+    s_Mock.pBuffer = NULL;
+    s_Mock.bufferSize = 0;
+    s_Mock.validSize = 0;
+
+    if (s_Mock.pBufferCompleted)
+    {
+        s_Mock.pBufferCompleted(NULL, 0, pBuffer, bufferSize, validSize);
+    }
+}
+
+// Return space for a record of recordSize bytes, completing and requesting buffers as needed.
+// Returns NULL if no buffer is available, the record is then dropped.
+static uint8_t *
+ReserveMockRecord(
+    size_t recordSize)
+{
+    if (s_Mock.pBuffer && s_Mock.validSize + recordSize > s_Mock.bufferSize)
+    {
+        CompleteMockBuffer();
+    }
+
+    if (!s_Mock.pBuffer)
+    {
+        size_t maxNumRecords = 0;
+
+        if (!s_Mock.pBufferRequested)
+        {
+            return NULL;
+        }
+
+        s_Mock.pBufferRequested(&s_Mock.pBuffer, &s_Mock.bufferSize, &maxNumRecords);
+        s_Mock.validSize = 0;
+        if (!s_Mock.pBuffer || s_Mock.bufferSize < recordSize)
+        {
+            s_Mock.pBuffer = NULL;
+            s_Mock.bufferSize = 0;
+            return NULL;
+        }
+    }
+
+    uint8_t *pRecord = s_Mock.pBuffer + s_Mock.validSize;
+    s_Mock.validSize += recordSize;
+
+    return pRecord;
+}
+
+static void
+IssueMockRuntimeCallback(
+    const MockOperation *pOperation,
+    CUpti_ApiCallbackSite site,
+    uint64_t *pCorrelationData)
+{
+    CUpti_CallbackData callbackData;
+
+    memset(&callbackData, 0, sizeof(CUpti_CallbackData));
+    callbackData.callbackSite = site;
+    callbackData.functionName = pOperation->pApiName;
+    callbackData.symbolName = pOperation->pKernelName;
+    callbackData.contextUid = pOperation->contextId;
+    callbackData.correlationData = pCorrelationData;
+    callbackData.correlationId = pOperation->correlationId;
+
+    s_Mock.subscriber.callback(s_Mock.subscriber.pUserData, CUPTI_CB_DOMAIN_RUNTIME_API,
+                               pOperation->cbid, &callbackData);
+}
+
+// Generate one operation. Must be called with the mutex held.
+static void
+GenerateMockOperation()
+{
+    MockOperation operation;
+    uint64_t correlationData = 0;
+
+    NextMockOperation(&s_Mock.generator, &operation);
+
+    bool callbacks = s_Mock.subscriber.callback && s_Mock.subscriber.runtimeCallbacks[operation.cbid];
+    if (callbacks)
+    {
+        IssueMockRuntimeCallback(&operation, CUPTI_API_ENTER, &correlationData);
+    }
+
+    // As in CUPTI, the external correlation records precede the API record they refer to.
+    if (IsMockKindEnabled(CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION))
+    {
+        for (int kind = 0; kind < CUPTI_EXTERNAL_CORRELATION_KIND_SIZE; kind++)
+        {
+            if (s_Mock.externalIds[kind].empty())
+            {
+                continue;
+            }
+
+            CUpti_ActivityExternalCorrelation *pRecord =
+                (CUpti_ActivityExternalCorrelation *)ReserveMockRecord(GetMockRecordSize(CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION));
+            if (pRecord)
+            {
+                memset(pRecord, 0, sizeof(CUpti_ActivityExternalCorrelation));
+                pRecord->kind = CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION;
+                pRecord->externalKind = (CUpti_ExternalCorrelationKind)kind;
+                pRecord->externalId = s_Mock.externalIds[kind].back();
+                pRecord->correlationId = operation.correlationId;
+            }
+        }
+    }
+
+    if (IsMockKindEnabled(CUPTI_ACTIVITY_KIND_RUNTIME))
+    {
+        uint8_t *pRecord = ReserveMockRecord(GetMockRecordSize(CUPTI_ACTIVITY_KIND_RUNTIME));
+        if (pRecord)
+        {
+            WriteMockApiRecord(&operation, pRecord);
+        }
+    }
+
+    if (operation.gpuKind == CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL &&
+        !IsMockKindEnabled(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL) &&
+        IsMockKindEnabled(CUPTI_ACTIVITY_KIND_KERNEL))
+    {
+        operation.gpuKind = CUPTI_ACTIVITY_KIND_KERNEL;
+    }
+    if (IsMockKindEnabled(operation.gpuKind))
+    {
+        uint8_t *pRecord = ReserveMockRecord(GetMockRecordSize(operation.gpuKind));
+        if (pRecord)
+        {
+            WriteMockGpuRecord(&operation, pRecord);
+        }
+    }
+
+    if (callbacks)
+    {
+        IssueMockRuntimeCallback(&operation, CUPTI_API_EXIT, &correlationData);
+    }
+}
+
+// Background generator: numOperations per period, on absolute deadlines so the rate does not drift.
+static void
+RunMockGenerator(
+    uint64_t recordRate)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+    uint64_t carry = 0;
+
+    while (!s_Mock.stopGenerator.load())
+    {
+        carry += recordRate * MOCK_GENERATOR_PERIOD_US;
+        uint64_t numOperations = carry / 1000000;
+        carry %= 1000000;
+
+        {
+            std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+            for (uint64_t i = 0; i < numOperations; i++)
+            {
+                GenerateMockOperation();
+            }
+        }
+
+        deadline += std::chrono::microseconds(MOCK_GENERATOR_PERIOD_US);
+        std::this_thread::sleep_until(deadline);
+    }
+}
+
+static void
+StopMockGenerator()
+{
+    if (!s_Mock.generatorThread.joinable())
+    {
+        return;
+    }
+
+    s_Mock.stopGenerator.store(true);
+    if (s_Mock.generatorThread.get_id() == std::this_thread::get_id())
+    {
+        // Called from a callback issued by the generator itself, it exits after the current period.
+        s_Mock.generatorThread.detach();
+        return;
+    }
+    s_Mock.generatorThread.join();
+    s_Mock.stopGenerator.store(false);
+}
+
+// Mock control interface
+extern "C" void
+CuptiMockSetWorkload(
+    const MockWorkload *pWorkload)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+    InitMockGenerator(&s_Mock.generator, pWorkload, GetMockTimestamp());
+}
+
+extern "C" void
+CuptiMockGetWorkload(
+    MockWorkload *pWorkload)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+    *pWorkload = s_Mock.generator.workload;
+}
+
+extern "C" uint64_t
+CuptiMockGenerate(
+    uint64_t numOperations)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    for (uint64_t i = 0; i < numOperations; i++)
+    {
+        GenerateMockOperation();
+    }
+
+    return numOperations;
+}
+
+extern "C" void
+CuptiMockRegisterNvtxPayloadAttr(
+    uint32_t cuptiDomainId,
+    uint64_t schemaId,
+    const CUpti_NvtxExtPayloadAttr *pAttr)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    s_Mock.nvtxPayloadAttributes[std::make_pair(cuptiDomainId, schemaId)] = *pAttr;
+}
+
+extern "C" void
+CuptiMockSetPcSamplingData(
+    const CUpti_PCSamplingData *pBuffers,
+    size_t numBuffers)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    s_Mock.pPcSamplingReplay = numBuffers ? pBuffers : NULL;
+    s_Mock.numPcSamplingReplay = pBuffers ? numBuffers : 0;
+    s_Mock.replayBuffer = 0;
+    s_Mock.replayPc = 0;
+}
+
+// CUPTI general API
+CUptiResult CUPTIAPI
+cuptiGetResultString(
+    CUptiResult result,
+    const char **str)
+{
+    if (!str)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    switch (result)
+    {
+        case CUPTI_SUCCESS:
+            *str = "CUPTI_SUCCESS";
+            break;
+        case CUPTI_ERROR_INVALID_PARAMETER:
+            *str = "CUPTI_ERROR_INVALID_PARAMETER";
+            break;
+        case CUPTI_ERROR_INVALID_KIND:
+            *str = "CUPTI_ERROR_INVALID_KIND";
+            break;
+        case CUPTI_ERROR_MAX_LIMIT_REACHED:
+            *str = "CUPTI_ERROR_MAX_LIMIT_REACHED";
+            break;
+        case CUPTI_ERROR_NOT_SUPPORTED:
+            *str = "CUPTI_ERROR_NOT_SUPPORTED";
+            break;
+        case CUPTI_ERROR_MULTIPLE_SUBSCRIBERS_NOT_SUPPORTED:
+            *str = "CUPTI_ERROR_MULTIPLE_SUBSCRIBERS_NOT_SUPPORTED";
+            break;
+        case CUPTI_ERROR_QUEUE_EMPTY:
+            *str = "CUPTI_ERROR_QUEUE_EMPTY";
+            break;
+        case CUPTI_ERROR_OUT_OF_MEMORY:
+            *str = "CUPTI_ERROR_OUT_OF_MEMORY";
+            break;
+        default:
+            *str = "CUPTI_ERROR_UNKNOWN";
+            break;
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiGetLastError(void)
+{
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiGetTimestamp(
+    uint64_t *timestamp)
+{
+    if (!timestamp)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    *timestamp = GetMockTimestamp();
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiFinalize(void)
+{
+    StopMockGenerator();
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+    CompleteMockBuffer();
+
+    s_Mock.pBufferRequested = NULL;
+    s_Mock.pBufferCompleted = NULL;
+    s_Mock.enabledKinds.assign(CUPTI_ACTIVITY_KIND_COUNT, 0);
+    s_Mock.subscriber.callback = NULL;
+    s_Mock.subscriber.pUserData = NULL;
+    s_Mock.subscriber.runtimeCallbacks.assign(CUPTI_RUNTIME_TRACE_CBID_SIZE, 0);
+
+    return CUPTI_SUCCESS;
+}
+
+// CUPTI activity API
+CUptiResult CUPTIAPI
+cuptiActivityEnable(
+    CUpti_ActivityKind kind)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    if ((size_t)kind >= s_Mock.enabledKinds.size())
+    {
+        return CUPTI_ERROR_INVALID_KIND;
+    }
+    s_Mock.enabledKinds[kind] = 1;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityDisable(
+    CUpti_ActivityKind kind)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    if ((size_t)kind >= s_Mock.enabledKinds.size())
+    {
+        return CUPTI_ERROR_INVALID_KIND;
+    }
+    s_Mock.enabledKinds[kind] = 0;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityRegisterCallbacks(
+    CUpti_BuffersCallbackRequestFunc funcBufferRequested,
+    CUpti_BuffersCallbackCompleteFunc funcBufferCompleted)
+{
+    if (!funcBufferRequested || !funcBufferCompleted)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    s_Mock.pBufferRequested = funcBufferRequested;
+    s_Mock.pBufferCompleted = funcBufferCompleted;
+
+    if (s_Mock.generator.workload.recordRate && !s_Mock.generatorThread.joinable())
+    {
+        s_Mock.generatorThread = std::thread(RunMockGenerator, s_Mock.generator.workload.recordRate);
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityGetNextRecord(
+    uint8_t *buffer,
+    size_t validBufferSizeBytes,
+    CUpti_Activity **record)
+{
+    if (!buffer || !record)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    return GetNextMockRecord(buffer, validBufferSizeBytes, record);
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityFlushAll(
+    uint32_t flag)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    // Stand-in for the CUDA work done since the last flush.
+    for (uint64_t i = 0; i < s_Mock.generator.workload.operationsPerFlush; i++)
+    {
+        GenerateMockOperation();
+    }
+    CompleteMockBuffer();
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityGetNumDroppedRecords(
+    CUcontext context,
+    uint32_t streamId,
+    size_t *dropped)
+{
+    if (!dropped)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    *dropped = 0;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivitySetAttribute(
+    CUpti_ActivityAttribute attr,
+    size_t *valueSize,
+    void *value)
+{
+    uint64_t storedValue = 0;
+
+    if (!valueSize || !value)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    memcpy(&storedValue, value, *valueSize < sizeof(uint64_t) ? *valueSize : sizeof(uint64_t));
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    s_Mock.attributes[(int)attr] = storedValue;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityGetAttribute(
+    CUpti_ActivityAttribute attr,
+    size_t *valueSize,
+    void *value)
+{
+    uint64_t storedValue = 0;
+
+    if (!valueSize || !value)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    std::map<int, uint64_t>::iterator it = s_Mock.attributes.find((int)attr);
+    if (it != s_Mock.attributes.end())
+    {
+        storedValue = it->second;
+    }
+    memset(value, 0, *valueSize);
+    memcpy(value, &storedValue, *valueSize < sizeof(uint64_t) ? *valueSize : sizeof(uint64_t));
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityPushExternalCorrelationId(
+    CUpti_ExternalCorrelationKind kind,
+    uint64_t id)
+{
+    if ((int)kind < 0 || (int)kind >= CUPTI_EXTERNAL_CORRELATION_KIND_SIZE)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    s_Mock.externalIds[kind].push_back(id);
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiActivityPopExternalCorrelationId(
+    CUpti_ExternalCorrelationKind kind,
+    uint64_t *lastId)
+{
+    if ((int)kind < 0 || (int)kind >= CUPTI_EXTERNAL_CORRELATION_KIND_SIZE)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    if (s_Mock.externalIds[kind].empty())
+    {
+        return CUPTI_ERROR_QUEUE_EMPTY;
+    }
+    if (lastId)
+    {
+        *lastId = s_Mock.externalIds[kind].back();
+    }
+    s_Mock.externalIds[kind].pop_back();
+
+    return CUPTI_SUCCESS;
+}
+
+// CUPTI callback API
+CUptiResult CUPTIAPI
+cuptiSubscribe(
+    CUpti_SubscriberHandle *subscriber,
+    CUpti_CallbackFunc callback,
+    void *userdata)
+{
+    if (!subscriber)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    if (s_Mock.subscriber.callback)
+    {
+        return CUPTI_ERROR_MULTIPLE_SUBSCRIBERS_NOT_SUPPORTED;
+    }
+
+    s_Mock.subscriber.callback = callback;
+    s_Mock.subscriber.pUserData = userdata;
+    *subscriber = (CUpti_SubscriberHandle)&s_Mock.subscriber;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiUnsubscribe(
+    CUpti_SubscriberHandle subscriber)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+
+    if (subscriber != (CUpti_SubscriberHandle)&s_Mock.subscriber)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    s_Mock.subscriber.callback = NULL;
+    s_Mock.subscriber.pUserData = NULL;
+    s_Mock.subscriber.runtimeCallbacks.assign(CUPTI_RUNTIME_TRACE_CBID_SIZE, 0);
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiEnableCallback(
+    uint32_t enable,
+    CUpti_SubscriberHandle subscriber,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId cbid)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+
+    if (subscriber != (CUpti_SubscriberHandle)&s_Mock.subscriber)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    // Only runtime API callbacks are generated, the other domains are accepted and stay silent.
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API)
+    {
+        if (cbid >= s_Mock.subscriber.runtimeCallbacks.size())
+        {
+            return CUPTI_ERROR_INVALID_PARAMETER;
+        }
+        s_Mock.subscriber.runtimeCallbacks[cbid] = enable ? 1 : 0;
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiEnableDomain(
+    uint32_t enable,
+    CUpti_SubscriberHandle subscriber,
+    CUpti_CallbackDomain domain)
+{
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+
+    if (subscriber != (CUpti_SubscriberHandle)&s_Mock.subscriber)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API)
+    {
+        s_Mock.subscriber.runtimeCallbacks.assign(CUPTI_RUNTIME_TRACE_CBID_SIZE, enable ? 1 : 0);
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiGetCallbackName(
+    CUpti_CallbackDomain domain,
+    uint32_t cbid,
+    const char **name)
+{
+    if (!name)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    *name = NULL;
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API)
+    {
+        switch (cbid)
+        {
+            case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000:
+                *name = "cudaLaunchKernel_v7000";
+                break;
+            case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020:
+                *name = "cudaMemcpyAsync_v3020";
+                break;
+            case CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020:
+                *name = "cudaMemsetAsync_v3020";
+                break;
+            default:
+                break;
+        }
+    }
+
+    return *name ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+// CUPTI PC sampling API
+CUptiResult CUPTIAPI
+cuptiPCSamplingEnable(
+    CUpti_PCSamplingEnableParams *pParams)
+{
+    return pParams ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingDisable(
+    CUpti_PCSamplingDisableParams *pParams)
+{
+    return pParams ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingStart(
+    CUpti_PCSamplingStartParams *pParams)
+{
+    return pParams ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingStop(
+    CUpti_PCSamplingStopParams *pParams)
+{
+    return pParams ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingSetConfigurationAttribute(
+    CUpti_PCSamplingConfigurationInfoParams *pParams)
+{
+    return pParams ? CUPTI_SUCCESS : CUPTI_ERROR_INVALID_PARAMETER;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingGetNumStallReasons(
+    CUpti_PCSamplingGetNumStallReasonsParams *pParams)
+{
+    if (!pParams || !pParams->numStallReasons)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    *pParams->numStallReasons = MOCK_NUM_STALL_REASONS;
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiPCSamplingGetStallReasons(
+    CUpti_PCSamplingGetStallReasonsParams *pParams)
+{
+    if (!pParams || !pParams->stallReasonIndex || !pParams->stallReasons)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    for (size_t i = 0; i < pParams->numStallReasons && i < MOCK_NUM_STALL_REASONS; i++)
+    {
+        pParams->stallReasonIndex[i] = (uint32_t)i;
+        strncpy(pParams->stallReasons[i], s_StallReasonNames[i], CUPTI_STALL_REASON_STRING_SIZE - 1);
+        pParams->stallReasons[i][CUPTI_STALL_REASON_STRING_SIZE - 1] = '\0';
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+// Copy the next PCs of the replayed buffers to pData. Must be called with the mutex held.
+static void
+ReplayMockPcSamplingData(
+    CUpti_PCSamplingData *pData)
+{
+    std::vector<std::pair<const char *, char *> > functionNames;     // Replayed name, name returned by this call.
+    const CUpti_PCSamplingData *pSource = &s_Mock.pPcSamplingReplay[s_Mock.replayBuffer];
+    size_t numPcs = 0;
+
+    // Skip the empty buffers, stop after a full round if they are all empty.
+    for (size_t i = 0; i < s_Mock.numPcSamplingReplay && s_Mock.replayPc >= pSource->totalNumPcs; i++)
+    {
+        s_Mock.replayBuffer = (s_Mock.replayBuffer + 1) % s_Mock.numPcSamplingReplay;
+        s_Mock.replayPc = 0;
+        pSource = &s_Mock.pPcSamplingReplay[s_Mock.replayBuffer];
+    }
+
+    pData->totalSamples = 0;
+    pData->droppedSamples = 0;
+    pData->rangeId = pSource->rangeId;
+    pData->nonUsrKernelsTotalSamples = 0;
+    pData->hardwareBufferFull = 0;
+
+    while (numPcs < pData->collectNumPcs && s_Mock.replayPc < pSource->totalNumPcs)
+    {
+        const CUpti_PCSamplingPCData *pSourcePc = &pSource->pPcData[s_Mock.replayPc++];
+        CUpti_PCSamplingPCData *pPc = &pData->pPcData[numPcs++];
+        char *pFunctionName = NULL;
+
+        // As in CUPTI, the PCs of a function share one name per call.
+        for (size_t i = 0; i < functionNames.size() && !pFunctionName; i++)
+        {
+            if (functionNames[i].first == pSourcePc->functionName ||
+                !strcmp(functionNames[i].first, pSourcePc->functionName))
+            {
+                pFunctionName = functionNames[i].second;
+            }
+        }
+        if (!pFunctionName)
+        {
+            pFunctionName = strdup(pSourcePc->functionName ? pSourcePc->functionName : "");
+            functionNames.push_back(std::make_pair(pSourcePc->functionName ? pSourcePc->functionName : "", pFunctionName));
+        }
+
+        pPc->cubinCrc = pSourcePc->cubinCrc;
+        pPc->pcOffset = pSourcePc->pcOffset;
+        pPc->functionIndex = pSourcePc->functionIndex;
+        pPc->functionName = pFunctionName;
+        pPc->correlationId = pSourcePc->correlationId;
+        pPc->stallReasonCount = 0;
+
+        if (!pPc->stallReason)
+        {
+            continue;
+        }
+
+        for (size_t j = 0; j < pSourcePc->stallReasonCount; j++)
+        {
+            pPc->stallReason[pPc->stallReasonCount++] = pSourcePc->stallReason[j];
+            pData->totalSamples += pSourcePc->stallReason[j].samples;
+        }
+    }
+
+    pData->totalNumPcs = numPcs;
+    pData->remainingNumPcs = pSource->totalNumPcs - s_Mock.replayPc;
+}
+
+// Fill the PC records preallocated by the caller. As in CUPTI, function names are allocated once per
+// function and call, are shared by the PCs of the function and are freed by the caller.
+CUptiResult CUPTIAPI
+cuptiPCSamplingGetData(
+    CUpti_PCSamplingGetDataParams *pParams)
+{
+    if (!pParams || !pParams->pcSamplingData)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    CUpti_PCSamplingData *pData = (CUpti_PCSamplingData *)pParams->pcSamplingData;
+    if (!pData->pPcData)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    InitMockState();
+
+    if (s_Mock.pPcSamplingReplay)
+    {
+        ReplayMockPcSamplingData(pData);
+        return CUPTI_SUCCESS;
+    }
+
+    MockGenerator *pGenerator = &s_Mock.generator;
+    size_t numPcs = pGenerator->workload.numPcs < pData->collectNumPcs ? pGenerator->workload.numPcs : pData->collectNumPcs;
+    char *pFunctionNames[MOCK_NUM_PC_FUNCTIONS] = { NULL };
+
+    pData->totalSamples = 0;
+    pData->droppedSamples = 0;
+    pData->totalNumPcs = numPcs;
+    pData->remainingNumPcs = 0;
+    pData->rangeId = 0;
+    pData->nonUsrKernelsTotalSamples = 0;
+    pData->hardwareBufferFull = 0;
+
+    for (size_t i = 0; i < numPcs; i++)
+    {
+        CUpti_PCSamplingPCData *pPc = &pData->pPcData[i];
+        uint32_t function = (uint32_t)(i % MOCK_NUM_PC_FUNCTIONS);
+
+        if (!pFunctionNames[function])
+        {
+            const std::string &kernelName = pGenerator->kernelNames[function % pGenerator->kernelNames.size()];
+            pFunctionNames[function] = strdup(kernelName.c_str());
+        }
+
+        pPc->cubinCrc = 0x5eed5eedULL;
+        pPc->pcOffset = (uint64_t)(i / MOCK_NUM_PC_FUNCTIONS) * 16;
+        pPc->functionIndex = function;
+        pPc->functionName = pFunctionNames[function];
+        pPc->correlationId = pGenerator->nextCorrelationId;
+        pPc->stallReasonCount = 0;
+
+        if (!pPc->stallReason)
+        {
+            continue;
+        }
+
+        // A few stall reasons per PC, the caller sized the array with the number of stall reasons.
+        for (size_t j = 0; j < 3 && j < MOCK_NUM_STALL_REASONS; j++)
+        {
+            CUpti_PCSamplingStallReason *pStallReason = &pPc->stallReason[pPc->stallReasonCount++];
+            pStallReason->pcSamplingStallReasonIndex = (uint32_t)(NextMockRandom(pGenerator) % MOCK_NUM_STALL_REASONS);
+            pStallReason->samples = (uint32_t)(1 + NextMockRandom(pGenerator) % 100);
+            pData->totalSamples += pStallReason->samples;
+        }
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+// The cubin is not decoded: the CRC is a hash of its bytes and every PC maps to a line of a
+// source file named after the function, so that source correlation can run on captured data.
+CUptiResult CUPTIAPI
+cuptiGetCubinCrc(
+    CUpti_GetCubinCrcParams *pParams)
+{
+    if (!pParams || !pParams->cubin || !pParams->cubinSize)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    pParams->cubinCrc = HashMockBytes(pParams->cubin, pParams->cubinSize);
+
+    return CUPTI_SUCCESS;
+}
+
+CUptiResult CUPTIAPI
+cuptiGetSassToSourceCorrelation(
+    CUpti_GetSassToSourceCorrelationParams *pParams)
+{
+    if (!pParams || !pParams->cubin || !pParams->functionName)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::string fileName(pParams->functionName, strcspn(pParams->functionName, "("));
+    fileName += ".cu";
+
+    // Both strings are freed by the caller.
+    pParams->fileName = strdup(fileName.c_str());
+    pParams->dirName = strdup("/mock/src");
+    pParams->lineNumber = (uint32_t)(pParams->pcOffset / 16) + 1;
+
+    return CUPTI_SUCCESS;
+}
+
+// CUPTI NVTX extended payload API
+extern "C" CUptiResult CUPTIAPI
+cuptiActivityGetNvtxExtPayloadAttr(
+    uint32_t cuptiDomainId,
+    uint64_t schemaId,
+    CUpti_NvtxExtPayloadAttr *pPayloadAttributes)
+{
+    if (!pPayloadAttributes)
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(s_Mock.mutex);
+    std::map<std::pair<uint32_t, uint64_t>, CUpti_NvtxExtPayloadAttr>::iterator it =
+        s_Mock.nvtxPayloadAttributes.find(std::make_pair(cuptiDomainId, schemaId));
+    if (it == s_Mock.nvtxPayloadAttributes.end())
+    {
+        return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    // CUPTI hands out copies, the caller frees the attributes and their entries array.
+    *pPayloadAttributes = it->second;
+    if (it->second.type == CUPTI_NVTX_EXT_PAYLOAD_TYPE_SCHEMA)
+    {
+        const nvtxPayloadSchemaAttr_t *pSource = (const nvtxPayloadSchemaAttr_t *)it->second.attributes;
+        nvtxPayloadSchemaAttr_t *pCopy = (nvtxPayloadSchemaAttr_t *)malloc(sizeof(nvtxPayloadSchemaAttr_t));
+        nvtxPayloadSchemaEntry_t *pEntries = (nvtxPayloadSchemaEntry_t *)malloc(pSource->numEntries * sizeof(nvtxPayloadSchemaEntry_t) + 1);
+        if (!pCopy || !pEntries)
+        {
+            free(pCopy);
+            free(pEntries);
+            return CUPTI_ERROR_OUT_OF_MEMORY;
+        }
+
+        *pCopy = *pSource;
+        memcpy(pEntries, pSource->entries, pSource->numEntries * sizeof(nvtxPayloadSchemaEntry_t));
+        pCopy->entries = pEntries;
+        pPayloadAttributes->attributes = pCopy;
+    }
+    else if (it->second.type == CUPTI_NVTX_EXT_PAYLOAD_TYPE_ENUM)
+    {
+        const nvtxPayloadEnumAttr_t *pSource = (const nvtxPayloadEnumAttr_t *)it->second.attributes;
+        nvtxPayloadEnumAttr_t *pCopy = (nvtxPayloadEnumAttr_t *)malloc(sizeof(nvtxPayloadEnumAttr_t));
+        nvtxPayloadEnum_t *pEntries = (nvtxPayloadEnum_t *)malloc(pSource->numEntries * sizeof(nvtxPayloadEnum_t) + 1);
+        if (!pCopy || !pEntries)
+        {
+            free(pCopy);
+            free(pEntries);
+            return CUPTI_ERROR_OUT_OF_MEMORY;
+        }
+
+        *pCopy = *pSource;
+        memcpy(pEntries, pSource->entries, pSource->numEntries * sizeof(nvtxPayloadEnum_t));
+        pCopy->entries = pEntries;
+        pPayloadAttributes->attributes = pCopy;
+    }
+
+    return CUPTI_SUCCESS;
+}
+
+// Size and alignment of the predefined NVTX payload entry types, indexed by type.
+// The first entry holds the number of entries in its size field.
+extern "C" const nvtxPayloadEntryTypeInfo_t * CUPTIAPI
+cuptiActivityGetNvtxExtPayloadEntryTypeInfo()
+{
+#define MOCK_NVTX_TYPE_INFO(type, cType) \
+    typeInfo[type].size = (uint16_t)sizeof(cType); \
+    typeInfo[type].align = (uint16_t)alignof(cType)
+
+    static nvtxPayloadEntryTypeInfo_t typeInfo[NVTX_PAYLOAD_ENTRY_TYPE_ADDRESS + 1];
+    static std::once_flag initialized;
+
+    std::call_once(initialized, []()
+    {
+        memset(typeInfo, 0, sizeof(typeInfo));
+        typeInfo[0].size = (uint16_t)(sizeof(typeInfo) / sizeof(typeInfo[0]));
+
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_CHAR, char);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UCHAR, unsigned char);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_SHORT, short);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_USHORT, unsigned short);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_INT, int);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UINT, unsigned int);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_LONG, long);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_ULONG, unsigned long);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_LONGLONG, long long);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_ULONGLONG, unsigned long long);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_INT8, int8_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UINT8, uint8_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_INT16, int16_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UINT16, uint16_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_INT32, int32_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UINT32, uint32_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_INT64, int64_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_UINT64, uint64_t);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_FLOAT, float);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_DOUBLE, double);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_LONGDOUBLE, long double);
+        MOCK_NVTX_TYPE_INFO(NVTX_PAYLOAD_ENTRY_TYPE_ADDRESS, void *);
+    });
+
+#undef MOCK_NVTX_TYPE_INFO
+
+    return typeInfo;
+}
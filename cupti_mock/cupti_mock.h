@@ -0,0 +1,56 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Control interface of the mock CUPTI library (libcupti.so built from
+ * cupti_mock.cpp). Applications linked against the mock can use these
+ * functions to choose the synthetic workload and to produce records on
+ * demand; unmodified samples are configured with the CUPTI_MOCK_*
+ * environment variables instead, see mock_workload.h.
+ */
+
+#ifndef CUPTI_MOCK_H_
+#define CUPTI_MOCK_H_
+
+#pragma once
+
+// System headers
+#include <stdint.h>
+
+// CUPTI headers
+#include <cupti.h>
+#include <cupti_pcsampling.h>
+
+#include "mock_workload.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Replace the workload and restart the generator (correlation ids and the virtual clock start over).
+void CuptiMockSetWorkload(const MockWorkload *pWorkload);
+
+// Current workload, including the values read from the environment.
+void CuptiMockGetWorkload(MockWorkload *pWorkload);
+
+// Generate numOperations CUDA operations on the calling thread: runtime API callbacks are
+// issued to the subscriber and the records of the enabled activity kinds are written to the
+// activity buffers, full buffers are completed. Returns the number of operations generated.
+uint64_t CuptiMockGenerate(uint64_t numOperations);
+
+// Make cuptiActivityGetNvtxExtPayloadAttr() return pAttr for the schema or enum schemaId of
+// the domain cuptiDomainId. pAttr->attributes must stay valid while the mock is in use, every
+// lookup returns a malloc'ed copy of the attributes and their entries, as CUPTI does.
+void CuptiMockRegisterNvtxPayloadAttr(uint32_t cuptiDomainId, uint64_t schemaId, const CUpti_NvtxExtPayloadAttr *pAttr);
+
+// Make cuptiPCSamplingGetData() replay the PC records of pBuffers, e.g. read from a file written by
+// CuptiUtilPutPcSampData(), instead of generating them. Every call returns the next PCs of the current
+// buffer, up to collectNumPcs, and moves to the next buffer once it is exhausted; the last buffer is
+// followed by the first. The buffers must stay valid while the mock is in use, NULL restores the
+// generator. The stall reason arrays of the caller must hold the stall reasons of every PC.
+void CuptiMockSetPcSamplingData(const CUpti_PCSamplingData *pBuffers, size_t numBuffers);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CUPTI_MOCK_H_
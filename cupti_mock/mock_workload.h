@@ -0,0 +1,653 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Synthetic CUDA workload used by the mock CUPTI library.
+ *
+ * The generator produces a deterministic stream of CUDA operations (kernel
+ * launches, memcpys and memsets) with a configurable mix, number of streams
+ * and devices and kernel name cardinality. Every operation has a runtime API
+ * call and a GPU activity sharing one correlation id, and timestamps follow a
+ * virtual clock: the API call runs on the host, the GPU activity starts after
+ * a launch latency once its stream is idle. The records are written in the
+ * same layout as the real CUPTI activity records, so the host side code of the
+ * samples processes them unchanged.
+ *
+ * The operations can also be replayed from an operation trace, a text file
+ * with one operation per line (see ReadMockOperationTrace()), so that the
+ * same workload is measured on every run.
+ */
+
+#ifndef MOCK_WORKLOAD_H_
+#define MOCK_WORKLOAD_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+
+// Macros
+#define MOCK_RECORD_ALIGNMENT 8
+#define MOCK_TRACE_LINE_SIZE 4096
+#define MOCK_ALIGN_SIZE(size) (((size) + MOCK_RECORD_ALIGNMENT - 1) & ~((size_t)MOCK_RECORD_ALIGNMENT - 1))
+
+// Data structures
+struct MockOperationTrace_st;
+
+// Workload description. Every field can be set from an environment variable, see ReadMockWorkloadFromEnv().
+typedef struct MockWorkload_st
+{
+    uint32_t numKernelNames;                                         // Distinct kernel names (CUPTI_MOCK_KERNEL_NAMES).
+    uint32_t numStreams;                                             // Streams per device (CUPTI_MOCK_STREAMS).
+    uint32_t numDevices;                                             // Devices (CUPTI_MOCK_DEVICES).
+    uint32_t kernelWeight;                                           // Relative weight of kernel launches (CUPTI_MOCK_MIX=kernel:memcpy:memset).
+    uint32_t memcpyWeight;                                           // Relative weight of memcpys.
+    uint32_t memsetWeight;                                           // Relative weight of memsets.
+    uint64_t recordRate;                                             // Operations per second made by the background generator, 0 disables it (CUPTI_MOCK_RECORD_RATE).
+    uint64_t operationsPerFlush;                                     // Operations made by every cuptiActivityFlushAll() (CUPTI_MOCK_OPERATIONS_PER_FLUSH).
+    uint64_t meanKernelNs;                                           // Mean kernel duration (CUPTI_MOCK_KERNEL_NS).
+    uint64_t meanCopyBytes;                                          // Mean memcpy and memset size (CUPTI_MOCK_COPY_BYTES).
+    uint32_t numPcs;                                                 // PCs returned by every cuptiPCSamplingGetData() (CUPTI_MOCK_PCS).
+    uint64_t seed;                                                   // Random seed (CUPTI_MOCK_SEED).
+    const struct MockOperationTrace_st *pOperationTrace;             // Operations replayed instead of the mix above, NULL if none.
+} MockWorkload;
+
+// One generated CUDA operation.
+typedef struct MockOperation_st
+{
+    CUpti_ActivityKind gpuKind;                                      // CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL, _MEMCPY or _MEMSET.
+    CUpti_CallbackId   cbid;                                         // Runtime API callback id.
+    const char         *pApiName;                                    // Runtime API name.
+    const char         *pKernelName;                                 // Kernel name, NULL for memory operations.
+    uint32_t           correlationId;                                // Shared by the API and GPU records.
+    uint64_t           apiStart;                                     // API timestamps.
+    uint64_t           apiEnd;
+    uint64_t           gpuStart;                                     // GPU timestamps.
+    uint64_t           gpuEnd;
+    uint64_t           bytes;                                        // Memcpy and memset size.
+    uint32_t           deviceId;
+    uint32_t           contextId;
+    uint32_t           streamId;
+    uint32_t           processId;
+    uint32_t           threadId;
+} MockOperation;
+
+// Operations read from an operation trace, timestamps relative to the start of the trace.
+typedef struct MockOperationTrace_st
+{
+    std::vector<MockOperation> operations;
+    std::vector<std::string>   kernelNames;                          // Owned kernel names of the operations.
+    uint64_t                   duration;                             // Latest end timestamp, every replay round is shifted by it.
+} MockOperationTrace;
+
+typedef struct MockGenerator_st
+{
+    MockWorkload             workload;
+    uint64_t                 rngState;                               // xorshift64* state.
+    uint64_t                 hostTime;                               // Virtual host clock in ns.
+    uint32_t                 nextCorrelationId;
+    uint64_t                 numOperations;                          // Operations generated so far.
+    uint64_t                 traceOffset;                            // Start of the current round of the operation trace.
+    std::vector<uint64_t>    streamIdleTime;                         // Per device and stream: end of the last GPU activity.
+    std::vector<std::string> kernelNames;                            // Owned kernel names, pointers stay valid for the generator lifetime.
+    std::vector<uint64_t>    kernelMeanNs;                           // Mean duration per kernel name.
+} MockGenerator;
+
+// Helper Functions
+static void
+GetDefaultMockWorkload(
+    MockWorkload *pWorkload)
+{
+    pWorkload->numKernelNames = 16;
+    pWorkload->numStreams = 4;
+    pWorkload->numDevices = 1;
+    pWorkload->kernelWeight = 8;
+    pWorkload->memcpyWeight = 1;
+    pWorkload->memsetWeight = 1;
+    pWorkload->recordRate = 0;
+    pWorkload->operationsPerFlush = 1000;
+    pWorkload->meanKernelNs = 20000;
+    pWorkload->meanCopyBytes = 1 << 20;
+    pWorkload->numPcs = 64;
+    pWorkload->seed = 1;
+    pWorkload->pOperationTrace = NULL;
+}
+
+static uint64_t
+ReadMockWorkloadValue(
+    const char *pName,
+    uint64_t defaultValue)
+{
+    const char *pValue = getenv(pName);
+    if (!pValue || !*pValue)
+    {
+        return defaultValue;
+    }
+
+    return strtoull(pValue, NULL, 0);
+}
+
+// Override the workload fields with the CUPTI_MOCK_* environment variables that are set.
+static void
+ReadMockWorkloadFromEnv(
+    MockWorkload *pWorkload)
+{
+    pWorkload->numKernelNames = (uint32_t)ReadMockWorkloadValue("CUPTI_MOCK_KERNEL_NAMES", pWorkload->numKernelNames);
+    pWorkload->numStreams = (uint32_t)ReadMockWorkloadValue("CUPTI_MOCK_STREAMS", pWorkload->numStreams);
+    pWorkload->numDevices = (uint32_t)ReadMockWorkloadValue("CUPTI_MOCK_DEVICES", pWorkload->numDevices);
+    pWorkload->recordRate = ReadMockWorkloadValue("CUPTI_MOCK_RECORD_RATE", pWorkload->recordRate);
+    pWorkload->operationsPerFlush = ReadMockWorkloadValue("CUPTI_MOCK_OPERATIONS_PER_FLUSH", pWorkload->operationsPerFlush);
+    pWorkload->meanKernelNs = ReadMockWorkloadValue("CUPTI_MOCK_KERNEL_NS", pWorkload->meanKernelNs);
+    pWorkload->meanCopyBytes = ReadMockWorkloadValue("CUPTI_MOCK_COPY_BYTES", pWorkload->meanCopyBytes);
+    pWorkload->numPcs = (uint32_t)ReadMockWorkloadValue("CUPTI_MOCK_PCS", pWorkload->numPcs);
+    pWorkload->seed = ReadMockWorkloadValue("CUPTI_MOCK_SEED", pWorkload->seed);
+
+    const char *pMix = getenv("CUPTI_MOCK_MIX");
+    if (pMix && *pMix)
+    {
+        unsigned int kernelWeight = 0, memcpyWeight = 0, memsetWeight = 0;
+        if (sscanf(pMix, "%u:%u:%u", &kernelWeight, &memcpyWeight, &memsetWeight) == 3 &&
+            kernelWeight + memcpyWeight + memsetWeight > 0)
+        {
+            pWorkload->kernelWeight = kernelWeight;
+            pWorkload->memcpyWeight = memcpyWeight;
+            pWorkload->memsetWeight = memsetWeight;
+        }
+        else
+        {
+            fprintf(stderr, "[CUPTI MOCK] Ignoring invalid CUPTI_MOCK_MIX \"%s\", expected kernel:memcpy:memset weights.\n", pMix);
+        }
+    }
+}
+
+static inline uint64_t
+NextMockRandom(
+    MockGenerator *pGenerator)
+{
+    uint64_t x = pGenerator->rngState;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    pGenerator->rngState = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform in [mean / 2, mean * 3 / 2).
+static inline uint64_t
+NextMockJitter(
+    MockGenerator *pGenerator,
+    uint64_t mean)
+{
+    if (mean < 2)
+    {
+        return mean;
+    }
+
+    return mean / 2 + NextMockRandom(pGenerator) % mean;
+}
+
+// Generator Functions
+static void
+InitMockGenerator(
+    MockGenerator *pGenerator,
+    const MockWorkload *pWorkload,
+    uint64_t startTime)
+{
+    pGenerator->workload = *pWorkload;
+    pWorkload = &pGenerator->workload;
+    if (pGenerator->workload.numKernelNames == 0)
+    {
+        pGenerator->workload.numKernelNames = 1;
+    }
+    if (pGenerator->workload.numStreams == 0)
+    {
+        pGenerator->workload.numStreams = 1;
+    }
+    if (pGenerator->workload.numDevices == 0)
+    {
+        pGenerator->workload.numDevices = 1;
+    }
+    if (pGenerator->workload.kernelWeight + pGenerator->workload.memcpyWeight + pGenerator->workload.memsetWeight == 0)
+    {
+        pGenerator->workload.kernelWeight = 1;
+    }
+
+    pGenerator->rngState = pWorkload->seed ? pWorkload->seed : 1;
+    pGenerator->hostTime = startTime;
+    pGenerator->nextCorrelationId = 1;
+    pGenerator->numOperations = 0;
+    pGenerator->traceOffset = startTime;
+    pGenerator->streamIdleTime.assign((size_t)pWorkload->numDevices * pWorkload->numStreams, startTime);
+
+    pGenerator->kernelNames.clear();
+    pGenerator->kernelMeanNs.clear();
+    pGenerator->kernelNames.reserve(pWorkload->numKernelNames);
+    for (uint32_t i = 0; i < pWorkload->numKernelNames; i++)
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "MockKernel%u(float*, float const*, int)", i);
+        pGenerator->kernelNames.push_back(name);
+        pGenerator->kernelMeanNs.push_back(NextMockJitter(pGenerator, pWorkload->meanKernelNs));
+    }
+}
+
+// Next operation of the operation trace: the trace is replayed in rounds, each shifted by the
+// duration of the trace, with new correlation ids.
+static void
+NextMockTraceOperation(
+    MockGenerator *pGenerator,
+    MockOperation *pOperation)
+{
+    const MockOperationTrace *pTrace = pGenerator->workload.pOperationTrace;
+    size_t index = (size_t)(pGenerator->numOperations % pTrace->operations.size());
+
+    if (index == 0 && pGenerator->numOperations)
+    {
+        pGenerator->traceOffset += pTrace->duration;
+    }
+
+    *pOperation = pTrace->operations[index];
+    pOperation->correlationId = pGenerator->nextCorrelationId++;
+    pOperation->apiStart += pGenerator->traceOffset;
+    pOperation->apiEnd += pGenerator->traceOffset;
+    pOperation->gpuStart += pGenerator->traceOffset;
+    pOperation->gpuEnd += pGenerator->traceOffset;
+    pGenerator->hostTime = pOperation->apiEnd;
+
+    pGenerator->numOperations++;
+}
+
+// Generate the next operation. Kernel names follow a skewed distribution: low indices are picked more often.
+static void
+NextMockOperation(
+    MockGenerator *pGenerator,
+    MockOperation *pOperation)
+{
+    const MockWorkload *pWorkload = &pGenerator->workload;
+
+    if (pWorkload->pOperationTrace && !pWorkload->pOperationTrace->operations.empty())
+    {
+        NextMockTraceOperation(pGenerator, pOperation);
+        return;
+    }
+
+    uint32_t totalWeight = pWorkload->kernelWeight + pWorkload->memcpyWeight + pWorkload->memsetWeight;
+    uint32_t pick = (uint32_t)(NextMockRandom(pGenerator) % (totalWeight ? totalWeight : 1));
+    uint32_t stream = (uint32_t)(NextMockRandom(pGenerator) % ((uint64_t)pWorkload->numDevices * pWorkload->numStreams));
+    uint64_t gpuDuration;
+
+    memset(pOperation, 0, sizeof(MockOperation));
+    pOperation->correlationId = pGenerator->nextCorrelationId++;
+    pOperation->deviceId = stream / pWorkload->numStreams;
+    pOperation->contextId = pOperation->deviceId + 1;
+    pOperation->streamId = stream % pWorkload->numStreams + 1;
+    pOperation->processId = 1000;
+    pOperation->threadId = 1000;
+
+    if (pick < pWorkload->kernelWeight)
+    {
+        uint32_t a = (uint32_t)(NextMockRandom(pGenerator) % pWorkload->numKernelNames);
+        uint32_t b = (uint32_t)(NextMockRandom(pGenerator) % pWorkload->numKernelNames);
+        uint32_t kernel = a < b ? a : b;
+
+        pOperation->gpuKind = CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL;
+        pOperation->cbid = CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000;
+        pOperation->pApiName = "cudaLaunchKernel";
+        pOperation->pKernelName = pGenerator->kernelNames[kernel].c_str();
+        gpuDuration = NextMockJitter(pGenerator, pGenerator->kernelMeanNs[kernel]);
+    }
+    else
+    {
+        pOperation->bytes = NextMockJitter(pGenerator, pWorkload->meanCopyBytes);
+        // About 10 GB/s.
+        gpuDuration = pOperation->bytes / 10 + 1000;
+
+        if (pick < pWorkload->kernelWeight + pWorkload->memcpyWeight)
+        {
+            pOperation->gpuKind = CUPTI_ACTIVITY_KIND_MEMCPY;
+            pOperation->cbid = CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020;
+            pOperation->pApiName = "cudaMemcpyAsync";
+        }
+        else
+        {
+            pOperation->gpuKind = CUPTI_ACTIVITY_KIND_MEMSET;
+            pOperation->cbid = CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020;
+            pOperation->pApiName = "cudaMemsetAsync";
+        }
+    }
+
+    // Host side: a few microseconds per API call, with some idle time in between.
+    pOperation->apiStart = pGenerator->hostTime + NextMockJitter(pGenerator, 1000);
+    pOperation->apiEnd = pOperation->apiStart + NextMockJitter(pGenerator, 3000);
+    pGenerator->hostTime = pOperation->apiEnd;
+
+    // GPU side: after the launch latency, once the stream is idle.
+    uint64_t ready = pOperation->apiStart + NextMockJitter(pGenerator, 5000);
+    uint64_t *pIdle = &pGenerator->streamIdleTime[stream];
+    pOperation->gpuStart = ready > *pIdle ? ready : *pIdle;
+    pOperation->gpuEnd = pOperation->gpuStart + gpuDuration;
+    *pIdle = pOperation->gpuEnd;
+
+    pGenerator->numOperations++;
+}
+
+// Read an operation trace. Every line that is not empty or a # comment holds one operation:
+//
+//   <kind> <apiStart> <apiEnd> <gpuStart> <gpuEnd> <bytes> <deviceId> <contextId> <streamId> <processId> <threadId> [<kernel name>]
+//
+// with kind one of kernel, memcpy or memset, timestamps in ns and the kernel name, which may hold
+// spaces, up to the end of the line. Returns false if the file can't be read or a line is invalid.
+static bool
+ReadMockOperationTrace(
+    const char *pFileName,
+    MockOperationTrace *pTrace)
+{
+    std::vector<size_t> nameIndices;
+    std::map<std::string, size_t> nameMap;
+    char line[MOCK_TRACE_LINE_SIZE];
+    unsigned int lineNumber = 0;
+
+    FILE *pFile = fopen(pFileName, "r");
+    if (!pFile)
+    {
+        fprintf(stderr, "Error: Failed to open the operation trace %s.\n", pFileName);
+        return false;
+    }
+
+    pTrace->operations.clear();
+    pTrace->kernelNames.clear();
+    pTrace->duration = 0;
+
+    while (fgets(line, sizeof(line), pFile))
+    {
+        MockOperation operation;
+        char kind[16];
+        unsigned long long apiStart, apiEnd, gpuStart, gpuEnd, bytes;
+        unsigned int deviceId, contextId, streamId, processId, threadId;
+        int nameOffset = 0;
+
+        lineNumber++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[strspn(line, " \t")] == '\0' || line[strspn(line, " \t")] == '#')
+        {
+            continue;
+        }
+
+        if (sscanf(line, "%15s %llu %llu %llu %llu %llu %u %u %u %u %u %n", kind, &apiStart, &apiEnd, &gpuStart, &gpuEnd, &bytes,
+                   &deviceId, &contextId, &streamId, &processId, &threadId, &nameOffset) != 11 ||
+            apiEnd < apiStart || gpuEnd < gpuStart)
+        {
+            fprintf(stderr, "Error: Invalid operation at line %u of %s.\n", lineNumber, pFileName);
+            fclose(pFile);
+            return false;
+        }
+
+        memset(&operation, 0, sizeof(MockOperation));
+        if (!strcmp(kind, "kernel"))
+        {
+            std::string name(nameOffset ? line + nameOffset : "");
+            if (name.empty())
+            {
+                fprintf(stderr, "Error: Kernel without name at line %u of %s.\n", lineNumber, pFileName);
+                fclose(pFile);
+                return false;
+            }
+
+            std::map<std::string, size_t>::iterator it = nameMap.find(name);
+            if (it == nameMap.end())
+            {
+                it = nameMap.insert(std::make_pair(name, pTrace->kernelNames.size())).first;
+                pTrace->kernelNames.push_back(name);
+            }
+            nameIndices.push_back(it->second);
+
+            operation.gpuKind = CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL;
+            operation.cbid = CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000;
+            operation.pApiName = "cudaLaunchKernel";
+        }
+        else if (!strcmp(kind, "memcpy") || !strcmp(kind, "memset"))
+        {
+            bool isMemcpy = !strcmp(kind, "memcpy");
+
+            nameIndices.push_back((size_t)-1);
+            operation.gpuKind = isMemcpy ? CUPTI_ACTIVITY_KIND_MEMCPY : CUPTI_ACTIVITY_KIND_MEMSET;
+            operation.cbid = isMemcpy ? CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020 : CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020;
+            operation.pApiName = isMemcpy ? "cudaMemcpyAsync" : "cudaMemsetAsync";
+        }
+        else
+        {
+            fprintf(stderr, "Error: Unknown operation kind %s at line %u of %s.\n", kind, lineNumber, pFileName);
+            fclose(pFile);
+            return false;
+        }
+
+        operation.apiStart = apiStart;
+        operation.apiEnd = apiEnd;
+        operation.gpuStart = gpuStart;
+        operation.gpuEnd = gpuEnd;
+        operation.bytes = bytes;
+        operation.deviceId = deviceId;
+        operation.contextId = contextId;
+        operation.streamId = streamId;
+        operation.processId = processId;
+        operation.threadId = threadId;
+        pTrace->operations.push_back(operation);
+
+        pTrace->duration = apiEnd > pTrace->duration ? apiEnd : pTrace->duration;
+        pTrace->duration = gpuEnd > pTrace->duration ? gpuEnd : pTrace->duration;
+    }
+    fclose(pFile);
+
+    // The names are no longer added, their pointers are stable.
+    for (size_t i = 0; i < pTrace->operations.size(); i++)
+    {
+        if (nameIndices[i] != (size_t)-1)
+        {
+            pTrace->operations[i].pKernelName = pTrace->kernelNames[nameIndices[i]].c_str();
+        }
+    }
+
+    if (pTrace->operations.empty())
+    {
+        fprintf(stderr, "Error: The operation trace %s holds no operation.\n", pFileName);
+        return false;
+    }
+
+    return true;
+}
+
+// Record Functions
+
+// Size of the records written for kind, 0 for kinds the generator does not produce.
+static size_t
+GetMockRecordSize(
+    CUpti_ActivityKind kind)
+{
+    switch (kind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+            return MOCK_ALIGN_SIZE(sizeof(CUpti_ActivityKernel10));
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+            return MOCK_ALIGN_SIZE(sizeof(CUpti_ActivityMemcpy6));
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+            return MOCK_ALIGN_SIZE(sizeof(CUpti_ActivityMemset4));
+        case CUPTI_ACTIVITY_KIND_RUNTIME:
+        case CUPTI_ACTIVITY_KIND_DRIVER:
+            return MOCK_ALIGN_SIZE(sizeof(CUpti_ActivityAPI));
+        case CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION:
+            return MOCK_ALIGN_SIZE(sizeof(CUpti_ActivityExternalCorrelation));
+        default:
+            return 0;
+    }
+}
+
+// Write the runtime API record of the operation to pDestination, which holds GetMockRecordSize(CUPTI_ACTIVITY_KIND_RUNTIME) bytes.
+static void
+WriteMockApiRecord(
+    const MockOperation *pOperation,
+    uint8_t *pDestination)
+{
+    CUpti_ActivityAPI *pRecord = (CUpti_ActivityAPI *)pDestination;
+
+    memset(pRecord, 0, sizeof(CUpti_ActivityAPI));
+    pRecord->kind = CUPTI_ACTIVITY_KIND_RUNTIME;
+    pRecord->cbid = pOperation->cbid;
+    pRecord->start = pOperation->apiStart;
+    pRecord->end = pOperation->apiEnd;
+    pRecord->processId = pOperation->processId;
+    pRecord->threadId = pOperation->threadId;
+    pRecord->correlationId = pOperation->correlationId;
+    pRecord->returnValue = 0;
+}
+
+// Write the GPU record of the operation to pDestination, which holds GetMockRecordSize(pOperation->gpuKind) bytes.
+static void
+WriteMockGpuRecord(
+    const MockOperation *pOperation,
+    uint8_t *pDestination)
+{
+    switch (pOperation->gpuKind)
+    {
+        case CUPTI_ACTIVITY_KIND_KERNEL:
+        case CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL:
+        {
+            CUpti_ActivityKernel10 *pRecord = (CUpti_ActivityKernel10 *)pDestination;
+
+            memset(pRecord, 0, sizeof(CUpti_ActivityKernel10));
+            pRecord->kind = pOperation->gpuKind;
+            pRecord->start = pOperation->gpuStart;
+            pRecord->end = pOperation->gpuEnd;
+            pRecord->completed = pOperation->gpuEnd;
+            pRecord->deviceId = pOperation->deviceId;
+            pRecord->contextId = pOperation->contextId;
+            pRecord->streamId = pOperation->streamId;
+            pRecord->correlationId = pOperation->correlationId;
+            pRecord->gridX = 196;
+            pRecord->gridY = 1;
+            pRecord->gridZ = 1;
+            pRecord->blockX = 256;
+            pRecord->blockY = 1;
+            pRecord->blockZ = 1;
+            pRecord->registersPerThread = 32;
+            pRecord->name = pOperation->pKernelName;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMCPY:
+        {
+            CUpti_ActivityMemcpy6 *pRecord = (CUpti_ActivityMemcpy6 *)pDestination;
+
+            memset(pRecord, 0, sizeof(CUpti_ActivityMemcpy6));
+            pRecord->kind = CUPTI_ACTIVITY_KIND_MEMCPY;
+            pRecord->copyKind = (pOperation->correlationId & 1) ? CUPTI_ACTIVITY_MEMCPY_KIND_HTOD : CUPTI_ACTIVITY_MEMCPY_KIND_DTOH;
+            pRecord->srcKind = (pOperation->correlationId & 1) ? CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE : CUPTI_ACTIVITY_MEMORY_KIND_DEVICE;
+            pRecord->dstKind = (pOperation->correlationId & 1) ? CUPTI_ACTIVITY_MEMORY_KIND_DEVICE : CUPTI_ACTIVITY_MEMORY_KIND_PAGEABLE;
+            pRecord->bytes = pOperation->bytes;
+            pRecord->start = pOperation->gpuStart;
+            pRecord->end = pOperation->gpuEnd;
+            pRecord->deviceId = pOperation->deviceId;
+            pRecord->contextId = pOperation->contextId;
+            pRecord->streamId = pOperation->streamId;
+            pRecord->correlationId = pOperation->correlationId;
+            break;
+        }
+        case CUPTI_ACTIVITY_KIND_MEMSET:
+        {
+            CUpti_ActivityMemset4 *pRecord = (CUpti_ActivityMemset4 *)pDestination;
+
+            memset(pRecord, 0, sizeof(CUpti_ActivityMemset4));
+            pRecord->kind = CUPTI_ACTIVITY_KIND_MEMSET;
+            pRecord->bytes = pOperation->bytes;
+            pRecord->start = pOperation->gpuStart;
+            pRecord->end = pOperation->gpuEnd;
+            pRecord->deviceId = pOperation->deviceId;
+            pRecord->contextId = pOperation->contextId;
+            pRecord->streamId = pOperation->streamId;
+            pRecord->correlationId = pOperation->correlationId;
+            pRecord->memoryKind = CUPTI_ACTIVITY_MEMORY_KIND_DEVICE;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Iterate the records of a buffer filled by the generator, with the semantics of cuptiActivityGetNextRecord().
+static CUptiResult
+GetNextMockRecord(
+    uint8_t *pBuffer,
+    size_t validBufferSizeBytes,
+    CUpti_Activity **ppRecord)
+{
+    size_t offset = 0;
+
+    if (*ppRecord)
+    {
+        size_t recordSize = GetMockRecordSize((*ppRecord)->kind);
+        if (recordSize == 0)
+        {
+            return CUPTI_ERROR_INVALID_KIND;
+        }
+        offset = (size_t)((uint8_t *)*ppRecord - pBuffer) + recordSize;
+    }
+
+    if (offset + sizeof(CUpti_Activity) > validBufferSizeBytes)
+    {
+        *ppRecord = NULL;
+        return CUPTI_ERROR_MAX_LIMIT_REACHED;
+    }
+
+    *ppRecord = (CUpti_Activity *)(pBuffer + offset);
+
+    return CUPTI_SUCCESS;
+}
+
+// Fill pBuffer with the API and GPU records of generated operations until the next
+// operation does not fit. Returns the number of valid bytes.
+static size_t
+FillMockActivityBuffer(
+    MockGenerator *pGenerator,
+    uint8_t *pBuffer,
+    size_t bufferSize,
+    bool apiRecords)
+{
+    size_t apiSize = apiRecords ? GetMockRecordSize(CUPTI_ACTIVITY_KIND_RUNTIME) : 0;
+    size_t maxGpuSize = GetMockRecordSize(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL);
+    size_t validSize = 0;
+    MockOperation operation;
+
+    if (GetMockRecordSize(CUPTI_ACTIVITY_KIND_MEMCPY) > maxGpuSize)
+    {
+        maxGpuSize = GetMockRecordSize(CUPTI_ACTIVITY_KIND_MEMCPY);
+    }
+    if (GetMockRecordSize(CUPTI_ACTIVITY_KIND_MEMSET) > maxGpuSize)
+    {
+        maxGpuSize = GetMockRecordSize(CUPTI_ACTIVITY_KIND_MEMSET);
+    }
+
+    while (validSize + apiSize + maxGpuSize <= bufferSize)
+    {
+        NextMockOperation(pGenerator, &operation);
+        if (apiRecords)
+        {
+            WriteMockApiRecord(&operation, pBuffer + validSize);
+            validSize += apiSize;
+        }
+        WriteMockGpuRecord(&operation, pBuffer + validSize);
+        validSize += GetMockRecordSize(operation.gpuKind);
+    }
+
+    return validSize;
+}
+
+#endif // MOCK_WORKLOAD_H_
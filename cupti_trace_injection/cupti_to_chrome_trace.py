@@ -18,6 +18,8 @@ def parse_cupti_trace(filename):
     memcpy_pattern = r'MEMCPY "([^"]+)" \[ (\d+), (\d+) \] duration (\d+), size (\d+), copyCount (\d+), srcKind (\w+), dstKind (\w+), correlationId (\d+)'
     grid_pattern = r'\s+grid \[ (\d+), (\d+), (\d+) \], block \[ (\d+), (\d+), (\d+) \]'
     device_pattern = r'\s+deviceId (\d+), contextId (\d+), streamId (\d+)'
+    trace_control_pattern = r'(TRACE_CONTROL_START|TRACE_CONTROL_STOP) \[ (\d+) \] source (\w+), command (\w+), count (\d+)'
+    governor_pattern = r'(GOVERNOR_THROTTLE|GOVERNOR_RESUME) \[ (\d+) \] windowId (\d+), overhead ([\d.]+)%, budget ([\d.]+)%, resume ([\d.]+)%, kind (\w+), records (\d+), throttled (\d+)'
     
     with open(filename, 'r') as f:
         lines = f.readlines()
@@ -228,6 +230,55 @@ def parse_cupti_trace(filename):
             i += 1
             continue
             
+        # Parse trace control start and stop
+        match = re.search(trace_control_pattern, line)
+        if match:
+            action = "Start" if match.group(1) == "TRACE_CONTROL_START" else "Stop"
+
+            events.append({
+                "name": f"Trace control: {action} ({match.group(4)})",
+                "ph": "i",
+                "ts": int(match.group(2)) / 1000,
+                "tid": "Trace_Control",
+                "pid": "CUPTI_Overhead",
+                "cat": "Overhead",
+                "s": "g",
+                "args": {
+                    "source": match.group(3),
+                    "command": match.group(4),
+                    "count": int(match.group(5))
+                }
+            })
+            i += 1
+            continue
+
+        # Parse overhead governor decisions
+        match = re.search(governor_pattern, line)
+        if match:
+            action = "Throttle" if match.group(1) == "GOVERNOR_THROTTLE" else "Resume"
+            timestamp = int(match.group(2))
+            kind = match.group(7)
+
+            events.append({
+                "name": f"Governor: {action} {kind}",
+                "ph": "i",
+                "ts": timestamp / 1000,
+                "tid": "Overhead_Governor",
+                "pid": "CUPTI_Overhead",
+                "cat": "Overhead",
+                "s": "g",
+                "args": {
+                    "windowId": int(match.group(3)),
+                    "overheadPercent": float(match.group(4)),
+                    "budgetPercent": float(match.group(5)),
+                    "resumePercent": float(match.group(6)),
+                    "records": int(match.group(8)),
+                    "throttledKinds": int(match.group(9))
+                }
+            })
+            i += 1
+            continue
+
         # Parse MEMORY2 events
         match = re.search(memory_pattern, line)
         if match:
@@ -26,19 +26,101 @@
  *      Register to the atexit handler to get all the activity buffers including the ones
  *      which have incomplete activity records by using force flush API
  *      cuptiActivityFlushAll(1).
+ *
+ *  Overhead governor:
+ *      A thread flushes the activity buffers every window and sums the CUPTI
+ *      overhead records and the buffer processing time. When they exceed the
+ *      budget the most active kind is disabled, and enabled again once the
+ *      overhead drops. Off unless CUPTI_OVERHEAD_BUDGET_PERCENT is set, refer to
+ *      overhead_governor.h.
+ *
+ *  Flight recorder:
+ *      With CUPTI_FLIGHT_RECORDER_MB set the activity records are not printed,
+ *      the completed buffers are kept in an in-memory ring instead and written
+ *      to a binary trace file on fatal error, SIGUSR1/SIGTERM or a call to
+ *      CuptiTraceInjectionDumpFlightRecorder(). Refer to helper_cupti_flight_recorder.h.
+ *
+ *  Trace control:
+ *      With CUPTI_TRACE_CONTROL_SIGNALS, CUPTI_TRACE_CONTROL_FILE or
+ *      CUPTI_TRACE_CONTROL_SOCKET set the collection waits for start, stop,
+ *      "seconds <N>" or "kernels <N>" commands applied by a control thread,
+ *      so a running application can be traced for a short time without being
+ *      modified or restarted. Refer to trace_control.h.
+ *
+ *  NVTX range attribution:
+ *      With CUPTI_NVTX_ATTRIBUTION set the MARKER, API and kernel records are
+ *      also joined as the buffers complete, and the kernel GPU time of every
+ *      NVTX range path is printed at exit. Refer to helper_cupti_range_attribution.h.
+ *
+ *  Utilization analysis:
+ *      With CUPTI_UTILIZATION_ANALYSIS set the kernel, memcpy and memset
+ *      records are swept per device and stream as the buffers complete, and
+ *      the busy time, kernel concurrency, copy/compute overlap and idle gaps
+ *      are printed at exit. Refer to helper_cupti_utilization.h.
+ *
+ *  Launch latency:
+ *      With CUPTI_LAUNCH_LATENCY set the API records are joined with the
+ *      kernel, memcpy and memset records by correlation id, and the launch
+ *      latency and queueing delay percentiles per stream, thread and kernel,
+ *      the queue depth over time and the launch bound phases are printed at
+ *      exit. Refer to helper_cupti_launch_latency.h.
+ *
+ *  Bandwidth analysis:
+ *      With CUPTI_BANDWIDTH_ANALYSIS set the throughput of the MEMCPY and
+ *      MEMCPY2 records is summarized per path and size bucket and compared
+ *      with the peak of the link, and the pageable copies and tiny copy
+ *      storms are flagged at exit. Refer to helper_cupti_bandwidth.h.
+ *
+ *  Synchronization stalls:
+ *      With CUPTI_SYNC_STALL_ANALYSIS set the SYNCHRONIZATION and CUDA_EVENT
+ *      records are enabled, the time host threads block in stream, event and
+ *      context synchronizations is split between the kernels, memcpys and
+ *      memsets they wait for, also across streams through the stream wait
+ *      event dependencies, and the top blocking sync sites are printed at
+ *      exit. Refer to helper_cupti_sync_stall.h.
+ *
+ *  Critical path:
+ *      With CUPTI_CRITICAL_PATH set the kernels, memcpys, memsets and API
+ *      calls are kept in an arena, and at exit their dependency DAG (stream
+ *      order, launches, synchronizations, stream waits and host order) gives
+ *      the critical path of every step, an NVTX range or the whole trace, and
+ *      the slack of the operations off the path. Refer to
+ *      helper_cupti_critical_path.h.
+ *
+ *  External correlation rollup:
+ *      With CUPTI_EXTERNAL_ROLLUP set the EXTERNAL_CORRELATION records are
+ *      enabled, and the GPU time, bytes and launches of the kernels, memcpys
+ *      and memsets are charged to the external ids the application pushed
+ *      with cuptiActivityPushExternalCorrelationId(), e.g. one per framework
+ *      operator. Ids idle for CUPTI_EXTERNAL_ROLLUP_MAX_AGE_MS are folded into
+ *      the totals of their kind, so memory stays bounded on long runs. Refer
+ *      to helper_cupti_external_rollup.h.
  */
 
 // System headers
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <chrono>
+#include <condition_variable>
 #include <mutex>
+#include <thread>
 
 // CUDA headers
 #include <cuda.h>
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_bandwidth.h"
+#include "helper_cupti_critical_path.h"
+#include "helper_cupti_external_rollup.h"
+#include "helper_cupti_flight_recorder.h"
+#include "helper_cupti_launch_latency.h"
+#include "helper_cupti_range_attribution.h"
+#include "helper_cupti_sync_stall.h"
+#include "helper_cupti_utilization.h"
+#include "overhead_governor.h"
+#include "trace_control.h"
 
 // Detours for Windows
 #ifdef _WIN32
@@ -66,6 +148,40 @@ typedef struct InjectionGlobals_st
     CUpti_SubscriberHandle  subscriberHandle;
     int                     tracingEnabled;
     uint64_t                profileMode;
+
+    int                     activitiesEnabled;                       // Activities are being collected.
+    CUcontext               profilerContext;                         // Context of cudaProfilerStart, NULL if the activities are enabled globally.
+    std::mutex              activityMutex;                           // Serializes the enabling of the activities with the governor.
+
+    OverheadGovernor        governor;
+    std::thread             governorThread;
+    std::mutex              governorMutex;
+    std::condition_variable governorCondition;
+    bool                    terminateGovernor;
+
+    TraceControl            control;
+    std::thread             controlThread;
+
+    int                     rangeAttributionEnabled;
+    RangeAttribution        rangeAttribution;
+
+    int                     utilizationEnabled;
+    UtilizationAnalyzer     utilization;
+
+    int                     launchLatencyEnabled;
+    LaunchLatencyAnalyzer   launchLatency;
+
+    int                     bandwidthEnabled;
+    BandwidthAnalyzer       bandwidth;
+
+    int                     syncStallEnabled;
+    SyncStallAnalyzer       syncStall;
+
+    int                     criticalPathEnabled;
+    CriticalPathAnalyzer    criticalPath;
+
+    int                     externalRollupEnabled;
+    ExternalRollup          externalRollup;
 } InjectionGlobals;
 
 InjectionGlobals injectionGlobals;
@@ -82,6 +198,44 @@ InitializeInjectionGlobals(void)
     injectionGlobals.subscriberHandle   = NULL;
     injectionGlobals.tracingEnabled     = 0;
     injectionGlobals.profileMode        = 0;
+    injectionGlobals.activitiesEnabled  = 0;
+    injectionGlobals.profilerContext    = NULL;
+    injectionGlobals.terminateGovernor  = false;
+    injectionGlobals.rangeAttributionEnabled = 0;
+    injectionGlobals.utilizationEnabled = 0;
+    injectionGlobals.launchLatencyEnabled = 0;
+    injectionGlobals.bandwidthEnabled = 0;
+    injectionGlobals.syncStallEnabled = 0;
+    injectionGlobals.criticalPathEnabled = 0;
+    injectionGlobals.externalRollupEnabled = 0;
+}
+
+static void
+StopOverheadGovernor(void)
+{
+    if (!injectionGlobals.governorThread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(injectionGlobals.governorMutex);
+        injectionGlobals.terminateGovernor = true;
+    }
+    injectionGlobals.governorCondition.notify_all();
+    injectionGlobals.governorThread.join();
+}
+
+static void
+StopTraceControl(void)
+{
+    if (injectionGlobals.controlThread.joinable())
+    {
+        PostTraceControlMessage(&injectionGlobals.control, TRACE_CONTROL_MESSAGE_EXIT);
+        injectionGlobals.controlThread.join();
+    }
+
+    DeInitTraceControl(&injectionGlobals.control);
 }
 
 static void
@@ -89,12 +243,72 @@ AtExitHandler(void)
 {
     CUPTI_API_CALL(cuptiGetLastError());
 
+    StopTraceControl();
+    StopOverheadGovernor();
+
     // Force flush the activity buffers.
     if (injectionGlobals.tracingEnabled)
     {
         CUPTI_API_CALL(DisableCuptiActivities(NULL));
         CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(1));
+
+        if (IsOverheadGovernorEnabled(&injectionGlobals.governor))
+        {
+            PrintOverheadGovernorSummary(&injectionGlobals.governor);
+        }
+
+        if (injectionGlobals.rangeAttributionEnabled)
+        {
+            PrintRangeAttribution(&injectionGlobals.rangeAttribution, stdout);
+            FreeRangeAttribution(&injectionGlobals.rangeAttribution);
+            injectionGlobals.rangeAttributionEnabled = 0;
+        }
+
+        if (injectionGlobals.utilizationEnabled)
+        {
+            PrintUtilizationReport(&injectionGlobals.utilization, stdout);
+            FreeUtilizationAnalyzer(&injectionGlobals.utilization);
+            injectionGlobals.utilizationEnabled = 0;
+        }
+
+        if (injectionGlobals.launchLatencyEnabled)
+        {
+            PrintLaunchLatencyReport(&injectionGlobals.launchLatency, stdout);
+            FreeLaunchLatencyAnalyzer(&injectionGlobals.launchLatency);
+            injectionGlobals.launchLatencyEnabled = 0;
+        }
+
+        if (injectionGlobals.bandwidthEnabled)
+        {
+            PrintBandwidthReport(&injectionGlobals.bandwidth, stdout);
+            FreeBandwidthAnalyzer(&injectionGlobals.bandwidth);
+            injectionGlobals.bandwidthEnabled = 0;
+        }
+
+        if (injectionGlobals.syncStallEnabled)
+        {
+            PrintSyncStallReport(&injectionGlobals.syncStall, stdout);
+            FreeSyncStallAnalyzer(&injectionGlobals.syncStall);
+            injectionGlobals.syncStallEnabled = 0;
+        }
+
+        if (injectionGlobals.criticalPathEnabled)
+        {
+            PrintCriticalPathReport(&injectionGlobals.criticalPath, stdout);
+            FreeCriticalPathAnalyzer(&injectionGlobals.criticalPath);
+            injectionGlobals.criticalPathEnabled = 0;
+        }
+
+        if (injectionGlobals.externalRollupEnabled)
+        {
+            PrintExternalRollupReport(&injectionGlobals.externalRollup, stdout);
+            FreeExternalRollup(&injectionGlobals.externalRollup);
+            injectionGlobals.externalRollupEnabled = 0;
+        }
     }
+
+    // The ring is only written on request, not at a normal exit.
+    DeInitFlightRecorder();
 }
 
 #ifdef _WIN32
@@ -200,6 +414,22 @@ SelectActivities()
     SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_NAME);
     SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_MARKER);
     SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_MARKER_DATA);
+    // The synchronizations are reported with the idle gaps they precede, attributed to the work they wait for
+    // and are edges of the critical path.
+    if (injectionGlobals.utilizationEnabled || injectionGlobals.syncStallEnabled || injectionGlobals.criticalPathEnabled)
+    {
+        SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_SYNCHRONIZATION);
+    }
+    // The event records give the stream an event synchronization or stream wait waits for.
+    if (injectionGlobals.syncStallEnabled || injectionGlobals.criticalPathEnabled)
+    {
+        SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_CUDA_EVENT);
+    }
+    // The external correlation records map the correlation ids to the external ids pushed by the application.
+    if (injectionGlobals.externalRollupEnabled)
+    {
+        SELECT_ACTIVITY(injectionGlobals.profileMode, CUPTI_ACTIVITY_KIND_EXTERNAL_CORRELATION);
+    }
 
     return CUPTI_SUCCESS;
 }
@@ -208,6 +438,8 @@ static CUptiResult
 EnableCuptiActivities(
     CUcontext context)
 {
+    std::lock_guard<std::mutex> lock(injectionGlobals.activityMutex);
+
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, injectionGlobals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020));
 
     CUPTI_API_CALL(SelectActivities());
@@ -216,7 +448,8 @@ EnableCuptiActivities(
     {
         CUptiResult result = CUPTI_SUCCESS;
 
-        if (IS_ACTIVITY_SELECTED(injectionGlobals.profileMode, i))
+        // Kinds throttled by the overhead governor stay disabled until it resumes them.
+        if (IS_ACTIVITY_SELECTED(injectionGlobals.profileMode, i) && !IsKindThrottled(&injectionGlobals.governor, i))
         {
             // If context is NULL activities are being enabled after CUDA initialization.
             // Else the activities are being enabled on cudaProfilerStart API.
@@ -246,6 +479,13 @@ EnableCuptiActivities(
         }
     }
 
+    injectionGlobals.activitiesEnabled = 1;
+    injectionGlobals.profilerContext = context;
+    if (IsOverheadGovernorEnabled(&injectionGlobals.governor))
+    {
+        ResetOverheadGovernorWindow(&injectionGlobals.governor);
+    }
+
     return CUPTI_SUCCESS;
 }
 
@@ -253,13 +493,16 @@ CUptiResult
 DisableCuptiActivities(
     CUcontext context)
 {
+    std::lock_guard<std::mutex> lock(injectionGlobals.activityMutex);
+
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(0, injectionGlobals.subscriberHandle, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020));
 
     for (int i = 0; i < CUPTI_ACTIVITY_KIND_COUNT; ++i)
     {
         CUptiResult result = CUPTI_SUCCESS;
 
-        if (IS_ACTIVITY_SELECTED(injectionGlobals.profileMode, i))
+        // Kinds throttled by the overhead governor are already disabled.
+        if (IS_ACTIVITY_SELECTED(injectionGlobals.profileMode, i) && !IsKindThrottled(&injectionGlobals.governor, i))
         {
             if (context == NULL)
             {
@@ -287,9 +530,218 @@ DisableCuptiActivities(
         }
     }
 
+    injectionGlobals.activitiesEnabled = 0;
+
     return CUPTI_SUCCESS;
 }
 
+// Apply a decision of the overhead governor, called with activityMutex held.
+static void
+SetGovernedActivityKind(
+    CUpti_ActivityKind kind,
+    int enable)
+{
+    CUcontext context = injectionGlobals.profilerContext;
+    CUptiResult result = CUPTI_ERROR_INVALID_KIND;
+
+    std::cout << (enable ? "Enabling" : "Disabling") << " CUPTI_ACTIVITY_KIND_" << GetActivityKindString(kind) << " (overhead governor).\n";
+
+    if (context != NULL)
+    {
+        result = enable ? cuptiActivityEnableContext(context, kind) : cuptiActivityDisableContext(context, kind);
+    }
+
+    if (result == CUPTI_ERROR_INVALID_KIND)
+    {
+        cuptiGetLastError();
+        CUPTI_API_CALL_VERBOSE(enable ? cuptiActivityEnable(kind) : cuptiActivityDisable(kind));
+    }
+    else if (result != CUPTI_SUCCESS)
+    {
+        CUPTI_API_CALL(result);
+    }
+}
+
+static void
+OverheadGovernorThread(void)
+{
+    OverheadGovernor *pGovernor = &injectionGlobals.governor;
+    std::chrono::milliseconds window(pGovernor->windowMs);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + window;
+
+    while (1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(injectionGlobals.governorMutex);
+            injectionGlobals.governorCondition.wait_until(lock, deadline, []{ return injectionGlobals.terminateGovernor; });
+            if (injectionGlobals.terminateGovernor)
+            {
+                break;
+            }
+        }
+        deadline += window;
+
+        // Deliver the completed records, the OVERHEAD records of the window among them.
+        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(0));
+
+        std::lock_guard<std::mutex> lock(injectionGlobals.activityMutex);
+        if (injectionGlobals.activitiesEnabled)
+        {
+            EvaluateOverheadGovernor(pGovernor, injectionGlobals.profileMode);
+        }
+    }
+}
+
+// Post processing of the activity records.
+static void
+InjectionPostProcessRecord(
+    CUpti_Activity *pRecord)
+{
+    if (IsOverheadGovernorEnabled(&injectionGlobals.governor))
+    {
+        GovernorProcessRecord(&injectionGlobals.governor, pRecord);
+    }
+
+    if (injectionGlobals.rangeAttributionEnabled)
+    {
+        RangeAttributionAddRecord(&injectionGlobals.rangeAttribution, pRecord);
+    }
+
+    if (injectionGlobals.utilizationEnabled)
+    {
+        UtilizationAddRecord(&injectionGlobals.utilization, pRecord);
+    }
+
+    if (injectionGlobals.launchLatencyEnabled)
+    {
+        LaunchLatencyAddRecord(&injectionGlobals.launchLatency, pRecord);
+    }
+
+    if (injectionGlobals.bandwidthEnabled)
+    {
+        BandwidthAddRecord(&injectionGlobals.bandwidth, pRecord);
+    }
+
+    if (injectionGlobals.syncStallEnabled)
+    {
+        SyncStallAddRecord(&injectionGlobals.syncStall, pRecord);
+    }
+
+    if (injectionGlobals.criticalPathEnabled)
+    {
+        CriticalPathAddRecord(&injectionGlobals.criticalPath, pRecord);
+    }
+
+    if (injectionGlobals.externalRollupEnabled)
+    {
+        ExternalRollupAddRecord(&injectionGlobals.externalRollup, pRecord);
+    }
+}
+
+// Enable (enable = 1) or disable (enable = 0) the kernel launch callbacks counted by the kernels command.
+static void
+EnableKernelLaunchCallbacks(
+    uint32_t enable)
+{
+    for (size_t i = 0; i < sizeof(s_TraceControlLaunchCallbacks) / sizeof(s_TraceControlLaunchCallbacks[0]); i++)
+    {
+        CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(enable, injectionGlobals.subscriberHandle, CUPTI_CB_DOMAIN_DRIVER_API, s_TraceControlLaunchCallbacks[i]));
+    }
+}
+
+static void
+StartControlledTracing(
+    const TraceControlCommand *pCommand)
+{
+    TraceControl *pControl = &injectionGlobals.control;
+
+    pControl->kernelsRemaining = (pCommand->type == TRACE_CONTROL_COMMAND_KERNELS) ? (int64_t)pCommand->count : 0;
+    EnableKernelLaunchCallbacks(pCommand->type == TRACE_CONTROL_COMMAND_KERNELS);
+
+    if (!injectionGlobals.activitiesEnabled)
+    {
+        CUPTI_API_CALL(EnableCuptiActivities(NULL));
+    }
+
+    PrintTraceControlMarker(pControl, "TRACE_CONTROL_START", pCommand);
+}
+
+static void
+StopControlledTracing(
+    const TraceControlCommand *pCommand)
+{
+    TraceControl *pControl = &injectionGlobals.control;
+
+    pControl->kernelsRemaining = 0;
+    EnableKernelLaunchCallbacks(0);
+
+    if (injectionGlobals.activitiesEnabled)
+    {
+        CUPTI_API_CALL(DisableCuptiActivities(injectionGlobals.profilerContext));
+        // Deliver the records of the traced interval now rather than with the next buffer.
+        CUPTI_API_CALL_VERBOSE(cuptiActivityFlushAll(0));
+    }
+
+    PrintTraceControlMarker(pControl, "TRACE_CONTROL_STOP", pCommand);
+}
+
+static void
+TraceControlThread(void)
+{
+    TraceControl *pControl = &injectionGlobals.control;
+    TraceControlCommand command = { TRACE_CONTROL_COMMAND_NONE, 0, NULL };
+    // Command of the seconds limit being waited for.
+    TraceControlCommand window = { TRACE_CONTROL_COMMAND_NONE, 0, NULL };
+    std::chrono::steady_clock::time_point deadline;
+    bool hasDeadline = false;
+
+    while (1)
+    {
+        int64_t timeoutMs = -1;
+
+        if (hasDeadline)
+        {
+            timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (timeoutMs <= 0)
+            {
+                hasDeadline = false;
+                window.pSource = "limit";
+                StopControlledTracing(&window);
+                continue;
+            }
+        }
+
+        if (!WaitTraceControlCommand(pControl, timeoutMs, &command))
+        {
+            continue;
+        }
+
+        switch (command.type)
+        {
+            case TRACE_CONTROL_COMMAND_START:
+            case TRACE_CONTROL_COMMAND_SECONDS:
+            case TRACE_CONTROL_COMMAND_KERNELS:
+                hasDeadline = (command.type == TRACE_CONTROL_COMMAND_SECONDS);
+                if (hasDeadline)
+                {
+                    deadline = std::chrono::steady_clock::now() + std::chrono::seconds(command.count);
+                    window = command;
+                }
+                StartControlledTracing(&command);
+                break;
+            case TRACE_CONTROL_COMMAND_STOP:
+            case TRACE_CONTROL_COMMAND_KERNEL_LIMIT:
+                hasDeadline = false;
+                StopControlledTracing(&command);
+                break;
+            case TRACE_CONTROL_COMMAND_EXIT:
+                return;
+            default:
+                break;
+        }
+    }
+}
+
 static CUptiResult
 OnCudaDeviceReset(void)
 {
@@ -330,72 +782,250 @@ OnProfilerStop(
     return CUPTI_SUCCESS;
 }
 
-void CUPTIAPI
-InjectionCallbackHandler(
+// Callback handlers, dispatched by CuptiCallbackHandler() through globals.callbackDispatch.
+static void
+ProfilerStartCallback(
     void *pUserData,
     CUpti_CallbackDomain domain,
     CUpti_CallbackId callbackId,
-    void *pCallbackData)
+    const void *pCallbackData)
 {
-    const CUpti_CallbackData *pCallbackInfo = (CUpti_CallbackData *)pCallbackData;
+    const CUpti_CallbackData *pCallbackInfo = (const CUpti_CallbackData *)pCallbackData;
 
-    // Check last error.
-    CUPTI_API_CALL(cuptiGetLastError());
+    // We start profiling collection on exit of the API.
+    if (pCallbackInfo->callbackSite == CUPTI_API_EXIT)
+    {
+        OnProfilerStart(pCallbackInfo->context);
+    }
+}
+
+static void
+ProfilerStopCallback(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    const CUpti_CallbackData *pCallbackInfo = (const CUpti_CallbackData *)pCallbackData;
 
-    switch (domain)
+    // We stop profiling collection on entry of the API.
+    if (pCallbackInfo->callbackSite == CUPTI_API_ENTER)
     {
-        case CUPTI_CB_DOMAIN_STATE:
-            HandleDomainStateCallback(callbackId, (CUpti_StateData *)pCallbackData);
-            break;
-        case CUPTI_CB_DOMAIN_DRIVER_API:
-        {
-            switch (callbackId)
-            {
-                case CUPTI_DRIVER_TRACE_CBID_cuProfilerStart:
-                {
-                    // We start profiling collection on exit of the API.
-                    if (pCallbackInfo->callbackSite == CUPTI_API_EXIT)
-                    {
-                        OnProfilerStart(pCallbackInfo->context);
-                    }
-                    break;
-                }
-                case CUPTI_DRIVER_TRACE_CBID_cuProfilerStop:
-                {
-                    // We stop profiling collection on entry of the API.
-                    if (pCallbackInfo->callbackSite == CUPTI_API_ENTER)
-                    {
-                        OnProfilerStop(pCallbackInfo->context);
-                    }
-                    break;
-                }
-                default:
-                    break;
-            }
-            break;
-        }
-        case CUPTI_CB_DOMAIN_RUNTIME_API:
-        {
-            switch (callbackId)
-            {
-                case CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020:
-                {
-                    if (pCallbackInfo->callbackSite == CUPTI_API_ENTER)
-                    {
-                        CUPTI_API_CALL(OnCudaDeviceReset());
-                    }
-                    break;
-                }
-                default:
-                    break;
-            }
-            break;
-        }
-        default:
-            break;
+        OnProfilerStop(pCallbackInfo->context);
+    }
+}
+
+static void
+KernelLaunchCallback(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    // Count the launches of a kernels command, the launch itself is still traced.
+    if (((const CUpti_CallbackData *)pCallbackData)->callbackSite == CUPTI_API_EXIT)
+    {
+        TraceControlOnKernelLaunch(&injectionGlobals.control);
     }
 }
 
+static void
+DeviceResetCallback(
+    void *pUserData,
+    CUpti_CallbackDomain domain,
+    CUpti_CallbackId callbackId,
+    const void *pCallbackData)
+{
+    if (((const CUpti_CallbackData *)pCallbackData)->callbackSite == CUPTI_API_ENTER)
+    {
+        CUPTI_API_CALL(OnCudaDeviceReset());
+    }
+}
+
+// Fill the dispatch table before the callbacks are enabled.
+static void
+RegisterInjectionCallbacks(void)
+{
+    CallbackDispatch *pDispatch = &globals.callbackDispatch;
+
+    RegisterCallbackHandler(pDispatch, CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuProfilerStart, ProfilerStartCallback, NULL);
+    RegisterCallbackHandler(pDispatch, CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuProfilerStop, ProfilerStopCallback, NULL);
+    RegisterCallbackHandler(pDispatch, CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaDeviceReset_v3020, DeviceResetCallback, NULL);
+
+    for (size_t i = 0; i < sizeof(s_TraceControlLaunchCallbacks) / sizeof(s_TraceControlLaunchCallbacks[0]); i++)
+    {
+        RegisterCallbackHandler(pDispatch, CUPTI_CB_DOMAIN_DRIVER_API, s_TraceControlLaunchCallbacks[i], KernelLaunchCallback, NULL);
+    }
+}
+
+static void
+SetupFlightRecorder(
+    UserData *pUserData)
+{
+    const char *pSize = getenv("CUPTI_FLIGHT_RECORDER_MB");
+    size_t ringSizeMb = pSize ? strtoul(pSize, NULL, 10) : 0;
+
+    if (ringSizeMb == 0)
+    {
+        return;
+    }
+
+    const char *pFileName = getenv("CUPTI_FLIGHT_RECORDER_FILE");
+    const char *pDumpWindow = getenv("CUPTI_FLIGHT_RECORDER_DUMP_MS");
+    char defaultFileName[64];
+
+    if (!pFileName || !*pFileName)
+    {
+#ifdef _WIN32
+        snprintf(defaultFileName, sizeof(defaultFileName), "cupti_flight_recorder_%d.bin", (int)GetCurrentProcessId());
+#else
+        snprintf(defaultFileName, sizeof(defaultFileName), "cupti_flight_recorder_%d.bin", (int)getpid());
+#endif
+        pFileName = defaultFileName;
+    }
+
+    // The records are kept raw in the ring, nothing is printed.
+    pUserData->printActivityRecords = 0;
+
+    InitFlightRecorder(ringSizeMb << 20, pFileName, pDumpWindow ? strtoull(pDumpWindow, NULL, 10) * 1000000 : 0);
+}
+
+static void
+SetupRangeAttribution(void)
+{
+    const char *pEnabled = getenv("CUPTI_NVTX_ATTRIBUTION");
+    const char *pMaxRanges = getenv("CUPTI_NVTX_ATTRIBUTION_MAX_RANGES");
+    uint32_t maxRanges = pMaxRanges ? (uint32_t)strtoul(pMaxRanges, NULL, 10) : 0;
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitRangeAttribution(&injectionGlobals.rangeAttribution, RANGE_ATTRIBUTION_DEFAULT_JOIN_CAPACITY, RANGE_ATTRIBUTION_DEFAULT_MAX_AGE_NS,
+                         maxRanges ? maxRanges : RANGE_ATTRIBUTION_DEFAULT_MAX_RANGES);
+    injectionGlobals.rangeAttributionEnabled = 1;
+
+    std::cout << "NVTX range attribution enabled, up to " << injectionGlobals.rangeAttribution.maxRanges << " ranges per thread.\n";
+}
+
+static void
+SetupUtilizationAnalysis(void)
+{
+    const char *pEnabled = getenv("CUPTI_UTILIZATION_ANALYSIS");
+    const char *pReorderMs = getenv("CUPTI_UTILIZATION_REORDER_MS");
+    const char *pLargeGapUs = getenv("CUPTI_UTILIZATION_LARGE_GAP_US");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitUtilizationAnalyzer(&injectionGlobals.utilization,
+                            pReorderMs ? strtoull(pReorderMs, NULL, 10) * 1000000 : UTILIZATION_DEFAULT_REORDER_NS,
+                            pLargeGapUs ? strtoull(pLargeGapUs, NULL, 10) * 1000 : UTILIZATION_DEFAULT_LARGE_GAP_NS);
+    injectionGlobals.utilizationEnabled = 1;
+
+    std::cout << "Utilization analysis enabled, reorder window " << injectionGlobals.utilization.reorderNs << " ns.\n";
+}
+
+static void
+SetupLaunchLatency(void)
+{
+    const char *pEnabled = getenv("CUPTI_LAUNCH_LATENCY");
+    const char *pWindowMs = getenv("CUPTI_LAUNCH_LATENCY_WINDOW_MS");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitLaunchLatencyAnalyzer(&injectionGlobals.launchLatency, LAUNCH_LATENCY_DEFAULT_JOIN_CAPACITY, LAUNCH_LATENCY_DEFAULT_MAX_AGE_NS,
+                              pWindowMs ? strtoull(pWindowMs, NULL, 10) * 1000000 : LAUNCH_LATENCY_DEFAULT_WINDOW_NS);
+    injectionGlobals.launchLatencyEnabled = 1;
+
+    std::cout << "Launch latency analysis enabled, windows of " << injectionGlobals.launchLatency.series.intervalNs << " ns.\n";
+}
+
+static void
+SetupBandwidthAnalysis(void)
+{
+    const char *pEnabled = getenv("CUPTI_BANDWIDTH_ANALYSIS");
+    const char *pPeaks = getenv("CUPTI_BANDWIDTH_PEAKS");
+    const char *pTinyBytes = getenv("CUPTI_BANDWIDTH_TINY_BYTES");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitBandwidthAnalyzer(&injectionGlobals.bandwidth, pTinyBytes ? strtoull(pTinyBytes, NULL, 10) : BANDWIDTH_DEFAULT_TINY_BYTES,
+                          BANDWIDTH_DEFAULT_STORM_COPIES);
+    if (pPeaks && !SetBandwidthPeaks(&injectionGlobals.bandwidth, pPeaks))
+    {
+        std::cerr << "Invalid CUPTI_BANDWIDTH_PEAKS " << pPeaks << ", expected e.g. pcie=25,peer=50,device=900,host=10.\n";
+    }
+    injectionGlobals.bandwidthEnabled = 1;
+
+    std::cout << "Bandwidth analysis enabled.\n";
+}
+
+static void
+SetupSyncStallAnalysis(void)
+{
+    const char *pEnabled = getenv("CUPTI_SYNC_STALL_ANALYSIS");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitSyncStallAnalyzer(&injectionGlobals.syncStall);
+    injectionGlobals.syncStallEnabled = 1;
+
+    std::cout << "Synchronization stall analysis enabled.\n";
+}
+
+static void
+SetupCriticalPath(void)
+{
+    const char *pEnabled = getenv("CUPTI_CRITICAL_PATH");
+    const char *pStep = getenv("CUPTI_CRITICAL_PATH_STEP");
+    const char *pMaxNodes = getenv("CUPTI_CRITICAL_PATH_MAX_NODES");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitCriticalPathAnalyzer(&injectionGlobals.criticalPath, pMaxNodes ? (uint32_t)strtoul(pMaxNodes, NULL, 10) : CRITICAL_PATH_DEFAULT_MAX_NODES, pStep);
+    injectionGlobals.criticalPathEnabled = 1;
+
+    std::cout << "Critical path analysis enabled, steps " << (pStep ? pStep : "<whole trace>") << ", up to "
+              << injectionGlobals.criticalPath.maxNodes << " nodes.\n";
+}
+
+static void
+SetupExternalRollup(void)
+{
+    const char *pEnabled = getenv("CUPTI_EXTERNAL_ROLLUP");
+    const char *pCapacity = getenv("CUPTI_EXTERNAL_ROLLUP_CAPACITY");
+    const char *pMaxAgeMs = getenv("CUPTI_EXTERNAL_ROLLUP_MAX_AGE_MS");
+
+    if (!pEnabled || atoi(pEnabled) == 0)
+    {
+        return;
+    }
+
+    InitExternalRollup(&injectionGlobals.externalRollup,
+                       pCapacity ? (uint32_t)strtoul(pCapacity, NULL, 10) : EXTERNAL_ROLLUP_DEFAULT_CAPACITY,
+                       pMaxAgeMs ? strtoull(pMaxAgeMs, NULL, 10) * 1000 * 1000 : EXTERNAL_ROLLUP_DEFAULT_MAX_AGE_NS);
+    injectionGlobals.externalRollupEnabled = 1;
+
+    std::cout << "External correlation rollup enabled, up to " << injectionGlobals.externalRollup.capacity
+              << " ids in flight per table, ids idle for " << injectionGlobals.externalRollup.maxAgeNs / (1000 * 1000) << " ms are complete.\n";
+}
+
 static void
 SetupCupti(void)
 {
@@ -406,8 +1036,26 @@ SetupCupti(void)
     pUserData->pPostProcessActivityRecords = NULL;
     pUserData->printActivityRecords        = 1;
 
-    // Common CUPTI Initialization.
-    InitCuptiTrace(pUserData, (void *)InjectionCallbackHandler, stdout);
+    InitOverheadGovernor(&injectionGlobals.governor, stdout, SetGovernedActivityKind);
+    SetupRangeAttribution();
+    SetupUtilizationAnalysis();
+    SetupLaunchLatency();
+    SetupBandwidthAnalysis();
+    SetupSyncStallAnalysis();
+    SetupCriticalPath();
+    SetupExternalRollup();
+    if (IsOverheadGovernorEnabled(&injectionGlobals.governor) || injectionGlobals.rangeAttributionEnabled ||
+        injectionGlobals.utilizationEnabled || injectionGlobals.launchLatencyEnabled || injectionGlobals.bandwidthEnabled ||
+        injectionGlobals.syncStallEnabled || injectionGlobals.criticalPathEnabled || injectionGlobals.externalRollupEnabled)
+    {
+        pUserData->pPostProcessActivityRecords = InjectionPostProcessRecord;
+    }
+
+    // Common CUPTI Initialization, with the table driven CuptiCallbackHandler().
+    InitCuptiTrace(pUserData, NULL, stdout);
+    RegisterInjectionCallbacks();
+
+    SetupFlightRecorder(pUserData);
 
     injectionGlobals.subscriberHandle = globals.subscriberHandle;
 
@@ -415,8 +1063,38 @@ SetupCupti(void)
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, injectionGlobals.subscriberHandle, CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuProfilerStart));
     CUPTI_API_CALL_VERBOSE(cuptiEnableCallback(1, injectionGlobals.subscriberHandle, CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuProfilerStop));
 
-    // Enable CUPTI activities.
-    CUPTI_API_CALL(EnableCuptiActivities(NULL));
+    InitTraceControl(&injectionGlobals.control, stdout, flightRecorder.enabled != 0);
+
+    // Enable CUPTI activities, unless the trace control waits for a start command.
+    if (!injectionGlobals.control.enabled || injectionGlobals.control.startEnabled)
+    {
+        CUPTI_API_CALL(EnableCuptiActivities(NULL));
+    }
+
+    if (IsOverheadGovernorEnabled(&injectionGlobals.governor))
+    {
+        std::cout << "Overhead governor: budget " << injectionGlobals.governor.budgetPercent << "%, resume below "
+                  << injectionGlobals.governor.resumePercent << "%, window " << injectionGlobals.governor.windowMs << " ms.\n";
+        injectionGlobals.governorThread = std::thread(OverheadGovernorThread);
+    }
+
+    if (injectionGlobals.control.enabled)
+    {
+        injectionGlobals.controlThread = std::thread(TraceControlThread);
+    }
+}
+
+// Write the flight recorder ring to pFileName, or to the default dump file if NULL.
+// Returns 1 on success, 0 if the flight recorder is not enabled or the file could not be written.
+#ifdef _WIN32
+extern "C" __declspec(dllexport) int
+CuptiTraceInjectionDumpFlightRecorder(const char *pFileName)
+#else
+extern "C" int
+CuptiTraceInjectionDumpFlightRecorder(const char *pFileName)
+#endif
+{
+    return FlightRecorderDump(pFileName, true) ? 1 : 0;
 }
 
 #ifdef _WIN32
@@ -0,0 +1,324 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Overhead governor used by the cupti_trace_injection sample.
+ *
+ * The governor adds up the duration of the CUPTI_ACTIVITY_KIND_OVERHEAD
+ * records and the time spent processing the activity buffers over a window
+ * of wall-clock time. When this self overhead exceeds the budget (a
+ * percentage of the window) the activity kind which produced the most records
+ * in the window is throttled, one kind per window. A throttled kind is
+ * resumed, the most recently throttled first, once the overhead stays below
+ * the resume threshold for a number of consecutive windows. The gap between
+ * the two thresholds and the resume delay keep the governor from oscillating.
+ *
+ * The governor is off by default: the buffer processing time includes the
+ * printing of every record, which alone can exceed a small budget.
+ *
+ * Every decision is printed to the trace output as a GOVERNOR_THROTTLE or
+ * GOVERNOR_RESUME marker line carrying the CUPTI timestamp of the decision.
+ */
+
+#ifndef OVERHEAD_GOVERNOR_H_
+#define OVERHEAD_GOVERNOR_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <vector>
+
+// CUPTI headers
+#include <cupti.h>
+#include "helper_cupti_activity.h"
+
+// Macros
+#define GOVERNOR_DEFAULT_BUDGET_PERCENT 0.0                          // Off unless CUPTI_OVERHEAD_BUDGET_PERCENT is set.
+#define GOVERNOR_DEFAULT_WINDOW_MS 1000
+#define GOVERNOR_DEFAULT_RESUME_WINDOWS 3
+
+#define GOVERNOR_KIND_MASK(activityKind) (1ULL << (activityKind))
+
+// Data structures
+// Enable (enable = 1) or disable (enable = 0) the collection of an activity kind.
+typedef void (*GovernorSetKindFunc)(CUpti_ActivityKind kind, int enable);
+
+typedef struct OverheadGovernor_st
+{
+    double              budgetPercent;                               // Overhead, in percent of the window, above which a kind is throttled. 0 disables the governor.
+    double              resumePercent;                               // Overhead below which a throttled kind may be resumed.
+    uint64_t            windowMs;                                    // Length of an evaluation window.
+    uint32_t            resumeWindows;                               // Consecutive windows below resumePercent before a kind is resumed.
+    uint64_t            candidateKinds;                              // Kinds the governor is allowed to throttle.
+    FILE                *pOutputFile;                                // Output of the marker lines.
+    GovernorSetKindFunc pSetKind;                                    // Applies the throttle decisions.
+
+    std::atomic<uint64_t> overheadNs;                                // Duration of the OVERHEAD records received in the window.
+    std::atomic<uint64_t> kindRecords[CUPTI_ACTIVITY_KIND_COUNT];    // Records received in the window, per kind.
+
+    uint32_t            windowId;                                    // Windows evaluated so far.
+    uint64_t            windowStartTimestamp;                        // CUPTI timestamp of the start of the window.
+    uint64_t            windowStartProcessingNs;                     // globals.bufferProcessingNs at the start of the window.
+    uint32_t            windowsBelow;                                // Consecutive windows below resumePercent.
+    uint64_t            throttledKinds;                              // Mask of the throttled kinds.
+    std::vector<CUpti_ActivityKind> throttleOrder;                   // Throttled kinds, most recent last.
+    uint64_t            throttleEvents;
+    uint64_t            resumeEvents;
+    double              maxOverheadPercent;                          // Highest overhead of a window.
+} OverheadGovernor;
+
+// Kinds throttled first when no records were seen in the window, the API tracing being the most expensive.
+static const CUpti_ActivityKind s_GovernorDefaultKinds[] =
+{
+    CUPTI_ACTIVITY_KIND_DRIVER,
+    CUPTI_ACTIVITY_KIND_RUNTIME,
+    CUPTI_ACTIVITY_KIND_MEMORY2,
+    CUPTI_ACTIVITY_KIND_MEMSET,
+    CUPTI_ACTIVITY_KIND_MEMCPY2,
+    CUPTI_ACTIVITY_KIND_MARKER,
+    CUPTI_ACTIVITY_KIND_MARKER_DATA
+};
+
+// Helper Functions
+static double
+ReadGovernorEnvDouble(
+    const char *pName,
+    double defaultValue)
+{
+    const char *pValue = getenv(pName);
+
+    return (pValue && *pValue) ? atof(pValue) : defaultValue;
+}
+
+// Configure the governor from CUPTI_OVERHEAD_BUDGET_PERCENT, CUPTI_OVERHEAD_RESUME_PERCENT,
+// CUPTI_OVERHEAD_WINDOW_MS and CUPTI_OVERHEAD_RESUME_WINDOWS.
+static void
+InitOverheadGovernor(
+    OverheadGovernor *pGovernor,
+    FILE *pOutputFile,
+    GovernorSetKindFunc pSetKind)
+{
+    pGovernor->budgetPercent = ReadGovernorEnvDouble("CUPTI_OVERHEAD_BUDGET_PERCENT", GOVERNOR_DEFAULT_BUDGET_PERCENT);
+    pGovernor->resumePercent = ReadGovernorEnvDouble("CUPTI_OVERHEAD_RESUME_PERCENT", pGovernor->budgetPercent / 2);
+    pGovernor->windowMs = (uint64_t)ReadGovernorEnvDouble("CUPTI_OVERHEAD_WINDOW_MS", GOVERNOR_DEFAULT_WINDOW_MS);
+    pGovernor->resumeWindows = (uint32_t)ReadGovernorEnvDouble("CUPTI_OVERHEAD_RESUME_WINDOWS", GOVERNOR_DEFAULT_RESUME_WINDOWS);
+
+    if (pGovernor->budgetPercent < 0)
+    {
+        pGovernor->budgetPercent = 0;
+    }
+    if (pGovernor->resumePercent > pGovernor->budgetPercent)
+    {
+        pGovernor->resumePercent = pGovernor->budgetPercent;
+    }
+    if (pGovernor->windowMs == 0)
+    {
+        pGovernor->windowMs = GOVERNOR_DEFAULT_WINDOW_MS;
+    }
+
+    pGovernor->candidateKinds = 0;
+    for (size_t i = 0; i < sizeof(s_GovernorDefaultKinds) / sizeof(s_GovernorDefaultKinds[0]); i++)
+    {
+        pGovernor->candidateKinds |= GOVERNOR_KIND_MASK(s_GovernorDefaultKinds[i]);
+    }
+
+    pGovernor->pOutputFile = pOutputFile ? pOutputFile : stdout;
+    pGovernor->pSetKind = pSetKind;
+
+    pGovernor->overheadNs = 0;
+    for (int i = 0; i < CUPTI_ACTIVITY_KIND_COUNT; i++)
+    {
+        pGovernor->kindRecords[i] = 0;
+    }
+
+    pGovernor->windowId = 0;
+    pGovernor->windowStartTimestamp = 0;
+    pGovernor->windowStartProcessingNs = 0;
+    pGovernor->windowsBelow = 0;
+    pGovernor->throttledKinds = 0;
+    pGovernor->throttleOrder.clear();
+    pGovernor->throttleEvents = 0;
+    pGovernor->resumeEvents = 0;
+    pGovernor->maxOverheadPercent = 0;
+}
+
+static int
+IsOverheadGovernorEnabled(
+    const OverheadGovernor *pGovernor)
+{
+    return pGovernor->budgetPercent > 0;
+}
+
+static int
+IsKindThrottled(
+    const OverheadGovernor *pGovernor,
+    int kind)
+{
+    return kind < 64 && (pGovernor->throttledKinds & GOVERNOR_KIND_MASK(kind)) != 0;
+}
+
+// Account one activity record. Called from the buffer completion, possibly concurrently with the evaluation.
+static void
+GovernorProcessRecord(
+    OverheadGovernor *pGovernor,
+    CUpti_Activity *pRecord)
+{
+    if (pRecord->kind < CUPTI_ACTIVITY_KIND_COUNT)
+    {
+        pGovernor->kindRecords[pRecord->kind].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (pRecord->kind == CUPTI_ACTIVITY_KIND_OVERHEAD)
+    {
+        CUpti_ActivityOverhead3 *pOverheadRecord = (CUpti_ActivityOverhead3 *)pRecord;
+
+        if (pOverheadRecord->end > pOverheadRecord->start)
+        {
+            pGovernor->overheadNs.fetch_add(pOverheadRecord->end - pOverheadRecord->start, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Start a new window, dropping what was accounted so far. Used when the collection (re)starts.
+static void
+ResetOverheadGovernorWindow(
+    OverheadGovernor *pGovernor)
+{
+    CUPTI_API_CALL(cuptiGetTimestamp(&pGovernor->windowStartTimestamp));
+    pGovernor->windowStartProcessingNs = globals.bufferProcessingNs.load();
+    pGovernor->windowsBelow = 0;
+
+    pGovernor->overheadNs = 0;
+    for (int i = 0; i < CUPTI_ACTIVITY_KIND_COUNT; i++)
+    {
+        pGovernor->kindRecords[i] = 0;
+    }
+}
+
+static void
+PrintGovernorMarker(
+    OverheadGovernor *pGovernor,
+    const char *pAction,
+    uint64_t timestamp,
+    double overheadPercent,
+    CUpti_ActivityKind kind,
+    uint64_t records)
+{
+    fprintf(pGovernor->pOutputFile, "%s [ %llu ] windowId %u, overhead %.3f%%, budget %.3f%%, resume %.3f%%, kind %s, records %llu, throttled %u\n",
+            pAction,
+            (unsigned long long)timestamp,
+            pGovernor->windowId,
+            overheadPercent,
+            pGovernor->budgetPercent,
+            pGovernor->resumePercent,
+            GetActivityKindString(kind),
+            (unsigned long long)records,
+            (unsigned int)pGovernor->throttleOrder.size());
+    fflush(pGovernor->pOutputFile);
+}
+
+// Close the window and apply at most one throttle decision. enabledKinds is the mask of the kinds being collected.
+// The caller serializes this with the enabling and disabling of the activities.
+static void
+EvaluateOverheadGovernor(
+    OverheadGovernor *pGovernor,
+    uint64_t enabledKinds)
+{
+    uint64_t timestamp = 0;
+    uint64_t records[CUPTI_ACTIVITY_KIND_COUNT];
+
+    CUPTI_API_CALL(cuptiGetTimestamp(&timestamp));
+    if (timestamp <= pGovernor->windowStartTimestamp)
+    {
+        return;
+    }
+
+    uint64_t processingNs = globals.bufferProcessingNs.load();
+    uint64_t overheadNs = pGovernor->overheadNs.exchange(0) + (processingNs - pGovernor->windowStartProcessingNs);
+    double overheadPercent = 100.0 * (double)overheadNs / (double)(timestamp - pGovernor->windowStartTimestamp);
+
+    for (int i = 0; i < CUPTI_ACTIVITY_KIND_COUNT; i++)
+    {
+        records[i] = pGovernor->kindRecords[i].exchange(0);
+    }
+
+    pGovernor->windowId++;
+    pGovernor->windowStartTimestamp = timestamp;
+    pGovernor->windowStartProcessingNs = processingNs;
+    if (overheadPercent > pGovernor->maxOverheadPercent)
+    {
+        pGovernor->maxOverheadPercent = overheadPercent;
+    }
+
+    if (overheadPercent > pGovernor->budgetPercent)
+    {
+        pGovernor->windowsBelow = 0;
+
+        // Throttle the busiest candidate, or the first candidate in priority order if none produced records.
+        int selected = -1;
+        for (size_t i = 0; i < sizeof(s_GovernorDefaultKinds) / sizeof(s_GovernorDefaultKinds[0]); i++)
+        {
+            CUpti_ActivityKind kind = s_GovernorDefaultKinds[i];
+
+            if (!(pGovernor->candidateKinds & GOVERNOR_KIND_MASK(kind)) ||
+                !(enabledKinds & GOVERNOR_KIND_MASK(kind)) ||
+                IsKindThrottled(pGovernor, kind))
+            {
+                continue;
+            }
+
+            if (selected < 0 || records[kind] > records[selected])
+            {
+                selected = kind;
+            }
+        }
+
+        if (selected >= 0)
+        {
+            pGovernor->pSetKind((CUpti_ActivityKind)selected, 0);
+            pGovernor->throttledKinds |= GOVERNOR_KIND_MASK(selected);
+            pGovernor->throttleOrder.push_back((CUpti_ActivityKind)selected);
+            pGovernor->throttleEvents++;
+
+            PrintGovernorMarker(pGovernor, "GOVERNOR_THROTTLE", timestamp, overheadPercent, (CUpti_ActivityKind)selected, records[selected]);
+        }
+    }
+    else if (overheadPercent < pGovernor->resumePercent && !pGovernor->throttleOrder.empty())
+    {
+        if (++pGovernor->windowsBelow >= pGovernor->resumeWindows)
+        {
+            CUpti_ActivityKind kind = pGovernor->throttleOrder.back();
+
+            pGovernor->throttleOrder.pop_back();
+            pGovernor->throttledKinds &= ~GOVERNOR_KIND_MASK(kind);
+            pGovernor->windowsBelow = 0;
+            pGovernor->resumeEvents++;
+            pGovernor->pSetKind(kind, 1);
+
+            PrintGovernorMarker(pGovernor, "GOVERNOR_RESUME", timestamp, overheadPercent, kind, 0);
+        }
+    }
+    else
+    {
+        pGovernor->windowsBelow = 0;
+    }
+}
+
+static void
+PrintOverheadGovernorSummary(
+    OverheadGovernor *pGovernor)
+{
+    fprintf(pGovernor->pOutputFile, "GOVERNOR_SUMMARY windows %u, throttles %llu, resumes %llu, throttled %u, maxOverhead %.3f%%, budget %.3f%%\n",
+            pGovernor->windowId,
+            (unsigned long long)pGovernor->throttleEvents,
+            (unsigned long long)pGovernor->resumeEvents,
+            (unsigned int)pGovernor->throttleOrder.size(),
+            pGovernor->maxOverheadPercent,
+            pGovernor->budgetPercent);
+}
+
+#endif // OVERHEAD_GOVERNOR_H_
@@ -0,0 +1,524 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * External start/stop control used by the cupti_trace_injection sample.
+ *
+ * Commands reach a control thread from three sources:
+ *  - SIGUSR1 (start) and SIGUSR2 (stop),
+ *  - a control file, polled by the thread and removed once read,
+ *  - a Unix domain socket accepting one command per connection.
+ *
+ * The commands are:
+ *     start        Enable the activities until the next stop.
+ *     stop         Disable the activities.
+ *     seconds <N>  Enable the activities for the next N seconds.
+ *     kernels <N>  Enable the activities for the next N kernel launches.
+ *
+ * The signal handler and the kernel launch callback only write a byte to a
+ * pipe, the control thread does the work. Every start and stop is printed to
+ * the trace output as a TRACE_CONTROL_START or TRACE_CONTROL_STOP marker line.
+ */
+
+#ifndef TRACE_CONTROL_H_
+#define TRACE_CONTROL_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// CUPTI headers
+#include <cupti.h>
+#include <helper_cupti.h>
+
+// Macros
+#define TRACE_CONTROL_DEFAULT_POLL_MS 500
+#define TRACE_CONTROL_MAX_COMMAND_LENGTH 256
+
+// Bytes written to the wake pipe.
+#define TRACE_CONTROL_MESSAGE_EXIT 0
+#define TRACE_CONTROL_MESSAGE_START 1
+#define TRACE_CONTROL_MESSAGE_STOP 2
+#define TRACE_CONTROL_MESSAGE_KERNEL_LIMIT 3
+
+// Data structures
+typedef enum
+{
+    TRACE_CONTROL_COMMAND_NONE = 0,
+    TRACE_CONTROL_COMMAND_START,
+    TRACE_CONTROL_COMMAND_STOP,
+    TRACE_CONTROL_COMMAND_SECONDS,
+    TRACE_CONTROL_COMMAND_KERNELS,
+    TRACE_CONTROL_COMMAND_KERNEL_LIMIT,                              // The kernel launches of a kernels command are done.
+    TRACE_CONTROL_COMMAND_EXIT                                       // Terminate the control thread.
+} TraceControlCommandType;
+
+typedef struct TraceControlCommand_st
+{
+    TraceControlCommandType type;
+    uint64_t                count;                                   // Seconds or kernel launches.
+    const char              *pSource;                                // "signal", "file", "socket" or "limit".
+} TraceControlCommand;
+
+typedef struct TraceControl_st
+{
+    int                     enabled;                                 // At least one command source is configured.
+    int                     startEnabled;                            // Collect from the start instead of waiting for a command.
+    int                     useSignals;
+    std::string             controlFile;
+    std::string             socketPath;
+    uint64_t                pollMs;                                  // Interval between two checks of the control file.
+    FILE                    *pOutputFile;                            // Output of the marker lines.
+
+    std::atomic<int64_t>    kernelsRemaining;                        // Launches left before the stop, 0 when no kernels command is active.
+
+#ifndef _WIN32
+    int                     wakePipe[2];
+    int                     socketFd;
+    struct sigaction        previousUsr1Action;
+    struct sigaction        previousUsr2Action;
+#endif
+} TraceControl;
+
+// Kernel launch callbacks counted by the kernels command.
+static const CUpti_CallbackId s_TraceControlLaunchCallbacks[] =
+{
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel,
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel_ptsz,
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx,
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx_ptsz,
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel,
+    CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel_ptsz
+};
+
+// Write end of the wake pipe, used by the signal handler.
+static volatile int s_TraceControlWakeFd = -1;
+
+// Helper Functions
+static const char *
+GetTraceControlCommandString(
+    TraceControlCommandType type)
+{
+    switch (type)
+    {
+        case TRACE_CONTROL_COMMAND_START:
+            return "start";
+        case TRACE_CONTROL_COMMAND_STOP:
+            return "stop";
+        case TRACE_CONTROL_COMMAND_SECONDS:
+            return "seconds";
+        case TRACE_CONTROL_COMMAND_KERNELS:
+            return "kernels";
+        case TRACE_CONTROL_COMMAND_KERNEL_LIMIT:
+            return "kernel_limit";
+        case TRACE_CONTROL_COMMAND_EXIT:
+            return "exit";
+        default:
+            return "<unknown>";
+    }
+}
+
+// Parse "start", "stop", "seconds <N>" or "kernels <N>", surrounding white space ignored.
+static bool
+ParseTraceControlCommand(
+    const char *pText,
+    TraceControlCommand *pCommand)
+{
+    char name[16] = { 0 };
+    unsigned long long count = 0;
+    char extra = 0;
+    int fields = sscanf(pText, " %15s %llu %c", name, &count, &extra);
+
+    pCommand->count = 0;
+
+    if (fields == 1 && !strcmp(name, "start"))
+    {
+        pCommand->type = TRACE_CONTROL_COMMAND_START;
+    }
+    else if (fields == 1 && !strcmp(name, "stop"))
+    {
+        pCommand->type = TRACE_CONTROL_COMMAND_STOP;
+    }
+    else if (fields == 2 && count > 0 && !strcmp(name, "seconds"))
+    {
+        pCommand->type = TRACE_CONTROL_COMMAND_SECONDS;
+        pCommand->count = count;
+    }
+    else if (fields == 2 && count > 0 && !strcmp(name, "kernels"))
+    {
+        pCommand->type = TRACE_CONTROL_COMMAND_KERNELS;
+        pCommand->count = count;
+    }
+    else
+    {
+        pCommand->type = TRACE_CONTROL_COMMAND_NONE;
+        return false;
+    }
+
+    return true;
+}
+
+static void
+PrintTraceControlMarker(
+    TraceControl *pControl,
+    const char *pMarker,
+    const TraceControlCommand *pCommand)
+{
+    uint64_t timestamp = 0;
+
+    CUPTI_API_CALL(cuptiGetTimestamp(&timestamp));
+
+    fprintf(pControl->pOutputFile, "%s [ %llu ] source %s, command %s, count %llu\n",
+            pMarker,
+            (unsigned long long)timestamp,
+            pCommand->pSource,
+            GetTraceControlCommandString(pCommand->type),
+            (unsigned long long)pCommand->count);
+    fflush(pControl->pOutputFile);
+}
+
+#ifndef _WIN32
+static void
+TraceControlSignalHandler(
+    int signalNumber)
+{
+    unsigned char message = (signalNumber == SIGUSR1) ? TRACE_CONTROL_MESSAGE_START : TRACE_CONTROL_MESSAGE_STOP;
+    int savedErrno = errno;
+
+    if (s_TraceControlWakeFd >= 0)
+    {
+        ssize_t written = write(s_TraceControlWakeFd, &message, 1);
+        (void)written;
+    }
+
+    errno = savedErrno;
+}
+
+static int
+CreateTraceControlSocket(
+    const char *pPath)
+{
+    struct sockaddr_un address;
+
+    if (strlen(pPath) >= sizeof(address.sun_path))
+    {
+        std::cerr << "Trace control: socket path " << pPath << " is too long.\n";
+        return -1;
+    }
+
+    int socketFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socketFd < 0)
+    {
+        std::cerr << "Trace control: failed to create the socket " << pPath << ": " << strerror(errno) << ".\n";
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, pPath);
+
+    // Remove the socket left by a previous run.
+    unlink(pPath);
+
+    if (bind(socketFd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(socketFd, 4) != 0)
+    {
+        std::cerr << "Trace control: failed to listen on the socket " << pPath << ": " << strerror(errno) << ".\n";
+        close(socketFd);
+        return -1;
+    }
+
+    fcntl(socketFd, F_SETFD, FD_CLOEXEC);
+
+    return socketFd;
+}
+
+// Read the command of one connection and answer "OK" or "ERROR".
+static bool
+ReadTraceControlSocket(
+    TraceControl *pControl,
+    TraceControlCommand *pCommand)
+{
+    char text[TRACE_CONTROL_MAX_COMMAND_LENGTH];
+    struct timeval timeout = { 1, 0 };
+    bool valid = false;
+
+    int connectionFd = accept(pControl->socketFd, NULL, NULL);
+    if (connectionFd < 0)
+    {
+        return false;
+    }
+
+    // A client that never writes does not block the control thread for more than the timeout.
+    setsockopt(connectionFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    ssize_t length = read(connectionFd, text, sizeof(text) - 1);
+    if (length > 0)
+    {
+        text[length] = '\0';
+        valid = ParseTraceControlCommand(text, pCommand);
+    }
+
+    const char *pReply = valid ? "OK\n" : "ERROR expected start, stop, seconds <N> or kernels <N>\n";
+    ssize_t written = write(connectionFd, pReply, strlen(pReply));
+    (void)written;
+    close(connectionFd);
+
+    pCommand->pSource = "socket";
+
+    return valid;
+}
+
+// Read and remove the control file if it exists.
+static bool
+ReadTraceControlFile(
+    TraceControl *pControl,
+    TraceControlCommand *pCommand)
+{
+    char text[TRACE_CONTROL_MAX_COMMAND_LENGTH];
+
+    FILE *pFile = fopen(pControl->controlFile.c_str(), "r");
+    if (!pFile)
+    {
+        return false;
+    }
+
+    bool hasLine = fgets(text, sizeof(text), pFile) != NULL;
+    fclose(pFile);
+    unlink(pControl->controlFile.c_str());
+
+    pCommand->pSource = "file";
+
+    if (!hasLine || !ParseTraceControlCommand(text, pCommand))
+    {
+        std::cerr << "Trace control: ignoring " << pControl->controlFile << ", expected start, stop, seconds <N> or kernels <N>.\n";
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+// Configure the control from CUPTI_TRACE_CONTROL_SIGNALS, CUPTI_TRACE_CONTROL_FILE,
+// CUPTI_TRACE_CONTROL_SOCKET, CUPTI_TRACE_CONTROL_POLL_MS and CUPTI_TRACE_CONTROL_START_ENABLED.
+// With signalsInUse set SIGUSR1 belongs to another handler and signal control is refused.
+static void
+InitTraceControl(
+    TraceControl *pControl,
+    FILE *pOutputFile,
+    bool signalsInUse)
+{
+    const char *pSignals = getenv("CUPTI_TRACE_CONTROL_SIGNALS");
+    const char *pFile = getenv("CUPTI_TRACE_CONTROL_FILE");
+    const char *pSocket = getenv("CUPTI_TRACE_CONTROL_SOCKET");
+    const char *pPollMs = getenv("CUPTI_TRACE_CONTROL_POLL_MS");
+    const char *pStartEnabled = getenv("CUPTI_TRACE_CONTROL_START_ENABLED");
+
+    pControl->enabled = 0;
+    pControl->useSignals = (pSignals && atoi(pSignals) != 0) ? 1 : 0;
+    pControl->controlFile = pFile ? pFile : "";
+    pControl->socketPath = pSocket ? pSocket : "";
+    pControl->pollMs = (pPollMs && atoi(pPollMs) > 0) ? (uint64_t)atoi(pPollMs) : TRACE_CONTROL_DEFAULT_POLL_MS;
+    pControl->startEnabled = (pStartEnabled && atoi(pStartEnabled) != 0) ? 1 : 0;
+    pControl->pOutputFile = pOutputFile ? pOutputFile : stdout;
+    pControl->kernelsRemaining = 0;
+
+    if (!pControl->useSignals && pControl->controlFile.empty() && pControl->socketPath.empty())
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    std::cerr << "Trace control: not supported on Windows, the CUPTI_TRACE_CONTROL_* variables are ignored.\n";
+#else
+    pControl->socketFd = -1;
+
+    if (pipe(pControl->wakePipe) != 0)
+    {
+        std::cerr << "Trace control: failed to create the wake pipe: " << strerror(errno) << ".\n";
+        return;
+    }
+    fcntl(pControl->wakePipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pControl->wakePipe[1], F_SETFD, FD_CLOEXEC);
+
+    if (pControl->useSignals && signalsInUse)
+    {
+        std::cerr << "Trace control: SIGUSR1 is used by the flight recorder, signal control is disabled.\n";
+        pControl->useSignals = 0;
+    }
+
+    if (pControl->useSignals)
+    {
+        struct sigaction action;
+
+        s_TraceControlWakeFd = pControl->wakePipe[1];
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = TraceControlSignalHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGUSR1, &action, &pControl->previousUsr1Action);
+        sigaction(SIGUSR2, &action, &pControl->previousUsr2Action);
+    }
+
+    if (!pControl->socketPath.empty())
+    {
+        pControl->socketFd = CreateTraceControlSocket(pControl->socketPath.c_str());
+    }
+
+    pControl->enabled = 1;
+
+    std::cout << "Trace control:"
+              << (pControl->useSignals ? " SIGUSR1/SIGUSR2" : "")
+              << (pControl->controlFile.empty() ? "" : " file " + pControl->controlFile)
+              << (pControl->socketFd >= 0 ? " socket " + pControl->socketPath : "")
+              << (pControl->startEnabled ? ", collecting from the start.\n" : ", waiting for a start command.\n");
+#endif
+}
+
+// Wake the control thread, safe to call from a callback.
+static void
+PostTraceControlMessage(
+    TraceControl *pControl,
+    unsigned char message)
+{
+#ifndef _WIN32
+    ssize_t written = write(pControl->wakePipe[1], &message, 1);
+    (void)written;
+#endif
+}
+
+// Count a kernel launch while a kernels command is active.
+static inline void
+TraceControlOnKernelLaunch(
+    TraceControl *pControl)
+{
+    if (pControl->kernelsRemaining.load(std::memory_order_relaxed) > 0 &&
+        pControl->kernelsRemaining.fetch_sub(1) == 1)
+    {
+        PostTraceControlMessage(pControl, TRACE_CONTROL_MESSAGE_KERNEL_LIMIT);
+    }
+}
+
+// Wait up to timeoutMs (forever if negative) for a command. Returns false on timeout.
+static bool
+WaitTraceControlCommand(
+    TraceControl *pControl,
+    int64_t timeoutMs,
+    TraceControlCommand *pCommand)
+{
+#ifndef _WIN32
+    struct pollfd fds[2];
+    nfds_t numFds = 1;
+
+    fds[0].fd = pControl->wakePipe[0];
+    fds[0].events = POLLIN;
+    if (pControl->socketFd >= 0)
+    {
+        fds[1].fd = pControl->socketFd;
+        fds[1].events = POLLIN;
+        numFds = 2;
+    }
+
+    // The control file has no notification, check it every pollMs.
+    if (!pControl->controlFile.empty() && (timeoutMs < 0 || (uint64_t)timeoutMs > pControl->pollMs))
+    {
+        timeoutMs = (int64_t)pControl->pollMs;
+    }
+
+    int ready = poll(fds, numFds, (int)timeoutMs);
+
+    if (ready > 0 && (fds[0].revents & POLLIN))
+    {
+        unsigned char message = TRACE_CONTROL_MESSAGE_EXIT;
+
+        if (read(pControl->wakePipe[0], &message, 1) == 1)
+        {
+            pCommand->count = 0;
+            pCommand->pSource = (message == TRACE_CONTROL_MESSAGE_KERNEL_LIMIT) ? "limit" : "signal";
+
+            switch (message)
+            {
+                case TRACE_CONTROL_MESSAGE_START:
+                    pCommand->type = TRACE_CONTROL_COMMAND_START;
+                    break;
+                case TRACE_CONTROL_MESSAGE_STOP:
+                    pCommand->type = TRACE_CONTROL_COMMAND_STOP;
+                    break;
+                case TRACE_CONTROL_MESSAGE_KERNEL_LIMIT:
+                    pCommand->type = TRACE_CONTROL_COMMAND_KERNEL_LIMIT;
+                    break;
+                default:
+                    pCommand->type = TRACE_CONTROL_COMMAND_EXIT;
+                    break;
+            }
+
+            return true;
+        }
+    }
+
+    if (ready > 0 && numFds == 2 && (fds[1].revents & POLLIN))
+    {
+        return ReadTraceControlSocket(pControl, pCommand);
+    }
+
+    if (!pControl->controlFile.empty())
+    {
+        return ReadTraceControlFile(pControl, pCommand);
+    }
+#endif
+
+    return false;
+}
+
+static void
+DeInitTraceControl(
+    TraceControl *pControl)
+{
+    if (!pControl->enabled)
+    {
+        return;
+    }
+
+#ifndef _WIN32
+    if (pControl->useSignals)
+    {
+        sigaction(SIGUSR1, &pControl->previousUsr1Action, NULL);
+        sigaction(SIGUSR2, &pControl->previousUsr2Action, NULL);
+        s_TraceControlWakeFd = -1;
+    }
+
+    if (pControl->socketFd >= 0)
+    {
+        close(pControl->socketFd);
+        unlink(pControl->socketPath.c_str());
+    }
+
+    close(pControl->wakePipe[0]);
+    close(pControl->wakePipe[1]);
+#endif
+
+    pControl->enabled = 0;
+}
+
+#endif // TRACE_CONTROL_H_
@@ -14,6 +14,7 @@
 // System headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // CUDA headers
 #include <cuda_runtime_api.h>
@@ -21,6 +22,7 @@
 // CUPTI headers
 #include <cupti_events.h>
 #include "helper_cupti.h"
+#include "helper_periodic_sampler.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -35,6 +37,9 @@
 #define N 100000
 #define ITERATIONS 10000
 #define SAMPLE_PERIOD_MS 50
+#define MAX_EVENTS 32
+#define SAMPLE_RING_ROWS 1024
+#define CONSUMER_PERIOD_MS 200
 
 // Global variables
 #ifdef _WIN32
@@ -45,12 +50,31 @@ sem_t semaphore;
 int ret;
 #endif
 
-// Used to signal from the compute thread to the sampling thread.
-static volatile int testComplete = 0;
-
 static CUcontext context;
 static CUdevice device;
-static const char *s_pEventName;
+
+// Events to sample, every event is one column of the sample row.
+static const char *s_pEventNames[MAX_EVENTS];
+static uint32_t s_numEventNames = 0;
+
+// Event groups read at every tick. Buffers are sized at setup so a read does no allocation.
+typedef struct EventGroupReader_st
+{
+    CUpti_EventGroupSets *pEventGroupSets;                           // Created by cuptiEventGroupSetsCreate, destroyed at teardown.
+    CUpti_EventGroupSet *pEventGroupSet;                             // Single pass set holding all requested events.
+    uint32_t            *pNumEvents;                                 // Events per group.
+    uint32_t            *pNumInstances;                              // Domain instances per group.
+    uint32_t            **ppColumns;                                 // Per group, column of each event in the sample row.
+    CUpti_EventID       **ppEventIds;                                // Per group, events in the order the columns assume.
+    uint64_t            *pValueBuffer;                               // Scratch buffer for cuptiEventGroupReadAllEvents.
+    size_t              valueBufferSize;                             // Size of pValueBuffer in bytes.
+    CUpti_EventID       *pEventIdBuffer;                             // Scratch buffer for the event ids read.
+    size_t              eventIdBufferSize;                           // Size of pEventIdBuffer in bytes.
+} EventGroupReader;
+
+static PeriodicSampler s_sampler;
+static SampleRing s_sampleRing;
+static uint64_t s_totals[MAX_EVENTS];
 
 // Kernels
 __global__ void
@@ -82,35 +106,201 @@ InitializeVector(
     }
 }
 
-void *
-DoSampling(
-    void *arg)
+static void
+SetupEventGroupReader(
+    EventGroupReader *pReader)
 {
-    CUpti_EventGroup eventGroup;
-    CUpti_EventID eventId;
-    size_t bytesRead, valueSize;
-    uint32_t numInstances = 0, j = 0;
-    uint64_t *pEventValues = NULL, eventValue = 0;
+    CUpti_EventID eventIds[MAX_EVENTS];
     uint32_t profileAll = 1;
+    size_t valueSize = 0;
+    size_t maxValues = 0;
+    size_t maxEvents = 0;
 
-    CUPTI_API_CALL(cuptiSetEventCollectionMode(context, CUPTI_EVENT_COLLECTION_MODE_CONTINUOUS));
+    for (uint32_t i = 0; i < s_numEventNames; i++)
+    {
+        CUPTI_API_CALL(cuptiEventGetIdFromName(device, s_pEventNames[i], &eventIds[i]));
+    }
+
+    // All events are read at the same tick, so they have to be collectable in a single pass.
+    CUPTI_API_CALL(cuptiEventGroupSetsCreate(context, sizeof(CUpti_EventID) * s_numEventNames, eventIds, &pReader->pEventGroupSets));
+    if (pReader->pEventGroupSets->numSets != 1)
+    {
+        printf("Error: The requested events need %u passes and cannot be sampled together.\n", pReader->pEventGroupSets->numSets);
+        exit(EXIT_FAILURE);
+    }
+    pReader->pEventGroupSet = &pReader->pEventGroupSets->sets[0];
+
+    uint32_t numGroups = pReader->pEventGroupSet->numEventGroups;
+    pReader->pNumEvents = (uint32_t *)calloc(numGroups, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pReader->pNumEvents);
+    pReader->pNumInstances = (uint32_t *)calloc(numGroups, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pReader->pNumInstances);
+    pReader->ppColumns = (uint32_t **)calloc(numGroups, sizeof(uint32_t *));
+    MEMORY_ALLOCATION_CALL(pReader->ppColumns);
+    pReader->ppEventIds = (CUpti_EventID **)calloc(numGroups, sizeof(CUpti_EventID *));
+    MEMORY_ALLOCATION_CALL(pReader->ppEventIds);
+
+    for (uint32_t group = 0; group < numGroups; group++)
+    {
+        CUpti_EventGroup eventGroup = pReader->pEventGroupSet->eventGroups[group];
+        CUpti_EventID groupEventIds[MAX_EVENTS];
+
+        CUPTI_API_CALL(cuptiEventGroupSetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(profileAll), &profileAll));
+
+        valueSize = sizeof(uint32_t);
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_NUM_EVENTS, &valueSize, &pReader->pNumEvents[group]));
+
+        valueSize = sizeof(groupEventIds);
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_EVENTS, &valueSize, groupEventIds));
+
+        // Map the position of each event in the group to its column in the sample row once,
+        // instead of searching event ids on every read.
+        pReader->ppColumns[group] = (uint32_t *)calloc(pReader->pNumEvents[group], sizeof(uint32_t));
+        MEMORY_ALLOCATION_CALL(pReader->ppColumns[group]);
+        pReader->ppEventIds[group] = (CUpti_EventID *)malloc(sizeof(CUpti_EventID) * pReader->pNumEvents[group]);
+        MEMORY_ALLOCATION_CALL(pReader->ppEventIds[group]);
+        memcpy(pReader->ppEventIds[group], groupEventIds, sizeof(CUpti_EventID) * pReader->pNumEvents[group]);
+        for (uint32_t j = 0; j < pReader->pNumEvents[group]; j++)
+        {
+            for (uint32_t column = 0; column < s_numEventNames; column++)
+            {
+                if (eventIds[column] == groupEventIds[j])
+                {
+                    pReader->ppColumns[group][j] = column;
+                    break;
+                }
+            }
+        }
+
+        CUPTI_API_CALL(cuptiEventGroupEnable(eventGroup));
+
+        valueSize = sizeof(uint32_t);
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &valueSize, &pReader->pNumInstances[group]));
+
+        if ((size_t)pReader->pNumEvents[group] * pReader->pNumInstances[group] > maxValues)
+        {
+            maxValues = (size_t)pReader->pNumEvents[group] * pReader->pNumInstances[group];
+        }
+        if (pReader->pNumEvents[group] > maxEvents)
+        {
+            maxEvents = pReader->pNumEvents[group];
+        }
+    }
+
+    pReader->valueBufferSize = sizeof(uint64_t) * maxValues;
+    pReader->pValueBuffer = (uint64_t *)malloc(pReader->valueBufferSize);
+    MEMORY_ALLOCATION_CALL(pReader->pValueBuffer);
+
+    pReader->eventIdBufferSize = sizeof(CUpti_EventID) * maxEvents;
+    pReader->pEventIdBuffer = (CUpti_EventID *)malloc(pReader->eventIdBufferSize);
+    MEMORY_ALLOCATION_CALL(pReader->pEventIdBuffer);
+}
+
+static void
+TeardownEventGroupReader(
+    EventGroupReader *pReader)
+{
+    for (uint32_t group = 0; group < pReader->pEventGroupSet->numEventGroups; group++)
+    {
+        CUPTI_API_CALL(cuptiEventGroupDisable(pReader->pEventGroupSet->eventGroups[group]));
+        free(pReader->ppColumns[group]);
+        free(pReader->ppEventIds[group]);
+    }
+
+    // Destroys the event groups of the sets as well.
+    CUPTI_API_CALL(cuptiEventGroupSetsDestroy(pReader->pEventGroupSets));
+    pReader->pEventGroupSets = NULL;
+    pReader->pEventGroupSet = NULL;
+
+    free(pReader->pNumEvents);
+    free(pReader->pNumInstances);
+    free(pReader->ppColumns);
+    free(pReader->ppEventIds);
+    free(pReader->pValueBuffer);
+    free(pReader->pEventIdBuffer);
+}
 
-    CUPTI_API_CALL(cuptiEventGroupCreate(context, &eventGroup, 0));
+// SampleReaderFunc reading every group of the set and summing all domain instances into one value per event.
+static int
+ReadEventGroups(
+    void *pReaderData,
+    uint64_t *pValues,
+    size_t numValues)
+{
+    EventGroupReader *pReader = (EventGroupReader *)pReaderData;
 
-    CUPTI_API_CALL(cuptiEventGetIdFromName(device, s_pEventName, &eventId));
+    memset(pValues, 0, sizeof(uint64_t) * numValues);
 
-    CUPTI_API_CALL(cuptiEventGroupAddEvent(eventGroup, eventId));
+    for (uint32_t group = 0; group < pReader->pEventGroupSet->numEventGroups; group++)
+    {
+        uint32_t numEvents = pReader->pNumEvents[group];
+        uint32_t numInstances = pReader->pNumInstances[group];
+        const uint32_t *pColumns = pReader->ppColumns[group];
+        size_t bytesRead = pReader->valueBufferSize;
+        size_t eventIdsRead = pReader->eventIdBufferSize;
+        size_t numEventIdsRead = 0;
 
-    CUPTI_API_CALL(cuptiEventGroupSetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(profileAll), &profileAll));
+        CUPTI_API_CALL(cuptiEventGroupReadAllEvents(pReader->pEventGroupSet->eventGroups[group], CUPTI_EVENT_READ_FLAG_NONE,
+                                                    &bytesRead, pReader->pValueBuffer, &eventIdsRead, pReader->pEventIdBuffer, &numEventIdsRead));
 
-    CUPTI_API_CALL(cuptiEventGroupEnable(eventGroup));
+        if (bytesRead != sizeof(uint64_t) * numEvents * numInstances)
+        {
+            printf("Error: Failed to read values for event group %u.\n", group);
+            return -1;
+        }
 
-    valueSize = sizeof(numInstances);
-    CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &valueSize, &numInstances));
+        // pColumns assumes the events cached at setup, in the same order.
+        if (numEventIdsRead != numEvents || eventIdsRead != sizeof(CUpti_EventID) * numEvents ||
+            memcmp(pReader->pEventIdBuffer, pReader->ppEventIds[group], sizeof(CUpti_EventID) * numEvents) != 0)
+        {
+            printf("Error: Event group %u read returned %llu event ids not matching the %u events cached at setup.\n",
+                   group, (unsigned long long)numEventIdsRead, numEvents);
+            return -1;
+        }
 
-    bytesRead = sizeof(uint64_t) * numInstances;
-    pEventValues = (uint64_t *)malloc(bytesRead);
-    MEMORY_ALLOCATION_CALL(pEventValues);
+        // Values are laid out instance major: pValueBuffer[instance * numEvents + event].
+        for (uint32_t k = 0; k < numInstances; k++)
+        {
+            const uint64_t *pInstanceValues = pReader->pValueBuffer + (size_t)k * numEvents;
+            for (uint32_t j = 0; j < numEvents; j++)
+            {
+                pValues[pColumns[j]] += pInstanceValues[j];
+            }
+        }
+    }
+
+    return 0;
+}
+
+// SampleConsumerFunc printing one row per tick.
+static void
+PrintSampleRow(
+    void *pConsumerData,
+    uint64_t tick,
+    uint64_t timestampNs,
+    const uint64_t *pValues,
+    size_t numValues)
+{
+    printf("tick %llu [ %llu ns ]", (unsigned long long)tick, (unsigned long long)timestampNs);
+    for (size_t i = 0; i < numValues; i++)
+    {
+        s_totals[i] += pValues[i];
+        printf(", %s: %llu", s_pEventNames[i], (unsigned long long)s_totals[i]);
+    }
+    printf("\n");
+}
+
+void *
+DoSampling(
+    void *arg)
+{
+    EventGroupReader reader;
+    memset(&reader, 0, sizeof(reader));
+
+    CUPTI_API_CALL(cuptiSetEventCollectionMode(context, CUPTI_EVENT_COLLECTION_MODE_CONTINUOUS));
+
+    SetupEventGroupReader(&reader);
+    InitPeriodicSampler(&s_sampler, SAMPLE_PERIOD_MS * 1000000ULL, ReadEventGroups, &reader, &s_sampleRing);
 
     // Release the semaphore as sampling thread is ready to read events.
 #ifdef _WIN32
@@ -129,35 +319,28 @@ DoSampling(
     }
 #endif
 
-    do
-    {
-        CUPTI_API_CALL(cuptiEventGroupReadEvent(eventGroup, CUPTI_EVENT_READ_FLAG_NONE, eventId, &bytesRead, pEventValues));
+    RunPeriodicSampler(&s_sampler);
 
-        if (bytesRead != (sizeof(uint64_t) * numInstances))
-        {
-            printf("Error: Failed to read value for \"%s\"\n", s_pEventName);
-            exit(EXIT_FAILURE);
-        }
+    TeardownEventGroupReader(&reader);
 
-        for (j = 0; j < numInstances; j++)
-        {
-            eventValue += pEventValues[j];
-        }
-        printf("%s: %llu\n", s_pEventName, (unsigned long long)eventValue);
+    return NULL;
+}
 
+// Drains the sample ring off the sampling thread, so output never delays a tick.
+void *
+DoConsume(
+    void *arg)
+{
+    while (!s_sampler.finished.load(std::memory_order_acquire))
+    {
 #ifdef _WIN32
-        Sleep(SAMPLE_PERIOD_MS);
+        Sleep(CONSUMER_PERIOD_MS);
 #else
-        usleep(SAMPLE_PERIOD_MS * 1000);
+        usleep(CONSUMER_PERIOD_MS * 1000);
 #endif
+        DrainSampleRing(&s_sampleRing, PrintSampleRow, NULL);
     }
-    while (!testComplete);
-
-    CUPTI_API_CALL(cuptiEventGroupDisable(eventGroup));
-
-    CUPTI_API_CALL(cuptiEventGroupDestroy(eventGroup));
-
-    free(pEventValues);
+    DrainSampleRing(&s_sampleRing, PrintSampleRow, NULL);
 
     return NULL;
 }
@@ -256,9 +439,11 @@ main(int argc, char *argv[])
 {
 #ifdef _WIN32
     HANDLE hThread;
+    HANDLE hConsumerThread;
 #else
     int status;
     pthread_t pThread;
+    pthread_t pConsumerThread;
 #endif
     int deviceNum;
     int deviceCount;
@@ -266,7 +451,7 @@ main(int argc, char *argv[])
     int major;
     int minor;
 
-    printf("Usage: %s [device_num] [event_name]\n", argv[0]);
+    printf("Usage: %s [device_num] [event_name[,event_name...]]\n", argv[0]);
 
     DRIVER_API_CALL(cuInit(0));
 
@@ -304,11 +489,20 @@ main(int argc, char *argv[])
 
     if (argc > 2)
     {
-        s_pEventName = argv[2];
+        for (char *pToken = strtok(argv[2], ","); pToken && s_numEventNames < MAX_EVENTS; pToken = strtok(NULL, ","))
+        {
+            s_pEventNames[s_numEventNames++] = pToken;
+        }
     }
-    else
+    if (s_numEventNames == 0)
     {
-        s_pEventName = EVENT_NAME;
+        s_pEventNames[s_numEventNames++] = EVENT_NAME;
+    }
+
+    if (InitSampleRing(&s_sampleRing, SAMPLE_RING_ROWS, s_numEventNames) != 0)
+    {
+        printf("Error: Failed to allocate the sample ring.\n");
+        exit(EXIT_FAILURE);
     }
 
     DRIVER_API_CALL(cuCtxCreate(&context, 0, device));
@@ -329,8 +523,6 @@ main(int argc, char *argv[])
     }
 #endif
 
-    testComplete = 0;
-
     printf("Creating sampling thread\n");
 #ifdef _WIN32
     hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) DoSampling, NULL, 0, NULL );
@@ -365,17 +557,44 @@ main(int argc, char *argv[])
     }
 #endif
 
+    printf("Creating consumer thread\n");
+#ifdef _WIN32
+    hConsumerThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) DoConsume, NULL, 0, NULL );
+    if (!hConsumerThread)
+    {
+        printf("Error: CreateThread failed.\n");
+        exit(EXIT_FAILURE);
+    }
+#else
+    status = pthread_create(&pConsumerThread, NULL, DoConsume, NULL);
+    if (status != 0)
+    {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+#endif
+
     // Run kernel while sampling.
     DoCompute(ITERATIONS);
 
     // "signal" the sampling thread to exit and wait for it.
-    testComplete = 1;
+    StopPeriodicSampler(&s_sampler);
 #ifdef _WIN32
     WaitForSingleObject(hThread, INFINITE);
+    WaitForSingleObject(hConsumerThread, INFINITE);
 #else
     pthread_join(pThread, NULL);
+    pthread_join(pConsumerThread, NULL);
 #endif
 
+    printf("Samples: %llu, missed deadlines: %llu, dropped rows: %llu, max wake-up lateness: %llu ns\n",
+           (unsigned long long)s_sampler.ticks,
+           (unsigned long long)s_sampler.missedTicks,
+           (unsigned long long)s_sampleRing.droppedRows.load(),
+           (unsigned long long)s_sampler.maxLatenessNs);
+
+    FreeSampleRing(&s_sampleRing);
+
     RUNTIME_API_CALL(cudaDeviceSynchronize());
 
     exit(EXIT_SUCCESS);
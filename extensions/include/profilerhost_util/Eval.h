@@ -15,6 +15,36 @@ namespace NV {
                 std::vector < std::pair<std::string, double> > rangeNameMetricValueMap;
             };
 
+            struct MetricValueMatrix
+            {
+                std::vector<std::string> metricNames;
+                std::vector<std::string> rangeNames;
+                // Row-major [range x metric] values, values[rangeIndex * metricNames.size() + metricIndex]
+                std::vector<double> values;
+
+                double Value(size_t rangeIndex, size_t metricIndex) const
+                {
+                    return values[rangeIndex * metricNames.size() + metricIndex];
+                }
+            };
+
+            /* Function to evaluate all metrics for all ranges in one pass
+             * Metric names are converted to eval requests and range names are resolved once,
+             * then ranges are split across threads, each evaluating all requests of a range in a single call.
+             * @param[in]  chipName                  Chip name for which to get metric values
+             * @param[in]  counterDataImage          Counter data image
+             * @param[in]  metricNames               List of metrics to read from counter data image
+             * @param[out] metricValueMatrix         Range x metric value matrix
+             * @param[in]  pCounterAvailabilityImage Pointer to counter availability image queried on target device
+             * @param[in]  numThreads                Number of evaluation threads, 0 selects based on hardware concurrency
+             */
+            bool GetMetricGpuValueMatrix(   std::string chipName,
+                                            const std::vector<uint8_t>& counterDataImage,
+                                            const std::vector<std::string>& metricNames,
+                                            MetricValueMatrix& metricValueMatrix,
+                                            const uint8_t* pCounterAvailabilityImage = NULL,
+                                            size_t numThreads = 0);
+
             /* Function to get aggregate metric values
              * @param[in]  chipName                 Chip name for which to get metric values
              * @param[in]  counterDataImage         Counter data image
@@ -6,6 +6,9 @@
 #include <nvperf_target.h>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <thread>
 #include <ScopeExit.h>
 
 namespace NV {
@@ -16,100 +19,255 @@ namespace NV {
                 return metricName.substr(0, metricName.find("__", 0));
             }
 
-            bool GetMetricGpuValue( std::string chipName,
-                                    const std::vector<uint8_t>& counterDataImage,
-                                    const std::vector<std::string>& metricNames,
-                                    std::vector<MetricNameValue>& metricNameValueMap,
-                                    const uint8_t* pCounterAvailabilityImage)
-            {
-                if (!counterDataImage.size())
-                {
-                    std::cout << "Counter Data Image is empty!\n";
-                    return false;
-                }
+            static const size_t MIN_RANGES_PER_THREAD = 16;
 
+            // Creates a metrics evaluator backed by the caller owned scratch buffer and binds it to the counter data image.
+            static NVPW_MetricsEvaluator* CreateMetricsEvaluator(   const std::string& chipName,
+                                                                    const std::vector<uint8_t>& counterDataImage,
+                                                                    const uint8_t* pCounterAvailabilityImage,
+                                                                    std::vector<uint8_t>& scratchBuffer)
+            {
                 NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params calculateScratchBufferSizeParam = {NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params_STRUCT_SIZE};
                 calculateScratchBufferSizeParam.pChipName = chipName.c_str();
                 calculateScratchBufferSizeParam.pCounterAvailabilityImage = pCounterAvailabilityImage;
-                RETURN_IF_NVPW_ERROR(false, NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize(&calculateScratchBufferSizeParam));
+                RETURN_IF_NVPW_ERROR(NULL, NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize(&calculateScratchBufferSizeParam));
 
-                std::vector<uint8_t> scratchBuffer(calculateScratchBufferSizeParam.scratchBufferSize);
+                scratchBuffer.resize(calculateScratchBufferSizeParam.scratchBufferSize);
                 NVPW_CUDA_MetricsEvaluator_Initialize_Params metricEvaluatorInitializeParams = {NVPW_CUDA_MetricsEvaluator_Initialize_Params_STRUCT_SIZE};
                 metricEvaluatorInitializeParams.scratchBufferSize = scratchBuffer.size();
                 metricEvaluatorInitializeParams.pScratchBuffer = scratchBuffer.data();
                 metricEvaluatorInitializeParams.pChipName = chipName.c_str();
                 metricEvaluatorInitializeParams.pCounterAvailabilityImage = pCounterAvailabilityImage;
-                RETURN_IF_NVPW_ERROR(false, NVPW_CUDA_MetricsEvaluator_Initialize(&metricEvaluatorInitializeParams));
+                RETURN_IF_NVPW_ERROR(NULL, NVPW_CUDA_MetricsEvaluator_Initialize(&metricEvaluatorInitializeParams));
                 NVPW_MetricsEvaluator* metricEvaluator = metricEvaluatorInitializeParams.pMetricsEvaluator;
 
-                NVPW_CounterData_GetNumRanges_Params getNumRangesParams = { NVPW_CounterData_GetNumRanges_Params_STRUCT_SIZE };
-                getNumRangesParams.pCounterDataImage = counterDataImage.data();
-                RETURN_IF_NVPW_ERROR(false, NVPW_CounterData_GetNumRanges(&getNumRangesParams));
+                // Device attributes only depend on the counter data image, so they are set once per evaluator.
+                NVPW_MetricsEvaluator_SetDeviceAttributes_Params setDeviceAttribParams = { NVPW_MetricsEvaluator_SetDeviceAttributes_Params_STRUCT_SIZE };
+                setDeviceAttribParams.pMetricsEvaluator = metricEvaluator;
+                setDeviceAttribParams.pCounterDataImage = counterDataImage.data();
+                setDeviceAttribParams.counterDataImageSize = counterDataImage.size();
+                NVPA_Status setDeviceAttribStatus = NVPW_MetricsEvaluator_SetDeviceAttributes(&setDeviceAttribParams);
+                if (setDeviceAttribStatus != NVPA_STATUS_SUCCESS)
+                {
+                    fprintf(stderr, "FAILED: NVPW_MetricsEvaluator_SetDeviceAttributes with error %s\n", NV::Metric::Utils::GetNVPWResultString(setDeviceAttribStatus));
+                    NVPW_MetricsEvaluator_Destroy_Params metricEvaluatorDestroyParams = { NVPW_MetricsEvaluator_Destroy_Params_STRUCT_SIZE };
+                    metricEvaluatorDestroyParams.pMetricsEvaluator = metricEvaluator;
+                    NVPW_MetricsEvaluator_Destroy(&metricEvaluatorDestroyParams);
+                    return NULL;
+                }
+
+                return metricEvaluator;
+            }
+
+            static bool DestroyMetricsEvaluator(NVPW_MetricsEvaluator* metricEvaluator)
+            {
+                NVPW_MetricsEvaluator_Destroy_Params metricEvaluatorDestroyParams = { NVPW_MetricsEvaluator_Destroy_Params_STRUCT_SIZE };
+                metricEvaluatorDestroyParams.pMetricsEvaluator = metricEvaluator;
+                RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_Destroy(&metricEvaluatorDestroyParams));
+                return true;
+            }
+
+            static bool GetRangeName(   const std::vector<uint8_t>& counterDataImage,
+                                        size_t rangeIndex,
+                                        std::vector<const char*>& descriptionPtrs,
+                                        std::string& rangeName)
+            {
+                NVPW_Profiler_CounterData_GetRangeDescriptions_Params getRangeDescParams = { NVPW_Profiler_CounterData_GetRangeDescriptions_Params_STRUCT_SIZE };
+                getRangeDescParams.pCounterDataImage = counterDataImage.data();
+                getRangeDescParams.rangeIndex = rangeIndex;
+                RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
+                descriptionPtrs.resize(getRangeDescParams.numDescriptions);
+                getRangeDescParams.ppDescriptions = descriptionPtrs.data();
+                RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
+
+                rangeName.clear();
+                for (size_t descriptionIndex = 0; descriptionIndex < getRangeDescParams.numDescriptions; ++descriptionIndex)
+                {
+                    if (descriptionIndex)
+                    {
+                        rangeName += "/";
+                    }
+                    rangeName += descriptionPtrs[descriptionIndex];
+                }
+                return true;
+            }
+
+            // Evaluates all requests for the ranges [rangeBegin, rangeEnd) and writes one matrix row per range.
+            static bool EvaluateRanges( NVPW_MetricsEvaluator* metricEvaluator,
+                                        const std::vector<uint8_t>& counterDataImage,
+                                        const std::vector<NVPW_MetricEvalRequest>& metricEvalRequests,
+                                        size_t rangeBegin,
+                                        size_t rangeEnd,
+                                        double* pMetricValues)
+            {
+                NVPW_MetricsEvaluator_EvaluateToGpuValues_Params evaluateToGpuValuesParams = { NVPW_MetricsEvaluator_EvaluateToGpuValues_Params_STRUCT_SIZE };
+                evaluateToGpuValuesParams.pMetricsEvaluator = metricEvaluator;
+                evaluateToGpuValuesParams.pMetricEvalRequests = metricEvalRequests.data();
+                evaluateToGpuValuesParams.numMetricEvalRequests = metricEvalRequests.size();
+                evaluateToGpuValuesParams.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
+                evaluateToGpuValuesParams.metricEvalRequestStrideSize = sizeof(NVPW_MetricEvalRequest);
+                evaluateToGpuValuesParams.pCounterDataImage = counterDataImage.data();
+                evaluateToGpuValuesParams.counterDataImageSize = counterDataImage.size();
+                evaluateToGpuValuesParams.isolated = true;
+
+                for (size_t rangeIndex = rangeBegin; rangeIndex < rangeEnd; ++rangeIndex)
+                {
+                    evaluateToGpuValuesParams.rangeIndex = rangeIndex;
+                    evaluateToGpuValuesParams.pMetricValues = pMetricValues + (rangeIndex - rangeBegin) * metricEvalRequests.size();
+                    RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_EvaluateToGpuValues(&evaluateToGpuValuesParams));
+                }
+                return true;
+            }
+
+            // Worker entry point, every thread owns its evaluator and scratch buffer.
+            static void EvaluateRangesWorker(   const std::string& chipName,
+                                                const std::vector<uint8_t>& counterDataImage,
+                                                const uint8_t* pCounterAvailabilityImage,
+                                                const std::vector<NVPW_MetricEvalRequest>& metricEvalRequests,
+                                                size_t rangeBegin,
+                                                size_t rangeEnd,
+                                                double* pMetricValues,
+                                                uint8_t* pResult)
+            {
+                *pResult = 0;
+                std::vector<uint8_t> scratchBuffer;
+                NVPW_MetricsEvaluator* metricEvaluator = CreateMetricsEvaluator(chipName, counterDataImage, pCounterAvailabilityImage, scratchBuffer);
+                if (!metricEvaluator)
+                {
+                    return;
+                }
+
+                bool evaluated = EvaluateRanges(metricEvaluator, counterDataImage, metricEvalRequests, rangeBegin, rangeEnd, pMetricValues);
+                if (DestroyMetricsEvaluator(metricEvaluator) && evaluated)
+                {
+                    *pResult = 1;
+                }
+            }
+
+            bool GetMetricGpuValueMatrix(   std::string chipName,
+                                            const std::vector<uint8_t>& counterDataImage,
+                                            const std::vector<std::string>& metricNames,
+                                            MetricValueMatrix& metricValueMatrix,
+                                            const uint8_t* pCounterAvailabilityImage,
+                                            size_t numThreads)
+            {
+                if (!counterDataImage.size())
+                {
+                    std::cout << "Counter Data Image is empty!\n";
+                    return false;
+                }
 
+                std::vector<uint8_t> scratchBuffer;
+                NVPW_MetricsEvaluator* metricEvaluator = CreateMetricsEvaluator(chipName, counterDataImage, pCounterAvailabilityImage, scratchBuffer);
+                if (!metricEvaluator)
+                {
+                    return false;
+                }
+                SCOPE_EXIT(DestroyMetricsEvaluator(metricEvaluator));
+
+                // Eval requests only encode indices into the chip's metric tables, so one conversion serves every evaluator.
+                std::vector<NVPW_MetricEvalRequest> metricEvalRequests(metricNames.size());
+                std::string reqName;
                 bool isolated = true;
                 bool keepInstances = true;
                 for (size_t metricIndex = 0; metricIndex < metricNames.size(); ++metricIndex)
                 {
-                    std::string reqName;
                     NV::Metric::Parser::ParseMetricNameString(metricNames[metricIndex], &reqName, &isolated, &keepInstances);
-                    NVPW_MetricEvalRequest metricEvalRequest;
                     NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params convertMetricToEvalRequest = {NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params_STRUCT_SIZE};
                     convertMetricToEvalRequest.pMetricsEvaluator = metricEvaluator;
                     convertMetricToEvalRequest.pMetricName = reqName.c_str();
-                    convertMetricToEvalRequest.pMetricEvalRequest = &metricEvalRequest;
+                    convertMetricToEvalRequest.pMetricEvalRequest = &metricEvalRequests[metricIndex];
                     convertMetricToEvalRequest.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
                     RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest(&convertMetricToEvalRequest));
-                    
+                }
+
+                NVPW_CounterData_GetNumRanges_Params getNumRangesParams = { NVPW_CounterData_GetNumRanges_Params_STRUCT_SIZE };
+                getNumRangesParams.pCounterDataImage = counterDataImage.data();
+                RETURN_IF_NVPW_ERROR(false, NVPW_CounterData_GetNumRanges(&getNumRangesParams));
+                const size_t numRanges = getNumRangesParams.numRanges;
+
+                metricValueMatrix.metricNames = metricNames;
+                metricValueMatrix.rangeNames.resize(numRanges);
+                metricValueMatrix.values.assign(numRanges * metricNames.size(), 0.0);
+
+                std::vector<const char*> descriptionPtrs;
+                for (size_t rangeIndex = 0; rangeIndex < numRanges; ++rangeIndex)
+                {
+                    if (!GetRangeName(counterDataImage, rangeIndex, descriptionPtrs, metricValueMatrix.rangeNames[rangeIndex]))
+                    {
+                        return false;
+                    }
+                }
+
+                if (!numRanges || metricEvalRequests.empty())
+                {
+                    return true;
+                }
+
+                if (numThreads == 0)
+                {
+                    numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+                }
+                numThreads = std::min(numThreads, (numRanges + MIN_RANGES_PER_THREAD - 1) / MIN_RANGES_PER_THREAD);
+                numThreads = std::max<size_t>(numThreads, 1);
+
+                // The calling thread evaluates the first chunk with the evaluator used for request conversion.
+                const size_t rangesPerThread = (numRanges + numThreads - 1) / numThreads;
+                std::vector<uint8_t> results(numThreads, 0);
+                std::vector<std::thread> workers;
+                for (size_t threadIndex = 1; threadIndex < numThreads; ++threadIndex)
+                {
+                    size_t rangeBegin = threadIndex * rangesPerThread;
+                    size_t rangeEnd = std::min(rangeBegin + rangesPerThread, numRanges);
+                    if (rangeBegin >= rangeEnd)
+                    {
+                        results[threadIndex] = 1;
+                        continue;
+                    }
+                    workers.push_back(std::thread(EvaluateRangesWorker,
+                                                  std::cref(chipName),
+                                                  std::cref(counterDataImage),
+                                                  pCounterAvailabilityImage,
+                                                  std::cref(metricEvalRequests),
+                                                  rangeBegin,
+                                                  rangeEnd,
+                                                  &metricValueMatrix.values[rangeBegin * metricNames.size()],
+                                                  &results[threadIndex]));
+                }
+
+                results[0] = EvaluateRanges(metricEvaluator, counterDataImage, metricEvalRequests, 0, std::min(rangesPerThread, numRanges), metricValueMatrix.values.data()) ? 1 : 0;
+
+                for (std::thread& worker : workers)
+                {
+                    worker.join();
+                }
+
+                return std::find(results.begin(), results.end(), 0) == results.end();
+            }
+
+            bool GetMetricGpuValue( std::string chipName,
+                                    const std::vector<uint8_t>& counterDataImage,
+                                    const std::vector<std::string>& metricNames,
+                                    std::vector<MetricNameValue>& metricNameValueMap,
+                                    const uint8_t* pCounterAvailabilityImage)
+            {
+                MetricValueMatrix metricValueMatrix;
+                if (!GetMetricGpuValueMatrix(chipName, counterDataImage, metricNames, metricValueMatrix, pCounterAvailabilityImage))
+                {
+                    return false;
+                }
+
+                for (size_t metricIndex = 0; metricIndex < metricNames.size(); ++metricIndex)
+                {
                     MetricNameValue metricNameValue;
-                    metricNameValue.numRanges = getNumRangesParams.numRanges;
+                    metricNameValue.numRanges = metricValueMatrix.rangeNames.size();
                     metricNameValue.metricName = metricNames[metricIndex];
-                    for (size_t rangeIndex = 0; rangeIndex < getNumRangesParams.numRanges; ++rangeIndex)
+                    for (size_t rangeIndex = 0; rangeIndex < metricValueMatrix.rangeNames.size(); ++rangeIndex)
                     {
-                        NVPW_Profiler_CounterData_GetRangeDescriptions_Params getRangeDescParams = { NVPW_Profiler_CounterData_GetRangeDescriptions_Params_STRUCT_SIZE };
-                        getRangeDescParams.pCounterDataImage = counterDataImage.data();
-                        getRangeDescParams.rangeIndex = rangeIndex;
-                        RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
-                        std::vector<const char*> descriptionPtrs(getRangeDescParams.numDescriptions);
-                        getRangeDescParams.ppDescriptions = descriptionPtrs.data();
-                        RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
-
-                        std::string rangeName;
-                        for (size_t descriptionIndex = 0; descriptionIndex < getRangeDescParams.numDescriptions; ++descriptionIndex)
-                        {
-                            if (descriptionIndex)
-                            {
-                                rangeName += "/";
-                            }
-                            rangeName += descriptionPtrs[descriptionIndex];
-                        }
-
-                        NVPW_MetricsEvaluator_SetDeviceAttributes_Params setDeviceAttribParams = { NVPW_MetricsEvaluator_SetDeviceAttributes_Params_STRUCT_SIZE };
-                        setDeviceAttribParams.pMetricsEvaluator = metricEvaluator;
-                        setDeviceAttribParams.pCounterDataImage = counterDataImage.data();
-                        setDeviceAttribParams.counterDataImageSize = counterDataImage.size();
-                        RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_SetDeviceAttributes(&setDeviceAttribParams));
-
-                        double metricValue = 0.0;
-                        NVPW_MetricsEvaluator_EvaluateToGpuValues_Params evaluateToGpuValuesParams = { NVPW_MetricsEvaluator_EvaluateToGpuValues_Params_STRUCT_SIZE };
-                        evaluateToGpuValuesParams.pMetricsEvaluator = metricEvaluator;
-                        evaluateToGpuValuesParams.pMetricEvalRequests = &metricEvalRequest;
-                        evaluateToGpuValuesParams.numMetricEvalRequests = 1;
-                        evaluateToGpuValuesParams.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
-                        evaluateToGpuValuesParams.metricEvalRequestStrideSize = sizeof(NVPW_MetricEvalRequest);
-                        evaluateToGpuValuesParams.pCounterDataImage = counterDataImage.data();
-                        evaluateToGpuValuesParams.counterDataImageSize = counterDataImage.size();
-                        evaluateToGpuValuesParams.rangeIndex = rangeIndex;
-                        evaluateToGpuValuesParams.isolated = true;
-                        evaluateToGpuValuesParams.pMetricValues = &metricValue;
-                        RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_EvaluateToGpuValues(&evaluateToGpuValuesParams));
-                        metricNameValue.rangeNameMetricValueMap.push_back(std::make_pair(rangeName, metricValue));
+                        metricNameValue.rangeNameMetricValueMap.push_back(std::make_pair(metricValueMatrix.rangeNames[rangeIndex], metricValueMatrix.Value(rangeIndex, metricIndex)));
                     }
                     metricNameValueMap.push_back(metricNameValue);
                 }
-                
-                NVPW_MetricsEvaluator_Destroy_Params metricEvaluatorDestroyParams = { NVPW_MetricsEvaluator_Destroy_Params_STRUCT_SIZE };
-                metricEvaluatorDestroyParams.pMetricsEvaluator = metricEvaluator;
-                RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_Destroy(&metricEvaluatorDestroyParams));
                 return true;
             }
 
@@ -118,99 +276,25 @@ namespace NV {
                                     const std::vector<std::string>& metricNames,
                                     const uint8_t* pCounterAvailabilityImage)
             {
-                if (!counterDataImage.size())
+                MetricValueMatrix metricValueMatrix;
+                if (!GetMetricGpuValueMatrix(chipName, counterDataImage, metricNames, metricValueMatrix, pCounterAvailabilityImage))
                 {
-                    std::cout << "Counter Data Image is empty!\n";
                     return false;
                 }
 
-                NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params calculateScratchBufferSizeParam = {NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize_Params_STRUCT_SIZE};
-                calculateScratchBufferSizeParam.pChipName = chipName.c_str();
-                calculateScratchBufferSizeParam.pCounterAvailabilityImage = pCounterAvailabilityImage;
-                RETURN_IF_NVPW_ERROR(false, NVPW_CUDA_MetricsEvaluator_CalculateScratchBufferSize(&calculateScratchBufferSizeParam));
-
-                std::vector<uint8_t> scratchBuffer(calculateScratchBufferSizeParam.scratchBufferSize);
-                NVPW_CUDA_MetricsEvaluator_Initialize_Params metricEvaluatorInitializeParams = {NVPW_CUDA_MetricsEvaluator_Initialize_Params_STRUCT_SIZE};
-                metricEvaluatorInitializeParams.scratchBufferSize = scratchBuffer.size();
-                metricEvaluatorInitializeParams.pScratchBuffer = scratchBuffer.data();
-                metricEvaluatorInitializeParams.pChipName = chipName.c_str();
-                metricEvaluatorInitializeParams.pCounterAvailabilityImage = pCounterAvailabilityImage;
-                metricEvaluatorInitializeParams.pCounterDataImage = counterDataImage.data();
-                metricEvaluatorInitializeParams.counterDataImageSize = counterDataImage.size();
-                RETURN_IF_NVPW_ERROR(false, NVPW_CUDA_MetricsEvaluator_Initialize(&metricEvaluatorInitializeParams));
-                NVPW_MetricsEvaluator* metricEvaluator = metricEvaluatorInitializeParams.pMetricsEvaluator;
-
-                NVPW_CounterData_GetNumRanges_Params getNumRangesParams = { NVPW_CounterData_GetNumRanges_Params_STRUCT_SIZE };
-                getNumRangesParams.pCounterDataImage = counterDataImage.data();
-                RETURN_IF_NVPW_ERROR(false, NVPW_CounterData_GetNumRanges(&getNumRangesParams));
-
                 std::cout << "\n" << std::setw(40) << std::left << "Range Name"
                           << std::setw(100) << std::left        << "Metric Name"
                           << "Metric Value" << std::endl;
                 std::cout << std::setfill('-') << std::setw(160) << "" << std::setfill(' ') << std::endl;
 
-                std::string reqName;
-                bool isolated = true;
-                bool keepInstances = true;
-                for (std::string metricName : metricNames)
+                for (size_t metricIndex = 0; metricIndex < metricNames.size(); ++metricIndex)
                 {
-                    NV::Metric::Parser::ParseMetricNameString(metricName, &reqName, &isolated, &keepInstances);
-                    NVPW_MetricEvalRequest metricEvalRequest;
-                    NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params convertMetricToEvalRequest = {NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest_Params_STRUCT_SIZE};
-                    convertMetricToEvalRequest.pMetricsEvaluator = metricEvaluator;
-                    convertMetricToEvalRequest.pMetricName = reqName.c_str();
-                    convertMetricToEvalRequest.pMetricEvalRequest = &metricEvalRequest;
-                    convertMetricToEvalRequest.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
-                    RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_ConvertMetricNameToMetricEvalRequest(&convertMetricToEvalRequest));
-
-                    for (size_t rangeIndex = 0; rangeIndex < getNumRangesParams.numRanges; ++rangeIndex)
+                    for (size_t rangeIndex = 0; rangeIndex < metricValueMatrix.rangeNames.size(); ++rangeIndex)
                     {
-                        NVPW_Profiler_CounterData_GetRangeDescriptions_Params getRangeDescParams = { NVPW_Profiler_CounterData_GetRangeDescriptions_Params_STRUCT_SIZE };
-                        getRangeDescParams.pCounterDataImage = counterDataImage.data();
-                        getRangeDescParams.rangeIndex = rangeIndex;
-                        RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
-                        std::vector<const char*> descriptionPtrs(getRangeDescParams.numDescriptions);
-                        getRangeDescParams.ppDescriptions = descriptionPtrs.data();
-                        RETURN_IF_NVPW_ERROR(false, NVPW_Profiler_CounterData_GetRangeDescriptions(&getRangeDescParams));
-
-                        std::string rangeName;
-                        for (size_t descriptionIndex = 0; descriptionIndex < getRangeDescParams.numDescriptions; ++descriptionIndex)
-                        {
-                            if (descriptionIndex)
-                            {
-                                rangeName += "/";
-                            }
-                            rangeName += descriptionPtrs[descriptionIndex];
-                        }
-
-                        NVPW_MetricsEvaluator_SetDeviceAttributes_Params setDeviceAttribParams = { NVPW_MetricsEvaluator_SetDeviceAttributes_Params_STRUCT_SIZE };
-                        setDeviceAttribParams.pMetricsEvaluator = metricEvaluator;
-                        setDeviceAttribParams.pCounterDataImage = counterDataImage.data();
-                        setDeviceAttribParams.counterDataImageSize = counterDataImage.size();
-                        RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_SetDeviceAttributes(&setDeviceAttribParams));
-
-                        double metricValue;
-                        NVPW_MetricsEvaluator_EvaluateToGpuValues_Params evaluateToGpuValuesParams = { NVPW_MetricsEvaluator_EvaluateToGpuValues_Params_STRUCT_SIZE };
-                        evaluateToGpuValuesParams.pMetricsEvaluator = metricEvaluator;
-                        evaluateToGpuValuesParams.pMetricEvalRequests = &metricEvalRequest;
-                        evaluateToGpuValuesParams.numMetricEvalRequests = 1;
-                        evaluateToGpuValuesParams.metricEvalRequestStructSize = NVPW_MetricEvalRequest_STRUCT_SIZE;
-                        evaluateToGpuValuesParams.metricEvalRequestStrideSize = sizeof(NVPW_MetricEvalRequest);
-                        evaluateToGpuValuesParams.pCounterDataImage = counterDataImage.data();
-                        evaluateToGpuValuesParams.counterDataImageSize = counterDataImage.size();
-                        evaluateToGpuValuesParams.rangeIndex = rangeIndex;
-                        evaluateToGpuValuesParams.isolated = true;
-                        evaluateToGpuValuesParams.pMetricValues = &metricValue;
-                        RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_EvaluateToGpuValues(&evaluateToGpuValuesParams));
-                        
-                        std::cout << std::setw(40) << std::left << rangeName << std::setw(100)
-                                  << std::left << metricName << metricValue << std::endl;
+                        std::cout << std::setw(40) << std::left << metricValueMatrix.rangeNames[rangeIndex] << std::setw(100)
+                                  << std::left << metricNames[metricIndex] << metricValueMatrix.Value(rangeIndex, metricIndex) << std::endl;
                     }
                 }
-                
-                NVPW_MetricsEvaluator_Destroy_Params metricEvaluatorDestroyParams = { NVPW_MetricsEvaluator_Destroy_Params_STRUCT_SIZE };
-                metricEvaluatorDestroyParams.pMetricsEvaluator = metricEvaluator;
-                RETURN_IF_NVPW_ERROR(false, NVPW_MetricsEvaluator_Destroy(&metricEvaluatorDestroyParams));
                 return true;
             }
         }
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Shared code of the host-side checks.
+ *
+ * A check is a program exercising one helper of ../common with synthetic
+ * input on the host, without a GPU. CHECK() reports every failed condition
+ * with its location and the check exits with the number of failures, so
+ * "make run" stops at the first failing program.
+ */
+
+#ifndef HOST_CHECK_UTIL_H_
+#define HOST_CHECK_UTIL_H_
+
+#pragma once
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+
+// Macros
+#define CHECK(condition)                                                                    \
+do                                                                                          \
+{                                                                                           \
+    s_HostCheckConditions++;                                                                \
+    if (!(condition))                                                                       \
+    {                                                                                       \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);       \
+        s_HostCheckFailures++;                                                              \
+    }                                                                                       \
+} while (0)
+
+// Global variables
+static int s_HostCheckConditions = 0;
+static int s_HostCheckFailures = 0;
+
+// Helper Functions
+// Print the summary and return the exit code of the check.
+static int
+FinishHostCheck(
+    const char *pName)
+{
+    printf("%s: %d conditions checked, %d failed\n", pName, s_HostCheckConditions, s_HostCheckFailures);
+
+    return s_HostCheckFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#endif // HOST_CHECK_UTIL_H_
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Host check of helper_cupti_nvlink_series.h with synthetic NVLINK records
+ * and counter samples: the mapping of the ports to the links, the bytes
+ * spread over the bins an interval covers, the counter resets and the
+ * merging of the bins when a sample falls past the last one.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "helper_cupti_nvlink_series.h"
+
+#include "host_check_util.h"
+
+// Macros
+#define BIN_NS 64
+#define MAX_BINS 4
+#define START_NS 1000
+
+// Helper Functions
+static void
+SetUuid(
+    CUuuid *pUuid,
+    char value)
+{
+    memset(pUuid, value, sizeof(CUuuid));
+}
+
+// GPU 0 and GPU 1 known by their UUID, physicalLinks links from ports pPorts0 of GPU 0 to pPorts1 of GPU 1.
+static void
+AddTwoGpuTopology(
+    NvLinkSeries *pSeries,
+    uint32_t physicalLinks,
+    const uint32_t *pPorts0,
+    const uint32_t *pPorts1)
+{
+    CUpti_ActivityNvLink4 record;
+    memset(&record, 0, sizeof(record));
+
+    record.kind = CUPTI_ACTIVITY_KIND_NVLINK;
+    record.typeDev0 = CUPTI_DEV_TYPE_GPU;
+    record.typeDev1 = CUPTI_DEV_TYPE_GPU;
+    SetUuid(&record.idDev0.uuidDev, 0xA);
+    SetUuid(&record.idDev1.uuidDev, 0xB);
+    record.physicalNvLinkCount = physicalLinks;
+    for (uint32_t i = 0; i < physicalLinks; i++)
+    {
+        record.portDev0[i] = pPorts0[i];
+        record.portDev1[i] = pPorts1[i];
+    }
+    record.bandwidth = 25000000;                                     // 25 GB/s in KB/s.
+
+    NvLinkSeriesAddRecord(pSeries, (CUpti_Activity *)&record);
+}
+
+static void
+SetTwoGpuUuids(
+    NvLinkSeries *pSeries)
+{
+    CUuuid uuid;
+
+    SetUuid(&uuid, 0xA);
+    NvLinkSeriesSetDeviceUuid(pSeries, 0, &uuid);
+    SetUuid(&uuid, 0xB);
+    NvLinkSeriesSetDeviceUuid(pSeries, 1, &uuid);
+}
+
+static uint32_t
+GetPortLink(
+    const NvLinkSeries *pSeries,
+    int32_t device,
+    int32_t port)
+{
+    std::map<uint64_t, uint32_t>::const_iterator it = pSeries->ports.find(GetNvLinkSeriesPortKey(device, port));
+
+    return it == pSeries->ports.end() ? (uint32_t)-1 : it->second;
+}
+
+static uint64_t
+SumBins(
+    const NvLinkSeries *pSeries,
+    const std::vector<uint64_t> &bytes,
+    uint32_t link)
+{
+    uint64_t sum = 0;
+
+    for (uint32_t bin = 0; bin < pSeries->maxBins; bin++)
+    {
+        sum += bytes[(size_t)link * pSeries->maxBins + bin];
+    }
+
+    return sum;
+}
+
+static void
+CheckPortMapping(void)
+{
+    const uint32_t Ports0[] = { 0, 1 };
+    const uint32_t Ports1[] = { 2, 3 };
+    NvLinkSeries series;
+
+    InitNvLinkSeries(&series, 8, MAX_BINS, BIN_NS);
+    SetTwoGpuUuids(&series);
+    AddTwoGpuTopology(&series, 2, Ports0, Ports1);
+
+    // One link per physical link, both ends of a link map to it.
+    CHECK(series.links.size() == 2);
+    CHECK(series.links[0].endpoints[0].id == 0 && series.links[0].endpoints[0].port == 0);
+    CHECK(series.links[0].endpoints[1].id == 1 && series.links[0].endpoints[1].port == 2);
+    CHECK(series.links[1].endpoints[0].id == 0 && series.links[1].endpoints[0].port == 1);
+    CHECK(series.links[1].endpoints[1].id == 1 && series.links[1].endpoints[1].port == 3);
+    CHECK(series.links[0].peakBytesPerSec == 25000000000ULL);
+    CHECK(GetPortLink(&series, 0, 0) == 0 && GetPortLink(&series, 1, 2) == 0);
+    CHECK(GetPortLink(&series, 0, 1) == 1 && GetPortLink(&series, 1, 3) == 1);
+
+    // The same record again, e.g. from another context, adds nothing.
+    AddTwoGpuTopology(&series, 2, Ports0, Ports1);
+    CHECK(series.links.size() == 2);
+    CHECK(series.numTopologyRecords == 2);
+
+    // Counters of the second endpoint: its TX is the RX of the link.
+    NvLinkSeriesAddSample(&series, 1, 3, START_NS, 0, 0);
+    NvLinkSeriesAddSample(&series, 1, 3, START_NS + BIN_NS, 10, 30);
+    CHECK(series.links[1].sampledEndpoint == 1);
+    CHECK(series.links[1].totalTxBytes == 30 && series.links[1].totalRxBytes == 10);
+
+    // The first endpoint of the same link reads the same traffic, it is dropped.
+    NvLinkSeriesAddSample(&series, 0, 1, START_NS + BIN_NS, 30, 10);
+    CHECK(series.numMirrored == 1);
+    CHECK(series.links[1].totalTxBytes == 30);
+
+    FreeNvLinkSeries(&series);
+
+    // A port sampled before the topology is known gets a link with an unknown peer, completed by the record.
+    const uint32_t Port0[] = { 5 };
+    const uint32_t Port1[] = { 7 };
+
+    InitNvLinkSeries(&series, 8, MAX_BINS, BIN_NS);
+    SetTwoGpuUuids(&series);
+    NvLinkSeriesAddSample(&series, 0, 5, START_NS, 0, 0);
+    CHECK(series.links.size() == 1 && series.links[0].endpoints[1].type == CUPTI_DEV_TYPE_INVALID);
+
+    AddTwoGpuTopology(&series, 1, Port0, Port1);
+    CHECK(series.links.size() == 1);
+    CHECK(series.links[0].endpoints[0].id == 0 && series.links[0].endpoints[0].port == 5);
+    CHECK(series.links[0].endpoints[1].id == 1 && series.links[0].endpoints[1].port == 7);
+    CHECK(GetPortLink(&series, 1, 7) == 0);
+
+    FreeNvLinkSeries(&series);
+}
+
+// Intervals and bytes are powers of two so that every share of a bin is exact.
+static void
+CheckBinsResetAndMerge(void)
+{
+    NvLinkSeries series;
+
+    InitNvLinkSeries(&series, 8, MAX_BINS, BIN_NS);
+
+    // Base of the counters, then [0, 32) in bin 0.
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS, 0, 0);
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS + 32, 32, 64);
+    CHECK(series.numBins == 1);
+    CHECK(series.txBytes[0] == 32 && series.rxBytes[0] == 64);
+
+    // [32, 160) covers a quarter of bin 0, bin 1 and a quarter of bin 2.
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS + 160, 160, 320);
+    CHECK(series.numBins == 3);
+    CHECK(series.txBytes[0] == 64 && series.txBytes[1] == 64 && series.txBytes[2] == 32);
+    CHECK(series.rxBytes[0] == 128 && series.rxBytes[1] == 128 && series.rxBytes[2] == 64);
+
+    // The TX counter went back: it was reset and counts 16 bytes from 0, over [160, 224).
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS + 224, 16, 384);
+    CHECK(series.numResets == 1);
+    CHECK(series.numBins == 4);
+    CHECK(series.txBytes[2] == 40 && series.txBytes[3] == 8);
+    CHECK(series.rxBytes[2] == 96 && series.rxBytes[3] == 32);
+    CHECK(series.links[0].totalTxBytes == 176 && series.links[0].totalRxBytes == 384);
+
+    // A sample at 480 is past the 4 bins of 64 ns: the bins are merged into bins of 128 ns,
+    // then [224, 480) spreads 256 bytes as 32, 128 and 96.
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS + 480, 272, 384);
+    CHECK(series.binNs == 2 * BIN_NS);
+    CHECK(series.numBins == 4);
+    CHECK(series.txBytes[0] == 128 && series.txBytes[1] == 80 && series.txBytes[2] == 128 && series.txBytes[3] == 96);
+    CHECK(series.rxBytes[0] == 256 && series.rxBytes[1] == 128 && series.rxBytes[2] == 0 && series.rxBytes[3] == 0);
+
+    // No byte is lost by the spreading, the reset or the merge.
+    CHECK(series.links[0].totalTxBytes == 432 && SumBins(&series, series.txBytes, 0) == 432);
+    CHECK(SumBins(&series, series.rxBytes, 0) == series.links[0].totalRxBytes);
+
+    // A sample not later than the previous one is dropped.
+    NvLinkSeriesAddSample(&series, 0, 0, START_NS + 480, 300, 400);
+    CHECK(series.numOutOfOrder == 1);
+    CHECK(series.links[0].totalTxBytes == 432);
+
+    FreeNvLinkSeries(&series);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CheckPortMapping();
+    CheckBinsResetAndMerge();
+
+    return FinishHostCheck("nvlink_series_check");
+}
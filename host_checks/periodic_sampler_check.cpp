@@ -0,0 +1,261 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Host check of helper_periodic_sampler.h with a mock reader: the tick
+ * numbering, the missed tick accounting when a read overruns the period, the
+ * rows dropped when the ring is full and the order rows are drained in,
+ * including across the wrap around of the ring.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "helper_periodic_sampler.h"
+
+#include "host_check_util.h"
+
+// Macros
+#define NUM_VALUES 2
+
+// Data structures
+// Mock reader: row n holds n and 2n, reads stop the sampler after stopAfter reads
+// and read number overrunRead sleeps overrunNs.
+typedef struct MockReader_st
+{
+    PeriodicSampler *pSampler;
+    uint64_t        numReads;
+    uint64_t        stopAfter;                                       // 0 to never stop from the reader.
+    uint64_t        overrunRead;
+    uint64_t        overrunNs;
+} MockReader;
+
+typedef struct DrainedRow_st
+{
+    uint64_t tick;
+    uint64_t timestampNs;
+    uint64_t values[NUM_VALUES];
+} DrainedRow;
+
+// Helper Functions
+static int
+ReadMockCounters(
+    void *pReaderData,
+    uint64_t *pValues,
+    size_t numValues)
+{
+    MockReader *pReader = (MockReader *)pReaderData;
+
+    if (pReader->overrunNs && pReader->numReads == pReader->overrunRead)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(pReader->overrunNs));
+    }
+
+    for (size_t i = 0; i < numValues; i++)
+    {
+        pValues[i] = pReader->numReads * (i + 1);
+    }
+
+    pReader->numReads++;
+    if (pReader->stopAfter && pReader->numReads == pReader->stopAfter)
+    {
+        StopPeriodicSampler(pReader->pSampler);
+    }
+
+    return 0;
+}
+
+static void
+CollectRow(
+    void *pConsumerData,
+    uint64_t tick,
+    uint64_t timestampNs,
+    const uint64_t *pValues,
+    size_t numValues)
+{
+    std::vector<DrainedRow> *pRows = (std::vector<DrainedRow> *)pConsumerData;
+    DrainedRow row;
+
+    CHECK(numValues == NUM_VALUES);
+    row.tick = tick;
+    row.timestampNs = timestampNs;
+    for (size_t i = 0; i < NUM_VALUES; i++)
+    {
+        row.values[i] = pValues[i];
+    }
+    pRows->push_back(row);
+}
+
+// The rows hold the reads in order, with increasing ticks whose gaps add up to the missed ticks.
+static void
+CheckRowSequence(
+    const std::vector<DrainedRow> &rows,
+    uint64_t firstRead,
+    uint64_t missedTicks)
+{
+    uint64_t skipped = 0;
+
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+        CHECK(rows[i].values[0] == firstRead + i);
+        CHECK(rows[i].values[1] == 2 * (firstRead + i));
+        if (i > 0)
+        {
+            CHECK(rows[i].tick > rows[i - 1].tick);
+            CHECK(rows[i].timestampNs >= rows[i - 1].timestampNs);
+            skipped += rows[i].tick - rows[i - 1].tick - 1;
+        }
+    }
+
+    CHECK(skipped == missedTicks);
+}
+
+static void
+CheckTickNumbering(void)
+{
+    PeriodicSampler sampler;
+    SampleRing ring;
+    MockReader reader = { &sampler, 0, 20, 0, 0 };
+    std::vector<DrainedRow> rows;
+
+    CHECK(InitSampleRing(&ring, 64, NUM_VALUES) == 0);
+    InitPeriodicSampler(&sampler, 2000000, ReadMockCounters, &reader, &ring);
+    RunPeriodicSampler(&sampler);
+
+    CHECK(sampler.finished.load() == 1);
+    CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 20);
+    CHECK(sampler.ticks == 20);
+    CHECK(ring.droppedRows.load() == 0);
+    CHECK(rows.size() == 20 && rows[0].tick == 0);
+    CHECK(rows.size() == 20 && rows.back().tick == 19 + sampler.missedTicks);
+    CheckRowSequence(rows, 0, sampler.missedTicks);
+
+    FreeSampleRing(&ring);
+}
+
+static void
+CheckMissedTicks(void)
+{
+    const uint64_t PeriodNs = 10000000;
+    PeriodicSampler sampler;
+    SampleRing ring;
+    // Read 3 takes 4.5 periods: the next 3 deadlines have passed when it returns.
+    MockReader reader = { &sampler, 0, 8, 3, 45000000 };
+    std::vector<DrainedRow> rows;
+
+    CHECK(InitSampleRing(&ring, 64, NUM_VALUES) == 0);
+    InitPeriodicSampler(&sampler, PeriodNs, ReadMockCounters, &reader, &ring);
+    RunPeriodicSampler(&sampler);
+
+    CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 8);
+    CHECK(sampler.ticks == 8);
+    CHECK(sampler.missedTicks >= 3);
+    CHECK(rows.size() == 8 && rows[4].tick - rows[3].tick >= 4);
+    CHECK(rows.size() == 8 && rows[4].timestampNs - rows[3].timestampNs >= 45000000);
+    CheckRowSequence(rows, 0, sampler.missedTicks);
+
+    FreeSampleRing(&ring);
+}
+
+static void
+CheckRingFull(void)
+{
+    PeriodicSampler sampler;
+    SampleRing ring;
+    MockReader reader = { &sampler, 0, 0, 0, 0 };
+    std::vector<DrainedRow> rows;
+
+    // Nothing drains the ring while sampling: the ticks after the first 4 are dropped.
+    CHECK(InitSampleRing(&ring, 4, NUM_VALUES) == 0);
+    InitPeriodicSampler(&sampler, 1000000, ReadMockCounters, &reader, &ring);
+
+    std::thread samplerThread(RunPeriodicSampler, &sampler);
+    while (ring.droppedRows.load() < 6)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    StopPeriodicSampler(&sampler);
+    samplerThread.join();
+
+    CHECK(reader.numReads == 4);
+    CHECK(sampler.ticks == 4 + ring.droppedRows.load());
+    CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 4);
+    CHECK(rows.size() == 4 && rows[0].tick == 0 && rows[3].tick == 3 + sampler.missedTicks);
+    CheckRowSequence(rows, 0, sampler.missedTicks);
+
+    // Draining makes room again.
+    CHECK(ReserveSampleRow(&ring) != NULL);
+
+    FreeSampleRing(&ring);
+}
+
+static void
+CheckDrainOrder(void)
+{
+    SampleRing ring;
+    std::vector<DrainedRow> rows;
+
+    // Without the sampler: drain part way, then fill the ring across its end.
+    CHECK(InitSampleRing(&ring, 8, NUM_VALUES) == 0);
+    for (uint64_t n = 0; n < 13; n++)
+    {
+        uint64_t *pValues = ReserveSampleRow(&ring);
+        CHECK(pValues != NULL);
+        pValues[0] = n;
+        pValues[1] = 2 * n;
+        CommitSampleRow(&ring, n, 1000 * n);
+
+        if (n == 4)
+        {
+            CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 5);
+        }
+    }
+    CHECK(ReserveSampleRow(&ring) == NULL);
+    CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 8);
+    CHECK(DrainSampleRing(&ring, CollectRow, &rows) == 0);
+
+    CHECK(rows.size() == 13);
+    CheckRowSequence(rows, 0, 0);
+    FreeSampleRing(&ring);
+
+    // With the sampler: a consumer draining concurrently sees every read once, in order.
+    PeriodicSampler sampler;
+    MockReader reader = { &sampler, 0, 100, 0, 0 };
+    std::vector<DrainedRow> sampledRows;
+
+    CHECK(InitSampleRing(&ring, 8, NUM_VALUES) == 0);
+    InitPeriodicSampler(&sampler, 1000000, ReadMockCounters, &reader, &ring);
+
+    std::thread samplerThread(RunPeriodicSampler, &sampler);
+    while (!sampler.finished.load(std::memory_order_acquire))
+    {
+        DrainSampleRing(&ring, CollectRow, &sampledRows);
+        std::this_thread::sleep_for(std::chrono::microseconds(500));
+    }
+    samplerThread.join();
+    DrainSampleRing(&ring, CollectRow, &sampledRows);
+
+    CHECK(sampledRows.size() == 100);
+    CHECK(sampler.ticks == 100 + ring.droppedRows.load());
+    CheckRowSequence(sampledRows, 0, sampler.ticks + sampler.missedTicks - sampledRows.size());
+
+    FreeSampleRing(&ring);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CheckTickNumbering();
+    CheckMissedTicks();
+    CheckRingFull();
+    CheckDrainOrder();
+
+    return FinishHostCheck("periodic_sampler_check");
+}
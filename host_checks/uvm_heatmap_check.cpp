@@ -0,0 +1,223 @@
+/*
+ * Copyright 2021-2022 NVIDIA Corporation. All rights reserved
+ *
+ * Host check of helper_cupti_uvm_heatmap.h with synthetic unified memory
+ * counter and kernel records: a transfer split between the address bins it
+ * covers, the ping-pong of a bin migrated back inside the bounce window and
+ * the bytes attributed to the kernels, including kernel records arriving
+ * after the counter records.
+ */
+
+// System headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "helper_cupti_uvm_heatmap.h"
+
+#include "host_check_util.h"
+
+// Macros
+#define BIN_SHIFT 12                                                 // 4 KB address bins.
+#define BIN_SIZE (1ULL << BIN_SHIFT)
+#define WINDOW_NS 1000
+#define BOUNCE_NS 500
+#define GPU_CPU_ID 9                                                 // Source of the HtoD transfers.
+
+// Helper Functions
+static void
+AddCounter(
+    UvmHeatmap *pHeatmap,
+    uint32_t counterKind,
+    uint64_t address,
+    uint64_t value,
+    uint64_t start,
+    uint32_t srcId,
+    uint32_t dstId)
+{
+    CUpti_ActivityUnifiedMemoryCounter2 record;
+    memset(&record, 0, sizeof(record));
+
+    record.kind = CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER;
+    record.counterKind = (CUpti_ActivityUnifiedMemoryCounterKind)counterKind;
+    record.address = address;
+    record.value = value;
+    record.start = start;
+    record.end = start + 10;
+    record.srcId = srcId;
+    record.dstId = dstId;
+
+    UvmHeatmapAddRecord(pHeatmap, (CUpti_Activity *)&record);
+}
+
+static void
+AddKernel(
+    UvmHeatmap *pHeatmap,
+    uint32_t deviceId,
+    uint32_t correlationId,
+    uint64_t start,
+    uint64_t end,
+    const char *pName)
+{
+    CUpti_ActivityKernel10 record;
+    memset(&record, 0, sizeof(record));
+
+    record.kind = CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL;
+    record.deviceId = deviceId;
+    record.correlationId = correlationId;
+    record.start = start;
+    record.end = end;
+    record.name = pName;
+
+    UvmHeatmapAddRecord(pHeatmap, (CUpti_Activity *)&record);
+}
+
+static const UvmHeatmapCounters *
+GetCell(
+    const UvmHeatmap *pHeatmap,
+    uint64_t bin,
+    uint64_t window)
+{
+    std::map<std::pair<uint64_t, uint64_t>, UvmHeatmapCounters>::const_iterator it = pHeatmap->cells.find(std::make_pair(bin, window));
+
+    return it == pHeatmap->cells.end() ? NULL : &it->second;
+}
+
+static void
+CheckTransferSplit(void)
+{
+    UvmHeatmap heatmap;
+
+    InitUvmHeatmap(&heatmap, BIN_SHIFT, WINDOW_NS, BOUNCE_NS);
+
+    // 4 KB from the middle of bin 1: half in bin 1, half in bin 2, in window 2.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, BIN_SIZE + BIN_SIZE / 2, BIN_SIZE, 2500, GPU_CPU_ID, 0);
+    CHECK(heatmap.ranges.size() == 2);
+    CHECK(heatmap.ranges[1].counters.bytesHtoD == BIN_SIZE / 2);
+    CHECK(heatmap.ranges[2].counters.bytesHtoD == BIN_SIZE / 2);
+    CHECK(GetCell(&heatmap, 1, 2) && GetCell(&heatmap, 1, 2)->bytesHtoD == BIN_SIZE / 2);
+    CHECK(GetCell(&heatmap, 2, 2) && GetCell(&heatmap, 2, 2)->bytesHtoD == BIN_SIZE / 2);
+
+    // 0x2200 bytes from 0x3F00: the end of bin 3, bins 4 and 5 whole and the start of bin 6.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH, 0x3F00, 0x2200, 3100, 0, 0);
+    CHECK(heatmap.ranges[3].counters.bytesDtoH == 0x100);
+    CHECK(heatmap.ranges[4].counters.bytesDtoH == BIN_SIZE);
+    CHECK(heatmap.ranges[5].counters.bytesDtoH == BIN_SIZE);
+    CHECK(heatmap.ranges[6].counters.bytesDtoH == 0x100);
+    CHECK(GetCell(&heatmap, 6, 3) && GetCell(&heatmap, 6, 3)->bytesDtoH == 0x100);
+
+    // A fault count is not a byte range, it stays in the bin of its address.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT, 0x3F00, 0x2200, 3200, 0, 0);
+    CHECK(heatmap.ranges[3].counters.gpuPageFaults == 0x2200);
+    CHECK(heatmap.ranges[4].counters.gpuPageFaults == 0);
+
+    CHECK(heatmap.totals.bytesHtoD == BIN_SIZE && heatmap.totals.bytesDtoH == 0x2200);
+    CHECK(heatmap.numRecords == 3);
+
+    FreeUvmHeatmap(&heatmap);
+}
+
+static void
+CheckPingPong(void)
+{
+    const uint64_t Address = 10 * BIN_SIZE;
+    UvmHeatmap heatmap;
+
+    InitUvmHeatmap(&heatmap, BIN_SHIFT, WINDOW_NS, BOUNCE_NS);
+
+    // To GPU 0, to the CPU, back to GPU 0 300 ns later: one bounce.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, Address, 256, 100, GPU_CPU_ID, 0);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH, Address, 256, 300, 0, GPU_CPU_ID);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, Address, 256, 600, GPU_CPU_ID, 0);
+    CHECK(heatmap.ranges[10].bounces == 1);
+    CHECK(heatmap.ranges[10].lastDestination == 0);
+    CHECK(heatmap.ranges[10].previousDestination == UVM_HEATMAP_CPU_ID);
+
+    // Back to the CPU 600 ns later, past the bounce window: no bounce.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH, Address, 256, 1200, 0, GPU_CPU_ID);
+    CHECK(heatmap.ranges[10].bounces == 1);
+
+    // Another part of the bin following the same way is not a bounce, going back to GPU 0 is.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH, Address + 256, 256, 1210, 0, GPU_CPU_ID);
+    CHECK(heatmap.ranges[10].bounces == 1);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, Address, 256, 1250, GPU_CPU_ID, 0);
+    CHECK(heatmap.ranges[10].bounces == 2);
+
+    // Between two GPUs: 0 to 1 and back to 0 inside the window.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, Address + BIN_SIZE, 256, 2000, GPU_CPU_ID, 0);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD, Address + BIN_SIZE, 256, 2100, 0, 1);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD, Address + BIN_SIZE, 256, 2200, 1, 0);
+    CHECK(heatmap.ranges[11].bounces == 1);
+    CHECK(heatmap.ranges[11].counters.bytesDtoD == 512);
+    CHECK(heatmap.ranges[10].bounces == 2);
+
+    FreeUvmHeatmap(&heatmap);
+}
+
+static void
+CheckKernelBytes(void)
+{
+    UvmHeatmap heatmap;
+    UvmHeatmapKernelCounters kernels;
+    UvmHeatmapCounters unattributed;
+
+    InitUvmHeatmap(&heatmap, BIN_SHIFT, WINDOW_NS, BOUNCE_NS);
+
+    // The counter records first, the kernel records complete later.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, 0, 100, 1200, GPU_CPU_ID, 0);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, 0, 200, 1700, GPU_CPU_ID, 0);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH, 0, 400, 2500, 0, GPU_CPU_ID);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT, 0, 3, 1100, 0, 1);
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD, 0, 50, 4000, GPU_CPU_ID, 0);
+    // Not a transfer or a GPU fault, not attributed.
+    AddCounter(&heatmap, CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_CPU_PAGE_FAULT_COUNT, 0, 7, 1200, 0, 0);
+
+    // Overlapping kernels on GPU 0, one on GPU 1.
+    AddKernel(&heatmap, 0, 1, 1000, 2000, "k1");
+    AddKernel(&heatmap, 0, 2, 1500, 3000, "k2");
+    AddKernel(&heatmap, 1, 3, 1000, 5000, "k3");
+
+    GetUvmHeatmapKernelCounters(&heatmap, &kernels, &unattributed);
+    CHECK(kernels.size() == 3);
+
+    // At 1200 only k1 runs on GPU 0; at 1700 both do, the latest started one gets the bytes.
+    const std::pair<const UvmHeatmapKernel *, UvmHeatmapCounters> &k1 = kernels[std::make_pair(1000ULL, 1U)];
+    CHECK(k1.first && !strcmp(k1.first->pName, "k1"));
+    CHECK(k1.second.bytesHtoD == 100 && k1.second.bytesDtoH == 0);
+
+    // A DtoH transfer goes to the CPU: attributed by its source device.
+    const std::pair<const UvmHeatmapKernel *, UvmHeatmapCounters> &k2 = kernels[std::make_pair(1500ULL, 2U)];
+    CHECK(k2.first && !strcmp(k2.first->pName, "k2"));
+    CHECK(k2.second.bytesHtoD == 200 && k2.second.bytesDtoH == 400);
+
+    const std::pair<const UvmHeatmapKernel *, UvmHeatmapCounters> &k3 = kernels[std::make_pair(1000ULL, 3U)];
+    CHECK(k3.first && k3.second.gpuPageFaults == 3 && GetUvmHeatmapBytes(&k3.second) == 0);
+
+    // After every kernel of GPU 0 ended.
+    CHECK(unattributed.bytesHtoD == 50 && unattributed.cpuPageFaults == 0);
+
+    // The report attributes the same way, it only has to run through.
+    FILE *pFile = tmpfile();
+    CHECK(pFile != NULL);
+    if (pFile)
+    {
+        PrintUvmHeatmapReport(&heatmap, pFile);
+        CHECK(ftell(pFile) > 0);
+        fclose(pFile);
+    }
+
+    FreeUvmHeatmap(&heatmap);
+}
+
+int
+main(
+    int argc,
+    char *argv[])
+{
+    CheckTransferSplit();
+    CheckPingPong();
+    CheckKernelBytes();
+
+    return FinishHostCheck("uvm_heatmap_check");
+}
@@ -2,6 +2,13 @@
 * Copyright 2015-2022 NVIDIA Corporation. All rights reserved.
 *
 * Sample to demonstrate use of NVlink CUPTI APIs
+*
+* The NVLink byte counters of device 0 are read every SAMPLE_PERIOD_MS during
+* the transfers, into buffers allocated once, by the periodic sampler of
+* helper_periodic_sampler.h. With the topology of the NVLINK records,
+* helper_cupti_nvlink_series.h turns them into TX and RX throughput series
+* per link and prints a per link utilization table. Set NVLINK_SERIES_CSV to
+* a file name to write the link x time matrix.
 */
 
 // System headers
@@ -9,6 +16,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
 // CUDA headers
 #include <cuda.h>
 #include <cuda_runtime.h>
@@ -16,14 +27,20 @@
 // CUPTI headers
 #include "cupti.h"
 #include "helper_cupti_activity.h"
+#include "helper_cupti_nvlink_series.h"
+#include "helper_periodic_sampler.h"
 
 #define MAX_DEVICES    (32)
 #define BLOCK_SIZE     (1024)
 #define GRID_SIZE      (512)
-#define NUM_METRIC     (4)
-#define NUM_EVENTS     (2)
+#define NUM_METRIC     (2)
 #define MAX_SIZE       (64*1024*1024)
 #define NUM_STREAMS    (6)
+#define NUM_ITERATIONS (8)
+#define SAMPLE_PERIOD_MS   (2)
+#define SAMPLE_RING_ROWS   (4096)
+#define CONSUMER_PERIOD_MS (100)
+#define MAX_GROUP_EVENTS   (32)
 
 int cpuToGpu       = 0;
 int gpuToGpu       = 0;
@@ -31,7 +48,37 @@ int cpuToGpuAccess = 0;
 int gpuToGpuAccess = 0;
 bool metricSupport = true;
 
-CUpti_ActivityNvLink4 *nvlinkRec = NULL;
+bool nvlinkFound = false;
+
+// Byte counters sampled per port: TX first, RX second.
+const char *pMetricNames[NUM_METRIC] =  {
+                                            "nvlink_total_data_transmitted",
+                                            "nvlink_total_data_received"
+                                        };
+
+// Event groups of the NVLink metrics of a device, and the buffers to read and convert them.
+typedef struct NvLinkCounterReader_st
+{
+    int                   deviceOrdinal;
+    CUdevice              device;
+    CUpti_MetricID        metricIds[NUM_METRIC];
+    CUpti_MetricValueKind valueKinds[NUM_METRIC];
+    CUpti_EventGroupSets  *pPasses;                                  // Created by cuptiMetricCreateEventGroupSets, destroyed at teardown.
+    CUpti_EventGroupSet   *pEventGroupSet;                           // Single pass set holding the events of both metrics.
+    uint32_t              *pNumEvents;                               // Events per group.
+    uint32_t              *pNumInstances;                            // Domain instances per group.
+    size_t                *pRowOffsets;                              // Per group, offset of its values in the sample row.
+    size_t                numValues;                                 // Values per sample row.
+    uint32_t              numPorts;                                  // Domain instances read in every group.
+    CUpti_EventID         *pEventIdBuffer;                           // Scratch buffer for the event ids read.
+    size_t                eventIdBufferSize;                         // Size of pEventIdBuffer in bytes.
+    CUpti_EventID         *pPortEventIds;                            // Events of all the groups, in row order.
+    uint64_t              *pPortValues;                              // Values of these events for one port.
+} NvLinkCounterReader;
+
+static PeriodicSampler s_sampler;
+static SampleRing s_sampleRing;
+static NvLinkSeries s_nvlinkSeries;
 
 extern "C" __global__ void
 TestNvLinkBandwidth(
@@ -72,188 +119,260 @@ void CalculateSize(
     return;
 }
 
-void
-ReadMetricValue(
-    CUpti_EventGroup eventGroup,
-    uint32_t numEvents,
-    CUdevice device,
-    CUpti_MetricID *pMetricId,
-    uint64_t timeDuration,
-    CUpti_MetricValue *pMetricValue)
+// Event groups of the NVLink byte metrics, read at every tick straight into the sample row.
+// Buffers are sized at setup so that neither the read nor the conversion allocates.
+static int
+ReadNvLinkCounters(
+    void *pReaderData,
+    uint64_t *pValues,
+    size_t numValues)
 {
+    NvLinkCounterReader *pReader = (NvLinkCounterReader *)pReaderData;
+    uint32_t numPortEvents = 0;
 
-    size_t bufferSizeBytes, numCountersRead;
-    size_t arraySizeBytes = 0;
-    size_t numTotalInstancesSize = 0;
-    size_t domainSize;
-    uint64_t numTotalInstances = 0;
-
-    uint64_t *pAggrEventValueArray = NULL;
-    size_t aggrEventValueArraySize;
-
-    uint64_t *pEventValueArray = NULL;
+    for (uint32_t group = 0; group < pReader->pEventGroupSet->numEventGroups; group++)
+    {
+        size_t expectedBytesRead = sizeof(uint64_t) * pReader->pNumEvents[group] * pReader->pNumInstances[group];
+        size_t expectedEventIdsRead = sizeof(CUpti_EventID) * pReader->pNumEvents[group];
+        size_t bytesRead = expectedBytesRead;
+        size_t eventIdsRead = pReader->eventIdBufferSize;
+        size_t numEventIdsRead = 0;
+
+        CUPTI_API_CALL(cuptiEventGroupReadAllEvents(pReader->pEventGroupSet->eventGroups[group], CUPTI_EVENT_READ_FLAG_NONE,
+                                                    &bytesRead, pValues + pReader->pRowOffsets[group], &eventIdsRead,
+                                                    pReader->pEventIdBuffer, &numEventIdsRead));
+
+        // The row layout and pPortEventIds assume the events cached at setup, in the same order, for every port.
+        if (numEventIdsRead != pReader->pNumEvents[group] || bytesRead != expectedBytesRead || eventIdsRead != expectedEventIdsRead ||
+            memcmp(pReader->pEventIdBuffer, pReader->pPortEventIds + numPortEvents, expectedEventIdsRead) != 0)
+        {
+            printf("Error: Event group %u read returned %llu event ids (%llu bytes of values) not matching the cached layout of %u events x %u instances.\n",
+                   group, (unsigned long long)numEventIdsRead, (unsigned long long)bytesRead, pReader->pNumEvents[group], pReader->pNumInstances[group]);
+            return -1;
+        }
+        numPortEvents += pReader->pNumEvents[group];
+    }
 
-    CUpti_EventID *pEventIdArray;
-    CUpti_EventDomainID domainId;
+    return 0;
+}
 
-    uint32_t i = 0, j = 0;
-    domainSize = sizeof(CUpti_EventDomainID);
+static uint64_t
+GetMetricBytes(
+    CUpti_MetricValueKind valueKind,
+    CUpti_MetricValue metricValue)
+{
+    switch (valueKind)
+    {
+        case CUPTI_METRIC_VALUE_KIND_DOUBLE:
+            return (uint64_t)metricValue.metricValueDouble;
+        case CUPTI_METRIC_VALUE_KIND_UINT64:
+            return metricValue.metricValueUint64;
+        case CUPTI_METRIC_VALUE_KIND_INT64:
+            return (uint64_t)metricValue.metricValueInt64;
+        default:
+            return 0;
+    }
+}
 
-    CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_EVENT_DOMAIN_ID, &domainSize, (void *)&domainId));
+// Converts a sample row into the cumulative TX and RX bytes of every NVLink port of the device.
+// The domain instances of the NVLink events are the ports of the device, and the byte metrics
+// are sums of events, so evaluating them on the values of one instance gives the bytes of a port.
+static void
+ConsumeNvLinkRow(
+    void *pConsumerData,
+    uint64_t tick,
+    uint64_t timestampNs,
+    const uint64_t *pValues,
+    size_t numValues)
+{
+    NvLinkCounterReader *pReader = (NvLinkCounterReader *)pConsumerData;
 
-    numTotalInstancesSize = sizeof(uint64_t);
+    for (uint32_t instance = 0; instance < pReader->numPorts; instance++)
+    {
+        uint64_t bytes[NUM_METRIC];
+        uint32_t numEvents = 0;
 
-    CUPTI_API_CALL(cuptiDeviceGetEventDomainAttribute(device, domainId, CUPTI_EVENT_DOMAIN_ATTR_TOTAL_INSTANCE_COUNT, &numTotalInstancesSize, (void *)&numTotalInstances));
+        for (uint32_t group = 0; group < pReader->pEventGroupSet->numEventGroups; group++)
+        {
+            const uint64_t *pInstanceValues = pValues + pReader->pRowOffsets[group] + (size_t)instance * pReader->pNumEvents[group];
 
-    arraySizeBytes = sizeof(CUpti_EventID) * numEvents;
-    bufferSizeBytes = sizeof(uint64_t) * numEvents * numTotalInstances;
+            memcpy(pReader->pPortValues + numEvents, pInstanceValues, sizeof(uint64_t) * pReader->pNumEvents[group]);
+            numEvents += pReader->pNumEvents[group];
+        }
 
-    pEventValueArray = (uint64_t *)malloc(bufferSizeBytes);
-    MEMORY_ALLOCATION_CALL(pEventValueArray);
+        for (uint32_t i = 0; i < NUM_METRIC; i++)
+        {
+            CUpti_MetricValue metricValue;
 
-    pEventIdArray = (CUpti_EventID *)malloc(arraySizeBytes);
-    MEMORY_ALLOCATION_CALL(pEventIdArray);
+            CUPTI_API_CALL(cuptiMetricGetValue(pReader->device, pReader->metricIds[i], sizeof(CUpti_EventID) * numEvents, pReader->pPortEventIds,
+                                               sizeof(uint64_t) * numEvents, pReader->pPortValues, SAMPLE_PERIOD_MS * 1000000ULL, &metricValue));
+            bytes[i] = GetMetricBytes(pReader->valueKinds[i], metricValue);
+        }
 
-    pAggrEventValueArray = (uint64_t *)calloc(numEvents, sizeof(uint64_t));
-    MEMORY_ALLOCATION_CALL(pAggrEventValueArray);
+        NvLinkSeriesAddSample(&s_nvlinkSeries, pReader->deviceOrdinal, (int32_t)instance, timestampNs, bytes[0], bytes[1]);
+    }
+}
 
-    aggrEventValueArraySize = sizeof(uint64_t) * numEvents;
+static void
+SetupNvLinkCounterReader(
+    NvLinkCounterReader *pReader,
+    CUcontext context,
+    int deviceOrdinal)
+{
+    uint32_t profileAll = 1;
+    size_t valueSize = 0;
+    size_t maxEvents = 0;
+    uint32_t numPortEvents = 0;
 
-    CUPTI_API_CALL(cuptiEventGroupReadAllEvents(eventGroup, CUPTI_EVENT_READ_FLAG_NONE, &bufferSizeBytes, pEventValueArray, &arraySizeBytes, pEventIdArray, &numCountersRead));
+    pReader->deviceOrdinal = deviceOrdinal;
+    DRIVER_API_CALL(cuDeviceGet(&pReader->device, deviceOrdinal));
 
-    for (i = 0; i < numEvents; i++)
+    for (uint32_t i = 0; i < NUM_METRIC; i++)
     {
-        for (j = 0; j < numTotalInstances; j++)
-        {
-            pAggrEventValueArray[i] += pEventValueArray[i + numEvents * j];
-        }
+        CUPTI_API_CALL(cuptiMetricGetIdFromName(pReader->device, pMetricNames[i], &pReader->metricIds[i]));
+
+        valueSize = sizeof(CUpti_MetricValueKind);
+        CUPTI_API_CALL(cuptiMetricGetAttribute(pReader->metricIds[i], CUPTI_METRIC_ATTR_VALUE_KIND, &valueSize, &pReader->valueKinds[i]));
     }
 
-    for (i = 0; i < NUM_METRIC; i++)
+    // All the counters are read at the same tick, so they have to be collectable in a single pass.
+    CUPTI_API_CALL(cuptiMetricCreateEventGroupSets(context, sizeof(pReader->metricIds), pReader->metricIds, &pReader->pPasses));
+    if (pReader->pPasses->numSets != 1)
     {
-        CUPTI_API_CALL(cuptiMetricGetValue(device, pMetricId[i], arraySizeBytes, pEventIdArray, aggrEventValueArraySize, pAggrEventValueArray, timeDuration, &pMetricValue[i]));
+        printf("Error: The NVLink metrics need %u passes and cannot be sampled together.\n", pReader->pPasses->numSets);
+        exit(EXIT_FAILURE);
     }
+    pReader->pEventGroupSet = &pReader->pPasses->sets[0];
+
+    uint32_t numGroups = pReader->pEventGroupSet->numEventGroups;
+    pReader->pNumEvents = (uint32_t *)calloc(numGroups, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pReader->pNumEvents);
+    pReader->pNumInstances = (uint32_t *)calloc(numGroups, sizeof(uint32_t));
+    MEMORY_ALLOCATION_CALL(pReader->pNumInstances);
+    pReader->pRowOffsets = (size_t *)calloc(numGroups, sizeof(size_t));
+    MEMORY_ALLOCATION_CALL(pReader->pRowOffsets);
+    pReader->pPortEventIds = (CUpti_EventID *)calloc(numGroups * MAX_GROUP_EVENTS, sizeof(CUpti_EventID));
+    MEMORY_ALLOCATION_CALL(pReader->pPortEventIds);
+    pReader->pPortValues = (uint64_t *)calloc(numGroups * MAX_GROUP_EVENTS, sizeof(uint64_t));
+    MEMORY_ALLOCATION_CALL(pReader->pPortValues);
+
+    pReader->numValues = 0;
+    pReader->numPorts = UINT32_MAX;
+
+    for (uint32_t group = 0; group < numGroups; group++)
+    {
+        CUpti_EventGroup eventGroup = pReader->pEventGroupSet->eventGroups[group];
 
-    free(pEventValueArray);
-    free(pEventIdArray);
-}
-
-// Print metric value, we format based on the value kind.
-int
-PrintMetricValue(
-    CUpti_MetricID metricId,
-    CUpti_MetricValue metricValue,
-    const char *pMetricName)
-{
+        CUPTI_API_CALL(cuptiEventGroupSetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(profileAll), &profileAll));
 
-    CUpti_MetricValueKind valueKind;
-    char stringArray[64];
-    size_t valueKindSize = sizeof(valueKind);
+        valueSize = sizeof(uint32_t);
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_NUM_EVENTS, &valueSize, &pReader->pNumEvents[group]));
+        if (pReader->pNumEvents[group] > MAX_GROUP_EVENTS)
+        {
+            printf("Error: Event group %u holds %u events, more than %d.\n", group, pReader->pNumEvents[group], MAX_GROUP_EVENTS);
+            exit(EXIT_FAILURE);
+        }
 
-    CUPTI_API_CALL(cuptiMetricGetAttribute(metricId, CUPTI_METRIC_ATTR_VALUE_KIND, &valueKindSize, &valueKind));
-    switch (valueKind)
-    {
+        // The events of every port are laid out in the order of the groups, as the row read at every tick.
+        valueSize = sizeof(CUpti_EventID) * pReader->pNumEvents[group];
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_EVENTS, &valueSize, pReader->pPortEventIds + numPortEvents));
+        numPortEvents += pReader->pNumEvents[group];
 
-        case CUPTI_METRIC_VALUE_KIND_DOUBLE:
-            printf("%s = ", pMetricName);
-            CalculateSize(stringArray, (uint64_t)metricValue.metricValueDouble);
-            printf("%s\n", stringArray);
-            break;
+        CUPTI_API_CALL(cuptiEventGroupEnable(eventGroup));
 
-        case CUPTI_METRIC_VALUE_KIND_UINT64:
-            printf("%s = ", pMetricName);
-            CalculateSize(stringArray, (uint64_t)metricValue.metricValueUint64);
-            printf("%s\n", stringArray);
-            break;
+        valueSize = sizeof(uint32_t);
+        CUPTI_API_CALL(cuptiEventGroupGetAttribute(eventGroup, CUPTI_EVENT_GROUP_ATTR_INSTANCE_COUNT, &valueSize, &pReader->pNumInstances[group]));
 
-        case CUPTI_METRIC_VALUE_KIND_INT64:
-            printf("%s = ", pMetricName);
-            CalculateSize(stringArray, (uint64_t)metricValue.metricValueInt64);
-            printf("%s\n", stringArray);
-            break;
+        pReader->pRowOffsets[group] = pReader->numValues;
+        pReader->numValues += (size_t)pReader->pNumEvents[group] * pReader->pNumInstances[group];
+        pReader->numPorts = std::min(pReader->numPorts, pReader->pNumInstances[group]);
+        maxEvents = std::max(maxEvents, (size_t)pReader->pNumEvents[group]);
+    }
 
-        case CUPTI_METRIC_VALUE_KIND_THROUGHPUT:
-            printf("%s = ", pMetricName);
-            CalculateSize(stringArray, (uint64_t)metricValue.metricValueThroughput);
-            printf("%s/Sec\n", stringArray);
-            break;
+    pReader->eventIdBufferSize = sizeof(CUpti_EventID) * maxEvents;
+    pReader->pEventIdBuffer = (CUpti_EventID *)malloc(pReader->eventIdBufferSize);
+    MEMORY_ALLOCATION_CALL(pReader->pEventIdBuffer);
+}
 
-        default:
-            fprintf(stderr, "Error: Unknown value kind.\n");
-            return -1;
+static void
+TeardownNvLinkCounterReader(
+    NvLinkCounterReader *pReader)
+{
+    for (uint32_t group = 0; group < pReader->pEventGroupSet->numEventGroups; group++)
+    {
+        CUPTI_API_CALL(cuptiEventGroupDisable(pReader->pEventGroupSet->eventGroups[group]));
     }
 
-    return 0;
-  }
+    // Destroys the event groups of the sets as well.
+    CUPTI_API_CALL(cuptiEventGroupSetsDestroy(pReader->pPasses));
+    pReader->pPasses = NULL;
+    pReader->pEventGroupSet = NULL;
+
+    free(pReader->pNumEvents);
+    free(pReader->pNumInstances);
+    free(pReader->pRowOffsets);
+    free(pReader->pPortEventIds);
+    free(pReader->pPortValues);
+    free(pReader->pEventIdBuffer);
+}
+
+// Drains the sample ring off the sampling thread, so the metric evaluation never delays a tick.
+static void
+DoConsume(
+    NvLinkCounterReader *pReader)
+{
+    while (!s_sampler.finished.load(std::memory_order_acquire))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(CONSUMER_PERIOD_MS));
+        DrainSampleRing(&s_sampleRing, ConsumeNvLinkRow, pReader);
+    }
+    DrainSampleRing(&s_sampleRing, ConsumeNvLinkRow, pReader);
+}
 
 void
 TestCpuToGpu(
-    CUpti_EventGroup *eventGroup,
     CUdeviceptr *pDevBuffer,
     float **pHostBuffer,
     size_t bufferSize,
-    cudaStream_t *pCudaStreams,
-    uint64_t *pTimeDuration,
-    int numEventGroup)
+    cudaStream_t *pCudaStreams)
 {
     int i;
-    uint32_t value = 1;
-    uint64_t startTimestamp, endTimestamp;
 
-    for (i = 0; i < numEventGroup; i++)
+    for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
     {
-        CUPTI_API_CALL(cuptiEventGroupEnable(eventGroup[i]));
-        CUPTI_API_CALL(cuptiEventGroupSetAttribute(eventGroup[i], CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(uint32_t), (void*)&value));
-    }
-
-    CUPTI_API_CALL(cuptiGetTimestamp(&startTimestamp));
-
-    // Unidirectional copy H2D.
-    for (i = 0; i < NUM_STREAMS; i++)
-    {
-        RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBuffer[i], pHostBuffer[i], bufferSize, cudaMemcpyHostToDevice, pCudaStreams[i]));
-    }
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
+        // Unidirectional copy H2D.
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBuffer[i], pHostBuffer[i], bufferSize, cudaMemcpyHostToDevice, pCudaStreams[i]));
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    // Unidirectional copy D2H.
-    for (i = 0; i < NUM_STREAMS; i++)
-    {
-        RUNTIME_API_CALL(cudaMemcpyAsync(pHostBuffer[i], (void *)pDevBuffer[i], bufferSize, cudaMemcpyDeviceToHost, pCudaStreams[i]));
-    }
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
+        // Unidirectional copy D2H.
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            RUNTIME_API_CALL(cudaMemcpyAsync(pHostBuffer[i], (void *)pDevBuffer[i], bufferSize, cudaMemcpyDeviceToHost, pCudaStreams[i]));
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    // Bidirectional copy.
-    for (i = 0; i < NUM_STREAMS; i += 2)
-    {
-        RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBuffer[i], pHostBuffer[i], bufferSize, cudaMemcpyHostToDevice, pCudaStreams[i]));
-        RUNTIME_API_CALL(cudaMemcpyAsync(pHostBuffer[i + 1], (void *)pDevBuffer[i + 1], bufferSize, cudaMemcpyDeviceToHost, pCudaStreams[i + 1]));
+        // Bidirectional copy.
+        for (i = 0; i < NUM_STREAMS; i += 2)
+        {
+            RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBuffer[i], pHostBuffer[i], bufferSize, cudaMemcpyHostToDevice, pCudaStreams[i]));
+            RUNTIME_API_CALL(cudaMemcpyAsync(pHostBuffer[i + 1], (void *)pDevBuffer[i + 1], bufferSize, cudaMemcpyDeviceToHost, pCudaStreams[i + 1]));
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
     }
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
-
-    CUPTI_API_CALL(cuptiGetTimestamp(&endTimestamp));
-    *pTimeDuration = endTimestamp - startTimestamp;
 }
 
 void
 TestGpuToGpu(
-    CUpti_EventGroup *pEventGroup,
     CUdeviceptr *pDevBufferA,
     CUdeviceptr *pDevBufferB,
     float** pHostBuffer,
     size_t bufferSize,
-    cudaStream_t *pCudaStreams,
-    uint64_t *pTimeDuration,
-    int numEventGroup)
+    cudaStream_t *pCudaStreams)
 {
     int i;
-    uint32_t value = 1;
-    uint64_t startTimestamp, endTimestamp;
-
-    for (i = 0; i < numEventGroup; i++)
-    {
-        CUPTI_API_CALL(cuptiEventGroupEnable(pEventGroup[i]));
-        CUPTI_API_CALL(cuptiEventGroupSetAttribute(pEventGroup[i], CUPTI_EVENT_GROUP_ATTR_PROFILE_ALL_DOMAIN_INSTANCES, sizeof(uint32_t), (void*)&value));
-    }
 
     RUNTIME_API_CALL(cudaSetDevice(0));
     RUNTIME_API_CALL(cudaDeviceEnablePeerAccess(1, 0));
@@ -273,28 +392,27 @@ TestGpuToGpu(
     }
     RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    CUPTI_API_CALL(cuptiGetTimestamp(&startTimestamp));
-
-    for (i = 0; i < NUM_STREAMS; i++)
+    for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
     {
-        RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBufferA[i], (void *)pDevBufferB[i], bufferSize, cudaMemcpyDeviceToDevice, pCudaStreams[i]));
-    }
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBufferA[i], (void *)pDevBufferB[i], bufferSize, cudaMemcpyDeviceToDevice, pCudaStreams[i]));
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    for (i = 0; i < NUM_STREAMS; i++)
-    {
-        RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBufferB[i], (void *)pDevBufferA[i], bufferSize, cudaMemcpyDeviceToDevice, pCudaStreams[i]));
-    }
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            RUNTIME_API_CALL(cudaMemcpyAsync((void *)pDevBufferB[i], (void *)pDevBufferA[i], bufferSize, cudaMemcpyDeviceToDevice, pCudaStreams[i]));
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    for (i = 0; i < NUM_STREAMS; i++)
-    {
-        TestNvLinkBandwidth <<< GRID_SIZE, BLOCK_SIZE >>> ((float*)pDevBufferB[i], (float*)pDevBufferA[i]);
-        RUNTIME_API_CALL(cudaGetLastError());
+        for (i = 0; i < NUM_STREAMS; i++)
+        {
+            TestNvLinkBandwidth <<< GRID_SIZE, BLOCK_SIZE >>> ((float*)pDevBufferB[i], (float*)pDevBufferA[i]);
+            RUNTIME_API_CALL(cudaGetLastError());
+        }
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
     }
-
-    CUPTI_API_CALL(cuptiGetTimestamp(&endTimestamp));
-    *pTimeDuration = endTimestamp - startTimestamp;
 }
 
 void
@@ -305,7 +423,20 @@ NVLinkRecords(
     {
         case CUPTI_ACTIVITY_KIND_NVLINK:
         {
-            nvlinkRec = (CUpti_ActivityNvLink4 *)pRecord;
+            CUpti_ActivityNvLink4 *pNvLinkRecord = (CUpti_ActivityNvLink4 *)pRecord;
+
+            nvlinkFound = true;
+            if (pNvLinkRecord->flag & CUPTI_LINK_FLAG_SYSMEM_ACCESS)
+            {
+                cpuToGpuAccess = 1;
+            }
+            if (pNvLinkRecord->flag & CUPTI_LINK_FLAG_PEER_ACCESS)
+            {
+                gpuToGpuAccess = 1;
+            }
+
+            // Topology of the links, to map the sampled ports to their peers.
+            NvLinkSeriesAddRecord(&s_nvlinkSeries, pRecord);
             break;
         }
         default:
@@ -374,9 +505,8 @@ main(
     int argc,
     char *argv[])
 {
-    int deviceCount = 0, i = 0, j = 0, numEventGroup = 0;
+    int deviceCount = 0, i = 0;
     size_t bufferSize = 0, freeMemory = 0, totalMemory = 0;
-    CUpti_EventGroupSets *pPasses = NULL;
     CUcontext context;
     char stringArray[64];
 
@@ -386,24 +516,14 @@ main(
 
     cudaStream_t cudaStreams[NUM_STREAMS] = {0};
 
-    CUpti_EventGroup eventGroup[32];
-    CUpti_MetricID metricId[NUM_METRIC];
-    uint32_t numEvents[NUM_METRIC];
-    CUpti_MetricValue metricValue[NUM_METRIC];
     cudaDeviceProp deviceProp[MAX_DEVICES];
-    uint64_t timeDuration;
-
-    // Adding NVLink Metrics.
-    const char *pMetricName[NUM_METRIC] =   {
-                                                "nvlink_total_data_transmitted",
-                                                "nvlink_total_data_received",
-                                                "nvlink_transmit_throughput",
-                                                "nvlink_receive_throughput"
-                                            };
+    NvLinkCounterReader reader;
 
     // Parse command line arguments.
     ParseCommandLineArgs(argc, argv);
 
+    InitNvLinkSeries(&s_nvlinkSeries, NVLINK_SERIES_DEFAULT_MAX_LINKS, NVLINK_SERIES_DEFAULT_MAX_BINS, SAMPLE_PERIOD_MS * 1000000ULL);
+
     SetupCupti();
 
     // Initialize CUDA.
@@ -421,9 +541,17 @@ main(
 
     for (i = 0; i < deviceCount; i++)
     {
+        CUdevice device;
+        CUuuid uuid;
+
         RUNTIME_API_CALL(cudaGetDeviceProperties(&deviceProp[i], i));
         printf("CUDA Device %d Name: %s\n", i, deviceProp[i].name);
 
+        // The NVLink records name the devices by UUID.
+        DRIVER_API_CALL(cuDeviceGet(&device, i));
+        DRIVER_API_CALL(cuDeviceGetUuid(&uuid, device));
+        NvLinkSeriesSetDeviceUuid(&s_nvlinkSeries, i, &uuid);
+
         // Check if any device is Turing+.
         if (deviceProp[i].major == 7 && deviceProp[i].minor > 0)
         {
@@ -455,10 +583,10 @@ main(
     CUPTI_API_CALL(cuptiActivityFlushAll(0));
 
     // Transfer Data between Host And Device, if Nvlink is Present.
-    // Check condition : nvlinkRec->flag & CUPTI_LINK_FLAG_SYSMEM_ACCESS.
+    // Check condition : flag & CUPTI_LINK_FLAG_SYSMEM_ACCESS of the NVLink records.
     // True : Nvlink is present between CPU & GPU.
     // False : Nvlink is not present.
-    if ((nvlinkRec) && (((cpuToGpu) && (cpuToGpuAccess)) || ((gpuToGpu) && (gpuToGpuAccess))))
+    if ((nvlinkFound) && (((cpuToGpu) && (cpuToGpuAccess)) || ((gpuToGpu) && (gpuToGpuAccess))))
     {
         if (!metricSupport)
         {
@@ -466,34 +594,20 @@ main(
             exit(EXIT_WAIVED);
         }
 
-        for (i = 0; i < NUM_METRIC; i++)
-        {
-            CUPTI_API_CALL(cuptiMetricGetIdFromName(0, pMetricName[i], &metricId[i]));
-            CUPTI_API_CALL(cuptiMetricGetNumEvents(metricId[i], &numEvents[i]));
-        }
-
         DRIVER_API_CALL(cuCtxCreate(&context, 0, 0));
 
-        CUPTI_API_CALL(cuptiMetricCreateEventGroupSets(context, (sizeof metricId) ,metricId, &pPasses));
-
-        // EventGroups required to profile Nvlink metrics.
-        for (i = 0; i < (signed)pPasses->numSets; i++)
-        {
-            for (j = 0; j < (signed)pPasses->sets[i].numEventGroups; j++)
-            {
-                eventGroup[numEventGroup] = pPasses->sets[i].eventGroups[j];
+        CUPTI_API_CALL(cuptiSetEventCollectionMode(context, CUPTI_EVENT_COLLECTION_MODE_CONTINUOUS));
 
-                if (!eventGroup[numEventGroup])
-                {
-                    printf("\nError: eventGroup initialization failed.\n");
-                    exit(EXIT_FAILURE);
-                }
+        // The counters of device 0 are read every SAMPLE_PERIOD_MS for the whole transfer test.
+        memset(&reader, 0, sizeof(reader));
+        SetupNvLinkCounterReader(&reader, context, 0);
 
-                numEventGroup++;
-            }
+        if (InitSampleRing(&s_sampleRing, SAMPLE_RING_ROWS, reader.numValues) != 0)
+        {
+            printf("Error: Failed to allocate the sample ring.\n");
+            exit(EXIT_FAILURE);
         }
-
-        CUPTI_API_CALL(cuptiSetEventCollectionMode(context, CUPTI_EVENT_COLLECTION_MODE_CONTINUOUS));
+        InitPeriodicSampler(&s_sampler, SAMPLE_PERIOD_MS * 1000000ULL, ReadNvLinkCounters, &reader, &s_sampleRing);
 
         // Allocate Memory.
         for (i = 0; i < NUM_STREAMS; i++)
@@ -504,12 +618,7 @@ main(
             MEMORY_ALLOCATION_CALL(pHostBuffer[i]);
         }
 
-        if (cpuToGpu)
-        {
-            TestCpuToGpu(eventGroup, devBufferA, pHostBuffer, bufferSize, cudaStreams, &timeDuration, numEventGroup);
-            printf("Data transferred between CPU & Device %d: \n", (int)nvlinkRec->typeDev0);
-        }
-        else if (gpuToGpu)
+        if (gpuToGpu)
         {
             RUNTIME_API_CALL(cudaSetDevice(1));
 
@@ -517,28 +626,36 @@ main(
             {
                 RUNTIME_API_CALL(cudaMalloc((void **)&devBufferB[i], bufferSize));
             }
-
-            TestGpuToGpu(eventGroup, devBufferA, devBufferB, pHostBuffer, bufferSize, cudaStreams, &timeDuration, numEventGroup);
-            printf("Data transferred between Device 0 & Device 1: \n");
         }
 
-        // Collect Nvlink Metric values for the data transfer via Nvlink for all the eventGroups.
-        for (i = 0; i < numEventGroup; i++)
+        std::thread samplingThread(RunPeriodicSampler, &s_sampler);
+        std::thread consumerThread(DoConsume, &reader);
+
+        if (cpuToGpu)
+        {
+            TestCpuToGpu(devBufferA, pHostBuffer, bufferSize, cudaStreams);
+            printf("Data transferred between CPU & Device 0.\n");
+        }
+        else if (gpuToGpu)
         {
-            ReadMetricValue(eventGroup[i], NUM_EVENTS, 0, metricId, timeDuration, metricValue);
+            TestGpuToGpu(devBufferA, devBufferB, pHostBuffer, bufferSize, cudaStreams);
+            printf("Data transferred between Device 0 & Device 1.\n");
+        }
 
-            CUPTI_API_CALL(cuptiEventGroupDisable(eventGroup[i]));
-            CUPTI_API_CALL(cuptiEventGroupDestroy(eventGroup[i]));
+        // Sample the idle links once more, then stop the sampler and wait for the ring to be drained.
+        std::this_thread::sleep_for(std::chrono::milliseconds(2 * SAMPLE_PERIOD_MS));
+        StopPeriodicSampler(&s_sampler);
+        samplingThread.join();
+        consumerThread.join();
 
-            for (i = 0; i < NUM_METRIC; i++)
-            {
-                if (PrintMetricValue(metricId[i], metricValue[i], pMetricName[i]) != 0)
-                {
-                    printf("\nError: PrintMetricValue() failed.\n");
-                    exit(EXIT_FAILURE);
-                }
-            }
-        }
+        printf("Samples: %llu, missed deadlines: %llu, dropped rows: %llu, max wake-up lateness: %llu ns\n",
+               (unsigned long long)s_sampler.ticks,
+               (unsigned long long)s_sampler.missedTicks,
+               (unsigned long long)s_sampleRing.droppedRows.load(),
+               (unsigned long long)s_sampler.maxLatenessNs);
+
+        TeardownNvLinkCounterReader(&reader);
+        FreeSampleRing(&s_sampleRing);
     }
     else
     {
@@ -548,5 +665,24 @@ main(
 
     DeInitCuptiTrace();
 
+    PrintNvLinkSeriesReport(&s_nvlinkSeries, stdout);
+
+    const char *pCsvFileName = getenv("NVLINK_SERIES_CSV");
+    if (pCsvFileName)
+    {
+        FILE *pCsvFile = fopen(pCsvFileName, "w");
+        if (pCsvFile)
+        {
+            WriteNvLinkSeriesCsv(&s_nvlinkSeries, pCsvFile);
+            fclose(pCsvFile);
+        }
+        else
+        {
+            printf("Warning: Failed to open %s.\n", pCsvFileName);
+        }
+    }
+
+    FreeNvLinkSeries(&s_nvlinkSeries);
+
     exit(EXIT_SUCCESS);
 }
@@ -81,40 +81,18 @@
 #include <cupti_pcsampling.h>
 #include "helper_cupti.h"
 #include <cupti.h>
+#include "helper_cupti_pc_sampling_store.h"
 
 #ifdef _WIN32
 #define strdup _strdup
 #endif
 
-using namespace CUPTI::PcSamplingUtil;
-
-// Macros
-#define THREAD_SLEEP_TIME 100 // in ms
-
 // Global structures and variables
-typedef struct ContextInfo_st
-{
-    uint32_t contextUid;
-    CUpti_PCSamplingData pcSamplingData;
-    std::vector<CUpti_PCSamplingConfigurationInfo> pcSamplingConfigurationInfo;
-    PcSamplingStallReasons pcSamplingStallReasons;
-} ContextInfo;
-
-// For multi-gpu we are preallocating buffers only for first context creation,
-// So preallocated buffer stall reason size will be equal to max stall reason for first context GPU.
-size_t stallReasonsCount = 0;
 // Consider firstly queried stall reason count using cuptiPCSamplingGetNumStallReasons() to allocate memory for circular buffers.
 bool g_collectedStallReasonsCount = false;
 std::mutex g_stallReasonsCountMutex;
 
-// Variables related to circular buffer.
-std::vector<CUpti_PCSamplingData> g_circularBuffer;
-std::unordered_set<char*> functions;
-int g_put = 0;
-int g_get = 0;
-std::vector<bool> g_bufferEmptyTrackerArray; // true - used, false - free.
-std::mutex g_circularBufferMutex;
-bool g_buffersGetUtilisedFasterThanStore = false;
+// Variables related to circular buffer, the buffers themselves are in helper_cupti_pc_sampling_store.h.
 bool g_allocatedCircularBuffers = false;
 
 // Variables related to context info book keeping.
@@ -123,11 +101,7 @@ std::mutex g_contextInfoMutex;
 std::vector<ContextInfo *> g_contextInfoToFreeInEndVector;
 
 // Variables related to thread which store data in file.
-std::string g_fileName = "pcsampling.dat";
 std::thread g_storeDataInFileThreadHandle;
-std::queue<std::pair<CUpti_PCSamplingData *, ContextInfo *>> g_pcSampDataQueue;
-bool g_waitAtJoin = false;
-std::mutex g_pcSampDataQueueMutex;
 bool g_createdWorkerThread = false;
 std::mutex g_workerThreadMutex;
 
@@ -141,9 +115,6 @@ uint32_t g_samplingPeriod = 0;
 size_t g_scratchBufSize = 0;
 size_t g_hwBufSize = 0;
 size_t g_pcConfigBufRecordCount = 5000;
-size_t g_circularbufCount = 10;
-size_t g_circularbufSize = 500;
-bool g_disableFileDump = false;
 bool g_verbose = false;
 
 bool g_running = false;
@@ -219,140 +190,9 @@ ReadInputParams()
     free(pInjectionParamCopy);
 }
 
-static bool
-GetPcSamplingDataFromCupti(
-    CUpti_PCSamplingGetDataParams &pcSamplingGetDataParams,
-    ContextInfo *pContextInfo)
-{
-    CUpti_PCSamplingData *pPcSamplingData = NULL;
-
-    g_circularBufferMutex.lock();
-    while (g_bufferEmptyTrackerArray[g_put])
-    {
-        g_buffersGetUtilisedFasterThanStore = true;
-    }
-
-    pcSamplingGetDataParams.pcSamplingData = (void *)&g_circularBuffer[g_put];
-    pPcSamplingData = &g_circularBuffer[g_put];
-
-    if (!g_disableFileDump)
-    {
-        g_bufferEmptyTrackerArray[g_put] = true;
-        g_put = (g_put + 1) % g_circularbufCount;
-    }
-    g_circularBufferMutex.unlock();
-
-    CUptiResult cuptiStatus = cuptiPCSamplingGetData(&pcSamplingGetDataParams);
-    if (cuptiStatus != CUPTI_SUCCESS)
-    {
-        CUpti_PCSamplingData *samplingData = (CUpti_PCSamplingData*)pcSamplingGetDataParams.pcSamplingData;
-        if (samplingData->hardwareBufferFull)
-        {
-            printf("ERROR!! hardware buffer is full, need to increase hardware buffer size or frequency of pc sample data decoding\n");
-            return false;
-        }
-    }
-
-    if (!g_disableFileDump)
-    {
-        g_pcSampDataQueueMutex.lock();
-        g_pcSampDataQueue.push(std::make_pair(pPcSamplingData, pContextInfo));
-        g_pcSampDataQueueMutex.unlock();
-    }
-
-    return true;
-}
-
-static void
-StorePcSampDataInFile()
-{
-    CUptiUtilResult utilResult;
-    ContextInfo *pContextInfo;
-    CUpti_PCSamplingData *pcSamplingData;
-
-    g_pcSampDataQueueMutex.lock();
-    pcSamplingData = g_pcSampDataQueue.front().first;
-    pContextInfo = g_pcSampDataQueue.front().second;
-    g_pcSampDataQueue.pop();
-    g_pcSampDataQueueMutex.unlock();
-
-    std::string file = std::to_string((long int)pContextInfo->contextUid) + "_" + g_fileName;
-
-    CUptiUtil_PutPcSampDataParams pPutPcSampDataParams = {};
-    pPutPcSampDataParams.size = CUptiUtil_PutPcSampDataParamsSize;
-    pPutPcSampDataParams.bufferType = PC_SAMPLING_BUFFER_PC_TO_COUNTER_DATA;
-    pPutPcSampDataParams.pSamplingData = (void*)pcSamplingData;
-    pPutPcSampDataParams.numAttributes = pContextInfo->pcSamplingConfigurationInfo.size();
-    pPutPcSampDataParams.pPCSamplingConfigurationInfo = pContextInfo->pcSamplingConfigurationInfo.data();
-    pPutPcSampDataParams.pPcSamplingStallReasons = &pContextInfo->pcSamplingStallReasons;
-    pPutPcSampDataParams.fileName = file.c_str();
-
-    utilResult = CuptiUtilPutPcSampData(&pPutPcSampDataParams);
-    if (utilResult != CUPTI_UTIL_SUCCESS)
-    {
-        std::cout << "error in StorePcSampDataInFile(), failed with error : " << utilResult << std::endl;
-        exit (EXIT_FAILURE);
-    }
-    for (size_t i = 0; i < pcSamplingData->totalNumPcs; i++)
-    {
-        functions.insert(pcSamplingData->pPcData[i].functionName);
-    }
-    g_bufferEmptyTrackerArray[g_get] = false;
-    g_get = (g_get + 1) % g_circularbufCount;
-}
-
-static void
-StorePcSampDataInFileThread()
-{
-    while (1)
-    {
-        if (g_waitAtJoin)
-        {
-            while (!g_pcSampDataQueue.empty())
-            {
-                StorePcSampDataInFile();
-            }
-            break;
-        }
-        else
-        {
-            while (!g_pcSampDataQueue.empty())
-            {
-                StorePcSampDataInFile();
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(THREAD_SLEEP_TIME));
-        }
-    }
-}
-
-static void
-PreallocateBuffersForRecords()
-{
-    for (size_t buffers = 0; buffers < g_circularbufCount; buffers++)
-    {
-        g_circularBuffer[buffers].size = sizeof(CUpti_PCSamplingData);
-        g_circularBuffer[buffers].collectNumPcs = g_circularbufSize;
-        g_circularBuffer[buffers].pPcData = (CUpti_PCSamplingPCData *)malloc(g_circularBuffer[buffers].collectNumPcs * sizeof(CUpti_PCSamplingPCData));
-        MEMORY_ALLOCATION_CALL(g_circularBuffer[buffers].pPcData);
-        for (size_t i = 0; i < g_circularBuffer[buffers].collectNumPcs; i++)
-        {
-            g_circularBuffer[buffers].pPcData[i].stallReason = (CUpti_PCSamplingStallReason *)malloc(stallReasonsCount * sizeof(CUpti_PCSamplingStallReason));
-            MEMORY_ALLOCATION_CALL(g_circularBuffer[buffers].pPcData[i].stallReason);
-        }
-    }
-}
-
 static void FreePreallocatedMemory()
 {
-    for (size_t buffers = 0; buffers < g_circularbufCount; buffers++)
-    {
-        for (size_t i = 0; i < g_circularBuffer[buffers].collectNumPcs; i++)
-        {
-            free(g_circularBuffer[buffers].pPcData[i].stallReason);
-        }
-
-        free(g_circularBuffer[buffers].pPcData);
-    }
+    FreeCircularBuffers();
 
     for (auto& itr: g_contextInfoMap)
     {
@@ -392,11 +232,7 @@ static void FreePreallocatedMemory()
         free(itr);
     }
 
-    for (auto it = functions.begin(); it != functions.end(); ++it)
-    {
-        free(*it);
-    }
-    functions.clear();
+    FreeStoredFunctionNames();
 }
 
 void
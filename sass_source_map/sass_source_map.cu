@@ -2,6 +2,11 @@
  * Copyright 2014-2022 NVIDIA Corporation. All rights reserved
  *
  * Sample CUPTI app to print sass to source correlation
+ *
+ * The cubin of every loaded module is stored once, named by its CRC, in a
+ * content-addressed directory (CUPTI_MODULE_STORE_DIR, default
+ * sass_source_map_cubins) by a writer thread, and the module load, unload and
+ * JIT times are summarized at the end (helper_cupti_module_store.h).
  */
 
 // System headers
@@ -15,14 +20,18 @@
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_module_store.h"
 
 // Macros
-#define DUMP_CUBIN 0
+#define MODULE_STORE_DIRECTORY "sass_source_map_cubins"
 
 // Global variables
 const int TileDim   = 32;
 const int BlockRows = 8;
 
+// Cubins of the loaded modules and their load costs.
+static ModuleStore s_moduleStore;
+
 // Kernels
 __global__
 void Transpose(
@@ -51,52 +60,15 @@ void Transpose(
 }
 
 // Functions
-static void
-DumpCudaModule(
-    CUpti_CallbackId callbackId,
-    void *pResourceDescriptor)
-{
-#if DUMP_CUBIN
-    const char *pCubin;
-    size_t cubinSize;
-
-    // Dump the cubin at MODULE_LOADED_STARTING.
-    CUpti_ModuleResourceData *pModuleResourceData = (CUpti_ModuleResourceData *)pResourceDescriptor;
-#endif
-
-    if (callbackId == CUPTI_CBID_RESOURCE_MODULE_LOADED)
-    {
-#if DUMP_CUBIN
-        // You can use nvdisasm to dump the SASS from the cubin.
-        // Try nvdisasm -b -fun <function_id> sass_to_source.cubin
-        pCubin    = pModuleResourceData->pCubin;
-        cubinSize = pModuleResourceData->cubinSize;
-
-        FILE *pCubinFileHandle;
-        pCubinFileHandle = fopen("sass_source_map.cubin", "wb");
-        fwrite(pCubin, sizeof(uint8_t), cubinSize, pCubinFileHandle);
-        fclose(pCubinFileHandle);
-#endif
-    }
-    else if (callbackId == CUPTI_CBID_RESOURCE_MODULE_UNLOAD_STARTING)
-    {
-        // You can dump the cubin either at MODULE_LOADED or MODULE_UNLOAD_STARTING.
-    }
-}
-
 static void
 HandleResource(
     CUpti_CallbackId callbackId,
     const CUpti_ResourceData *pResourceData)
 {
-    if (callbackId == CUPTI_CBID_RESOURCE_MODULE_LOADED)
-    {
-        DumpCudaModule(callbackId, pResourceData->resourceDescriptor);
-    }
-    else if (callbackId == CUPTI_CBID_RESOURCE_MODULE_UNLOAD_STARTING)
-    {
-        DumpCudaModule(callbackId, pResourceData->resourceDescriptor);
-    }
+    // Store the cubin at MODULE_LOADED, the cubin pointer is only valid during the callback.
+    // You can use nvdisasm to dump the SASS from the cubin.
+    // Try nvdisasm -b -fun <function_id> sass_source_map_cubins/<cubinCrc>.cubin
+    ModuleStoreHandleResource(&s_moduleStore, callbackId, pResourceData);
 }
 
 void CUPTIAPI
@@ -117,11 +89,22 @@ TraceCallback(
         case CUPTI_CB_DOMAIN_RESOURCE:
             HandleResource(callbackId, (CUpti_ResourceData *)pCallbackData);
             break;
+        case CUPTI_CB_DOMAIN_DRIVER_API:
+            // Time the driver API calls loading modules, explicitly or lazily at the first launch.
+            ModuleStoreHandleDriverApi(&s_moduleStore, callbackId, (CUpti_CallbackData *)pCallbackData);
+            break;
         default:
             break;
     }
 }
 
+static void
+ModuleStoreRecords(
+    CUpti_Activity *pRecord)
+{
+    ModuleStoreAddRecord(&s_moduleStore, pRecord);
+}
+
 static void
 SetupCupti()
 {
@@ -129,14 +112,19 @@ SetupCupti()
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
-    pUserData->pPostProcessActivityRecords = NULL;
+    pUserData->pPostProcessActivityRecords = ModuleStoreRecords;
     pUserData->printActivityRecords        = 1;
 
     // Common CUPTI Initialization.
     InitCuptiTrace(pUserData, (void *)TraceCallback, stdout);
 
+    const char *pDirectory = getenv("CUPTI_MODULE_STORE_DIR");
+    InitModuleStore(&s_moduleStore, pDirectory ? pDirectory : MODULE_STORE_DIRECTORY, MODULE_STORE_DEFAULT_QUEUE_BYTES);
+
     CUPTI_API_CALL_VERBOSE(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_INSTRUCTION_EXECUTION));
+    CUPTI_API_CALL_VERBOSE(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_JIT));
     CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_RESOURCE));
+    CUPTI_API_CALL_VERBOSE(cuptiEnableDomain(1, globals.subscriberHandle, CUPTI_CB_DOMAIN_DRIVER_API));
 }
 
 int
@@ -220,6 +208,9 @@ main(
 
     DeInitCuptiTrace();
 
+    PrintModuleStoreReport(&s_moduleStore, stdout);
+    FreeModuleStore(&s_moduleStore);
+
     exit(EXIT_SUCCESS);
 }
 
@@ -3,6 +3,13 @@
  *
  * Sample CUPTI app to demonstrate the usage of unified memory counter profiling
  *
+ * The counter records and the kernel records are also fed to the heatmap of
+ * helper_cupti_uvm_heatmap.h, which reports the hot address ranges, the
+ * ranges migrated back and forth between the CPU and the GPU and the bytes
+ * migrated during every kernel. The address bins are 2 MB, set
+ * UVM_HEATMAP_BIN_SIZE to another power of two (e.g. 4096) to change it, and
+ * UVM_HEATMAP_CSV to a file name to write every cell of the heatmap.
+ *
  */
 
 // System headers
@@ -16,6 +23,13 @@
 
 // CUPTI headers
 #include "helper_cupti_activity.h"
+#include "helper_cupti_uvm_heatmap.h"
+
+// Macros
+#define NUM_ITERATIONS 4                                             // CPU and GPU accesses, migrating the data back and forth.
+
+// Global variables
+static UvmHeatmap s_UvmHeatmap;
 
 template<class T>
 __host__ __device__ void
@@ -64,24 +78,77 @@ TestKernel(
 }
 
 // Functions
+static void
+UvmHeatmapPostProcessRecord(
+    CUpti_Activity *pRecord)
+{
+    UvmHeatmapAddRecord(&s_UvmHeatmap, pRecord);
+}
+
+static void
+SetupUvmHeatmap()
+{
+    uint32_t binShift = UVM_HEATMAP_DEFAULT_BIN_SHIFT;
+    const char *pBinSize = getenv("UVM_HEATMAP_BIN_SIZE");
+
+    if (pBinSize)
+    {
+        unsigned long long binSize = strtoull(pBinSize, NULL, 0);
+
+        if (binSize == 0 || (binSize & (binSize - 1)))
+        {
+            printf("Warning: UVM_HEATMAP_BIN_SIZE %s is not a power of two, using 2 MB bins.\n", pBinSize);
+        }
+        else
+        {
+            for (binShift = 0; (1ULL << binShift) < binSize; binShift++);
+        }
+    }
+
+    InitUvmHeatmap(&s_UvmHeatmap, binShift, UVM_HEATMAP_DEFAULT_WINDOW_NS, UVM_HEATMAP_DEFAULT_BOUNCE_NS);
+}
+
 static void
 SetupCupti()
 {
     CUptiResult cuptiResult;
-    CUpti_ActivityUnifiedMemoryCounterConfig config[2];
+    CUpti_ActivityUnifiedMemoryCounterKind counterKinds[] =
+    {
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_CPU_PAGE_FAULT_COUNT,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_GPU_PAGE_FAULT,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THRASHING,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_THROTTLING,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_REMOTE_MAP,
+        CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOD
+    };
+    const uint32_t numCounters = sizeof(counterKinds) / sizeof(counterKinds[0]);
+    CUpti_ActivityUnifiedMemoryCounterConfig config[numCounters];
+
+    // Configure Unified memory counters, the byte counters first.
+    for (uint32_t i = 0; i < numCounters; i++)
+    {
+        config[i].scope = CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_SCOPE_PROCESS_SINGLE_DEVICE;
+        config[i].kind = counterKinds[i];
+        config[i].deviceId = 0;
+        config[i].enable = 1;
+    }
 
-    // Configure Unified memory counters.
-    config[0].scope = CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_SCOPE_PROCESS_SINGLE_DEVICE;
-    config[0].kind = CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_HTOD;
-    config[0].deviceId = 0;
-    config[0].enable = 1;
+    cuptiResult = cuptiActivityConfigureUnifiedMemoryCounter(config, numCounters);
+    if (cuptiResult != CUPTI_SUCCESS &&
+        cuptiResult != CUPTI_ERROR_UM_PROFILING_NOT_SUPPORTED &&
+        cuptiResult != CUPTI_ERROR_UM_PROFILING_NOT_SUPPORTED_ON_DEVICE &&
+        cuptiResult != CUPTI_ERROR_UM_PROFILING_NOT_SUPPORTED_ON_NON_P2P_DEVICES)
+    {
+        // The fault, thrashing, throttling and remote map counters are not available on every platform.
+        const char *pErrorString;
+        cuptiGetResultString(cuptiResult, &pErrorString);
+        printf("Warning: Failed to configure the page fault counters (%s), profiling the transferred bytes only.\n", pErrorString);
 
-    config[1].scope = CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_SCOPE_PROCESS_SINGLE_DEVICE;
-    config[1].kind = CUPTI_ACTIVITY_UNIFIED_MEMORY_COUNTER_KIND_BYTES_TRANSFER_DTOH;
-    config[1].deviceId = 0;
-    config[1].enable = 1;
+        cuptiResult = cuptiActivityConfigureUnifiedMemoryCounter(config, 2);
+    }
 
-    cuptiResult = cuptiActivityConfigureUnifiedMemoryCounter(config, 2);
     if (cuptiResult == CUPTI_ERROR_UM_PROFILING_NOT_SUPPORTED)
     {
         printf("Warning: Unified memory is not supported on the underlying platform. Waiving sample.\n");
@@ -106,14 +173,17 @@ SetupCupti()
     MEMORY_ALLOCATION_CALL(pUserData);
 
     memset(pUserData, 0, sizeof(UserData));
-    pUserData->pPostProcessActivityRecords = NULL;
+    pUserData->pPostProcessActivityRecords = UvmHeatmapPostProcessRecord;
     pUserData->printActivityRecords        = 1;
 
+    SetupUvmHeatmap();
+
     // Common CUPTI Initialization.
     InitCuptiTrace(pUserData, NULL, stdout);
 
-    // Enable unified memory counter activity.
+    // Enable unified memory counter activity, and the kernels to attribute the migrations to.
     CUPTI_API_CALL_VERBOSE(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER));
+    CUPTI_API_CALL_VERBOSE(cuptiActivityEnable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL));
 }
 
 int
@@ -142,26 +212,49 @@ main(
     printf("Allocation size in bytes %d\n", size);
     RUNTIME_API_CALL(cudaMallocManaged(&pData, size));
 
-    // CPU access.
-    WriteData(pData, size, i);
+    for (int iteration = 0; iteration < NUM_ITERATIONS; iteration++)
+    {
+        // CPU access.
+        WriteData(pData, size, i);
 
-    // Kernel launch.
-    TestKernel<<< 1, 1 >>> (pData, size, i);
-    RUNTIME_API_CALL(cudaGetLastError());
-    RUNTIME_API_CALL(cudaDeviceSynchronize());
+        // Kernel launch.
+        TestKernel<<< 1, 1 >>> (pData, size, i);
+        RUNTIME_API_CALL(cudaGetLastError());
+        RUNTIME_API_CALL(cudaDeviceSynchronize());
 
-    // CPU access.
-    CheckData("CPU", pData, size, -i);
+        // CPU access.
+        CheckData("CPU", pData, size, -i);
+    }
 
     // Free unified memory.
     RUNTIME_API_CALL(cudaFree(pData));
 
     // Disable unified memory counter activity.
     CUPTI_API_CALL_VERBOSE(cuptiActivityDisable(CUPTI_ACTIVITY_KIND_UNIFIED_MEMORY_COUNTER));
+    CUPTI_API_CALL_VERBOSE(cuptiActivityDisable(CUPTI_ACTIVITY_KIND_CONCURRENT_KERNEL));
 
     RUNTIME_API_CALL(cudaDeviceReset());
 
     DeInitCuptiTrace();
 
+    PrintUvmHeatmapReport(&s_UvmHeatmap, stdout);
+
+    const char *pCsvFileName = getenv("UVM_HEATMAP_CSV");
+    if (pCsvFileName)
+    {
+        FILE *pCsvFile = fopen(pCsvFileName, "w");
+        if (pCsvFile)
+        {
+            WriteUvmHeatmapCsv(&s_UvmHeatmap, pCsvFile);
+            fclose(pCsvFile);
+        }
+        else
+        {
+            printf("Warning: Failed to open %s.\n", pCsvFileName);
+        }
+    }
+
+    FreeUvmHeatmap(&s_UvmHeatmap);
+
     exit(EXIT_SUCCESS);
 }